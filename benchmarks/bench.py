@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+#  Copyright 2022 Google LLC.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""Build and time every benchmark, and flag regressions against a baseline.
+
+Each .rn benchmark is built in each mode below, and C and C++ twins with
+clang -O3.  Every executable is run --warmup times untimed, then --runs times,
+recording the median wall time, the peak RSS, and for Rune programs, the
+array heap allocations the runtime writes to $RUNE_HEAP_STATS at exit.
+Results are written as JSON.  With --baseline, a benchmark whose median time
+grew by more than --threshold is reported, and the exit status is 1.
+
+  python3 bench.py --runs 5 --output results.json --baseline baseline.json
+"""
+
+import argparse
+import glob
+import json
+import os
+import platform
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+# Compiler flags for each build mode.
+MODES = {
+    "safe": [],
+    "unsafe": ["-U"],
+    "optimized": ["-O"],
+    "unsafe_optimized": ["-U", "-O"],
+}
+
+# C and C++ programs doing the same work as a Rune benchmark.
+TWINS = {
+    "binary_trees": ["binary_trees.cc", "binary_trees2.cc"],
+    "fh": ["priority_queue.cc"],
+    "string_find": ["string_find.c"],
+}
+
+# Arguments giving each program enough work to time.  The twins get the same
+# arguments as their Rune benchmark.
+ARGS = {
+    "binary_trees": ["16"],
+    "fannkuch_redux": ["10"],
+    "mandelbrot": ["4000"],
+    "mandelbrot_parallel": ["4000"],
+}
+
+
+def runBuild(command):
+  """Run a build command, returning True if it succeeded."""
+  try:
+    return subprocess.run(command, stdout=subprocess.DEVNULL).returncode == 0
+  except OSError as e:
+    print("Unable to run %s: %s" % (command[0], e), file=sys.stderr)
+    return False
+
+
+def build(args, buildDir):
+  """Build the executables, returning a list of (name, exe, argv, isRune)."""
+  runes = sorted(glob.glob("*.rn"))
+  if args.only:
+    runes = [rn for rn in runes if rn[:-3] in args.only]
+  executables = []
+  for rn in runes:
+    name = rn[:-3]
+    benchArgs = ARGS.get(name, [])
+    for mode in args.modes:
+      exe = os.path.join(buildDir, "%s_%s" % (name, mode))
+      command = [args.rune] + MODES[mode] + ["-l", exe + ".ll", rn]
+      if not runBuild(command):
+        print("Failed to build %s in %s mode" % (rn, mode), file=sys.stderr)
+        continue
+      checkOutput(name, exe)
+      executables.append(("%s/%s" % (name, mode), exe, benchArgs, True))
+    for twin in TWINS.get(name, []):
+      base, ext = os.path.splitext(twin)
+      exe = os.path.join(buildDir, base + "_cc")
+      compiler = "clang++" if ext == ".cc" else "clang"
+      command = [compiler, "-O3", "-o", exe, twin]
+      if not runBuild(command):
+        print("Failed to build %s" % twin, file=sys.stderr)
+        continue
+      executables.append(("%s/%s" % (name, base + ext.replace(".", "_")), exe, benchArgs,
+                          False))
+  return executables
+
+
+def checkOutput(name, exe):
+  """Warn if the program's output with no arguments differs from name.stdout."""
+  expectedFile = name + ".stdout"
+  if not os.path.exists(expectedFile):
+    return
+  with open(expectedFile, "rb") as f:
+    expected = f.read()
+  output = subprocess.run([exe], stdout=subprocess.PIPE).stdout
+  if output != expected:
+    print("Warning: %s output differs from %s" % (exe, expectedFile), file=sys.stderr)
+
+
+def runOnce(exe, argv, statsFile):
+  """Run the executable, returning (wall seconds, max RSS in KiB, heap stats)."""
+  env = dict(os.environ)
+  if statsFile:
+    env["RUNE_HEAP_STATS"] = statsFile
+  start = time.perf_counter()
+  process = subprocess.Popen([exe] + argv, stdout=subprocess.DEVNULL, env=env)
+  _, status, usage = os.wait4(process.pid, 0)
+  wallTime = time.perf_counter() - start
+  # wait4 reaped the process, so tell Popen not to wait for it again.
+  process.returncode = os.waitstatus_to_exitcode(status)
+  if process.returncode != 0:
+    raise RuntimeError("%s exited with status %d" % (exe, process.returncode))
+  stats = {}
+  if statsFile and os.path.exists(statsFile):
+    with open(statsFile) as f:
+      stats = json.load(f)
+    os.remove(statsFile)
+  # ru_maxrss is in KiB on Linux, and bytes on macOS.
+  maxRss = usage.ru_maxrss
+  if sys.platform == "darwin":
+    maxRss //= 1024
+  return wallTime, maxRss, stats
+
+
+def measure(args, executables, buildDir):
+  results = {}
+  for key, exe, argv, isRune in executables:
+    statsFile = os.path.join(buildDir, "heap_stats.json") if isRune else None
+    try:
+      for _ in range(args.warmup):
+        runOnce(exe, argv, statsFile)
+      times = []
+      maxRss = 0
+      stats = {}
+      for _ in range(args.runs):
+        wallTime, rss, stats = runOnce(exe, argv, statsFile)
+        times.append(wallTime)
+        maxRss = max(maxRss, rss)
+    except RuntimeError as e:
+      print(e, file=sys.stderr)
+      continue
+    result = {
+        "medianSeconds": statistics.median(times),
+        "minSeconds": min(times),
+        "maxSeconds": max(times),
+        "maxRssKiB": maxRss,
+    }
+    result.update(stats)
+    results[key] = result
+    print("%-40s %8.3fs %8d KiB" % (key, result["medianSeconds"], maxRss))
+  return results
+
+
+def findRegressions(results, baseline, threshold):
+  """Return a description of each benchmark slower than its baseline."""
+  regressions = []
+  for key, result in sorted(results.items()):
+    old = baseline.get("results", {}).get(key)
+    if old is None:
+      continue
+    ratio = result["medianSeconds"] / old["medianSeconds"]
+    if ratio > 1.0 + threshold:
+      regressions.append("%s: %.3fs vs %.3fs baseline, %.0f%% slower" % (
+          key, result["medianSeconds"], old["medianSeconds"], (ratio - 1.0) * 100))
+  return regressions
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__,
+                                   formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument("--rune", default="../rune", help="The Rune compiler.")
+  parser.add_argument("--runs", type=int, default=5, help="Timed runs of each program.")
+  parser.add_argument("--warmup", type=int, default=1, help="Untimed runs first.")
+  parser.add_argument("--modes", default=",".join(MODES),
+                      help="Comma separated build modes, from: " + ", ".join(MODES))
+  parser.add_argument("--only", help="Comma separated benchmarks to run.")
+  parser.add_argument("--output", default="results.json", help="JSON results file.")
+  parser.add_argument("--baseline", help="JSON results to compare against.")
+  parser.add_argument("--threshold", type=float, default=0.1,
+                      help="Fraction slower than the baseline that is a regression.")
+  parser.add_argument("--update-baseline", action="store_true",
+                      help="Also write the results to the --baseline file.")
+  args = parser.parse_args()
+  args.modes = args.modes.split(",")
+  for mode in args.modes:
+    if mode not in MODES:
+      parser.error("Unknown mode %s" % mode)
+  if args.only:
+    args.only = args.only.split(",")
+  os.chdir(os.path.dirname(os.path.abspath(__file__)))
+  with tempfile.TemporaryDirectory(prefix="rune_bench") as buildDir:
+    executables = build(args, buildDir)
+    results = measure(args, executables, buildDir)
+  report = {
+      "machine": platform.machine(),
+      "system": platform.platform(),
+      "processors": os.cpu_count(),
+      "runs": args.runs,
+      "warmup": args.warmup,
+      "results": results,
+  }
+  with open(args.output, "w") as f:
+    json.dump(report, f, indent=2, sort_keys=True)
+    f.write("\n")
+  status = 0
+  if args.baseline and os.path.exists(args.baseline) and not args.update_baseline:
+    with open(args.baseline) as f:
+      baseline = json.load(f)
+    regressions = findRegressions(results, baseline, args.threshold)
+    for regression in regressions:
+      print("Regression: " + regression)
+    if regressions:
+      status = 1
+  if args.baseline and args.update_baseline:
+    with open(args.baseline, "w") as f:
+      json.dump(report, f, indent=2, sort_keys=True)
+      f.write("\n")
+  return status
+
+
+if __name__ == "__main__":
+  sys.exit(main())
@@ -0,0 +1,46 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Write a Rune program that stresses datatype and signature creation in the
+// binder: each generated function calls the same small generic functions with
+// a different combination of integer widths, so every call binds new tuple,
+// array and function signatures.  "make compile_time" times compiling it.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+  int numFuncs = argc > 1? atoi(argv[1]) : 2000;
+  printf("func pair(a, b) {\n"
+         "  return (a, b)\n"
+         "}\n\n"
+         "func nest(a, b, c) {\n"
+         "  return pair(pair(a, b), pair(c, [a]))\n"
+         "}\n\n");
+  for (int i = 0; i < numFuncs; i++) {
+    int w1 = i % 64 + 1;
+    int w2 = (i / 64) % 64 + 1;
+    int w3 = (i * 7) % 64 + 1;
+    printf("func f%d() {\n"
+           "  t = nest(1u%d, 0i%d, (1u%d, \"s%d\"))\n"
+           "  return t[0][0]\n"
+           "}\n\n", i, w1, w2, w3, i);
+  }
+  printf("total = 0u64\n");
+  for (int i = 0; i < numFuncs; i++) {
+    printf("total += <u64>f%d()\n", i);
+  }
+  printf("println total\n");
+  return 0;
+}
@@ -0,0 +1,62 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Write a Rune program that stresses iterator inlining: one function runs
+// thousands of loops over builtin and user defined iterators, so the inliner
+// renames conflicting iterator variables and binds inlined code many times, and
+// a generic class is instantiated with many parameter types.  "make
+// iter_compile_time" times compiling it.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+  int numLoops = argc > 1? atoi(argv[1]) : 10000;
+  printf("class Counter(self, end) {\n"
+         "  self.end = end\n\n"
+         "  iterator values(self) {\n"
+         "    for i = 0, i < self.end, i += 1 {\n"
+         "      yield i\n"
+         "    }\n"
+         "  }\n"
+         "}\n\n"
+         "class Box(self, <value>) {\n"
+         "  self.value = value\n"
+         "}\n\n"
+         "func run() {\n"
+         "  total = 0u64\n");
+  for (int i = 0; i < numLoops; i++) {
+    int width = i % 64 + 1;
+    switch (i % 3) {
+    case 0:
+      printf("  for j in range(%d) {\n"
+             "    total += <u64>j\n"
+             "  }\n", i % 7 + 1);
+      break;
+    case 1:
+      printf("  for v in Counter(%d) {\n"
+             "    total += <u64>v\n"
+             "  }\n", i % 5 + 1);
+      break;
+    default:
+      printf("  box%d = Box(%du%d)\n"
+             "  total += <u64>box%d.value\n", i, i % 3, width, i);
+      break;
+    }
+  }
+  printf("  return total\n"
+         "}\n\n"
+         "println run()\n");
+  return 0;
+}
@@ -0,0 +1,162 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Time runtime_bigintModularInverse against the previous extended Euclidean
+// implementation, for public and secret values mod 2^255 - 19 and the
+// Mersenne prime 2^2203 - 1.
+
+#define _POSIX_C_SOURCE 199309L
+#include "runtime.h"
+#include <stdio.h>
+#include <time.h>
+
+// Return the time in seconds.
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Copy a bigint of the same type.
+static void copyBigint(runtime_array *dest, runtime_array *source) {
+  runtime_bigintCast(dest, source, runtime_bigintWidth(source), runtime_bigintSigned(source),
+      runtime_bigintSecret(source), false);
+}
+
+// The previous runtime_bigintModularInverse: extended Euclid, with one
+// constant time division per step.
+static void oldModularInverse(runtime_array *dest, runtime_array *source, runtime_array *modulus) {
+  uint32_t width = runtime_bigintWidth(modulus);
+  bool secret = runtime_bigintSecret(source);
+  runtime_array signedModulus = runtime_makeEmptyArray();
+  runtime_array a = runtime_makeEmptyArray();
+  runtime_array b = runtime_makeEmptyArray();
+  runtime_array x = runtime_makeEmptyArray();
+  runtime_array y = runtime_makeEmptyArray();
+  runtime_array u = runtime_makeEmptyArray();
+  runtime_array v = runtime_makeEmptyArray();
+  runtime_array q = runtime_makeEmptyArray();
+  runtime_array r = runtime_makeEmptyArray();
+  runtime_array n = runtime_makeEmptyArray();
+  runtime_array m = runtime_makeEmptyArray();
+  runtime_array t = runtime_makeEmptyArray();
+  runtime_bigintCast(&signedModulus, modulus, width + 1, true, false, false);
+  runtime_bigintCast(&a, source, width + 1, true, secret, false);
+  copyBigint(&b, &signedModulus);
+  runtime_integerToBigint(&x, 0, width + 1, true, false);
+  runtime_integerToBigint(&y, 1, width + 1, true, false);
+  runtime_integerToBigint(&u, 1, width + 1, true, false);
+  runtime_integerToBigint(&v, 0, width + 1, true, false);
+  while (!runtime_rnBoolToBool(runtime_bigintZero(&a))) {
+    runtime_bigintDivRem(&q, &r, &b, &a);
+    runtime_bigintMul(&t, &u, &q);
+    runtime_bigintSub(&m, &x, &t);
+    runtime_bigintMul(&t, &v, &q);
+    runtime_bigintSub(&n, &y, &t);
+    copyBigint(&t, &b);
+    copyBigint(&b, &a);
+    copyBigint(&a, &r);
+    copyBigint(&r, &t);
+    copyBigint(&t, &x);
+    copyBigint(&x, &u);
+    copyBigint(&u, &m);
+    copyBigint(&m, &t);
+    copyBigint(&t, &y);
+    copyBigint(&y, &v);
+    copyBigint(&v, &n);
+    copyBigint(&n, &t);
+  }
+  if (runtime_rnBoolToBool(runtime_bigintNegative(&x))) {
+    runtime_bigintAdd(&x, &x, &signedModulus);
+  }
+  runtime_bigintCast(dest, &x, width, false, secret, false);
+  runtime_freeArray(&signedModulus);
+  runtime_freeArray(&a);
+  runtime_freeArray(&b);
+  runtime_freeArray(&x);
+  runtime_freeArray(&y);
+  runtime_freeArray(&u);
+  runtime_freeArray(&v);
+  runtime_freeArray(&q);
+  runtime_freeArray(&r);
+  runtime_freeArray(&n);
+  runtime_freeArray(&m);
+  runtime_freeArray(&t);
+}
+
+// Set |modulus| to 2^width - c.
+static void initModulus(runtime_array *modulus, uint32_t width, uint64_t c) {
+  runtime_array power = runtime_makeEmptyArray();
+  runtime_array small = runtime_makeEmptyArray();
+  runtime_integerToBigint(&power, 2, width + 1, false, false);
+  runtime_bigintExp(&power, &power, width);
+  runtime_integerToBigint(&small, c, width + 1, false, false);
+  runtime_bigintSub(&power, &power, &small);
+  runtime_bigintCast(modulus, &power, width, false, false, false);
+  runtime_freeArray(&power);
+  runtime_freeArray(&small);
+}
+
+// Time |numInverses| inverses of random values with the old and new code,
+// checking that they agree.
+static void timeInverses(const char *name, uint32_t width, uint64_t c, uint32_t numInverses) {
+  runtime_array modulus = runtime_makeEmptyArray();
+  runtime_array values[numInverses];
+  runtime_array oldInverse = runtime_makeEmptyArray();
+  runtime_array newInverse = runtime_makeEmptyArray();
+  initModulus(&modulus, width, c);
+  for (uint32_t i = 0; i < numInverses; i++) {
+    values[i] = runtime_makeEmptyArray();
+    runtime_array bits = runtime_makeEmptyArray();
+    runtime_generateTrueRandomBigint(&bits, width - 1);
+    runtime_bigintCast(&values[i], &bits, width, false, false, false);
+    runtime_freeArray(&bits);
+  }
+  for (uint32_t secret = 0; secret < 2; secret++) {
+    for (uint32_t i = 0; i < numInverses; i++) {
+      runtime_bigintSetSecret(&values[i], secret);
+    }
+    double start = now();
+    for (uint32_t i = 0; i < numInverses; i++) {
+      oldModularInverse(&oldInverse, &values[i], &modulus);
+    }
+    double oldTime = now() - start;
+    start = now();
+    for (uint32_t i = 0; i < numInverses; i++) {
+      runtime_bigintModularInverse(&newInverse, &values[i], &modulus);
+    }
+    double newTime = now() - start;
+    // Spot check the last one.
+    oldModularInverse(&oldInverse, &values[numInverses - 1], &modulus);
+    if (!runtime_compareBigints(RN_EQUAL, &oldInverse, &newInverse)) {
+      printf("%s: inverses differ\n", name);
+    }
+    printf("%s %s: old %.1f us, new %.1f us, %.2fX faster\n", name, secret? "secret" : "public",
+        oldTime * 1e6 / numInverses, newTime * 1e6 / numInverses, oldTime / newTime);
+  }
+  for (uint32_t i = 0; i < numInverses; i++) {
+    runtime_freeArray(&values[i]);
+  }
+  runtime_freeArray(&modulus);
+  runtime_freeArray(&oldInverse);
+  runtime_freeArray(&newInverse);
+}
+
+int main(void) {
+  runtime_arrayStart();
+  timeInverses("p25519", 255, 19, 1000);
+  timeInverses("m2203", 2203, 1, 100);
+  runtime_arrayStop();
+  return 0;
+}
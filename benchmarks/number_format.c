@@ -0,0 +1,96 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Time the runtime's integer and float to string conversions against the
+// previous implementations: one array append per digit for integers, and
+// snprintf("%.17g") for doubles.
+
+#define _POSIX_C_SOURCE 199309L
+#include "runtime.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_VALUES 1000000
+
+// Return the time in seconds.
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The previous runtime_nativeIntToString.
+static void oldIntToString(runtime_array *string, uint64_t value) {
+  runtime_freeArray(string);
+  do {
+    uint8_t c = '0' + value % 10;
+    value /= 10;
+    runtime_appendArrayElement(string, &c, sizeof(uint8_t), false, false);
+  } while (value != 0);
+  runtime_reverseArray(string, sizeof(uint8_t), false);
+}
+
+// The previous runtime_f64tostring.
+static void oldDoubleToString(runtime_array *string, double value) {
+  char tmp[64];
+  int len = snprintf(tmp, sizeof(tmp), "%.17g", value);
+  runtime_freeArray(string);
+  runtime_allocArray(string, len, sizeof(uint8_t), false);
+  memcpy(string->data, tmp, len);
+}
+
+// Report the time per conversion for the old and new versions.
+static void report(const char *name, double oldTime, double newTime, uint64_t oldLength,
+    uint64_t newLength) {
+  printf("%s: old %.1f ns, new %.1f ns, %.2fX faster (%lu vs %lu bytes)\n", name,
+      oldTime * 1e9 / NUM_VALUES, newTime * 1e9 / NUM_VALUES, oldTime / newTime,
+      (unsigned long)oldLength, (unsigned long)newLength);
+}
+
+int main(void) {
+  runtime_arrayStart();
+  runtime_array string = runtime_makeEmptyArray();
+  uint64_t seed = 0x9e3779b97f4a7c15ull;
+  uint64_t oldLength = 0, newLength = 0;
+  double start = now();
+  for (uint64_t i = 0; i < NUM_VALUES; i++) {
+    oldIntToString(&string, (seed * i) >> (i & 63));
+    oldLength += string.numElements;
+  }
+  double oldTime = now() - start;
+  start = now();
+  for (uint64_t i = 0; i < NUM_VALUES; i++) {
+    runtime_nativeIntToString(&string, (seed * i) >> (i & 63), 10, false);
+    newLength += string.numElements;
+  }
+  report("u64", oldTime, now() - start, oldLength, newLength);
+  oldLength = 0;
+  newLength = 0;
+  start = now();
+  for (uint64_t i = 0; i < NUM_VALUES; i++) {
+    oldDoubleToString(&string, (double)(seed * i) / (double)(i + 1));
+    oldLength += string.numElements;
+  }
+  oldTime = now() - start;
+  start = now();
+  for (uint64_t i = 0; i < NUM_VALUES; i++) {
+    runtime_f64tostring(&string, (double)(seed * i) / (double)(i + 1));
+    newLength += string.numElements;
+  }
+  report("f64", oldTime, now() - start, oldLength, newLength);
+  runtime_freeArray(&string);
+  runtime_arrayStop();
+  return 0;
+}
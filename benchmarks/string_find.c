@@ -0,0 +1,56 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The same search as string_find.rn, using glibc's memmem, for comparison.
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t countMatches(const char *text, size_t length, const char *needle) {
+  size_t needleLength = strlen(needle);
+  uint64_t count = 0;
+  const char *p = memmem(text, length, needle, needleLength);
+  while (p != NULL) {
+    count++;
+    p++;
+    p = memmem(p, text + length - p, needle, needleLength);
+  }
+  return count;
+}
+
+int main(void) {
+  size_t allocated = 1 << 20;
+  size_t length = 0;
+  char *text = malloc(allocated);
+  for (uint64_t i = 0; i < 200000; i++) {
+    char line[64];
+    int lineLength = snprintf(line, sizeof(line), "GET /index.html status=%s latency=%lu ms\n",
+        i % 1000 == 999? "error" : "ok", (unsigned long)i);
+    if (length + lineLength > allocated) {
+      allocated <<= 1;
+      text = realloc(text, allocated);
+    }
+    memcpy(text + length, line, lineLength);
+    length += lineLength;
+  }
+  for (uint32_t i = 0; i < 10; i++) {
+    printf("%lu %lu\n", (unsigned long)countMatches(text, length, "status=error"),
+        (unsigned long)countMatches(text, length, "GET /index.html status=error latency="));
+  }
+  free(text);
+  return 0;
+}
@@ -169,6 +169,7 @@ static bool instantiateSubExpressions(deExpressionType type) {
   case DE_EXPR_NULL:
   case DE_EXPR_FUNCADDR:
   case DE_EXPR_ARRAYOF:
+  case DE_EXPR_VECTOROF:
   case DE_EXPR_TYPEOF:
   case DE_EXPR_WIDTHOF:
     return false;
@@ -562,7 +563,10 @@ static void removeUnusedVariables(deClass theClass) {
 }
 
 // Bind signatures until done.  This can be called multiple times, to bind new
-// statements and functions.
+// statements and functions.  Binding is serial: DataDraw keeps every object's
+// fields in global arrays that realloc as they grow, so a binding on one thread
+// that creates an expression, variable or datatype could move memory another is
+// reading.  With -j, parsing imports runs in parallel instead.
 void deBindAllSignatures(void) {
   deBinding binding = deRootGetFirstBinding(deTheRoot);
   while (binding != deBindingNull) {
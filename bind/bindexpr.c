@@ -146,6 +146,10 @@ static void bindModintExpression(deBlock scopeBlock, deExpression expression) {
 // datatype.
 static void autocastExpression(deExpression expression, deDatatype datatype) {
   deDatatype oldDatatype = deExpressionGetDatatype(expression);
+  if (deDatatypeIsVector(datatype)) {
+    // Scalars combined with vectors are splatted to every lane.
+    datatype = deDatatypeGetElementType(datatype);
+  }
   if (!deDatatypeIsInteger(oldDatatype) || !deDatatypeIsInteger(datatype)) {
     return;  // We only auto-cast integers without type specifiers to integers.
   }
@@ -343,11 +347,67 @@ static deBindRes bindOverloadedOperator(deBlock scopeBlock, deExpression express
   return bindOverloadedFunctionCall(scopeBlock, operatorFunc, expression, paramTypes);
 }
 
+// Bind a binary operator on vectors.  One operand can be a scalar of the
+// element type, which is splatted to every lane.  Integer lanes wrap rather
+// than throw overflow exceptions, as in SIMD hardware, and cannot be divided.
+// Every operator works lane by lane without branches, so it is constant time.
+static void bindVectorArithmeticExpression(deExpression expression, deDatatype leftType,
+    deDatatype rightType) {
+  bool secret = deDatatypeSecret(leftType) || deDatatypeSecret(rightType);
+  deDatatype vectorType = deDatatypeIsVector(leftType)? leftType : rightType;
+  deDatatype otherType = deDatatypeIsVector(leftType)? rightType : leftType;
+  vectorType = deSetDatatypeSecret(vectorType, false);
+  otherType = deSetDatatypeSecret(otherType, false);
+  if (otherType != vectorType && otherType != deDatatypeGetElementType(vectorType)) {
+    deExprError(expression, "Vector operands must have the same type, or be a lane value:%s",
+        deGetOldVsNewDatatypeStrings(leftType, rightType));
+  }
+  bool isFloat = deDatatypeIsFloat(deDatatypeGetElementType(vectorType));
+  switch (deExpressionGetType(expression)) {
+    case DE_EXPR_ADD:
+    case DE_EXPR_ADD_EQUALS:
+    case DE_EXPR_SUB:
+    case DE_EXPR_SUB_EQUALS:
+    case DE_EXPR_MUL:
+    case DE_EXPR_MUL_EQUALS:
+      break;
+    case DE_EXPR_DIV:
+    case DE_EXPR_DIV_EQUALS:
+      if (!isFloat) {
+        deExprError(expression, "Integer vectors cannot be divided");
+      }
+      break;
+    case DE_EXPR_BITAND:
+    case DE_EXPR_BITAND_EQUALS:
+    case DE_EXPR_BITOR:
+    case DE_EXPR_BITOR_EQUALS:
+    case DE_EXPR_BITXOR:
+    case DE_EXPR_BITXOR_EQUALS:
+    case DE_EXPR_ADDTRUNC:
+    case DE_EXPR_ADDTRUNC_EQUALS:
+    case DE_EXPR_SUBTRUNC:
+    case DE_EXPR_SUBTRUNC_EQUALS:
+    case DE_EXPR_MULTRUNC:
+    case DE_EXPR_MULTRUNC_EQUALS:
+      if (isFloat) {
+        deExprError(expression, "Invalid binary operation on floating point vectors");
+      }
+      break;
+    default:
+      deExprError(expression, "Invalid operator for vectors");
+  }
+  deExpressionSetDatatype(expression, deSetDatatypeSecret(vectorType, secret));
+}
+
 // Bind a binary arithmetic expression.  The left and right types should have
 // the same numeric type, resulting in the same type.
 static void bindBinaryArithmeticExpression(deBlock scopeBlock, deExpression expression) {
   deDatatype leftType, rightType;
   checkBinaryExpression(scopeBlock, expression, &leftType, &rightType, true);
+  if (deDatatypeIsVector(leftType) || deDatatypeIsVector(rightType)) {
+    bindVectorArithmeticExpression(expression, leftType, rightType);
+    return;
+  }
   if (deDatatypeSecret(leftType)) {
     rightType = deSetDatatypeSecret(rightType, true);
   } else if (deDatatypeSecret(rightType)) {
@@ -635,6 +695,7 @@ static void bindNullExpression(deBlock scopeBlock, deExpression expression) {
     case DE_TYPE_FUNCPTR:
     case DE_TYPE_TEMPLATE:
     case DE_TYPE_EXPR:
+    case DE_TYPE_VECTOR:
       break;
     case DE_TYPE_FUNCTION: {
       deFunctionType type = deFunctionGetType(deDatatypeGetFunction(datatype));
@@ -682,14 +743,43 @@ static void bindFunctionPointerExpression(deExpression expression) {
   deExpressionSetDatatype(expression, funcptrType);
 }
 
-// Bind an arrayof expression.
+// Bind an arrayof expression.  With a length, as in arrayof(u8, 32), this is a
+// fixed-sized array, which is stored inline rather than on the heap.
 static void bindArrayofExpression(deBlock scopeBlock, deExpression expression) {
   deDatatype datatype = bindUnaryExpression(scopeBlock, expression);
   datatype = coerceToClassDatatype(datatype);
   if (deDatatypeGetType(datatype) == DE_TYPE_TEMPLATE) {
     deExprError(expression, "Cannot have array of template classes");
   }
-  deExpressionSetDatatype(expression, deArrayDatatypeCreate(datatype));
+  if (deDatatypeContainsVector(datatype)) {
+    deExprError(expression, "Cannot have arrays of vectors: use loadVector and storeVector instead");
+  }
+  deExpression lengthExpr = deExpressionGetNextExpression(deExpressionGetFirstExpression(expression));
+  if (lengthExpr == deExpressionNull) {
+    deExpressionSetDatatype(expression, deArrayDatatypeCreate(datatype));
+    return;
+  }
+  if (deExpressionGetType(lengthExpr) != DE_EXPR_INTEGER) {
+    deExprError(expression, "Fixed array lengths must be constant integers, like arrayof(u8, 32)");
+  }
+  uint32 length = deBigintGetUint32(deExpressionGetBigint(lengthExpr), deExpressionGetLine(lengthExpr));
+  if (length == 0 || length > DE_MAX_FIXED_ARRAY_LENGTH) {
+    deExprError(expression, "Fixed array lengths must be from 1 to %u", DE_MAX_FIXED_ARRAY_LENGTH);
+  }
+  deExpressionSetDatatype(expression, deFixedArrayDatatypeCreate(datatype, length));
+}
+
+// Bind a vectorof expression, like vectorof(f32, 8), which is the same type as
+// f32x8.  The lane count must be a constant power of 2.
+static void bindVectorofExpression(deBlock scopeBlock, deExpression expression) {
+  deDatatype datatype = bindUnaryExpression(scopeBlock, expression);
+  if (!deDatatypeIsValidVectorElement(datatype)) {
+    deExprError(expression, "Vector lanes must be u8-u64, i8-i64, f32 or f64, not %s",
+        deDatatypeGetTypeString(datatype));
+  }
+  deExpression lanesExpr = deExpressionGetNextExpression(deExpressionGetFirstExpression(expression));
+  uint32 lanes = deFindVectorLanes(lanesExpr);
+  deExpressionSetDatatype(expression, deVectorDatatypeCreate(datatype, lanes));
 }
 
 // Bind a typeof expression.
@@ -909,6 +999,9 @@ static void bindEqualityExpression(deBlock scopeBlock, deExpression expression)
           deGetOldVsNewDatatypeStrings(leftType, rightType));
     }
   }
+  if (deDatatypeContainsVector(leftType)) {
+    deExprError(expression, "Vectors cannot be compared: compare their lanes instead");
+  }
   deExpressionSetDatatype(expression, deSetDatatypeSecret(deBoolDatatypeCreate(),
       deDatatypeSecret(leftType)));
 }
@@ -916,6 +1009,14 @@ static void bindEqualityExpression(deBlock scopeBlock, deExpression expression)
 // Bind a negate expression.  The operand must be an integer.
 static void bindUnaryArithmeticExpression(deBlock scopeBlock, deExpression expression) {
   deDatatype childType = bindUnaryExpression(scopeBlock, expression);
+  if (deDatatypeIsVector(childType)) {
+    if (deExpressionGetType(expression) == DE_EXPR_BITNOT &&
+        deDatatypeIsFloat(deDatatypeGetElementType(childType))) {
+      deExprError(expression, "Floating point vectors cannot be complemented");
+    }
+    deExpressionSetDatatype(expression, childType);
+    return;
+  }
   if (!deDatatypeIsInteger(childType) && !deDatatypeIsFloat(childType)) {
     deExprError(expression, "Only integers can be negated");
   }
@@ -950,6 +1051,25 @@ static void verifyCast(deExpression expression, deDatatype leftDatatype,
   }
   deDatatypeType leftType = deDatatypeGetType(leftDatatype);
   deDatatypeType rightType = deDatatypeGetType(rightDatatype);
+  if (leftType == DE_TYPE_VECTOR) {
+    // Scalars are splatted to every lane.  Vectors convert lane by lane.
+    deDatatype elementType = deDatatypeGetElementType(leftDatatype);
+    if (rightType == DE_TYPE_VECTOR) {
+      if (deDatatypeGetWidth(rightDatatype) != deDatatypeGetWidth(leftDatatype)) {
+        deExprError(expression, "Invalid cast: vectors must have the same number of lanes");
+      }
+      return;
+    }
+    if (rightType != DE_TYPE_UINT && rightType != DE_TYPE_INT && rightType != DE_TYPE_FLOAT) {
+      deExprError(expression, "Invalid cast: only numbers can be splatted to vectors");
+    }
+    verifyCast(expression, deSetDatatypeSecret(elementType, deDatatypeSecret(rightDatatype)),
+        rightDatatype, line);
+    return;
+  }
+  if (rightType == DE_TYPE_VECTOR) {
+    deExprError(expression, "Invalid cast: vectors can only be cast to other vectors");
+  }
   if (datatypeIsNumberOrEnumClass(leftType) && datatypeIsNumberOrEnum(rightType)) {
     return;
   }
@@ -1326,11 +1446,30 @@ static void bindIndexExpression(deBlock scopeBlock, deExpression expression) {
     deExprError(expression, "Indexing with a secret is not allowed");
   }
   deDatatypeType type = deDatatypeGetType(leftType);
+  if (type == DE_TYPE_VECTOR) {
+    // Lanes are indexed like fixed arrays: constant indexes are checked here.
+    if (deExpressionGetType(right) == DE_EXPR_INTEGER &&
+        deBigintGetUint32(deExpressionGetBigint(right), deExpressionGetLine(expression)) >=
+            deDatatypeGetWidth(leftType)) {
+      deExprError(expression, "Vector lane index out of bounds");
+    }
+    deDatatype elementType = deSetDatatypeSecret(deDatatypeGetElementType(leftType),
+        deDatatypeSecret(leftType));
+    deExpressionSetDatatype(expression, elementType);
+    deExpressionSetConst(expression, deExpressionConst(left));
+    return;
+  }
   if (type != DE_TYPE_ARRAY && type != DE_TYPE_STRING && type != DE_TYPE_TUPLE &&
       type != DE_TYPE_STRUCT) {
     deExprError(expression, "Index into non-array/non-string/non-tuple type");
   }
-  if (type == DE_TYPE_TUPLE || type == DE_TYPE_STRUCT) {
+  if (deExpressionGetType(right) != DE_EXPR_INTEGER && deDatatypeIsFixedArray(leftType)) {
+    // Fixed-sized arrays get a bounds check against their constant length.
+    if (deDatatypeGetNumTypeList(leftType) == 0) {
+      deExprError(expression, "Index into empty fixed-sized array");
+    }
+    deExpressionSetDatatype(expression, deDatatypeGetiTypeList(leftType, 0));
+  } else if (type == DE_TYPE_TUPLE || type == DE_TYPE_STRUCT) {
     if (deExpressionGetType(right) != DE_EXPR_INTEGER) {
       deExprError(expression,
           "Tuples can only be indexed by constant integers, like y = point[1]");
@@ -1364,6 +1503,7 @@ static deBlock findExpressionSubScope(deExpression expression) {
     case DE_TYPE_ENUM:
     case DE_TYPE_FUNCPTR:
     case DE_TYPE_EXPR:
+    case DE_TYPE_VECTOR:
       deExprError(expression, "Cannot use '.' on  datatype %s", deDatatypeGetTypeString(datatype));
       break;
     case DE_TYPE_CLASS:
@@ -1438,6 +1578,11 @@ static void updateVariable(deBlock scopeBlock, deVariable variable,
     deExprError(expr, "Assigning different type to %s than assigned before:%s",
       deVariableGetName(variable), deGetOldVsNewDatatypeStrings(oldDatatype, newDatatype));
   }
+  if (deBlockGetType(deVariableGetBlock(variable)) == DE_BLOCK_CLASS &&
+      deDatatypeContainsVector(datatype)) {
+    // Member arrays are not aligned for vectors.
+    deExprError(expr, "Class member %s cannot hold vectors", deVariableGetName(variable));
+  }
   deVariableSetDatatype(variable, datatype);
   if ((oldDatatype == deDatatypeNull || !deDatatypeConcrete(oldDatatype)) &&
       deDatatypeConcrete(datatype)) {
@@ -1506,6 +1651,19 @@ static deBindRes bindAssignmentExpression(deBlock scopeBlock, deExpression expre
     deExprError(expression, "Right side of assignment does not return a value.");
   }
   deStatement statement = deExpressionGetStatement(expression);
+  if (statement != deStatementNull && deStatementParallel(statement) &&
+      deDatatypeGetType(valueDatatype) == DE_TYPE_TEMPLATE) {
+    // A parallel for over all objects of a class, like 'parallel for node in Node'.
+    valueDatatype = coerceToClassDatatype(valueDatatype);
+    if (deDatatypeGetType(valueDatatype) != DE_TYPE_CLASS) {
+      deExprError(expression, "Parallel for over a template class must name a concrete class");
+    }
+    deVariable variable = findOrCreateVariable(scopeBlock, access);
+    updateVariable(scopeBlock, variable, valueDatatype, expression);
+    deExpressionSetDatatype(access, valueDatatype);
+    deExpressionSetDatatype(expression, valueDatatype);
+    return DE_BINDRES_OK;
+  }
   if (statement != deStatementNull && deStatementGetType(statement) == DE_STATEMENT_FOREACH) {
     if (addValuesIteratorIfNeeded(scopeBlock, statement)) {
       return DE_BINDRES_REBIND;
@@ -1550,6 +1708,9 @@ static void bindArrayExpression(deBlock scopeBlock, deExpression expression) {
     }
     nextElement = deExpressionGetNextExpression(nextElement);
   }
+  if (deDatatypeContainsVector(datatype)) {
+    deExprError(expression, "Cannot have arrays of vectors: use loadVector and storeVector instead");
+  }
   deDatatype arrayDatatype = deArrayDatatypeCreate(datatype);
   deExpressionSetDatatype(expression, arrayDatatype);
 }
@@ -1836,6 +1997,9 @@ static deBindRes bindExpression(deBlock scopeBlock, deExpression expression, boo
     case DE_EXPR_ARRAYOF:
       bindArrayofExpression(scopeBlock, expression);
       break;
+    case DE_EXPR_VECTOROF:
+      bindVectorofExpression(scopeBlock, expression);
+      break;
       break;
     case DE_EXPR_TYPEOF:
       bindTypeofExpression(scopeBlock, expression);
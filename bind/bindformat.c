@@ -47,6 +47,9 @@ static void checkExpressionIsPrintable(deExpression expression) {
   case DE_TYPE_FUNCPTR:
     deExprError(expression, "Cannot print function pointers");
     break;
+  case DE_TYPE_VECTOR:
+    deExprError(expression, "Cannot print vectors: print their lanes, like v[0]");
+    break;
   }
 }
 
@@ -64,7 +64,11 @@ void deRefineAccessExpressionDatatype(deBlock scopeBlock, deExpression target,
       deExpression indexExpr = deExpressionGetNextExpression(nextTarget);
       deDatatype nextTargetType = deExpressionGetDatatype(nextTarget);
       deDatatype nextValueType;
-      if (deDatatypeGetType(nextTargetType) == DE_TYPE_TUPLE) {
+      if (deDatatypeIsFixedArray(nextTargetType)) {
+        // Like arrays, all elements of a fixed-sized array share one type.
+        nextValueType = deFixedArrayDatatypeCreate(valueType,
+            deDatatypeGetNumTypeList(nextTargetType));
+      } else if (deDatatypeGetType(nextTargetType) == DE_TYPE_TUPLE) {
         deDatatypeArray types = deListDatatypes(target);
         uint32 index = deBigintGetUint32(deExpressionGetBigint(indexExpr), line);
         deDatatypeArraySetiDatatype(types, index, valueType);
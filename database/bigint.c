@@ -251,6 +251,26 @@ bool deBigintsEqual(deBigint bigint1, deBigint bigint2) {
   return deBigintSigned(bigint1) == deBigintSigned(bigint2);
 }
 
+// Compare two bigints of the same width and signedness.  Return -1 if
+// |bigint1| is less than |bigint2|, 0 if they are equal, and 1 if greater.
+int32 deBigintCompare(deBigint bigint1, deBigint bigint2) {
+  utAssert(deBigintGetWidth(bigint1) == deBigintGetWidth(bigint2) &&
+      deBigintSigned(bigint1) == deBigintSigned(bigint2));
+  bool negative1 = deBigintNegative(bigint1);
+  if (negative1 != deBigintNegative(bigint2)) {
+    return negative1? -1 : 1;
+  }
+  // With the same sign, two's complement values order like unsigned values.
+  for (int32 i = deBigintGetNumData(bigint1) - 1; i >= 0; i--) {
+    uint8 byte1 = deBigintGetiData(bigint1, i);
+    uint8 byte2 = deBigintGetiData(bigint2, i);
+    if (byte1 != byte2) {
+      return byte1 < byte2? -1 : 1;
+    }
+  }
+  return 0;
+}
+
 // Get the value of a bigint as a uint64.  If it is bigger than 64-bits can
 // hold, report an error at |line|.  The returned value ca be cast to int64
 // if the bigint is signed.
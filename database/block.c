@@ -354,16 +354,20 @@ void deRestoreBlockVariableNames(deBlock block) {
 // Generate a unique name for an identifier in the block, based on |name|.
 // Just use |name| if there is no conflict, otherwise, add _n, where n is an
 // integer to make the name unique in the block.
+// The conflicting identifier remembers where the search ended, so renaming the
+// same name many times is not quadratic.
 utSym deBlockCreateUniqueName(deBlock scopeBlock, utSym name) {
-  if (deFindIdent(scopeBlock, name) == deIdentNull) {
+  deIdent ident = deFindIdent(scopeBlock, name);
+  if (ident == deIdentNull) {
     return name;
   }
-  uint32 counter = 1;
+  uint32 counter = deIdentGetLastUniqueSuffix(ident);
   utSym newName;
   do {
-    newName = utSymCreateFormatted("%s_%u", utSymGetName(name), counter);
     counter++;
+    newName = utSymCreateFormatted("%s_%u", utSymGetName(name), counter);
   } while (deFindIdent(scopeBlock, newName) != deIdentNull);
+  deIdentSetLastUniqueSuffix(ident, counter);
   return newName;
 }
 
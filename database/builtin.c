@@ -18,17 +18,19 @@
 // The global array class.
 deTemplate deArrayTemplate, deFuncptrTemplate, deFunctionTemplate, deBoolTemplate, deStringTemplate,
     deUintTemplate, deIntTemplate, deModintTemplate, deFloatTemplate, deTupleTemplate,
-    deStructTemplate, deEnumTemplate, deClassTemplate, deNoneTemplate;
+    deStructTemplate, deEnumTemplate, deClassTemplate, deNoneTemplate, deVectorTemplate;
 
 // Builtin methods.
-static deFunction deArrayLengthFunc, deArrayResizeFunc, deArrayAppendFunc,
+static deFunction deArrayLengthFunc, deArrayResizeFunc, deArrayReserveFunc, deArrayAppendFunc,
     deArrayConcatFunc, deArrayReverseFunc, deStringLengthFunc,
     deStringResizeFunc, deStringAppendFunc, deStringConcatFunc,
     deStringReverseFunc, deStringToUintLEFunc, deUintToStringLEFunc,
     deStringToUintBEFunc, deUintToStringBEFunc, deStringToHexFunc,
-    deHexToStringFunc, deFindFunc, deRfindFunc, deArrayToStringFunc,
+    deHexToStringFunc, deStringToBase64Func, deBase64ToStringFunc, deFindFunc, deRfindFunc, deArrayToStringFunc,
     deBoolToStringFunc, deUintToStringFunc, deIntToStringFunc,
-    deTupleToStringFunc, deStructToStringFunc, deEnumToStringFunc;
+    deTupleToStringFunc, deStructToStringFunc, deEnumToStringFunc, deArrayLoadVectorFunc,
+    deArrayStoreVectorFunc, deVectorSumFunc, deVectorMinFunc, deVectorMaxFunc,
+    deVectorShuffleFunc, deVectorShuffleWithFunc;
 
 deTemplate deFindTypeTemplate(deDatatypeType type) {
   switch (type) {
@@ -59,6 +61,8 @@ deTemplate deFindTypeTemplate(deDatatypeType type) {
       return deEnumTemplate;
     case DE_TYPE_CLASS:
       return deClassTemplate;
+    case DE_TYPE_VECTOR:
+      return deVectorTemplate;
     case DE_TYPE_TEMPLATE:
     case DE_TYPE_NONE:
     case DE_TYPE_EXPR:
@@ -125,10 +129,15 @@ void deBuiltinStart(void) {
   deArrayTemplate = createBuiltinTemplate("Array", 1, DE_BUILTINTEMPLATE_ARRAY, "elementType");
   deArrayLengthFunc = addMethod(deArrayTemplate, DE_BUILTINFUNC_ARRAYLENGTH, "length", 0);
   deArrayResizeFunc = addMethod(deArrayTemplate, DE_BUILTINFUNC_ARRAYRESIZE, "resize", 1, "length");
+  deArrayReserveFunc = addMethod(deArrayTemplate, DE_BUILTINFUNC_ARRAYRESERVE, "reserve", 1, "length");
   deArrayAppendFunc = addMethod(deArrayTemplate, DE_BUILTINFUNC_ARRAYAPPEND, "append", 1, "element");
   deArrayConcatFunc = addMethod(deArrayTemplate, DE_BUILTINFUNC_ARRAYCONCAT, "concat", 1, "array");
   deArrayReverseFunc = addMethod(deArrayTemplate, DE_BUILTINFUNC_ARRAYREVERSE, "reverse", 0);
   deArrayToStringFunc = addMethod(deArrayTemplate, DE_BUILTINFUNC_ARRAYTOSTRING, "toString", 0);
+  deArrayLoadVectorFunc = addMethod(deArrayTemplate, DE_BUILTINFUNC_ARRAYLOADVECTOR,
+      "loadVector", 2, "offset", "lanes");
+  deArrayStoreVectorFunc = addMethod(deArrayTemplate, DE_BUILTINFUNC_ARRAYSTOREVECTOR,
+      "storeVector", 2, "offset", "vector");
   createBuiltinTemplate("Funcptr", DE_BUILTINTEMPLATE_FUNCPTR, 2, "function", "parameterArray");
   // TODO: upgrade Function constructor to take statement expression and
   // construct the function.  This would implement lambda expressions.
@@ -150,6 +159,12 @@ void deBuiltinStart(void) {
      "toUintBE", 1, "width");
   deStringToHexFunc = addMethod(deStringTemplate, DE_BUILTINFUNC_STRINGTOHEX, "toHex", 0);
   deHexToStringFunc = addMethod(deStringTemplate, DE_BUILTINFUNC_HEXTOSTRING, "fromHex", 0);
+  deStringToBase64Func = addMethod(deStringTemplate, DE_BUILTINFUNC_STRINGTOBASE64,
+      "toBase64", 1, "urlSafe");
+  setParameterDefault(deStringToBase64Func, 1, deBoolExpressionCreate(false, 0));
+  deBase64ToStringFunc = addMethod(deStringTemplate, DE_BUILTINFUNC_BASE64TOSTRING,
+      "fromBase64", 1, "urlSafe");
+  setParameterDefault(deBase64ToStringFunc, 1, deBoolExpressionCreate(false, 0));
   deFindFunc = addMethod(deStringTemplate, DE_BUILTINFUNC_FIND, "find", 2, "subString", "offset");
   setParameterDefault(deFindFunc, 2, deIntegerExpressionCreate(deNativeUintBigintCreate(0), 0));
   deRfindFunc = addMethod(deStringTemplate, DE_BUILTINFUNC_RFIND, "rfind", 2, "subString", "offset");
@@ -171,6 +186,14 @@ void deBuiltinStart(void) {
   deStructToStringFunc = addMethod(deStructTemplate, DE_BUILTINFUNC_STRUCTTOSTRING, "toString", 0);
   deEnumTemplate = createBuiltinTemplate("Enum", DE_BUILTINTEMPLATE_ENUM, 1, "value");
   deEnumToStringFunc = addMethod(deEnumTemplate, DE_BUILTINFUNC_ENUMTOSTRING, "toString", 0);
+  deVectorTemplate = createBuiltinTemplate("Vector", DE_BUILTINTEMPLATE_VECTOR, 1, "value");
+  deVectorSumFunc = addMethod(deVectorTemplate, DE_BUILTINFUNC_VECTORSUM, "sum", 0);
+  deVectorMinFunc = addMethod(deVectorTemplate, DE_BUILTINFUNC_VECTORMIN, "min", 0);
+  deVectorMaxFunc = addMethod(deVectorTemplate, DE_BUILTINFUNC_VECTORMAX, "max", 0);
+  deVectorShuffleFunc = addMethod(deVectorTemplate, DE_BUILTINFUNC_VECTORSHUFFLE,
+      "shuffle", 1, "indexes");
+  deVectorShuffleWithFunc = addMethod(deVectorTemplate, DE_BUILTINFUNC_VECTORSHUFFLE,
+      "shuffleWith", 2, "other", "indexes");
   deClassTemplate = createBuiltinTemplate("Class", DE_BUILTINTEMPLATE_STRUCT, 0);
   deNoneTemplate = createBuiltinTemplate("None", DE_BUILTINTEMPLATE_NONE, 0);
 }
@@ -179,6 +202,106 @@ void deBuiltinStart(void) {
 void deBuiltinStop(void) {
 }
 
+// Return the number of vector lanes given by the constant integer expression.
+// Lane counts are powers of 2, from 2 to DE_MAX_VECTOR_LANES.
+uint32 deFindVectorLanes(deExpression lanesExpr) {
+  if (deExpressionGetType(lanesExpr) != DE_EXPR_INTEGER) {
+    deExprError(lanesExpr, "Vector lane counts must be constant integers, like vectorof(f32, 8)");
+  }
+  uint32 lanes = deBigintGetUint32(deExpressionGetBigint(lanesExpr), deExpressionGetLine(lanesExpr));
+  if (lanes < 2 || lanes > DE_MAX_VECTOR_LANES || (lanes & (lanes - 1)) != 0) {
+    deExprError(lanesExpr, "Vectors must have 2, 4, 8, 16, 32 or 64 lanes");
+  }
+  return lanes;
+}
+
+// Bind Array.loadVector(offset, lanes) and Array.storeVector(offset, vector).
+// Lanes past the end of the array are masked off, so these never throw a bounds
+// exception: loads fill them with 0, and stores skip them.  The offset is
+// public, so memory access patterns are not secret.
+static deDatatype bindArrayVectorMethod(deFunction function, deDatatypeArray parameterTypes,
+    deExpression expression) {
+  deDatatype selfType = deDatatypeArrayGetiDatatype(parameterTypes, 0);
+  deDatatype offsetType = deDatatypeArrayGetiDatatype(parameterTypes, 1);
+  deDatatype elementType = deDatatypeGetElementType(selfType);
+  bool secret = deDatatypeSecret(elementType);
+  elementType = deSetDatatypeSecret(elementType, false);
+  if (!deDatatypeIsValidVectorElement(elementType)) {
+    deExprError(expression, "Vectors can only be loaded from and stored to arrays of "
+        "8 to 64 bit integers or floats, not %s", deDatatypeGetTypeString(selfType));
+  }
+  if (deDatatypeGetType(offsetType) != DE_TYPE_UINT || deDatatypeSecret(offsetType)) {
+    deExprError(expression, "Vector load and store offsets must be non-secret uints");
+  }
+  deExpression accessExpr = deExpressionGetFirstExpression(expression);
+  deExpression offsetExpr = deExpressionGetFirstExpression(deExpressionGetNextExpression(accessExpr));
+  deExpression paramExpr = deExpressionGetNextExpression(offsetExpr);
+  if (function == deArrayLoadVectorFunc) {
+    uint32 lanes = deFindVectorLanes(paramExpr);
+    return deSetDatatypeSecret(deVectorDatatypeCreate(elementType, lanes), secret);
+  }
+  deDatatype vectorType = deDatatypeArrayGetiDatatype(parameterTypes, 2);
+  if (!deDatatypeIsVector(vectorType) || deDatatypeGetElementType(vectorType) != elementType) {
+    deExprError(expression, "Array.storeVector needs a vector of %s, but got %s",
+        deDatatypeGetTypeString(elementType), deDatatypeGetTypeString(vectorType));
+  }
+  if (deDatatypeSecret(vectorType) && !secret) {
+    deExprError(expression, "Cannot store a secret vector in a non-secret array");
+  }
+  return deNoneDatatypeCreate();
+}
+
+// Bind builtin methods of vectors.  Min and max reductions of secret vectors are
+// not allowed, since LLVM may lower them with branches on some targets.
+static deDatatype bindVectorBuiltinMethod(deFunction function,
+    deDatatypeArray parameterTypes, deExpression expression) {
+  deDatatype selfType = deDatatypeArrayGetiDatatype(parameterTypes, 0);
+  deDatatype elementType = deDatatypeGetElementType(selfType);
+  bool secret = deDatatypeSecret(selfType);
+  if (function == deVectorSumFunc) {
+    return deSetDatatypeSecret(elementType, secret);
+  } else if (function == deVectorMinFunc || function == deVectorMaxFunc) {
+    if (secret) {
+      deExprError(expression, "Vector min and max reductions cannot be applied to secrets");
+    }
+    return elementType;
+  }
+  utAssert(function == deVectorShuffleFunc || function == deVectorShuffleWithFunc);
+  uint32 numSources = 1;
+  deExpression accessExpr = deExpressionGetFirstExpression(expression);
+  deExpression indexesExpr = deExpressionGetFirstExpression(deExpressionGetNextExpression(accessExpr));
+  if (function == deVectorShuffleWithFunc) {
+    deDatatype otherType = deDatatypeArrayGetiDatatype(parameterTypes, 1);
+    if (deSetDatatypeSecret(otherType, false) != deSetDatatypeSecret(selfType, false)) {
+      deExprError(expression, "Vector.shuffleWith needs two vectors of the same type:%s",
+          deGetOldVsNewDatatypeStrings(selfType, otherType));
+    }
+    secret |= deDatatypeSecret(otherType);
+    numSources = 2;
+    indexesExpr = deExpressionGetNextExpression(indexesExpr);
+  }
+  // The indexes become an LLVM shufflevector mask, which must be constant.
+  if (deExpressionGetType(indexesExpr) != DE_EXPR_ARRAY) {
+    deExprError(expression, "Vector shuffle indexes must be a constant array, like [3, 2, 1, 0]");
+  }
+  uint32 maxIndex = numSources * deDatatypeGetWidth(selfType);
+  uint32 lanes = 0;
+  deExpression indexExpr;
+  deForeachExpressionExpression(indexesExpr, indexExpr) {
+    if (deExpressionGetType(indexExpr) != DE_EXPR_INTEGER ||
+        deBigintGetUint32(deExpressionGetBigint(indexExpr), deExpressionGetLine(indexExpr)) >=
+            maxIndex) {
+      deExprError(expression, "Vector shuffle indexes must be constant integers less than %u",
+          maxIndex);
+    }
+    lanes++;
+  } deEndExpressionExpression;
+  if (lanes < 2 || lanes > DE_MAX_VECTOR_LANES || (lanes & (lanes - 1)) != 0) {
+    deExprError(expression, "Vector shuffles must select 2, 4, 8, 16, 32 or 64 lanes");
+  }
+  return deSetDatatypeSecret(deVectorDatatypeCreate(elementType, lanes), secret);
+}
+
 // Bind builtin methods of arrays.
 static deDatatype bindArrayBuiltinMethod(deBlock scopeBlock, deExpression expression,
     deFunction function, deDatatypeArray parameterTypes) {
@@ -195,6 +318,11 @@ static deDatatype bindArrayBuiltinMethod(deBlock scopeBlock, deExpression expres
       deExprError(expression, "Array.resize method requires a uint length parameter");
     }
     return selfType;  // Resize returns the array.
+  } else if (function == deArrayReserveFunc) {
+    if (deDatatypeGetType(paramType) != DE_TYPE_UINT) {
+      deExprError(expression, "Array.reserve method requires a uint length parameter");
+    }
+    return deNoneDatatypeCreate();
   } else if (function == deArrayAppendFunc) {
     deExpression accessExpr = deExpressionGetFirstExpression(expression);
     utAssert(deExpressionGetType(accessExpr) == DE_EXPR_DOT);
@@ -216,6 +344,8 @@ static deDatatype bindArrayBuiltinMethod(deBlock scopeBlock, deExpression expres
     return deNoneDatatypeCreate();
   } else if (function == deArrayToStringFunc) {
     return deStringDatatypeCreate();
+  } else if (function == deArrayLoadVectorFunc || function == deArrayStoreVectorFunc) {
+    return bindArrayVectorMethod(function, parameterTypes, expression);
   }
   utExit("Unknown builtin Array method");
   return deDatatypeNull;  // Dummy return;
@@ -277,6 +407,12 @@ static deDatatype bindStringBuiltinMethod(deFunction function,
     return deSetDatatypeSecret(paramType, secret);
   } else if (function == deStringToHexFunc || function == deHexToStringFunc) {
     return selfType;
+  } else if (function == deStringToBase64Func || function == deBase64ToStringFunc) {
+    if (paramType != deDatatypeNull && (deDatatypeGetType(paramType) != DE_TYPE_BOOL ||
+        deDatatypeSecret(paramType))) {
+      deExprError(expression, "String base64 methods take a non-secret bool urlSafe parameter");
+    }
+    return selfType;
   } else if (function == deFindFunc || function == deRfindFunc) {
     if (deDatatypeSecret(selfType) || deDatatypeSecret(paramType)) {
       deExprError(expression, "Cannot search for substrings in secret strings");
@@ -391,6 +527,8 @@ deDatatype deBindBuiltinCall(deBlock scopeBlock, deFunction function,
     return bindIntBuiltinMethod(function, parameterTypes, expression);
   } else if (type == DE_TYPE_BOOL) {
     return bindBoolBuiltinMethod(function, parameterTypes, expression);
+  } else if (type == DE_TYPE_VECTOR) {
+    return bindVectorBuiltinMethod(function, parameterTypes, expression);
   } else {
     deExprError(expression, "unknown builtin method call");
     utExit("Unknown builtin method call");
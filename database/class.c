@@ -36,13 +36,35 @@
 
 utSym deToStringSym, deShowSym;
 
+// Classes of template instantiations, in an open-addressed hash table with
+// linear probing, keyed by the template and its parameter datatypes.  Each slot
+// caches the hash of its class.
+typedef struct {
+  uint32 hash;
+  bool deleted;
+  deClass theClass;
+} deClassSlot;
+
+static deClassSlot *deClassTable;
+static uint32 deClassTableSize;  // Always a power of 2.
+static uint32 deNumClassSlotsUsed;  // Including deleted ones.
+
+static void removeFromClassTable(deClass theClass);
+
 void deClassStart(void) {
   deToStringSym = utSymCreate("toString");
   deShowSym = utSymCreate("show");
+  deClassTableSize = 256;
+  deClassTable = utCalloc(deClassTableSize, sizeof(deClassSlot));
+  deNumClassSlotsUsed = 0;
+  deClassSetDestructorCallback(removeFromClassTable);
 }
 
 void deClassStop(void) {
-  // Nothing for now.
+  deClassSetDestructorCallback(NULL);
+  utFree(deClassTable);
+  deClassTable = NULL;
+  deClassTableSize = 0;
 }
 
 // Dump the class to the end of |string| for debugging purposes.
@@ -82,10 +104,12 @@ static void addDestroyMethod(deTemplate templ) {
 
 // Create a new class object.  Add a destroy method.  The template is a child of
 // its constructor function, essentially implementing inheritance through
-// composition.
+// composition.  A |refWidth| of 0 means the class did not declare one, so it
+// gets the default of 32 bits, which -useprofile can change.
 deTemplate deTemplateCreate(deFunction constructor, uint32 refWidth, deLine line) {
   deTemplate templ = deTemplateAlloc();
-  deTemplateSetRefWidth(templ, refWidth);
+  deTemplateSetRefWidth(templ, refWidth == 0? 32 : refWidth);
+  deTemplateSetRefWidthDeclared(templ, refWidth != 0);
   deTemplateSetLine(templ, line);
   deFunctionInsertTemplate(constructor, templ);
   if (!deFunctionBuiltin(constructor)) {
@@ -95,6 +119,21 @@ deTemplate deTemplateCreate(deFunction constructor, uint32 refWidth, deLine line
   return templ;
 }
 
+// Add a compact() function to the template, unless the class defines its own.
+// Calling Class.compact() renumbers live objects densely and shrinks the
+// class's arrays.  Memory management fills in its body.
+void deTemplateAddCompactFunction(deTemplate templ) {
+  deFunction constructor = deTemplateGetFunction(templ);
+  deBlock classBlock = deFunctionGetSubBlock(constructor);
+  utSym funcName = utSymCreate("compact");
+  if (deBlockFindIdent(classBlock, funcName) != deIdentNull) {
+    return;
+  }
+  deFunction function = deFunctionCreate(deBlockGetFilepath(classBlock), classBlock,
+      DE_FUNC_PLAIN, funcName, deFunctionGetLinkage(constructor), deBlockGetLine(classBlock));
+  deFunctionSetCompactor(function, true);
+}
+
 // Determine if two signatures generate the same theClass.  This is true if the
 // types for variables in the class constructor marked inTemplateSignature have the
 // same type.
@@ -171,15 +210,109 @@ static bool classMatchesParams(deClass theClass, deDatatypeArray templParams) {
   return true;
 }
 
+// Compute a 32-bit hash of the template and its parameter types.
+static uint32 hashClassParams(deTemplate templ, deDatatype *types, uint32 numTypes) {
+  uint32 hash = deTemplate2Index(templ);
+  for (uint32 xType = 0; xType < numTypes; xType++) {
+    hash = utHashValues(hash, deDatatype2Index(types[xType]));
+  }
+  return hash;
+}
+
+// Compute the hash of a class from the template parameters in its datatype.
+static uint32 hashClass(deClass theClass) {
+  deDatatype classType = deClassGetDatatype(theClass);
+  return hashClassParams(deClassGetTemplate(theClass), deDatatypeGetTypeLists(classType),
+      deDatatypeGetNumTypeList(classType));
+}
+
 // Find an existing class matching the parameters.
 static deClass findTemplateClassFromParams(deTemplate templ, deDatatypeArray templParams) {
-  deClass theClass;
-  deForeachTemplateClass(templ, theClass) {
-    if (classMatchesParams(theClass, templParams)) {
+  uint32 hash = hashClassParams(templ, deDatatypeArrayGetDatatypes(templParams),
+      deDatatypeArrayGetUsedDatatype(templParams));
+  uint32 mask = deClassTableSize - 1;
+  for (uint32 i = hash & mask;; i = (i + 1) & mask) {
+    deClassSlot *slot = deClassTable + i;
+    deClass theClass = slot->theClass;
+    if (theClass == deClassNull) {
+      if (!slot->deleted) {
+        return deClassNull;
+      }
+    } else if (slot->hash == hash && deClassGetTemplate(theClass) == templ &&
+        classMatchesParams(theClass, templParams)) {
       return theClass;
     }
-  } deEndTemplateClass;
-  return deClassNull;
+  }
+}
+
+// Rebuild the table, dropping deleted slots, and double its size if it is
+// crowded with live classes.
+static void rehashClassTable(bool grow) {
+  deClassSlot *oldTable = deClassTable;
+  uint32 oldSize = deClassTableSize;
+  if (grow) {
+    deClassTableSize <<= 1;
+  }
+  deClassTable = utCalloc(deClassTableSize, sizeof(deClassSlot));
+  deNumClassSlotsUsed = 0;
+  uint32 mask = deClassTableSize - 1;
+  for (uint32 i = 0; i < oldSize; i++) {
+    if (oldTable[i].theClass != deClassNull) {
+      uint32 j = oldTable[i].hash & mask;
+      while (deClassTable[j].theClass != deClassNull) {
+        j = (j + 1) & mask;
+      }
+      deClassTable[j] = oldTable[i];
+      deNumClassSlotsUsed++;
+    }
+  }
+  utFree(oldTable);
+}
+
+// Add a class to the hash table, once its datatype is set.
+static void addToClassTable(deClass theClass) {
+  uint32 hash = hashClass(theClass);
+  deClassSetHash(theClass, hash);
+  uint32 mask = deClassTableSize - 1;
+  uint32 i = hash & mask;
+  while (deClassTable[i].theClass != deClassNull) {
+    i = (i + 1) & mask;
+  }
+  deClassSlot *slot = deClassTable + i;
+  if (!slot->deleted) {
+    deNumClassSlotsUsed++;
+  }
+  slot->hash = hash;
+  slot->deleted = false;
+  slot->theClass = theClass;
+  if (deNumClassSlotsUsed > deClassTableSize >> 1) {
+    uint32 numLive = 0;
+    for (uint32 j = 0; j < deClassTableSize; j++) {
+      if (deClassTable[j].theClass != deClassNull) {
+        numLive++;
+      }
+    }
+    rehashClassTable(numLive > deClassTableSize >> 2);
+  }
+}
+
+// Remove a class being destroyed from the hash table.
+static void removeFromClassTable(deClass theClass) {
+  if (deClassTable == NULL || deClassGetDatatype(theClass) == deDatatypeNull) {
+    return;
+  }
+  uint32 mask = deClassTableSize - 1;
+  for (uint32 i = deClassGetHash(theClass) & mask;; i = (i + 1) & mask) {
+    deClassSlot *slot = deClassTable + i;
+    if (slot->theClass == theClass) {
+      slot->theClass = deClassNull;
+      slot->deleted = true;
+      return;
+    }
+    if (slot->theClass == deClassNull && !slot->deleted) {
+      return;
+    }
+  }
 }
 
 // Create a class from template parameters.  Free |templParams|.
@@ -187,10 +320,12 @@ static deClass createClassFromParams(deTemplate templ, deDatatypeArray templPara
   deClass theClass = classCreate(templ);
   deDatatype datatype = deClassDatatypeCreateFromParams(theClass, templParams);
   deClassSetDatatype(theClass, datatype);
+  addToClassTable(theClass);
   return theClass;
 }
 
-// Find or create a class given the template parameters.
+// Find or create a class given the template parameters.  Instantiations are
+// memoized in the class hash table, so this does not scan the template's classes.
 deClass deTemplateFindClassFromParams(deTemplate templ, deDatatypeArray templParams) {
   deClass theClass = findTemplateClassFromParams(templ, templParams);
   if (theClass != deClassNull) {
@@ -206,6 +341,7 @@ deClass deTemplateGetDefaultClass(deTemplate templ) {
   if (theClass == deClassNull) {
     theClass = classCreate(templ);
     deClassSetDatatype(theClass, deClassDatatypeCreate(theClass));
+    addToClassTable(theClass);
   }
   return theClass;
 }
@@ -221,7 +357,11 @@ deClass deClassCreate(deTemplate templ, deSignature signature) {
 
 // Make a copy of the template in |destBlock|.
 deTemplate deCopyTemplate(deTemplate templ, deFunction destConstructor) {
-  return deTemplateCreate(destConstructor, deTemplateGetRefWidth(templ), deTemplateGetLine(templ));
+  deTemplate newTempl = deTemplateCreate(destConstructor, deTemplateGetRefWidth(templ),
+      deTemplateGetLine(templ));
+  deTemplateSetRefWidthDeclared(newTempl, deTemplateRefWidthDeclared(templ));
+  deTemplateSetPacked(newTempl, deTemplatePacked(templ));
+  return newTempl;
 }
 
 // Build a tuple expression for the class members.  Bind types as we go.
@@ -72,6 +72,8 @@ char *deDatatypeTypeGetName(deDatatypeType type) {
     return "enumclass";
   case DE_TYPE_ENUM:
     return "enum";
+  case DE_TYPE_VECTOR:
+    return "vector";
   case DE_TYPE_EXPR:
     return "expr";
   }
@@ -92,206 +94,271 @@ deTemplate deFindDatatypeTemplate(deDatatype datatype) {
   return deFindTypeTemplate(type);
 }
 
+// Return true if integers of this width are represented as bigints.
+bool deIntegerWidthIsBigint(uint32 width) {
+  return width > (deNativeWideInts? DE_MAX_NATIVE_INT_WIDTH : 64);
+}
+
 // Create a datatype of type DE_TYPE_NONE.  Making it unique comes later.
 static inline deDatatype datatypeCreate(deDatatypeType type, uint32 width, bool concrete) {
   deDatatype datatype = deDatatypeAlloc();
   deDatatypeSetType(datatype, type);
   deDatatypeSetWidth(datatype, width);
   if (type == DE_TYPE_ARRAY || type == DE_TYPE_STRING ||
-      (deDatatypeTypeIsInteger(type) && width > 64)) {
+      (deDatatypeTypeIsInteger(type) && deIntegerWidthIsBigint(width))) {
     deDatatypeSetContainsArray(datatype, true);
   }
   deDatatypeSetConcrete(datatype, concrete);
   return datatype;
 }
 
-// Make a copy of the datatype.
-deDatatype copyDatatype(deDatatype datatype) {
-  deDatatype copy = datatypeCreate(deDatatypeGetType(datatype),
-      deDatatypeGetWidth(datatype), deDatatypeConcrete(datatype));
-  deDatatypeSetSecret(copy, deDatatypeSecret(datatype));
-  deDatatypeSetNullable(copy, deDatatypeNullable(datatype));
-  deDatatypeSetContainsArray(copy, deDatatypeContainsArray(datatype));
+// The fields that make a datatype unique.  Create functions fill one in on the
+// stack, so finding an existing datatype allocates nothing.
+typedef struct {
+  deDatatypeType type;
+  uint32 width;
+  bool secret;
+  bool nullable;
+  bool fixedArray;
+  // The index of the element type, return type, template, class, function or
+  // modulus, depending on the type.
+  uint32 member;
+  uint32 numTypes;
+  const deDatatype *types;
+} deDatatypeKey;
+
+// Interned datatypes, in an open-addressed hash table with linear probing.
+// Each slot caches the hash of its datatype, so most probes that do not match
+// never touch the datatype itself.
+typedef struct {
+  uint32 hash;
+  deDatatype datatype;
+} deDatatypeSlot;
+
+static deDatatypeSlot *deDatatypeTable;
+static uint32 deDatatypeTableSize;  // Always a power of 2.
+static uint32 deNumInternedDatatypes;
+
+// Initialize a key with no sub-types.
+static inline void initKey(deDatatypeKey *key, deDatatypeType type, uint32 width, uint32 member) {
+  key->type = type;
+  key->width = width;
+  key->secret = false;
+  key->nullable = false;
+  key->fixedArray = false;
+  key->member = member;
+  key->numTypes = 0;
+  key->types = NULL;
+}
+
+// Return the index of the datatype's member that distinguishes it from other
+// datatypes of the same type.
+static uint32 datatypeMember(deDatatype datatype) {
   switch (deDatatypeGetType(datatype)) {
-    case DE_TYPE_ARRAY: case DE_TYPE_STRING:
-      deDatatypeSetElementType(copy, deDatatypeGetElementType(datatype));
-      break;
+    case DE_TYPE_ARRAY:
+    case DE_TYPE_STRING:
+    case DE_TYPE_VECTOR:
+      return deDatatype2Index(deDatatypeGetElementType(datatype));
     case DE_TYPE_FUNCPTR:
-      deDatatypeSetReturnType(copy, deDatatypeGetReturnType(datatype));
-      break;
+      return deDatatype2Index(deDatatypeGetReturnType(datatype));
     case DE_TYPE_TEMPLATE:
-      deDatatypeSetTemplate(copy, deDatatypeGetTemplate(datatype));
-      break;
+      return deTemplate2Index(deDatatypeGetTemplate(datatype));
     case DE_TYPE_CLASS:
-      deDatatypeSetClass(copy, deDatatypeGetClass(datatype));
-      break;
+      return deClass2Index(deDatatypeGetClass(datatype));
     case DE_TYPE_FUNCTION:
-      deDatatypeSetFunction(copy, deDatatypeGetFunction(datatype));
-      break;
+    case DE_TYPE_STRUCT:
+    case DE_TYPE_ENUMCLASS:
+    case DE_TYPE_ENUM:
+      return deFunction2Index(deDatatypeGetFunction(datatype));
+    case DE_TYPE_MODINT:
+      return deExpression2Index(deDatatypeGetModulus(datatype));
     default:
-      break;
-  }
-  uint32 numTypeList = deDatatypeGetNumTypeList(datatype);
-  if (numTypeList != 0) {
-    deDatatypeResizeTypeLists(copy, numTypeList);
-    memcpy(deDatatypeGetTypeLists(copy), deDatatypeGetTypeLists(datatype),
-           numTypeList * sizeof(deDatatype));
+      return 0;
   }
-  return copy;
 }
 
-// Hash all the values in the datatype together for use in hash-table lookup.
-static uint32 hashDatatype(deDatatype datatype) {
-  uint32 hash = deDatatypeGetType(datatype);
-  hash = utHashValues(hash, deDatatypeSecret(datatype));
-  hash = utHashValues(hash, deDatatypeNullable(datatype));
-  hash = utHashValues(hash, deDatatypeGetWidth(datatype));
-  switch (deDatatypeGetType(datatype)) {
-    case DE_TYPE_ARRAY:
-      hash = utHashValues(hash, deDatatype2Index(deDatatypeGetElementType(datatype)));
-      break;
-    case DE_TYPE_FUNCPTR:
-      hash = utHashValues(hash, deDatatype2Index(deDatatypeGetReturnType(datatype)));
-      break;
-    case DE_TYPE_TEMPLATE:
-      hash = utHashValues(hash, deTemplate2Index(deDatatypeGetTemplate(datatype)));
-      break;
-    case DE_TYPE_CLASS:
-      hash = utHashValues(hash, deClass2Index(deDatatypeGetClass(datatype)));
-      break;
-    case DE_TYPE_FUNCTION:
-      hash = utHashValues(hash, deFunction2Index(deDatatypeGetFunction(datatype)));
-      break;
-    default:
-    break;
+// Fill out the key to match an existing datatype.
+static void keyFromDatatype(deDatatypeKey *key, deDatatype datatype) {
+  initKey(key, deDatatypeGetType(datatype), deDatatypeGetWidth(datatype),
+      datatypeMember(datatype));
+  key->secret = deDatatypeSecret(datatype);
+  key->nullable = deDatatypeNullable(datatype);
+  key->fixedArray = deDatatypeFixedArray(datatype);
+  key->numTypes = deDatatypeGetNumTypeList(datatype);
+  key->types = deDatatypeGetTypeLists(datatype);
+}
+
+// Hash all the values in the key together for use in hash-table lookup.
+static uint32 hashKey(const deDatatypeKey *key) {
+  uint32 hash = utHashValues(key->type, key->width);
+  hash = utHashValues(hash, (key->fixedArray << 2) | (key->secret << 1) | key->nullable);
+  hash = utHashValues(hash, key->member);
+  for (uint32 i = 0; i < key->numTypes; i++) {
+    hash = utHashValues(hash, deDatatype2Index(key->types[i]));
   }
-  deDatatype tupleType;
-  deForeachDatatypeTypeList(datatype, tupleType) {
-    hash = utHashValues(hash, deDatatype2Index(tupleType));
-  } deEndDatatypeTypeList;
   return hash;
 }
 
-// Compare two datatypes to see if they are the same.
-static bool datatypesAreIdentical(deDatatype datatype1, deDatatype datatype2) {
-  if (deDatatypeGetType(datatype1) != deDatatypeGetType(datatype2)) {
+// Determine if the datatype is the one described by the key.
+static bool keyMatchesDatatype(const deDatatypeKey *key, deDatatype datatype) {
+  if (deDatatypeGetType(datatype) != key->type || deDatatypeGetWidth(datatype) != key->width ||
+      deDatatypeSecret(datatype) != key->secret ||
+      deDatatypeNullable(datatype) != key->nullable ||
+      deDatatypeFixedArray(datatype) != key->fixedArray ||
+      datatypeMember(datatype) != key->member ||
+      deDatatypeGetNumTypeList(datatype) != key->numTypes) {
     return false;
   }
-  if (deDatatypeSecret(datatype1) != deDatatypeSecret(datatype2)) {
-    return false;
+  return key->numTypes == 0 ||
+      !memcmp(deDatatypeGetTypeLists(datatype), key->types, key->numTypes * sizeof(deDatatype));
+}
+
+// Return the slot holding the datatype matching the key, or the empty slot
+// where it belongs.
+static deDatatypeSlot *findDatatypeSlot(const deDatatypeKey *key, uint32 hash) {
+  uint32 mask = deDatatypeTableSize - 1;
+  for (uint32 i = hash & mask;; i = (i + 1) & mask) {
+    deDatatypeSlot *slot = deDatatypeTable + i;
+    if (slot->datatype == deDatatypeNull ||
+        (slot->hash == hash && keyMatchesDatatype(key, slot->datatype))) {
+      return slot;
+    }
   }
-  if (deDatatypeNullable(datatype1) != deDatatypeNullable(datatype2)) {
-    return false;
+}
+
+// Double the size of the table, keeping it at most half full.
+static void growDatatypeTable(void) {
+  deDatatypeSlot *oldTable = deDatatypeTable;
+  uint32 oldSize = deDatatypeTableSize;
+  deDatatypeTableSize <<= 1;
+  deDatatypeTable = utCalloc(deDatatypeTableSize, sizeof(deDatatypeSlot));
+  uint32 mask = deDatatypeTableSize - 1;
+  for (uint32 i = 0; i < oldSize; i++) {
+    if (oldTable[i].datatype != deDatatypeNull) {
+      uint32 j = oldTable[i].hash & mask;
+      while (deDatatypeTable[j].datatype != deDatatypeNull) {
+        j = (j + 1) & mask;
+      }
+      deDatatypeTable[j] = oldTable[i];
+    }
   }
-  if (deDatatypeGetWidth(datatype1) != deDatatypeGetWidth(datatype2)) {
-    return false;
+  utFree(oldTable);
+}
+
+// Return the unique datatype described by the key, creating it if it does not
+// yet exist.  |concrete| is only used when creating it.
+static deDatatype internDatatype(const deDatatypeKey *key, bool concrete) {
+  uint32 hash = hashKey(key);
+  deDatatypeSlot *slot = findDatatypeSlot(key, hash);
+  if (slot->datatype != deDatatypeNull) {
+    return slot->datatype;
   }
-  switch (deDatatypeGetType(datatype1)) {
+  deDatatype datatype = datatypeCreate(key->type, key->width, concrete);
+  deDatatypeSetSecret(datatype, key->secret);
+  deDatatypeSetNullable(datatype, key->nullable);
+  deDatatypeSetFixedArray(datatype, key->fixedArray);
+  switch (key->type) {
     case DE_TYPE_ARRAY:
-      if (deDatatypeGetElementType(datatype1) != deDatatypeGetElementType(datatype2)) {
-        return false;
-      }
+    case DE_TYPE_STRING:
+    case DE_TYPE_VECTOR:
+      deDatatypeSetElementType(datatype, deIndex2Datatype(key->member));
       break;
     case DE_TYPE_FUNCPTR:
-      if (deDatatypeGetReturnType(datatype1) != deDatatypeGetReturnType(datatype2)) {
-        return false;
-      }
+      deDatatypeSetReturnType(datatype, deIndex2Datatype(key->member));
       break;
     case DE_TYPE_TEMPLATE:
-      if (deDatatypeGetTemplate(datatype1) != deDatatypeGetTemplate(datatype2)) {
-        return false;
-      }
+      deDatatypeSetTemplate(datatype, deIndex2Template(key->member));
       break;
     case DE_TYPE_CLASS:
-      if (deDatatypeGetClass(datatype1) != deDatatypeGetClass(datatype2)) {
-        return false;
-      }
+      deDatatypeSetClass(datatype, deIndex2Class(key->member));
       break;
     case DE_TYPE_FUNCTION:
-      if (deDatatypeGetFunction(datatype1) != deDatatypeGetFunction(datatype2)) {
-        return false;
-      }
-      break;
-    case DE_TYPE_MODINT:
-      if (deDatatypeGetModulus(datatype1) != deDatatypeGetModulus(datatype2)) {
-        return false;
-      }
-      break;
     case DE_TYPE_STRUCT:
     case DE_TYPE_ENUMCLASS:
     case DE_TYPE_ENUM:
-      if (deDatatypeGetFunction(datatype1) != deDatatypeGetFunction(datatype2)) {
-        return false;
-      }
+      deDatatypeSetFunction(datatype, deIndex2Function(key->member));
       break;
-    case DE_TYPE_NONE:
-    case DE_TYPE_BOOL:
-    case DE_TYPE_STRING:
-    case DE_TYPE_UINT:
-    case DE_TYPE_INT:
-    case DE_TYPE_FLOAT:
-    case DE_TYPE_TUPLE:
-    case DE_TYPE_EXPR:
+    case DE_TYPE_MODINT:
+      deDatatypeSetModulus(datatype, deIndex2Expression(key->member));
+      break;
+    default:
       break;
   }
-  if (deDatatypeGetNumTypeList(datatype1) !=
-      deDatatypeGetNumTypeList(datatype2)) {
-    return false;
-  }
-  for (uint32 i = 0; i < deDatatypeGetNumTypeList(datatype1); i++) {
-    if (deDatatypeGetiTypeList(datatype1, i) !=
-        deDatatypeGetiTypeList(datatype2, i)) {
-      return false;
+  if (key->numTypes != 0) {
+    // The key's types may be in the heap of type lists, which can move when
+    // this one is allocated.
+    uint32 size = key->numTypes * sizeof(deDatatype);
+    deDatatype *types = utCalloc(key->numTypes, sizeof(deDatatype));
+    memcpy(types, key->types, size);
+    deDatatypeResizeTypeLists(datatype, key->numTypes);
+    memcpy(deDatatypeGetTypeLists(datatype), types, size);
+    utFree(types);
+    if (key->type == DE_TYPE_TUPLE || key->type == DE_TYPE_STRUCT) {
+      for (uint32 i = 0; i < key->numTypes; i++) {
+        if (deDatatypeContainsArray(deDatatypeGetiTypeList(datatype, i))) {
+          deDatatypeSetContainsArray(datatype, true);
+        }
+      }
     }
   }
-  return true;
-}
-
-// Add the data type to the hash table.  If it already exists, destroy the
-// passed datatype and return the old one.
-static deDatatype addToHashTable(deDatatype datatype) {
-  uint32 hash = hashDatatype(datatype);
-  deDatatypeBin bin = deRootFindDatatypeBin(deTheRoot, hash);
-  if (bin == deDatatypeBinNull) {
-    bin = deDatatypeBinAlloc();
-    deDatatypeBinSetHash(bin, hash);
-    deRootInsertDatatypeBin(deTheRoot, bin);
-  } else {
-    deDatatype oldDatatype;
-    deForeachDatatypeBinDatatype(bin, oldDatatype) {
-      if (datatypesAreIdentical(datatype, oldDatatype)) {
-        deDatatypeDestroy(datatype);
-        return oldDatatype;
-      }
-    } deEndDatatypeBinDatatype;
+  slot->hash = hash;
+  slot->datatype = datatype;
+  deNumInternedDatatypes++;
+  if (deNumInternedDatatypes > deDatatypeTableSize >> 1) {
+    growDatatypeTable();
   }
-  deDatatypeBinInsertDatatype(bin, datatype);
   return datatype;
 }
 
+// Return the unique datatype with no sub-types.
+static deDatatype internSimpleDatatype(deDatatypeType type, uint32 width, uint32 member,
+    bool concrete) {
+  deDatatypeKey key;
+  initKey(&key, type, width, member);
+  return internDatatype(&key, concrete);
+}
+
+// Return the unique datatype with the sub-types in the array.
+static deDatatype internDatatypeWithTypes(deDatatypeType type, uint32 member,
+    deDatatypeArray types, bool concrete) {
+  deDatatypeKey key;
+  initKey(&key, type, 0, member);
+  key.numTypes = deDatatypeArrayGetUsedDatatype(types);
+  key.types = deDatatypeArrayGetDatatypes(types);
+  return internDatatype(&key, concrete);
+}
+
 // Initialize common data types to speed things up a bit.
 void deDatatypeStart(void) {
-  deNoneDatatype = addToHashTable(datatypeCreate(DE_TYPE_NONE, 0, true));
-  deBoolDatatype = addToHashTable(datatypeCreate(DE_TYPE_BOOL, 0, true));
-  deUint8Datatype = addToHashTable(datatypeCreate(DE_TYPE_UINT, 8, true));
-  deUint16Datatype = addToHashTable(datatypeCreate(DE_TYPE_UINT, 16, true));
-  deUint32Datatype = addToHashTable(datatypeCreate(DE_TYPE_UINT, 32, true));
-  deUint64Datatype = addToHashTable(datatypeCreate(DE_TYPE_UINT, 64, true));
-  deInt8Datatype = addToHashTable(datatypeCreate(DE_TYPE_INT, 8, true));
-  deInt16Datatype = addToHashTable(datatypeCreate(DE_TYPE_INT, 16, true));
-  deInt32Datatype = addToHashTable(datatypeCreate(DE_TYPE_INT, 32, true));
-  deInt64Datatype = addToHashTable(datatypeCreate(DE_TYPE_INT, 64, true));
-  deFloat32Datatype = addToHashTable(datatypeCreate(DE_TYPE_FLOAT, 32, true));
-  deFloat64Datatype = addToHashTable(datatypeCreate(DE_TYPE_FLOAT, 64, true));
+  deDatatypeTableSize = 1024;
+  deDatatypeTable = utCalloc(deDatatypeTableSize, sizeof(deDatatypeSlot));
+  deNumInternedDatatypes = 0;
+  deNoneDatatype = internSimpleDatatype(DE_TYPE_NONE, 0, 0, true);
+  deBoolDatatype = internSimpleDatatype(DE_TYPE_BOOL, 0, 0, true);
+  deUint8Datatype = internSimpleDatatype(DE_TYPE_UINT, 8, 0, true);
+  deUint16Datatype = internSimpleDatatype(DE_TYPE_UINT, 16, 0, true);
+  deUint32Datatype = internSimpleDatatype(DE_TYPE_UINT, 32, 0, true);
+  deUint64Datatype = internSimpleDatatype(DE_TYPE_UINT, 64, 0, true);
+  deInt8Datatype = internSimpleDatatype(DE_TYPE_INT, 8, 0, true);
+  deInt16Datatype = internSimpleDatatype(DE_TYPE_INT, 16, 0, true);
+  deInt32Datatype = internSimpleDatatype(DE_TYPE_INT, 32, 0, true);
+  deInt64Datatype = internSimpleDatatype(DE_TYPE_INT, 64, 0, true);
+  deFloat32Datatype = internSimpleDatatype(DE_TYPE_FLOAT, 32, 0, true);
+  deFloat64Datatype = internSimpleDatatype(DE_TYPE_FLOAT, 64, 0, true);
   // Be sure to build uint8 type first.
-  deDatatype datatype = datatypeCreate(DE_TYPE_STRING, 0, true);
-  deDatatypeSetElementType(datatype, deUint8Datatype);
-  deStringDatatype = addToHashTable(datatype);
+  deStringDatatype = internSimpleDatatype(DE_TYPE_STRING, 0, deDatatype2Index(deUint8Datatype), true);
 }
 
 // Free memory used by the datatype module.
 void deDatatypeStop(void) {
-  // Nothing yet.
+  utFree(deDatatypeTable);
+  deDatatypeTable = NULL;
+  deDatatypeTableSize = 0;
+}
+
+// Return the number of unique datatypes created so far.
+uint32 deCountDatatypes(void) {
+  return deNumInternedDatatypes;
 }
 
 // Return the None datatype, representing no value computed at all.
@@ -323,7 +390,7 @@ deDatatype deUintDatatypeCreate(uint32 width) {
   if (width == 0) {
     utExit("Attempted to create zero-width integer");
   }
-  return addToHashTable(datatypeCreate(DE_TYPE_UINT, width, true));
+  return internSimpleDatatype(DE_TYPE_UINT, width, 0, true);
 }
 
 // Create an int datatype of the given width.  If it already exists, return the
@@ -340,7 +407,7 @@ deDatatype deIntDatatypeCreate(uint32 width) {
   if (width == 0) {
     utExit("Attempted to create zero-width integer");
   }
-  return addToHashTable(datatypeCreate(DE_TYPE_INT, width, true));
+  return internSimpleDatatype(DE_TYPE_INT, width, 0, true);
 }
 
 // Create a modular integer datatype.  If it already exists, return the old one.
@@ -350,9 +417,8 @@ deDatatype deIntDatatypeCreate(uint32 width) {
 deDatatype deModintDatatypeCreate(deExpression modulus) {
   deDatatype modulusDatatype = deExpressionGetDatatype(modulus);
   utAssert(deDatatypeIsInteger(modulusDatatype));
-  deDatatype datatype = datatypeCreate(DE_TYPE_MODINT, deDatatypeGetWidth(modulusDatatype), true);
-  deDatatypeSetModulus(datatype, modulus);
-  return addToHashTable(datatype);
+  return internSimpleDatatype(DE_TYPE_MODINT, deDatatypeGetWidth(modulusDatatype),
+      deExpression2Index(modulus), true);
 }
 
 // Return a floating point datatype.
@@ -367,16 +433,14 @@ deDatatype deFloatDatatypeCreate(uint32 width) {
 
 // Create an array datatype.  If it already exists, return the old one.
 deDatatype deArrayDatatypeCreate(deDatatype elementType) {
-  deDatatype datatype = datatypeCreate(DE_TYPE_ARRAY, 0, deDatatypeConcrete(elementType));
-  deDatatypeSetElementType(datatype, elementType);
-  return addToHashTable(datatype);
+  return internSimpleDatatype(DE_TYPE_ARRAY, 0, deDatatype2Index(elementType),
+      deDatatypeConcrete(elementType));
 }
 
 // Create a template datatype.  If it already exists, return the old one.
 deDatatype deTemplateDatatypeCreate(deTemplate templ) {
-  deDatatype datatype = datatypeCreate(DE_TYPE_TEMPLATE, deTemplateGetRefWidth(templ), false);
-  deDatatypeSetTemplate(datatype, templ);
-  return addToHashTable(datatype);
+  return internSimpleDatatype(DE_TYPE_TEMPLATE, deTemplateGetRefWidth(templ),
+      deTemplate2Index(templ), false);
 }
 
 // Create a class version datatype.  |width| is the width of an object reference for the class.
@@ -386,9 +450,8 @@ deDatatype deClassDatatypeCreate(deClass theClass) {
     return datatype;
   }
   utAssert(!deTemplateIsTemplate(deClassGetTemplate(theClass)));
-  datatype = datatypeCreate(DE_TYPE_CLASS, deClassGetRefWidth(theClass), true);
-  deDatatypeSetClass(datatype, theClass);
-  return addToHashTable(datatype);
+  return internSimpleDatatype(DE_TYPE_CLASS, deClassGetRefWidth(theClass),
+      deClass2Index(theClass), true);
 }
 
 // Create a class from the template parameters.  |tclassParams| is freed.
@@ -404,14 +467,11 @@ deDatatype deClassDatatypeCreateFromParams(deClass theClass, deDatatypeArray tem
   if (!deTemplateIsTemplate(templ)) {
     return deClassDatatypeCreate(deTemplateGetDefaultClass(templ));
   }
-  datatype = datatypeCreate(DE_TYPE_CLASS, deClassGetRefWidth(theClass), true);
-  if (numTypes != 0) {
-    deDatatypeResizeTypeLists(datatype, numTypes);
-    memcpy(deDatatypeGetTypeLists(datatype), deDatatypeArrayGetDatatypes(templParams),
-           numTypes * sizeof(deDatatype));
-  }
-  deDatatypeSetClass(datatype, theClass);
-  return addToHashTable(datatype);
+  deDatatypeKey key;
+  initKey(&key, DE_TYPE_CLASS, deClassGetRefWidth(theClass), deClass2Index(theClass));
+  key.numTypes = numTypes;
+  key.types = deDatatypeArrayGetDatatypes(templParams);
+  return internDatatype(&key, true);
 }
 
 // Return the function datatype.
@@ -426,9 +486,7 @@ deDatatype deFunctionDatatypeCreate(deFunction function) {
     case DE_FUNC_ITERATOR:
     case DE_FUNC_STRUCT:
     case DE_FUNC_TRANSFORMER: {
-      deDatatype datatype = datatypeCreate(DE_TYPE_FUNCTION, 0, false);
-      deDatatypeSetFunction(datatype, function);
-      return addToHashTable(datatype);
+      return internSimpleDatatype(DE_TYPE_FUNCTION, 0, deFunction2Index(function), false);
     }
     case DE_FUNC_ENUM:
       return deEnumClassDatatypeCreate(function);
@@ -444,28 +502,8 @@ deDatatype deFunctionDatatypeCreate(deFunction function) {
 
 // Return the function pointer datatype.  Do not the datatypes array.
 deDatatype deFuncptrDatatypeCreate(deDatatype returnType, deDatatypeArray parameterTypes) {
-  deDatatype datatype = datatypeCreate(DE_TYPE_FUNCPTR, 0, true);
-  deDatatypeSetReturnType(datatype, returnType);
-  uint32 numTypes = deDatatypeArrayGetUsedDatatype(parameterTypes);
-  deDatatypeResizeTypeLists(datatype, numTypes);
-  for (uint32 i = 0; i < numTypes; i++) {
-    deDatatypeSetiTypeList(datatype, i, deDatatypeArrayGetiDatatype(parameterTypes, i));
-  }
-  return addToHashTable(datatype);
-}
-
-// Fill out the sub-datatype list on the datatype.  Free |types|.
-static void fillDatatypeTypeList(deDatatype datatype, deDatatypeArray types) {
-  uint32 numTypes = deDatatypeArrayGetUsedDatatype(types);
-  deDatatypeResizeTypeLists(datatype, numTypes);
-  for (uint32 i = 0; i < numTypes; i++) {
-    deDatatype subType = deDatatypeArrayGetiDatatype(types, i);
-    deDatatypeSetiTypeList(datatype, i, subType);
-    if (deDatatypeContainsArray(subType)) {
-      deDatatypeSetContainsArray(datatype, true);
-    }
-  }
-  deDatatypeArrayFree(types);
+  return internDatatypeWithTypes(DE_TYPE_FUNCPTR, deDatatype2Index(returnType),
+      parameterTypes, true);
 }
 
 // Return true if all the datatypes in the array are concrete.
@@ -483,9 +521,73 @@ static deDatatype findNonConcreteDatatype(deDatatypeArray types) {
 // Free the types array.
 deDatatype deTupleDatatypeCreate(deDatatypeArray types) {
   bool concrete = findNonConcreteDatatype(types) == deDatatypeNull;
-  deDatatype datatype = datatypeCreate(DE_TYPE_TUPLE, 0, concrete);
-  fillDatatypeTypeList(datatype, types);
-  return addToHashTable(datatype);
+  deDatatype datatype = internDatatypeWithTypes(DE_TYPE_TUPLE, 0, types, concrete);
+  deDatatypeArrayFree(types);
+  return datatype;
+}
+
+// Create a fixed-sized array datatype, which is a tuple of |length| elements of
+// |elementType|.  Tuples are stored inline, so these need no heap buffer.
+deDatatype deFixedArrayDatatypeCreate(deDatatype elementType, uint32 length) {
+  deDatatype *types = utCalloc(length == 0? 1 : length, sizeof(deDatatype));
+  for (uint32 i = 0; i < length; i++) {
+    types[i] = elementType;
+  }
+  deDatatypeKey key;
+  initKey(&key, DE_TYPE_TUPLE, 0, 0);
+  key.fixedArray = true;
+  key.numTypes = length;
+  key.types = types;
+  deDatatype datatype = internDatatype(&key, length == 0 || deDatatypeConcrete(elementType));
+  utFree(types);
+  return datatype;
+}
+
+// Return true if the datatype was declared as a fixed-sized array, such as
+// with arrayof(u8, 32).  These can be indexed by non-constant indexes.  Tuples
+// that merely have elements of the same type, like (1, 2), cannot.
+bool deDatatypeIsFixedArray(deDatatype datatype) {
+  return deDatatypeFixedArray(datatype);
+}
+
+// Return true if the datatype can be a vector lane: a non-secret 8, 16, 32 or
+// 64 bit integer, or a float.  Secrecy applies to the whole vector.
+bool deDatatypeIsValidVectorElement(deDatatype elementType) {
+  if (deDatatypeSecret(elementType)) {
+    return false;
+  }
+  deDatatypeType type = deDatatypeGetType(elementType);
+  uint32 width = deDatatypeGetWidth(elementType);
+  if (type == DE_TYPE_FLOAT) {
+    return true;
+  }
+  return (type == DE_TYPE_UINT || type == DE_TYPE_INT) &&
+      (width == 8 || width == 16 || width == 32 || width == 64);
+}
+
+// Create a vector datatype, such as f32x8.  If it already exists, return the
+// old one.  Vectors are values, like integers, and lower to LLVM <N x T> types.
+deDatatype deVectorDatatypeCreate(deDatatype elementType, uint32 lanes) {
+  utAssert(deDatatypeIsValidVectorElement(elementType));
+  return internSimpleDatatype(DE_TYPE_VECTOR, lanes, deDatatype2Index(elementType), true);
+}
+
+// Return true if the datatype is a vector, or a tuple or struct holding one.
+bool deDatatypeContainsVector(deDatatype datatype) {
+  deDatatypeType type = deDatatypeGetType(datatype);
+  if (type == DE_TYPE_VECTOR) {
+    return true;
+  }
+  if (type != DE_TYPE_TUPLE && type != DE_TYPE_STRUCT) {
+    return false;
+  }
+  deDatatype subType;
+  deForeachDatatypeTypeList(datatype, subType) {
+    if (deDatatypeContainsVector(subType)) {
+      return true;
+    }
+  } deEndDatatypeTypeList;
+  return false;
 }
 
 // Create a struct datatype.  If it already exists, return the old one.
@@ -496,32 +598,30 @@ deDatatype deStructDatatypeCreate(deFunction structFunction, deDatatypeArray typ
     deError(line, "Struct  %s has non-concrete datatype %s",
         deFunctionGetName(structFunction), deDatatypeGetTypeString(nonConcreteDatatype));
   }
-  deDatatype datatype = datatypeCreate(DE_TYPE_STRUCT, 0, true);
-  deDatatypeSetFunction(datatype, structFunction);
-  fillDatatypeTypeList(datatype, types);
-  return addToHashTable(datatype);
+  deDatatype datatype = internDatatypeWithTypes(DE_TYPE_STRUCT,
+      deFunction2Index(structFunction), types, true);
+  deDatatypeArrayFree(types);
+  return datatype;
 }
 
 // Create a tuple datatype for the struct.
 deDatatype deGetStructTupleDatatype(deDatatype structDatatype) {
   utAssert(deDatatypeGetType(structDatatype) == DE_TYPE_STRUCT);
-  deDatatype tupleDatatype = copyDatatype(structDatatype);
-  deDatatypeSetFunction(tupleDatatype, deFunctionNull);
-  deDatatypeSetType(tupleDatatype, DE_TYPE_TUPLE);
-  return addToHashTable(tupleDatatype);
+  deDatatypeKey key;
+  keyFromDatatype(&key, structDatatype);
+  key.type = DE_TYPE_TUPLE;
+  key.member = 0;
+  return internDatatype(&key, deDatatypeConcrete(structDatatype));
 }
 
 // Create an enum or enumclass datatype.  If it already exists, return the old one.
 static deDatatype enumDatatypeCreate(deDatatypeType type, deFunction enumFunction, bool concrete) {
-  deDatatype datatype = datatypeCreate(type, 0, concrete);
   uint32 width = 0;
   deVariable var = deBlockGetFirstVariable(deFunctionGetSubBlock(enumFunction));
   if (var != deVariableNull) {
     width = deDatatypeGetWidth(deVariableGetDatatype(var));
   }
-  deDatatypeSetWidth(datatype, width);
-  deDatatypeSetFunction(datatype, enumFunction);
-  return addToHashTable(datatype);
+  return internSimpleDatatype(type, width, deFunction2Index(enumFunction), concrete);
 }
 
 // Create an enumclass datatype.  If it already exists, return the old one.
@@ -544,9 +644,10 @@ deDatatype deSetDatatypeNullable(deDatatype datatype, bool nullable) {
   if (type != DE_TYPE_CLASS && type != DE_TYPE_TEMPLATE) {
     return datatype;
   }
-  deDatatype nullableDatatype = copyDatatype(datatype);
-  deDatatypeSetNullable(nullableDatatype, nullable);
-  return addToHashTable(nullableDatatype);
+  deDatatypeKey key;
+  keyFromDatatype(&key, datatype);
+  key.nullable = nullable;
+  return internDatatype(&key, deDatatypeConcrete(datatype));
 }
 
 // Make the datatype secret.  If it already exists in the secret form, return
@@ -555,9 +656,10 @@ deDatatype deSetDatatypeSecret(deDatatype datatype, bool secret) {
   if (deDatatypeSecret(datatype) == secret) {
     return datatype;
   }
-  deDatatype secretDatatype = copyDatatype(datatype);
-  deDatatypeSetSecret(secretDatatype, secret);
-  return addToHashTable(secretDatatype);
+  deDatatypeKey key;
+  keyFromDatatype(&key, datatype);
+  key.secret = secret;
+  return internDatatype(&key, deDatatypeConcrete(datatype));
 }
 
 // Set the Uint/Int type to signed or unsigned.
@@ -701,6 +803,8 @@ char *deDatatypeGetDefaultValueString(deDatatype datatype) {
     case DE_TYPE_ENUMCLASS:
     case DE_TYPE_ENUM:
       return getEnumClassDefaultValue(datatype);
+    case DE_TYPE_VECTOR:
+      return deDatatypeGetTypeString(datatype);
     case DE_TYPE_NONE:
       return "None";
     case DE_TYPE_FUNCTION:
@@ -815,6 +919,9 @@ char *deDatatypeGetTypeString(deDatatype datatype) {
     }
     case DE_TYPE_FUNCTION:
       return utSprintf("func %s", deFunctionGetName(deDatatypeGetFunction(datatype)));
+    case DE_TYPE_VECTOR:
+      return utSprintf("%sx%u", deDatatypeGetTypeString(deDatatypeGetElementType(datatype)),
+          deDatatypeGetWidth(datatype));
     case DE_TYPE_NONE:
       return "None";
     case DE_TYPE_EXPR:
@@ -845,6 +952,34 @@ static bool matchDotDotDotTypeConstraint(deBlock scopeBlock,
   return leftWidth <= width && width <= rightWidth;
 }
 
+// Match a vector type constraint, e.g. f32x8 or vectorof(u8, 32).  Only
+// literal element types and lane counts are supported.
+static bool matchVectorTypeConstraint(deDatatype datatype, deExpression typeExpression) {
+  if (deDatatypeGetType(datatype) != DE_TYPE_VECTOR) {
+    return false;
+  }
+  deExpression elementExpr = deExpressionGetFirstExpression(typeExpression);
+  deExpression lanesExpr = deExpressionGetNextExpression(elementExpr);
+  if (deExpressionGetType(lanesExpr) != DE_EXPR_INTEGER) {
+    deError(deExpressionGetLine(typeExpression), "Vector lane counts must be constant integers");
+  }
+  uint32 lanes = deBigintGetUint32(deExpressionGetBigint(lanesExpr),
+      deExpressionGetLine(lanesExpr));
+  deDatatype elementType = deDatatypeGetElementType(datatype);
+  uint32 width = deExpressionGetWidth(elementExpr);
+  switch (deExpressionGetType(elementExpr)) {
+    case DE_EXPR_UINTTYPE:
+      return lanes == deDatatypeGetWidth(datatype) && elementType == deUintDatatypeCreate(width);
+    case DE_EXPR_INTTYPE:
+      return lanes == deDatatypeGetWidth(datatype) && elementType == deIntDatatypeCreate(width);
+    case DE_EXPR_FLOATTYPE:
+      return lanes == deDatatypeGetWidth(datatype) && elementType == deFloatDatatypeCreate(width);
+    default:
+      deError(deExpressionGetLine(typeExpression), "Invalid vector type constraint");
+  }
+  return false;  // Dummy return.
+}
+
 // Match the datatype against the identifier expression.
 static bool datatypeMatchesIdentExpression(deBlock scopeBlock, deDatatype datatype,
     deExpression typeExpression) {
@@ -987,6 +1122,8 @@ bool deDatatypeMatchesTypeExpression(deBlock scopeBlock, deDatatype datatype,
       return datatype == deSetDatatypeSecret(deBoolDatatypeCreate(), secret);
     case DE_EXPR_NONETYPE:
       return datatype == deNoneDatatypeCreate();
+    case DE_EXPR_VECTOROF:
+      return matchVectorTypeConstraint(datatype, typeExpression);
     case DE_EXPR_DOTDOTDOT:
       return matchDotDotDotTypeConstraint(scopeBlock, datatype, typeExpression);
     default:
@@ -1012,6 +1149,17 @@ static deDatatype unifyTupleDatatypes(deDatatype datatype1, deDatatype datatype2
   if (deDatatypeGetNumTypeList(datatype2) != numElements) {
     return deDatatypeNull;
   }
+  if (deDatatypeFixedArray(datatype1) && deDatatypeFixedArray(datatype2)) {
+    if (numElements == 0) {
+      return datatype1;
+    }
+    deDatatype unifiedType = deUnifyDatatypes(deDatatypeGetiTypeList(datatype1, 0),
+        deDatatypeGetiTypeList(datatype2, 0));
+    if (unifiedType == deDatatypeNull) {
+      return deDatatypeNull;
+    }
+    return deFixedArrayDatatypeCreate(unifiedType, numElements);
+  }
   deDatatypeArray datatypes = deDatatypeArrayAlloc();
   for (uint32 i = 0; i < numElements; i++) {
     deDatatype elementType1 = deDatatypeGetiTypeList(datatype1, i);
@@ -1106,6 +1254,7 @@ deSecretType deFindDatatypeSectype(deDatatype datatype) {
     case DE_TYPE_FLOAT:
     case DE_TYPE_ENUMCLASS:
     case DE_TYPE_ENUM:
+    case DE_TYPE_VECTOR:
       return deDatatypeSecret(datatype)? DE_SECTYPE_ALL_SECRET : DE_SECTYPE_ALL_PUBLIC;
     case DE_TYPE_ARRAY:
       return deFindDatatypeSectype(deDatatypeGetElementType(datatype));
@@ -1192,6 +1341,14 @@ static deDatatype findUniqueConcreteTemplateDatatype(deDatatype datatype) {
 
 // Find a concrete datatype for the array if it is unique.
 static deDatatype findUniqueConcreteTupleDatatype(deDatatype datatype, deExpression expression) {
+  if (deDatatypeFixedArray(datatype) && deDatatypeGetNumTypeList(datatype) != 0) {
+    deDatatype concreteType = deFindUniqueConcreteDatatype(
+        deDatatypeGetiTypeList(datatype, 0), expression);
+    if (concreteType == deDatatypeNull) {
+      return deDatatypeNull;
+    }
+    return deFixedArrayDatatypeCreate(concreteType, deDatatypeGetNumTypeList(datatype));
+  }
   deDatatypeArray types = deDatatypeArrayAlloc();
   deDatatype type;
   deForeachDatatypeTypeList(datatype, type) {
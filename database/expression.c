@@ -39,7 +39,7 @@ uint32 getPrecedence(deExpressionType type) {
       return 13;
     case DE_EXPR_NOT: case DE_EXPR_NEGATE: case DE_EXPR_SECRET:
     case DE_EXPR_REVEAL: case DE_EXPR_FUNCADDR: case DE_EXPR_TYPEOF:
-    case DE_EXPR_WIDTHOF: case DE_EXPR_ARRAYOF: case DE_EXPR_BITNOT:
+    case DE_EXPR_WIDTHOF: case DE_EXPR_ARRAYOF: case DE_EXPR_VECTOROF: case DE_EXPR_BITNOT:
     case DE_EXPR_ISNULL:
       return 14;
     case DE_EXPR_CALL: case DE_EXPR_CAST:
@@ -446,6 +446,9 @@ void deDumpExpressionStr(deString string, deExpression expression) {
     case DE_EXPR_ARRAYOF:
       dumpBuiltinExpr(string, expression, "arrayof");
       break;
+    case DE_EXPR_VECTOROF:
+      dumpBuiltinExpr(string, expression, "vectorof");
+      break;
     case DE_EXPR_TYPEOF:
       dumpBuiltinExpr(string, expression, "typeof");
       break;
@@ -725,6 +728,7 @@ deExpression deCopyExpression(deExpression expression) {
       deExpressionGetLine(expression));
   deExpressionSetDatatype(newExpression, deExpressionGetDatatype(expression));
   deExpressionSetIsType(newExpression, deExpressionIsType(expression));
+  deExpressionSetInBounds(newExpression, deExpressionInBounds(expression));
   switch (deExpressionGetType(expression)) {
     case DE_EXPR_INTEGER:
       deExpressionSetBigint(newExpression, deCopyBigint(deExpressionGetBigint(expression)));
@@ -798,6 +802,7 @@ static void setExpressionToValue(deExpression expression, deValue value) {
     case DE_TYPE_FUNCTION:
     case DE_TYPE_FUNCPTR:
     case DE_TYPE_ENUMCLASS:
+    case DE_TYPE_VECTOR:
     case DE_TYPE_EXPR:
       utExit("Cannot morph an expression into this type of value");
       break;
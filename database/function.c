@@ -119,6 +119,8 @@ static deFunction copyFunction(deFunction function, deBlock destBlock, bool shal
     newBlock = deCopyBlock(subBlock);
   }
   deFunctionInsertSubBlock(newFunction, newBlock);
+  deFunctionSetCompactor(newFunction, deFunctionCompactor(function));
+  deFunctionSetBulkAllocator(newFunction, deFunctionBulkAllocator(function));
   deExpression typeConstraint = deFunctionGetTypeExpression(function);
   if (typeConstraint != deExpressionNull) {
     deExpression newTypeConstraint = deCopyExpression(typeConstraint);
@@ -77,6 +77,19 @@ deBlock deSignatureGetBlock(deSignature signature) {
   return deFunctionGetSubBlock(deSignatureGetFunction(signature));
 }
 
+// Signatures, in an open-addressed hash table with linear probing.  Each slot
+// caches the hash of its signature.  Signatures are destroyed along with their
+// functions, leaving deleted slots that later inserts reuse.
+typedef struct {
+  uint32 hash;
+  bool deleted;
+  deSignature signature;
+} deSignatureSlot;
+
+static deSignatureSlot *deSignatureTable;
+static uint32 deSignatureTableSize;  // Always a power of 2.
+static uint32 deNumSignatureSlotsUsed;  // Including deleted ones.
+
 // Compute a 32-bit hash of the signature.
 static uint32 hashSignature(deFunction function, deDatatypeArray parameterTypes) {
   uint32 hash = deFunction2Index(function);
@@ -87,18 +100,6 @@ static uint32 hashSignature(deFunction function, deDatatypeArray parameterTypes)
   return hash;
 }
 
-// Add the signature to the hash table.
-static void addToHashTable(deSignature signature, deDatatypeArray parameterTypes) {
-  uint32 hash = hashSignature(deSignatureGetFunction(signature), parameterTypes);
-  deSignatureBin bin = deRootFindSignatureBin(deTheRoot, hash);
-  if (bin == deSignatureBinNull) {
-    bin = deSignatureBinAlloc();
-    deSignatureBinSetHash(bin, hash);
-    deRootInsertSignatureBin(deTheRoot, bin);
-  }
-  deSignatureBinInsertSignature(bin, signature);
-}
-
 // Determine if the signature is for the same function or class call with the
 // same types.
 static bool signatureMatches(deSignature signature, deFunction function, deDatatypeArray parameterTypes) {
@@ -119,20 +120,121 @@ static bool signatureMatches(deSignature signature, deFunction function, deDatat
   return true;
 }
 
-// Lookup a function signature from the function and array of datatypes.
-deSignature deLookupSignature(deFunction function, deDatatypeArray parameterTypes) {
+// Return the slot holding the matching signature, or NULL if there is none.
+// If |freeSlot| is not NULL, set it to the first slot where the signature could
+// be inserted.
+static deSignatureSlot *findSignatureSlot(deFunction function, deDatatypeArray parameterTypes,
+    uint32 hash, deSignatureSlot **freeSlot) {
+  uint32 mask = deSignatureTableSize - 1;
+  deSignatureSlot *firstDeleted = NULL;
+  for (uint32 i = hash & mask;; i = (i + 1) & mask) {
+    deSignatureSlot *slot = deSignatureTable + i;
+    if (slot->signature == deSignatureNull) {
+      if (!slot->deleted) {
+        if (freeSlot != NULL) {
+          *freeSlot = firstDeleted != NULL? firstDeleted : slot;
+        }
+        return NULL;
+      }
+      if (firstDeleted == NULL) {
+        firstDeleted = slot;
+      }
+    } else if (slot->hash == hash && signatureMatches(slot->signature, function, parameterTypes)) {
+      return slot;
+    }
+  }
+}
+
+// Rebuild the table, dropping deleted slots, and double its size if it is
+// crowded with live signatures.
+static void rehashSignatureTable(bool grow) {
+  deSignatureSlot *oldTable = deSignatureTable;
+  uint32 oldSize = deSignatureTableSize;
+  if (grow) {
+    deSignatureTableSize <<= 1;
+  }
+  deSignatureTable = utCalloc(deSignatureTableSize, sizeof(deSignatureSlot));
+  deNumSignatureSlotsUsed = 0;
+  uint32 mask = deSignatureTableSize - 1;
+  for (uint32 i = 0; i < oldSize; i++) {
+    if (oldTable[i].signature != deSignatureNull) {
+      uint32 j = oldTable[i].hash & mask;
+      while (deSignatureTable[j].signature != deSignatureNull) {
+        j = (j + 1) & mask;
+      }
+      deSignatureTable[j] = oldTable[i];
+      deNumSignatureSlotsUsed++;
+    }
+  }
+  utFree(oldTable);
+}
+
+// Add the signature to the hash table.  It replaces any older signature with
+// the same function and types.
+static void addToHashTable(deSignature signature, deDatatypeArray parameterTypes) {
+  deFunction function = deSignatureGetFunction(signature);
   uint32 hash = hashSignature(function, parameterTypes);
-  deSignatureBin bin = deRootFindSignatureBin(deTheRoot, hash);
-  if (bin == deSignatureBinNull) {
-    return deSignatureNull;
+  deSignatureSetHash(signature, hash);
+  deSignatureSlot *freeSlot;
+  deSignatureSlot *slot = findSignatureSlot(function, parameterTypes, hash, &freeSlot);
+  if (slot != NULL) {
+    slot->signature = signature;
+    return;
   }
-  deSignature signature;
-  deForeachSignatureBinSignature(bin, signature) {
-    if (signatureMatches(signature, function, parameterTypes)) {
-      return signature;
+  if (!freeSlot->deleted) {
+    deNumSignatureSlotsUsed++;
+  }
+  freeSlot->hash = hash;
+  freeSlot->deleted = false;
+  freeSlot->signature = signature;
+  if (deNumSignatureSlotsUsed > deSignatureTableSize >> 1) {
+    uint32 numLive = 0;
+    for (uint32 i = 0; i < deSignatureTableSize; i++) {
+      if (deSignatureTable[i].signature != deSignatureNull) {
+        numLive++;
+      }
+    }
+    rehashSignatureTable(numLive > deSignatureTableSize >> 2);
+  }
+}
+
+// Remove a signature being destroyed from the hash table.
+static void removeFromHashTable(deSignature signature) {
+  uint32 mask = deSignatureTableSize - 1;
+  for (uint32 i = deSignatureGetHash(signature) & mask;; i = (i + 1) & mask) {
+    deSignatureSlot *slot = deSignatureTable + i;
+    if (slot->signature == signature) {
+      slot->signature = deSignatureNull;
+      slot->deleted = true;
+      return;
     }
-  } deEndSignatureBinSignature;
-  return deSignatureNull;
+    if (slot->signature == deSignatureNull && !slot->deleted) {
+      return;  // It was replaced by a newer signature with the same types.
+    }
+  }
+}
+
+// Lookup a function signature from the function and array of datatypes.
+deSignature deLookupSignature(deFunction function, deDatatypeArray parameterTypes) {
+  uint32 hash = hashSignature(function, parameterTypes);
+  deSignatureSlot *slot = findSignatureSlot(function, parameterTypes, hash, NULL);
+  return slot == NULL? deSignatureNull : slot->signature;
+}
+
+// Initialize the signature hash table.
+void deSignatureStart(void) {
+  deSignatureTableSize = 1024;
+  deSignatureTable = utCalloc(deSignatureTableSize, sizeof(deSignatureSlot));
+  deNumSignatureSlotsUsed = 0;
+  deSignatureSetDestructorCallback(removeFromHashTable);
+}
+
+// Free memory used by the signature hash table.
+void deSignatureStop(void) {
+  deSignatureSetDestructorCallback(NULL);
+  utFree(deSignatureTable);
+  deSignatureTable = NULL;
+  deSignatureTableSize = 0;
 }
 
 // Create a new parameter specification object on the signature.
@@ -90,6 +90,7 @@ deStatement deStatementCreate(deBlock block, deStatementType type, deLine line)
   utAssert(line != deLineNull);
   deStatementSetLine(statement, line);
   deStatementSetGenerated(statement, deGenerating || deInIterator);
+  deStatementSetUnsafe(statement, deUnsafeDepth != 0);
   deBlockAppendStatement(block, statement);
   return statement;
 }
@@ -109,6 +110,9 @@ static void copyExpressionAndSubBlockToNewStatement(deStatement statement,
   }
   deStatementSetInstantiated(newStatement, deStatementInstantiated(statement));
   deStatementSetExecuted(newStatement, deStatementExecuted(statement));
+  deStatementSetUnsafe(newStatement, deStatementUnsafe(statement));
+  deStatementSetParallel(newStatement, deStatementParallel(statement));
+  deStatementSetArena(newStatement, deStatementArena(statement));
 }
 
 // Append a deep copy of the statement to destBlock.
@@ -28,10 +28,10 @@ syn keyword runeThrowKeywords throw
 syn keyword runeBoolean true false
 syn keyword runeBuiltinFunc arrayof assert isnull mod null ref reveal typeof unref widthof
 syn keyword runeConditional else if case default switch
-syn keyword runeRepeat do for in while
+syn keyword runeRepeat do for in parallel while
 syn keyword runeImport as import importlib importrpc use
-syn keyword runeStatements println print return yield
-syn keyword runeQualifierKeywords const export exportlib extern final secret signed unsigned var
+syn keyword runeStatements arena println print return yield
+syn keyword runeQualifierKeywords const export exportlib extern final packed secret signed unsafe unsigned var
 syn keyword runeDeclKeywords enum transform transformer iterator operator rpc struct message unittest
 syn keyword runeRelationKeywords relation appendcode prependcode cascade
 
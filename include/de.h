@@ -33,13 +33,26 @@ void deStart(char *fileName);
 void deStop(void);
 deValue deEvaluateExpression(deBlock scopeBlock, deExpression expression, deBigint modulus);
 void deAddMemoryManagement(void);
+void deReadFieldProfile(char *fileName);
+void deChooseRefWidths(void);
 void deCallFinalInDestructors(void);
+void deAddBulkAllocators(void);
 void deParseBuiltinFunctions(void);
 deBlock deParseModule(char *fileName, deBlock destPackageBlock,
                       bool isMainModule, deLine importLine);
 void deParseString(char *string, deBlock currentBlock);
+double deWallTime(void);
+void deTimeReportBeginPhase(char *name);
+void deTimeReportEndPhase(void);
+void deTimeReportAddModule(char *fileName, double seconds);
+void deTimeReportCountIRLines(char *llvmFileName);
+void deTimeReportPrint(char *jsonFileName);
+void deTimeReportStop(void);
 deStatement deInlineIterator(deBlock scopeBlock, deStatement statement);
 void deConstantPropagation(deBlock scopeBlock, deBlock block);
+void dePropagateConstantsAcrossSignatures(void);
+bool deEvaluateCallAtCompileTime(deExpression call);
+void deClearCompileTimeResults(void);
 void deInstantiateRelation(deStatement statement);
 void deAnalyzeRechability(deBlock block);
 
@@ -57,6 +70,12 @@ void deBindRPCs(void);
 void deBind(void);
 void deReportEvents(void);
 void deInlineIterators(void);
+void deEliminateBoundsChecks(bool report);
+bool deIsRangeCall(deExpression call);
+void deMarkBorrowedVariables(void);
+void deCheckParallelStatements(void);
+bool deProgramUsesArenas(void);
+void deExpandArenaStatements(void);
 void deBindAllSignatures(void);
 void deBindStatement(deBinding binding);
 void deQueueSignature(deSignature signature);
@@ -72,6 +91,7 @@ void dePostProcessPrintStatement(deStatement statement);
 void deCreateVariableConstraintBinding(deSignature signature, deVariable var);
 void deCreateLocalAndGlobalVariables(void);
 void deCreateBlockVariables(deBlock scopeBlock, deBlock block);
+void deCreateStatementVariables(deBlock scopeBlock, deStatement statement);
 
 // Block methods.
 deBlock deBlockCreate(deFilepath filepath, deBlockType type, deLine line);
@@ -171,6 +191,7 @@ void deDumpTemplateStr(deString string, deTemplate templ);
 deClass deClassCreate(deTemplate templ, deSignature signature);
 deClass deTemplateGetDefaultClass(deTemplate templ);
 deTemplate deCopyTemplate(deTemplate templ, deFunction destConstructor);
+void deTemplateAddCompactFunction(deTemplate templ);
 void deGenerateDefaultMethods(deClass theClass);
 deFunction deGenerateDefaultToStringMethod(deClass theClass);
 deFunction deGenerateDefaultShowMethod(deClass theClass);
@@ -299,6 +320,7 @@ deBigint deNativeUintBigintCreate(uint64 value);
 deBigint deZeroBigintCreate(bool isSigned, uint32 width);
 uint32 deHashBigint(deBigint bigint);
 bool deBigintsEqual(deBigint bigint1, deBigint bigint2);
+int32 deBigintCompare(deBigint bigint1, deBigint bigint2);
 uint32 deBigintGetUint32(deBigint bigint, deLine line);
 int32 deBigintGetInt32(deBigint bigint, deLine line);
 uint64 deBigintGetUint64(deBigint bigint, deLine line);
@@ -323,9 +345,10 @@ deFloat deFloatNegate(deFloat theFloat);
 char *deFloatToString(deFloat floatVal);
 deFloat deCopyFloat(deFloat theFloat);
 
-// Datatype, and DatatypeBin methods.
+// Datatype methods.
 void deDatatypeStart(void);
 void deDatatypeStop(void);
+uint32 deCountDatatypes(void);
 deDatatype deUnifyDatatypes(deDatatype datatype1, deDatatype datatype2);
 void deRefineAccessExpressionDatatype(deBlock scopeBlock, deExpression target,
     deDatatype valueType);
@@ -348,6 +371,15 @@ deDatatype deClassDatatypeCreateFromParams(deClass theClass,
 deDatatype deFunctionDatatypeCreate(deFunction function);
 deDatatype deFuncptrDatatypeCreate(deDatatype returnType, deDatatypeArray parameterTypes);
 deDatatype deTupleDatatypeCreate(deDatatypeArray types);
+// Fixed-sized arrays are tuples with a type list entry per element, so keep them short.
+#define DE_MAX_FIXED_ARRAY_LENGTH 4096u
+deDatatype deFixedArrayDatatypeCreate(deDatatype elementType, uint32 length);
+bool deDatatypeIsFixedArray(deDatatype datatype);
+// Vector lanes are 8 to 64 bit integers or f32/f64, and there are 2 to 64 of them.
+#define DE_MAX_VECTOR_LANES 64u
+deDatatype deVectorDatatypeCreate(deDatatype elementType, uint32 lanes);
+bool deDatatypeIsValidVectorElement(deDatatype elementType);
+bool deDatatypeContainsVector(deDatatype datatype);
 deDatatype deStructDatatypeCreate(deFunction structFunction, deDatatypeArray types, deLine line);
 deDatatype deGetStructTupleDatatype(deDatatype structDatatype);
 deDatatype deEnumClassDatatypeCreate(deFunction enumFunction);
@@ -369,6 +401,9 @@ deDatatype deFindUniqueConcreteDatatype(deDatatype datatype,
 deSecretType deFindDatatypeSectype(deDatatype datatype);
 deSecretType deCombineSectypes(deSecretType a, deSecretType b);
 bool deDatatypeIsTemplate(deDatatype datatype);
+// With -nativeints, integers up to this width are LLVM integers rather than bigints.
+#define DE_MAX_NATIVE_INT_WIDTH 512
+bool deIntegerWidthIsBigint(uint32 width);
 static inline bool deDatatypeTypeIsInteger(deDatatypeType type) {
   return type == DE_TYPE_UINT || type == DE_TYPE_INT || type == DE_TYPE_MODINT;
 }
@@ -381,6 +416,9 @@ static inline bool deDatatypeSigned(deDatatype datatype) {
 static inline bool deDatatypeIsFloat(deDatatype datatype) {
   return deDatatypeGetType(datatype) == DE_TYPE_FLOAT;
 }
+static inline bool deDatatypeIsVector(deDatatype datatype) {
+  return deDatatypeGetType(datatype) == DE_TYPE_VECTOR;
+}
 static inline bool deDatatypeTypeIsNumber(deDatatypeType type) {
   return type == DE_TYPE_UINT || type == DE_TYPE_INT || type == DE_TYPE_MODINT || type == DE_TYPE_FLOAT;
 }
@@ -388,7 +426,9 @@ static inline bool deDatatypeIsNumber(deDatatype datatype) {
   return deDatatypeTypeIsNumber(deDatatypeGetType(datatype));
 }
 
-// Signature, SignatureBin, and Paramspec methods.
+// Signature and Paramspec methods.
+void deSignatureStart(void);
+void deSignatureStop(void);
 deSignature deLookupSignature(deFunction function, deDatatypeArray parameterTypes);
 deSignature deSignatureCreate(deFunction function,
     deDatatypeArray parameterTypes, deLine line);
@@ -442,7 +482,8 @@ deDatatype deBindBuiltinCall(deBlock scopeBlock, deFunction function,
 extern deTemplate deArrayTemplate, deFuncptrTemplate, deFunctionTemplate,
     deBoolTemplate, deStringTemplate, deUintTemplate, deIntTemplate,
     deModintTemplate, deFloatTemplate, deTupleTemplate, deStructTemplate,
-    deEnumTemplate, deClassTemplate;
+    deEnumTemplate, deClassTemplate, deVectorTemplate;
+uint32 deFindVectorLanes(deExpression lanesExpr);
 
 // String methods.  Strings are uniquified and stored in a hash table.  To use a
 // string as a buffer, call deStringAlloc, and later deStringFree.
@@ -552,6 +593,28 @@ extern char *deLibDir;
 extern char *deRunePackageDir;
 extern char *deProjectPackageDir;
 extern bool deUnsafeMode;
+extern uint32 deUnsafeDepth;
+extern char *deUnsafeModules;
+extern bool deReserveFieldArrays;
+extern bool deBitPackFields;
+extern uint32 dePrefetchDistance;
+// Set by -layout to override which classes are declared packed.
+typedef enum {
+  DE_LAYOUT_DECLARED,  // Pack classes declared packed.
+  DE_LAYOUT_SOA,  // Never pack: one array per data member.
+  DE_LAYOUT_AOS,  // Pack every class.
+} deLayout;
+extern deLayout deClassLayout;
+extern bool deProfileFields;
+extern bool deHeapProfile;
+extern bool deInstrumentCode;
+extern bool deTimeReport;
+extern char *deParseCacheDir;
+extern uint32 deParseJobs;
+extern uint32 deNumInlinedIterators;
+extern bool deCoroutineIterators;
+extern bool deUnwindExceptions;
+extern bool deNativeWideInts;
 extern bool deDebugMode;
 extern bool deLogTokens;
 extern bool deInvertReturnCode;
@@ -15,6 +15,9 @@
 #ifndef EXPERIMENTAL_WAYWARDGEEK_RUNE_INCLUDE_LLEXPORT_H_
 #define EXPERIMENTAL_WAYWARDGEEK_RUNE_INCLUDE_LLEXPORT_H_
 
-void llGenerateLLVMAssemblyCode(char* fileName, bool debugMode);
+void llGenerateLLVMAssemblyCode(char* fileName, bool debugMode, char **moduleText,
+    size_t *moduleLength);
+bool llCompileToObject(char *llvmFileName, char *moduleText, size_t moduleLength,
+    char *objectFileName, bool optimized, bool debugMode);
 
 #endif  // EXPERIMENTAL_WAYWARDGEEK_RUNE_INCLUDE_LLEXPORT_H_
@@ -0,0 +1,104 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Optimize the generated LLVM module and emit its object file in process, with
+// the LLVM C API, rather than running clang on it.  The module is still built
+// as IR text by genllvm.c: it is parsed from memory, not built with LLVMBuild*
+// calls.  This is only built when the LLVM C API is available: build with make
+// LLVM_CAPI=1.
+
+#include "ll.h"
+
+#ifdef RN_LLVM_CAPI
+#include <llvm-c/Core.h>
+#include <llvm-c/Error.h>
+#include <llvm-c/IRReader.h>
+#include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
+#include <llvm-c/Transforms/PassBuilder.h>
+
+// Print the LLVM error message, free it, and return false.
+static bool reportLLVMError(char *what, char *fileName, char *message) {
+  printf("%s %s: %s\n", what, fileName, message == NULL? "unknown error" : message);
+  if (message != NULL) {
+    LLVMDisposeMessage(message);
+  }
+  return false;
+}
+
+// Parse the LLVM IR in |moduleText|, which is |moduleLength| bytes followed by
+// a '\0', or if it is NULL, the IR or bitcode in |llvmFileName|.  Run the -O3
+// pipeline on it, or -O0 in debug mode, and write the object code to
+// |objectFileName|.  Like clang, code is generated for a generic CPU of the
+// module's target triple.  Return false on failure, after printing why.
+bool llCompileToObject(char *llvmFileName, char *moduleText, size_t moduleLength,
+    char *objectFileName, bool optimized, bool debugMode) {
+  LLVMInitializeNativeTarget();
+  LLVMInitializeNativeAsmPrinter();
+  char *message = NULL;
+  LLVMMemoryBufferRef buffer;
+  if (moduleText != NULL) {
+    // The buffer does not copy or own the text.  The parser needs the '\0'.
+    buffer = LLVMCreateMemoryBufferWithMemoryRange(moduleText, moduleLength, llvmFileName, true);
+  } else if (LLVMCreateMemoryBufferWithContentsOfFile(llvmFileName, &buffer, &message)) {
+    return reportLLVMError("Could not read", llvmFileName, message);
+  }
+  LLVMContextRef context = LLVMContextCreate();
+  LLVMModuleRef module;
+  // This takes ownership of the buffer.
+  if (LLVMParseIRInContext(context, buffer, &module, &message)) {
+    LLVMContextDispose(context);
+    return reportLLVMError("Could not parse", llvmFileName, message);
+  }
+  const char *triple = LLVMGetTarget(module);
+  LLVMTargetRef target;
+  if (LLVMGetTargetFromTriple(triple, &target, &message)) {
+    LLVMDisposeModule(module);
+    LLVMContextDispose(context);
+    return reportLLVMError("No LLVM target for", llvmFileName, message);
+  }
+  bool optimize = optimized && !debugMode;
+  LLVMTargetMachineRef machine = LLVMCreateTargetMachine(target, triple, "generic", "",
+      optimize? LLVMCodeGenLevelAggressive : LLVMCodeGenLevelNone, LLVMRelocPIC,
+      LLVMCodeModelDefault);
+  LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+  LLVMErrorRef error = LLVMRunPasses(module, optimize? "default<O3>" : "default<O0>",
+      machine, options);
+  LLVMDisposePassBuilderOptions(options);
+  bool passed = true;
+  if (error != NULL) {
+    char *errorMessage = LLVMGetErrorMessage(error);
+    printf("Could not optimize %s: %s\n", llvmFileName, errorMessage);
+    LLVMDisposeErrorMessage(errorMessage);
+    passed = false;
+  } else if (LLVMTargetMachineEmitToFile(machine, module, objectFileName, LLVMObjectFile,
+      &message)) {
+    passed = reportLLVMError("Could not write", objectFileName, message);
+  }
+  LLVMDisposeTargetMachine(machine);
+  LLVMDisposeModule(module);
+  LLVMContextDispose(context);
+  return passed;
+}
+
+#else
+
+// Without the LLVM C API, say how to get it.
+bool llCompileToObject(char *llvmFileName, char *moduleText, size_t moduleLength,
+    char *objectFileName, bool optimized, bool debugMode) {
+  printf("This rune was built without the LLVM C API.  Rebuild with make LLVM_CAPI=1\n");
+  return false;
+}
+
+#endif  // RN_LLVM_CAPI
@@ -25,8 +25,8 @@ static uint32 llTagNum;
 static llTag createDatatypeTag(deDatatype datatype);
 static uint32 findDatatypeSize(deDatatype datatype);
 
-// Create a new debug tag.
-static llTag createTag(char *text) {
+// Create a new metadata tag, or return the existing one with the same text.
+llTag llCreateTag(char *text) {
   llTag tag = llRootFindTag(deTheRoot, text, strlen(text) + 1);
   if (tag != llTagNull) {
     return tag;
@@ -46,7 +46,7 @@ static void createFilepathTag(deFilepath filepath) {
   char *fileName = utBaseName(path);
   char *dirName = utDirName(path);
   char *text = utSprintf("!DIFile(filename: \"%s\", directory: \"%s\")", fileName, dirName);
-  llTag tag = createTag(text);
+  llTag tag = llCreateTag(text);
   // Also set all our package parent filepaths to point to this tag, if they do
   // not already have a tag.  This causes package functions and some globals to
   // be assigned to the first module loaded in a package.
@@ -58,7 +58,6 @@ static void createFilepathTag(deFilepath filepath) {
 
 // Generate file tags.  They have the form:
 void llCreateFilepathTags(void) {
-  llTagNum = LL_NUM_HEADER_TAGS + 1;
   deFilepath filepath;
   deForeachRootFilepath(deTheRoot, filepath) {
     deBlock moduleBlock = deFilepathGetModuleBlock(filepath);
@@ -87,7 +86,7 @@ uint32 llCreateSignatureTag(deSignature signature) {
     text = utSprintf( "distinct !DISubprogram(name: \"%s\", file: !%u, line: %u, "
         "isLocal: true, isDefinition: true)", path, llTagGetNum(fileTag));
   }
-  llTag tag = createTag(text);
+  llTag tag = llCreateTag(text);
   return llTagGetNum(tag);
 }
 
@@ -102,7 +101,7 @@ static llTag createPointerTag(deDatatype datatype) {
   char *text = utSprintf(
       "!DIDerivedType(tag: DW_TAG_pointer_type, baseType: !%u, size: %u)",
       baseTypeNum, llSizeWidth);
-  pointerTag = createTag(text);
+  pointerTag = llCreateTag(text);
   llDatatypeSetPointerTag(datatype, pointerTag);
   return pointerTag;
 }
@@ -114,7 +113,7 @@ static llTag createMemberTag(char *name, llTag baseTypeTag, uint32 size, uint32
   char *text = utSprintf(
       "!DIDerivedType(tag: DW_TAG_member, name: \"%s\", baseType: !%u, size: %u, offset: %u)",
       name, baseTypeNum, size, offset);
-  llTag memberTag = createTag(text);
+  llTag memberTag = llCreateTag(text);
   return memberTag;
 }
 
@@ -133,12 +132,12 @@ static llTag createArrayTypeTag(deDatatype datatype) {
   deDatatype sizetDatatype = deUintDatatypeCreate(llSizeWidth);
   llTag sizeTypeTag = createDatatypeTag(sizetDatatype);
   llTag numElementsTag = createMemberTag("numElements", sizeTypeTag, llSizeWidth, llSizeWidth);
-  llTag arrayElements = createTag(utSprintf("!{!%u, !%u}", llTagGetNum(dataMemberTag),
+  llTag arrayElements = llCreateTag(utSprintf("!{!%u, !%u}", llTagGetNum(dataMemberTag),
       llTagGetNum(numElementsTag)));
   char *text = utSprintf(
       "distinct !DICompositeType(tag: DW_TAG_structure_type, size: %u, elements: !%u)",
       2*llSizeWidth, llTagGetNum(arrayElements));
-  llTag tag = createTag(text);
+  llTag tag = llCreateTag(text);
   llDatatypeSetTag(datatype, tag);
   return tag;
 }
@@ -158,7 +157,7 @@ static llTag createClassTypeTag(deDatatype datatype) {
   char *text = utSprintf(
       "!DIDerivedType(tag: DW_TAG_typedef, name: \"class.%s\", file: !%u, line: %u, baseType: !%u)\n",
       classTypeName, llTagGetNum(fileTag), deLineGetLineNum(line), llTagGetNum(baseTypeTag));
-  return createTag(text);
+  return llCreateTag(text);
 }
 
 // Pad |offset| to be a multiple of |size|.
@@ -204,6 +203,8 @@ static uint32 findDatatypeSize(deDatatype datatype) {
     case DE_TYPE_TUPLE:
     case DE_TYPE_STRUCT:
       return findTupleSize(datatype);
+    case DE_TYPE_VECTOR:
+      return deDatatypeGetWidth(datatype) * findDatatypeSize(deDatatypeGetElementType(datatype));
     default:
       utExit("Unexpected datatype");
   }
@@ -229,7 +230,7 @@ static llTag createTupleOrStructTag(deDatatype datatype) {
           "!DIDerivedType(tag: DW_TAG_member, baseType: !%u, size: %u, offset: %u)\n",
           llTagGetNum(elementTag), size, offset);
     }
-    llTag tag = createTag(text);
+    llTag tag = llCreateTag(text);
     llTagArrayAppendTag(tags, tag);
     offset += size;
   } deEndDatatypeTypeList;
@@ -248,7 +249,7 @@ static llTag createTupleOrStructTag(deDatatype datatype) {
   } llEndTagArrayTag;
   text = utSprintf("%s})", text);
   llTagArrayFree(tags);
-  return createTag(text);
+  return llCreateTag(text);
 }
 
 // Create an enumerated type tag.  E.g.:
@@ -268,7 +269,7 @@ static llTag createEnumTag(deDatatype datatype) {
   deForeachBlockVariable(enumBlock, var) {
     text = utSprintf("!DIEnumerator(name: \"%s\", value: %u, isUnsigned: true)",
         deVariableGetName(var), deVariableGetEntryValue(var));
-    llTag tag = createTag(text);
+    llTag tag = llCreateTag(text);
     llTagArrayAppendTag(tags, tag);
   } deEndBlockVariable;
   text = "!{";
@@ -284,20 +285,20 @@ static llTag createEnumTag(deDatatype datatype) {
   } llEndTagArrayTag;
   text = utSprintf("%s}", text);
   llTagArrayFree(tags);
-  llTag elementsTag = createTag(text);
+  llTag elementsTag = llCreateTag(text);
   deFilepath filepath = deBlockGetFilepath(enumBlock);
   llTag fileTag = llFilepathGetTag(filepath);
   deDatatype baseDatatype = deVariableGetDatatype(deBlockGetFirstVariable(enumBlock));
   uint32 width = deDatatypeGetWidth(baseDatatype);
   text = utSprintf(
     "!DIBasicType(name: \"u%u\", size: %u, encoding: DW_ATE_unsigned)", width, width);
-  llTag baseTypeTag = createTag(text);
+  llTag baseTypeTag = llCreateTag(text);
   text = utSprintf(
       "!DICompositeType(tag: DW_TAG_enumeration_type, file: !%u, line: %u, "
       "baseType: !%u, size: %u, elements: !%u)", llTagGetNum(fileTag),
       deLineGetLineNum(deFunctionGetLine(enumFunc)), llTagGetNum(baseTypeTag), width,
       llTagGetNum(elementsTag));
-  return createTag(text);
+  return llCreateTag(text);
 }
 
 // Create a tag for a function pointer datatype.  For example:
@@ -322,13 +323,28 @@ static llTag createFuncptrTag(deDatatype datatype) {
     text = utSprintf("%s, !%u", text, llTagGetNum(tag));
   } deEndDatatypeTypeList;
   text = utSprintf("%s}\n", text);
-  llTag argsTag = createTag(text);
-  llTag funcTypeTag = createTag(utSprintf("!DISubroutineType(types: !%u)", llTagGetNum(argsTag)));
-  return createTag(utSprintf(
+  llTag argsTag = llCreateTag(text);
+  llTag funcTypeTag = llCreateTag(utSprintf("!DISubroutineType(types: !%u)", llTagGetNum(argsTag)));
+  return llCreateTag(utSprintf(
       "!DIDerivedType(tag: DW_TAG_pointer_type, baseType: !%u, size: %s)",
       llTagGetNum(funcTypeTag), llSize));
 }
 
+// Create a tag for a vector datatype.  For example, f32x4 is:
+//   !12 = !DICompositeType(tag: DW_TAG_array_type, baseType: !13, size: 128,
+//         flags: DIFlagVector, elements: !14)
+//   !14 = !{!15}
+//   !15 = !DISubrange(count: 4)
+static llTag createVectorTag(deDatatype datatype) {
+  llTag elementTag = createDatatypeTag(deDatatypeGetElementType(datatype));
+  llTag rangeTag = llCreateTag(utSprintf("!DISubrange(count: %u)", deDatatypeGetWidth(datatype)));
+  llTag elementsTag = llCreateTag(utSprintf("!{!%u}", llTagGetNum(rangeTag)));
+  return llCreateTag(utSprintf(
+      "!DICompositeType(tag: DW_TAG_array_type, baseType: !%u, size: %u, "
+      "flags: DIFlagVector, elements: !%u)", llTagGetNum(elementTag),
+      findDatatypeSize(datatype), llTagGetNum(elementsTag)));
+}
+
 // Create a type tag for the datatype if it does not already exist.
 static llTag createDatatypeTag(deDatatype datatype) {
   llTag tag = llDatatypeGetTag(datatype);
@@ -337,7 +353,7 @@ static llTag createDatatypeTag(deDatatype datatype) {
   }
   char *text = NULL;
   deDatatypeType type = deDatatypeGetType(datatype);
-  if (deDatatypeTypeIsInteger(type) && deDatatypeGetWidth(datatype) > llSizeWidth) {
+  if (llDatatypeIsBigint(datatype)) {
     return createArrayTypeTag(datatype);
   }
   switch (type) {
@@ -399,12 +415,14 @@ static llTag createDatatypeTag(deDatatype datatype) {
       return createEnumTag(datatype);
     case DE_TYPE_FUNCPTR:
       return createFuncptrTag(datatype);
+    case DE_TYPE_VECTOR:
+      return createVectorTag(datatype);
     case DE_TYPE_MODINT:
     case DE_TYPE_EXPR:
       utExit("Unexpected type");
       break;
   }
-  return createTag(text);
+  return llCreateTag(text);
 }
 
 // Create global variable tags.
@@ -420,11 +438,11 @@ void llCreateGlobalVariableTags(deBlock block) {
           "distinct !DIGlobalVariable(name: \"%s\", scope: !0, file: !%u, line: %u, "
           "type: !%u, isLocal: false, isDefinition: true)",
           llEscapeText(deVariableGetName(globalVar)), fileNum, line, datatypeNum);
-      llTag globalVarTag = createTag(globalVarText);
+      llTag globalVarTag = llCreateTag(globalVarText);
       char *globalVarExprText = utSprintf(
           "!DIGlobalVariableExpression(var: !%u, expr: !DIExpression())",
           llTagGetNum(globalVarTag));
-      llTag tag = createTag(globalVarExprText);
+      llTag tag = llCreateTag(globalVarExprText);
       llVariableSetTag(globalVar, tag);
     }
   } deEndBlockVariable;
@@ -434,7 +452,7 @@ void llCreateGlobalVariableTags(deBlock block) {
 // most likely switch to having main declared in the runtime, and have it
 // Initialize a global array of strings to the parameters.
 static uint32 createMainTypeTag(void) {
-  llTag tag = createTag("!DISubroutineType(types: !{null})");
+  llTag tag = llCreateTag("!DISubroutineType(types: !{null})");
   return llTagGetNum(tag);
 }
 
@@ -449,7 +467,7 @@ llTag llGenerateMainTags(void) {
       "distinct !DISubprogram(name: \"main\", scope: !%u, file: !%u, line: %u, type: !%u, "
       "isLocal: false, isDefinition: true, scopeLine: %u, isOptimized: false, unit: !0)",
       fileNum, fileNum, line, typeNum, line);
-  llTag tag = createTag(text);
+  llTag tag = llCreateTag(text);
   return tag;
 }
 
@@ -473,7 +491,7 @@ static uint32 createSignatureTypeTag(deSignature signature) {
     }
   }
   deStringPuts(buf, "})");
-  llTag tag = createTag(deStringGetCstr(buf));
+  llTag tag = llCreateTag(deStringGetCstr(buf));
   deStringDestroy(buf);
   return llTagGetNum(tag);
 }
@@ -490,7 +508,7 @@ void llGenerateSignatureTags(deSignature signature) {
       "distinct !DISubprogram(name: \"%s\", scope: !%u, file: !%u, line: %u, type: !%u, "
       "isLocal: false, isDefinition: true, scopeLine: %u, isOptimized: false, unit: !0)",
       name, fileNum, fileNum, line, typeNum, line);
-  llTag tag = createTag(text);
+  llTag tag = llCreateTag(text);
   llSignatureSetTag(signature, tag);
 }
 
@@ -531,9 +549,18 @@ static void writeTagsHeader(void) {
   writeGlobalsTag(LL_NUM_HEADER_TAGS);
 }
 
-// Write debug tags to the output file.
-void llWriteDebugTags(void) {
-  writeTagsHeader();
+// Start numbering tags.  In debug mode, the first few are reserved for the
+// debug info header.
+void llStartTags(void) {
+  llTagNum = llDebugMode? LL_NUM_HEADER_TAGS + 1 : 0;
+}
+
+// Write metadata tags to the output file, with the debug info header in debug
+// mode.
+void llWriteTags(void) {
+  if (llDebugMode) {
+    writeTagsHeader();
+  }
   llTag tag;
   llForeachRootTag(deTheRoot, tag) {
     llPrintf("!%u = %s\n", llTagGetNum(tag), llTagGetText(tag));
@@ -544,7 +571,7 @@ void llWriteDebugTags(void) {
 llTag llCreateLocationTag(llTag scopeTag, deLine line) {
   char *text = utSprintf("!DILocation(line: %u, scope: !%u)",
       deLineGetLineNum(line), llTagGetNum(scopeTag));
-  return createTag(text);
+  return llCreateTag(text);
 }
 
 // Output a call to @llvm.dbg.declare to declare a local variable, and generate
@@ -566,7 +593,7 @@ void llDeclareLocalVariable(deVariable variable, uint32 argNum) {
       "!DILocalVariable(name: \"%s\"%s, scope: !%u, file: !%u, line: %u, type: !%u)",
       name, argPos, llTagGetNum(blockTag), llTagGetNum(fileTag),
       deVariableGetLine(variable), llTagGetNum(typeTag));
-  llTag localVarTag = createTag(localVarText);
+  llTag localVarTag = llCreateTag(localVarText);
   if (deVariableGetType(variable) == DE_VAR_PARAMETER) {
     char *suffix = "";
     if (!deVariableConst(variable) || llDatatypePassedByReference(datatype)) {
@@ -13,13 +13,32 @@
 // limitations under the License.
 
 // Generate LLVM IR assembly code.
+
+// This is required for open_memstream.  It must come before including ll.h,
+// which also includes stdio.h.
+#define _DEFAULT_SOURCE
 #include "ll.h"
 #include "runtime.h"
 #include <ctype.h>
 #include <math.h>
 #include <setjmp.h>
 
+// Everything printed in this file first prints any pending reference count
+// increment, since the new instructions could observe it.
+static void flushPendingRef(void);
+#undef llPrintf
+#undef llPuts
+#define llPrintf(...) (flushPendingRef(), deSprintToString(__VA_ARGS__))
+#define llPuts(text) (flushPendingRef(), deAddString(text))
+
 #define LL_TMPVARS_STRING ".tmpvars."
+// With -unwind, these comments bracket try bodies until calls in them are
+// rewritten as invokes.  The begin marker is followed by the landing pad label.
+#define LL_TRY_BEGIN_STRING "; try.begin "
+#define LL_TRY_END_STRING "; try.end"
+// LLVM backends only lower division and remainder of native integers up to
+// this width, through compiler-rt.  Wider native integers divide as bigints.
+#define LL_MAX_NATIVE_DIV_WIDTH 128
 
 // The LLVM IR output file.
 FILE* llAsmFile;
@@ -59,6 +78,57 @@ static utSym llBoundsCheckFailedLabel;
 static utSym llPrevLabel;  // Most recently printed label: used in phi instructions.
 // This is the number of setjmp buffers that need to be popped before a return.
 static uint32 llSetjmpDepth;
+// Set when a try statement is lowered with -unwind in the current function.
+static bool llFunctionHasTry;
+// Blocks split at invokes by lowerCallsToInvokes.
+typedef struct {
+  utSym label;
+  utSym lastLabel;
+} llSplitBlock;
+static llSplitBlock *llSplitBlocks;
+static uint32 llNumSplitBlocks, llSplitBlocksAllocated;
+// Set while generating an iterator as a coroutine.  Yields branch to these
+// labels when the coroutine is suspended or destroyed.
+static bool llInCoroutine;
+static utSym llCoroSuspendLabel;
+static utSym llCoroCleanupLabel;
+// The alignment of a coroutine's promise, which holds the yielded value.
+#define LL_COROUTINE_PROMISE_ALIGN 8
+// Parallel for bodies are outlined into functions numbered with llParallelNum,
+// which take the addresses of the variables they use in a context array.
+static uint32 llParallelNum;
+static deVariable *llParallelCaptures;
+static uint32 llNumParallelCaptures, llParallelCapturesAllocated;
+// Number of data member access counters, and the length of their names, when
+// profiling.
+static uint32 llNumProfiledFields;
+static uint32 llFieldNamesLen;
+// Number of entries in the table of class globals saveSnapshot writes, and a
+// hash of their names and types, if the program uses snapshots.
+static uint32 llNumSnapshotEntries;
+static uint64 llSnapshotLayoutHash;
+// Number of classes in the table of class memory globals for memoryStats.
+static uint32 llNumClassStats;
+static uint32 llNumClassStatsArrays;
+static uint32 llClassStatsNamesLen;
+// With -instrument, each counter is a global named @.instrumentCount<N>, and
+// llInstrumentNames has a "<kind> <file>:<line> <function>" line for each.
+static uint32 llNumInstrumentCounters;
+static deString llInstrumentNames;
+
+// Instrumentation counter kinds, which index llInstrumentKindNames.
+typedef enum {
+  LL_COUNT_CALL,
+  LL_COUNT_LOOP,
+  LL_COUNT_BOUNDS_CHECK,
+  LL_COUNT_REF,
+  LL_COUNT_UNREF,
+  LL_COUNT_RESIZE,
+  LL_COUNT_BIGINT,
+} llCounterKind;
+
+static char *llInstrumentKindNames[] = {"call", "loop", "boundsCheck", "ref", "unref", "resize",
+    "bigint"};
 
 typedef struct {
   deDatatype datatype;
@@ -68,6 +138,9 @@ typedef struct {
   bool isDelegate;  // The next element on the stack is the instance expression.
   bool isNull;  // The next element on the stack is the instance expression.
   bool isConst;  // To indicate a copy is needed for resize or other mutation.
+  llTag tbaaTag;  // Set on references to class member array elements.
+  utSym loadedFrom;  // The pointer a dereferenced element was loaded from.
+  uint32 loadNum;  // The llPrintNum of its load.
 } llElement;
 
 // Stack of elements.
@@ -92,6 +165,8 @@ static inline void llElementSetNeedsFree(llElement *element, bool value) {
 }
 static inline llElement llMakeEmptyElement(void) {
   llElement element = {0,};
+  element.tbaaTag = llTagNull;
+  element.loadedFrom = utSymNull;
   return element;
 }
 static inline bool llElementIsDelegate(llElement element) { return element.isDelegate; }
@@ -100,6 +175,13 @@ static inline void llSetTopOfStackAsDelegate(void) {
   element->isDelegate = true;
 }
 
+// Determine if safety checks are disabled for the statement being generated,
+// either globally with -U, or by an unsafe function, block or module.
+static inline bool uncheckedCode(void) {
+  return deUnsafeMode ||
+      (llCurrentStatement != deStatementNull && deStatementUnsafe(llCurrentStatement));
+}
+
 // Determine if |datatype| is a reference counted class.
 static inline bool isRefCounted(deDatatype datatype) {
   return !deStatementGenerated(llCurrentStatement) &&
@@ -107,6 +189,20 @@ static inline bool isRefCounted(deDatatype datatype) {
       deTemplateRefCounted(deClassGetTemplate(deDatatypeGetClass(datatype)));
 }
 
+// Return the !tbaa attachment for a load or store through the element, if any.
+static char *tbaaInfo(llElement element) {
+  if (element.tbaaTag == llTagNull) {
+    return "";
+  }
+  return utSprintf(", !tbaa !%u", llTagGetNum(element.tbaaTag));
+}
+
+// Return the !prof attachment for a runtime check branch.  Checks rarely fail,
+// so this lets LLVM lay out the failure paths as cold code.
+static char *checkBranchWeights(bool firstIsLikely) {
+  return utSprintf(", !prof !%u", llTagGetNum(llCreateBranchWeightsTag(firstIsLikely)));
+}
+
 // Generate a location tag if in debug mode.
 static char *locationInfo(void) {
   if (!llDebugMode) {
@@ -117,6 +213,27 @@ static char *locationInfo(void) {
   return utSprintf(", !dbg !%u", llTagGetNum(tag));
 }
 
+// With -instrument, count each time the code at |line| of the current
+// function runs.  The values are named, since a deferred ref, which counts
+// itself, can be printed after the next value number is taken.
+static void countEvent(llCounterKind kind, deLine line) {
+  if (!deInstrumentCode) {
+    return;
+  }
+  char *fileName = "?";
+  uint32 lineNum = 0;
+  if (line != deLineNull && deLineGetFilepath(line) != deFilepathNull) {
+    fileName = utSymGetName(deFilepathGetSym(deLineGetFilepath(line)));
+    lineNum = deLineGetLineNum(line);
+  }
+  uint32 num = llNumInstrumentCounters++;
+  deStringSprintf(llInstrumentNames, "%s %s:%u %s\n", llInstrumentKindNames[kind], fileName,
+      lineNum, *llPath == '\0'? "main" : llPath);
+  llPrintf("  %%ic%1$u.count = load i64, i64* @.instrumentCount%1$u\n"
+      "  %%ic%1$u.newCount = add i64 %%ic%1$u.count, 1\n"
+      "  store i64 %%ic%1$u.newCount, i64* @.instrumentCount%1$u\n", num);
+}
+
 // Print to llTmpValueBuf.
 static char *llTmpPrintf(char *format, ...) {
   va_list ap;
@@ -146,7 +263,94 @@ static bool classInstantiated(deClass theClass) {
   return false;
 }
 
-// Call the object's ref function.
+// An inline reference count increment that has not been printed yet.  It is
+// printed before the next instruction, unless an unref of the same object
+// comes first, which cancels it.
+typedef struct {
+  bool valid;
+  llElement element;  // The object being referenced.
+  deLine line;
+  llTag location;  // Its !dbg location in debug mode, else llTagNull.
+  uint32 printNum;  // The llPrintNum when the ref was deferred.
+} llRefRecord;
+static llRefRecord llPendingRef;
+// Counts prints to deStringVal, so we know when nothing came between two of them.
+static uint32 llPrintNum;
+// Numbers the %rc<N> temporaries of inline reference count updates.
+static uint32 llRefCountNum;
+
+// Print instructions setting %rc<num>.ptr to the address of the object's
+// reference count, which is its element in the class's nextFree array.
+// nextFree[0] is always 0, so the null object needs no special case.
+static void printRefCountPointer(deClass theClass, llElement element, uint32 num) {
+  uint32 refWidth = deClassGetRefWidth(theClass);
+  deVariable nextFree = deBlockGetFirstVariable(deClassGetSubBlock(theClass));
+  char *array = llGetVariableName(deVariableGetGlobalArrayVariable(nextFree));
+  llPrintf("  %%rc%1$u.dataAddr = getelementptr inbounds %%struct.runtime_array, "
+      "%%struct.runtime_array* %2$s, i32 0, i32 0\n", num, array);
+  llPrintf("  %%rc%1$u.data = load i%2$s*, i%2$s** %%rc%1$u.dataAddr, !nonnull !%3$u\n",
+      num, llSize, llTagGetNum(llCreateNonnullTag()));
+  llPrintf("  %%rc%1$u.counts = bitcast i%2$s* %%rc%1$u.data to i%3$u*\n", num, llSize, refWidth);
+  char *index = llElementGetName(element);
+  if (refWidth < 64) {
+    llPrintf("  %%rc%1$u.index = zext i%2$u %3$s to i64\n", num, refWidth, index);
+    index = utSprintf("%%rc%u.index", num);
+  }
+  llPrintf("  %%rc%1$u.ptr = getelementptr inbounds i%2$u, i%2$u* %%rc%1$u.counts, i64 %3$s\n",
+      num, refWidth, index);
+}
+
+// Print the pending ref, if any.  This is called before everything printed.
+static void flushPendingRef(void) {
+  llPrintNum++;
+  if (!llPendingRef.valid) {
+    return;
+  }
+  // Clear it first, since printing it calls this again.
+  llPendingRef.valid = false;
+  llElement element = llPendingRef.element;
+  deClass theClass = deDatatypeGetClass(llElementGetDatatype(element));
+  uint32 refWidth = deClassGetRefWidth(theClass);
+  uint32 num = llRefCountNum++;
+  printRefCountPointer(theClass, element, num);
+  llPrintf("  %%rc%1$u.count = load i%2$u, i%2$u* %%rc%1$u.ptr\n"
+      "  %%rc%1$u.live = icmp ne i%2$u %%rc%1$u.count, 0\n"
+      "  %%rc%1$u.inc = zext i1 %%rc%1$u.live to i%2$u\n"
+      "  %%rc%1$u.newCount = add i%2$u %%rc%1$u.count, %%rc%1$u.inc\n"
+      "  store i%2$u %%rc%1$u.newCount, i%2$u* %%rc%1$u.ptr%3$s\n",
+      num, refWidth, llPendingRef.location == llTagNull? "" :
+      utSprintf(", !dbg !%u", llTagGetNum(llPendingRef.location)));
+  countEvent(LL_COUNT_REF, llPendingRef.line);
+}
+
+// Return true if |element| is the object of the pending ref, either by name, or
+// because both were loaded from the same pointer, with nothing printed between
+// the first load and the ref.  Since then, only loads can have been printed.
+static bool isPendingRefObject(llElement element) {
+  llElement refElement = llPendingRef.element;
+  if (element.name == refElement.name) {
+    return true;
+  }
+  return element.loadedFrom != utSymNull && element.loadedFrom == refElement.loadedFrom &&
+      refElement.loadNum == llPendingRef.printNum;
+}
+
+// A ref followed by an unref of the same object, with nothing in between that
+// could observe the count, does nothing.  If the unref of |element| cancels the
+// pending ref, drop the ref and return true.
+static bool cancelPendingRef(deClass theClass, llElement element) {
+  if (!llPendingRef.valid ||
+      deDatatypeGetClass(llElementGetDatatype(llPendingRef.element)) != theClass ||
+      !isPendingRefObject(element)) {
+    return false;
+  }
+  llPendingRef.valid = false;
+  return true;
+}
+
+// Increment the object's reference count inline, unless it is 0, meaning the
+// object is null or has been destroyed.  This is deferred until the next
+// instruction is printed, in case an unref cancels it.
 static void refObject(llElement element) {
   if (llElementIsNull(element)) {
     return;
@@ -156,29 +360,54 @@ static void refObject(llElement element) {
   if (!classInstantiated(theClass)) {
     return;
   }
-  deBlock classBlock = deClassGetSubBlock(theClass);
-  char *location = locationInfo();
-  char* path = utSprintf("%s_ref", deGetBlockPath(classBlock, true));
-  llPrintf("  call void @%s(%s %s)%s\n", llEscapeIdentifier(path),
-      llGetTypeString(llElementGetDatatype(element), false),
-      llElementGetName(element), location);
-}
-
-// Call the object's unref function.
+  // Printing an earlier pending ref only stores a reference count, so it does
+  // not count as printing something between the element's load and this ref.
+  uint32 printNum = llPrintNum;
+  flushPendingRef();
+  llPendingRef.valid = true;
+  llPendingRef.element = element;
+  llPendingRef.line = llCurrentLine;
+  llPendingRef.location = llDebugMode? llCreateLocationTag(
+      llBlockGetTag(llCurrentScopeBlock), llCurrentLine) : llTagNull;
+  llPendingRef.printNum = printNum;
+}
+
+// Decrement the object's reference count inline when other references remain.
+// Only the release of the last reference calls the class's unref function,
+// which destroys the object.
 static void unrefObject(llElement element) {
   if (llElementIsNull(element)) {
     return;
   }
   deClass theClass = deDatatypeGetClass(llElementGetDatatype(element));
-  if (!classInstantiated(theClass)) {
+  if (!classInstantiated(theClass) || cancelPendingRef(theClass, element)) {
     return;
   }
-  deBlock classBlock = deClassGetSubBlock(theClass);
+  countEvent(LL_COUNT_UNREF, llCurrentLine);
+  uint32 refWidth = deClassGetRefWidth(theClass);
+  uint32 num = llRefCountNum++;
   char *location = locationInfo();
+  printRefCountPointer(theClass, element, num);
+  llPrintf("  %%rc%1$u.count = load i%2$u, i%2$u* %%rc%1$u.ptr\n"
+      "  %%rc%1$u.shared = icmp ugt i%2$u %%rc%1$u.count, 1\n"
+      "  br i1 %%rc%1$u.shared, label %%rc%1$u.dec, label %%rc%1$u.check%3$s\n"
+      "rc%1$u.dec:\n"
+      "  %%rc%1$u.newCount = sub i%2$u %%rc%1$u.count, 1\n"
+      "  store i%2$u %%rc%1$u.newCount, i%2$u* %%rc%1$u.ptr%4$s\n"
+      "  br label %%rc%1$u.done\n"
+      "rc%1$u.check:\n"
+      "  %%rc%1$u.last = icmp eq i%2$u %%rc%1$u.count, 1\n",
+      num, refWidth, checkBranchWeights(true), location);
+  llPrintf("  br i1 %%rc%1$u.last, label %%rc%1$u.release, label %%rc%1$u.done%2$s\n"
+      "rc%1$u.release:\n", num, checkBranchWeights(false));
+  deBlock classBlock = deClassGetSubBlock(theClass);
   char* path = utSprintf("%s_unref", deGetBlockPath(classBlock, true));
   llPrintf("  call void @%s(%s %s)%s\n", llEscapeIdentifier(path),
       llGetTypeString(llElementGetDatatype(element), false),
       llElementGetName(element), location);
+  llPrintf("  br label %%rc%1$u.done\n"
+      "rc%1$u.done:\n", num);
+  llPrevLabel = utSymCreateFormatted("rc%u.done", num);
 }
 
 // Create an element.
@@ -191,6 +420,9 @@ static inline llElement createElement(deDatatype datatype, char *name, bool isRe
   element.needsFree = false;
   element.isNull = false;
   element.isConst = false;
+  element.tbaaTag = llTagNull;
+  element.loadedFrom = utSymNull;
+  element.loadNum = 0;
   return element;
 }
 
@@ -230,6 +462,7 @@ void llDumpStack(void) {
 // Write the global string buffer to llAsmFile, and reset the global string
 // buffer.
 static void flushStringBuffer(void) {
+  flushPendingRef();
   // Print out the portion up to point where we need to insert llTmpValueBuffer.
   char *p = strstr(deStringVal, LL_TMPVARS_STRING);
   if (p != NULL) {
@@ -247,7 +480,7 @@ static void flushStringBuffer(void) {
 
 // Determine if a variable is local or global.
 static inline bool isLocal(deVariable variable) {
-  if (deVariableGetType(variable) == DE_VAR_PARAMETER) {
+  if (deVariableGetType(variable) == DE_VAR_PARAMETER || deVariableParallelPrivate(variable)) {
     return true;
   }
   deFunction function = deBlockGetOwningFunction(deVariableGetBlock(variable));
@@ -345,11 +578,16 @@ static inline llElement *pushTmpValue(deDatatype datatype, uint32 value, bool is
 static llElement derefAnyElement(llElement *element) {
   deDatatype datatype = llElementGetDatatype(*element);
   char *typeString = llGetTypeString(datatype, true);
-  uint32 value = printNewValue();
-  llPrintf("load %s, %s* %s\n", typeString, typeString, llElementGetName(*element));
+  // A load cannot observe a reference count, so this does not print a pending ref.
+  uint32 value = ++llVarNum;
+  deSprintToString("  %%%u = load %s, %s* %s%s\n", value, typeString, typeString,
+      llElementGetName(*element), tbaaInfo(*element));
+  element->loadedFrom = element->name;
+  element->loadNum = ++llPrintNum;
   char *name = utSprintf("%%%u", value);
   element->name = utSymCreate(name);
   element->isRef = false;
+  element->tbaaTag = llTagNull;
   return *element;
 }
 
@@ -363,11 +601,53 @@ static llElement derefElement(llElement *element) {
   return derefAnyElement(element);
 }
 
+// Unref the objects in a one-dimensional array of references with a loop
+// specialized to the class, which drops shared references inline, like
+// unrefObject, and only calls <Class>_unref to release the last one.  The
+// array's length and data pointer are reloaded each iteration, since
+// releasing an object can run a destructor that moves heap memory.
+static void unrefArrayElementsInline(llElement element, deClass theClass) {
+  uint32 num = llRefCountNum++;
+  uint32 refWidth = deClassGetRefWidth(theClass);
+  char *array = llElementGetName(element);
+  llPrintf("  br label %%ua%1$u.start\n"
+      "ua%1$u.start:\n"
+      "  br label %%ua%1$u.head\n"
+      "ua%1$u.head:\n"
+      "  %%ua%1$u.i = phi i%2$s [0, %%ua%1$u.start], [%%ua%1$u.next, %%ua%1$u.latch]\n"
+      "  %%ua%1$u.numAddr = getelementptr inbounds %%struct.runtime_array, "
+      "%%struct.runtime_array* %3$s, i32 0, i32 1\n"
+      "  %%ua%1$u.num = load i%2$s, i%2$s* %%ua%1$u.numAddr\n"
+      "  %%ua%1$u.more = icmp ult i%2$s %%ua%1$u.i, %%ua%1$u.num\n"
+      "  br i1 %%ua%1$u.more, label %%ua%1$u.body, label %%ua%1$u.done\n"
+      "ua%1$u.body:\n"
+      "  %%ua%1$u.dataAddr = getelementptr inbounds %%struct.runtime_array, "
+      "%%struct.runtime_array* %3$s, i32 0, i32 0\n"
+      "  %%ua%1$u.data = load i%2$s*, i%2$s** %%ua%1$u.dataAddr, !nonnull !%4$u\n"
+      "  %%ua%1$u.refs = bitcast i%2$s* %%ua%1$u.data to i%5$u*\n"
+      "  %%ua%1$u.ptr = getelementptr inbounds i%5$u, i%5$u* %%ua%1$u.refs, i%2$s %%ua%1$u.i\n"
+      "  %%ua%1$u.object = load i%5$u, i%5$u* %%ua%1$u.ptr\n",
+      num, llSize, array, llTagGetNum(llCreateNonnullTag()), refWidth);
+  unrefObject(createElement(deClassDatatypeCreate(theClass),
+      utSprintf("%%ua%u.object", num), false));
+  llPrintf("  br label %%ua%1$u.latch\n"
+      "ua%1$u.latch:\n"
+      "  %%ua%1$u.next = add i%2$s %%ua%1$u.i, 1\n"
+      "  br label %%ua%1$u.head\n"
+      "ua%1$u.done:\n",
+      num, llSize);
+  llPrevLabel = utSymCreateFormatted("ua%u.done", num);
+}
+
 // Unref the elements in the potentially multi-dimensional array.
 static void unrefArrayElements(llElement element, deDatatype baseType) {
   deClass theClass = deDatatypeGetClass(baseType);
   deBlock classBlock = deClassGetSubBlock(theClass);
   uint32 depth = deArrayDatatypeGetDepth(llElementGetDatatype(element));
+  if (depth == 1) {
+    unrefArrayElementsInline(element, theClass);
+    return;
+  }
   uint32 refWidth = deClassGetRefWidth(theClass);
   char* path = utSprintf("%s_unref", deGetBlockPath(classBlock, true));
 
@@ -379,7 +659,8 @@ static void unrefArrayElements(llElement element, deDatatype baseType) {
       llElementGetName(element), unrefPointer, refWidth, depth, locationInfo());
 }
 
-// Call runtime_freeArray on the variable.
+// Call runtime_freeArray on the variable, or runtime_freeSecretArray if it is
+// secret.
 static void callFree(llElement element) {
   deDatatype datatype = llElementGetDatatype(element);
   deDatatypeType type = deDatatypeGetType(datatype);
@@ -395,11 +676,26 @@ static void callFree(llElement element) {
         unrefArrayElements(element, baseType);
       }
     }
-    llDeclareRuntimeFunction("runtime_freeArray");
-    llPrintf("  call void @runtime_freeArray(%%struct.runtime_array* %s)\n", llElementGetName(element));
+    // Only secret data needs to be wiped before its memory is reused.
+    char* freeFunc = deDatatypeSecret(datatype)? "runtime_freeSecretArray" : "runtime_freeArray";
+    llDeclareRuntimeFunction(freeFunc);
+    llPrintf("  call void @%s(%%struct.runtime_array* %s)\n", freeFunc, llElementGetName(element));
   }
 }
 
+// If the string or array is of a secret type, mark its buffer secret, so the
+// runtime wipes it when it is resized or moved, not only when it is freed.
+static void markSecretArray(llElement array, bool markSubArrays) {
+  deDatatype datatype = llElementGetDatatype(array);
+  deDatatypeType type = deDatatypeGetType(datatype);
+  if (!deDatatypeSecret(datatype) || (type != DE_TYPE_STRING && type != DE_TYPE_ARRAY)) {
+    return;
+  }
+  llDeclareRuntimeFunction("runtime_markSecretArray");
+  llPrintf("  call void @runtime_markSecretArray(%%struct.runtime_array* %s, i1 zeroext %s)\n",
+      llElementGetName(array), boolVal(markSubArrays));
+}
+
 // Index into a tuple.  For values passed by reference, or if |getRef| is true,
 // return a pointer to the field of the tuple.
 // element.
@@ -477,7 +773,7 @@ static inline void pushInteger(deExpression expression) {
   deBigint bigint = deExpressionGetBigint(expression);
   // Get width from datatype in case this integer was auto-cast to a different width.
   uint32 width = deDatatypeGetWidth(deExpressionGetDatatype(expression));
-  if (width > llSizeWidth) {
+  if (deIntegerWidthIsBigint(width)) {
     pushBigint(expression);
     return;
   }
@@ -633,6 +929,7 @@ static char *getDefaultValue(deDatatype datatype) {
     case DE_TYPE_STRUCT:
     case DE_TYPE_MODINT:
     case DE_TYPE_FLOAT:
+    case DE_TYPE_VECTOR:
       return "zeroinitializer";
     case DE_TYPE_FUNCPTR:
       return "null";
@@ -654,7 +951,8 @@ static void initializeLocalVariable(deVariable variable) {
   if (deDatatypeContainsArray(datatype)) {
     llElement element = createElement(datatype, varName, true);
     addNeedsFreeElement(element);
-  } else if (!deVariableGenerated(variable) && isRefCounted(datatype)) {
+  } else if (!deVariableGenerated(variable) && !deVariableBorrowed(variable) &&
+      isRefCounted(datatype)) {
     llElement element = createElement(datatype, varName, true);
     addNeedsFreeElement(element);
   }
@@ -670,9 +968,42 @@ static void printMainTop(void) {
   llDeclareRuntimeFunction("runtime_initArrayFromCUTF8");
   llVarNum += 2;  // For argc and argv.
   llPrevLabel = utSymCreate("2");
+  if (deUnwindExceptions) {
+    llPuts("  store i8 1, i8* @runtime_unwindExceptions\n");
+  }
+  if (deNativeWideInts) {
+    llPuts("  store i8 1, i8* @runtime_nativeWideInts\n");
+  }
   llPrintf(
       "  call void @runtime_arrayStart()\n"
       "  call void @runtime_initArrayOfStringsFromCUTF8(%%struct.runtime_array* @argv, i8** %%1, i32 %%0)\n");
+  if (llNumProfiledFields != 0) {
+    llDeclareRuntimeFunction("runtime_startFieldProfile");
+    llPrintf("  call void @runtime_startFieldProfile("
+        "i8* getelementptr inbounds ([%1$u x i8], [%1$u x i8]* @.fieldNames, i64 0, i64 0), "
+        "i64* getelementptr inbounds ([%2$u x i64], [%2$u x i64]* @.fieldAccessCounts, i64 0, i64 0), "
+        "i32 %2$u, void ()* @.recordObjectCounts)\n", llFieldNamesLen, llNumProfiledFields);
+  }
+  if (llNumSnapshotEntries != 0) {
+    llDeclareRuntimeFunction("runtime_registerSnapshot");
+    llPrintf("  call void @runtime_registerSnapshot(%%struct.runtime_snapshotEntry* "
+        "getelementptr inbounds ([%1$u x %%struct.runtime_snapshotEntry], "
+        "[%1$u x %%struct.runtime_snapshotEntry]* @.snapshotEntries, i64 0, i64 0), "
+        "i32 %1$u, i64 %2$lld)\n", llNumSnapshotEntries, (long long)llSnapshotLayoutHash);
+  }
+  if (deInstrumentCode) {
+    llPrintf("  call void @.startInstrumentation()\n");
+  }
+  if (llNumClassStats != 0) {
+    llDeclareRuntimeFunction("runtime_registerClassStats");
+    llPrintf("  call void @runtime_registerClassStats("
+        "%%struct.runtime_classStatsEntry* getelementptr inbounds ([%1$u x "
+        "%%struct.runtime_classStatsEntry], [%1$u x %%struct.runtime_classStatsEntry]* "
+        "@.classStats, i64 0, i64 0), i32 %1$u, %%struct.runtime_array** bitcast ([%2$u x "
+        "%%struct.runtime_array*]* @.classStatsArrays to %%struct.runtime_array**), "
+        "i8* getelementptr inbounds ([%3$u x i8], [%3$u x i8]* @.classStatsNames, i64 0, i64 0))\n",
+        llNumClassStats, llNumClassStatsArrays, llClassStatsNamesLen);
+  }
 }
 
 // Declare parameter values so they are visible in gdb.
@@ -710,14 +1041,16 @@ static void printFunctionHeader(deBlock block, deSignature signature) {
   if (signature != deSignatureNull) {
     deDatatype returnType = deSignatureGetReturnType(signature);
     deDatatype retType = returnType;
-    bool returnsValuePassedByReference = llDatatypePassedByReference(returnType);
+    bool isCoroutine = deSignatureIsCoroutine(signature);
+    bool returnsValuePassedByReference = !isCoroutine && llDatatypePassedByReference(returnType);
     if (returnsValuePassedByReference) {
       // The first parameter will be a pointer to the returned value.
       retType = deNoneDatatypeCreate();
     }
     char *visibility = findBlockVisibility(block);
-    llPrintf("\ndefine %s %s @%s(", visibility, llGetTypeString(retType, false),
-        llEscapeIdentifier(llPath));
+    // Coroutines return their handle.
+    char *retTypeString = isCoroutine? "i8*" : llGetTypeString(retType, false);
+    llPrintf("\ndefine %s %s @%s(", visibility, retTypeString, llEscapeIdentifier(llPath));
     if (returnsValuePassedByReference) {
       first = false;
       llPrintf("%s* %%.retVal", llGetTypeString(returnType, true));
@@ -758,7 +1091,10 @@ static void printFunctionHeader(deBlock block, deSignature signature) {
   }
   llVarNum = 0;
   llTmpVarNum = 0;
+  llRefCountNum = 0;
+  utAssert(!llPendingRef.valid);
   llSetjmpDepth = 0;
+  llFunctionHasTry = false;
   llPuts(")");
   llPrevLabel = utSymCreate("0");
   if (llDebugMode) {
@@ -776,7 +1112,9 @@ static void printFunctionHeader(deBlock block, deSignature signature) {
   llNeedsFreePos = 0;
   if (block != deRootGetBlock(deTheRoot)) {
     while (variable != deVariableNull) {
-      if (deVariableInstantiated(variable) && isLocal(variable)) {
+      // Variables private to parallel for bodies are locals of the outlined bodies.
+      if (deVariableInstantiated(variable) && isLocal(variable) &&
+          !deVariableParallelPrivate(variable)) {
         initializeLocalVariable(variable);
       }
       variable = deVariableGetNextBlockVariable(variable);
@@ -832,6 +1170,9 @@ static llElement allocateTempArray(deDatatype datatype) {
   llTmpPrintf("  store %%struct.runtime_array zeroinitializer, %%struct.runtime_array* %%.tmp%u\n", value);
   llElement *result = pushTmpValue(datatype, value, true);
   llElementSetNeedsFree(result, true);
+  if (llDatatypeIsBigint(datatype)) {
+    countEvent(LL_COUNT_BIGINT, llCurrentLine);
+  }
   return *result;
 }
 
@@ -862,15 +1203,22 @@ static deDatatype getElementType(deDatatype arrayDatatype) {
   return deDatatypeGetElementType(arrayDatatype);
 }
 
-// Load the array.data pointer, and cast it to a |datatype| pointer.
-static llElement loadArrayDataPointer(llElement array) {
+// Load the array.data pointer, and cast it to a |datatype| pointer.  If
+// |nonempty|, the pointer is only used to index the array, which is not empty,
+// so it is marked !nonnull.  Empty arrays have a null data pointer.
+static llElement loadArrayDataPointer(llElement array, bool nonempty) {
   deDatatype elementDatatype = getElementType(llElementGetDatatype(array));
   uint32 dataPtrAddress = printNewValue();
   llPrintf(
       "getelementptr inbounds %%struct.runtime_array, %%struct.runtime_array* %s, i32 0, i32 0\n",
       llElementGetName(array));
   uint32 dataPtr = printNewValue();
-  llPrintf("load i%s*, i%s** %%%u%s\n", llSize, llSize, dataPtrAddress, locationInfo());
+  if (nonempty) {
+    llPrintf("load i%s*, i%s** %%%u, !nonnull !%u%s\n", llSize, llSize, dataPtrAddress,
+        llTagGetNum(llCreateNonnullTag()), locationInfo());
+  } else {
+    llPrintf("load i%s*, i%s** %%%u%s\n", llSize, llSize, dataPtrAddress, locationInfo());
+  }
   char *type = llGetTypeString(elementDatatype, true);
   uint32 castDataPtr = printNewValue();
   llPrintf("bitcast i%s* %%%u to %s*\n", llSize, dataPtr, type);
@@ -920,6 +1268,23 @@ static char *findBigintModularFunctionName(deExpression expression) {
   return NULL; // Dummy return.
 }
 
+// Return the runtime function that multiplies bigints.  Public values use the
+// variable time engine, which is much faster on large bigints.
+static char *findBigintMulFunction(bool isPublic, bool truncate) {
+  if (isPublic) {
+    return truncate? "runtime_publicBigintMulTrunc" : "runtime_publicBigintMul";
+  }
+  return truncate? "runtime_bigintMulTrunc" : "runtime_bigintMul";
+}
+
+// Return the runtime function that divides bigints, or finds the remainder.
+static char *findBigintDivFunction(bool isPublic, bool isMod) {
+  if (isPublic) {
+    return isMod? "runtime_publicBigintMod" : "runtime_publicBigintDiv";
+  }
+  return isMod? "runtime_bigintMod" : "runtime_bigintDiv";
+}
+
 // Return the runtime function name that can execute this expression.
 static char *findExpressionFunction(deExpression expression) {
   deDatatype datatype = deExpressionGetDatatype(expression);
@@ -932,18 +1297,20 @@ static char *findExpressionFunction(deExpression expression) {
   if (!llDatatypeIsBigint(datatype)) {
     return findSmallnumFunction(expression);
   }
+  // Public values multiply and divide with the faster variable time engine.
+  bool isPublic = !deDatatypeSecret(datatype);
   switch (deExpressionGetType(expression)) {
     case DE_EXPR_ADD: return "runtime_bigintAdd";
-    case DE_EXPR_ADDTRUNC: return deUnsafeMode? "runtime_bigintAdd" : "runtime_bigintAddTrunc";
+    case DE_EXPR_ADDTRUNC: return uncheckedCode()? "runtime_bigintAdd" : "runtime_bigintAddTrunc";
     case DE_EXPR_SUB: return "runtime_bigintSub";
-    case DE_EXPR_SUBTRUNC: return deUnsafeMode? "runtime_bigintSub" : "runtime_bigintSubTrunc";
-    case DE_EXPR_MUL: return "runtime_bigintMul";
-    case DE_EXPR_MULTRUNC: return deUnsafeMode? "runtime_bigintMul" : "runtime_bigintMulTrunc";
-    case DE_EXPR_DIV: return "runtime_bigintDiv";
-    case DE_EXPR_MOD: return "runtime_bigintMod";
+    case DE_EXPR_SUBTRUNC: return uncheckedCode()? "runtime_bigintSub" : "runtime_bigintSubTrunc";
+    case DE_EXPR_MUL: return findBigintMulFunction(isPublic, false);
+    case DE_EXPR_MULTRUNC: return findBigintMulFunction(isPublic, !uncheckedCode());
+    case DE_EXPR_DIV: return findBigintDivFunction(isPublic, false);
+    case DE_EXPR_MOD: return findBigintDivFunction(isPublic, true);
     case DE_EXPR_EXP: return "runtime_bigintExp";
     case DE_EXPR_NEGATE: return "runtime_bigintNeg";
-    case DE_EXPR_NEGATETRUNC: return deUnsafeMode? "runtime_bigintNeg" : "runtime_bigintNegTrunc";
+    case DE_EXPR_NEGATETRUNC: return uncheckedCode()? "runtime_bigintNeg" : "runtime_bigintNegTrunc";
     case DE_EXPR_BITNOT: return "runtime_bigintNot";
     case DE_EXPR_SHR: return "runtime_bigintShr";
     case DE_EXPR_SHL: return "runtime_bigintShl";
@@ -1056,8 +1423,11 @@ static llElement findDatatypeSize(deDatatype datatype) {
     case DE_TYPE_UINT:
     case DE_TYPE_INT: {
       uint32_t width = deDatatypeGetWidth(datatype);
-      if (deDatatypeGetWidth(datatype) > sizeof(size_t) << 3) {
+      if (deIntegerWidthIsBigint(width)) {
         return createSmallInteger(sizeof(runtime_array), llSizeWidth, false);
+      } else if (width > 64) {
+        // LLVM rounds wide native integers up to whole 64-bit words.
+        return createSmallInteger(((width + 63) >> 6)*sizeof(uint64_t), llSizeWidth, false);
       } else if (width > 32) {
         return createSmallInteger(sizeof(uint64_t), llSizeWidth, false);
       } else if (width > 16) {
@@ -1076,6 +1446,11 @@ static llElement findDatatypeSize(deDatatype datatype) {
       return findTupleSize(datatype);
     case DE_TYPE_STRUCT:
       return findTupleSize(deGetStructTupleDatatype(datatype));
+    case DE_TYPE_VECTOR: {
+      deDatatype elementType = deDatatypeGetElementType(datatype);
+      uint32 size = deDatatypeGetWidth(datatype) * (deDatatypeGetWidth(elementType) >> 3);
+      return createSmallInteger(size, llSizeWidth, false);
+    }
     case DE_TYPE_EXPR:
       utExit("Not expecting an expression type");
   }
@@ -1117,21 +1492,39 @@ static void copyArray(llElement access, llElement value, bool freeDest) {
       boolVal(hasSubArrays), location);
 }
 
-// Generate concatenation of a string or array.
+// Generate concatenation of a string or array.  The result is secret if either
+// operand is.
 static void generateConcat(llElement left, llElement right) {
   deDatatype datatype = llElementGetDatatype(left);
+  if (deDatatypeSecret(llElementGetDatatype(right))) {
+    datatype = deSetDatatypeSecret(datatype, true);
+  }
   deDatatype elementDatatype = deDatatypeGetElementType(datatype);
   llElement sizeValue = findDatatypeSize(elementDatatype);
-  llDeclareRuntimeFunction("runtime_concatArrays");
   char *location = locationInfo();
   allocateTempArray(datatype);
   llElement *destArray = topOfStack();
-  copyArray(*destArray, left, false);
   bool hasSubArrays = llDatatypeIsArray(elementDatatype);
+  if (!hasSubArrays && strcmp(llElementGetName(left), "zeroinitializer") &&
+      strcmp(llElementGetName(right), "zeroinitializer")) {
+    // Allocate the result once, rather than copying left and then growing it.
+    llDeclareRuntimeFunction("runtime_joinArrays");
+    llPrintf(
+        "  call void @runtime_joinArrays(%%struct.runtime_array* %s, %%struct.runtime_array* %s, "
+        "%%struct.runtime_array* %s, i%s %s)%s\n", llElementGetName(*destArray),
+        llElementGetName(left), llElementGetName(right), llSize, llElementGetName(sizeValue),
+        location);
+    markSecretArray(*destArray, false);
+    return;
+  }
+  llDeclareRuntimeFunction("runtime_concatArrays");
+  copyArray(*destArray, left, false);
+  markSecretArray(*destArray, true);
   llPrintf(
       "  call void @runtime_concatArrays(%%struct.runtime_array* %s, %%struct.runtime_array* %s, "
       "i%s %s, i1 zeroext %s)%s\n", llElementGetName(*destArray), llElementGetName(right),
       llSize, llElementGetName(sizeValue), boolVal(hasSubArrays), location);
+  markSecretArray(*destArray, true);
 }
 
 // Generate a concatenate expression.
@@ -1319,6 +1712,9 @@ static void generateOperatorOverloadCall(deExpression expression, deSignature si
   }
 }
 
+static void generateWideIntBigintCall(char *function, deDatatype datatype,
+    llElement *operands, uint32 numOperands, llElement *extraParam);
+
 // Generate an LLVM instruction for a binary operation.
 static void generateBasicBinaryOp(char *op, llElement leftElement, llElement rightElement) {
   deDatatype datatype = llElementGetDatatype(leftElement);
@@ -1354,6 +1750,13 @@ static void generateBinaryExpression(deExpression expression, char *op) {
     generateXorStringsExpression(leftElement, rightElement);
     return;
   }
+  if ((exprType == DE_EXPR_DIV || exprType == DE_EXPR_MOD) && llDatatypeIsWideInt(datatype) &&
+      deDatatypeGetWidth(datatype) > LL_MAX_NATIVE_DIV_WIDTH) {
+    llElement operands[2] = {leftElement, rightElement};
+    char *function = findBigintDivFunction(!deDatatypeSecret(datatype), exprType == DE_EXPR_MOD);
+    generateWideIntBigintCall(function, datatype, operands, 2, NULL);
+    return;
+  }
   generateBasicBinaryOp(op, leftElement, rightElement);
 }
 
@@ -1423,8 +1826,8 @@ static void generateBinaryExpressionWithOverflow(deExpression expression) {
   llPrintf("extractvalue {i%u, i1} %%%u, 1\n", width, structValue);
   utSym passed = newLabel("overflowCheckPassed");
   utSym failed = newLabel("overflowCheckFailed");
-  llPrintf("  br i1 %%%u, label %%%s, label %%%s\n",
-      overflowValue, utSymGetName(failed), utSymGetName(passed));
+  llPrintf("  br i1 %%%u, label %%%s, label %%%s%s\n",
+      overflowValue, utSymGetName(failed), utSymGetName(passed), checkBranchWeights(false));
   printLabel(failed);
   llDeclareRuntimeFunction("runtime_raiseOverflow");
   llPrintf("  call void @runtime_raiseOverflow()\n  unreachable\n");
@@ -1495,8 +1898,24 @@ static void generateArrayComparison(llElement left, llElement right, runtime_com
   bool hasSubArrays = arrayHasSubArrays(datatype);
   runtime_type primType = findRuntimeType(deDatatypeGetType(primDatatype));
   llElement elementSize = findDatatypeSize(primDatatype);
-  llDeclareRuntimeFunction("runtime_compareArrays");
   bool secret = deDatatypeSecret(datatype) || deDatatypeSecret(llElementGetDatatype(right));
+  if ((compareType == RN_EQUAL || compareType == RN_NOTEQUAL) && !hasSubArrays &&
+      !llDatatypeIsBigint(primDatatype)) {
+    // Equality skips the lexical comparison, and fails fast on lengths.
+    llDeclareRuntimeFunction("runtime_arraysEqual");
+    uint32 value = printNewValue();
+    llPrintf("call zeroext i1 @runtime_arraysEqual(%%struct.runtime_array* %s, "
+        "%%struct.runtime_array* %s, i%s %s, i1 zeroext %s)\n", llElementGetName(left),
+        llElementGetName(right), llSize, llElementGetName(elementSize), boolVal(secret));
+    if (compareType == RN_NOTEQUAL) {
+      uint32 notValue = printNewValue();
+      llPrintf("xor i1 %%%u, true\n", value);
+      value = notValue;
+    }
+    pushValue(deBoolDatatypeCreate(), value, false);
+    return;
+  }
+  llDeclareRuntimeFunction("runtime_compareArrays");
   uint32 value = printNewValue();
   llPrintf(
       "call i1 @runtime_compareArrays(i32 %u, i32 %u, "
@@ -1636,6 +2055,70 @@ static void generateComparison(llElement leftElement, llElement rightElement,
   generateBasicComparison(leftElement, rightElement, type);
 }
 
+// Forward declaration.
+static inline void resizeTop(uint32 width);
+
+// Generate a slice that refers to the source array's data rather than copying
+// it.  The view has no heap header and is never freed, so it is only used where
+// nothing can move or resize the source before the view is read.
+static void generateSliceView(deExpression expression) {
+  deExpression left = deExpressionGetFirstExpression(expression);
+  deExpression lower = deExpressionGetNextExpression(left);
+  deExpression upper = deExpressionGetNextExpression(lower);
+  deDatatype datatype = deExpressionGetDatatype(left);
+  deDatatype elementDatatype = deDatatypeGetElementType(datatype);
+  generateExpression(left);
+  llElement sourceElement = popElement(false);
+  generateExpression(lower);
+  resizeTop(llSizeWidth);
+  llElement lowerElement = popElement(true);
+  generateExpression(upper);
+  resizeTop(llSizeWidth);
+  llElement upperElement = popElement(true);
+  uint32 value = printNewTmpValue();
+  llTmpPrintf("alloca %%struct.runtime_array\n");
+  llElement *viewRef = pushTmpValue(datatype, value, true);
+  viewRef->isConst = true;
+  llElement viewElement = *viewRef;
+  llElement sizeValue = findDatatypeSize(elementDatatype);
+  llDeclareRuntimeFunction("runtime_viewArraySlice");
+  char *location = locationInfo();
+  llPrintf(
+      "  call void @runtime_viewArraySlice(%%struct.runtime_array* %s, %%struct.runtime_array* %s, "
+      "i%s %s, i%s %s, i%s %s)%s\n",
+      llElementGetName(viewElement), llElementGetName(sourceElement), llSize,
+      llElementGetName(lowerElement), llSize, llElementGetName(upperElement),
+      llSize, llElementGetName(sizeValue), location);
+}
+
+// Determine if evaluating the expression could call a function, which could
+// modify arrays that a slice view refers to.
+static bool expressionHasCall(deExpression expression) {
+  if (deExpressionGetType(expression) == DE_EXPR_CALL ||
+      deExpressionGetSignature(expression) != deSignatureNull) {
+    return true;
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    if (expressionHasCall(child)) {
+      return true;
+    }
+  }
+  deEndExpressionExpression;
+  return false;
+}
+
+// Generate an operand of a comparison.  Slices of flat arrays are compared in
+// place, rather than copied to a temporary array first.
+static void generateComparisonOperand(deExpression expression, bool allowView) {
+  if (allowView && deExpressionGetType(expression) == DE_EXPR_SLICE &&
+      !arrayHasSubArrays(deExpressionGetDatatype(expression))) {
+    generateSliceView(expression);
+  } else {
+    generateExpression(expression);
+  }
+}
+
 // Generate code for a relational expression.
 static void generateRelationalExpression(deExpression expression) {
   deSignature signature = deExpressionGetSignature(expression);
@@ -1645,9 +2128,10 @@ static void generateRelationalExpression(deExpression expression) {
   }
   deExpression left = deExpressionGetFirstExpression(expression);
   deExpression right = deExpressionGetNextExpression(left);
-  generateExpression(left);
+  bool allowViews = !expressionHasCall(expression);
+  generateComparisonOperand(left, allowViews);
   llElement leftElement = popElement(true);
-  generateExpression(right);
+  generateComparisonOperand(right, allowViews);
   llElement rightElement = popElement(true);
   runtime_comparisonType type = findBigintComparisonType(expression);
   generateComparison(leftElement, rightElement, type);
@@ -1662,6 +2146,65 @@ static uint32 getUintPointer(llElement element, uint32 width) {
   return value;
 }
 
+// Append |element| to |array| with a store and an increment when the buffer
+// has room for it, which is almost always.  Otherwise, branch to the call to
+// runtime_appendArrayElement which the caller prints next.  Empty arrays have
+// no buffer, and take the slow path.  The capacity is the allocatedWords field
+// of the heap header, which runtime_arrayStart verifies is the header word
+// before the back pointer, above the 3 flag bits.  Return the label to branch
+// to after the call.
+static utSym generateInlineAppend(llElement array, llElement element, llElement sizeValue) {
+  char *type = llGetTypeString(llElementGetDatatype(element), true);
+  char *arrayName = llElementGetName(array);
+  char *size = llElementGetName(sizeValue);
+  utSym checkLabel = newLabel("appendCheck");
+  utSym fastLabel = newLabel("appendFast");
+  utSym slowLabel = newLabel("appendSlow");
+  utSym doneLabel = newLabel("appendDone");
+  uint32 lengthPtr = printNewValue();
+  llPrintf("getelementptr inbounds %%struct.runtime_array, %%struct.runtime_array* %s, "
+      "i32 0, i32 1\n", arrayName);
+  uint32 length = printNewValue();
+  llPrintf("load i%1$s, i%1$s* %%%2$u\n", llSize, lengthPtr);
+  uint32 nonEmpty = printNewValue();
+  llPrintf("icmp ne i%s %%%u, 0\n", llSize, length);
+  llPrintf("  br i1 %%%u, label %%%s, label %%%s%s\n%s:\n", nonEmpty, utSymGetName(checkLabel),
+      utSymGetName(slowLabel), checkBranchWeights(true), utSymGetName(checkLabel));
+  uint32 dataPtr = printNewValue();
+  llPrintf("getelementptr inbounds %%struct.runtime_array, %%struct.runtime_array* %s, "
+      "i32 0, i32 0\n", arrayName);
+  uint32 data = printNewValue();
+  llPrintf("load i%1$s*, i%1$s** %%%2$u\n", llSize, dataPtr);
+  uint32 headerPtr = printNewValue();
+  llPrintf("getelementptr inbounds i%1$s, i%1$s* %%%2$u, i%1$s -2\n", llSize, data);
+  uint32 header = printNewValue();
+  llPrintf("load i%1$s, i%1$s* %%%2$u\n", llSize, headerPtr);
+  uint32 capacity = printNewValue();
+  llPrintf("and i%s %%%u, -8\n", llSize, header);
+  uint32 usedBytes = printNewValue();
+  llPrintf("mul nuw i%s %%%u, %s\n", llSize, length, size);
+  uint32 freeBytes = printNewValue();
+  llPrintf("sub i%s %%%u, %%%u\n", llSize, capacity, usedBytes);
+  uint32 fits = printNewValue();
+  llPrintf("icmp uge i%s %%%u, %s\n", llSize, freeBytes, size);
+  llPrintf("  br i1 %%%u, label %%%s, label %%%s%s\n%s:\n", fits, utSymGetName(fastLabel),
+      utSymGetName(slowLabel), checkBranchWeights(true), utSymGetName(fastLabel));
+  uint32 bytes = printNewValue();
+  llPrintf("bitcast i%s* %%%u to i8*\n", llSize, data);
+  uint32 dest = printNewValue();
+  llPrintf("getelementptr inbounds i8, i8* %%%u, i%s %%%u\n", bytes, llSize, usedBytes);
+  uint32 typedDest = printNewValue();
+  llPrintf("bitcast i8* %%%u to %s*\n", dest, type);
+  uint32 value = printNewValue();
+  llPrintf("load %s, %s* %s\n", type, type, llElementGetName(element));
+  llPrintf("  store %s %%%u, %s* %%%u\n", type, value, type, typedDest);
+  uint32 newLength = printNewValue();
+  llPrintf("add nuw i%s %%%u, 1\n", llSize, length);
+  llPrintf("  store i%1$s %%%2$u, i%1$s* %%%3$u\n", llSize, newLength, lengthPtr);
+  llPrintf("  br label %%%s\n%s:\n", utSymGetName(doneLabel), utSymGetName(slowLabel));
+  return doneLabel;
+}
+
 // Store the element and return a reference to it.
 static llElement storeElementAndReturnRef(llElement element) {
   char *defaultValue = getDefaultValue(llElementGetDatatype(element));
@@ -1686,8 +2229,9 @@ static void checkTruncation(llElement element, llElement result,
   llElement condition = popElement(true);
   utSym passedLabel = newLabel("truncCheckPassed");
   utSym failedLabel = newLabel("truncCheckFailed");
-  llPrintf("  br i1 %s, label %%%s, label %%%s\n",
-      llElementGetName(condition), utSymGetName(passedLabel), utSymGetName(failedLabel));
+  llPrintf("  br i1 %s, label %%%s, label %%%s%s\n",
+      llElementGetName(condition), utSymGetName(passedLabel), utSymGetName(failedLabel),
+      checkBranchWeights(true));
   printLabel(failedLabel);
   llDeclareRuntimeFunction("runtime_raiseOverflow");
   llPuts("  call void @runtime_raiseOverflow()\n  unreachable\n");
@@ -1721,16 +2265,73 @@ static llElement resizeSmallInteger(llElement element, uint32 newWidth,
   llPrintf("%s i%u %s to i%u%s\n",
       operation, oldWidth, llElementGetName(element), newWidth, locationInfo());
   llElement result = createValueElement(newDatatype, value, false);
-  if (!truncate && !deUnsafeMode && newWidth < oldWidth) {
+  if (!truncate && !uncheckedCode() && newWidth < oldWidth) {
     checkTruncation(element, result, oldWidth, newWidth, isSigned);
   }
   return result;
 }
 
+static llElement resizeBigint(llElement bigintArray, uint32 newWidth,
+    bool isSigned, bool truncate);
+
+// Allocate a temporary array of 64-bit words for passing a native integer
+// wider than 64 bits to or from the runtime.  Return the value number of an
+// iN* pointer to it, and set |firstWord| to the value number of an i64* pointer.
+static uint32 allocateNativeIntWords(uint32 width, uint32 *firstWord) {
+  uint32 numWords = (width + 63) >> 6;
+  uint32 words = printNewTmpValue();
+  llTmpPrintf("alloca [%u x i64]\n", numWords);
+  *firstWord = printNewValue();
+  llPrintf("getelementptr inbounds [%u x i64], [%u x i64]* %%.tmp%u, i32 0, i32 0\n",
+      numWords, numWords, words);
+  uint32 pointer = printNewValue();
+  llPrintf("bitcast i64* %%%u to i%u*\n", *firstWord, width);
+  return pointer;
+}
+
+// Convert a native integer wider than 64 bits to a bigint of the same width.
+static llElement convertNativeIntToBigint(llElement element) {
+  deDatatype datatype = llElementGetDatatype(element);
+  uint32 width = deDatatypeGetWidth(datatype);
+  uint32 firstWord;
+  uint32 pointer = allocateNativeIntWords(width, &firstWord);
+  llPrintf("  store i%u %s, i%u* %%%u\n", width, llElementGetName(element), width, pointer);
+  allocateTempArray(datatype);
+  llElement bigintArray = popElement(false);
+  llDeclareRuntimeFunction("runtime_nativeIntToBigint");
+  llPrintf("  call void @runtime_nativeIntToBigint(%%struct.runtime_array* %s, i64* %%%u, "
+      "i32 zeroext %u, i1 zeroext %s, i1 zeroext %s)\n", llElementGetName(bigintArray), firstWord,
+      width, boolVal(deDatatypeSigned(datatype)), boolVal(deDatatypeSecret(datatype)));
+  return bigintArray;
+}
+
+// Convert a bigint to a native integer wider than 64 bits.
+static llElement convertBigintToNativeInt(llElement bigintArray, uint32 newWidth,
+    bool isSigned, bool truncate) {
+  deDatatype datatype = llElementGetDatatype(bigintArray);
+  deDatatype newDatatype = deDatatypeSetSigned(deDatatypeResize(datatype, newWidth), isSigned);
+  uint32 firstWord;
+  uint32 pointer = allocateNativeIntWords(newWidth, &firstWord);
+  llDeclareRuntimeFunction("runtime_bigintToNativeInt");
+  llPrintf("  call void @runtime_bigintToNativeInt(i64* %%%u, %%struct.runtime_array* %s, "
+      "i32 zeroext %u, i1 zeroext %s, i1 zeroext %s)\n", firstWord, llElementGetName(bigintArray),
+      newWidth, boolVal(isSigned), boolVal(truncate));
+  uint32 value = printNewValue();
+  llPrintf("load i%u, i%u* %%%u\n", newWidth, newWidth, pointer);
+  return createValueElement(newDatatype, value, false);
+}
+
 // Convert a small integer to a bigint on the array heap.
 static llElement convertSmallIntToBigint(llElement element, uint32 newWidth, bool isSigned) {
   deDatatype datatype = llElementGetDatatype(element);
   uint32 oldWidth = deDatatypeGetWidth(datatype);
+  if (oldWidth > llSizeWidth) {
+    llElement bigintArray = convertNativeIntToBigint(element);
+    if (newWidth == oldWidth && deDatatypeSigned(datatype) == isSigned) {
+      return bigintArray;
+    }
+    return resizeBigint(bigintArray, newWidth, isSigned, false);
+  }
   if (oldWidth < llSizeWidth) {
     element = resizeSmallInteger(element, llSizeWidth, isSigned, false);
   }
@@ -1749,6 +2350,9 @@ static llElement convertSmallIntToBigint(llElement element, uint32 newWidth, boo
 // Convert a bigint in an array to a small integer.
 static llElement convertBigintToSmallInt(llElement bigintArray, uint32 newWidth,
     bool isSigned, bool truncate) {
+  if (newWidth > llSizeWidth) {
+    return convertBigintToNativeInt(bigintArray, newWidth, isSigned, truncate);
+  }
   char *func = truncate? "runtime_bigintToIntegerTrunc" : "runtime_bigintToInteger";
   llDeclareRuntimeFunction(func);
   uint32 value = printNewValue();
@@ -1769,7 +2373,7 @@ static llElement resizeBigint(llElement bigintArray, uint32 newWidth,
   utAssert(oldWidth > llSizeWidth && newWidth > llSizeWidth);
   deDatatype newDatatype = deDatatypeSetSigned(deDatatypeResize(datatype, newWidth), isSigned);
   llDeclareRuntimeFunction("runtime_bigintCast");
-  llElement tempArray = allocateTempValue(newDatatype);
+  llElement tempArray = allocateTempArray(newDatatype);
   bool secret = deDatatypeSecret(datatype);
   llPrintf(
       "  call void @runtime_bigintCast(%%struct.runtime_array* %s, "
@@ -1783,13 +2387,15 @@ static llElement resizeBigint(llElement bigintArray, uint32 newWidth,
 static llElement resizeInteger(llElement element, uint32 newWidth, bool isSigned, bool truncate) {
   deDatatype oldDatatype = llElementGetDatatype(element);
   uint32 oldWidth = deDatatypeGetWidth(oldDatatype);
+  bool oldIsBigint = deIntegerWidthIsBigint(oldWidth);
+  bool newIsBigint = deIntegerWidthIsBigint(newWidth);
   if (newWidth == oldWidth && deDatatypeSigned(oldDatatype) == isSigned) {
     return element;
-  } else if (oldWidth <= llSizeWidth && newWidth > llSizeWidth) {
+  } else if (!oldIsBigint && newIsBigint) {
     return convertSmallIntToBigint(element, newWidth, isSigned);
-  } else if (oldWidth > llSizeWidth && newWidth <= llSizeWidth) {
+  } else if (oldIsBigint && !newIsBigint) {
     return convertBigintToSmallInt(element, newWidth, isSigned, truncate);
-  } else if (newWidth > llSizeWidth) {
+  } else if (newIsBigint) {
     return resizeBigint(element, newWidth, isSigned, truncate);
   }
   return resizeSmallInteger(element, newWidth, isSigned, truncate);
@@ -1800,6 +2406,35 @@ static inline void resizeTop(uint32 width) {
   pushElement(resizeInteger(popElement(true), width, false, false), false);
 }
 
+// Call a bigint runtime function on native integers wider than 64 bits, for
+// operations LLVM cannot lower, such as wide division and modular arithmetic.
+// Operands which are not already bigints are converted to bigints of their own
+// width, and the result is converted back to |datatype| and pushed.  If
+// |extraParam| is not NULL, it is passed after the bigints.
+static void generateWideIntBigintCall(char *function, deDatatype datatype,
+    llElement *operands, uint32 numOperands, llElement *extraParam) {
+  for (uint32 i = 0; i < numOperands; i++) {
+    deDatatype operandDatatype = llElementGetDatatype(operands[i]);
+    if (!llDatatypeIsBigint(operandDatatype)) {
+      uint32 width = deDatatypeGetWidth(operandDatatype);
+      operands[i] = convertSmallIntToBigint(operands[i], width, deDatatypeSigned(operandDatatype));
+    }
+  }
+  allocateTempArray(datatype);
+  llElement resultArray = popElement(false);
+  llDeclareRuntimeFunction(function);
+  llPrintf("  call void @%s(%%struct.runtime_array* %s", function, llElementGetName(resultArray));
+  for (uint32 i = 0; i < numOperands; i++) {
+    llPrintf(", %%struct.runtime_array* %s", llElementGetName(operands[i]));
+  }
+  if (extraParam != NULL) {
+    llPrintf(", %s %s", getElementTypeString(*extraParam), llElementGetName(*extraParam));
+  }
+  llPrintf(")%s\n", locationInfo());
+  uint32 width = deDatatypeGetWidth(datatype);
+  pushElement(convertBigintToNativeInt(resultArray, width, deDatatypeSigned(datatype), true), false);
+}
+
 // Generate a constant string.
 static llElement generateString(deString text) {
   llAddStringConstant(text);
@@ -1827,6 +2462,9 @@ static uint32 evalFormatParams(llElement format, deExpression argument, bool ski
         derefElement(elementPtr);
         if (deDatatypeIsInteger(datatype) && deDatatypeGetWidth(datatype) < llSizeWidth) {
           resizeTop(llSizeWidth);
+        } else if (llDatatypeIsWideInt(datatype)) {
+          // The runtime formats integers wider than 64 bits as bigints.
+          pushElement(convertNativeIntToBigint(popElement(true)), false);
         }
         numArguments++;
       }
@@ -1926,6 +2564,9 @@ static void generateIntegerToString(llElement value, llElement base) {
         llElementGetName(result), llSize, llElementGetName(value),
         llElementGetName(base), boolVal(isSigned), locationInfo());
   } else {
+    if (llDatatypeIsWideInt(datatype)) {
+      value = convertNativeIntToBigint(value);
+    }
     llDeclareRuntimeFunction("runtime_bigintToString");
     llPrintf(
         "  call void @runtime_bigintToString(%%struct.runtime_array* %s, "
@@ -1953,6 +2594,150 @@ static void generateValueToString(llElement value) {
       llGetTypeString(datatype, false), llElementGetName(value), locationInfo());
 }
 
+// Copy a scalar into every lane of a new vector.
+static llElement splatElement(llElement scalar, deDatatype vectorType) {
+  char *vectorString = llGetTypeString(vectorType, true);
+  char *elementString = llGetTypeString(deDatatypeGetElementType(vectorType), true);
+  uint32 inserted = printNewValue();
+  llPrintf("insertelement %s undef, %s %s, i32 0\n", vectorString, elementString,
+      llElementGetName(scalar));
+  uint32 value = printNewValue();
+  llPrintf("shufflevector %s %%%u, %s undef, <%u x i32> zeroinitializer\n", vectorString,
+      inserted, vectorString, deDatatypeGetWidth(vectorType));
+  return createElement(vectorType, utSprintf("%%%u", value), false);
+}
+
+// Return the LLVM intrinsic name suffix for the vector type, like v8f32.
+static char *getVectorIntrinsicSuffix(deDatatype vectorType) {
+  deDatatype elementType = deDatatypeGetElementType(vectorType);
+  return utSprintf("v%u%c%u", deDatatypeGetWidth(vectorType),
+      deDatatypeIsFloat(elementType)? 'f' : 'i', deDatatypeGetWidth(elementType));
+}
+
+// Generate Array.loadVector(offset, lanes) or Array.storeVector(offset, vector).
+// Lanes past the end of the array are masked off with llvm.masked.load and
+// llvm.masked.store, so loops need no scalar tail.  Masked lanes load as 0.
+static void generateArrayVectorMethod(deBuiltinFuncType type, llElement access,
+    deExpression parameters, deDatatype resultType) {
+  deExpression offsetExpression = deExpressionGetFirstExpression(parameters);
+  generateExpression(offsetExpression);
+  llElement offset = resizeInteger(popElement(true), llSizeWidth, false, false);
+  deDatatype vectorType = resultType;
+  llElement vector;
+  if (type == DE_BUILTINFUNC_ARRAYSTOREVECTOR) {
+    generateExpression(deExpressionGetNextExpression(offsetExpression));
+    vector = popElement(true);
+    vectorType = llElementGetDatatype(vector);
+  }
+  uint32 lanes = deDatatypeGetWidth(vectorType);
+  deDatatype elementType = deDatatypeGetElementType(vectorType);
+  uint32 lenPtr = printNewValue();
+  llPrintf("getelementptr inbounds %%struct.runtime_array, %%struct.runtime_array* %s, i32 0, i32 1\n",
+      llElementGetName(access));
+  uint32 len = printNewValue();
+  llPrintf("load i%s, i%s* %%%u\n", llSize, llSize, lenPtr);
+  uint32 inBounds = printNewValue();
+  llPrintf("icmp ult i%s %s, %%%u\n", llSize, llElementGetName(offset), len);
+  uint32 remaining = printNewValue();
+  llPrintf("sub i%s %%%u, %s\n", llSize, len, llElementGetName(offset));
+  uint32 avail = printNewValue();
+  llPrintf("select i1 %%%u, i%s %%%u, i%s 0\n", inBounds, llSize, remaining, llSize);
+  deDatatype indexVectorType = deVectorDatatypeCreate(llSizeType, lanes);
+  llElement availVector = splatElement(createValueElement(llSizeType, avail, false), indexVectorType);
+  char *indexVectorString = llGetTypeString(indexVectorType, true);
+  char *laneIndexes = utSprintf("i%s 0", llSize);
+  for (uint32 i = 1; i < lanes; i++) {
+    laneIndexes = utSprintf("%s, i%s %u", laneIndexes, llSize, i);
+  }
+  uint32 mask = printNewValue();
+  llPrintf("icmp ult %s <%s>, %s\n", indexVectorString, laneIndexes,
+      llElementGetName(availVector));
+  // The array can be empty, when every lane is masked off.
+  llElement dataPtr = loadArrayDataPointer(access, false);
+  char *elementString = llGetTypeString(elementType, true);
+  char *vectorString = llGetTypeString(vectorType, true);
+  // No inbounds: the offset can be past the end, when every lane is masked off.
+  uint32 elementPtr = printNewValue();
+  llPrintf("getelementptr %s, %s* %s, i%s %s\n", elementString, elementString,
+      llElementGetName(dataPtr), llSize, llElementGetName(offset));
+  uint32 vectorPtr = printNewValue();
+  llPrintf("bitcast %s* %%%u to %s*\n", elementString, elementPtr, vectorString);
+  // Array data is only aligned to the element size.
+  uint32 align = deDatatypeGetWidth(elementType) >> 3;
+  char *suffix = getVectorIntrinsicSuffix(vectorType);
+  if (type == DE_BUILTINFUNC_ARRAYLOADVECTOR) {
+    llDeclareOverloadedFunction(utSprintf(
+        "declare %1$s @llvm.masked.load.%2$s.p0%2$s(%1$s*, i32, <%3$u x i1>, %1$s)\n",
+        vectorString, suffix, lanes));
+    uint32 value = printNewValue();
+    llPrintf("call %1$s @llvm.masked.load.%2$s.p0%2$s(%1$s* %%%3$u, i32 %4$u, <%5$u x i1> %%%6$u, "
+        "%1$s zeroinitializer)%7$s\n", vectorString, suffix, vectorPtr, align, lanes, mask,
+        locationInfo());
+    pushValue(resultType, value, false);
+  } else {
+    llDeclareOverloadedFunction(utSprintf(
+        "declare void @llvm.masked.store.%2$s.p0%2$s(%1$s, %1$s*, i32, <%3$u x i1>)\n",
+        vectorString, suffix, lanes));
+    llPrintf("  call void @llvm.masked.store.%2$s.p0%2$s(%1$s %3$s, %1$s* %%%4$u, i32 %5$u, "
+        "<%6$u x i1> %%%7$u)%8$s\n", vectorString, suffix, llElementGetName(vector), vectorPtr,
+        align, lanes, mask, locationInfo());
+  }
+}
+
+// Generate Vector.sum(), min() or max() with LLVM's reduction intrinsics.  Float
+// sums are ordered, so they give the same result as summing the lanes in order.
+static void generateVectorReduction(deBuiltinFuncType type, llElement vector) {
+  deDatatype vectorType = llElementGetDatatype(vector);
+  deDatatype elementType = deDatatypeGetElementType(vectorType);
+  bool isFloat = deDatatypeIsFloat(elementType);
+  char *op;
+  if (type == DE_BUILTINFUNC_VECTORSUM) {
+    op = isFloat? "fadd" : "add";
+  } else if (isFloat) {
+    op = type == DE_BUILTINFUNC_VECTORMIN? "fmin" : "fmax";
+  } else if (deDatatypeSigned(elementType)) {
+    op = type == DE_BUILTINFUNC_VECTORMIN? "smin" : "smax";
+  } else {
+    op = type == DE_BUILTINFUNC_VECTORMIN? "umin" : "umax";
+  }
+  char *elementString = llGetTypeString(elementType, true);
+  char *vectorString = llGetTypeString(vectorType, true);
+  char *suffix = getVectorIntrinsicSuffix(vectorType);
+  bool ordered = isFloat && type == DE_BUILTINFUNC_VECTORSUM;
+  llDeclareOverloadedFunction(utSprintf("declare %s @llvm.vector.reduce.%s.%s(%s%s)\n",
+      elementString, op, suffix, ordered? utSprintf("%s, ", elementString) : "", vectorString));
+  uint32 value = printNewValue();
+  llPrintf("call %s @llvm.vector.reduce.%s.%s(%s%s %s)%s\n", elementString, op, suffix,
+      ordered? utSprintf("%s -0.000000e+00, ", elementString) : "", vectorString,
+      llElementGetName(vector), locationInfo());
+  pushValue(deSetDatatypeSecret(elementType, deDatatypeSecret(vectorType)), value, false);
+}
+
+// Generate Vector.shuffle(indexes) or Vector.shuffleWith(other, indexes).  The
+// binder verified the indexes are a constant array, which becomes the mask.
+static void generateVectorShuffle(llElement vector, deExpression parameters,
+    deDatatype resultType) {
+  char *vectorString = llGetTypeString(llElementGetDatatype(vector), true);
+  deExpression indexesExpression = deExpressionGetFirstExpression(parameters);
+  char *other = "undef";
+  if (deExpressionGetNextExpression(indexesExpression) != deExpressionNull) {
+    generateExpression(indexesExpression);
+    other = llElementGetName(popElement(true));
+    indexesExpression = deExpressionGetNextExpression(indexesExpression);
+  }
+  char *mask = NULL;
+  deExpression indexExpression;
+  deForeachExpressionExpression(indexesExpression, indexExpression) {
+    uint32 index = deBigintGetUint32(deExpressionGetBigint(indexExpression),
+        deExpressionGetLine(indexExpression));
+    mask = mask == NULL? utSprintf("i32 %u", index) : utSprintf("%s, i32 %u", mask, index);
+  } deEndExpressionExpression;
+  uint32 value = printNewValue();
+  llPrintf("shufflevector %s %s, %s %s, <%u x i32> <%s>\n", vectorString,
+      llElementGetName(vector), vectorString, other, deDatatypeGetWidth(resultType), mask);
+  pushValue(resultType, value, false);
+}
+
 // Generate a builtin function.  Parameters have already been pushed onto the
 // stack.
 static void generateBuiltinMethod(deExpression expression) {
@@ -1999,13 +2784,34 @@ static void generateBuiltinMethod(deExpression expression) {
       llElement elementSize = findDatatypeSize(elementDatatype);
       llDeclareRuntimeFunction("runtime_resizeArray");
       char *location = locationInfo();
+      countEvent(LL_COUNT_RESIZE, llCurrentLine);
+      markSecretArray(access, false);
       llPrintf("  call void @runtime_resizeArray(%%struct.runtime_array* %s, i%s %s, i%s %s, "
           "i1 zeroext %u)%s\n", llElementGetName(access), llSize, llElementGetName(numElements),
           llSize, llElementGetName(elementSize), hasSubArrays, location);
+      markSecretArray(access, false);
       // Push the array back on the stack.
       pushElement(access, access.needsFree);
       break;
     }
+    case DE_BUILTINFUNC_ARRAYRESERVE: {
+      deDatatype datatype = llElementGetDatatype(access);
+      generateExpression(deExpressionGetFirstExpression(parameters));
+      llElement numElements = popElement(true);
+      numElements = resizeInteger(numElements, llSizeWidth, false, false);
+      bool hasSubArrays = arrayHasSubArrays(datatype);
+      deDatatype elementDatatype = deDatatypeGetElementType(datatype);
+      llElement elementSize = findDatatypeSize(elementDatatype);
+      llDeclareRuntimeFunction("runtime_reserveArray");
+      char *location = locationInfo();
+      countEvent(LL_COUNT_RESIZE, llCurrentLine);
+      markSecretArray(access, false);
+      llPrintf("  call void @runtime_reserveArray(%%struct.runtime_array* %s, i%s %s, i%s %s, "
+          "i1 zeroext %u)%s\n", llElementGetName(access), llSize, llElementGetName(numElements),
+          llSize, llElementGetName(elementSize), hasSubArrays, location);
+      markSecretArray(access, false);
+      break;
+    }
     case DE_BUILTINFUNC_ARRAYAPPEND:
     case DE_BUILTINFUNC_STRINGAPPEND: {
       deExpression elementExpression = deExpressionGetFirstExpression(parameters);
@@ -2020,10 +2826,22 @@ static void generateBuiltinMethod(deExpression expression) {
       uint32 uint8Ptr = getUintPointer(element, 8);
       llElement sizeValue = findDatatypeSize(elementDatatype);
       char *location = locationInfo();
+      utSym doneLabel = utSymNull;
+      if (!llDatatypeIsArray(elementDatatype)) {
+        doneLabel = generateInlineAppend(access, element, sizeValue);
+      }
+      // Only appends to full arrays get here.
+      countEvent(LL_COUNT_RESIZE, llCurrentLine);
+      markSecretArray(access, false);
       llPrintf("  call void @runtime_appendArrayElement(%%struct.runtime_array* %s, i8* %%%u, "
           "i%s %s, i1 zeroext %u, i1 zeroext %u)%s\n", llElementGetName(access), uint8Ptr, llSize,
           llElementGetName(sizeValue), llDatatypeIsArray(elementDatatype),
           arrayHasSubArrays(elementDatatype), location);
+      markSecretArray(access, false);
+      if (doneLabel != utSymNull) {
+        llPrintf("  br label %%%s\n%s:\n", utSymGetName(doneLabel), utSymGetName(doneLabel));
+        llPrevLabel = doneLabel;
+      }
       if (isRefCounted(elementDatatype)) {
         derefAnyElement(&element);
         refObject(element);
@@ -2041,9 +2859,12 @@ static void generateBuiltinMethod(deExpression expression) {
       llElement sizeValue = findDatatypeSize(elementDatatype);
       llDeclareRuntimeFunction("runtime_concatArrays");
       char *location = locationInfo();
+      countEvent(LL_COUNT_RESIZE, llCurrentLine);
+      markSecretArray(access, false);
       llPrintf("  call void @runtime_concatArrays(%%struct.runtime_array* %s, %%struct.runtime_array* %s, "
           "i%s %s, i1 zeroext false)%s\n", llElementGetName(access), llElementGetName(array2),
           llSize, llElementGetName(sizeValue), location);
+      markSecretArray(access, false);
       break;
     }
     case DE_BUILTINFUNC_ARRAYREVERSE:
@@ -2076,7 +2897,7 @@ static void generateBuiltinMethod(deExpression expression) {
                "zeroext %u, i1 zeroext false, i1 zeroext %s)%s\n",
           funcName, llElementGetName(bigint), llElementGetName(access), width,
           boolVal(secret), location);
-      if (width <= llSizeWidth) {
+      if (!deIntegerWidthIsBigint(width)) {
         // We need to convert it to an integer.
         popElement(false);  // Pop off bigint.
         llElement smallnum = convertBigintToSmallInt(bigint, width, false, false);
@@ -2100,6 +2921,26 @@ static void generateBuiltinMethod(deExpression expression) {
           llElementGetName(binString), llElementGetName(access), location);
       break;
     }
+    case DE_BUILTINFUNC_STRINGTOBASE64:
+    case DE_BUILTINFUNC_BASE64TOSTRING: {
+      deExpression urlSafeExpression = deExpressionGetFirstExpression(parameters);
+      llElement urlSafe;
+      if (urlSafeExpression != deExpressionNull) {
+        generateExpression(urlSafeExpression);
+        urlSafe = popElement(true);
+      } else {
+        urlSafe = createElement(deBoolDatatypeCreate(), "false", false);
+      }
+      llElement destString = allocateTempArray(deStringDatatypeCreate());
+      char *location = locationInfo();
+      char *funcName = type == DE_BUILTINFUNC_STRINGTOBASE64?
+          "runtime_stringToBase64" : "runtime_base64ToString";
+      llDeclareRuntimeFunction(funcName);
+      llPrintf("  call void @%s(%%struct.runtime_array* %s, %%struct.runtime_array* %s, "
+          "i1 zeroext %s)%s\n", funcName, llElementGetName(destString), llElementGetName(access),
+          llElementGetName(urlSafe), location);
+      break;
+    }
     case DE_BUILTINFUNC_UINTTOSTRINGBE:
     case DE_BUILTINFUNC_UINTTOSTRINGLE: {
       deDatatype accessType = llElementGetDatatype(access);
@@ -2143,6 +2984,18 @@ static void generateBuiltinMethod(deExpression expression) {
       pushValue(llSizeType, retValue, false);
       break;
     }
+    case DE_BUILTINFUNC_ARRAYLOADVECTOR:
+    case DE_BUILTINFUNC_ARRAYSTOREVECTOR:
+      generateArrayVectorMethod(type, access, parameters, deExpressionGetDatatype(expression));
+      break;
+    case DE_BUILTINFUNC_VECTORSUM:
+    case DE_BUILTINFUNC_VECTORMIN:
+    case DE_BUILTINFUNC_VECTORMAX:
+      generateVectorReduction(type, access);
+      break;
+    case DE_BUILTINFUNC_VECTORSHUFFLE:
+      generateVectorShuffle(access, parameters, deExpressionGetDatatype(expression));
+      break;
     case DE_BUILTINFUNC_BOOLTOSTRING: {
       llElement trueElement = generateString(deCStringCreate("true"));
       llElement falseElement = generateString(deCStringCreate("false"));
@@ -2289,8 +3142,8 @@ static void moveElement(llElement dest, llElement source, bool freeDest) {
 void storeBasicType(llElement dest, llElement source) {
   utAssert(llElementIsRef(dest));
   char *type = llGetTypeString(llElementGetDatatype(source), true);
-  llPrintf("  store %s %s, %s* %s%s\n", type, llElementGetName(source), type,
-           llElementGetName(dest), locationInfo());
+  llPrintf("  store %s %s, %s* %s%s%s\n", type, llElementGetName(source), type,
+           llElementGetName(dest), tbaaInfo(dest), locationInfo());
 }
 
 // Forward reference for recursion.
@@ -2352,6 +3205,22 @@ static bool isUnusedVariable(deExpression accessExpression) {
   return !deVariableInstantiated(var);
 }
 
+// Determine if the access expression is a borrowed variable, which is not
+// reference counted.
+static bool isBorrowedVariable(deExpression accessExpression) {
+  if (deExpressionGetType(accessExpression) != DE_EXPR_IDENT) {
+    return false;
+  }
+  deIdent ident = deExpressionGetIdent(accessExpression);
+  return ident != deIdentNull && deIdentGetType(ident) == DE_IDENT_VARIABLE &&
+      deVariableBorrowed(deIdentGetVariable(ident));
+}
+
+// Forward declarations for bit-packed data members.
+static deVariable findPackedBitsMember(deExpression accessExpression);
+static void writePackedBits(deVariable variable, deExpression accessExpression,
+    llElement value);
+
 // Generate write expression.  The top level operator of the access expression
 // needs to be evaluated differently, since it needs to give us the address to
 // write to rather than the value contained there.
@@ -2360,18 +3229,25 @@ static void generateWriteExpression(deExpression accessExpression) {
   if (isUnusedVariable(accessExpression)) {
     return;
   }
+  deVariable packedBitsMember = findPackedBitsMember(accessExpression);
+  if (packedBitsMember != deVariableNull) {
+    writePackedBits(packedBitsMember, accessExpression, value);
+    return;
+  }
   generateExpression(accessExpression);
   llElement access = popElement(false);
   deDatatype datatype = llElementGetDatatype(access);
-  if (deDatatypeContainsArray(datatype) || isRefCounted(datatype) ||
+  if (deDatatypeContainsArray(datatype) ||
+      (isRefCounted(datatype) && !isBorrowedVariable(accessExpression)) ||
       deDatatypeGetType(datatype) == DE_TYPE_TUPLE ||
       deDatatypeGetType(datatype) == DE_TYPE_STRUCT) {
     copyOrMoveElement(access, value, !deStatementIsFirstAssignment(llCurrentStatement));
+    markSecretArray(access, true);
   } else {
     utAssert(llElementIsRef(access));
     char *type = llGetTypeString(llElementGetDatatype(value), true);
-    llPrintf("  store %s %s, %s* %s%s\n", type, llElementGetName(value), type,
-             llElementGetName(access), locationInfo());
+    llPrintf("  store %s %s, %s* %s%s%s\n", type, llElementGetName(value), type,
+             llElementGetName(access), tbaaInfo(access), locationInfo());
   }
 }
 
@@ -2428,6 +3304,20 @@ static void generateStructConstructor(deExpression expression) {
   }
 }
 
+// Pop the parameters evaluated since |savedStackPos|, and print them as call
+// arguments.
+static void printCallArguments(uint32 savedStackPos) {
+  bool firstTime = true;
+  while (llStackPos > savedStackPos) {
+    if (!firstTime) {
+      llPuts(", ");
+    }
+    firstTime = false;
+    llElement element = popElement(false);
+    llPrintf("%s %s", getElementTypeString(element), llElementGetName(element));
+  }
+}
+
 // Generate a function call.  The return value is reserved on the stack first,
 // then the arguments in reverse order of how they are listed.
 static void generateCallExpression(deExpression expression) {
@@ -2488,15 +3378,7 @@ static void generateCallExpression(deExpression expression) {
     char *path = llEscapeIdentifier(deGetSignaturePath(signature));
     llPrintf("call %s @%s(", llGetTypeString(returnType, false), path);
   }
-  bool firstTime = true;
-  while (llStackPos > savedStackPos) {
-    if (!firstTime) {
-      llPuts(", ");
-    }
-    firstTime = false;
-    llElement element = popElement(false);
-    llPrintf("%s %s", getElementTypeString(element), llElementGetName(element));
-  }
+  printCallArguments(savedStackPos);
   llPrintf(")%s\n", locationInfo());
   if (returnsVal) {
     // If returned value is a reference counted object, add it to the needsFree list.
@@ -2507,10 +3389,36 @@ static void generateCallExpression(deExpression expression) {
   }
 }
 
+// Call an iterator generated as a coroutine, which runs it to its first yield.
+// Return the value number of the coroutine handle.
+static uint32 generateCoroutineCall(deExpression expression) {
+  deExpression accessExpression = deExpressionGetFirstExpression(expression);
+  deExpression parameters = deExpressionGetNextExpression(accessExpression);
+  deSignature signature = deExpressionGetSignature(expression);
+  uint32 savedStackPos = llStackPos;
+  evaluateParameters(signature, deDatatypeNull, parameters,
+      deExpressionIsMethodCall(accessExpression));
+  generateExpression(accessExpression);
+  llElement element = popElement(true);
+  if (llElementIsDelegate(element)) {
+    if (!deSignatureParamInstantiated(signature, 0)) {
+      popElement(false);
+    } else {
+      llElement *selfElement = topOfStack();
+      derefElement(selfElement);
+    }
+  }
+  uint32 handle = printNewValue();
+  llPrintf("call i8* @%s(", llEscapeIdentifier(deGetSignaturePath(signature)));
+  printCallArguments(savedStackPos);
+  llPrintf(")%s\n", locationInfo());
+  return handle;
+}
+
 // Generate code to bounds check a value.  The message will be passed to
 // runtime_raiseException if the bounds check fails.
 static void limitCheck(llElement index, llElement limit) {
-  if (deUnsafeMode || (!llDebugMode && deStatementGenerated(llCurrentStatement))) {
+  if (uncheckedCode() || (!llDebugMode && deStatementGenerated(llCurrentStatement))) {
     return;
   }
   deDatatype limitType = llElementGetDatatype(limit);
@@ -2528,9 +3436,9 @@ static void limitCheck(llElement index, llElement limit) {
   if (!generatedFailBlock) {
     llLimitCheckFailedLabel = newLabel("limitCheckFailed");
   }
-  llPrintf("  br i1 %s, label %%%s, label %%%s%s\n",
+  llPrintf("  br i1 %s, label %%%s, label %%%s%s%s\n",
       llElementGetName(condition), utSymGetName(passedLabel),
-      utSymGetName(llLimitCheckFailedLabel), locationInfo());
+      utSymGetName(llLimitCheckFailedLabel), checkBranchWeights(true), locationInfo());
   if (!generatedFailBlock) {
     llPrintf("%s:\n", utSymGetName(llLimitCheckFailedLabel));
     llDeclareRuntimeFunction("runtime_panic");
@@ -2544,7 +3452,7 @@ static void limitCheck(llElement index, llElement limit) {
 
 // Check that the index is not null, when in debug mode.
 static void nullCheck(llElement index, bool alwaysCheck) {
-  if (deUnsafeMode || (!alwaysCheck && !llDebugMode && deStatementGenerated(llCurrentStatement))) {
+  if (uncheckedCode() || (!alwaysCheck && !llDebugMode && deStatementGenerated(llCurrentStatement))) {
     return;
   }
   llElement string = generateString(deCStringCreate("Null indirection"));
@@ -2556,9 +3464,9 @@ static void nullCheck(llElement index, bool alwaysCheck) {
   if (!generatedFailBlock) {
     llBoundsCheckFailedLabel = newLabel("boundsCheckFailed");
   }
-  llPrintf("  br i1 %s, label %%%s, label %%%s%s\n",
+  llPrintf("  br i1 %s, label %%%s, label %%%s%s%s\n",
       llElementGetName(condition), utSymGetName(passedLabel),
-      utSymGetName(llBoundsCheckFailedLabel), locationInfo());
+      utSymGetName(llBoundsCheckFailedLabel), checkBranchWeights(true), locationInfo());
   if (!generatedFailBlock) {
     llPrintf("%s:\n", utSymGetName(llBoundsCheckFailedLabel));
     llDeclareRuntimeFunction("runtime_panic");
@@ -2572,7 +3480,7 @@ static void nullCheck(llElement index, bool alwaysCheck) {
 
 // Perform a bounds check before indexing into an array.
 static void boundsCheck(llElement array, llElement index, char *message) {
-  if (deUnsafeMode || (!llDebugMode && deStatementGenerated(llCurrentStatement))) {
+  if (uncheckedCode() || (!llDebugMode && deStatementGenerated(llCurrentStatement))) {
     return;
   }
   uint32 value = printNewValue();
@@ -2590,9 +3498,9 @@ static void boundsCheck(llElement array, llElement index, char *message) {
   if (!generatedFailBlock) {
     llBoundsCheckFailedLabel = newLabel("boundsCheckFailed");
   }
-  llPrintf("  br i1 %s, label %%%s, label %%%s%s\n",
+  llPrintf("  br i1 %s, label %%%s, label %%%s%s%s\n",
       llElementGetName(condition), utSymGetName(passedLabel),
-      utSymGetName(llBoundsCheckFailedLabel), locationInfo());
+      utSymGetName(llBoundsCheckFailedLabel), checkBranchWeights(true), locationInfo());
   if (!generatedFailBlock) {
     llPrintf("%s:\n", utSymGetName(llBoundsCheckFailedLabel));
     llDeclareRuntimeFunction("runtime_panic");
@@ -2602,6 +3510,7 @@ static void boundsCheck(llElement array, llElement index, char *message) {
   }
   llPrintf("%s:\n", utSymGetName(passedLabel));
   llPrevLabel = passedLabel;
+  countEvent(LL_COUNT_BOUNDS_CHECK, llCurrentLine);
 }
 
 // Index into an array.
@@ -2617,7 +3526,7 @@ static void indexArray(llElement array, llElement index, bool needsBoundsCheck)
   }
   deDatatype arrayDatatype = llElementGetDatatype(array);
   deDatatype elementDatatype = getElementType(arrayDatatype);
-  llElement dataPtr = loadArrayDataPointer(array);
+  llElement dataPtr = loadArrayDataPointer(array, true);
   char *type = llGetTypeString(llElementGetDatatype(dataPtr), true);
   char *indexType = llGetTypeString(llElementGetDatatype(index), false);
   uint32 valuePtr = printNewValue();
@@ -2626,15 +3535,214 @@ static void indexArray(llElement array, llElement index, bool needsBoundsCheck)
   pushValue(elementDatatype, valuePtr, true);
 }
 
-// Generate code for the member access.
-static void generateMemberAccess(deIdent ident, deExpression left, deExpression right) {
+// Increment the data member's access counter, when profiling.
+static void countFieldAccess(deVariable variable) {
+  uint32 profileIndex = llVariableGetProfileIndex(variable);
+  if (profileIndex == 0) {
+    return;
+  }
+  char *counter = utAllocString(utSprintf(
+      "getelementptr inbounds ([%1$u x i64], [%1$u x i64]* @.fieldAccessCounts, i64 0, i64 %2$u)",
+      llNumProfiledFields, profileIndex - 1));
+  uint32 count = printNewValue();
+  llPrintf("load i64, i64* %s\n", counter);
+  uint32 newCount = printNewValue();
+  llPrintf("add i64 %%%u, 1\n", count);
+  llPrintf("  store i64 %%%u, i64* %s\n", newCount, counter);
+  utFree(counter);
+}
+
+// Index the byte of the bit-packed global array holding the data member of
+// the object, and push a reference to it.  Return the shift of the object's
+// bits within the byte, as an i8.  Like other member accesses, only null is
+// checked, since the arrays cover all allocated objects.
+static llElement indexPackedBitsByte(deVariable variable, deExpression left) {
   generateExpression(left);
-  llElement index = popElement(true);
-  deVariable variable = deIdentGetVariable(ident);
+  llElement object = popElement(true);
+  countFieldAccess(variable);
+  deClass theClass = deDatatypeGetClass(llElementGetDatatype(object));
+  deDatatype indexDatatype = deUintDatatypeCreate(deClassGetRefWidth(theClass));
+  llElement index = createElement(indexDatatype, llElementGetName(object), false);
+  nullCheck(index, false);
+  uint32 bits = deVariableGetPackedBits(variable);
+  uint32 slotsLog2 = bits == 1? 3 : bits == 2? 2 : 1;
+  char *indexType = llGetTypeString(indexDatatype, false);
+  uint32 byteIndex = printNewValue();
+  llPrintf("lshr %s %s, %u\n", indexType, llElementGetName(index), slotsLog2);
+  uint32 slot = printNewValue();
+  llPrintf("and %s %s, %u\n", indexType, llElementGetName(index), (1 << slotsLog2) - 1);
+  llElement slotByte = resizeSmallInteger(createValueElement(indexDatatype, slot, false),
+      8, false, true);
+  uint32 shift = printNewValue();
+  llPrintf("mul i8 %s, %u\n", llElementGetName(slotByte), bits);
   deVariable arrayVar = deVariableGetGlobalArrayVariable(variable);
-  char *arrayName = llGetVariableName(arrayVar);
-  llElement array = createElement(deVariableGetDatatype(arrayVar), arrayName, true);
+  llElement array = createElement(deVariableGetDatatype(arrayVar),
+      llGetVariableName(arrayVar), true);
+  indexArray(array, createValueElement(indexDatatype, byteIndex, false), false);
+  return createValueElement(deUintDatatypeCreate(8), shift, false);
+}
+
+// Read a bit-packed data member.  The value is pushed, rather than a
+// reference, since it has no address of its own.
+static void readPackedBits(deVariable variable, deExpression left) {
+  llElement shift = indexPackedBitsByte(variable, left);
+  llElement byte = popElement(true);
+  uint32 shifted = printNewValue();
+  llPrintf("lshr i8 %s, %s\n", llElementGetName(byte), llElementGetName(shift));
+  deDatatype datatype = deVariableGetDatatype(variable);
+  uint32 value = printNewValue();
+  llPrintf("trunc i8 %%%u to %s\n", shifted, llGetTypeString(datatype, true));
+  pushValue(datatype, value, false);
+}
+
+// Return the data member written by the access expression, if it is bit-packed.
+static deVariable findPackedBitsMember(deExpression accessExpression) {
+  if (deExpressionGetType(accessExpression) != DE_EXPR_DOT) {
+    return deVariableNull;
+  }
+  deExpression left = deExpressionGetFirstExpression(accessExpression);
+  deDatatype leftType = deExpressionGetDatatype(left);
+  if (deDatatypeGetType(leftType) != DE_TYPE_CLASS) {
+    return deVariableNull;
+  }
+  deExpression right = deExpressionGetNextExpression(left);
+  deBlock block = deClassGetSubBlock(deDatatypeGetClass(leftType));
+  deIdent ident = deBlockFindIdent(block, deExpressionGetName(right));
+  if (ident == deIdentNull || deIdentGetType(ident) != DE_IDENT_VARIABLE ||
+      deVariableGetPackedBits(deIdentGetVariable(ident)) == 0) {
+    return deVariableNull;
+  }
+  return deIdentGetVariable(ident);
+}
+
+// Write a bit-packed data member: clear the object's bits in their byte, and
+// or in the new value.
+static void writePackedBits(deVariable variable, deExpression accessExpression,
+    llElement value) {
+  llElement shift = indexPackedBitsByte(variable,
+      deExpressionGetFirstExpression(accessExpression));
+  llElement byteRef = popElement(false);
+  char *location = locationInfo();
+  uint32 oldByte = printNewValue();
+  llPrintf("load i8, i8* %s%s\n", llElementGetName(byteRef), location);
+  uint32 mask = printNewValue();
+  llPrintf("shl i8 %u, %s\n", (1 << deVariableGetPackedBits(variable)) - 1,
+      llElementGetName(shift));
+  uint32 inverseMask = printNewValue();
+  llPrintf("xor i8 %%%u, -1\n", mask);
+  uint32 cleared = printNewValue();
+  llPrintf("and i8 %%%u, %%%u\n", oldByte, inverseMask);
+  uint32 bits = printNewValue();
+  llPrintf("zext %s %s to i8\n", llGetTypeString(llElementGetDatatype(value), true),
+      llElementGetName(value));
+  uint32 shiftedBits = printNewValue();
+  llPrintf("shl i8 %%%u, %s\n", bits, llElementGetName(shift));
+  uint32 newByte = printNewValue();
+  llPrintf("or i8 %%%u, %%%u\n", cleared, shiftedBits);
+  llPrintf("  store i8 %%%u, i8* %s%s\n", newByte, llElementGetName(byteRef), location);
+}
+
+// Generate code for the member access.
+static void generateMemberAccess(deIdent ident, deExpression left, deExpression right) {
+  deVariable variable = deIdentGetVariable(ident);
+  if (deVariableGetPackedBits(variable) != 0) {
+    readPackedBits(variable, left);
+    return;
+  }
+  generateExpression(left);
+  llElement index = popElement(true);
+  countFieldAccess(variable);
+  deVariable arrayVar = deVariableGetGlobalArrayVariable(variable);
+  char *arrayName = llGetVariableName(arrayVar);
+  llElement array = createElement(deVariableGetDatatype(arrayVar), arrayName, true);
   indexArray(array, index, true);
+  if (deVariablePacked(variable)) {
+    // The array element is a tuple of the class's scalar data members.
+    llElement tuple = popElement(true);
+    pushElement(indexTuple(tuple, deVariableGetPackedIndex(variable), true), false);
+  }
+  llElement *element = topOfStack();
+  if (!llDatatypePassedByReference(llElementGetDatatype(*element))) {
+    element->tbaaTag = llCreateMemberTbaaTag(arrayVar);
+  }
+}
+
+// Check the index against a constant length, and panic if it is out of bounds.
+static void generateConstantBoundsCheck(llElement index, uint32 length) {
+  if (!uncheckedCode() && (llDebugMode || !deStatementGenerated(llCurrentStatement))) {
+    llElement string = generateString(deCStringCreate("Indexed passed the end of an array"));
+    generateBasicComparison(index, createSmallInteger(length, llSizeWidth, false), RN_LT);
+    llElement condition = popElement(true);
+    utSym passedLabel = newLabel("boundsCheckPassed");
+    bool generatedFailBlock = llBoundsCheckFailedLabel != utSymNull;
+    if (!generatedFailBlock) {
+      llBoundsCheckFailedLabel = newLabel("boundsCheckFailed");
+    }
+    llPrintf("  br i1 %s, label %%%s, label %%%s%s%s\n",
+        llElementGetName(condition), utSymGetName(passedLabel),
+        utSymGetName(llBoundsCheckFailedLabel), checkBranchWeights(true), locationInfo());
+    if (!generatedFailBlock) {
+      llPrintf("%s:\n", utSymGetName(llBoundsCheckFailedLabel));
+      llDeclareRuntimeFunction("runtime_panic");
+      llPrintf("  call void (%%struct.runtime_array*, ...) @runtime_panic(%%struct.runtime_array* %s)%s\n",
+          llElementGetName(string), locationInfo());
+      llPrintf("  unreachable\n");
+    }
+    llPrintf("%s:\n", utSymGetName(passedLabel));
+    llPrevLabel = passedLabel;
+    countEvent(LL_COUNT_BOUNDS_CHECK, llCurrentLine);
+  }
+}
+
+// Generate an index into a fixed-sized array, which is a tuple of identical
+// elements, and so has the same layout as an LLVM array.  The bounds check is
+// against the constant length.
+static void generateFixedArrayIndexExpression(deExpression left, deExpression right) {
+  deDatatype datatype = deExpressionGetDatatype(left);
+  deDatatype elementType = deDatatypeGetiTypeList(datatype, 0);
+  uint32 length = deDatatypeGetNumTypeList(datatype);
+  generateExpression(left);
+  llElement tuple = popElement(true);
+  generateExpression(right);
+  llElement index = resizeInteger(popElement(true), llSizeWidth, false, false);
+  generateConstantBoundsCheck(index, length);
+  char *tupleType = llGetTypeString(datatype, true);
+  char *arrayType = utSprintf("[%u x %s]", length, llGetTypeString(elementType, true));
+  uint32 arrayPtr = printNewValue();
+  llPrintf("bitcast %s* %s to %s*\n", tupleType, llElementGetName(tuple), arrayType);
+  uint32 valuePtr = printNewValue();
+  llPrintf("getelementptr inbounds %s, %s* %%%u, i%s 0, i%s %s\n", arrayType, arrayType,
+      arrayPtr, llSize, llSize, llElementGetName(index));
+  pushValue(elementType, valuePtr, true);
+}
+
+// Generate an index into a vector's lanes.  Vectors in variables have the same
+// layout as LLVM arrays, so we index them in place, which lets us write lanes.
+// Vector values use extractelement.
+static void generateVectorIndexExpression(deExpression left, deExpression right) {
+  deDatatype datatype = deExpressionGetDatatype(left);
+  deDatatype elementType = deDatatypeGetElementType(datatype);
+  uint32 lanes = deDatatypeGetWidth(datatype);
+  generateExpression(left);
+  llElement vector = popElement(false);
+  generateExpression(right);
+  llElement index = resizeInteger(popElement(true), llSizeWidth, false, false);
+  generateConstantBoundsCheck(index, lanes);
+  char *vectorType = llGetTypeString(datatype, true);
+  if (!llElementIsRef(vector)) {
+    uint32 value = printNewValue();
+    llPrintf("extractelement %s %s, i%s %s\n", vectorType, llElementGetName(vector),
+        llSize, llElementGetName(index));
+    pushValue(elementType, value, false);
+    return;
+  }
+  char *arrayType = utSprintf("[%u x %s]", lanes, llGetTypeString(elementType, true));
+  uint32 arrayPtr = printNewValue();
+  llPrintf("bitcast %s* %s to %s*\n", vectorType, llElementGetName(vector), arrayType);
+  uint32 valuePtr = printNewValue();
+  llPrintf("getelementptr inbounds %s, %s* %%%u, i%s 0, i%s %s\n", arrayType, arrayType,
+      arrayPtr, llSize, llSize, llElementGetName(index));
+  pushValue(elementType, valuePtr, true);
 }
 
 // Generate an index expression.
@@ -2642,16 +3750,18 @@ static void generateIndexExpression(deExpression expression) {
   deExpression left = deExpressionGetFirstExpression(expression);
   deExpression right = deExpressionGetNextExpression(left);
   deDatatypeType type = deDatatypeGetType(deExpressionGetDatatype(left));
-  if (type == DE_TYPE_ARRAY || type == DE_TYPE_STRING) {
+  if (type == DE_TYPE_VECTOR) {
+    generateVectorIndexExpression(left, right);
+  } else if (type == DE_TYPE_ARRAY || type == DE_TYPE_STRING) {
     generateExpression(left);
     llElement array = popElement(false);
     generateExpression(right);
     llElement index = popElement(true);
-    boundsCheck(array, index, "Index out of bounds");
-    indexArray(array, index, true);
+    indexArray(array, index, !deExpressionInBounds(expression));
+  } else if (deExpressionGetType(right) != DE_EXPR_INTEGER) {
+    generateFixedArrayIndexExpression(left, right);
   } else {
     utAssert(type == DE_TYPE_TUPLE || type == DE_TYPE_STRUCT);
-    utAssert(deExpressionGetType(right) == DE_EXPR_INTEGER);
     deLine line = deExpressionGetLine(right);
     uint32 index = deBigintGetUint32(deExpressionGetBigint(right), line);
     generateTupleIndexExpression(left, index);
@@ -2790,7 +3900,8 @@ static void generateDotExpression(deExpression expression) {
     case DE_TYPE_MODINT:
     case DE_TYPE_FLOAT:
     case DE_TYPE_ARRAY:
-    case DE_TYPE_TUPLE: {
+    case DE_TYPE_TUPLE:
+    case DE_TYPE_VECTOR: {
       // This is a buitin type method access.
       deTemplate templ = deFindTypeTemplate(type);
       block = deFunctionGetSubBlock(deTemplateGetFunction(templ));
@@ -2830,7 +3941,7 @@ static bool isConstant(deExpression expression) {
   deExpressionType type = deExpressionGetType(expression);
   if (type == DE_EXPR_INTEGER) {
     deDatatype datatype = deExpressionGetDatatype(expression);
-    if (deDatatypeGetWidth(datatype) > llSizeWidth) {
+    if (deIntegerWidthIsBigint(deDatatypeGetWidth(datatype))) {
       return false;
     }
   }
@@ -2939,6 +4050,75 @@ static deDatatype castEnumToBaseType(deExpression expression, bool orEnumClass)
   return deFindEnumIntType(enumBlock);
 }
 
+// Return the LLVM instruction converting numbers of one type to another, or
+// NULL if the bits do not change.  This works on scalars and on the lanes of
+// vectors.  Unlike scalar casts, these never check for overflow.
+static char *findNumericConversionOp(deDatatype toType, deDatatype fromType) {
+  deDatatypeType to = deDatatypeGetType(toType);
+  deDatatypeType from = deDatatypeGetType(fromType);
+  uint32 toWidth = deDatatypeGetWidth(toType);
+  uint32 fromWidth = deDatatypeGetWidth(fromType);
+  if (to == DE_TYPE_FLOAT) {
+    if (from == DE_TYPE_FLOAT) {
+      return toWidth == fromWidth? NULL : toWidth > fromWidth? "fpext" : "fptrunc";
+    }
+    return from == DE_TYPE_INT? "sitofp" : "uitofp";
+  }
+  if (from == DE_TYPE_FLOAT) {
+    return to == DE_TYPE_INT? "fptosi" : "fptoui";
+  }
+  if (toWidth == fromWidth) {
+    return NULL;
+  }
+  if (toWidth < fromWidth) {
+    return "trunc";
+  }
+  return from == DE_TYPE_INT? "sext" : "zext";
+}
+
+// Convert a number or vector of numbers to the type.
+static llElement convertNumericElement(llElement element, deDatatype toType) {
+  deDatatype fromType = llElementGetDatatype(element);
+  deDatatype toLaneType = toType;
+  deDatatype fromLaneType = fromType;
+  if (deDatatypeIsVector(toType)) {
+    toLaneType = deDatatypeGetElementType(toType);
+  }
+  if (deDatatypeIsVector(fromType)) {
+    fromLaneType = deDatatypeGetElementType(fromType);
+  }
+  char *op = findNumericConversionOp(toLaneType, fromLaneType);
+  if (op == NULL) {
+    element.datatype = toType;
+    return element;
+  }
+  uint32 value = printNewValue();
+  llPrintf("%s %s %s to %s%s\n", op, llGetTypeString(fromType, true),
+      llElementGetName(element), llGetTypeString(toType, true), locationInfo());
+  return createElement(toType, utSprintf("%%%u", value), false);
+}
+
+// Generate a cast to a vector.  Scalars are converted to the lane type, with
+// the usual overflow checks, and then splatted to every lane.  Vectors are
+// converted lane by lane.
+static void generateVectorCastExpression(deExpression right, deDatatype datatype,
+    deDatatype rightDatatype, bool truncate) {
+  generateExpression(right);
+  llElement element = popElement(true);
+  if (deDatatypeIsVector(rightDatatype)) {
+    pushElement(convertNumericElement(element, datatype), false);
+    return;
+  }
+  deDatatype elementType = deDatatypeGetElementType(datatype);
+  if (deDatatypeIsInteger(elementType) && deDatatypeIsInteger(rightDatatype)) {
+    element = resizeInteger(element, deDatatypeGetWidth(elementType),
+        deDatatypeSigned(elementType), truncate);
+  } else {
+    element = convertNumericElement(element, elementType);
+  }
+  pushElement(splatElement(element, datatype), false);
+}
+
 // Generate a cast expression.
 static void generateCastExpression(deExpression expression, bool truncate) {
   deSignature signature = deExpressionGetSignature(expression);
@@ -2957,6 +4137,10 @@ static void generateCastExpression(deExpression expression, bool truncate) {
     topOfStack()->datatype = rightDatatype;
     return;
   }
+  if (deDatatypeIsVector(datatype)) {
+    generateVectorCastExpression(right, datatype, rightDatatype, truncate);
+    return;
+  }
   deDatatypeType type = deDatatypeGetType(datatype);
   deDatatypeType rightType = deDatatypeGetType(rightDatatype);
   generateExpression(right);
@@ -3019,7 +4203,7 @@ static void generateSignedCastExpression(deExpression expression, bool isSigned)
   deExpression child = deExpressionGetFirstExpression(expression);
   generateExpression(child);
   uint32 width = deDatatypeGetWidth(datatype);
-  if (width <= llSizeWidth) {
+  if (!deIntegerWidthIsBigint(width)) {
     llElement *element = topOfStack();
     deDatatype datatype = deDatatypeSetSigned(llElementGetDatatype(*element), isSigned);
     element->datatype = datatype;
@@ -3053,6 +4237,19 @@ static void generateBigintExp(deExpression expression) {
       llElementGetName(expElement), locationInfo());
 }
 
+// Generate a call to runtime_bigintExp on a native integer wider than 64 bits.
+static void generateWideIntExp(deExpression expression) {
+  deExpression base = deExpressionGetFirstExpression(expression);
+  deExpression exp = deExpressionGetNextExpression(base);
+  generateExpression(base);
+  llElement baseElement = popElement(true);
+  generateExpression(exp);
+  llElement expElement = popElement(true);
+  expElement = resizeInteger(expElement, 32, false, false);
+  generateWideIntBigintCall("runtime_bigintExp", deExpressionGetDatatype(expression),
+      &baseElement, 1, &expElement);
+}
+
 // Generate a call to runtime_smallnumExp.
 static void generateSmallnumExp(deExpression expression) {
   deDatatype datatype = deExpressionGetDatatype(expression);
@@ -3086,6 +4283,8 @@ static void generateExpExpression(deExpression expression) {
   deDatatype datatype = deExpressionGetDatatype(expression);
   if (llDatatypeIsBigint(datatype)) {
     generateBigintExp(expression);
+  } else if (llDatatypeIsWideInt(datatype)) {
+    generateWideIntExp(expression);
   } else {
     generateSmallnumExp(expression);
   }
@@ -3116,6 +4315,21 @@ static void generateModularBigintExp(deExpression expression, llElement modulusE
       locationInfo());
 }
 
+// Generate a modular exponentiation of native integers wider than 64 bits with
+// the bigint runtime.  The exponent may have any width.
+static void generateModularWideIntExp(deExpression expression, llElement modulusElement) {
+  deExpression base = deExpressionGetFirstExpression(expression);
+  deExpression exp = deExpressionGetNextExpression(base);
+  generateModularExpression(base, modulusElement);
+  llElement operands[3];
+  operands[0] = popElement(true);
+  generateExpression(exp);
+  operands[1] = popElement(true);
+  operands[2] = modulusElement;
+  generateWideIntBigintCall("runtime_bigintModularExp", deExpressionGetDatatype(expression),
+      operands, 3, NULL);
+}
+
 // Generate a modular exponentiation smallnum call.
 static void generateModularSmallnumExp(deExpression expression, llElement modulusElement) {
   deDatatype datatype = deExpressionGetDatatype(expression);
@@ -3143,6 +4357,8 @@ static void generateModularExpExpression(deExpression expression, llElement modu
   deDatatype datatype = deExpressionGetDatatype(expression);
   if (llDatatypeIsBigint(datatype)) {
     generateModularBigintExp(expression, modulusElement);
+  } else if (llDatatypeIsWideInt(datatype)) {
+    generateModularWideIntExp(expression, modulusElement);
   } else {
     generateModularSmallnumExp(expression, modulusElement);
   }
@@ -3194,6 +4410,82 @@ static void generateComplementExpression(deExpression expression) {
   }
 }
 
+// Return the LLVM instruction for a binary operator on vectors, or NULL if it
+// is not a vector operator.  Integer lanes wrap, so checked and truncating
+// operators are the same.
+static char *findVectorBinaryOp(deExpressionType exprType, bool isFloat) {
+  switch (exprType) {
+    case DE_EXPR_ADD:
+    case DE_EXPR_ADDTRUNC:
+      return isFloat? "fadd" : "add";
+    case DE_EXPR_SUB:
+    case DE_EXPR_SUBTRUNC:
+      return isFloat? "fsub" : "sub";
+    case DE_EXPR_MUL:
+    case DE_EXPR_MULTRUNC:
+      return isFloat? "fmul" : "mul";
+    case DE_EXPR_DIV:
+      return "fdiv";
+    case DE_EXPR_BITAND:
+      return "and";
+    case DE_EXPR_BITOR:
+      return "or";
+    case DE_EXPR_BITXOR:
+      return "xor";
+    default:
+      return NULL;
+  }
+}
+
+// Generate an arithmetic expression on vectors.  Scalar operands are splatted
+// first.  Return false if this is not a vector arithmetic expression.
+static bool generateVectorExpression(deExpression expression) {
+  deDatatype datatype = deExpressionGetDatatype(expression);
+  deDatatype elementType = deDatatypeGetElementType(datatype);
+  bool isFloat = deDatatypeIsFloat(elementType);
+  deExpressionType exprType = deExpressionGetType(expression);
+  char *typeString = llGetTypeString(datatype, true);
+  deExpression left = deExpressionGetFirstExpression(expression);
+  if (exprType == DE_EXPR_NEGATE || exprType == DE_EXPR_NEGATETRUNC ||
+      exprType == DE_EXPR_BITNOT) {
+    generateExpression(left);
+    llElement element = popElement(true);
+    uint32 value;
+    if (exprType == DE_EXPR_BITNOT) {
+      llElement ones = splatElement(createElement(elementType, "-1", false), datatype);
+      value = printNewValue();
+      llPrintf("xor %s %s, %s\n", typeString, llElementGetName(element), llElementGetName(ones));
+    } else if (isFloat) {
+      value = printNewValue();
+      llPrintf("fneg %s %s\n", typeString, llElementGetName(element));
+    } else {
+      value = printNewValue();
+      llPrintf("sub %s zeroinitializer, %s\n", typeString, llElementGetName(element));
+    }
+    pushValue(datatype, value, false);
+    return true;
+  }
+  char *op = findVectorBinaryOp(exprType, isFloat);
+  if (op == NULL) {
+    return false;
+  }
+  generateExpression(left);
+  llElement leftElement = popElement(true);
+  generateExpression(deExpressionGetNextExpression(left));
+  llElement rightElement = popElement(true);
+  if (!deDatatypeIsVector(llElementGetDatatype(leftElement))) {
+    leftElement = splatElement(leftElement, datatype);
+  }
+  if (!deDatatypeIsVector(llElementGetDatatype(rightElement))) {
+    rightElement = splatElement(rightElement, datatype);
+  }
+  uint32 value = printNewValue();
+  llPrintf("%s %s %s, %s%s\n", op, typeString, llElementGetName(leftElement),
+      llElementGetName(rightElement), locationInfo());
+  pushValue(datatype, value, false);
+  return true;
+}
+
 // Generate a negate expression.  LLVM does not have negate, so subtract from 0.
 static void generateNegateExpression(deExpression expression) {
   deSignature signature = deExpressionGetSignature(expression);
@@ -3211,9 +4503,9 @@ static void generateNegateExpression(deExpression expression) {
     uint32 value = printNewValue();
     llPrintf("fneg %s %s\n", type, llElementGetName(leftElement));
     pushValue(datatype, value, false);
-  } else if (width > llSizeWidth) {
+  } else if (llDatatypeIsBigint(datatype)) {
     char *funcName = "runtime_bigintNegate";
-    if (!deUnsafeMode && deExpressionGetType(expression) == DE_EXPR_NEGATETRUNC) {
+    if (!uncheckedCode() && deExpressionGetType(expression) == DE_EXPR_NEGATETRUNC) {
       funcName = "runtime_bigintNegateTrunc";
     }
     llDeclareRuntimeFunction(funcName);
@@ -3221,7 +4513,7 @@ static void generateNegateExpression(deExpression expression) {
     llPrintf(
       "  call void @%s(%%struct.runtime_array* %s, %%struct.runtime_array* %s)\n",
       funcName, llElementGetName(resultArray), llElementGetName(leftElement));
-  } else if (!deUnsafeMode && deExpressionGetType(expression) != DE_EXPR_NEGATETRUNC) {
+  } else if (!uncheckedCode() && deExpressionGetType(expression) != DE_EXPR_NEGATETRUNC) {
     uint32 structValue = printNewValue();
     char *opType = findTruncatingOpName(expression);
     llDeclareOverloadedFunction(utSprintf(
@@ -3236,8 +4528,8 @@ static void generateNegateExpression(deExpression expression) {
     llPrintf("extractvalue {i%u, i1} %%%u, 1\n", width, structValue);
     utSym passed = newLabel("overflowCheckPassed");
     utSym failed = newLabel("overflowCheckFailed");
-    llPrintf("  br i1 %%%u, label %%%s, label %%%s\n",
-        overflowValue, utSymGetName(failed), utSymGetName(passed));
+    llPrintf("  br i1 %%%u, label %%%s, label %%%s%s\n",
+        overflowValue, utSymGetName(failed), utSymGetName(passed), checkBranchWeights(false));
     printLabel(failed);
     llDeclareRuntimeFunction("runtime_raiseOverflow");
     llPrintf("  call void @runtime_raiseOverflow()\n  unreachable\n");
@@ -3257,10 +4549,14 @@ static void generateRandomUint(deExpression expression) {
   uint32 width = deDatatypeGetWidth(datatype);
   char *location = locationInfo();
   if (width > llSizeWidth) {
-    llElement dest = allocateTempValue(datatype);
+    llElement dest = allocateTempArray(datatype);
     llDeclareRuntimeFunction("runtime_generateTrueRandomBigint");
     llPrintf("  call void @runtime_generateTrueRandomBigint(%%struct.runtime_array* %s, i32 %u)%s\n",
         llElementGetName(dest), width, location);
+    if (llDatatypeIsWideInt(datatype)) {
+      popElement(false);
+      pushElement(convertBigintToNativeInt(dest, width, false, true), false);
+    }
   } else {
     uint32 value = printNewValue();
     llDeclareRuntimeFunction("runtime_generateTrueRandomValue");
@@ -3289,7 +4585,7 @@ static bool couldBeGreaterOrEqual(deExpression expression, uint32 width) {
 static void generateBigintShiftOrRotateExpression(deExpression expression) {
   deDatatype datatype = deExpressionGetDatatype(expression);
   uint32 width = deDatatypeGetWidth(datatype);
-  utAssert(width > llSizeWidth);
+  utAssert(llDatatypeIsBigint(datatype));
   deExpression left = deExpressionGetFirstExpression(expression);
   deExpression right = deExpressionGetNextExpression(left);
   generateExpression(left);
@@ -3321,7 +4617,7 @@ static void generateShiftOrRotateExpression(deExpression expression) {
   }
   deDatatype datatype = deExpressionGetDatatype(expression);
   uint32 width = deDatatypeGetWidth(datatype);
-  if (width > llSizeWidth) {
+  if (llDatatypeIsBigint(datatype)) {
     generateBigintShiftOrRotateExpression(expression);
     return;
   }
@@ -3380,12 +4676,82 @@ static void generateShiftOrRotateExpression(deExpression expression) {
   pushValue(datatype, value, false);
 }
 
+// Public smallnum modular add, sub and mul do not need to be constant time,
+// so emit them inline rather than calling the runtime.  The operands are
+// already reduced, and all three are llSize integers.  Return false if the
+// operator has no inline form.
+static bool generateInlineModularOp(deExpression expression, llElement leftElement,
+    llElement rightElement, llElement modulusElement) {
+  char *a = llElementGetName(leftElement);
+  char *b = llElementGetName(rightElement);
+  char *m = llElementGetName(modulusElement);
+  uint32 result;
+  switch (deExpressionGetType(expression)) {
+    case DE_EXPR_ADD:
+      uint32 sum = printNewValue();
+      llPrintf("add i%s %s, %s\n", llSize, a, b);
+      uint32 carry = printNewValue();
+      llPrintf("icmp ult i%s %%%u, %s\n", llSize, sum, a);
+      uint32 tooBig = printNewValue();
+      llPrintf("icmp uge i%s %%%u, %s\n", llSize, sum, m);
+      uint32 wrap = printNewValue();
+      llPrintf("or i1 %%%u, %%%u\n", carry, tooBig);
+      uint32 reduced = printNewValue();
+      llPrintf("sub i%s %%%u, %s\n", llSize, sum, m);
+      result = printNewValue();
+      llPrintf("select i1 %%%u, i%s %%%u, i%s %%%u\n", wrap, llSize, reduced, llSize, sum);
+      break;
+    }
+    case DE_EXPR_SUB:
+      uint32 diff = printNewValue();
+      llPrintf("sub i%s %s, %s\n", llSize, a, b);
+      uint32 borrow = printNewValue();
+      llPrintf("icmp ult i%s %s, %s\n", llSize, a, b);
+      uint32 wrapped = printNewValue();
+      llPrintf("add i%s %%%u, %s\n", llSize, diff, m);
+      result = printNewValue();
+      llPrintf("select i1 %%%u, i%s %%%u, i%s %%%u\n", borrow, llSize, wrapped, llSize, diff);
+      break;
+    }
+    case DE_EXPR_MUL:
+      uint32 width = 2 * llSizeWidth;
+      uint32 wideA = printNewValue();
+      llPrintf("zext i%s %s to i%u\n", llSize, a, width);
+      uint32 wideB = printNewValue();
+      llPrintf("zext i%s %s to i%u\n", llSize, b, width);
+      uint32 wideM = printNewValue();
+      llPrintf("zext i%s %s to i%u\n", llSize, m, width);
+      uint32 product = printNewValue();
+      llPrintf("mul nuw i%u %%%u, %%%u\n", width, wideA, wideB);
+      uint32 remainder = printNewValue();
+      llPrintf("urem i%u %%%u, %%%u\n", width, product, wideM);
+      result = printNewValue();
+      llPrintf("trunc i%u %%%u to i%s\n", width, remainder, llSize);
+      break;
+    }
+    default:
+      return false;
+  }
+  pushValue(llSizeType, result, false);
+  return true;
+}
+
 // Write a binary modular expression.
 static void generateBinaryModularExpression(deExpression expression, llElement modulusElement) {
   deDatatype datatype = deExpressionGetDatatype(expression);
   deExpression left = deExpressionGetFirstExpression(expression);
   deExpression right = deExpressionGetNextExpression(left);
   generateModularExpression(left, modulusElement);
+  if (llDatatypeIsWideInt(datatype)) {
+    llElement operands[3];
+    operands[0] = popElement(true);
+    generateModularExpression(right, modulusElement);
+    operands[1] = popElement(true);
+    operands[2] = modulusElement;
+    generateWideIntBigintCall(findBigintModularFunctionName(expression), datatype,
+        operands, 3, NULL);
+    return;
+  }
   if (!llDatatypeIsBigint(datatype)) {
     resizeTop(llSizeWidth);
   }
@@ -3396,6 +4762,11 @@ static void generateBinaryModularExpression(deExpression expression, llElement m
     modulusElement = resizeSmallInteger(modulusElement, llSizeWidth, false, false);
   }
   llElement rightElement = popElement(true);
+  if (!llDatatypeIsBigint(datatype) && !deDatatypeSecret(datatype) &&
+      generateInlineModularOp(expression, leftElement, rightElement, modulusElement)) {
+    resizeTop(deDatatypeGetWidth(datatype));
+    return;
+  }
   char *function = findExpressionFunction(expression);
   char *location = locationInfo();
   llDeclareRuntimeFunction(function);
@@ -3437,13 +4808,17 @@ static void modularReduction(deExpression expression,
   }
   char *location = locationInfo();
   if (llDatatypeIsBigint(modDatatype)) {
-    char *function = "runtime_bigintMod";
+    char *function = findBigintDivFunction(!deDatatypeSecret(valDatatype), true);
     llDeclareRuntimeFunction(function);
     llElement resultArray = allocateTempValue(modDatatype);
     llPrintf("  call void @%s(%%struct.runtime_array* %s, %%struct.runtime_array* %s, "
              "%%struct.runtime_array* %s)%s\n",
         function, llElementGetName(resultArray), llElementGetName(valueElement),
         llElementGetName(modulusElement), location);
+  } else if (llDatatypeIsWideInt(modDatatype)) {
+    llElement operands[2] = {valueElement, modulusElement};
+    generateWideIntBigintCall(findBigintDivFunction(!deDatatypeSecret(valDatatype), true),
+        modDatatype, operands, 2, NULL);
   } else {
     bool isSigned = deDatatypeGetType(valDatatype) == DE_TYPE_INT;
     bool secret = deDatatypeSecret(valDatatype);
@@ -3699,6 +5074,9 @@ static void generateExpression(deExpression expression) {
   deDatatypeType type = deDatatypeGetType(datatype);
   bool isSigned = deDatatypeGetType(datatype) == DE_TYPE_INT;
   deExpressionType exprType = deExpressionGetType(expression);
+  if (type == DE_TYPE_VECTOR && generateVectorExpression(expression)) {
+    return;
+  }
   switch (exprType) {
     case DE_EXPR_INTEGER:
       pushInteger(expression);
@@ -3742,7 +5120,7 @@ static void generateExpression(deExpression expression) {
         generateBinaryExpression(expression, "fadd");
       } else if ((type == DE_TYPE_ARRAY || type == DE_TYPE_STRING) && exprType == DE_EXPR_ADD) {
         generateConcatExpression(expression);
-      } else if (deUnsafeMode) {
+      } else if (uncheckedCode()) {
         generateBinaryExpression(expression, "add");
       } else {
         generateBinaryExpressionWithOverflow(expression);
@@ -3752,7 +5130,7 @@ static void generateExpression(deExpression expression) {
       if (type == DE_TYPE_FLOAT) {
         generateBinaryExpression(expression, "fsub");
       } else {
-        if (deUnsafeMode) {
+        if (uncheckedCode()) {
           generateBinaryExpression(expression, "sub");
         } else {
           generateBinaryExpressionWithOverflow(expression);
@@ -3763,7 +5141,7 @@ static void generateExpression(deExpression expression) {
       if (type == DE_TYPE_FLOAT) {
         generateBinaryExpression(expression, "fmul");
       } else {
-        if (deUnsafeMode) {
+        if (uncheckedCode()) {
           generateBinaryExpression(expression, "mul");
         } else {
           generateBinaryExpressionWithOverflow(expression);
@@ -3902,6 +5280,16 @@ static void generateExpression(deExpression expression) {
       generateNotNullExpression(expression);
       break;
     case DE_EXPR_ARRAYOF:
+      if (deDatatypeGetType(datatype) == DE_TYPE_TUPLE) {
+        // Fixed-sized arrays are tuples, which need a zeroed temporary.
+        pushNullValue(datatype);
+      } else {
+        pushDefaultValue(datatype);
+      }
+      break;
+    case DE_EXPR_VECTOROF:
+      pushDefaultValue(datatype);
+      break;
     case DE_EXPR_TYPEOF:
     case DE_EXPR_UINTTYPE:
     case DE_EXPR_INTTYPE:
@@ -4096,6 +5484,7 @@ static utSym generateDoWhileStatement(deStatement statement, utSym startLabel) {
   }
   printLabel(loopLabel);
   if (type == DE_STATEMENT_DO) {
+    countEvent(LL_COUNT_LOOP, deStatementGetLine(statement));
     utSym blockEndLabel = generateBlockStatements(deStatementGetSubBlock(statement), utSymNull);
     printLabel(blockEndLabel);
     // Advance to the while statement.
@@ -4116,6 +5505,12 @@ static utSym generateDoWhileStatement(deStatement statement, utSym startLabel) {
     utSym loopBodyLabel = newLabel("whileBody");
     llPrintf("  br i1 %s, label %%%s, label%%%s\n",
         llElementGetName(condition), utSymGetName(loopBodyLabel), utSymGetName(doneLabel));
+    // Do-while loops were counted at the top.
+    if (deInstrumentCode && type != DE_STATEMENT_DO) {
+      printLabel(loopBodyLabel);
+      countEvent(LL_COUNT_LOOP, deStatementGetLine(statement));
+      loopBodyLabel = utSymNull;
+    }
     utSym blockEndLabel = generateBlockStatements(whileBlock, loopBodyLabel);
     printLabel(blockEndLabel);
     jumpTo(loopLabel);
@@ -4123,6 +5518,152 @@ static utSym generateDoWhileStatement(deStatement statement, utSym startLabel) {
   return doneLabel;
 }
 
+// The most data member arrays to prefetch per element in a linked traversal.
+#define LL_MAX_PREFETCH_ARRAYS 4
+
+// If the for-loop's update is |v = v.link|, where |link| refers to the same
+// class as |v|, as in the loops of LinkedList and DoublyLinked iterators,
+// return the |link| data member.
+static deVariable findLinkedTraversalMember(deExpression update) {
+  if (deExpressionGetType(update) != DE_EXPR_EQUALS) {
+    return deVariableNull;
+  }
+  deExpression target = deExpressionGetFirstExpression(update);
+  deExpression value = deExpressionGetNextExpression(target);
+  if (deExpressionGetType(target) != DE_EXPR_IDENT || deExpressionGetType(value) != DE_EXPR_DOT) {
+    return deVariableNull;
+  }
+  deExpression object = deExpressionGetFirstExpression(value);
+  if (deExpressionGetType(object) != DE_EXPR_IDENT ||
+      deExpressionGetName(object) != deExpressionGetName(target)) {
+    return deVariableNull;
+  }
+  deDatatype datatype = deExpressionGetDatatype(target);
+  if (deDatatypeGetType(datatype) != DE_TYPE_CLASS ||
+      deExpressionGetDatatype(value) != datatype) {
+    return deVariableNull;
+  }
+  deBlock classBlock = deClassGetSubBlock(deDatatypeGetClass(datatype));
+  deExpression member = deExpressionGetNextExpression(object);
+  deIdent ident = deBlockFindIdent(classBlock, deExpressionGetName(member));
+  if (ident == deIdentNull || deIdentGetType(ident) != DE_IDENT_VARIABLE) {
+    return deVariableNull;
+  }
+  return deIdentGetVariable(ident);
+}
+
+// Add the global array of the data member to |arrays| if there is room, and
+// it is not there already.
+static void addPrefetchArray(deVariable *arrays, uint32 *numArrays, deVariable variable) {
+  if (deVariableGetPackedBits(variable) != 0) {
+    return;
+  }
+  deVariable arrayVar = deVariableGetGlobalArrayVariable(variable);
+  if (arrayVar == deVariableNull) {
+    return;
+  }
+  for (uint32 i = 0; i < *numArrays; i++) {
+    if (arrays[i] == arrayVar) {
+      return;
+    }
+  }
+  if (*numArrays < LL_MAX_PREFETCH_ARRAYS) {
+    arrays[(*numArrays)++] = arrayVar;
+  }
+}
+
+// Find data members of the class read in the expression through a variable of
+// the class, and add their arrays to |arrays|.
+static void findExpressionPrefetchArrays(deExpression expression, deClass theClass,
+    deVariable *arrays, uint32 *numArrays) {
+  if (deExpressionGetType(expression) == DE_EXPR_DOT) {
+    deExpression object = deExpressionGetFirstExpression(expression);
+    deDatatype datatype = deExpressionGetDatatype(object);
+    if (deExpressionGetType(object) == DE_EXPR_IDENT && datatype != deDatatypeNull &&
+        deDatatypeGetType(datatype) == DE_TYPE_CLASS && deDatatypeGetClass(datatype) == theClass) {
+      deExpression member = deExpressionGetNextExpression(object);
+      deIdent ident = deBlockFindIdent(deClassGetSubBlock(theClass), deExpressionGetName(member));
+      if (ident != deIdentNull && deIdentGetType(ident) == DE_IDENT_VARIABLE) {
+        addPrefetchArray(arrays, numArrays, deIdentGetVariable(ident));
+      }
+    }
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    findExpressionPrefetchArrays(child, theClass, arrays, numArrays);
+  } deEndExpressionExpression;
+}
+
+// Find data members of the class read in the block, including sub-blocks.
+static void findBlockPrefetchArrays(deBlock block, deClass theClass, deVariable *arrays,
+    uint32 *numArrays) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull) {
+      findExpressionPrefetchArrays(expression, theClass, arrays, numArrays);
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      findBlockPrefetchArrays(subBlock, theClass, arrays, numArrays);
+    }
+  } deEndBlockStatement;
+}
+
+// Return a pointer to the element of the data member's global array for the
+// object at |index|.  There are no checks: slot 0, for null, always exists,
+// and prefetches of stale slots are harmless.
+static llElement indexPrefetchArray(deVariable arrayVar, llElement index) {
+  llElement array = createElement(deVariableGetDatatype(arrayVar),
+      llGetVariableName(arrayVar), true);
+  indexArray(array, index, false);
+  return popElement(false);
+}
+
+// Prefetch the data of the element |dePrefetchDistance| links ahead in a
+// linked traversal: the link member itself, so the walk does not stall on the
+// next hop, and the members of the class the loop body reads.  The elements
+// in between were prefetched by earlier iterations, so following the links to
+// it usually hits the cache.  Null links end at slot 0, which is never freed.
+static void generateLinkedTraversalPrefetches(deExpression update, deBlock body) {
+  if (dePrefetchDistance == 0 || deProfileFields) {
+    return;
+  }
+  deVariable link = findLinkedTraversalMember(update);
+  if (link == deVariableNull || deVariableGetPackedBits(link) != 0) {
+    return;
+  }
+  deClass theClass = deDatatypeGetClass(deVariableGetDatatype(link));
+  deVariable arrays[LL_MAX_PREFETCH_ARRAYS];
+  uint32 numArrays = 0;
+  addPrefetchArray(arrays, &numArrays, link);
+  findBlockPrefetchArrays(body, theClass, arrays, &numArrays);
+  deDatatype indexDatatype = deUintDatatypeCreate(deClassGetRefWidth(theClass));
+  char *indexType = llGetTypeString(indexDatatype, true);
+  deExpression object = deExpressionGetFirstExpression(update);
+  generateExpression(object);
+  llElement index = createElement(indexDatatype, llElementGetName(popElement(true)), false);
+  deVariable linkArray = deVariableGetGlobalArrayVariable(link);
+  for (uint32 hop = 0; hop < dePrefetchDistance; hop++) {
+    llElement linkRef = indexPrefetchArray(linkArray, index);
+    if (deVariablePacked(link)) {
+      linkRef = indexTuple(linkRef, deVariableGetPackedIndex(link), true);
+    }
+    uint32 next = printNewValue();
+    llPrintf("load %s, %s* %s\n", indexType, indexType, llElementGetName(linkRef));
+    index = createValueElement(indexDatatype, next, false);
+  }
+  llDeclareRuntimeFunction("llvm.prefetch");
+  for (uint32 i = 0; i < numArrays; i++) {
+    llElement elementRef = indexPrefetchArray(arrays[i], index);
+    uint32 address = printNewValue();
+    llPrintf("bitcast %s* %s to i8*\n", llGetTypeString(llElementGetDatatype(elementRef), true),
+        llElementGetName(elementRef));
+    // Read, high temporal locality, data cache.
+    llPrintf("  call void @llvm.prefetch.p0i8(i8* %%%u, i32 0, i32 3, i32 1)\n", address);
+  }
+}
+
 // Generate a for-loop.  It is like a while loop with the following structure:
 //   init
 //   while (test) {
@@ -4151,6 +5692,17 @@ static utSym generateForStatement(deStatement statement, utSym startLabel) {
   llPrintf("  br i1 %s, label %%%s, label%%%s\n",
       llElementGetName(condition), utSymGetName(forLoopBody), utSymGetName(forLoopDone));
   deBlock body = deStatementGetSubBlock(statement);
+  if (deInstrumentCode) {
+    printLabel(forLoopBody);
+    countEvent(LL_COUNT_LOOP, deStatementGetLine(statement));
+    forLoopBody = utSymNull;
+  }
+  if (findLinkedTraversalMember(update) != deVariableNull) {
+    printLabel(forLoopBody);
+    generateLinkedTraversalPrefetches(update, body);
+    forLoopBody = newLabel("forLoopPrefetched");
+    jumpTo(forLoopBody);
+  }
   utSym blockEndLabel = generateBlockStatements(body, forLoopBody);
   printLabel(blockEndLabel);
   generateExpression(update);
@@ -4296,8 +5848,43 @@ static void generateExceptStatement(deStatement statement, utSym exceptDoneLabel
   } deEndBlockStatement;
 }
 
+// Generate a try statement with -unwind.  Nothing is executed on entry.  Calls
+// in the body are turned into invokes of the landing pad by lowerCallsToInvokes,
+// and the runtime unwinds to it when an exception is raised.
+static utSym generateUnwindTryStatement(deStatement tryStatement, utSym startLabel) {
+  llFunctionHasTry = true;
+  printLabel(startLabel);
+  utSym tryLabel = newLabel("try");
+  utSym landingPadLabel = newLabel("landingPad");
+  utSym exceptLabel = newLabel("except");
+  utSym exceptDoneLabel = newLabel("exceptDone");
+  jumpTo(tryLabel);
+  llPrintf("%s%s\n", LL_TRY_BEGIN_STRING, utSymGetName(landingPadLabel));
+  deBlock subBlock = deStatementGetSubBlock(tryStatement);
+  utSym blockEndLabel = generateBlockStatements(subBlock, tryLabel);
+  llPrintf("%s\n", LL_TRY_END_STRING);
+  if (!blockEndsInReturn(subBlock)) {
+    printLabel(blockEndLabel);
+    jumpTo(exceptDoneLabel);
+  }
+  // The landingpad must come first, so don't use printLabel, which may free
+  // elements.
+  llPrintf("%s:\n", utSymGetName(landingPadLabel));
+  llPrevLabel = landingPadLabel;
+  printNewValue();
+  llPrintf("landingpad {i8*, i32} cleanup\n");
+  jumpTo(exceptLabel);
+  printLabel(exceptLabel);
+  deStatement exceptStatement = deStatementGetNextBlockStatement(tryStatement);
+  generateExceptStatement(exceptStatement, exceptDoneLabel);
+  return exceptDoneLabel;
+}
+
 // Generate a try statement.  For now, just generate if (runtime_setjmp()).
 static utSym generateTryStatement(deStatement tryStatement, utSym startLabel) {
+  if (deUnwindExceptions) {
+    return generateUnwindTryStatement(tryStatement, startLabel);
+  }
   printLabel(startLabel);
   uint32 setjmpBuffer = printNewTmpValue();
   llTmpPrintf("alloca %%struct.jmpbuf_wrapped\n");
@@ -4314,9 +5901,9 @@ static utSym generateTryStatement(deStatement tryStatement, utSym startLabel) {
   utSym tryLabel = newLabel("try");
   utSym exceptLabel = newLabel("except");
   utSym exceptDoneLabel = newLabel("exceptDone");
-  llPrintf("  br i1 %s, label %%%s, label %%%s%s\n",
+  llPrintf("  br i1 %s, label %%%s, label %%%s%s%s\n",
       llElementGetName(condition), utSymGetName(tryLabel),
-      utSymGetName(exceptLabel), locationInfo());
+      utSymGetName(exceptLabel), checkBranchWeights(true), locationInfo());
   deBlock subBlock = deStatementGetSubBlock(tryStatement);
   llSetjmpDepth++;
   utSym blockEndLabel = generateBlockStatements(subBlock, tryLabel);
@@ -4334,9 +5921,71 @@ static utSym generateTryStatement(deStatement tryStatement, utSym startLabel) {
   return exceptDoneLabel;
 }
 
+// Determine if all print arguments are strings or integers that fit in a
+// machine word, so that they can be written directly to the stdout buffer.
+static bool printArgumentsAreSimple(deExpression expression) {
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    if (deExpressionIsType(child)) {
+      return false;
+    }
+    if (deExpressionGetType(child) != DE_EXPR_STRING) {
+      deDatatype datatype = deExpressionGetDatatype(child);
+      deDatatypeType type = deDatatypeGetType(datatype);
+      if (deDatatypeSecret(datatype)) {
+        return false;
+      }
+      if (type != DE_TYPE_STRING && ((type != DE_TYPE_UINT && type != DE_TYPE_INT) ||
+          deDatatypeGetWidth(datatype) > llSizeWidth)) {
+        return false;
+      }
+    }
+  } deEndExpressionExpression;
+  return true;
+}
+
+// Generate a print statement of only strings and small integers.  Each argument
+// is written to the stdout buffer with runtime_puts or runtime_putInteger,
+// rather than being formatted into a temporary string first.  Arguments are
+// still all evaluated before anything is printed, in the same order as
+// evalFormatParams.
+static void generateSimplePrintStatement(deExpression expression) {
+  deExpression child;
+  for (child = deExpressionGetLastExpression(expression); child != deExpressionNull;
+      child = deExpressionGetPrevExpression(child)) {
+    if (deExpressionGetType(child) != DE_EXPR_STRING) {
+      generateExpression(child);
+      derefElement(topOfStack());
+      if (deDatatypeIsInteger(deExpressionGetDatatype(child))) {
+        resizeTop(llSizeWidth);
+      }
+    }
+  }
+  deForeachExpressionExpression(expression, child) {
+    if (deExpressionGetType(child) == DE_EXPR_STRING) {
+      callPuts(generateString(deExpressionGetString(child)));
+    } else {
+      llElement element = popElement(false);
+      deDatatype datatype = deExpressionGetDatatype(child);
+      if (deDatatypeGetType(datatype) == DE_TYPE_STRING) {
+        callPuts(element);
+      } else {
+        llDeclareRuntimeFunction("runtime_putInteger");
+        llPrintf("  call void @runtime_putInteger(i%s %s, i32 %u, i1 zeroext %s)%s\n",
+            llSize, llElementGetName(element), deDatatypeGetWidth(datatype),
+            boolVal(deDatatypeSigned(datatype)), locationInfo());
+      }
+    }
+  } deEndExpressionExpression;
+}
+
 // Generate a print statement.
 static void generatePrintStatement(deStatement statement) {
   deExpression expression = deStatementGetExpression(statement);
+  if (printArgumentsAreSimple(expression)) {
+    generateSimplePrintStatement(expression);
+    return;
+  }
   deString formatString = deFindPrintFormat(expression);
   llElement format = generateString(formatString);
   llElement array = allocateTempValue(deStringDatatypeCreate());
@@ -4446,6 +6095,483 @@ static void generateRefOrUnrefStatement(deStatement statement) {
   }
 }
 
+// Declare the intrinsics used to create, resume, and destroy coroutines.
+static void declareCoroutineIntrinsics(void) {
+  llDeclareRuntimeFunction("calloc");
+  llDeclareRuntimeFunction("free");
+  llDeclareRuntimeFunction("llvm.coro.id");
+  llDeclareRuntimeFunction("llvm.coro.alloc");
+  llDeclareRuntimeFunction("llvm.coro.size");
+  llDeclareRuntimeFunction("llvm.coro.begin");
+  llDeclareRuntimeFunction("llvm.coro.suspend");
+  llDeclareRuntimeFunction("llvm.coro.free");
+  llDeclareRuntimeFunction("llvm.coro.end");
+  llDeclareRuntimeFunction("llvm.coro.done");
+  llDeclareRuntimeFunction("llvm.coro.promise");
+  llDeclareRuntimeFunction("llvm.coro.resume");
+  llDeclareRuntimeFunction("llvm.coro.destroy");
+}
+
+// Start the body of an iterator generated as a coroutine.  The frame is
+// allocated with calloc, unless LLVM's heap elision moves it into the caller's
+// frame.  CoroEarly marks the function as a coroutine when it sees coro.id.
+static void printCoroutineBegin(deSignature signature) {
+  declareCoroutineIntrinsics();
+  char *type = llGetTypeString(deSignatureGetReturnType(signature), true);
+  llPrintf("  %%.coroPromise = alloca %s, align %u\n", type, LL_COROUTINE_PROMISE_ALIGN);
+  llPrintf("  %%.coroPromisePtr = bitcast %s* %%.coroPromise to i8*\n", type);
+  llPrintf("  %%.coroId = call token @llvm.coro.id(i32 %u, i8* %%.coroPromisePtr, "
+      "i8* null, i8* null)\n", LL_COROUTINE_PROMISE_ALIGN);
+  llPrintf("  %%.coroNeedsAlloc = call i1 @llvm.coro.alloc(token %%.coroId)\n");
+  utSym entryLabel = llPrevLabel;
+  utSym allocLabel = newLabel("coroAlloc");
+  utSym beginLabel = newLabel("coroBegin");
+  llPrintf("  br i1 %%.coroNeedsAlloc, label %%%s, label %%%s\n",
+      utSymGetName(allocLabel), utSymGetName(beginLabel));
+  printLabel(allocLabel);
+  llPrintf("  %%.coroSize = call i%s @llvm.coro.size.i%s()\n", llSize, llSize);
+  llPrintf("  %%.coroMem = call i8* @calloc(i%s 1, i%s %%.coroSize)\n", llSize, llSize);
+  jumpTo(beginLabel);
+  printLabel(beginLabel);
+  llPrintf("  %%.coroFrame = phi i8* [null, %%%s], [%%.coroMem, %%%s]\n",
+      utSymGetName(entryLabel), utSymGetName(allocLabel));
+  llPrintf("  %%.coroHandle = call i8* @llvm.coro.begin(token %%.coroId, i8* %%.coroFrame)\n");
+  llCoroSuspendLabel = newLabel("coroSuspend");
+  llCoroCleanupLabel = newLabel("coroCleanup");
+  llInCoroutine = true;
+}
+
+// Finish an iterator generated as a coroutine.  After the last yield, free
+// locals and suspend for the last time, so the caller sees coro.done.
+static void printCoroutineEnd(deBlock block, utSym label) {
+  if (!blockEndsInReturn(block)) {
+    printLabel(label);
+    freeElements(true);
+    uint32 result = printNewValue();
+    llPrintf("call i8 @llvm.coro.suspend(token none, i1 true)\n");
+    llPrintf("  switch i8 %%%u, label %%%s [i8 1, label %%%s]\n", result,
+        utSymGetName(llCoroSuspendLabel), utSymGetName(llCoroCleanupLabel));
+  }
+  printLabel(llCoroCleanupLabel);
+  llPrintf("  %%.coroFreeMem = call i8* @llvm.coro.free(token %%.coroId, i8* %%.coroHandle)\n");
+  llPrintf("  call void @free(i8* %%.coroFreeMem)\n");
+  jumpTo(llCoroSuspendLabel);
+  printLabel(llCoroSuspendLabel);
+  printNewValue();
+  llPrintf("call i1 @llvm.coro.end(i8* %%.coroHandle, i1 false)\n");
+  llPrintf("  ret i8* %%.coroHandle\n");
+  llInCoroutine = false;
+}
+
+// Generate a yield in an iterator generated as a coroutine.  Store the value in
+// the promise, and suspend.  Return the label where the caller resumes us.
+static utSym generateYieldStatement(deStatement statement) {
+  if (!llInCoroutine) {
+    utExit("Not expecting to see a yield() statement during code generation");
+  }
+  generateExpression(deStatementGetExpression(statement));
+  llElement value = popElement(true);
+  char *type = llGetTypeString(llElementGetDatatype(value), true);
+  llPrintf("  store %s %s, %s* %%.coroPromise\n", type, llElementGetName(value), type);
+  freeElements(false);
+  uint32 result = printNewValue();
+  llPrintf("call i8 @llvm.coro.suspend(token none, i1 false)\n");
+  utSym resumeLabel = newLabel("yieldResume");
+  llPrintf("  switch i8 %%%u, label %%%s [i8 0, label %%%s\n    i8 1, label %%%s]\n",
+      result, utSymGetName(llCoroSuspendLabel), utSymGetName(resumeLabel),
+      utSymGetName(llCoroCleanupLabel));
+  return resumeLabel;
+}
+
+// Generate a foreach statement that calls its iterator as a coroutine:
+//   handle = iterator(parameters)
+//   while !coro.done(handle) {
+//     loopVar = *coro.promise(handle)
+//     body
+//     coro.resume(handle)
+//   }
+//   coro.destroy(handle)
+// The iterator only ever sees the end of the loop, since the body cannot return.
+static utSym generateCoroutineForeachStatement(deStatement statement, utSym startLabel) {
+  printLabel(startLabel);
+  declareCoroutineIntrinsics();
+  deExpression assignment = deStatementGetExpression(statement);
+  deExpression access = deExpressionGetFirstExpression(assignment);
+  deExpression call = deExpressionGetNextExpression(access);
+  deVariable loopVar = deIdentGetVariable(deExpressionGetIdent(access));
+  // Temporary parameters must live until the iterator is done with them.
+  uint32 numNeedsFreeLocals = llNumLocalsNeedingFree;
+  uint32 handle = generateCoroutineCall(call);
+  llNumLocalsNeedingFree = llNeedsFreePos;
+  utSym loopLabel = newLabel("coroLoop");
+  utSym bodyLabel = newLabel("coroBody");
+  utSym doneLabel = newLabel("coroDone");
+  jumpTo(loopLabel);
+  printLabel(loopLabel);
+  uint32 done = printNewValue();
+  llPrintf("call i1 @llvm.coro.done(i8* %%%u)\n", handle);
+  llPrintf("  br i1 %%%u, label %%%s, label %%%s\n", done,
+      utSymGetName(doneLabel), utSymGetName(bodyLabel));
+  printLabel(bodyLabel);
+  char *type = llGetTypeString(deVariableGetDatatype(loopVar), true);
+  uint32 promise = printNewValue();
+  llPrintf("call i8* @llvm.coro.promise(i8* %%%u, i32 %u, i1 false)\n", handle,
+      LL_COROUTINE_PROMISE_ALIGN);
+  uint32 valuePtr = printNewValue();
+  llPrintf("bitcast i8* %%%u to %s*\n", promise, type);
+  uint32 value = printNewValue();
+  llPrintf("load %s, %s* %%%u\n", type, type, valuePtr);
+  llPrintf("  store %s %%%u, %s* %s\n", type, value, type, llGetVariableName(loopVar));
+  utSym blockEndLabel = generateBlockStatements(deStatementGetSubBlock(statement), utSymNull);
+  printLabel(blockEndLabel);
+  llPrintf("  call void @llvm.coro.resume(i8* %%%u)\n", handle);
+  jumpTo(loopLabel);
+  printLabel(doneLabel);
+  llPrintf("  call void @llvm.coro.destroy(i8* %%%u)\n", handle);
+  llNumLocalsNeedingFree = numNeedsFreeLocals;
+  freeElements(false);
+  return utSymNull;
+}
+
+// Add the variable to llParallelCaptures if it is not already there.
+static void addParallelCapture(deVariable variable) {
+  for (uint32 i = 0; i < llNumParallelCaptures; i++) {
+    if (llParallelCaptures[i] == variable) {
+      return;
+    }
+  }
+  if (llNumParallelCaptures == llParallelCapturesAllocated) {
+    llParallelCapturesAllocated <<= 1;
+    utResizeArray(llParallelCaptures, llParallelCapturesAllocated);
+  }
+  llParallelCaptures[llNumParallelCaptures++] = variable;
+}
+
+// Add the locals and parameters of the current function the expression uses
+// to llParallelCaptures.
+static void findExpressionCaptures(deExpression expression) {
+  if (deExpressionGetType(expression) == DE_EXPR_IDENT) {
+    deIdent ident = deExpressionGetIdent(expression);
+    if (ident != deIdentNull && deIdentGetType(ident) == DE_IDENT_VARIABLE) {
+      deVariable variable = deIdentGetVariable(ident);
+      if (deVariableGetBlock(variable) == llCurrentScopeBlock && isLocal(variable) &&
+          !deVariableParallelPrivate(variable) && deVariableInstantiated(variable)) {
+        addParallelCapture(variable);
+      }
+    }
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    findExpressionCaptures(child);
+  } deEndExpressionExpression;
+}
+
+// Add the locals and parameters of the current function the block uses to
+// llParallelCaptures.
+static void findBlockCaptures(deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (deStatementInstantiated(statement)) {
+      deExpression expression = deStatementGetExpression(statement);
+      if (expression != deExpressionNull) {
+        findExpressionCaptures(expression);
+      }
+      deBlock subBlock = deStatementGetSubBlock(statement);
+      if (subBlock != deBlockNull) {
+        findBlockCaptures(subBlock);
+      }
+    }
+  } deEndBlockStatement;
+}
+
+// Find the variables of the current function a parallel for body uses, in a
+// deterministic order shared by the caller and the outlined body.
+static void findParallelCaptures(deStatement statement) {
+  llNumParallelCaptures = 0;
+  findBlockCaptures(deStatementGetSubBlock(statement));
+}
+
+// Determine if the variable's name is a pointer to its value, rather than its value.
+static bool variableIsRef(deVariable variable) {
+  return deVariableGetType(variable) != DE_VAR_PARAMETER || !deVariableConst(variable) ||
+      llDatatypePassedByReference(deVariableGetDatatype(variable));
+}
+
+// Evaluate an argument of the range call in a parallel for statement, as an i64.
+static llElement generateParallelRangeBound(deExpression argument, bool isSigned) {
+  generateExpression(argument);
+  return resizeInteger(popElement(true), 64, isSigned, false);
+}
+
+// Generate a parallel for statement as a call to the runtime's thread pool:
+//
+//   parallel for i in range(first, last) { body }
+//
+// becomes runtime_parallelFor(body, context, last - first), where the
+// outlined body loops over its chunks of the range, and the context holds
+// first and the addresses of the variables the body uses.  Object loops call
+// runtime_parallelForObjects, which skips freed objects using the class's
+// free list.  The outlined body is generated after the current function, by
+// generateParallelBodies.
+static utSym generateParallelForeachStatement(deStatement statement, utSym startLabel) {
+  printLabel(startLabel);
+  deExpression assignment = deStatementGetExpression(statement);
+  deExpression access = deExpressionGetFirstExpression(assignment);
+  deExpression value = deExpressionGetNextExpression(access);
+  deVariable loopVar = deIdentGetVariable(deExpressionGetIdent(access));
+  deDatatype datatype = deVariableGetDatatype(loopVar);
+  bool overObjects = deDatatypeGetType(datatype) == DE_TYPE_CLASS;
+  char *path = *llPath == '\0'? "main" : llPath;
+  utSym name = utSymCreate(llEscapeIdentifier(utSprintf("%s.parallel%u", path, ++llParallelNum)));
+  llStatementSetParallelName(statement, name);
+  findParallelCaptures(statement);
+  // Range loops pass the first index in slot 0 of the context.
+  uint32 firstSlot = overObjects? 0 : 1;
+  uint32 numSlots = llNumParallelCaptures + firstSlot;
+  char *count = NULL;
+  char *pointers[numSlots + 1];
+  char *types[numSlots + 1];
+  if (!overObjects) {
+    deExpression parameters = deExpressionGetNextExpression(deExpressionGetFirstExpression(value));
+    deExpression firstArg = deExpressionGetFirstExpression(parameters);
+    deExpression lastArg = deExpressionGetNextExpression(firstArg);
+    bool isSigned = deDatatypeGetType(datatype) == DE_TYPE_INT;
+    char *first = "0";
+    if (lastArg != deExpressionNull) {
+      first = llElementGetName(generateParallelRangeBound(firstArg, isSigned));
+    } else {
+      lastArg = firstArg;
+    }
+    char *last = llElementGetName(generateParallelRangeBound(lastArg, isSigned));
+    uint32 nonEmpty = printNewValue();
+    llPrintf("icmp %s i64 %s, %s\n", isSigned? "sgt" : "ugt", last, first);
+    uint32 difference = printNewValue();
+    llPrintf("sub i64 %s, %s\n", last, first);
+    uint32 numIterations = printNewValue();
+    llPrintf("select i1 %%%u, i64 %%%u, i64 0\n", nonEmpty, difference);
+    count = utSprintf("%%%u", numIterations);
+    uint32 firstPtr = printNewTmpValue();
+    llTmpPrintf("alloca i64\n");
+    llPrintf("  store i64 %s, i64* %%.tmp%u\n", first, firstPtr);
+    pointers[0] = utSprintf("%%.tmp%u", firstPtr);
+    types[0] = "i64";
+  }
+  for (uint32 i = 0; i < llNumParallelCaptures; i++) {
+    deVariable variable = llParallelCaptures[i];
+    char *type = llGetTypeString(deVariableGetDatatype(variable), true);
+    char *pointer = llGetVariableName(variable);
+    if (!variableIsRef(variable)) {
+      // Parameters passed by value get a copy the body can point to.
+      uint32 copy = printNewTmpValue();
+      llTmpPrintf("alloca %s\n", type);
+      llPrintf("  store %s %s, %s* %%.tmp%u\n", type, pointer, type, copy);
+      pointer = utSprintf("%%.tmp%u", copy);
+    }
+    pointers[firstSlot + i] = pointer;
+    types[firstSlot + i] = type;
+  }
+  char *context = "null";
+  if (numSlots != 0) {
+    uint32 contextArray = printNewTmpValue();
+    llTmpPrintf("alloca [%u x i8*]\n", numSlots);
+    for (uint32 i = 0; i < numSlots; i++) {
+      uint32 slot = printNewValue();
+      llPrintf("getelementptr inbounds [%1$u x i8*], [%1$u x i8*]* %%.tmp%2$u, i64 0, i64 %3$u\n",
+          numSlots, contextArray, i);
+      uint32 pointer = printNewValue();
+      llPrintf("bitcast %s* %s to i8*\n", types[i], pointers[i]);
+      llPrintf("  store i8* %%%u, i8** %%%u\n", pointer, slot);
+    }
+    uint32 contextPtr = printNewValue();
+    llPrintf("bitcast [%u x i8*]* %%.tmp%u to i8*\n", numSlots, contextArray);
+    context = utSprintf("%%%u", contextPtr);
+  }
+  if (overObjects) {
+    deClass theClass = deDatatypeGetClass(datatype);
+    deBlock classBlock = deClassGetSubBlock(theClass);
+    char *classPath = deGetBlockPath(classBlock, true);
+    deBlock rootBlock = deRootGetBlock(deTheRoot);
+    deIdent usedIdent = deBlockFindIdent(rootBlock, utSymCreateFormatted("%s_used", classPath));
+    deIdent firstFreeIdent = deBlockFindIdent(rootBlock, utSymCreateFormatted("%s_firstFree", classPath));
+    if (usedIdent == deIdentNull || firstFreeIdent == deIdentNull) {
+      // The class has no memory manager, so it never has objects.
+      return utSymNull;
+    }
+    uint32 refWidth = deClassGetRefWidth(theClass);
+    // Array elements are a power of two bytes, like LLVM's i<refWidth>.
+    uint32 refBytes = 1;
+    while (refBytes << 3 < refWidth) {
+      refBytes <<= 1;
+    }
+    deVariable nextFree = deVariableGetGlobalArrayVariable(deBlockGetFirstVariable(classBlock));
+    uint32 used = printNewValue();
+    llPrintf("load i%1$u, i%1$u* %2$s\n", refWidth, llGetVariableName(deIdentGetVariable(usedIdent)));
+    uint32 used64 = printNewValue();
+    llPrintf("zext i%u %%%u to i64\n", refWidth, used);
+    uint32 firstFree = printNewValue();
+    llPrintf("load i%1$u, i%1$u* %2$s\n", refWidth,
+        llGetVariableName(deIdentGetVariable(firstFreeIdent)));
+    uint32 firstFree64 = printNewValue();
+    llPrintf("zext i%u %%%u to i64\n", refWidth, firstFree);
+    llDeclareRuntimeFunction("runtime_parallelForObjects");
+    llPrintf("  call void @runtime_parallelForObjects(void (i8*, i64, i64)* @%s, i8* %s, "
+        "%%struct.runtime_array* %s, i64 %u, i64 %%%u, i64 %%%u)%s\n", utSymGetName(name),
+        context, llGetVariableName(nextFree), refBytes, used64, firstFree64,
+        locationInfo());
+  } else {
+    llDeclareRuntimeFunction("runtime_parallelFor");
+    llPrintf("  call void @runtime_parallelFor(void (i8*, i64, i64)* @%s, i8* %s, i64 %s)%s\n",
+        utSymGetName(name), context, count, locationInfo());
+  }
+  freeElements(false);
+  return utSymNull;
+}
+
+// Generate the outlined body of a parallel for statement in the current
+// function, which runs iterations [first, last):
+//
+//   define internal void @<function>.parallel<n>(i8* %.context, i64 %.first, i64 %.last)
+//
+// It rebuilds the variables it uses from the context, and has its own copy of
+// the variables private to parallel for bodies.
+static void generateParallelBody(deStatement statement) {
+  deExpression access = deExpressionGetFirstExpression(deStatementGetExpression(statement));
+  deVariable loopVar = deIdentGetVariable(deExpressionGetIdent(access));
+  deDatatype datatype = deVariableGetDatatype(loopVar);
+  bool overObjects = deDatatypeGetType(datatype) == DE_TYPE_CLASS;
+  bool savedDebugMode = llDebugMode;
+  llDebugMode = false;
+  llInCoroutine = false;
+  llTmpValueBuffer[0] = '\0';
+  llStackPos = 0;
+  llVarNum = 0;
+  llTmpVarNum = 0;
+  llRefCountNum = 0;
+  utAssert(!llPendingRef.valid);
+  llSetjmpDepth = 0;
+  llFunctionHasTry = false;
+  llLabelNum = 1;
+  llLimitCheckFailedLabel = utSymNull;
+  llBoundsCheckFailedLabel = utSymNull;
+  llPrevLabel = utSymCreate("0");
+  llPrintf("\ndefine internal void @%s(i8* %%.context, i64 %%.first, i64 %%.last) {\n",
+      utSymGetName(llStatementGetParallelName(statement)));
+  findParallelCaptures(statement);
+  uint32 firstSlot = overObjects? 0 : 1;
+  uint32 numSlots = llNumParallelCaptures + firstSlot;
+  uint32 slots = 0;
+  if (numSlots != 0) {
+    slots = printNewValue();
+    llPrintf("bitcast i8* %%.context to i8**\n");
+  }
+  char *rangeFirst = NULL;
+  for (uint32 i = 0; i < numSlots; i++) {
+    uint32 slot = printNewValue();
+    llPrintf("getelementptr inbounds i8*, i8** %%%u, i64 %u\n", slots, i);
+    uint32 pointer = printNewValue();
+    llPrintf("load i8*, i8** %%%u\n", slot);
+    if (i < firstSlot) {
+      uint32 firstPtr = printNewValue();
+      llPrintf("bitcast i8* %%%u to i64*\n", pointer);
+      uint32 first = printNewValue();
+      llPrintf("load i64, i64* %%%u\n", firstPtr);
+      rangeFirst = utSprintf("%%%u", first);
+      continue;
+    }
+    deVariable variable = llParallelCaptures[i - firstSlot];
+    char *type = llGetTypeString(deVariableGetDatatype(variable), true);
+    char *name = llGetVariableName(variable);
+    if (variableIsRef(variable)) {
+      llPrintf("  %s = bitcast i8* %%%u to %s*\n", name, pointer, type);
+    } else {
+      uint32 valuePtr = printNewValue();
+      llPrintf("bitcast i8* %%%u to %s*\n", pointer, type);
+      llPrintf("  %s = load %s, %s* %%%u\n", name, type, type, valuePtr);
+    }
+  }
+  llNeedsFreePos = 0;
+  deVariable variable;
+  deForeachBlockVariable(llCurrentScopeBlock, variable) {
+    if (deVariableInstantiated(variable) && deVariableParallelPrivate(variable)) {
+      initializeLocalVariable(variable);
+    }
+  } deEndBlockVariable;
+  llPuts(LL_TMPVARS_STRING);
+  llNumLocalsNeedingFree = llNeedsFreePos;
+  llPrintf("  %%.parallelIndex = alloca i64\n"
+      "  store i64 %%.first, i64* %%.parallelIndex\n");
+  utSym loopLabel = newLabel("parallelLoop");
+  utSym bodyLabel = newLabel("parallelBody");
+  utSym doneLabel = newLabel("parallelDone");
+  jumpTo(loopLabel);
+  printLabel(loopLabel);
+  uint32 index = printNewValue();
+  llPrintf("load i64, i64* %%.parallelIndex\n");
+  uint32 more = printNewValue();
+  llPrintf("icmp ult i64 %%%u, %%.last\n", index);
+  llPrintf("  br i1 %%%u, label %%%s, label %%%s\n", more,
+      utSymGetName(bodyLabel), utSymGetName(doneLabel));
+  printLabel(bodyLabel);
+  char *type = llGetTypeString(datatype, true);
+  uint32 width = overObjects? deClassGetRefWidth(deDatatypeGetClass(datatype)) :
+      deDatatypeGetWidth(datatype);
+  char *loopValue = utSprintf("%%%u", index);
+  if (!overObjects) {
+    uint32 sum = printNewValue();
+    llPrintf("add i64 %s, %%%u\n", rangeFirst, index);
+    loopValue = utSprintf("%%%u", sum);
+  }
+  if (width < 64) {
+    uint32 truncated = printNewValue();
+    llPrintf("trunc i64 %s to %s\n", loopValue, type);
+    loopValue = utSprintf("%%%u", truncated);
+  }
+  llPrintf("  store %s %s, %s* %s\n", type, loopValue, type, llGetVariableName(loopVar));
+  utSym blockEndLabel = generateBlockStatements(deStatementGetSubBlock(statement), utSymNull);
+  printLabel(blockEndLabel);
+  uint32 next = printNewValue();
+  llPrintf("load i64, i64* %%.parallelIndex\n");
+  uint32 incremented = printNewValue();
+  llPrintf("add i64 %%%u, 1\n", next);
+  llPrintf("  store i64 %%%u, i64* %%.parallelIndex\n", incremented);
+  jumpTo(loopLabel);
+  printLabel(doneLabel);
+  freeElements(true);
+  llPrintf("  ret void\n}\n\n");
+  llDebugMode = savedDebugMode;
+}
+
+// Generate the outlined bodies of the parallel for statements in the block,
+// after the function containing them.
+static void generateParallelBodies(deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (llStatementGetParallelName(statement) != utSymNull) {
+      flushStringBuffer();
+      generateParallelBody(statement);
+      llStatementSetParallelName(statement, utSymNull);
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      generateParallelBodies(subBlock);
+    }
+  } deEndBlockStatement;
+}
+
+// With -heapprofile, store the statement's file and line where the runtime's
+// sampled allocation profiler finds them.
+static void recordAllocationSite(void) {
+  if (!deHeapProfile) {
+    return;
+  }
+  deFilepath filepath = deLineGetFilepath(llCurrentLine);
+  deString filePathString = deCStringCreate(utSymGetName(deFilepathGetSym(filepath)));
+  llElement filePathElem = generateString(filePathString);
+  llPrintf("  store %%struct.runtime_array* %s, %%struct.runtime_array** @runtime_allocFile\n"
+      "  store i32 %u, i32* @runtime_allocLine\n",
+      llElementGetName(filePathElem), deLineGetLineNum(llCurrentLine));
+}
+
 // Dump the statement about to be generated to a comment.
 static void dumpStatementInComment(deStatement statement) {
   deString string = deMutableStringCreate();
@@ -4485,11 +6611,13 @@ static utSym generateStatement(deStatement statement, utSym label) {
     case DE_STATEMENT_ASSIGN:
       printLabel(label);
       label = utSymNull;
+      recordAllocationSite();
       generateExpression(deStatementGetExpression(statement));
       break;
     case DE_STATEMENT_CALL:
       printLabel(label);
       label = utSymNull;
+      recordAllocationSite();
       generateExpression(deStatementGetExpression(statement));
       if (deExpressionGetDatatype(expression) != deNoneDatatypeCreate()) {
         popElement(false);
@@ -4498,6 +6626,7 @@ static utSym generateStatement(deStatement statement, utSym label) {
     case DE_STATEMENT_PRINT:
       printLabel(label);
       label = utSymNull;
+      recordAllocationSite();
       generatePrintStatement(statement);
       break;
     case DE_STATEMENT_TRY:
@@ -4514,6 +6643,7 @@ static utSym generateStatement(deStatement statement, utSym label) {
     case DE_STATEMENT_RETURN:
       printLabel(label);
       label = utSymNull;
+      recordAllocationSite();
       generateReturnStatement(statement);
       break;
     case DE_STATEMENT_CASE:
@@ -4537,9 +6667,19 @@ static utSym generateStatement(deStatement statement, utSym label) {
       // Nothing to do.
       break;
     case DE_STATEMENT_YIELD:
-      utExit("Not expecting to see a yield() statement during code generation");
+      printLabel(label);
+      label = generateYieldStatement(statement);
+      break;
     case DE_STATEMENT_FOREACH:
-      utExit("Not expecting to see a foreach statement during code generation");
+      if (deStatementParallel(statement)) {
+        label = generateParallelForeachStatement(statement, label);
+        break;
+      }
+      if (!deStatementCallsCoroutine(statement)) {
+        utExit("Not expecting to see a foreach statement during code generation");
+      }
+      label = generateCoroutineForeachStatement(statement, label);
+      break;
   }
   return label;
 }
@@ -4569,6 +6709,187 @@ static void resetBlock(deBlock block, deSignature signature) {
 }
 
 // Generate LLVM assembly code for a fully bound block.
+// Write the text from |start| up to |end|.
+static void putRange(char *start, char *end) {
+  char saved = *end;
+  *end = '\0';
+  llPuts(start);
+  *end = saved;
+}
+
+// Record that the block labeled |label| was split at invokes, and now reaches
+// its successors from the block labeled |lastLabel|.
+static void setSplitBlock(utSym label, utSym lastLabel) {
+  for (uint32 i = 0; i < llNumSplitBlocks; i++) {
+    if (llSplitBlocks[i].label == label) {
+      llSplitBlocks[i].lastLabel = lastLabel;
+      return;
+    }
+  }
+  if (llNumSplitBlocks == llSplitBlocksAllocated) {
+    llSplitBlocksAllocated = llSplitBlocksAllocated == 0? 16 : llSplitBlocksAllocated << 1;
+    if (llSplitBlocks == NULL) {
+      llSplitBlocks = utNewA(llSplitBlock, llSplitBlocksAllocated);
+    } else {
+      utResizeArray(llSplitBlocks, llSplitBlocksAllocated);
+    }
+  }
+  llSplitBlocks[llNumSplitBlocks].label = label;
+  llSplitBlocks[llNumSplitBlocks].lastLabel = lastLabel;
+  llNumSplitBlocks++;
+}
+
+// Return the label of the last part of a split block, or utSymNull.
+static utSym findSplitBlock(utSym label) {
+  for (uint32 i = 0; i < llNumSplitBlocks; i++) {
+    if (llSplitBlocks[i].label == label) {
+      return llSplitBlocks[i].lastLabel;
+    }
+  }
+  return utSymNull;
+}
+
+// Return a pointer to "call" if the instruction on this line calls a function
+// other than an LLVM intrinsic.  Resuming or destroying a coroutine runs its
+// code, which may raise, so those intrinsics count as calls.  Otherwise return
+// NULL.
+static char *findCall(char *line) {
+  char *p = line;
+  while (*p == ' ') {
+    p++;
+  }
+  if (*p == '%') {
+    p = strstr(p, " = ");
+    if (p == NULL) {
+      return NULL;
+    }
+    p += 3;
+  }
+  if (strncmp(p, "call ", 5)) {
+    return NULL;
+  }
+  if (strstr(p, "@llvm.") != NULL && strstr(p, "@llvm.coro.resume(") == NULL &&
+      strstr(p, "@llvm.coro.destroy(") == NULL) {
+    return NULL;
+  }
+  return p;
+}
+
+// Write a phi instruction, renaming predecessors that were split at invokes.
+static void renameSplitPredecessors(char *line) {
+  char *p = line;
+  char *ref;
+  while ((ref = strstr(p, ", %")) != NULL) {
+    char *name = ref + 3;
+    char *nameEnd = name + strcspn(name, " ],");
+    putRange(p, name);
+    char saved = *nameEnd;
+    *nameEnd = '\0';
+    utSym lastLabel = findSplitBlock(utSymCreate(name));
+    llPuts(lastLabel != utSymNull? utSymGetName(lastLabel) : name);
+    *nameEnd = saved;
+    p = nameEnd;
+  }
+  llPuts(p);
+}
+
+// With -unwind, rewrite each call between try markers in the current function
+// as an invoke that unwinds to the innermost try's landing pad, and give the
+// function a personality.  Calls are printed all over this file, so this is
+// done on the text once the function is complete.  Each invoke ends its block,
+// so phi instructions naming a split block are then renamed to its last part.
+static void lowerCallsToInvokes(void) {
+  char *text = utAllocString(deStringVal);
+  deResetString();
+  uint32 maxDepth = 0;
+  for (char *p = strstr(text, LL_TRY_BEGIN_STRING); p != NULL;
+      p = strstr(p + 1, LL_TRY_BEGIN_STRING)) {
+    maxDepth++;
+  }
+  utSym *landingPads = utNewA(utSym, maxDepth);
+  uint32 depth = 0;
+  utSym blockLabel = utSymNull;
+  llNumSplitBlocks = 0;
+  char *line = text;
+  while (*line != '\0') {
+    char *end = line + strcspn(line, "\n");
+    char saved = *end;
+    *end = '\0';
+    char *body = line;
+    if (!strncmp(body, LL_TMPVARS_STRING, sizeof(LL_TMPVARS_STRING) - 1)) {
+      llPuts(LL_TMPVARS_STRING);
+      body += sizeof(LL_TMPVARS_STRING) - 1;
+    }
+    char *call = depth == 0? NULL : findCall(body);
+    // Marker lines are dropped.
+    bool isMarker = false;
+    if (!strncmp(body, LL_TRY_BEGIN_STRING, sizeof(LL_TRY_BEGIN_STRING) - 1)) {
+      landingPads[depth++] = utSymCreate(body + sizeof(LL_TRY_BEGIN_STRING) - 1);
+      isMarker = true;
+    } else if (!strcmp(body, LL_TRY_END_STRING)) {
+      depth--;
+      isMarker = true;
+    } else if (call != NULL) {
+      utSym contLabel = newLabel("invokeCont");
+      char *metadata = strstr(call, ", !");
+      if (metadata == NULL) {
+        metadata = end;
+      }
+      putRange(body, call);
+      llPuts("invoke ");
+      putRange(call + 5, metadata);
+      llPrintf(" to label %%%s unwind label %%%s%s\n%s:", utSymGetName(contLabel),
+          utSymGetName(landingPads[depth - 1]), metadata, utSymGetName(contLabel));
+      setSplitBlock(blockLabel, contLabel);
+    } else if (!strncmp(body, "define ", 7)) {
+      char *pos = strstr(body, " !dbg");
+      if (pos == NULL) {
+        pos = strrchr(body, ' ');
+      }
+      putRange(body, pos);
+      llPrintf(" personality i32 (...)* @__gcc_personality_v0%s", pos);
+    } else {
+      if (*body != ' ' && end > body && end[-1] == ':') {
+        end[-1] = '\0';
+        blockLabel = utSymCreate(body);
+        end[-1] = ':';
+      }
+      llPuts(body);
+    }
+    if (saved == '\n') {
+      if (!isMarker) {
+        llPuts("\n");
+      }
+      end++;
+    }
+    line = end;
+  }
+  utFree(landingPads);
+  utFree(text);
+  if (llNumSplitBlocks == 0) {
+    return;
+  }
+  text = utAllocString(deStringVal);
+  deResetString();
+  line = text;
+  while (*line != '\0') {
+    char *end = line + strcspn(line, "\n");
+    char saved = *end;
+    *end = '\0';
+    if (strstr(line, " = phi ") != NULL) {
+      renameSplitPredecessors(line);
+    } else {
+      llPuts(line);
+    }
+    if (saved == '\n') {
+      llPuts("\n");
+      end++;
+    }
+    line = end;
+  }
+  utFree(text);
+}
+
 static void generateBlockAssemblyCode(deBlock block, deSignature signature) {
   resetBlock(block, signature);
   // If this is an auto-generated function, like a destructor, turn off debug.
@@ -4594,8 +6915,22 @@ static void generateBlockAssemblyCode(deBlock block, deSignature signature) {
   llLabelNum = 1;
   llLimitCheckFailedLabel = utSymNull;
   llBoundsCheckFailedLabel = utSymNull;
-  generateBlockStatements(block, utSymNull);
+  bool isCoroutine = signature != deSignatureNull && deSignatureIsCoroutine(signature);
+  if (isCoroutine) {
+    printCoroutineBegin(signature);
+  }
+  if (signature != deSignatureNull) {
+    countEvent(LL_COUNT_CALL, deBlockGetLine(block));
+  }
+  utSym label = generateBlockStatements(block, utSymNull);
+  if (isCoroutine) {
+    printCoroutineEnd(block, label);
+  }
   llPrintf("}\n\n");
+  if (llFunctionHasTry) {
+    lowerCallsToInvokes();
+  }
+  generateParallelBodies(block);
   utFree(llPath);
   llCurrentScopeBlock = deBlockNull;
   llDebugMode = savedDebugMode;
@@ -4627,11 +6962,387 @@ static void printHeader(void) {
   fputs("declare i32 @_setjmp(%struct.__jmp_buf_tag* noundef)\n", llAsmFile);
   fputs("declare void @longjmp(%struct.__jmp_buf_tag* noundef, i32 noundef)\n", llAsmFile);
   fputs("%struct.jmpbuf_wrapped = type {%struct.__jmp_buf_tag, %struct.jmpbuf_wrapped*}\n", llAsmFile);
-  fputs("@runtime_firstSetjmpBuffer = dso_local global %struct.jmpbuf_wrapped* zeroinitializer\n", llAsmFile);
+  // Exception state is per-thread, for parallel for statements.
+  fputs("@runtime_firstSetjmpBuffer = dso_local thread_local global %struct.jmpbuf_wrapped* zeroinitializer\n",
+      llAsmFile);
+  // These are defined in the runtime, and set at the top of main.
+  fputs("@runtime_unwindExceptions = external global i8\n"
+      "@runtime_nativeWideInts = external global i8\n", llAsmFile);
+  if (deUnwindExceptions) {
+    fputs("declare i32 @__gcc_personality_v0(...)\n", llAsmFile);
+  }
+  if (deHeapProfile) {
+    // The allocation profiler's current line is per-thread, like exceptions.
+    fputs("@runtime_allocFile = external thread_local global %struct.runtime_array*\n"
+        "@runtime_allocLine = external thread_local global i32\n", llAsmFile);
+  }
 }
 
-// Generate LLVM assembly code.
-void llGenerateLLVMAssemblyCode(char* fileName, bool debugMode) {
+// Return the data member's name in the profile, which is the name of its
+// global array in SoA layout.
+static char *getFieldProfileName(deVariable variable) {
+  return utSprintf("%s_%s", deGetBlockPath(deVariableGetBlock(variable), true),
+      deVariableGetName(variable));
+}
+
+// Return the global <Class>_<suffix> that memory management created for the
+// class, if any.
+static deVariable findClassGlobal(deClass theClass, char *suffix) {
+  utSym name = utSymCreateFormatted("%s_%s",
+      deGetBlockPath(deClassGetSubBlock(theClass), true), suffix);
+  deIdent ident = deBlockFindIdent(deRootGetBlock(deTheRoot), name);
+  if (ident == deIdentNull || deIdentGetType(ident) != DE_IDENT_VARIABLE) {
+    return deVariableNull;
+  }
+  return deIdentGetVariable(ident);
+}
+
+// Return the class's global holding how many of its object slots are in use,
+// if memory management created one.
+static deVariable findObjectCountVariable(deClass theClass) {
+  return findClassGlobal(theClass, "used");
+}
+
+// Define the function runtime_startFieldProfile calls at exit to copy each
+// class's <Class>_used global into its slot in the profile, after the slots
+// of the class's data members.
+static void defineRecordObjectCounts(void) {
+  llPrintf("define internal void @.recordObjectCounts() {\n");
+  uint32 index = 0;
+  deClass theClass;
+  deVariable variable;
+  deForeachRootClass(deTheRoot, theClass) {
+    if (deClassBound(theClass)) {
+      deForeachBlockVariable(deClassGetSubBlock(theClass), variable) {
+        if (llVariableGetProfileIndex(variable) != 0) {
+          index++;
+        }
+      } deEndBlockVariable;
+      deVariable usedVar = findObjectCountVariable(theClass);
+      if (usedVar != deVariableNull) {
+        uint32 width = deDatatypeGetWidth(deVariableGetDatatype(usedVar));
+        llPrintf("  %%used%1$u = load i%2$u, i%2$u* %3$s\n", index, width,
+            llGetVariableName(usedVar));
+        char *count = utSprintf("%%used%u", index);
+        if (width < 64) {
+          llPrintf("  %%count%1$u = zext i%2$u %%used%1$u to i64\n", index, width);
+          count = utSprintf("%%count%u", index);
+        }
+        llPrintf("  store i64 %1$s, i64* getelementptr inbounds ([%2$u x i64], "
+            "[%2$u x i64]* @.fieldAccessCounts, i64 0, i64 %3$u)\n",
+            count, llNumProfiledFields, index);
+        index++;
+      }
+    }
+  } deEndRootClass;
+  llPrintf("  ret void\n}\n");
+}
+
+// Number the data members of all classes except nextFree, and declare their
+// access counters and newline separated names for runtime_startFieldProfile.
+// Each class's data members are followed by its <Class>_used count, which
+// -useprofile uses to choose reference widths.
+static void declareFieldProfile(void) {
+  llNumProfiledFields = 0;
+  llFieldNamesLen = 1;
+  deClass theClass;
+  deVariable variable;
+  deForeachRootClass(deTheRoot, theClass) {
+    deBlock block = deClassGetSubBlock(theClass);
+    if (deClassBound(theClass)) {
+      deForeachBlockVariable(block, variable) {
+        if (variable != deBlockGetFirstVariable(block)) {
+          llVariableSetProfileIndex(variable, ++llNumProfiledFields);
+          llFieldNamesLen += strlen(getFieldProfileName(variable)) + 1;
+        }
+      } deEndBlockVariable;
+      deVariable usedVar = findObjectCountVariable(theClass);
+      if (usedVar != deVariableNull) {
+        llNumProfiledFields++;
+        llFieldNamesLen += strlen(deVariableGetName(usedVar)) + 1;
+      }
+    }
+  } deEndRootClass;
+  if (llNumProfiledFields == 0) {
+    return;
+  }
+  char *names = utNewA(char, llFieldNamesLen);
+  char *p = names;
+  deForeachRootClass(deTheRoot, theClass) {
+    deBlock block = deClassGetSubBlock(theClass);
+    if (deClassBound(theClass)) {
+      deForeachBlockVariable(block, variable) {
+        if (llVariableGetProfileIndex(variable) != 0) {
+          char *name = getFieldProfileName(variable);
+          uint32 len = strlen(name);
+          memcpy(p, name, len);
+          p[len] = '\n';
+          p += len + 1;
+        }
+      } deEndBlockVariable;
+      deVariable usedVar = findObjectCountVariable(theClass);
+      if (usedVar != deVariableNull) {
+        char *name = deVariableGetName(usedVar);
+        uint32 len = strlen(name);
+        memcpy(p, name, len);
+        p[len] = '\n';
+        p += len + 1;
+      }
+    }
+  } deEndRootClass;
+  *p = '\0';
+  llPrintf("@.fieldAccessCounts = internal global [%u x i64] zeroinitializer\n",
+      llNumProfiledFields);
+  llPrintf("@.fieldNames = private unnamed_addr constant [%u x i8] c\"%s\\00\"\n",
+      llFieldNamesLen, llEscapeText(names));
+  utFree(names);
+  defineRecordObjectCounts();
+}
+
+// Snapshot entry kinds.  These match the RN_SNAPSHOT_* kinds in the runtime.
+#define LL_SNAPSHOT_SCALAR 0
+#define LL_SNAPSHOT_ARRAY 1
+#define LL_SNAPSHOT_SUBARRAYS 2
+#define LL_SNAPSHOT_UNSUPPORTED 3
+
+// Return true if the program calls the builtin saveSnapshot or loadSnapshot.
+static bool programUsesSnapshots(void) {
+  deSignature signature;
+  deForeachRootSignature(deTheRoot, signature) {
+    deFunction function = deSignatureGetFunction(signature);
+    if (function != deFunctionNull && deSignatureInstantiated(signature) &&
+        deFunctionGetLinkage(function) == DE_LINK_EXTERN_C) {
+      char *name = deFunctionGetName(function);
+      if (!strcmp(name, "saveSnapshot") || !strcmp(name, "loadSnapshot")) {
+        return true;
+      }
+    }
+  } deEndRootSignature;
+  return false;
+}
+
+// True while counting and hashing the snapshot table's entries, before they
+// are printed.
+static bool llCountingSnapshotEntries;
+
+// Count one entry of the snapshot table and hash its name and type into
+// llSnapshotLayoutHash, or print it once counted.
+static void visitSnapshotEntry(deVariable variable, char *elementType, uint32 kind) {
+  char *name = llGetVariableName(variable);
+  char *typeString = llGetTypeString(deVariableGetDatatype(variable), true);
+  if (llCountingSnapshotEntries) {
+    char *text = utSprintf("%s:%s:%u\n", name, typeString, kind);
+    for (char *p = text; *p != '\0'; p++) {
+      llSnapshotLayoutHash = (llSnapshotLayoutHash ^ (uint8)*p) * 0x100000001b3ULL;
+    }
+    llNumSnapshotEntries++;
+    return;
+  }
+  llPrintf("%s  %%struct.runtime_snapshotEntry {i8* bitcast (%s* %s to i8*), "
+      "i64 ptrtoint (%s* getelementptr (%s, %s* null, i32 1) to i64), i32 %u}",
+      llNumSnapshotEntries == 0? "" : ",\n", typeString, name, elementType, elementType,
+      elementType, kind);
+  llNumSnapshotEntries++;
+}
+
+// Visit the snapshot table entry for the global array of class data members.
+static void visitSnapshotArrayEntry(deVariable arrayVar) {
+  deDatatype elementType = getElementType(deVariableGetDatatype(arrayVar));
+  uint32 kind = LL_SNAPSHOT_ARRAY;
+  if (deDatatypeContainsArray(elementType)) {
+    deDatatypeType type = deDatatypeGetType(elementType);
+    kind = LL_SNAPSHOT_UNSUPPORTED;
+    if (type == DE_TYPE_ARRAY || type == DE_TYPE_STRING || llDatatypeIsBigint(elementType)) {
+      elementType = getElementType(elementType);
+      if (!deDatatypeContainsArray(elementType)) {
+        kind = LL_SNAPSHOT_SUBARRAYS;
+      }
+    }
+  }
+  visitSnapshotEntry(arrayVar, llGetTypeString(elementType, true), kind);
+}
+
+// Visit the class globals that saveSnapshot writes and loadSnapshot restores:
+// every global array of class data members, including nextFree, which holds
+// reference counts and the free list, and the _allocated, _used and
+// _firstFree counters.
+static void visitSnapshotGlobals(void) {
+  llNumSnapshotEntries = 0;
+  deClass theClass;
+  deForeachRootClass(deTheRoot, theClass) {
+    if (!deClassBound(theClass)) {
+      continue;
+    }
+    deVariable variable;
+    deForeachBlockVariable(deClassGetSubBlock(theClass), variable) {
+      deVariable arrayVar = deVariableGetGlobalArrayVariable(variable);
+      // Packed data members share their class's one tuple array.
+      if (arrayVar != deVariableNull && deVariableInstantiated(arrayVar) &&
+          (!deVariablePacked(variable) || deVariableGetPackedIndex(variable) == 0)) {
+        visitSnapshotArrayEntry(arrayVar);
+      }
+    } deEndBlockVariable;
+    char *suffixes[] = {"allocated", "used", "firstFree"};
+    for (uint32 i = 0; i < sizeof(suffixes) / sizeof(char*); i++) {
+      deVariable scalar = findClassGlobal(theClass, suffixes[i]);
+      if (scalar != deVariableNull && deVariableInstantiated(scalar)) {
+        visitSnapshotEntry(scalar, llGetTypeString(deVariableGetDatatype(scalar), true),
+            LL_SNAPSHOT_SCALAR);
+      }
+    }
+  } deEndRootClass;
+}
+
+// Define the table of class globals for runtime_registerSnapshot.  Objects
+// keep their indices, so references between them survive a snapshot.  Arrays
+// of arrays, such as string data members, are marked so the runtime copies
+// them rather than mapping them.
+static void declareSnapshotTable(void) {
+  llSnapshotLayoutHash = 0xcbf29ce484222325ULL;
+  llCountingSnapshotEntries = true;
+  visitSnapshotGlobals();
+  llCountingSnapshotEntries = false;
+  uint32 numEntries = llNumSnapshotEntries;
+  if (numEntries == 0) {
+    return;
+  }
+  llPrintf("%%struct.runtime_snapshotEntry = type {i8*, i64, i32}\n"
+      "@.snapshotEntries = private constant [%u x %%struct.runtime_snapshotEntry] [\n",
+      numEntries);
+  visitSnapshotGlobals();
+  llPrintf("\n]\n");
+  flushStringBuffer();
+}
+
+// Return the class's global array of nextFree links, if the class allocates
+// objects, so it has memory stats.
+static deVariable findClassStatsNextFree(deClass theClass) {
+  if (!deClassBound(theClass)) {
+    return deVariableNull;
+  }
+  char *suffixes[] = {"allocated", "used", "firstFree"};
+  for (uint32 i = 0; i < sizeof(suffixes) / sizeof(char*); i++) {
+    deVariable scalar = findClassGlobal(theClass, suffixes[i]);
+    if (scalar == deVariableNull || !deVariableInstantiated(scalar)) {
+      return deVariableNull;
+    }
+  }
+  deVariable self = deBlockGetFirstVariable(deClassGetSubBlock(theClass));
+  if (self == deVariableNull) {
+    return deVariableNull;
+  }
+  deVariable nextFree = deVariableGetGlobalArrayVariable(self);
+  if (nextFree == deVariableNull || !deVariableInstantiated(nextFree)) {
+    return deVariableNull;
+  }
+  return nextFree;
+}
+
+// Return the class global as an i8*, for the class stats table.
+static char *classStatsCounter(deClass theClass, char *suffix) {
+  deVariable scalar = findClassGlobal(theClass, suffix);
+  return utSprintf("i8* bitcast (%s* %s to i8*)",
+      llGetTypeString(deVariableGetDatatype(scalar), true), llGetVariableName(scalar));
+}
+
+// Define the tables runtime_registerClassStats reads to report each class's
+// live objects, allocated slots and field array bytes: one entry per class
+// with its counters, the class's global data member arrays, and a newline
+// separated list of each class's name followed by the names of its arrays.
+static void declareClassStatsTable(void) {
+  llNumClassStats = 0;
+  llNumClassStatsArrays = 0;
+  deString classes = deMutableStringCreate();
+  deString arrays = deMutableStringCreate();
+  deString names = deMutableStringCreate();
+  deClass theClass;
+  deForeachRootClass(deTheRoot, theClass) {
+    deVariable nextFree = findClassStatsNextFree(theClass);
+    if (nextFree == deVariableNull) {
+      continue;
+    }
+    deStringSprintf(names, "%s\n", deGetBlockPath(deClassGetSubBlock(theClass), false));
+    uint32 numClassArrays = 0;
+    deVariable variable;
+    deForeachBlockVariable(deClassGetSubBlock(theClass), variable) {
+      deVariable arrayVar = deVariableGetGlobalArrayVariable(variable);
+      // Packed data members share their class's one tuple array.
+      if (arrayVar != deVariableNull && deVariableInstantiated(arrayVar) &&
+          (!deVariablePacked(variable) || deVariableGetPackedIndex(variable) == 0)) {
+        deStringSprintf(arrays, "%s  %%struct.runtime_array* %s",
+            llNumClassStatsArrays == 0? "" : ",\n",
+            llGetVariableName(arrayVar));
+        deStringSprintf(names, "%s\n", deVariableGetName(arrayVar));
+        llNumClassStatsArrays++;
+        numClassArrays++;
+      }
+    } deEndBlockVariable;
+    deStringSprintf(classes, "%s  %%struct.runtime_classStatsEntry {%%struct.runtime_array* %s, "
+        "%s, %s, %s, i32 %u, i32 %u}", llNumClassStats == 0? "" : ",\n",
+        llGetVariableName(nextFree), classStatsCounter(theClass, "allocated"),
+        classStatsCounter(theClass, "used"), classStatsCounter(theClass, "firstFree"),
+        deClassGetRefWidth(theClass), numClassArrays);
+    llNumClassStats++;
+  } deEndRootClass;
+  if (llNumClassStats != 0) {
+    llClassStatsNamesLen = deStringGetUsed(names) + 1;
+    llPrintf("%%struct.runtime_classStatsEntry = type {%%struct.runtime_array*, i8*, i8*, i8*, "
+        "i32, i32}\n"
+        "@.classStats = private constant [%u x %%struct.runtime_classStatsEntry] [\n",
+        llNumClassStats);
+    llPuts(deStringGetCstr(classes));
+    llPrintf("\n]\n@.classStatsArrays = private constant [%u x %%struct.runtime_array*] [\n",
+        llNumClassStatsArrays);
+    llPuts(deStringGetCstr(arrays));
+    llPrintf("\n]\n@.classStatsNames = private unnamed_addr constant [%u x i8] c\"%s\\00\"\n",
+        llClassStatsNamesLen, llEscapeText(deStringGetCstr(names)));
+  }
+  deStringDestroy(classes);
+  deStringDestroy(arrays);
+  deStringDestroy(names);
+  flushStringBuffer();
+}
+
+// Define the -instrument counters, and @.startInstrumentation, which main calls
+// to pass them and their names to runtime_startInstrumentation.
+static void defineInstrumentCounters(void) {
+  uint32 numCounters = llNumInstrumentCounters;
+  for (uint32 i = 0; i < numCounters; i++) {
+    llPrintf("@.instrumentCount%u = internal global i64 0\n", i);
+  }
+  uint32 namesLen = deStringGetUsed(llInstrumentNames) + 1;
+  llPrintf("@.instrumentNames = private unnamed_addr constant [%u x i8] c\"%s\\00\"\n",
+      namesLen, llEscapeText(deStringGetCstr(llInstrumentNames)));
+  llPrintf("@.instrumentCounters = private constant [%u x i64*] [", numCounters);
+  for (uint32 i = 0; i < numCounters; i++) {
+    llPrintf("%si64* @.instrumentCount%u", i == 0? "" : ", ", i);
+  }
+  llDeclareRuntimeFunction("runtime_startInstrumentation");
+  llPrintf("]\n"
+      "define internal void @.startInstrumentation() {\n"
+      "  call void @runtime_startInstrumentation("
+      "i8* getelementptr inbounds ([%1$u x i8], [%1$u x i8]* @.instrumentNames, i64 0, i64 0), "
+      "i64** getelementptr inbounds ([%2$u x i64*], [%2$u x i64*]* @.instrumentCounters, i64 0, i64 0), "
+      "i32 %2$u)\n"
+      "  ret void\n"
+      "}\n\n", namesLen, numCounters);
+  flushStringBuffer();
+}
+
+// Write the module text kept in memory to the .ll file.
+static void writeModuleFile(char *fileName, char *text, size_t length) {
+  FILE *file = fopen(fileName, "w");
+  if (file == NULL || fwrite(text, 1, length, file) != length) {
+    deError(0, "Unable to write to %s", fileName);
+  }
+  fclose(file);
+}
+
+// Generate LLVM assembly code.  If |moduleText| is not NULL, the module is also
+// returned in it, with its length in |moduleLength|, so it can be compiled
+// without reading the file back.  The caller frees it with free.
+void llGenerateLLVMAssemblyCode(char* fileName, bool debugMode, char **moduleText,
+    size_t *moduleLength) {
   llStackPos = 0;
   llStackAllocated = 32;
   llStack = utNewA(llElement, llStackAllocated);
@@ -4639,7 +7350,21 @@ void llGenerateLLVMAssemblyCode(char* fileName, bool debugMode) {
   llNumLocalsNeedingFree = 0;
   llNeedsFreeAllocated = 32;
   llNeedsFree = utNewA(llElement, llNeedsFreeAllocated);
+  llParallelNum = 0;
+  llParallelCapturesAllocated = 16;
+  llParallelCaptures = utNewA(deVariable, llParallelCapturesAllocated);
+#ifndef _WIN32
+  if (moduleText != NULL) {
+    llAsmFile = open_memstream(moduleText, moduleLength);
+  } else {
+    llAsmFile = fopen(fileName, "w");
+  }
+#else
+  if (moduleText != NULL) {
+    *moduleText = NULL;
+  }
   llAsmFile = fopen(fileName, "w");
+#endif
   if (llAsmFile == NULL) {
     deError(0, "Unable to write to %s", fileName);
   }
@@ -4657,6 +7382,18 @@ void llGenerateLLVMAssemblyCode(char* fileName, bool debugMode) {
   flushStringBuffer();
   llDeclareExternCFunctions();
   flushStringBuffer();
+  llNumProfiledFields = 0;
+  if (deProfileFields) {
+    declareFieldProfile();
+    flushStringBuffer();
+  }
+  llNumSnapshotEntries = 0;
+  if (programUsesSnapshots()) {
+    declareSnapshotTable();
+  }
+  declareClassStatsTable();
+  llNumInstrumentCounters = 0;
+  llInstrumentNames = deMutableStringCreate();
   deBlock rootBlock = deRootGetBlock(deTheRoot);
   if (llDebugMode) {
     llTag tag = llGenerateMainTags();
@@ -4671,8 +7408,8 @@ void llGenerateLLVMAssemblyCode(char* fileName, bool debugMode) {
       deBlock block = deSignatureGetBlock(signature);
       deFunction function = deBlockGetOwningFunction(block);
       deFunctionType type = deFunctionGetType(function);
-      if (block != rootBlock && type != DE_FUNC_ITERATOR && type != DE_FUNC_STRUCT &&
-          deFunctionGetLinkage(function) != DE_LINK_EXTERN_C) {
+      if (block != rootBlock && (type != DE_FUNC_ITERATOR || deSignatureIsCoroutine(signature)) &&
+          type != DE_FUNC_STRUCT && deFunctionGetLinkage(function) != DE_LINK_EXTERN_C) {
         deResetString();
         llDeclareBlockGlobals(block);
         generateBlockAssemblyCode(block, signature);
@@ -4680,14 +7417,27 @@ void llGenerateLLVMAssemblyCode(char* fileName, bool debugMode) {
       }
     }
   } deEndRootSignature;
+  if (deInstrumentCode) {
+    defineInstrumentCounters();
+  }
+  deStringDestroy(llInstrumentNames);
   llWriteDeclarations();
   flushStringBuffer();
   fclose(llAsmFile);
+  if (moduleText != NULL && *moduleText != NULL) {
+    writeModuleFile(fileName, *moduleText, *moduleLength);
+  }
   llStop();
   utFree(llNeedsFree);
+  utFree(llParallelCaptures);
   utFree(llStack);
   utFree(llModuleName);
   utFree(llTmpValueBuffer);
+  if (llSplitBlocks != NULL) {
+    utFree(llSplitBlocks);
+    llSplitBlocks = NULL;
+    llSplitBlocksAllocated = 0;
+  }
   llTmpValueLen = 0;
   llTmpValuePos = 0;
 }
@@ -41,7 +41,12 @@ char *llStringGetName(deString string);
 void llCreateFilepathTags(void);
 llTag llGenerateMainTags(void);
 void llGenerateSignatureTags(deSignature signature);
-void llWriteDebugTags(void);
+void llStartTags(void);
+void llWriteTags(void);
+llTag llCreateTag(char *text);
+llTag llCreateBranchWeightsTag(bool firstIsLikely);
+llTag llCreateMemberTbaaTag(deVariable arrayVar);
+llTag llCreateNonnullTag(void);
 void llCreateGlobalVariableTags(deBlock block);
 void llDeclareLocalVariable(deVariable variable, uint32 argNum);
 void llDeclareGlobalVariable(deVariable variable);
@@ -49,6 +54,7 @@ llTag llCreateLocationTag(llTag scopeTag, deLine line);
 char *llGetVariableName(deVariable variable);
 void llDeclareNewTuples(void);
 bool llDatatypeIsBigint(deDatatype datatype);
+bool llDatatypeIsWideInt(deDatatype datatype);
 bool llDatatypeIsArray(deDatatype datatype);
 uint32 llBigintBitsToWords(uint32 width, bool isSigned);
 bool llDatatypePassedByReference(deDatatype datatype);
@@ -22,13 +22,24 @@ static uint32 llStringNum;
 static uint32 llArrayNum;
 static uint32 llTupleNum;
 
-// Return true if the datatype is an int or uint > uint64 width.  These
-// integers are represented as bigints.
+// Return true if the datatype is an int or uint > uint64 width, or with
+// -nativeints, > DE_MAX_NATIVE_INT_WIDTH.  These integers are represented as
+// bigints.
 bool llDatatypeIsBigint(deDatatype datatype) {
+  deDatatypeType type = deDatatypeGetType(datatype);
+  if (type == DE_TYPE_UINT || type == DE_TYPE_INT || type == DE_TYPE_MODINT) {
+    return deIntegerWidthIsBigint(deDatatypeGetWidth(datatype));
+  }
+  return false;
+}
+
+// Return true if the datatype is an int or uint wider than uint64 that is
+// represented as an LLVM integer, which only happens with -nativeints.
+bool llDatatypeIsWideInt(deDatatype datatype) {
   deDatatypeType type = deDatatypeGetType(datatype);
   if (type == DE_TYPE_UINT || type == DE_TYPE_INT || type == DE_TYPE_MODINT) {
     uint32 width = deDatatypeGetWidth(datatype);
-    return width > llSizeWidth;
+    return width > llSizeWidth && !deIntegerWidthIsBigint(width);
   }
   return false;
 }
@@ -40,8 +51,7 @@ bool llDatatypeIsArray(deDatatype datatype) {
     return true;
   }
   if (type == DE_TYPE_UINT || type == DE_TYPE_INT || type == DE_TYPE_MODINT) {
-    uint32 width = deDatatypeGetWidth(datatype);
-    return width > llSizeWidth;
+    return deIntegerWidthIsBigint(deDatatypeGetWidth(datatype));
   }
   return false;
 }
@@ -221,7 +231,7 @@ static char *getTypeString(deDatatype datatype, bool isDefinition) {
     case DE_TYPE_UINT:
     case DE_TYPE_INT: {
       uint32 width = deDatatypeGetWidth(datatype);
-      if (width <= llSizeWidth) {
+      if (!deIntegerWidthIsBigint(width)) {
         return utSprintf("i%u", width);
       } else {
         if (isDefinition) {
@@ -255,6 +265,9 @@ static char *getTypeString(deDatatype datatype, bool isDefinition) {
       return utSprintf("i%u", deDatatypeGetWidth(datatype));
     case DE_TYPE_TUPLE:
       return getTupleTypeString(datatype, isDefinition);
+    case DE_TYPE_VECTOR:
+      return utSprintf("<%u x %s>", deDatatypeGetWidth(datatype),
+          getTypeString(deDatatypeGetElementType(datatype), isDefinition));
     case DE_TYPE_NONE:
       return "void";
     case DE_TYPE_FUNCTION:
@@ -312,9 +325,17 @@ static void declareRuntimeFunctions(void) {
   createFuncDecl("runtime_concatArrays", utSprintf(
       "declare dso_local void @runtime_concatArrays(%%struct.runtime_array*, %%struct.runtime_array*, "
      "i%s, i1 zeroext)", llSize));
+  createFuncDecl("runtime_joinArrays", utSprintf(
+      "declare dso_local void @runtime_joinArrays(%%struct.runtime_array*, %%struct.runtime_array*, "
+     "%%struct.runtime_array*, i%s)", llSize));
+  createFuncDecl("runtime_viewArraySlice", utSprintf(
+      "declare dso_local void @runtime_viewArraySlice(%%struct.runtime_array*, %%struct.runtime_array*, "
+     "i%s, i%s, i%s)", llSize, llSize, llSize));
   createFuncDecl("runtime_xorStrings",
       "declare dso_local void @runtime_xorStrings(%struct.runtime_array*, %struct.runtime_array*, %struct.runtime_array*)\n");
   createFuncDecl("runtime_freeArray", "declare dso_local void @runtime_freeArray(%struct.runtime_array*)");
+  createFuncDecl("runtime_freeSecretArray", "declare dso_local void @runtime_freeSecretArray(%struct.runtime_array*)");
+  createFuncDecl("runtime_markSecretArray", "declare dso_local void @runtime_markSecretArray(%struct.runtime_array*, i1 zeroext)");
   createFuncDecl("runtime_foreachArrayObject",
       "declare dso_local void @runtime_foreachArrayObject(%struct.runtime_array*, i8 *, i32, i32)");
   createFuncDecl("runtime_panicCstr", "declare dso_local void @runtime_panicCstr(i8*, ...)");
@@ -324,6 +345,15 @@ static void declareRuntimeFunctions(void) {
   createFuncDecl("runtime_appendArrayElement", utSprintf(
       "declare dso_local void @runtime_appendArrayElement(%%struct.runtime_array*, i8*, i%s, i1 zeroext, i1 zeroext)",
       llSize));
+  createFuncDecl("runtime_startFieldProfile",
+      "declare dso_local void @runtime_startFieldProfile(i8*, i64*, i32, void ()*)");
+  createFuncDecl("runtime_startInstrumentation",
+      "declare dso_local void @runtime_startInstrumentation(i8*, i64**, i32)");
+  createFuncDecl("runtime_parallelFor",
+      "declare dso_local void @runtime_parallelFor(void (i8*, i64, i64)*, i8*, i64)");
+  createFuncDecl("runtime_parallelForObjects",
+      "declare dso_local void @runtime_parallelForObjects(void (i8*, i64, i64)*, i8*, "
+      "%struct.runtime_array*, i64, i64, i64)");
   createFuncDecl("runtime_arrayStart", utSprintf("declare dso_local void @runtime_arrayStart()"));
   createFuncDecl("runtime_arrayStop", "declare dso_local void @runtime_arrayStop()");
   createFuncDecl("runtime_compactArrayHeap", "declare dso_local void @runtime_compactArrayHeap()");
@@ -342,13 +372,22 @@ static void declareRuntimeFunctions(void) {
   createFuncDecl("runtime_panic", "declare dso_local void @runtime_panic(%struct.runtime_array*, ...) noreturn");
   createFuncDecl("runtime_putsCstr", "declare dso_local void @runtime_putsCstr(i8*)");
   createFuncDecl("runtime_puts", "declare dso_local void @runtime_puts(%struct.runtime_array*)");
+  createFuncDecl("runtime_putInteger", utSprintf(
+      "declare dso_local void @runtime_putInteger(i%s, i32, i1 zeroext)", llSize));
   createFuncDecl("runtime_resizeArray", utSprintf(
       "declare dso_local void @runtime_resizeArray(%%struct.runtime_array*, i%s, i%s, i1 zeroext)",
       llSize, llSize));
+  createFuncDecl("runtime_reserveArray", utSprintf(
+      "declare dso_local void @runtime_reserveArray(%%struct.runtime_array*, i%s, i%s, i1 zeroext)",
+      llSize, llSize));
   createFuncDecl("runtime_stringToHex",
       "declare dso_local void @runtime_stringToHex(%struct.runtime_array*, %struct.runtime_array*)");
   createFuncDecl("runtime_hexToString",
       "declare dso_local void @runtime_hexToString(%struct.runtime_array*, %struct.runtime_array*)");
+  createFuncDecl("runtime_stringToBase64", "declare dso_local void "
+      "@runtime_stringToBase64(%struct.runtime_array*, %struct.runtime_array*, i1 zeroext)");
+  createFuncDecl("runtime_base64ToString", "declare dso_local void "
+      "@runtime_base64ToString(%struct.runtime_array*, %struct.runtime_array*, i1 zeroext)");
   createFuncDecl("runtime_stringFind", utSprintf(
       "declare dso_local i%s @runtime_stringFind(%%struct.runtime_array*, %%struct.runtime_array*, i%s)", llSize, llSize));
   createFuncDecl("runtime_stringRfind", utSprintf(
@@ -370,9 +409,29 @@ static void declareRuntimeFunctions(void) {
       "declare void @llvm.dbg.declare(metadata, metadata, metadata)");
   createFuncDecl("llvm.dbg.value",
       "declare void @llvm.dbg.value(metadata, metadata, metadata)");
+  createFuncDecl("free", "declare dso_local void @free(i8*)");
+  createFuncDecl("runtime_registerSnapshot", "declare dso_local void "
+      "@runtime_registerSnapshot(%struct.runtime_snapshotEntry*, i32, i64)");
+  createFuncDecl("runtime_registerClassStats", "declare dso_local void "
+      "@runtime_registerClassStats(%struct.runtime_classStatsEntry*, i32, %struct.runtime_array**, i8*)");
+  createFuncDecl("llvm.prefetch", "declare void @llvm.prefetch.p0i8(i8*, i32, i32, i32)");
+  createFuncDecl("llvm.coro.id", "declare token @llvm.coro.id(i32, i8*, i8*, i8*)");
+  createFuncDecl("llvm.coro.alloc", "declare i1 @llvm.coro.alloc(token)");
+  createFuncDecl("llvm.coro.size", utSprintf("declare i%s @llvm.coro.size.i%s()", llSize, llSize));
+  createFuncDecl("llvm.coro.begin", "declare i8* @llvm.coro.begin(token, i8*)");
+  createFuncDecl("llvm.coro.suspend", "declare i8 @llvm.coro.suspend(token, i1)");
+  createFuncDecl("llvm.coro.free", "declare i8* @llvm.coro.free(token, i8*)");
+  createFuncDecl("llvm.coro.end", "declare i1 @llvm.coro.end(i8*, i1)");
+  createFuncDecl("llvm.coro.done", "declare i1 @llvm.coro.done(i8*)");
+  createFuncDecl("llvm.coro.promise", "declare i8* @llvm.coro.promise(i8*, i32, i1)");
+  createFuncDecl("llvm.coro.resume", "declare void @llvm.coro.resume(i8*)");
+  createFuncDecl("llvm.coro.destroy", "declare void @llvm.coro.destroy(i8*)");
   createFuncDecl("runtime_compareArrays", utSprintf(
       "declare i1 @runtime_compareArrays(i32, i32, %%struct.runtime_array*, "
       "%%struct.runtime_array*, i%s, i1 zeroext, i1 zeroext)", llSize));
+  createFuncDecl("runtime_arraysEqual", utSprintf(
+      "declare zeroext i1 @runtime_arraysEqual(%%struct.runtime_array*, "
+      "%%struct.runtime_array*, i%s, i1 zeroext)", llSize));
   createFuncDecl("runtime_updateArrayBackPointer",
       "declare void @runtime_updateArrayBackPointer(%struct.runtime_array*)");
   createFuncDecl("runtime_bigintWidth", "declare zeroext i32 @runtime_bigintWidth(%struct.runtime_array*)");
@@ -387,6 +446,12 @@ static void declareRuntimeFunctions(void) {
   createFuncDecl("runtime_integerToBigint", utSprintf(
       "declare dso_local void @runtime_integerToBigint(%%struct.runtime_array*, "
       "i%s, i32, i1, i1)", llSize));
+  createFuncDecl("runtime_nativeIntToBigint",
+     "declare void @runtime_nativeIntToBigint(%struct.runtime_array*, i64*, i32 zeroext, "
+     "i1 zeroext, i1 zeroext)");
+  createFuncDecl("runtime_bigintToNativeInt",
+     "declare void @runtime_bigintToNativeInt(i64*, %struct.runtime_array*, i32 zeroext, "
+     "i1 zeroext, i1 zeroext)");
   createFuncDecl("runtime_bigintToInteger", utSprintf(
       "declare i%s @runtime_bigintToInteger(%%struct.runtime_array*)", llSize));
   createFuncDecl("runtime_bigintToIntegerTrunc", utSprintf(
@@ -423,6 +488,14 @@ static void declareRuntimeFunctions(void) {
       "declare void @runtime_bigintDiv(%struct.runtime_array*, %struct.runtime_array*, %struct.runtime_array*)");
   createFuncDecl("runtime_bigintMod",
       "declare void @runtime_bigintMod(%struct.runtime_array*, %struct.runtime_array*, %struct.runtime_array*)");
+  createFuncDecl("runtime_publicBigintMul",
+      "declare void @runtime_publicBigintMul(%struct.runtime_array*, %struct.runtime_array*, %struct.runtime_array*)");
+  createFuncDecl("runtime_publicBigintMulTrunc",
+      "declare void @runtime_publicBigintMulTrunc(%struct.runtime_array*, %struct.runtime_array*, %struct.runtime_array*)");
+  createFuncDecl("runtime_publicBigintDiv",
+      "declare void @runtime_publicBigintDiv(%struct.runtime_array*, %struct.runtime_array*, %struct.runtime_array*)");
+  createFuncDecl("runtime_publicBigintMod",
+      "declare void @runtime_publicBigintMod(%struct.runtime_array*, %struct.runtime_array*, %struct.runtime_array*)");
   createFuncDecl("runtime_bigintExp",
       "declare void @runtime_bigintExp(%struct.runtime_array*, %struct.runtime_array*, i32)");
   createFuncDecl("runtime_bigintNegate",
@@ -508,6 +581,7 @@ void llStart(void) {
   llArrayNum = 1;
   llTupleNum = 1;
   declareRuntimeFunctions();
+  llStartTags();
   if (llDebugMode) {
     llCreateFilepathTags();
   }
@@ -546,6 +620,11 @@ static void writeString(deString string) {
   uint32 num = llStringGetNum(string);
   char *escapedString = llEscapeString(string);
   uint32 len = deStringGetNumText(string);
+  if (len == 0) {
+    // Like other empty arrays, the empty string has no buffer.
+    fprintf(llAsmFile, "@.str%u = internal constant %%struct.runtime_array zeroinitializer\n", num);
+    return;
+  }
   fprintf(llAsmFile,
       "@.str%u = internal constant %%struct.runtime_array {i%s* bitcast "
       "([%u x i8]* @.str%u.data to i%s*), i%s %u}\n",
@@ -736,13 +815,16 @@ static void declareGlobalVariable(deVariable variable) {
   char *typeString = llGetTypeString(datatype, true);
   char *initializer;
   if (llDatatypeIsArray(datatype) || type == DE_TYPE_TUPLE || type == DE_TYPE_STRUCT ||
-      type == DE_TYPE_FLOAT) {
+      type == DE_TYPE_FLOAT || type == DE_TYPE_VECTOR) {
     initializer = "zeroinitializer";
   } else {
     initializer = "0";
   }
-  llPrintf("%s = dso_local global %s %s%s\n",
-      llGetVariableName(variable), typeString, initializer, getVariableTag(variable));
+  char *name = llGetVariableName(variable);
+  // The runtime's exception state is per-thread, for parallel for statements.
+  char *threadLocal = !strcmp(name, "@runtimeException")? "thread_local " : "";
+  llPrintf("%s = dso_local %sglobal %s %s%s\n",
+      name, threadLocal, typeString, initializer, getVariableTag(variable));
 }
 
 // Declare the block's variables as globals.
@@ -758,8 +840,9 @@ void llDeclareBlockGlobals(deBlock block) {
   }
   deVariable variable;
   deForeachBlockVariable(block, variable) {
+    // Variables private to parallel for bodies are locals of the outlined body.
     if (deVariableGetType(variable) == DE_VAR_LOCAL &&
-        deVariableInstantiated(variable)) {
+        deVariableInstantiated(variable) && !deVariableParallelPrivate(variable)) {
       declareGlobalVariable(variable);
     }
   } deEndBlockVariable;
@@ -779,8 +862,6 @@ char *llEscapeText(char *text) {
 
 // Print declarations for all used functions.
 void llWriteDeclarations(void) {
-  if (llDebugMode) {
-    llWriteDebugTags();
-  }
+  llWriteTags();
 }
 
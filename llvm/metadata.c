@@ -0,0 +1,47 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Optimization metadata, which tells LLVM what Rune already knows: runtime
+// check failures are rare, class member arrays never alias each other, and an
+// array being indexed has a non-null data pointer.  Tags are shared with debug
+// info, and identical tags are only written once.
+
+#include "ll.h"
+
+// Branch weights for a branch whose first target is almost always taken, or
+// almost never taken.  These are the weights clang uses for __builtin_expect.
+llTag llCreateBranchWeightsTag(bool firstIsLikely) {
+  if (firstIsLikely) {
+    return llCreateTag("!{!\"branch_weights\", i32 2000, i32 1}");
+  }
+  return llCreateTag("!{!\"branch_weights\", i32 1, i32 2000}");
+}
+
+// Create the TBAA access tag for elements of a class member's global array.
+// Each member variable has its own array, so loads and stores through one
+// member never alias loads and stores through another.  Members of a packed
+// class share their tuple array's tag, which is conservative.
+llTag llCreateMemberTbaaTag(deVariable arrayVar) {
+  llTag rootTag = llCreateTag("!{!\"Rune TBAA\"}");
+  char *path = deGetBlockPath(deVariableGetBlock(arrayVar), true);
+  char *name = llEscapeText(utSprintf("%s_%s", path, deVariableGetName(arrayVar)));
+  llTag typeTag = llCreateTag(utSprintf("!{!\"%s\", !%u, i64 0}", name, llTagGetNum(rootTag)));
+  uint32 typeNum = llTagGetNum(typeTag);
+  return llCreateTag(utSprintf("!{!%u, !%u, i64 0}", typeNum, typeNum));
+}
+
+// The empty tag used by !nonnull.
+llTag llCreateNonnullTag(void) {
+  return llCreateTag("!{}");
+}
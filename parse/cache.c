@@ -0,0 +1,812 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A cache of parsed syntax trees, so unchanged builtin and package modules are
+// not lexed and parsed on every run.  After parsing a file, we write the
+// objects the parser added to the destination block to <cacheDir>/<hash>.rnast,
+// keyed by a hash of the file's contents, the flags that change what the
+// parser builds, and the rune executable itself.  Loading replays the same
+// constructors the deCopy* functions use, so the objects created match what
+// parsing would have created.
+//
+// A file is only cached when everything it created lives in its destination
+// block: files with top-level appendcode or prependcode statements modify other
+// modules, and are always parsed.
+
+#include "parse.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// Bump this whenever the format, or the objects the parser creates, change.
+#define DE_CACHE_VERSION 5
+#define DE_CACHE_MAGIC 0x54534152  // "RAST"
+
+// Set by the parser when top-level appendcode or prependcode sends statements
+// outside the file's destination block.
+bool deParsedOutsideModule;
+
+// The destination block's contents before the parse, so we know what it added.
+static deBlock deCacheBlock;
+static deFilepath deCacheFilepath;
+static deStatement deCacheFirstStatement;
+static deStatement deCacheLastStatement;
+static deFunction deCacheLastFunction;
+static deVariable deCacheLastVariable;
+static deLine deCacheLastLine;
+static uint64 deCacheKey;
+
+// The serialized syntax tree being written or read.
+static uint8 *deCacheData;
+static uint32 deCacheUsed, deCacheAllocated;
+static uint32 deCachePos;
+static bool deCacheFailed;
+
+// Lines of the file path, sorted by handle, for finding a line's position.
+typedef struct {
+  uint32 index;
+  uint32 position;
+} deLinePosition;
+
+static deLinePosition *deLinePositions;
+static uint32 deNumLinePositions;
+// Lines by position, while loading.
+static deLine *deLoadedLines;
+static uint32 deNumLoadedLines;
+
+// Hash bytes with 64-bit FNV-1a.
+static uint64 hashBytes(uint64 hash, const uint8 *data, uint64 len) {
+  for (uint64 i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Hash a 64-bit value.
+static uint64 hashUint64(uint64 hash, uint64 value) {
+  return hashBytes(hash, (uint8*)&value, sizeof(value));
+}
+
+// Identify the rune executable by size and modification time, so a rebuilt
+// compiler never reads trees written by an older one.
+static uint64 hashExecutable(uint64 hash) {
+  struct stat info;
+  if (deExeName != NULL && stat(deExeName, &info) == 0) {
+    hash = hashUint64(hash, info.st_size);
+    hash = hashUint64(hash, info.st_mtime);
+  }
+  return hash;
+}
+
+// Return the cache key for the file's contents and the current parser flags,
+// or 0 if the file cannot be read.
+static uint64 computeKey(char *fullName) {
+  FILE *file = fopen(fullName, "rb");
+  if (file == NULL) {
+    return 0;
+  }
+  uint64 hash = 0xcbf29ce484222325ULL;
+  uint8 buf[1 << 12];
+  size_t len;
+  while ((len = fread(buf, 1, sizeof(buf), file)) != 0) {
+    hash = hashBytes(hash, buf, len);
+  }
+  fclose(file);
+  hash = hashUint64(hash, DE_CACHE_VERSION);
+  hash = hashUint64(hash, deTestMode);
+  hash = hashUint64(hash, deDebugMode);
+  hash = hashUint64(hash, deUnsafeDepth != 0);
+  hash = hashUint64(hash, deCurrentBlock == deRootGetBlock(deTheRoot));
+  hash = hashExecutable(hash);
+  return hash == 0? 1 : hash;
+}
+
+// Return the cache file name for |fullName|.
+static char *cacheFileName(char *fullName) {
+  uint64 hash = hashBytes(0xcbf29ce484222325ULL, (uint8*)fullName, strlen(fullName));
+  return utSprintf("%s/%016llx.rnast", deParseCacheDir, (unsigned long long)hash);
+}
+
+// Append bytes to the cache buffer.
+static void writeBytes(const void *data, uint32 len) {
+  if (deCacheUsed + len > deCacheAllocated) {
+    while (deCacheUsed + len > deCacheAllocated) {
+      deCacheAllocated <<= 1;
+    }
+    utResizeArray(deCacheData, deCacheAllocated);
+  }
+  memcpy(deCacheData + deCacheUsed, data, len);
+  deCacheUsed += len;
+}
+
+static void writeUint32(uint32 value) {
+  writeBytes(&value, sizeof(value));
+}
+
+static void writeBool(bool value) {
+  uint8 byte = value;
+  writeBytes(&byte, 1);
+}
+
+// Write a symbol's name, or a length of UINT32_MAX for utSymNull.
+static void writeSym(utSym sym) {
+  if (sym == utSymNull) {
+    writeUint32(UINT32_MAX);
+    return;
+  }
+  char *name = utSymGetName(sym);
+  uint32 len = strlen(name);
+  writeUint32(len);
+  writeBytes(name, len);
+}
+
+// Compare line positions by handle index.
+static int compareLinePositions(const void *a, const void *b) {
+  uint32 indexA = ((const deLinePosition*)a)->index;
+  uint32 indexB = ((const deLinePosition*)b)->index;
+  return indexA < indexB? -1 : indexA > indexB;
+}
+
+// Record the position of each line in the file path, so lines can be written
+// as positions.
+static void indexFilepathLines(deFilepath filepath) {
+  uint32 numLines = 0;
+  deLine line;
+  deForeachFilepathLine(filepath, line) {
+    numLines++;
+  } deEndFilepathLine;
+  deLinePositions = utNewA(deLinePosition, numLines == 0? 1 : numLines);
+  deNumLinePositions = numLines;
+  uint32 position = 0;
+  deForeachFilepathLine(filepath, line) {
+    deLinePositions[position].index = deLine2Index(line);
+    deLinePositions[position].position = position;
+    position++;
+  } deEndFilepathLine;
+  qsort(deLinePositions, numLines, sizeof(deLinePosition), compareLinePositions);
+}
+
+// Return the position of |line| in the file path, or UINT32_MAX if it is from
+// another file.
+static uint32 findLinePosition(deLine line) {
+  deLinePosition key = {deLine2Index(line), 0};
+  deLinePosition *found = bsearch(&key, deLinePositions, deNumLinePositions,
+      sizeof(deLinePosition), compareLinePositions);
+  return found == NULL? UINT32_MAX : found->position;
+}
+
+// Write a line as its position in the file path, plus 1, or 0 for deLineNull.
+// Lines from other files cannot be cached.
+static void writeLine(deLine line) {
+  if (line == deLineNull) {
+    writeUint32(0);
+    return;
+  }
+  uint32 position = findLinePosition(line);
+  if (position == UINT32_MAX) {
+    deCacheFailed = true;
+    position = 0;
+  }
+  writeUint32(position + 1);
+}
+
+static void writeBlockContents(deBlock block, deStatement firstStatement,
+    deFunction firstFunction, deVariable firstVariable);
+
+// Write an expression tree.  Expressions are untyped right after parsing.
+static void writeExpression(deExpression expression) {
+  if (deExpressionGetDatatype(expression) != deDatatypeNull ||
+      deExpressionGetSignature(expression) != deSignatureNull) {
+    deCacheFailed = true;
+  }
+  deExpressionType type = deExpressionGetType(expression);
+  writeUint32(type);
+  writeLine(deExpressionGetLine(expression));
+  writeBool(deExpressionIsType(expression));
+  writeBool(deExpressionConst(expression));
+  writeBool(deExpressionAutocast(expression));
+  switch (type) {
+    case DE_EXPR_INTEGER: {
+      deBigint bigint = deExpressionGetBigint(expression);
+      writeBool(deBigintSigned(bigint));
+      writeUint32(deBigintGetWidth(bigint));
+      writeBool(deBigintWidthUnspecified(bigint));
+      writeUint32(deBigintGetNumData(bigint));
+      writeBytes(deBigintGetData(bigint), deBigintGetNumData(bigint));
+      break;
+    }
+    case DE_EXPR_STRING: {
+      deString string = deExpressionGetString(expression);
+      writeUint32(deStringGetUsed(string));
+      writeBytes(deStringGetText(string), deStringGetUsed(string));
+      break;
+    }
+    case DE_EXPR_IDENT:
+      writeSym(deExpressionGetName(expression));
+      break;
+    case DE_EXPR_BOOL:
+      writeBool(deExpressionBoolVal(expression));
+      break;
+    case DE_EXPR_RANDUINT:
+    case DE_EXPR_UINTTYPE:
+    case DE_EXPR_INTTYPE:
+    case DE_EXPR_FLOATTYPE:
+      writeUint32(deExpressionGetWidth(expression));
+      break;
+    case DE_EXPR_FLOAT: {
+      deFloat floatVal = deExpressionGetFloat(expression);
+      double value = deFloatGetValue(floatVal);
+      writeUint32(deFloatGetType(floatVal));
+      writeBytes(&value, sizeof(value));
+      break;
+    }
+    default:
+      break;
+  }
+  writeUint32(deExpressionCountExpressions(expression));
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    writeExpression(child);
+  } deEndExpressionExpression;
+}
+
+// Write an optional expression.
+static void writeOptionalExpression(deExpression expression) {
+  writeBool(expression != deExpressionNull);
+  if (expression != deExpressionNull) {
+    writeExpression(expression);
+  }
+}
+
+// Write a block's own fields, and all of its contents.
+static void writeBlock(deBlock block) {
+  if (deBlockGetFilepath(block) != deCacheFilepath) {
+    deCacheFailed = true;
+  }
+  writeLine(deBlockGetLine(block));
+  writeBool(deBlockCanReturn(block));
+  writeBool(deBlockCanContinue(block));
+  writeBlockContents(block, deBlockGetFirstStatement(block), deBlockGetFirstFunction(block),
+      deBlockGetFirstVariable(block));
+}
+
+// Write a variable.  Only enum entries are typed during parsing, and those
+// types are recomputed on load.
+static void writeVariable(deVariable variable, bool inEnum) {
+  if (deVariableGetDatatype(variable) != deDatatypeNull && !inEnum) {
+    deCacheFailed = true;
+  }
+  writeUint32(deVariableGetType(variable));
+  writeBool(deVariableConst(variable));
+  writeSym(deVariableGetSym(variable));
+  writeBool(deVariableGenerated(variable));
+  writeLine(deVariableGetLine(variable));
+  writeOptionalExpression(deVariableGetInitializerExpression(variable));
+  writeOptionalExpression(deVariableGetTypeExpression(variable));
+  writeBool(deVariableIsType(variable));
+  writeBool(deVariableInstantiated(variable));
+  writeBool(deVariableInTemplateSignature(variable));
+  writeBool(deVariableInitializedAtTop(variable));
+}
+
+// Write a statement, with its expression and sub-block.
+static void writeStatement(deStatement statement) {
+  writeUint32(deStatementGetType(statement));
+  writeLine(deStatementGetLine(statement));
+  writeBool(deStatementGenerated(statement));
+  writeBool(deStatementUnsafe(statement));
+  writeBool(deStatementInstantiated(statement));
+  writeBool(deStatementExecuted(statement));
+  writeBool(deStatementIsFirstAssignment(statement));
+  writeBool(deStatementParallel(statement));
+  writeBool(deStatementArena(statement));
+  writeOptionalExpression(deStatementGetExpression(statement));
+  deBlock subBlock = deStatementGetSubBlock(statement);
+  writeBool(subBlock != deBlockNull);
+  if (subBlock != deBlockNull) {
+    writeBlock(subBlock);
+  }
+}
+
+// Write a function, with its sub-block, template, and transformer.
+static void writeFunction(deFunction function) {
+  deIdent ident = deFunctionGetFirstIdent(function);
+  if (ident != deIdentNull && deIdentGetNextFunctionIdent(ident) != deIdentNull) {
+    deCacheFailed = true;
+  }
+  writeUint32(deFunctionGetType(function));
+  writeSym(ident == deIdentNull? utSymNull : deIdentGetSym(ident));
+  writeUint32(deFunctionGetLinkage(function));
+  writeLine(deFunctionGetLine(function));
+  writeBool(deFunctionExtern(function));
+  writeBool(deFunctionInUnitTest(function));
+  writeBool(deFunctionUnsafe(function));
+  writeBool(deFunctionReturnsValue(function));
+  writeBool(deFunctionCompactor(function));
+  writeUint32(deFunctionGetOpType(function));
+  writeUint32(deFunctionGetBuiltinType(function));
+  writeOptionalExpression(deFunctionGetTypeExpression(function));
+  writeBlock(deFunctionGetSubBlock(function));
+  deTemplate templ = deFunctionGetTemplate(function);
+  writeBool(templ != deTemplateNull);
+  if (templ != deTemplateNull) {
+    writeUint32(deTemplateGetRefWidth(templ));
+    writeBool(deTemplateRefWidthDeclared(templ));
+    writeLine(deTemplateGetLine(templ));
+    writeBool(deTemplatePacked(templ));
+    writeUint32(deTemplateGetNumTemplateParams(templ));
+    writeBool(deTemplateIsTemplate(templ));
+    writeBool(deTemplateHasFinalMethod(templ));
+    writeUint32(deTemplateGetBuiltinType(templ));
+  }
+  deTransformer transformer = deFunctionGetTransformer(function);
+  writeBool(transformer != deTransformerNull);
+  if (transformer != deTransformerNull) {
+    writeLine(deTransformerGetLine(transformer));
+  }
+  // The parser creates fully specified signatures for exported classes and
+  // library calls.
+  deSignature signature = deFunctionGetFirstSignature(function);
+  if (signature != deSignatureNull && deSignatureGetNextFunctionSignature(signature) != deSignatureNull) {
+    deCacheFailed = true;
+  }
+  writeBool(signature != deSignatureNull);
+}
+
+// Write the variables of a block, starting at |firstVariable|, followed by its
+// functions and statements in source order.
+static void writeBlockContents(deBlock block, deStatement firstStatement,
+    deFunction firstFunction, deVariable firstVariable) {
+  deFunction owningFunction = deBlockGetOwningFunction(block);
+  bool inEnum = owningFunction != deFunctionNull &&
+      deFunctionGetType(owningFunction) == DE_FUNC_ENUM;
+  uint32 numVariables = 0;
+  for (deVariable variable = firstVariable; variable != deVariableNull;
+       variable = deVariableGetNextBlockVariable(variable)) {
+    numVariables++;
+  }
+  writeUint32(numVariables);
+  for (deVariable variable = firstVariable; variable != deVariableNull;
+       variable = deVariableGetNextBlockVariable(variable)) {
+    writeVariable(variable, inEnum);
+  }
+  uint32 numItems = 0;
+  for (deFunction function = firstFunction; function != deFunctionNull;
+       function = deFunctionGetNextBlockFunction(function)) {
+    numItems++;
+  }
+  for (deStatement statement = firstStatement; statement != deStatementNull;
+       statement = deStatementGetNextBlockStatement(statement)) {
+    numItems++;
+  }
+  writeUint32(numItems);
+  deFunction function = firstFunction;
+  deStatement statement = firstStatement;
+  while (function != deFunctionNull || statement != deStatementNull) {
+    bool writeFunc = statement == deStatementNull || (function != deFunctionNull &&
+        findLinePosition(deFunctionGetLine(function)) <=
+        findLinePosition(deStatementGetLine(statement)));
+    writeBool(writeFunc);
+    if (writeFunc) {
+      writeFunction(function);
+      function = deFunctionGetNextBlockFunction(function);
+    } else {
+      writeStatement(statement);
+      statement = deStatementGetNextBlockStatement(statement);
+    }
+  }
+}
+
+static bool loadCachedModule(char *fullName);
+
+// Called before parsing a file into deCurrentBlock.  Returns true if the file's
+// syntax tree was loaded from the cache, in which case there is nothing to parse.
+bool deStartCachedParse(char *fullName) {
+  deCacheKey = 0;
+  if (deParseCacheDir == NULL || *deParseCacheDir == '\0') {
+    return false;
+  }
+  deCacheKey = computeKey(fullName);
+  if (deCacheKey == 0) {
+    return false;
+  }
+  if (loadCachedModule(fullName)) {
+    return true;
+  }
+  deCacheBlock = deCurrentBlock;
+  deCacheFilepath = deCurrentFilepath;
+  deCacheFirstStatement = deBlockGetFirstStatement(deCacheBlock);
+  deCacheLastStatement = deBlockGetLastStatement(deCacheBlock);
+  deCacheLastFunction = deBlockGetLastFunction(deCacheBlock);
+  deCacheLastVariable = deBlockGetLastVariable(deCacheBlock);
+  deCacheLastLine = deFilepathGetLastLine(deCacheFilepath);
+  deParsedOutsideModule = false;
+  return false;
+}
+
+// Write the file to |fileName| in one step, so concurrent compilers never see
+// a partial file.
+static void writeCacheFile(char *fileName) {
+#ifndef _WIN32
+  mkdir(deParseCacheDir, 0755);
+  char *tmpName = utAllocString(utSprintf("%s.%d", fileName, (int)getpid()));
+#else
+  char *tmpName = utAllocString(utSprintf("%s.tmp", fileName));
+#endif
+  FILE *file = fopen(tmpName, "wb");
+  if (file != NULL) {
+    bool written = fwrite(deCacheData, 1, deCacheUsed, file) == deCacheUsed;
+    if (fclose(file) == 0 && written) {
+      rename(tmpName, fileName);
+    }
+    remove(tmpName);
+  }
+  utFree(tmpName);
+}
+
+// Called after parsing a file.  Write what the parser created to the cache.
+void deFinishCachedParse(char *fullName) {
+  if (deCacheKey == 0 || deParsedOutsideModule) {
+    return;
+  }
+  // Relation statements are moved to the start of the block, in front of
+  // statements from earlier files.
+  if (deCacheFirstStatement != deStatementNull &&
+      deBlockGetFirstStatement(deCacheBlock) != deCacheFirstStatement) {
+    return;
+  }
+  deCacheFailed = false;
+  deCacheAllocated = 1 << 16;
+  deCacheUsed = 0;
+  deCacheData = utNewA(uint8, deCacheAllocated);
+  indexFilepathLines(deCacheFilepath);
+  writeUint32(DE_CACHE_MAGIC);
+  writeBytes(&deCacheKey, sizeof(deCacheKey));
+  uint32 firstNewLine = deCacheLastLine == deLineNull? 0 : findLinePosition(deCacheLastLine) + 1;
+  writeUint32(firstNewLine);
+  writeUint32(deNumLinePositions - firstNewLine);
+  deLine line = deCacheLastLine == deLineNull? deFilepathGetFirstLine(deCacheFilepath) :
+      deLineGetNextFilepathLine(deCacheLastLine);
+  for (; line != deLineNull; line = deLineGetNextFilepathLine(line)) {
+    // The text includes the terminating '\0'.
+    writeUint32(deLineGetLineNum(line));
+    writeUint32(deLineGetNumText(line) - 1);
+    writeBytes(deLineGetText(line), deLineGetNumText(line) - 1);
+  }
+  // A top-level return marks the module function as returning a value.
+  deFunction owningFunction = deBlockGetOwningFunction(deCacheBlock);
+  writeBool(owningFunction != deFunctionNull && deFunctionReturnsValue(owningFunction));
+  writeBlockContents(deCacheBlock,
+      deCacheLastStatement == deStatementNull? deBlockGetFirstStatement(deCacheBlock) :
+          deStatementGetNextBlockStatement(deCacheLastStatement),
+      deCacheLastFunction == deFunctionNull? deBlockGetFirstFunction(deCacheBlock) :
+          deFunctionGetNextBlockFunction(deCacheLastFunction),
+      deCacheLastVariable == deVariableNull? deBlockGetFirstVariable(deCacheBlock) :
+          deVariableGetNextBlockVariable(deCacheLastVariable));
+  uint64 checksum = hashBytes(0xcbf29ce484222325ULL, deCacheData, deCacheUsed);
+  writeBytes(&checksum, sizeof(checksum));
+  if (!deCacheFailed) {
+    char *fileName = utAllocString(cacheFileName(fullName));
+    writeCacheFile(fileName);
+    utFree(fileName);
+  }
+  utFree(deLinePositions);
+  utFree(deCacheData);
+  deCacheData = NULL;
+}
+
+// Read bytes from the cache buffer.  The checksum has already been verified,
+// so running off the end means the format changed without a version bump.
+static void readBytes(void *dest, uint32 len) {
+  if (deCachePos + len > deCacheUsed) {
+    utExit("Corrupt syntax tree cache in %s", deParseCacheDir);
+  }
+  memcpy(dest, deCacheData + deCachePos, len);
+  deCachePos += len;
+}
+
+static uint32 readUint32(void) {
+  uint32 value;
+  readBytes(&value, sizeof(value));
+  return value;
+}
+
+static bool readBool(void) {
+  uint8 byte;
+  readBytes(&byte, 1);
+  return byte != 0;
+}
+
+static utSym readSym(void) {
+  uint32 len = readUint32();
+  if (len == UINT32_MAX) {
+    return utSymNull;
+  }
+  char *name = utNewA(char, len + 1);
+  readBytes(name, len);
+  name[len] = '\0';
+  utSym sym = utSymCreate(name);
+  utFree(name);
+  return sym;
+}
+
+static deLine readLine(void) {
+  uint32 position = readUint32();
+  if (position == 0) {
+    return deLineNull;
+  }
+  if (position > deNumLoadedLines) {
+    utExit("Corrupt syntax tree cache in %s", deParseCacheDir);
+  }
+  return deLoadedLines[position - 1];
+}
+
+static void readBlockContents(deBlock block);
+
+static deExpression readExpression(void) {
+  deExpressionType type = readUint32();
+  deExpression expression = deExpressionCreate(type, readLine());
+  deExpressionSetIsType(expression, readBool());
+  deExpressionSetConst(expression, readBool());
+  deExpressionSetAutocast(expression, readBool());
+  switch (type) {
+    case DE_EXPR_INTEGER: {
+      bool isSigned = readBool();
+      uint32 width = readUint32();
+      bool widthUnspecified = readBool();
+      deBigint bigint = deZeroBigintCreate(isSigned, width);
+      uint32 numData = readUint32();
+      uint8 *data = utNewA(uint8, numData == 0? 1 : numData);
+      readBytes(data, numData);
+      deBigintSetData(bigint, data, numData);
+      utFree(data);
+      deBigintSetWidthUnspecified(bigint, widthUnspecified);
+      deExpressionSetBigint(expression, bigint);
+      break;
+    }
+    case DE_EXPR_STRING: {
+      uint32 len = readUint32();
+      deString string = deMutableStringCreate();
+      // Needed to ensure deStringSetText does not realloc string texts.
+      deStringResizeTexts(string, len);
+      readBytes(deStringGetText(string), len);
+      deStringSetUsed(string, len);
+      deExpressionSetString(expression, string);
+      break;
+    }
+    case DE_EXPR_IDENT:
+      deExpressionSetName(expression, readSym());
+      break;
+    case DE_EXPR_BOOL:
+      deExpressionSetBoolVal(expression, readBool());
+      break;
+    case DE_EXPR_RANDUINT:
+    case DE_EXPR_UINTTYPE:
+    case DE_EXPR_INTTYPE:
+    case DE_EXPR_FLOATTYPE:
+      deExpressionSetWidth(expression, readUint32());
+      break;
+    case DE_EXPR_FLOAT: {
+      deFloatType floatType = readUint32();
+      double value;
+      readBytes(&value, sizeof(value));
+      deExpressionSetFloat(expression, deFloatCreate(floatType, value));
+      break;
+    }
+    default:
+      break;
+  }
+  uint32 numChildren = readUint32();
+  for (uint32 i = 0; i < numChildren; i++) {
+    deExpressionAppendExpression(expression, readExpression());
+  }
+  return expression;
+}
+
+static deExpression readOptionalExpression(void) {
+  return readBool()? readExpression() : deExpressionNull;
+}
+
+// Read a block's fields and contents into |block|, which already exists.
+static void readBlock(deBlock block) {
+  deBlockSetLine(block, readLine());
+  deBlockSetCanReturn(block, readBool());
+  deBlockSetCanContinue(block, readBool());
+  readBlockContents(block);
+}
+
+static void readVariable(deBlock block) {
+  deVariableType type = readUint32();
+  bool isConst = readBool();
+  utSym name = readSym();
+  bool generated = readBool();
+  deLine line = readLine();
+  deExpression initializer = readOptionalExpression();
+  deVariable variable = deVariableCreate(block, type, isConst, name, initializer, generated, line);
+  deExpression typeConstraint = readOptionalExpression();
+  if (typeConstraint != deExpressionNull) {
+    deVariableInsertTypeExpression(variable, typeConstraint);
+  }
+  deVariableSetIsType(variable, readBool());
+  deVariableSetInstantiated(variable, readBool());
+  deVariableSetInTemplateSignature(variable, readBool());
+  deVariableSetInitializedAtTop(variable, readBool());
+}
+
+static void readStatement(deBlock block) {
+  deStatementType type = readUint32();
+  deStatement statement = deStatementCreate(block, type, readLine());
+  deStatementSetGenerated(statement, readBool());
+  deStatementSetUnsafe(statement, readBool());
+  deStatementSetInstantiated(statement, readBool());
+  deStatementSetExecuted(statement, readBool());
+  deStatementSetIsFirstAssignment(statement, readBool());
+  deStatementSetParallel(statement, readBool());
+  deStatementSetArena(statement, readBool());
+  deExpression expression = readOptionalExpression();
+  if (expression != deExpressionNull) {
+    deStatementInsertExpression(statement, expression);
+  }
+  if (readBool()) {
+    deBlock subBlock = deBlockCreate(deCacheFilepath, DE_BLOCK_STATEMENT, deStatementGetLine(statement));
+    deStatementInsertSubBlock(statement, subBlock);
+    readBlock(subBlock);
+  }
+}
+
+static void readFunction(deBlock block) {
+  deFunctionType type = readUint32();
+  utSym name = readSym();
+  deLinkage linkage = readUint32();
+  deLine line = readLine();
+  deFunction function = deFunctionCreate(deCacheFilepath, block, type, name, linkage, line);
+  deFunctionSetExtern(function, readBool());
+  deFunctionSetInUnitTest(function, readBool());
+  deFunctionSetUnsafe(function, readBool());
+  deFunctionSetReturnsValue(function, readBool());
+  deFunctionSetCompactor(function, readBool());
+  deFunctionSetOpType(function, readUint32());
+  deFunctionSetBuiltinType(function, readUint32());
+  deExpression typeConstraint = readOptionalExpression();
+  if (typeConstraint != deExpressionNull) {
+    deFunctionInsertTypeExpression(function, typeConstraint);
+  }
+  deBlock subBlock = deFunctionGetSubBlock(function);
+  readBlock(subBlock);
+  if (readBool()) {
+    // Like deTemplateCreate, but the destroy method was already read with the
+    // class block.
+    deTemplate templ = deTemplateAlloc();
+    deTemplateSetRefWidth(templ, readUint32());
+    deTemplateSetRefWidthDeclared(templ, readBool());
+    deTemplateSetLine(templ, readLine());
+    deTemplateSetPacked(templ, readBool());
+    deTemplateSetNumTemplateParams(templ, readUint32());
+    deTemplateSetIsTemplate(templ, readBool());
+    deTemplateSetHasFinalMethod(templ, readBool());
+    deTemplateSetBuiltinType(templ, readUint32());
+    deFunctionInsertTemplate(function, templ);
+    deRootAppendTemplate(deTheRoot, templ);
+  }
+  if (readBool()) {
+    deTransformer transformer = deTransformerAlloc();
+    deTransformerSetLine(transformer, readLine());
+    deFunctionInsertTransformer(function, transformer);
+  }
+  if (type == DE_FUNC_ENUM) {
+    deAssignEnumEntryConstants(subBlock);
+  }
+  if (readBool()) {
+    deCreateFullySpecifiedSignature(function);
+  }
+}
+
+// Read variables, then functions and statements, appending them to |block|.
+static void readBlockContents(deBlock block) {
+  uint32 numVariables = readUint32();
+  for (uint32 i = 0; i < numVariables; i++) {
+    readVariable(block);
+  }
+  uint32 numItems = readUint32();
+  for (uint32 i = 0; i < numItems; i++) {
+    if (readBool()) {
+      readFunction(block);
+    } else {
+      readStatement(block);
+    }
+  }
+}
+
+// Read the cache file for |fullName| into deCacheData.  Return false if it does
+// not exist, or was written for different contents, flags, or compiler.
+static bool readCacheFile(char *fullName) {
+  FILE *file = fopen(cacheFileName(fullName), "rb");
+  if (file == NULL) {
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  long len = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint32 headerLen = sizeof(uint32) + sizeof(uint64);
+  if (len < (long)(headerLen + sizeof(uint64)) || len > UINT32_MAX) {
+    fclose(file);
+    return false;
+  }
+  deCacheUsed = len;
+  deCacheData = utNewA(uint8, deCacheUsed);
+  bool read = fread(deCacheData, 1, deCacheUsed, file) == deCacheUsed;
+  fclose(file);
+  uint32 magic;
+  uint64 key, checksum;
+  memcpy(&magic, deCacheData, sizeof(magic));
+  memcpy(&key, deCacheData + sizeof(magic), sizeof(key));
+  deCacheUsed -= sizeof(checksum);
+  memcpy(&checksum, deCacheData + deCacheUsed, sizeof(checksum));
+  if (!read || magic != DE_CACHE_MAGIC || key != deCacheKey ||
+      checksum != hashBytes(0xcbf29ce484222325ULL, deCacheData, deCacheUsed)) {
+    utFree(deCacheData);
+    deCacheData = NULL;
+    return false;
+  }
+  deCachePos = headerLen;
+  return true;
+}
+
+// Load the syntax tree of |fullName| into deCurrentBlock, if it is cached.
+static bool loadCachedModule(char *fullName) {
+  if (!readCacheFile(fullName)) {
+    return false;
+  }
+  deCacheFilepath = deCurrentFilepath;
+  uint32 numOldLines = 0;
+  deLine line;
+  deForeachFilepathLine(deCacheFilepath, line) {
+    numOldLines++;
+  } deEndFilepathLine;
+  uint32 firstNewLine = readUint32();
+  if (firstNewLine != numOldLines) {
+    utFree(deCacheData);
+    deCacheData = NULL;
+    return false;
+  }
+  uint32 numNewLines = readUint32();
+  deNumLoadedLines = numOldLines + numNewLines;
+  deLoadedLines = utNewA(deLine, deNumLoadedLines == 0? 1 : deNumLoadedLines);
+  uint32 position = 0;
+  deForeachFilepathLine(deCacheFilepath, line) {
+    deLoadedLines[position++] = line;
+  } deEndFilepathLine;
+  for (uint32 i = 0; i < numNewLines; i++) {
+    uint32 lineNum = readUint32();
+    uint32 len = readUint32();
+    char *text = utNewA(char, len + 1);
+    readBytes(text, len);
+    deLoadedLines[position++] = deLineCreate(deCacheFilepath, text, len, lineNum);
+    utFree(text);
+  }
+  if (readBool()) {
+    deFunctionSetReturnsValue(deBlockGetOwningFunction(deCurrentBlock), true);
+  }
+  readBlockContents(deCurrentBlock);
+  utFree(deLoadedLines);
+  deLoadedLines = NULL;
+  deNumLoadedLines = 0;
+  utFree(deCacheData);
+  deCacheData = NULL;
+  return true;
+}
@@ -95,6 +95,25 @@ static void moveNewStatementsToBlockStart(void) {
   deBlockSetLastStatement(block, deLastStatement);
 }
 
+// Create the vectorof expression for a vector type literal like u8x32.  The
+// scanner has already checked the element width and lane count are non-zero.
+static deExpression createVectorTypeExpression(utSym sym, deLine line) {
+  char *text = utSymGetName(sym);
+  char *end;
+  uint32 width = strtol(text + 1, &end, 10);
+  uint32 lanes = strtol(end + 1, NULL, 10);
+  deExpressionType elementType = DE_EXPR_FLOATTYPE;
+  if (*text == 'u') {
+    elementType = DE_EXPR_UINTTYPE;
+  } else if (*text == 'i') {
+    elementType = DE_EXPR_INTTYPE;
+  }
+  deExpression elementExpr = deExpressionCreate(elementType, line);
+  deExpressionSetWidth(elementExpr, width);
+  deExpression lanesExpr = deIntegerExpressionCreate(deUint32BigintCreate(lanes), line);
+  return deBinaryExpressionCreate(DE_EXPR_VECTOROF, elementExpr, lanesExpr, line);
+}
+
 // Set the function linkage to extern C or extern RPC.
 static void setFunctionExtern(deFunction function, deString langName) {
   if (!strcmp(deStringGetCstr(langName), "C")) {
@@ -160,14 +179,14 @@ static void moveImportsToBlock(deBlock subBlock, deBlock destBlock) {
   deFloat floatVal;
 };
 
-%token <symVal> IDENT
+%token <symVal> IDENT VECTORTYPE
 %token <stringVal> STRING
 %token <bigintVal> INTEGER
 %token <uint16Val> RANDUINT INTTYPE UINTTYPE
 %token <boolVal> BOOL
 %token <floatVal> FLOAT
 
-%type <boolVal> optVar
+%type <boolVal> optVar optPacked
 %type <exprTypeVal> assignmentOp
 %type <exprTypeVal> operator
 %type <exprVal> accessExpression
@@ -229,6 +248,7 @@ static void moveImportsToBlock(deBlock subBlock, deBlock destBlock) {
 %token <lineVal> KWAND
 %token <lineVal> KWANDEQUALS
 %token <lineVal> KWAPPENDCODE
+%token <lineVal> KWARENA
 %token <lineVal> KWARRAYOF
 %token <lineVal> KWARROW
 %token <lineVal> KWIMPLIES
@@ -282,6 +302,8 @@ static void moveImportsToBlock(deBlock subBlock, deBlock destBlock) {
 %token <lineVal> KWOPERATOR
 %token <lineVal> KWOR
 %token <lineVal> KWOREQUALS
+%token <lineVal> KWPACKED
+%token <lineVal> KWPARALLEL
 %token <lineVal> KWPREPENDCODE
 %token <lineVal> KWPRINT
 %token <lineVal> KWPRINTLN
@@ -314,9 +336,11 @@ static void moveImportsToBlock(deBlock subBlock, deBlock destBlock) {
 %token <lineVal> KWTYPESWITCH
 %token <lineVal> KWUNITTEST
 %token <lineVal> KWUNREF
+%token <lineVal> KWUNSAFE
 %token <lineVal> KWUNSIGNED
 %token <lineVal> KWUSE
 %token <lineVal> KWVAR
+%token <lineVal> KWVECTOROF
 %token <lineVal> KWWHILE
 %token <lineVal> KWWIDTHOF
 %token <lineVal> KWXOR
@@ -367,6 +391,7 @@ statements: // Empty
 | statements statement
 
 statement: appendCode
+| arenaStatement
 | assertStatement
 | assignmentStatement
 | callStatement
@@ -378,6 +403,7 @@ statement: appendCode
 | foreachStatement
 | forStatement
 | function
+| parallelForeachStatement
 | transformStatement
 | transformer
 | ifStatement
@@ -397,6 +423,7 @@ statement: appendCode
 | panicStatement
 | unitTest
 | unrefStatement
+| unsafeStatement
 | whileStatement
 | yield
 
@@ -429,27 +456,39 @@ import: KWIMPORT pathExpressionWithAlias newlines
 
 class: classHeader '(' oneOrMoreParameters ')' optRaises block
 {
+  deTemplateAddCompactFunction(deFunctionGetTemplate(deBlockGetOwningFunction(deCurrentBlock)));
   deCurrentBlock = deBlockGetOwningBlock(deCurrentBlock);
 }
 | exportClassHeader '(' oneOrMoreParameters ')' optRaises block
 {
   deFunction constructor = deBlockGetOwningFunction(deCurrentBlock);
+  deTemplateAddCompactFunction(deFunctionGetTemplate(constructor));
   deCreateFullySpecifiedSignature(constructor);
   deCurrentBlock = deBlockGetOwningBlock(deCurrentBlock);
 }
 
-classHeader: KWCLASS IDENT optWidth
+classHeader: optPacked KWCLASS IDENT optWidth
 {
   deFunction constructor = deFunctionCreate(deCurrentFilepath, deCurrentBlock,
-      DE_FUNC_CONSTRUCTOR, $2, DE_LINK_MODULE, $1);
+      DE_FUNC_CONSTRUCTOR, $3, DE_LINK_MODULE, $2);
   deFunctionSetInUnitTest(constructor, deInUnitTest);
-  deTemplateCreate(constructor, $3, $1);
+  deTemplate templ = deTemplateCreate(constructor, $4, $2);
+  deTemplateSetPacked(templ, $1);
   deCurrentBlock = deFunctionGetSubBlock(constructor);
 }
 
+optPacked:  // Empty
+{
+  $$ = false;
+}
+| KWPACKED
+{
+  $$ = true;  // Store scalar data members in one array of tuples.
+}
+
 optWidth:  // Empty
 {
-  $$ = 32;  // Default to 32 bit reference width by default.
+  $$ = 0;  // deTemplateCreate defaults this to 32 bits.
 }
 | ':' UINTTYPE
 {
@@ -459,28 +498,31 @@ optWidth:  // Empty
   $$ = $2;
 }
 
-exportClassHeader: KWEXPORT KWCLASS IDENT optWidth  // Means the constructor is in package API.
+exportClassHeader: KWEXPORT optPacked KWCLASS IDENT optWidth  // Means the constructor is in package API.
 {
   deFunction constructor = deFunctionCreate(deCurrentFilepath, deCurrentBlock,
-      DE_FUNC_CONSTRUCTOR, $3, DE_LINK_PACKAGE, $1);
+      DE_FUNC_CONSTRUCTOR, $4, DE_LINK_PACKAGE, $1);
   deFunctionSetInUnitTest(constructor, deInUnitTest);
-  deTemplateCreate(constructor, $4, $1);
+  deTemplate templ = deTemplateCreate(constructor, $5, $1);
+  deTemplateSetPacked(templ, $2);
   deCurrentBlock = deFunctionGetSubBlock(constructor);
 }
-| KWEXPORTLIB KWCLASS IDENT optWidth  // Means the constructor is a libcall.
+| KWEXPORTLIB optPacked KWCLASS IDENT optWidth  // Means the constructor is a libcall.
 {
   deFunction constructor = deFunctionCreate(deCurrentFilepath, deCurrentBlock,
-      DE_FUNC_CONSTRUCTOR, $3, DE_LINK_LIBCALL, $1);
+      DE_FUNC_CONSTRUCTOR, $4, DE_LINK_LIBCALL, $1);
   deFunctionSetInUnitTest(constructor, deInUnitTest);
-  deTemplateCreate(constructor, $4, $1);
+  deTemplate templ = deTemplateCreate(constructor, $5, $1);
+  deTemplateSetPacked(templ, $2);
   deCurrentBlock = deFunctionGetSubBlock(constructor);
 }
-| KWRPC KWCLASS IDENT optWidth  // Means the constructor is an RPC call.
+| KWRPC optPacked KWCLASS IDENT optWidth  // Means the constructor is an RPC call.
 {
   deFunction constructor = deFunctionCreate(deCurrentFilepath, deCurrentBlock,
-      DE_FUNC_CONSTRUCTOR, $3, DE_LINK_RPC, $1);
+      DE_FUNC_CONSTRUCTOR, $4, DE_LINK_RPC, $1);
   deFunctionSetInUnitTest(constructor, deInUnitTest);
-  deTemplateCreate(constructor, $4, $1);
+  deTemplate templ = deTemplateCreate(constructor, $5, $1);
+  deTemplateSetPacked(templ, $2);
   deCurrentBlock = deFunctionGetSubBlock(constructor);
 }
 
@@ -569,6 +611,7 @@ appendCodeHeader: KWAPPENDCODE pathExpression
       deError($1, "Identifier is not a class or function", deIdentGetName(ident));
     }
     deSavedBlock = deCurrentBlock;
+    deParsedOutsideModule = true;
     deCurrentBlock = deIdentGetSubBlock(ident);
   }
 }
@@ -585,6 +628,7 @@ appendCodeHeader: KWAPPENDCODE pathExpression
       deError( $1, "Cannot append code inside another append/prepend statement");
     }
     deSavedBlock = deCurrentBlock;
+    deParsedOutsideModule = true;
     deCurrentBlock = deFilepathGetModuleBlock(deBlockGetFilepath(deCurrentBlock));
   }
 }
@@ -623,6 +667,7 @@ prependCodeHeader: KWPREPENDCODE pathExpression
               deIdentGetName(ident));
     }
     deSavedBlock = deCurrentBlock;
+    deParsedOutsideModule = true;
     deCurrentBlock = deIdentGetSubBlock(ident);
     deLastStatement = deBlockGetLastStatement(deCurrentBlock);
   }
@@ -640,6 +685,7 @@ prependCodeHeader: KWPREPENDCODE pathExpression
       deError( $1, "Cannot prepend code inside another append/prepend statement");
     }
     deSavedBlock = deCurrentBlock;
+    deParsedOutsideModule = true;
     deCurrentBlock = deFilepathGetModuleBlock(deBlockGetFilepath(deCurrentBlock));
     deLastStatement = deBlockGetLastStatement(deCurrentBlock);
   }
@@ -656,6 +702,9 @@ function: functionHeader '(' parameters ')' optFuncTypeExpression optRaises bloc
   if (deFunctionGetType(function) == DE_FUNC_OPERATOR) {
     checkOperatorFunction(function);
   }
+  if (deFunctionUnsafe(function)) {
+    deUnsafeDepth--;
+  }
   deCurrentBlock = deFunctionGetBlock(function);
   deInIterator = false;
 }
@@ -689,6 +738,15 @@ functionHeader: KWFUNC IDENT
   deFunctionSetInUnitTest(function, deInUnitTest);
   deCurrentBlock = deFunctionGetSubBlock(function);
 }
+| KWUNSAFE KWFUNC IDENT
+{
+  deFunction function = deFunctionCreate(deCurrentFilepath, deCurrentBlock,
+      DE_FUNC_PLAIN, $3, DE_LINK_MODULE, $1);
+  deFunctionSetInUnitTest(function, deInUnitTest);
+  deFunctionSetUnsafe(function, true);
+  deUnsafeDepth++;
+  deCurrentBlock = deFunctionGetSubBlock(function);
+}
 | KWITERATOR IDENT
 {
   deFunction function = deFunctionCreate(deCurrentFilepath, deCurrentBlock,
@@ -944,6 +1002,20 @@ ifStatementHeader: KWIF
   createBlockStatement(DE_STATEMENT_IF, $1);
 }
 
+// Objects created in an arena block are freed together when it ends.  The
+// block runs once, as if true { ... }, and deExpandArenaStatements adds the
+// code that saves and restores the class allocators.
+arenaStatement: arenaStatementHeader block
+{
+  finishBlockStatement(deBoolExpressionCreate(true, $1));
+}
+
+arenaStatementHeader: KWARENA
+{
+  deStatement statement = createBlockStatement(DE_STATEMENT_IF, $1);
+  deStatementSetArena(statement, true);
+}
+
 elseIfParts: // Empty
 | elseIfParts elseIfPart
 
@@ -1296,6 +1368,10 @@ typeRangeExpressionList: typeRangeExpression
 }
 
 basicTypeExpression: typePathExpression
+| KWVECTOROF '(' typeExpression ',' expression ')'
+{
+  $$ = deBinaryExpressionCreate(DE_EXPR_VECTOROF, $3, $5, $1);
+}
 | KWTYPEOF '(' expression ')'
 {
   $$ = deUnaryExpressionCreate(DE_EXPR_TYPEOF, $3, $1);
@@ -1384,6 +1460,10 @@ accessExpression: writableExpression
 {
   $$ = deUnaryExpressionCreate(DE_EXPR_ARRAYOF, $3, $1);
 }
+| KWARRAYOF '(' typeExpression ',' expression ')'
+{
+  $$ = deBinaryExpressionCreate(DE_EXPR_ARRAYOF, $3, $5, $1);
+}
 | KWTYPEOF '(' expression ')'
 {
   $$ = deUnaryExpressionCreate(DE_EXPR_TYPEOF, $3, $1);
@@ -1722,6 +1802,17 @@ unnamedUnitTestHeader: KWUNITTEST
   }
 }
 
+// Statements in an unsafe block are generated without runtime safety checks.
+unsafeStatement: unsafeHeader block
+{
+  deUnsafeDepth--;
+}
+
+unsafeHeader: KWUNSAFE
+{
+  deUnsafeDepth++;
+}
+
 debugStatement: debugHeader block
 {
   if (!deDebugMode) {
@@ -1782,6 +1873,12 @@ foreachStatement: forStatementHeader IDENT KWIN expression block
   finishBlockStatement(expr);
 }
 
+// Iterations of a parallel for statement run concurrently on the runtime's thread pool.
+parallelForeachStatement: KWPARALLEL foreachStatement
+{
+  deStatementSetParallel(deBlockGetLastStatement(deCurrentBlock), true);
+}
+
 finalFunction: finalHeader '(' parameter ')' optRaises block
 {
   deFunction function = deBlockGetOwningFunction(deCurrentBlock);
@@ -2095,6 +2192,10 @@ typeLiteral: UINTTYPE
   $$ = deExpressionCreate(DE_EXPR_FLOATTYPE, deCurrentLine);
   deExpressionSetWidth($$, 64);
 }
+| VECTORTYPE
+{
+  $$ = createVectorTypeExpression($1, deCurrentLine);
+}
 
 pathExpression: IDENT
 {
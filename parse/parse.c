@@ -20,6 +20,10 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #endif
 
 #include "parse.h"
@@ -27,6 +31,34 @@
 deRoot deTheRoot;
 uint32 deDumpIndentLevel;
 bool deUnsafeMode;
+// Statements are created unsafe while this is non-zero, in unsafe functions,
+// unsafe blocks, and modules listed in deUnsafeModules.
+uint32 deUnsafeDepth;
+// Comma separated names of modules to compile without safety checks.
+char *deUnsafeModules;
+bool deReserveFieldArrays;
+bool deBitPackFields;
+// Set by -prefetch: how many links ahead linked traversals prefetch.
+uint32 dePrefetchDistance;
+deLayout deClassLayout;
+// Set by -profile to count data member accesses in the generated program.
+bool deProfileFields;
+// Set by -heapprofile to tell the runtime which line is running, for sampled
+// allocation profiles.
+bool deHeapProfile;
+// Set by -instrument to count calls, loop trips and runtime overheads.
+bool deInstrumentCode;
+// Set by -time-report to time each phase of the compiler.
+bool deTimeReport;
+// Set by -coroutines to call large iterators as coroutines instead of inlining them.
+bool deCoroutineIterators;
+// Set by -unwind to lower try statements to invoke and landingpad instead of setjmp.
+bool deUnwindExceptions;
+// Set by -nativeints to lower integers of up to 512 bits to LLVM integers.
+bool deNativeWideInts;
+// Set by -cache, or $RUNE_CACHE, to cache syntax trees of builtin and package modules.
+char *deParseCacheDir;
+uint32 deParseJobs;
 bool deDebugMode;
 bool deLogTokens;
 bool deInvertReturnCode;
@@ -289,16 +321,23 @@ static char *createPackagePathToModule(deBlock packageBlock,
   return fileName;
 }
 
-// Handle a use statement.
-static void loadImportStatement(deStatement statement, deBlock packageBlock) {
+// Parse the module imported by the statement.  Set |alias| to what the
+// importing module calls it.
+static deBlock parseImportedModule(deStatement statement, deBlock packageBlock, utSym *alias) {
   deLine importLine = deStatementGetLine(statement);
   deExpression pathExpr;
-  utSym alias = getPathExpressionAndAlias(deStatementGetExpression(statement), &pathExpr);
-  deBlock moduleBlock;
+  *alias = getPathExpressionAndAlias(deStatementGetExpression(statement), &pathExpr);
   deBlock destPackageBlock;
   char *fileName = createPackagePathToModule(packageBlock, pathExpr, &destPackageBlock);
-  moduleBlock = deParseModule(fileName, destPackageBlock, false, importLine);
+  deBlock moduleBlock = deParseModule(fileName, destPackageBlock, false, importLine);
   utFree(fileName);
+  return moduleBlock;
+}
+
+// Handle a use statement.
+static void loadImportStatement(deStatement statement, deBlock packageBlock) {
+  utSym alias;
+  deBlock moduleBlock = parseImportedModule(statement, packageBlock, &alias);
   // Now import just one identifier.
   deBlock destBlock = deStatementGetBlock(statement);
   deFunction moduleFunction = deBlockGetOwningFunction(moduleBlock);
@@ -306,8 +345,64 @@ static void loadImportStatement(deStatement statement, deBlock packageBlock) {
   deIdentSetImported(newIdent, true);
 }
 
+#ifndef _WIN32
+// Parse the modules imported by |moduleBlock| in up to deParseJobs child
+// processes, which write their syntax trees to the parse cache.  The imports
+// are then loaded from the cache one at a time, as usual.  A child that fails
+// is ignored: the parent parses that module again, and reports the error.
+static void parseImportsInParallel(deBlock packageBlock, deBlock moduleBlock) {
+  if (deParseJobs <= 1 || deParseCacheDir == NULL || *deParseCacheDir == '\0') {
+    return;
+  }
+  uint32 numImports = 0;
+  deStatement statement;
+  deForeachBlockStatement(moduleBlock, statement) {
+    if (deStatementGetType(statement) == DE_STATEMENT_IMPORT) {
+      numImports++;
+    }
+  } deEndBlockStatement;
+  if (numImports < 2) {
+    return;
+  }
+  fflush(stdout);
+  fflush(stderr);
+  uint32 numRunning = 0;
+  deForeachBlockStatement(moduleBlock, statement) {
+    if (deStatementGetType(statement) == DE_STATEMENT_IMPORT) {
+      if (numRunning == deParseJobs) {
+        if (wait(NULL) > 0) {
+          numRunning--;
+        }
+      }
+      pid_t pid = fork();
+      if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull >= 0) {
+          dup2(devNull, STDOUT_FILENO);
+          dup2(devNull, STDERR_FILENO);
+        }
+        deParseJobs = 1;
+        deTimeReport = false;
+        utSym alias;
+        parseImportedModule(statement, packageBlock, &alias);
+        _exit(0);
+      }
+      if (pid > 0) {
+        numRunning++;
+      }
+    }
+  } deEndBlockStatement;
+  while (numRunning != 0 && wait(NULL) > 0) {
+    numRunning--;
+  }
+}
+#endif
+
 // Load all the imported modules and packages.
 static void loadImports(deBlock packageBlock, deBlock moduleBlock) {
+#ifndef _WIN32
+  parseImportsInParallel(packageBlock, moduleBlock);
+#endif
   deStatement statement;
   deForeachBlockStatement(moduleBlock, statement) {
     switch (deStatementGetType(statement)) {
@@ -347,6 +442,15 @@ static void parseFile(char *fileName, char *fullName) {
   deCurrentFileName = NULL;
 }
 
+// Parse the file, unless its syntax tree is in the cache.
+static void parseOrLoadFile(char *fileName, char *fullName) {
+  if (deStartCachedParse(fullName)) {
+    return;
+  }
+  parseFile(fileName, fullName);
+  deFinishCachedParse(fullName);
+}
+
 // Execute module relations.
 static void executeModuleRelations(deBlock moduleBlock) {
   deStatement statement;
@@ -359,6 +463,28 @@ static void executeModuleRelations(deBlock moduleBlock) {
   } deEndSafeBlockStatement;
 }
 
+// Determine if the module is listed in deUnsafeModules.
+static bool moduleIsUnsafe(utSym moduleName) {
+  if (deUnsafeModules == NULL) {
+    return false;
+  }
+  char *name = utSymGetName(moduleName);
+  size_t len = strlen(name);
+  char *p = deUnsafeModules;
+  while (*p != '\0') {
+    char *end = strchr(p, ',');
+    size_t entryLen = end == NULL? strlen(p) : (size_t)(end - p);
+    if (entryLen == len && !strncmp(p, name, len)) {
+      return true;
+    }
+    if (end == NULL) {
+      break;
+    }
+    p = end + 1;
+  }
+  return false;
+}
+
 // Parse the Rune file into a module.  |currentBlock| should be the package
 // initializer function that will call this module's initializer function.
 deBlock deParseModule(char *fileName, deBlock packageBlock, bool isMainModule, deLine importLine) {
@@ -393,7 +519,22 @@ deBlock deParseModule(char *fileName, deBlock packageBlock, bool isMainModule, d
   deParsingMainModule = isMainModule;
   deCurrentBlock = newModuleBlock;
   deFilepathInsertModuleBlock(filepath, deCurrentBlock);
-  parseFile(fileName, fullName);
+  bool unsafeModule = moduleIsUnsafe(moduleName);
+  if (unsafeModule) {
+    deUnsafeDepth++;
+  }
+  double startTime = deTimeReport? deWallTime() : 0.0;
+  if (isMainModule) {
+    parseFile(fileName, fullName);
+  } else {
+    parseOrLoadFile(fileName, fullName);
+  }
+  if (deTimeReport) {
+    deTimeReportAddModule(fullName, deWallTime() - startTime);
+  }
+  if (unsafeModule) {
+    deUnsafeDepth--;
+  }
   deCurrentFilepath = deFilepathNull;
   deParsingMainModule = false;
   loadImports(packageBlock, newModuleBlock);
@@ -432,7 +573,11 @@ static void parseBuiltinFile(char *dirName, char *fileName) {
   deCurrentBlock = deRootGetBlock(deTheRoot);
   deCurrentFilepath = deFilepathCreate(fullName, deFilepathNull, false);
   deFilepathInsertModuleBlock(deCurrentFilepath, deCurrentBlock);
-  parseFile(fileName, fullName);
+  double startTime = deTimeReport? deWallTime() : 0.0;
+  parseOrLoadFile(fileName, fullName);
+  if (deTimeReport) {
+    deTimeReportAddModule(fullName, deWallTime() - startTime);
+  }
   deCurrentFilepath = deFilepathNull;
   deCurrentBlock = deBlockNull;
   utFree(fullName);
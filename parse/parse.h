@@ -40,4 +40,9 @@ extern deFilepath deCurrentFilepath;
 extern bool deInTransformer;
 extern bool deParsingMainModule;
 
+// Syntax tree cache, in cache.c.
+extern bool deParsedOutsideModule;
+bool deStartCachedParse(char *fullName);
+void deFinishCachedParse(char *fullName);
+
 #endif  // THIRD_PARTY_RUNE_PARSE_PARSE_H_
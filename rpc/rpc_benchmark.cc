@@ -0,0 +1,282 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measure Sealed Computing RPC encoding and decoding throughput on
+// representative messages, and report messages/s and MB/s of encoded data.
+// Usage: rpc_benchmark [seconds per case]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "base/init_google.h"
+#include "third_party/sealedcomputing/rpc/rpc.h"
+
+namespace {
+
+constexpr uint32_t kLargeBytes = 64 * 1024;
+constexpr uint32_t kNumStrings = 256;
+constexpr uint32_t kStringBytes = 32;
+constexpr uint32_t kSecretBytes = 1024;
+constexpr uint32_t kNumEnums = 4096;
+
+// An encoded message, with its public and secret streams.
+struct Message {
+  std::string public_data;
+  std::string secret_data;
+};
+
+// A benchmark case encodes into two contexts, and decodes from two contexts,
+// returning false if the message does not decode.
+struct Case {
+  const char* name;
+  std::function<void(RpcEncoderContext*, RpcEncoderContext*)> encode;
+  std::function<bool(RpcDecoderContext*, RpcDecoderContext*)> decode;
+};
+
+// Keep the optimizer from dropping decoded values.
+volatile uint64_t sink;
+
+std::string FinishEncoding(RpcEncoderContext* ctx) {
+  uint8_t* buf;
+  RpcLengthType len;
+  rpcFinishEncoding(ctx, &buf, &len);
+  std::string result(reinterpret_cast<char*>(buf), len);
+  rpcFreeEncoderContext(ctx);
+  return result;
+}
+
+Message Encode(const Case& c) {
+  RpcEncoderContext public_ctx, secret_ctx;
+  rpcInitEncoderContext(&public_ctx, true);
+  rpcInitEncoderContext(&secret_ctx, false);
+  c.encode(&public_ctx, &secret_ctx);
+  Message message;
+  message.public_data = FinishEncoding(&public_ctx);
+  message.secret_data = FinishEncoding(&secret_ctx);
+  return message;
+}
+
+bool Decode(const Case& c, const Message& message) {
+  RpcDecoderContext public_ctx, secret_ctx;
+  rpcInitDecoderContext(&public_ctx, true,
+      reinterpret_cast<uint8_t*>(const_cast<char*>(message.public_data.data())),
+      message.public_data.length());
+  rpcInitDecoderContext(&secret_ctx, false,
+      reinterpret_cast<uint8_t*>(const_cast<char*>(message.secret_data.data())),
+      message.secret_data.length());
+  bool ok = c.decode(&public_ctx, &secret_ctx) && rpcFinishDecoding(&public_ctx) &&
+      rpcFinishDecoding(&secret_ctx);
+  rpcFreeDecoderContext(&public_ctx);
+  rpcFreeDecoderContext(&secret_ctx);
+  return ok;
+}
+
+// Encode a string the way rpc_encoding.c does: a length and the bytes.
+void EncodeBytes(RpcEncoderContext* ctx, uint32_t len, uint8_t seed) {
+  rpcEncodeStartArray(ctx, len);
+  for (uint32_t i = 0; i < len; i++) {
+    rpcEncodeU8(ctx, static_cast<uint8_t>(seed + i));
+  }
+  rpcEncodeFinishArray(ctx);
+}
+
+bool DecodeBytes(RpcDecoderContext* ctx) {
+  RpcLengthType len;
+  if (!rpcDecodeStartArray(ctx, &len)) {
+    return false;
+  }
+  uint64_t sum = 0;
+  for (RpcLengthType i = 0; i < len; i++) {
+    uint8_t byte;
+    if (!rpcDecodeU8(ctx, &byte)) {
+      return false;
+    }
+    sum += byte;
+  }
+  sink = sum;
+  return rpcDecodeFinishArray(ctx);
+}
+
+// ((u32, (u16, f64)), (i64, (u8, f32)))
+void EncodeNestedTuple(RpcEncoderContext* ctx, RpcEncoderContext*) {
+  rpcEncodeStartStructure(ctx);
+  rpcEncodeStartStructure(ctx);
+  rpcEncodeU32(ctx, 123456789);
+  rpcEncodeStartStructure(ctx);
+  rpcEncodeU16(ctx, 4321);
+  rpcEncodeF64(ctx, 3.141592);
+  rpcEncodeFinishStructure(ctx);
+  rpcEncodeFinishStructure(ctx);
+  rpcEncodeStartStructure(ctx);
+  rpcEncodeS64(ctx, -123456789012345);
+  rpcEncodeStartStructure(ctx);
+  rpcEncodeU8(ctx, 255);
+  rpcEncodeF32(ctx, 2.718f);
+  rpcEncodeFinishStructure(ctx);
+  rpcEncodeFinishStructure(ctx);
+  rpcEncodeFinishStructure(ctx);
+}
+
+bool DecodeNestedTuple(RpcDecoderContext* ctx, RpcDecoderContext*) {
+  uint32_t a = 0;
+  uint16_t b = 0;
+  double c = 0.0;
+  int64_t d = 0;
+  uint8_t e = 0;
+  float f = 0.0f;
+  rpcDecodeStartStructure(ctx);
+  rpcDecodeStartStructure(ctx);
+  bool ok = rpcDecodeU32(ctx, &a);
+  rpcDecodeStartStructure(ctx);
+  ok = ok && rpcDecodeU16(ctx, &b) && rpcDecodeF64(ctx, &c);
+  rpcDecodeFinishStructure(ctx);
+  rpcDecodeFinishStructure(ctx);
+  rpcDecodeStartStructure(ctx);
+  ok = ok && rpcDecodeS64(ctx, &d);
+  rpcDecodeStartStructure(ctx);
+  ok = ok && rpcDecodeU8(ctx, &e) && rpcDecodeF32(ctx, &f);
+  rpcDecodeFinishStructure(ctx);
+  rpcDecodeFinishStructure(ctx);
+  rpcDecodeFinishStructure(ctx);
+  sink = a + b + static_cast<uint64_t>(c) + d + e + static_cast<uint64_t>(f);
+  return ok;
+}
+
+// [u8] of kLargeBytes.
+void EncodeLargeBytes(RpcEncoderContext* ctx, RpcEncoderContext*) {
+  EncodeBytes(ctx, kLargeBytes, 0);
+}
+
+bool DecodeLargeBytes(RpcDecoderContext* ctx, RpcDecoderContext*) {
+  return DecodeBytes(ctx);
+}
+
+// [string] of kNumStrings strings.
+void EncodeStrings(RpcEncoderContext* ctx, RpcEncoderContext*) {
+  rpcEncodeStartArray(ctx, kNumStrings);
+  for (uint32_t i = 0; i < kNumStrings; i++) {
+    EncodeBytes(ctx, kStringBytes, static_cast<uint8_t>(i));
+  }
+  rpcEncodeFinishArray(ctx);
+}
+
+bool DecodeStrings(RpcDecoderContext* ctx, RpcDecoderContext*) {
+  RpcLengthType len;
+  if (!rpcDecodeStartArray(ctx, &len)) {
+    return false;
+  }
+  for (RpcLengthType i = 0; i < len; i++) {
+    if (!DecodeBytes(ctx)) {
+      return false;
+    }
+  }
+  return rpcDecodeFinishArray(ctx);
+}
+
+// (string, secret(string)), as in EchoMixed.
+void EncodeSecretFields(RpcEncoderContext* public_ctx, RpcEncoderContext* secret_ctx) {
+  rpcEncodeStartStructure(public_ctx);
+  rpcEncodeStartStructure(secret_ctx);
+  EncodeBytes(public_ctx, kSecretBytes, 1);
+  EncodeBytes(secret_ctx, kSecretBytes, 2);
+  rpcEncodeFinishStructure(public_ctx);
+  rpcEncodeFinishStructure(secret_ctx);
+}
+
+bool DecodeSecretFields(RpcDecoderContext* public_ctx, RpcDecoderContext* secret_ctx) {
+  rpcDecodeStartStructure(public_ctx);
+  rpcDecodeStartStructure(secret_ctx);
+  bool ok = DecodeBytes(public_ctx) && DecodeBytes(secret_ctx);
+  rpcDecodeFinishStructure(public_ctx);
+  rpcDecodeFinishStructure(secret_ctx);
+  return ok;
+}
+
+// [Color], a u16 enum with several values, as in EnumToStringService.
+void EncodeEnums(RpcEncoderContext* ctx, RpcEncoderContext*) {
+  rpcEncodeStartArray(ctx, kNumEnums);
+  for (uint32_t i = 0; i < kNumEnums; i++) {
+    rpcEncodeU16(ctx, static_cast<uint16_t>(i % 7));
+  }
+  rpcEncodeFinishArray(ctx);
+}
+
+bool DecodeEnums(RpcDecoderContext* ctx, RpcDecoderContext*) {
+  RpcLengthType len;
+  if (!rpcDecodeStartArray(ctx, &len)) {
+    return false;
+  }
+  uint64_t sum = 0;
+  for (RpcLengthType i = 0; i < len; i++) {
+    uint16_t value;
+    if (!rpcDecodeU16(ctx, &value) || value >= 7) {
+      return false;
+    }
+    sum += value;
+  }
+  sink = sum;
+  return rpcDecodeFinishArray(ctx);
+}
+
+// Run |func| until |seconds| have passed, and return the calls per second.
+double Measure(double seconds, const std::function<void()>& func) {
+  using Clock = std::chrono::steady_clock;
+  uint64_t calls = 0;
+  uint64_t batch = 1;
+  auto start = Clock::now();
+  double elapsed = 0.0;
+  while (elapsed < seconds) {
+    for (uint64_t i = 0; i < batch; i++) {
+      func();
+    }
+    calls += batch;
+    batch *= 2;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  return calls / elapsed;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  InitGoogle(argv[0], &argc, &argv, true);
+  double seconds = argc > 1 ? std::strtod(argv[1], nullptr) : 1.0;
+  std::vector<Case> cases = {
+      {"nested tuples", EncodeNestedTuple, DecodeNestedTuple},
+      {"large [u8]", EncodeLargeBytes, DecodeLargeBytes},
+      {"[string]", EncodeStrings, DecodeStrings},
+      {"secret fields", EncodeSecretFields, DecodeSecretFields},
+      {"[enum]", EncodeEnums, DecodeEnums},
+  };
+  std::printf("%-14s %8s %14s %10s %14s %10s\n", "case", "bytes", "encode msg/s",
+              "MB/s", "decode msg/s", "MB/s");
+  for (const Case& c : cases) {
+    Message message = Encode(c);
+    if (!Decode(c, message)) {
+      std::fprintf(stderr, "Failed to decode %s\n", c.name);
+      return 1;
+    }
+    double bytes = message.public_data.length() + message.secret_data.length();
+    double encode_rate = Measure(seconds, [&c]() { Encode(c); });
+    double decode_rate = Measure(seconds, [&c, &message]() { Decode(c, message); });
+    std::printf("%-14s %8.0f %14.0f %10.1f %14.0f %10.1f\n", c.name, bytes, encode_rate,
+                encode_rate * bytes / 1e6, decode_rate, decode_rate * bytes / 1e6);
+  }
+  return 0;
+}
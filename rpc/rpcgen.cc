@@ -21,12 +21,14 @@
 
 int main(int argc, char **argv) {
   InitGoogle(argv[0], &argc, &argv, true);
-  if (argc != 5) {
+  if (argc != 5 && argc != 6) {
     std::cout << "Usage: genrpc your.proto output.h output_client.cc "
-                 "output_server.cc\n";
+                 "output_server.cc [output_rune_decoder.h]\n";
     return 1;
   }
+  char *rune_decoder_file = argc == 6 ? argv[5] : nullptr;
   deGenCCRpcCode(const_cast<char *>(argv[1]), const_cast<char *>(argv[2]),
-                 const_cast<char *>(argv[3]), const_cast<char *>(argv[4]));
+                 const_cast<char *>(argv[3]), const_cast<char *>(argv[4]),
+                 rune_decoder_file);
   return 0;
 }
@@ -145,6 +145,7 @@ static void appendDatatypeString(deString string, deDatatype datatype) {
     case DE_TYPE_TEMPLATE:
     case DE_TYPE_FUNCTION:
     case DE_TYPE_ENUMCLASS:
+    case DE_TYPE_VECTOR:
     case DE_TYPE_EXPR:
       utExit("Unexpected datatype");
   }
@@ -294,6 +295,7 @@ static void declareDatatype(deString headerTop, deDatatype datatype, deLine line
     case DE_TYPE_NONE:
     case DE_TYPE_MODINT:
     case DE_TYPE_ENUMCLASS:
+    case DE_TYPE_VECTOR:
     case DE_TYPE_EXPR:
       utExit("Unexpected datatype in RPC call");
   }
@@ -484,9 +486,117 @@ static void declareDecodeResponse(deString headerBot, deSignature signature) {
       funcName, findSectypeName(sectype));
 }
 
+// Declare the struct holding the parameters of one call in a batch.
+static void declareBatchRequest(deString headerBot, deSignature signature) {
+  deFunction function = deSignatureGetFunction(signature);
+  deStringSprintf(headerBot,
+      "// The parameters of one %1$s call in a batch.\n"
+      "struct %1$sRequest {\n",
+      deFunctionGetName(function));
+  deString typeString = deMutableStringCreate();
+  deVariable param = deBlockGetFirstVariable(deFunctionGetSubBlock(function));
+  deParamspec paramspec;
+  deForeachSignatureParamspec(signature, paramspec) {
+    deDatatype datatype = deParamspecGetDatatype(paramspec);
+    deStringSetUsed(typeString, 0);
+    appendDatatypeString(typeString, datatype);
+    char *initializer = findDatatypeInitializer(datatype);
+    if (initializer == NULL) {
+      deStringSprintf(headerBot, "  %s %s;\n",
+          deStringGetCstr(typeString), deVariableGetName(param));
+    } else {
+      deStringSprintf(headerBot, "  %s %s = %s;\n",
+          deStringGetCstr(typeString), deVariableGetName(param), initializer);
+    }
+    param = deVariableGetNextBlockVariable(param);
+  } deEndSignatureParamspec;
+  deStringDestroy(typeString);
+  deStringPuts(headerBot, "};\n\n");
+}
+
+// Append the result type of a batch: the responses in order, or just a status
+// if the RPC returns nothing.
+static void appendBatchResultType(deString string, deSignature signature) {
+  deDatatype returnType = deSignatureGetReturnType(signature);
+  if (returnType == deNoneDatatypeCreate()) {
+    deStringPuts(string, "sealed::wasm::Status");
+    return;
+  }
+  deStringPuts(string, "sealed::wasm::StatusOr<std::vector<");
+  appendDatatypeString(string, returnType);
+  deStringPuts(string, ">>");
+}
+
+// Declare the function that calls the RPC once per request in one round trip.
+static void declareBatchFunction(deString headerBot, deSignature signature, bool socket) {
+  appendBatchResultType(headerBot, signature);
+  char *funcName = deFunctionGetName(deSignatureGetFunction(signature));
+  deStringSprintf(headerBot, " %1$sBatch(const std::vector<%1$sRequest>& requests", funcName);
+  if (socket) {
+    deStringPuts(headerBot, ", wasm::Socket* socket");
+  }
+  deStringPuts(headerBot, ")");
+}
+
+// Declare the function encoding a batch of requests.  Batches always use both
+// streams, and the request count is in the public one.
+static void declareEncodeBatchRequest(deString headerBot, deSignature signature) {
+  deStringSprintf(headerBot,
+      "sealed::wasm::EncodedMessage Encode%1$sBatchRequest("
+      "const std::vector<%1$sRequest>& requests)",
+      deFunctionGetName(deSignatureGetFunction(signature)));
+}
+
+// Declare the function decoding a batch of responses.
+static void declareDecodeBatchResponse(deString headerBot, deSignature signature) {
+  appendBatchResultType(headerBot, signature);
+  deStringSprintf(headerBot,
+      " Decode%sBatchResponse(const sealed::wasm::EncodedMessage& encoded_response, "
+      "size_t num_requests)",
+      deFunctionGetName(deSignatureGetFunction(signature)));
+}
+
+// Declare the pipeline class, which queues calls and sends them in batches.
+static void declarePipelineClass(deString headerBot, deSignature signature) {
+  deFunction function = deSignatureGetFunction(signature);
+  char *funcName = deFunctionGetName(function);
+  deDatatype returnType = deSignatureGetReturnType(signature);
+  deStringSprintf(headerBot,
+      "// Queues %1$s calls on one socket, and sends them in batches of up to\n"
+      "// |max_outstanding|, so many calls share each round trip.\n"
+      "class %1$sPipeline {\n"
+      " public:\n"
+      "  %1$sPipeline(wasm::Socket* socket, size_t max_outstanding)\n"
+      "      : socket_(socket), max_outstanding_(max_outstanding) {}\n"
+      "  // Queue a call, first sending the queued calls if the queue is full.\n"
+      "  sealed::wasm::Status Call(",
+      funcName);
+  declareFunctionParams(headerBot, function, signature);
+  deStringPuts(headerBot,
+      ");\n"
+      "  // Send the queued calls, and return the responses of every call in order.\n"
+      "  ");
+  appendBatchResultType(headerBot, signature);
+  deStringSprintf(headerBot,
+      " Finish();\n\n"
+      " private:\n"
+      "  sealed::wasm::Status Flush();\n\n"
+      "  wasm::Socket* socket_;\n"
+      "  size_t max_outstanding_;\n"
+      "  std::vector<%sRequest> pending_;\n",
+      funcName);
+  if (returnType != deNoneDatatypeCreate()) {
+    deStringPuts(headerBot, "  std::vector<");
+    appendDatatypeString(headerBot, returnType);
+    deStringPuts(headerBot, "> responses_;\n");
+  }
+  deStringPuts(headerBot, "};\n");
+}
+
 // Generate the C header file for both client and server of RPCs.
 static void genHeaderCode(deString header, deSignature signature, deLine line) {
   declareSignatureDatatypes(header, signature, line);
+  declareBatchRequest(header, signature);
   deStringPuts(header, "namespace client {\n");
   declareSignatureSocketFunction(header, signature);
   deStringPuts(header, ";\n");
@@ -495,7 +605,17 @@ static void genHeaderCode(deString header, deSignature signature, deLine line) {
   declareEncodeRequest(header, signature);
   deStringPuts(header, ";\n");
   declareDecodeResponse(header, signature);
-  deStringPuts(header, ";\n}  // namespace client\n");
+  deStringPuts(header, ";\n");
+  declareBatchFunction(header, signature, true);
+  deStringPuts(header, ";\n");
+  declareBatchFunction(header, signature, false);
+  deStringPuts(header, ";\n");
+  declareEncodeBatchRequest(header, signature);
+  deStringPuts(header, ";\n");
+  declareDecodeBatchResponse(header, signature);
+  deStringPuts(header, ";\n");
+  declarePipelineClass(header, signature);
+  deStringPuts(header, "}  // namespace client\n");
 
   deStringPuts(header, "namespace server {\n");
   declareSignatureFunction(header, signature);
@@ -750,6 +870,7 @@ static void decodeParameter(deString server, deString lexpr, deDatatype datatype
     case DE_TYPE_TEMPLATE:
     case DE_TYPE_MODINT:
     case DE_TYPE_ENUMCLASS:
+    case DE_TYPE_VECTOR:
     case DE_TYPE_EXPR:
       utExit("Unexpected datatype in RPC call");
   }
@@ -882,6 +1003,7 @@ static void encodeParameter(deString server, deString expr, deDatatype datatype)
     case DE_TYPE_TEMPLATE:
     case DE_TYPE_MODINT:
     case DE_TYPE_ENUMCLASS:
+    case DE_TYPE_VECTOR:
     case DE_TYPE_EXPR:
       utExit("Unexpected datatype in RPC call");
   }
@@ -1058,6 +1180,70 @@ static void genDecodeRequest(deString server, deSignature signature) {
   deStringPuts(server, "  return ::sealed::wasm::Status();\n}\n");
 }
 
+// Generate the code to decode each request in a batch, call the handler, and
+// encode its response.
+static void genServeBatch(deString server, deSignature signature) {
+  deFunction function = deSignatureGetFunction(signature);
+  char *funcName = deFunctionGetName(function);
+  deStringSprintf(server,
+      "\n"
+      "// Decode a batch of %1$s requests, call the handler on each, and encode the\n"
+      "// responses in order.  The first failed call fails the whole batch.\n"
+      "static ::sealed::wasm::StatusOr<EncodedMessage> Serve%1$sBatch(\n"
+      "    const ByteString& encoded_request, const SecretByteString& encoded_request_secret) {\n"
+      "  Decoder public_decoder(encoded_request);\n"
+      "  Decoder secret_decoder(encoded_request_secret);\n"
+      "  Encoder public_encoder;\n"
+      "  Encoder secret_encoder;\n"
+      "  uint32_t num_requests = 0;\n"
+      "  public_decoder.StartArray(&num_requests);\n"
+      "  public_encoder.StartArray(num_requests);\n"
+      "  for (uint32_t _batch_index = 0; _batch_index < num_requests; _batch_index++) {\n",
+      funcName);
+  declareDecodeRequestVariables(server, signature);
+  genDecodeRequestParameters(server, signature);
+  deStringPuts(server, "  auto _response = ");
+  genFunctionCall(server, signature);
+  deStringPuts(server,
+      "  if (!_response.ok()) {\n"
+      "    return ::sealed::wasm::Status(_response.code(), _response.message());\n"
+      "  }\n");
+  deDatatype returnType = deSignatureGetReturnType(signature);
+  if (returnType != deNoneDatatypeCreate()) {
+    deString string = deMutableCStringCreate("(*_response)");
+    encodeParameter(server, string, returnType);
+    deStringDestroy(string);
+  }
+  deStringSprintf(server,
+      "  }\n"
+      "  public_encoder.FinishArray();\n"
+      "  public_decoder.FinishArray();\n"
+      "  if (!public_decoder.Finish() || !secret_decoder.Finish()) {\n"
+      "    return ::sealed::wasm::Status(::sealed::wasm::kInvalidArgument,\n"
+      "           \"Failed decoder.Finish\");\n"
+      "  }\n"
+      "  return EncodedMessage(public_encoder.Finish(), secret_encoder.Finish());\n"
+      "}\n"
+      "\n"
+      "// Serve method %1$sBatch, a batch of %1$s calls in one round trip.\n"
+      "extern \"C\" int WASM_EXPORT %1$sBatch_RPC(int32_t request_len, int32_t request_secret_len) {\n"
+      "  ::sealed::wasm::ByteString encoded_request(request_len);\n"
+      "  ::sealed::wasm::SecretByteString encoded_request_secret(request_secret_len);\n"
+      "  biGetRequest(static_cast<void*>(encoded_request.data()), request_len);\n"
+      "  biGetRequestSecret(static_cast<void*>(\n"
+      "                     encoded_request_secret.data()), request_secret_len);\n"
+      "  auto encoded_response = Serve%1$sBatch(encoded_request, encoded_request_secret);\n"
+      "  if (!encoded_response.ok()) {\n"
+      "    ::sealed::wasm::SetResponseStatus(::sealed::wasm::Status(\n"
+      "        encoded_response.code(), encoded_response.message()));\n"
+      "    return true;\n"
+      "  }\n"
+      "  sealed::wasm::SetResponse(*encoded_response);\n"
+      "  return true;\n"
+      "}\n",
+      funcName);
+}
+
 // Generate an RPC function served by the server.
 static void genServerFunction(deString server, deSignature signature) {
   genDecodeRequest(server, signature);
@@ -1176,6 +1362,152 @@ static void genDecodeResponse(deString client, deSignature signature) {
   }
 }
 
+// Generate the batch and pipeline client functions.
+static void genClientBatchFunctions(deString client, deSignature signature, char *baseFileName) {
+  deFunction function = deSignatureGetFunction(signature);
+  char *funcName = deFunctionGetName(function);
+  deDatatype returnType = deSignatureGetReturnType(signature);
+  bool hasResponse = returnType != deNoneDatatypeCreate();
+  char *serviceName = utBaseName(utReplaceSuffix(baseFileName, ""));
+
+  // Encode the batch request.
+  deStringPuts(client, "\n");
+  declareEncodeBatchRequest(client, signature);
+  deStringSprintf(client,
+      " {\n"
+      "  Encoder public_encoder;\n"
+      "  Encoder secret_encoder;\n"
+      "  public_encoder.StartArray(requests.size());\n"
+      "  for (const %sRequest& request : requests) {\n",
+      funcName);
+  deBlock block = deFunctionGetSubBlock(function);
+  deVariable param = deBlockGetFirstVariable(block);
+  deString string = deMutableStringCreate();
+  deParamspec paramspec;
+  deForeachSignatureParamspec(signature, paramspec) {
+    deStringSetUsed(string, 0);
+    deStringSprintf(string, "request.%s", deVariableGetName(param));
+    encodeParameter(client, string, deParamspecGetDatatype(paramspec));
+    param = deVariableGetNextBlockVariable(param);
+  } deEndSignatureParamspec;
+  deStringPuts(client,
+      "  }\n"
+      "  public_encoder.FinishArray();\n"
+      "  return EncodedMessage(public_encoder.Finish(), secret_encoder.Finish());\n"
+      "}\n\n");
+
+  // Decode the batch response.
+  declareDecodeBatchResponse(client, signature);
+  deStringPuts(client,
+      " {\n"
+      "  Decoder public_decoder(encoded_response.public_data);\n"
+      "  Decoder secret_decoder(encoded_response.secret_data);\n"
+      "  uint32_t num_responses = 0;\n"
+      "  public_decoder.StartArray(&num_responses);\n"
+      "  if (num_responses != num_requests) {\n"
+      "    return ::sealed::wasm::Status(::sealed::wasm::kInvalidArgument,\n"
+      "        \"Wrong number of responses in RPC batch\");\n"
+      "  }\n");
+  if (hasResponse) {
+    deStringPuts(client, "  std::vector<");
+    appendDatatypeString(client, returnType);
+    deStringPuts(client,
+        "> responses(num_responses);\n"
+        "  for (uint32_t _batch_index = 0; _batch_index < num_responses; _batch_index++) {\n");
+    deStringSetUsed(string, 0);
+    deStringPuts(string, "responses[_batch_index]");
+    decodeParameter(client, string, returnType);
+    deStringPuts(client, "  }\n");
+  }
+  deStringSprintf(client,
+      "  public_decoder.FinishArray();\n"
+      "  if (!public_decoder.Finish() || !secret_decoder.Finish()) {\n"
+      "    return ::sealed::wasm::Status(::sealed::wasm::kInvalidArgument,\n"
+      "           \"Failed decoder.Finish in Decode%sBatchResponse\");\n"
+      "  }\n"
+      "  return %s;\n"
+      "}\n",
+      funcName, hasResponse? "responses" : "::sealed::wasm::Status()");
+  deStringDestroy(string);
+
+  // Call the server with the batch.
+  deStringSprintf(client, "\n// Call the server once for a batch of %s RPCs.\n", funcName);
+  declareBatchFunction(client, signature, false);
+  deStringSprintf(client,
+      " {\n"
+      "  ::sealed::wasm::EncodedMessage encoded_request = Encode%1$sBatchRequest(requests);\n"
+      "  ::sealed::wasm::EncodedMessage encoded_response;\n"
+      "  SC_RETURN_IF_ERROR(::sealed::wasm::SendRpc(\n"
+      "      \"%2$s\", \"%1$sBatch\", encoded_request, 0, &encoded_response));\n"
+      "  return Decode%1$sBatchResponse(encoded_response, requests.size());\n"
+      "}\n\n",
+      funcName, serviceName);
+  declareBatchFunction(client, signature, true);
+  deStringSprintf(client,
+      " {\n"
+      "  EncodedMessage encoded_request = Encode%1$sBatchRequest(requests);\n"
+      "  std::string response;\n"
+      "  ::sealed::wasm::SecretByteString response_secret;\n"
+      "  SC_RETURN_IF_ERROR(::sealed::wasm::SendRpc(\n"
+      "      \"%2$s\", \"%1$sBatch\",\n"
+      "      encoded_request.public_data.string(), encoded_request.secret_data,\n"
+      "      &response, &response_secret, socket));\n"
+      "  return Decode%1$sBatchResponse(EncodedMessage(response, response_secret),\n"
+      "                                 requests.size());\n"
+      "}\n",
+      funcName, serviceName);
+
+  // The pipeline methods.
+  deStringSprintf(client,
+      "\n"
+      "sealed::wasm::Status %1$sPipeline::Call(",
+      funcName);
+  declareFunctionParams(client, function, signature);
+  deStringSprintf(client,
+      ") {\n"
+      "  if (pending_.size() >= max_outstanding_) {\n"
+      "    SC_RETURN_IF_ERROR(Flush());\n"
+      "  }\n"
+      "  pending_.push_back(%sRequest{",
+      funcName);
+  printFunctionCallParameters(client, function);
+  deStringSprintf(client,
+      "});\n"
+      "  return ::sealed::wasm::Status();\n"
+      "}\n"
+      "\n"
+      "sealed::wasm::Status %sPipeline::Flush() {\n"
+      "  if (pending_.empty()) {\n"
+      "    return ::sealed::wasm::Status();\n"
+      "  }\n",
+      funcName);
+  if (hasResponse) {
+    deStringSprintf(client,
+        "  auto responses = %sBatch(pending_, socket_);\n"
+        "  if (!responses.ok()) {\n"
+        "    return ::sealed::wasm::Status(responses.code(), responses.message());\n"
+        "  }\n"
+        "  responses_.insert(responses_.end(), responses->begin(), responses->end());\n",
+        funcName);
+  } else {
+    deStringSprintf(client, "  SC_RETURN_IF_ERROR(%sBatch(pending_, socket_));\n", funcName);
+  }
+  deStringPuts(client,
+      "  pending_.clear();\n"
+      "  return ::sealed::wasm::Status();\n"
+      "}\n\n");
+  appendBatchResultType(client, signature);
+  deStringSprintf(client,
+      " %sPipeline::Finish() {\n"
+      "  SC_RETURN_IF_ERROR(Flush());\n",
+      funcName);
+  if (hasResponse) {
+    deStringPuts(client, "  return std::move(responses_);\n}\n");
+  } else {
+    deStringPuts(client, "  return ::sealed::wasm::Status();\n}\n");
+  }
+}
+
 // Generate code to call the server for the RPC function.
 static void genClientFunction(deString client, deSignature signature, char *baseFileName) {
   genEncodeRequest(client, signature);
@@ -1221,8 +1553,414 @@ static void genClientFunction(deString client, deSignature signature, char *base
       serviceName, funcName, funcName);
 }
 
+// The in-place Rune request decoder.  Requests decode into a C struct with the
+// layout of the Rune parameters, where strings and arrays are runtime_arrays.
+// Public strings and byte arrays at the top level, or in structs and tuples,
+// are views into the wire buffer.  Everything in a heap array is copied, since
+// the runtime frees sub-arrays with their parent.  Secret data is only copied
+// into heap arrays marked secret.
+
+// Forward declaration for recursion.
+static void appendRuneTypeString(deString string, deDatatype datatype);
+
+// Return true if the datatype is a string or an array of bytes.
+static bool isRuneByteArray(deDatatype datatype) {
+  deDatatypeType type = deDatatypeGetType(datatype);
+  if (type == DE_TYPE_STRING) {
+    return true;
+  }
+  if (type != DE_TYPE_ARRAY) {
+    return false;
+  }
+  deDatatype elementType = deDatatypeGetElementType(datatype);
+  deDatatypeType elementTypeType = deDatatypeGetType(elementType);
+  return (elementTypeType == DE_TYPE_UINT || elementTypeType == DE_TYPE_INT) &&
+      deDatatypeGetWidth(elementType) == 8;
+}
+
+// Return true if the datatype is an integer, float or enum, which decode byte
+// for byte into memory.
+static bool isRuneScalar(deDatatype datatype) {
+  deDatatypeType type = deDatatypeGetType(datatype);
+  return type == DE_TYPE_UINT || type == DE_TYPE_INT || type == DE_TYPE_FLOAT ||
+      type == DE_TYPE_ENUM;
+}
+
+// Return the decoder used for data of the given secret type.  Array lengths of
+// mixed arrays are in both, and decodeRuneArray checks that they match.
+static char *runeDecoderName(deSecretType sectype) {
+  return sectype == DE_SECTYPE_ALL_SECRET? "secret" : "public";
+}
+
+// Append the C type of a Rune value.
+static void appendRuneTypeString(deString string, deDatatype datatype) {
+  switch (deDatatypeGetType(datatype)) {
+    case DE_TYPE_BOOL:
+      deStringPuts(string, "bool");
+      break;
+    case DE_TYPE_UINT:
+    case DE_TYPE_ENUM:
+      deStringSprintf(string, "uint%u_t", deDatatypeGetWidth(datatype));
+      break;
+    case DE_TYPE_INT:
+      deStringSprintf(string, "int%u_t", deDatatypeGetWidth(datatype));
+      break;
+    case DE_TYPE_FLOAT:
+      appendFloatTypeString(string, datatype);
+      break;
+    case DE_TYPE_STRING:
+    case DE_TYPE_ARRAY:
+      deStringPuts(string, "runtime_array");
+      break;
+    case DE_TYPE_TUPLE:
+    case DE_TYPE_STRUCT:
+      deStringPuts(string, utSymGetName(rpcDatatypeGetRuneTypeName(datatype)));
+      break;
+    default:
+      utExit("Unexpected datatype in RPC call");
+  }
+}
+
+// Forward declaration for recursion.
+static void declareRuneDatatype(deString types, deDatatype datatype, deLine line,
+    uint32 *numTuples);
+
+// Declare a C struct for the tuple or struct datatype, after its sub-types.
+static void declareRuneStruct(deString types, deDatatype datatype, deLine line,
+    uint32 *numTuples) {
+  deDatatype elementType;
+  deForeachDatatypeTypeList(datatype, elementType) {
+    declareRuneDatatype(types, elementType, line, numTuples);
+  } deEndDatatypeTypeList;
+  bool isTuple = deDatatypeGetType(datatype) == DE_TYPE_TUPLE;
+  deVariable var = deVariableNull;
+  if (!isTuple) {
+    var = deBlockGetFirstVariable(deFunctionGetSubBlock(deDatatypeGetFunction(datatype)));
+  }
+  deStringPuts(types, "typedef struct {\n");
+  uint32 xField = 0;
+  deForeachDatatypeTypeList(datatype, elementType) {
+    deStringPuts(types, "  ");
+    appendRuneTypeString(types, elementType);
+    if (isTuple) {
+      deStringSprintf(types, " _%u;\n", xField);
+    } else {
+      deStringSprintf(types, " %s;\n", deVariableGetName(var));
+      var = deVariableGetNextBlockVariable(var);
+    }
+    xField++;
+  } deEndDatatypeTypeList;
+  char *name;
+  if (isTuple) {
+    name = utSprintf("RuneTuple%u", *numTuples);
+    (*numTuples)++;
+  } else {
+    name = utSprintf("%sRune", deFunctionGetName(deDatatypeGetFunction(datatype)));
+  }
+  deStringSprintf(types, "} %s;\n\n", name);
+  rpcDatatypeSetRuneTypeName(datatype, utSymCreate(name));
+}
+
+// Declare the C types needed to hold the datatype.
+static void declareRuneDatatype(deString types, deDatatype datatype, deLine line,
+    uint32 *numTuples) {
+  deDatatypeType type = deDatatypeGetType(datatype);
+  if (type == DE_TYPE_ARRAY) {
+    deDatatype elementType = deDatatypeGetElementType(datatype);
+    deDatatypeType elementTypeType = deDatatypeGetType(elementType);
+    if ((elementTypeType == DE_TYPE_TUPLE || elementTypeType == DE_TYPE_STRUCT) &&
+        deDatatypeContainsArray(elementType)) {
+      deError(line, "The in-place RPC decoder cannot decode arrays of structs "
+          "or tuples containing strings or arrays");
+    }
+    declareRuneDatatype(types, elementType, line, numTuples);
+  } else if ((type == DE_TYPE_TUPLE || type == DE_TYPE_STRUCT) &&
+      rpcDatatypeGetRuneTypeName(datatype) == utSymNull) {
+    declareRuneStruct(types, datatype, line, numTuples);
+  }
+}
+
+// Write a check that fails decoding.
+static void checkRuneDecode(deString decoder, char *indent, char *condition) {
+  deStringSprintf(decoder,
+      "%1$sif (!(%2$s)) {\n"
+      "%1$s  goto fail;\n"
+      "%1$s}\n",
+      indent, condition);
+}
+
+// Forward declaration for recursion.
+static void decodeRuneValue(deString decoder, deString lexpr, deDatatype datatype,
+    bool copy, uint32 depth);
+
+// Decode a string or byte array.  Public ones become views unless |copy| is set.
+static void decodeRuneByteArray(deString decoder, deString lexpr, deDatatype datatype,
+    bool copy, char *indent) {
+  deSecretType sectype = deFindDatatypeSectype(datatype);
+  char *name = runeDecoderName(sectype);
+  char *value = deStringGetCstr(lexpr);
+  deStringSprintf(decoder, "%s{\n%s  uint64_t len;\n", indent, indent);
+  char *innerIndent = utSprintf("%s  ", indent);
+  checkRuneDecode(decoder, innerIndent,
+      utSprintf("runtime_rpcDecodeLength(&%s_decoder, &len)", name));
+  if (sectype == DE_SECTYPE_ALL_SECRET || copy) {
+    checkRuneDecode(decoder, innerIndent,
+        utSprintf("runtime_rpcCopyScalars(&%s_decoder, &%s, len, 1, %s)", name, value,
+        sectype == DE_SECTYPE_ALL_SECRET? "true" : "false"));
+  } else {
+    checkRuneDecode(decoder, innerIndent,
+        utSprintf("runtime_rpcViewBytes(&%s_decoder, &%s, len)", name, value));
+  }
+  deStringSprintf(decoder, "%s}\n", indent);
+}
+
+// Decode an array other than a byte array into a new heap array.
+static void decodeRuneArray(deString decoder, deString lexpr, deDatatype datatype,
+    uint32 depth, char *indent) {
+  deSecretType sectype = deFindDatatypeSectype(datatype);
+  bool secret = sectype != DE_SECTYPE_ALL_PUBLIC;
+  char *name = runeDecoderName(sectype);
+  deDatatype elementType = deDatatypeGetElementType(datatype);
+  char *value = utAllocString(deStringGetCstr(lexpr));
+  char *innerIndent = utSprintf("%s  ", indent);
+  deStringSprintf(decoder, "%s{\n%s  uint64_t len;\n", indent, indent);
+  checkRuneDecode(decoder, innerIndent,
+      utSprintf("runtime_rpcDecodeLength(&%s_decoder, &len)", name));
+  if (sectype == DE_SECTYPE_MIXED) {
+    deStringSprintf(decoder, "%s  uint64_t secretLen;\n", indent);
+    checkRuneDecode(decoder, innerIndent,
+        "runtime_rpcDecodeLength(&secret_decoder, &secretLen) && secretLen == len");
+  }
+  if (isRuneScalar(elementType)) {
+    uint32 elementBytes = deDatatypeGetWidth(elementType) >> 3;
+    checkRuneDecode(decoder, innerIndent,
+        utSprintf("runtime_rpcCopyScalars(&%s_decoder, &%s, len, %u, %s)", name, value,
+        elementBytes, secret? "true" : "false"));
+    deStringSprintf(decoder, "%s}\n", indent);
+    utFree(value);
+    return;
+  }
+  deString elementTypeString = deMutableStringCreate();
+  appendRuneTypeString(elementTypeString, elementType);
+  char *elementTypeName = deStringGetCstr(elementTypeString);
+  bool hasSubArrays = deDatatypeGetType(elementType) == DE_TYPE_STRING ||
+      deDatatypeGetType(elementType) == DE_TYPE_ARRAY;
+  deStringSprintf(decoder,
+      "%1$s  runtime_rpcAllocArray(&%2$s, len, sizeof(%3$s), %4$s, %5$s);\n"
+      "%1$s  for (uint64_t i%6$u = 0; i%6$u < len; i%6$u++) {\n",
+      indent, value, elementTypeName, hasSubArrays? "true" : "false",
+      secret? "true" : "false", depth);
+  deString element = deMutableStringCreate();
+  deStringSprintf(element, "((%s*)%s.data)[i%u]", elementTypeName, value, depth);
+  decodeRuneValue(decoder, element, elementType, true, depth + 1);
+  deStringDestroy(element);
+  deStringDestroy(elementTypeString);
+  deStringSprintf(decoder, "%1$s  }\n%1$s}\n", indent);
+  utFree(value);
+}
+
+// Decode the fields of a tuple or struct.
+static void decodeRuneStruct(deString decoder, deString lexpr, deDatatype datatype,
+    bool copy, uint32 depth) {
+  bool isTuple = deDatatypeGetType(datatype) == DE_TYPE_TUPLE;
+  deVariable var = deVariableNull;
+  if (!isTuple) {
+    var = deBlockGetFirstVariable(deFunctionGetSubBlock(deDatatypeGetFunction(datatype)));
+  }
+  uint32_t usedChars = deStringGetUsed(lexpr);
+  uint32 xField = 0;
+  deDatatype elementType;
+  deForeachDatatypeTypeList(datatype, elementType) {
+    if (isTuple) {
+      deStringSprintf(lexpr, "._%u", xField);
+    } else {
+      deStringSprintf(lexpr, ".%s", deVariableGetName(var));
+      var = deVariableGetNextBlockVariable(var);
+    }
+    decodeRuneValue(decoder, lexpr, elementType, copy, depth);
+    deStringSetUsed(lexpr, usedChars);
+    xField++;
+  } deEndDatatypeTypeList;
+}
+
+// Decode the value at |lexpr|, e.g. request->names.  |copy| is set inside heap
+// arrays, where strings cannot be views.  |depth| is the number of enclosing arrays.
+static void decodeRuneValue(deString decoder, deString lexpr, deDatatype datatype,
+    bool copy, uint32 depth) {
+  char *indent = utAllocString(utSprintf("%*s", 2 * (2 * depth + 1), ""));
+  char *value = deStringGetCstr(lexpr);
+  char *name = visibilityPrefix(datatype);
+  switch (deDatatypeGetType(datatype)) {
+    case DE_TYPE_BOOL:
+      checkRuneDecode(decoder, indent,
+          utSprintf("runtime_rpcDecodeBool(&%s_decoder, &%s)", name, value));
+      break;
+    case DE_TYPE_UINT:
+    case DE_TYPE_INT:
+    case DE_TYPE_FLOAT:
+    case DE_TYPE_ENUM:
+      checkRuneDecode(decoder, indent, utSprintf(
+          "runtime_rpcDecodeScalar(&%1$s_decoder, &%2$s, sizeof(%2$s))", name, value));
+      break;
+    case DE_TYPE_STRING:
+      decodeRuneByteArray(decoder, lexpr, datatype, copy, indent);
+      break;
+    case DE_TYPE_ARRAY:
+      if (isRuneByteArray(datatype)) {
+        decodeRuneByteArray(decoder, lexpr, datatype, copy, indent);
+      } else {
+        decodeRuneArray(decoder, lexpr, datatype, depth, indent);
+      }
+      break;
+    case DE_TYPE_TUPLE:
+    case DE_TYPE_STRUCT:
+      decodeRuneStruct(decoder, lexpr, datatype, copy, depth);
+      break;
+    default:
+      utExit("Unexpected datatype in RPC call");
+  }
+  utFree(indent);
+}
+
+// Free the copies in the value at |lexpr|.  Views are not freed, and heap
+// arrays free their sub-arrays.
+static void freeRuneValue(deString decoder, deString lexpr, deDatatype datatype) {
+  deDatatypeType type = deDatatypeGetType(datatype);
+  if (type == DE_TYPE_TUPLE || type == DE_TYPE_STRUCT) {
+    bool isTuple = type == DE_TYPE_TUPLE;
+    deVariable var = deVariableNull;
+    if (!isTuple) {
+      var = deBlockGetFirstVariable(deFunctionGetSubBlock(deDatatypeGetFunction(datatype)));
+    }
+    uint32_t usedChars = deStringGetUsed(lexpr);
+    uint32 xField = 0;
+    deDatatype elementType;
+    deForeachDatatypeTypeList(datatype, elementType) {
+      if (isTuple) {
+        deStringSprintf(lexpr, "._%u", xField);
+      } else {
+        deStringSprintf(lexpr, ".%s", deVariableGetName(var));
+        var = deVariableGetNextBlockVariable(var);
+      }
+      freeRuneValue(decoder, lexpr, elementType);
+      deStringSetUsed(lexpr, usedChars);
+      xField++;
+    } deEndDatatypeTypeList;
+    return;
+  }
+  if (type != DE_TYPE_STRING && type != DE_TYPE_ARRAY) {
+    return;
+  }
+  deSecretType sectype = deFindDatatypeSectype(datatype);
+  if (sectype != DE_SECTYPE_ALL_PUBLIC) {
+    deStringSprintf(decoder, "  runtime_freeSecretArray(&%s);\n", deStringGetCstr(lexpr));
+  } else if (!isRuneByteArray(datatype)) {
+    deStringSprintf(decoder, "  runtime_freeArray(&%s);\n", deStringGetCstr(lexpr));
+  }
+}
+
+// Generate the request struct, and the functions to decode and free it.
+static void genRuneDecodeRequest(deString types, deString decoder, deSignature signature,
+    deLine line, uint32 *numTuples) {
+  deFunction function = deSignatureGetFunction(signature);
+  char *funcName = deFunctionGetName(function);
+  deParamspec paramspec;
+  deForeachSignatureParamspec(signature, paramspec) {
+    declareRuneDatatype(types, deParamspecGetDatatype(paramspec), line, numTuples);
+  } deEndSignatureParamspec;
+  deStringPuts(decoder, "typedef struct {\n");
+  deVariable param = deBlockGetFirstVariable(deFunctionGetSubBlock(function));
+  deForeachSignatureParamspec(signature, paramspec) {
+    deStringPuts(decoder, "  ");
+    appendRuneTypeString(decoder, deParamspecGetDatatype(paramspec));
+    deStringSprintf(decoder, " %s;\n", deVariableGetName(param));
+    param = deVariableGetNextBlockVariable(param);
+  } deEndSignatureParamspec;
+  if (deSignatureGetUsedParamspec(signature) == 0) {
+    deStringPuts(decoder, "  bool unused;  // The RPC has no parameters.\n");
+  }
+  deStringSprintf(decoder,
+      "} %1$sRuneRequest;\n\n"
+      "// Free the copies made by Decode%1$sRequestInPlace.\n"
+      "static void Free%1$sRuneRequest(%1$sRuneRequest *request) {\n",
+      funcName);
+  deString lexpr = deMutableStringCreate();
+  param = deBlockGetFirstVariable(deFunctionGetSubBlock(function));
+  deForeachSignatureParamspec(signature, paramspec) {
+    deStringSetUsed(lexpr, 0);
+    deStringSprintf(lexpr, "request->%s", deVariableGetName(param));
+    freeRuneValue(decoder, lexpr, deParamspecGetDatatype(paramspec));
+    param = deVariableGetNextBlockVariable(param);
+  } deEndSignatureParamspec;
+  deStringSprintf(decoder,
+      "  (void)request;\n"
+      "}\n\n"
+      "// Decode the request for RPC %1$s.  Public strings and byte arrays are\n"
+      "// views into |public_data|, which must outlive the request, and must not move.\n"
+      "// On failure, the request is freed and false is returned.\n"
+      "static bool Decode%1$sRequestInPlace(const uint8_t *public_data, size_t public_len,\n"
+      "    const uint8_t *secret_data, size_t secret_len, %1$sRuneRequest *request) {\n"
+      "  runtime_rpcDecoder public_decoder, secret_decoder;\n"
+      "  runtime_rpcInitDecoder(&public_decoder, public_data, public_len);\n"
+      "  runtime_rpcInitDecoder(&secret_decoder, secret_data, secret_len);\n"
+      "  memset(request, 0, sizeof(*request));\n",
+      funcName);
+  param = deBlockGetFirstVariable(deFunctionGetSubBlock(function));
+  deForeachSignatureParamspec(signature, paramspec) {
+    deStringSetUsed(lexpr, 0);
+    deStringSprintf(lexpr, "request->%s", deVariableGetName(param));
+    decodeRuneValue(decoder, lexpr, deParamspecGetDatatype(paramspec), false, 0);
+    param = deVariableGetNextBlockVariable(param);
+  } deEndSignatureParamspec;
+  deStringDestroy(lexpr);
+  deStringSprintf(decoder,
+      "  if (runtime_rpcFinishDecoder(&public_decoder) &&\n"
+      "      runtime_rpcFinishDecoder(&secret_decoder)) {\n"
+      "    return true;\n"
+      "  }\n"
+      "fail:\n"
+      "  Free%sRuneRequest(request);\n"
+      "  return false;\n"
+      "}\n\n",
+      funcName);
+}
+
+// Write the in-place Rune request decoders for all the RPCs to |decoderFile|.
+// It is a C header, since the decoders are static.
+static void genRuneDecoderCode(char *rpcDefFile, char *decoderFile) {
+  char *headerGuard = deUpperSnakeCase(utReplaceSuffix(rpcDefFile, ""));
+  deString types = deMutableStringCreate();
+  deString decoder = deMutableStringCreate();
+  deStringSprintf(types,
+      "#ifndef %s_RUNE_DECODER_H_\n"
+      "#define %s_RUNE_DECODER_H_\n\n"
+      "// This is a generated file: DO NOT EDIT!\n\n"
+      "#include <stdbool.h>\n"
+      "#include <stdint.h>\n"
+      "#include <string.h>\n\n"
+      "#include \"third_party/rune/runtime/runtime.h\"\n\n",
+      headerGuard, headerGuard);
+  uint32 numTuples = 0;
+  deSignature signature;
+  deForeachRootSignature(deTheRoot, signature) {
+    deFunction function = deSignatureGetFunction(signature);
+    if (function != deFunctionNull && deFunctionIsRpc(function)) {
+      genRuneDecodeRequest(types, decoder, signature, deFunctionGetLine(function),
+          &numTuples);
+    }
+  } deEndRootSignature;
+  deStringSprintf(decoder, "#endif  // %s_RUNE_DECODER_H_\n", headerGuard);
+  FILE *file = openOrDie(decoderFile);
+  deWriteStringToFile(file, types);
+  deWriteStringToFile(file, decoder);
+  fclose(file);
+  deStringFree(types);
+  deStringFree(decoder);
+}
+
 // Find all the exported RPC functions and generate code for them.
-static void genCCRpcCode(char *rpcDefFile, char *headerFile, char *clientFile, char *serverFile) {
+static void genCCRpcCode(char *rpcDefFile, char *headerFile, char *clientFile, char *serverFile,
+    char *runeDecoderFile) {
   // We declare all the required type declarations before functions, so we need
   // two header strings to track them.
   deString header = deMutableStringCreate();
@@ -1239,7 +1977,9 @@ static void genCCRpcCode(char *rpcDefFile, char *headerFile, char *clientFile, c
         deLine line = deFunctionGetLine(function);
         genHeaderCode(header, signature, line);
         genServerFunction(server, signature);
+        genServeBatch(server, signature);
         genClientFunction(client, signature, rpcDefFile);
+        genClientBatchFunctions(client, signature, rpcDefFile);
       }
     }
   } deEndRootSignature;
@@ -1252,17 +1992,22 @@ static void genCCRpcCode(char *rpcDefFile, char *headerFile, char *clientFile, c
   deStringFree(header);
   deStringFree(client);
   deStringFree(server);
+  if (runeDecoderFile != NULL) {
+    genRuneDecoderCode(rpcDefFile, runeDecoderFile);
+  }
 }
 
-// Find all the exported RPC functions and generate code for them.
-void deGenCCRpcCode(char *rpcDefFile, char *headerFile, char *clientFile, char *serverFile) {
+// Find all the exported RPC functions and generate code for them.  If
+// |runeDecoderFile| is not NULL, also write in-place Rune request decoders to it.
+void deGenCCRpcCode(char *rpcDefFile, char *headerFile, char *clientFile, char *serverFile,
+    char *runeDecoderFile) {
   deStart(rpcDefFile);
   rpcDatabaseStart();
   if (!utSetjmp()) {
     deParseModule(rpcDefFile, deRootGetBlock(deTheRoot), true, deLineNull);
     deBind();
     deBindRPCs();
-    genCCRpcCode(rpcDefFile, headerFile, clientFile, serverFile);
+    genCCRpcCode(rpcDefFile, headerFile, clientFile, serverFile, runeDecoderFile);
     utUnsetjmp();
   } else {
     printf("Exiting due to errors\n");
@@ -19,7 +19,8 @@
 extern "C" {
 #endif
 
-void deGenCCRpcCode(char *rpcDefFile, char *headerFile, char *clientFile, char *serverFile);
+void deGenCCRpcCode(char *rpcDefFile, char *headerFile, char *clientFile, char *serverFile,
+    char *runeDecoderFile);
 
 #ifdef __cplusplus
 }  // extern "C"
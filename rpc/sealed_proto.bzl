@@ -28,6 +28,8 @@ def _genrpcfiles_impl(ctx):
     args.add(ctx.outputs.header_out)
     args.add(ctx.outputs.client_out)
     args.add(ctx.outputs.server_out)
+    if ctx.outputs.rune_decoder_out:
+        args.add(ctx.outputs.rune_decoder_out)
 
     transitive = get_transitive_srcs(ctx.file.src, ctx.attr.deps)
 
@@ -37,6 +39,8 @@ def _genrpcfiles_impl(ctx):
         ctx.outputs.client_out,
         ctx.outputs.server_out,
     ]
+    if ctx.outputs.rune_decoder_out:
+        outputs.append(ctx.outputs.rune_decoder_out)
 
     ctx.actions.run(
         arguments = [args],
@@ -73,6 +77,9 @@ genrpcfiles = rule(
             doc = "The generated server source file",
             mandatory = True,
         ),
+        "rune_decoder_out": attr.output(
+            doc = "Optional C header of in-place request decoders into Rune runtime arrays",
+        ),
         "deps": attr.label_list(
             allow_files = True,
             doc = "SealedProto .rn files that your .rn file imports.",
@@ -30,9 +30,9 @@ for outFile in tests/*.stdout; do
     args=`cat $argsFile`
   fi
   if [ -e "$inputFile" ]; then
-    ./rune "$args" "$test" && "./$executable"  > "$resFile" < "$inputFile"
+    ./rune $args "$test" && "./$executable"  > "$resFile" < "$inputFile"
   else
-    ./rune "$args" "$test" && "./$executable"  > "$resFile"
+    ./rune $args "$test" && "./$executable"  > "$resFile"
   fi
   sed 's/\r$//' -i "$outFile"
   sed 's/\r$//' -i "$resFile"
@@ -60,5 +60,20 @@ for test in errortests/*.rn; do
   fi
 done
 
+# With -incremental, editing one function recompiles only the part defining it.
+incrementalDir=$(mktemp -d)
+cp tests/incremental.rn "$incrementalDir"
+./rune -incremental "$incrementalDir/cache" "$incrementalDir/incremental.rn" > /dev/null
+sed 's/value \* 3u32/value * 5u32/' -i "$incrementalDir/incremental.rn"
+result=$(./rune -incremental "$incrementalDir/cache" "$incrementalDir/incremental.rn" | grep "Compiling")
+if [[ "$result" == "Compiling 1 of 32 parts" && $("$incrementalDir/incremental") == "225" ]]; then
+  echo "incremental rebuild passed"
+  numPassed=$((numPassed + 1))
+else
+  echo "incremental rebuild failed ***************************** $result"
+  numFailed=$((numFailed + 1))
+fi
+rm -rf "$incrementalDir"
+
 echo "Passed: $numPassed"
 echo "Failed: $numFailed"
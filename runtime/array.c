@@ -12,16 +12,25 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+// For MAP_ANONYMOUS, MAP_NORESERVE and madvise under -std=c11.
+#define _DEFAULT_SOURCE
 #include "runtime.h"
 
 #include <assert.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <stdlib.h>  // For calloc, realloc, and free.
+#include <string.h>  // For memset.
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>  // For vectorized array comparison.
+#endif
 #ifdef _WIN32
 #include <windows.h>  // To find total RAM available.
 #else
+#include <pthread.h>  // To lock the heap once threads are running.
+#include <sys/mman.h>  // To reserve address space for the array heap.
 #include <sys/sysinfo.h>  // To find total RAM available.
+#include <unistd.h>  // For sysconf.
 #endif
 
 // These are verified with static_assert in runtime_arrayStart.
@@ -32,14 +41,59 @@
 #define RN_HEADER_WORDS 3u
 #endif
 // Used when initializing array headers to help track down heap bugs.
-static size_t runtime_arrayCounter = 0;
+static _Atomic size_t runtime_arrayCounter = 0;
 #else
 #define RN_HEADER_WORDS 2u
 #endif
 #define RN_ARRAY_WORDS 2u
+// Size class |i| holds buffers with room for 1 << i words of data.
+#define RN_POOL_MAX_WORDS (1u << (RN_POOL_NUM_CLASSES - 1))
+// New pool buffers are carved out of slabs of this many words.
+#define RN_POOL_SLAB_WORDS (1u << 13)
 
 static size_t runtime_totalRam;
 
+// Set when the parallel for thread pool starts.  Until then only one thread
+// uses the heap, so it is not locked, and statistics are updated directly.
+bool runtime_multiThreaded;
+// Protects the compacting heap and the list of pool slabs.
+static pthread_mutex_t runtime_heapMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Small array buffers come from per-size-class free lists rather than calloc,
+// since most arrays are short strings.  Each pooled buffer keeps the usual heap
+// header and back-pointer, with allocatedWords set to the size of its class.
+// The free lists and the slab being carved up are per-thread, so allocating
+// small arrays never takes a lock.  A buffer freed by another thread than the
+// one that allocated it just joins the freeing thread's pool.  Slabs are only
+// returned to the system in runtime_arrayStop.
+typedef struct runtime_poolBuffer_ {
+  struct runtime_poolBuffer_ *nextFree;
+} runtime_poolBuffer;
+
+static _Thread_local runtime_poolBuffer *runtime_poolFreeLists[RN_POOL_NUM_CLASSES];
+static size_t *runtime_poolSlabs;  // Linked through the first word of each slab.
+static _Thread_local size_t *runtime_poolSlabPos;
+static _Thread_local size_t *runtime_poolSlabEnd;
+static runtime_arrayHeapStats runtime_heapStats;
+
+// Buffers too large to be pooled are bump-allocated in one contiguous heap,
+// reserved up front so it never has to move.  Freed buffers keep their header,
+// with a NULL back-pointer, until runtime_compactArrayHeap slides the live ones
+// down and updates their back-pointers.  Freeing the last buffer in the heap
+// just lowers runtime_heapTop, and the last buffer can grow in place.  If the
+// heap cannot be reserved or is full, large buffers fall back to calloc.
+static size_t *runtime_heapStart;
+static size_t *runtime_heapTop;
+static size_t *runtime_heapEnd;
+// Memory above this has never been touched, so it is still zero.
+static size_t *runtime_heapMaxTop;
+// Holes in the heap give memory back to the OS in aligned chunks of this many words.
+#define RN_HEAP_RELEASE_WORDS (1u << 13)
+// Reservations at least this large get their own mapping, committed lazily.
+#define RN_RESERVE_MIN_WORDS (1u << 16)
+// No reservation maps more address space than this, or the size of RAM.
+#define RN_RESERVE_MAX_BYTES ((size_t)1 << 30)
+
 #ifdef RN_DEBUG
 
 // Verify the back pointers in the sub-array, and any sub-arrays.
@@ -154,23 +208,431 @@ static inline bool isOutOfRange(size_t numWords) {
   return numWords > runtime_totalRam >> RN_SIZET_SHIFT;
 }
 
-// Allocate data on the heap for array elements.
-static size_t *allocArrayBuffer(size_t numWords, bool hasSubArrays) {
-  if (numWords == 0) {
+// Return the size class for a buffer of |numWords|, or RN_POOL_NUM_CLASSES if
+// it is too large to be pooled.
+static inline uint32_t findPoolClass(size_t numWords) {
+  if (numWords > RN_POOL_MAX_WORDS) {
+    return RN_POOL_NUM_CLASSES;
+  }
+  if (numWords <= 1) {
+    return 0;
+  }
+  // This is on every allocate and free, so use the bit length of numWords - 1.
+  return 64 - __builtin_clzll((uint64_t)numWords - 1);
+}
+
+// Return the number of data words actually allocated when |numWords| are requested.
+static inline size_t findBufferCapacity(size_t numWords) {
+  uint32_t poolClass = findPoolClass(numWords);
+  if (poolClass == RN_POOL_NUM_CLASSES) {
+    return numWords;
+  }
+  return (size_t)1 << poolClass;
+}
+
+// Lock the heap, if threads are running.
+static inline void lockHeap(void) {
+  if (runtime_multiThreaded) {
+    pthread_mutex_lock(&runtime_heapMutex);
+  }
+}
+
+// Unlock the heap, if threads are running.
+static inline void unlockHeap(void) {
+  if (runtime_multiThreaded) {
+    pthread_mutex_unlock(&runtime_heapMutex);
+  }
+}
+
+// Add |delta| to the heap statistic.
+static inline void addHeapStat(uint64_t *stat, uint64_t delta) {
+  if (runtime_multiThreaded) {
+    __atomic_fetch_add(stat, delta, __ATOMIC_RELAXED);
+  } else {
+    *stat += delta;
+  }
+}
+
+// Subtract |delta| from the heap statistic.
+static inline void subHeapStat(uint64_t *stat, uint64_t delta) {
+  addHeapStat(stat, -delta);
+}
+
+// Account for |numBytes| more bytes in use on the heap.
+static inline void addLiveBytes(size_t numBytes) {
+  if (!runtime_multiThreaded) {
+    runtime_heapStats.liveBytes += numBytes;
+    if (runtime_heapStats.liveBytes > runtime_heapStats.maxLiveBytes) {
+      runtime_heapStats.maxLiveBytes = runtime_heapStats.liveBytes;
+    }
+    return;
+  }
+  uint64_t liveBytes = __atomic_add_fetch(&runtime_heapStats.liveBytes, numBytes, __ATOMIC_RELAXED);
+  uint64_t maxLiveBytes = __atomic_load_n(&runtime_heapStats.maxLiveBytes, __ATOMIC_RELAXED);
+  while (liveBytes > maxLiveBytes && !__atomic_compare_exchange_n(&runtime_heapStats.maxLiveBytes,
+      &maxLiveBytes, liveBytes, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+// Take a zeroed buffer from the pool for |poolClass|, carving a new one from
+// the current slab if the free list is empty.
+static runtime_heapHeader *allocPoolBuffer(uint32_t poolClass) {
+  size_t bufferWords = RN_HEADER_WORDS + ((size_t)1 << poolClass);
+  runtime_poolBuffer *buffer = runtime_poolFreeLists[poolClass];
+  if (buffer != NULL) {
+    runtime_poolFreeLists[poolClass] = buffer->nextFree;
+    memset(buffer, 0, bufferWords << RN_SIZET_SHIFT);
+    return (runtime_heapHeader*)buffer;
+  }
+  if (runtime_poolSlabPos + bufferWords > runtime_poolSlabEnd) {
+    size_t *slab = calloc(RN_POOL_SLAB_WORDS, sizeof(size_t));
+    if (slab == NULL) {
+      runtime_raiseExceptionCstr("OutOfMemory", __FILE__, __LINE__, "Out of memory");
+    }
+    lockHeap();
+    *(size_t**)slab = runtime_poolSlabs;
+    runtime_poolSlabs = slab;
+    unlockHeap();
+    runtime_poolSlabPos = slab + 1;
+    runtime_poolSlabEnd = slab + RN_POOL_SLAB_WORDS;
+  }
+  // Slab memory is zeroed by calloc.
+  runtime_heapHeader *header = (runtime_heapHeader*)runtime_poolSlabPos;
+  runtime_poolSlabPos += bufferWords;
+  return header;
+}
+
+// Determine if the buffer is in the compacting heap.
+static inline bool isInHeap(const runtime_heapHeader *header) {
+  return (size_t*)header >= runtime_heapStart && (size_t*)header < runtime_heapEnd;
+}
+
+// Return the first word past the end of the buffer.
+static inline size_t *findBufferEnd(runtime_heapHeader *header) {
+  return (size_t*)header + RN_HEADER_WORDS + header->allocatedWords;
+}
+
+// Give the whole pages between |start| and |end| back to the OS.  They read
+// as zero the next time they are touched.
+static void releasePages(size_t *start, size_t *end) {
+#ifndef _WIN32
+  uintptr_t pageMask = RN_HEAP_RELEASE_WORDS * sizeof(size_t) - 1;
+  uintptr_t first = ((uintptr_t)start + pageMask) & ~pageMask;
+  uintptr_t last = (uintptr_t)end & ~pageMask;
+  if (first < last) {
+    madvise((void*)first, last - first, MADV_DONTNEED);
+  }
+#endif
+}
+
+// Zero the words from |start| to |end| in the heap, before they are reused.
+static void zeroHeapRange(size_t *start, size_t *end) {
+  if (start < runtime_heapMaxTop) {
+    size_t *dirtyEnd = end < runtime_heapMaxTop? end : runtime_heapMaxTop;
+    memset(start, 0, (dirtyEnd - start) << RN_SIZET_SHIFT);
+  }
+  if (end > runtime_heapMaxTop) {
+    runtime_heapMaxTop = end;
+  }
+}
+
+// Reserve address space for the compacting heap.  Pages are only committed as
+// they are touched.
+static void reserveHeap(void) {
+#ifndef _WIN32
+  size_t reserveBytes = runtime_totalRam & ~(size_t)(RN_HEAP_RELEASE_WORDS * sizeof(size_t) - 1);
+  while (reserveBytes >= (RN_HEAP_RELEASE_WORDS << RN_SIZET_SHIFT)) {
+    void *heap = mmap(NULL, reserveBytes, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (heap != MAP_FAILED) {
+      runtime_heapStart = heap;
+      runtime_heapTop = heap;
+      runtime_heapMaxTop = heap;
+      runtime_heapEnd = runtime_heapStart + (reserveBytes >> RN_SIZET_SHIFT);
+      return;
+    }
+    reserveBytes >>= 1;
+  }
+#endif
+}
+
+// Map a buffer with room for at least |numWords| of data, outside of the heap.
+// Its pages are committed as they are touched, so it can grow up to its
+// capacity without moving.  Return NULL if the mapping fails.
+static runtime_heapHeader *mapReservedBuffer(size_t numWords) {
+#ifndef _WIN32
+  size_t chunkBytes = RN_HEAP_RELEASE_WORDS * sizeof(size_t);
+  size_t mapBytes = ((RN_HEADER_WORDS + numWords) << RN_SIZET_SHIFT) + chunkBytes - 1;
+  mapBytes &= ~(chunkBytes - 1);
+  void *buffer = mmap(NULL, mapBytes, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (buffer == MAP_FAILED) {
+    return NULL;
+  }
+  runtime_heapHeader *header = buffer;
+  header->reserved = true;
+  header->allocatedWords = (mapBytes >> RN_SIZET_SHIFT) - RN_HEADER_WORDS;
+  addHeapStat(&runtime_heapStats.reservedBytes, mapBytes);
+  return header;
+#else
+  return NULL;
+#endif
+}
+
+// Unmap a buffer created by mapReservedBuffer or runtime_mapFileArray.  The OS
+// zeroes its pages before they are reused, so it does not need to be wiped.
+// The mapping starts at the page holding the header.
+static void unmapReservedBuffer(runtime_heapHeader *header) {
+#ifndef _WIN32
+  uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t)header & ~(pageSize - 1);
+  uintptr_t end = (uintptr_t)((size_t*)header + RN_HEADER_WORDS + header->allocatedWords);
+  subHeapStat(&runtime_heapStats.reservedBytes, end - start);
+  munmap((void*)start, end - start);
+#endif
+}
+
+// Bump-allocate a zeroed buffer in the heap.  Return NULL if there is no room.
+static runtime_heapHeader *allocHeapTop(size_t numWords) {
+  size_t bufferWords = RN_HEADER_WORDS + numWords;
+  lockHeap();
+  if (bufferWords > (size_t)(runtime_heapEnd - runtime_heapTop)) {
+    unlockHeap();
     return NULL;
   }
+  runtime_heapHeader *header = (runtime_heapHeader*)runtime_heapTop;
+  runtime_heapTop += bufferWords;
+  zeroHeapRange((size_t*)header, runtime_heapTop);
+  unlockHeap();
+  return header;
+}
+
+// Allocate a zeroed heap buffer with room for at least |numWords| of data.
+static runtime_heapHeader *allocHeapBuffer(size_t numWords) {
   if (isOutOfRange(numWords)) {
     runtime_raiseExceptionCstr("OutOfMemory", __FILE__, __LINE__, "Out of memory");
   }
+  uint32_t poolClass = findPoolClass(numWords);
+  runtime_heapHeader *header;
+  if (poolClass != RN_POOL_NUM_CLASSES) {
+    numWords = (size_t)1 << poolClass;
+    header = allocPoolBuffer(poolClass);
+    addHeapStat(&runtime_heapStats.poolAllocations[poolClass], 1);
+    addHeapStat(&runtime_heapStats.poolLiveBuffers[poolClass], 1);
+  } else {
+    header = allocHeapTop(numWords);
+    if (header == NULL) {
+      header = (runtime_heapHeader*)calloc(numWords + RN_HEADER_WORDS, sizeof(size_t));
+      if (header == NULL) {
+        runtime_raiseExceptionCstr("OutOfMemory", __FILE__, __LINE__, "Out of memory");
+      }
+    }
+    addHeapStat(&runtime_heapStats.largeAllocations, 1);
+  }
+  header->allocatedWords = numWords;
+  addLiveBytes((numWords + RN_HEADER_WORDS) << RN_SIZET_SHIFT);
+  if (runtime_allocSampleBytes != 0 || runtime_memoryStatsRequested) {
+    runtime_noteAllocation((numWords + RN_HEADER_WORDS) << RN_SIZET_SHIFT);
+  }
+  return header;
+}
+
+// Return the heap buffer to its pool, or to the system if it is not pooled.
+static void freeHeapBuffer(runtime_heapHeader *header) {
+  if (header->reserved) {
+    unmapReservedBuffer(header);
+    return;
+  }
+  size_t numWords = header->allocatedWords;
+  subHeapStat(&runtime_heapStats.liveBytes, (numWords + RN_HEADER_WORDS) << RN_SIZET_SHIFT);
+  uint32_t poolClass = findPoolClass(numWords);
+  if (poolClass == RN_POOL_NUM_CLASSES) {
+    if (!isInHeap(header)) {
+      free(header);
+      return;
+    }
+    lockHeap();
+    if (findBufferEnd(header) == runtime_heapTop) {
+      runtime_heapTop = (size_t*)header;
+      releasePages(runtime_heapTop, runtime_heapTop + RN_HEADER_WORDS + numWords);
+    } else {
+      // Leave a hole for runtime_compactArrayHeap to squeeze out.
+      header->backPointer = NULL;
+      releasePages((size_t*)(header + 1), findBufferEnd(header));
+    }
+    unlockHeap();
+    return;
+  }
+  subHeapStat(&runtime_heapStats.poolLiveBuffers[poolClass], 1);
+  runtime_poolBuffer *buffer = (runtime_poolBuffer*)header;
+  buffer->nextFree = runtime_poolFreeLists[poolClass];
+  runtime_poolFreeLists[poolClass] = buffer;
+}
+
+// Try to resize a large buffer in the heap without moving it.  The last buffer
+// can grow or shrink, and any other can shrink by splitting off a hole.  The
+// heap must be locked.
+static bool resizeHeapBufferInPlace(runtime_heapHeader *header, size_t numWords) {
+  size_t oldWords = header->allocatedWords;
+  size_t *data = (size_t*)header + RN_HEADER_WORDS;
+  if (findBufferEnd(header) == runtime_heapTop) {
+    if (numWords > oldWords && numWords - oldWords > (size_t)(runtime_heapEnd - runtime_heapTop)) {
+      return false;
+    }
+    if (numWords > oldWords) {
+      zeroHeapRange(data + oldWords, data + numWords);
+    }
+    runtime_heapTop = data + numWords;
+  } else if (numWords + RN_HEADER_WORDS < oldWords) {
+    runtime_heapHeader *hole = (runtime_heapHeader*)(data + numWords);
+    hole->allocatedWords = oldWords - numWords - RN_HEADER_WORDS;
+    hole->backPointer = NULL;
+  } else {
+    return false;
+  }
+  header->allocatedWords = numWords;
+  if (numWords > oldWords) {
+    addLiveBytes((numWords - oldWords) << RN_SIZET_SHIFT);
+  } else {
+    subHeapStat(&runtime_heapStats.liveBytes, (oldWords - numWords) << RN_SIZET_SHIFT);
+  }
+  return true;
+}
+
+// Resize the heap buffer to hold at least |numWords| of data, and return the
+// possibly moved header.  Data is preserved up to the smaller of the two sizes,
+// and any new words are zero.  The caller must update back-pointers.
+static runtime_heapHeader *resizeHeapBuffer(runtime_heapHeader *header, size_t numWords) {
+  size_t oldWords = header->allocatedWords;
+  bool reserved = header->reserved;
+  if (reserved) {
+    if (numWords <= oldWords) {
+      return header;
+    }
+    // It outgrew its reservation, so move it to the heap.
+  } else if (findPoolClass(oldWords) == RN_POOL_NUM_CLASSES &&
+      findPoolClass(numWords) == RN_POOL_NUM_CLASSES) {
+    if (isOutOfRange(numWords)) {
+      runtime_raiseExceptionCstr("OutOfMemory", __FILE__, __LINE__, "Out of memory");
+    }
+    if (isInHeap(header)) {
+      lockHeap();
+      bool resized = resizeHeapBufferInPlace(header, numWords);
+      unlockHeap();
+      if (resized) {
+        return header;
+      }
+    } else if (!header->secret) {
+      // realloc could leave a copy behind, so secret buffers are moved instead.
+      header = realloc(header, (numWords + RN_HEADER_WORDS) << RN_SIZET_SHIFT);
+      if (header == NULL) {
+        runtime_raiseExceptionCstr("OutOfMemory", __FILE__, __LINE__, "Out of memory");
+      }
+      size_t *data = (size_t*)header + RN_HEADER_WORDS;
+      if (numWords > oldWords) {
+        runtime_zeroMemory(data + oldWords, numWords - oldWords);
+        addLiveBytes((numWords - oldWords) << RN_SIZET_SHIFT);
+      } else {
+        subHeapStat(&runtime_heapStats.liveBytes, (oldWords - numWords) << RN_SIZET_SHIFT);
+      }
+      header->allocatedWords = numWords;
+      return header;
+    }
+  }
+  runtime_heapHeader *newHeader = allocHeapBuffer(numWords);
+  size_t newWords = newHeader->allocatedWords;
+  *newHeader = *header;
+  newHeader->reserved = false;
+  newHeader->allocatedWords = newWords;
+  runtime_copyWords((size_t*)newHeader + RN_HEADER_WORDS, (size_t*)header + RN_HEADER_WORDS,
+      newWords < oldWords? newWords : oldWords);
+  if (!reserved && header->secret) {
+    runtime_zeroMemory((size_t*)header, RN_HEADER_WORDS + oldWords);
+    header->allocatedWords = oldWords;
+  }
+  freeHeapBuffer(header);
+  return newHeader;
+}
+
+// Slide all live buffers in the heap down over the holes left by freed ones,
+// and update back-pointers, including those of sub-arrays of moved buffers.
+// Buffers are visited in address order, so a back-pointer into a buffer not yet
+// moved is still valid when it is followed.  No C code may hold a pointer into
+// an array's data across this call.  In parallel for bodies, other threads may
+// be using any array, so this does nothing.
+void runtime_compactArrayHeap(void) {
+  if (runtime_inParallelBody()) {
+    return;
+  }
+  size_t *dest = runtime_heapStart;
+  size_t *p = runtime_heapStart;
+  bool movedSecret = false;
+  while (p < runtime_heapTop) {
+    runtime_heapHeader *header = (runtime_heapHeader*)p;
+    size_t bufferWords = RN_HEADER_WORDS + header->allocatedWords;
+    if (header->backPointer != NULL) {
+      if (dest != p) {
+        memmove(dest, p, bufferWords << RN_SIZET_SHIFT);
+        header = (runtime_heapHeader*)dest;
+        movedSecret |= header->secret;
+        runtime_array *array = header->backPointer;
+        array->data = dest + RN_HEADER_WORDS;
+        if (header->hasSubArrays) {
+          updateSubArrayBackPointers(array);
+        }
+      }
+      dest += bufferWords;
+    }
+    p += bufferWords;
+  }
+  // Wipe what is left of moved secret buffers above the new top.  Otherwise,
+  // zeroHeapRange clears the space when it is reused.
+  releasePages(dest, runtime_heapTop);
+  if (!movedSecret) {
+    runtime_heapTop = dest;
+    addHeapStat(&runtime_heapStats.compactions, 1);
+    return;
+  }
+  size_t *chunkEnd = (size_t*)(((uintptr_t)dest + RN_HEAP_RELEASE_WORDS * sizeof(size_t) - 1) &
+      ~(uintptr_t)(RN_HEAP_RELEASE_WORDS * sizeof(size_t) - 1));
+  size_t *chunkStart = (size_t*)((uintptr_t)runtime_heapTop &
+      ~(uintptr_t)(RN_HEAP_RELEASE_WORDS * sizeof(size_t) - 1));
+  if (chunkEnd >= chunkStart) {
+    runtime_zeroMemory(dest, runtime_heapTop - dest);
+  } else {
+    runtime_zeroMemory(dest, chunkEnd - dest);
+    runtime_zeroMemory(chunkStart, runtime_heapTop - chunkStart);
+  }
+  runtime_heapTop = dest;
+  addHeapStat(&runtime_heapStats.compactions, 1);
+}
+
+// Allocate data on the heap for array elements.
+static size_t *allocArrayBuffer(size_t numWords, bool hasSubArrays) {
+  if (numWords == 0) {
+    return NULL;
+  }
   // We need space for the header.
-  // Allocate data with calloc.
-  runtime_heapHeader *header = (runtime_heapHeader*)calloc(numWords + RN_HEADER_WORDS, sizeof(size_t));
+  runtime_heapHeader *header = allocHeapBuffer(numWords);
   size_t *data = ((size_t*)header) + RN_HEADER_WORDS;
-  header->allocatedWords = numWords;
   header->hasSubArrays = hasSubArrays;
   return data;
 }
 
+// Copy the array heap statistics into |stats|.
+void runtime_getArrayHeapStats(runtime_arrayHeapStats *stats) {
+  if (!runtime_multiThreaded) {
+    *stats = runtime_heapStats;
+    return;
+  }
+  // Every field is a uint64_t.
+  const uint64_t *source = (const uint64_t*)&runtime_heapStats;
+  uint64_t *dest = (uint64_t*)stats;
+  for (size_t i = 0; i < sizeof(runtime_arrayHeapStats) / sizeof(uint64_t); i++) {
+    dest[i] = __atomic_load_n(source + i, __ATOMIC_RELAXED);
+  }
+}
+
 // Allocate space for an array, and initialize the array object.  The array
 // object must not be directly copied, as the heap has a back-pointer to only
 // the one object.  Instead pass the array object by reference.
@@ -194,28 +656,39 @@ void runtime_arrayInitCstr(runtime_array *array, const char *text) {
   runtime_memcopy((uint8_t*)array->data, (uint8_t*)text, len);
 }
 
-// Free any memory used by the array and set its num_elements to 0.
-static void resetArray(runtime_array *array) {
+// Free any memory used by the array and set its num_elements to 0.  Only
+// secret buffers are wiped first: buffers are zeroed when they are reused.
+static void wipeAndResetArray(runtime_array *array, bool secret) {
   if (array->data == NULL) {
     // Already reset.
     return;
   }
   runtime_heapHeader *header = (runtime_heapHeader*)(array->data - RN_HEADER_WORDS);
+  secret |= header->secret;
   if (header->hasSubArrays) {
     //  Reset sub-arrays first.
     uint32_t numElements = array->numElements;
     runtime_array *childArray = (runtime_array*)(array->data);
     while (numElements-- != 0) {
-      resetArray(childArray);
+      wipeAndResetArray(childArray, secret);
       childArray++;
     }
   }
-  runtime_zeroMemory((size_t*)header, RN_HEADER_WORDS + header->allocatedWords);
-  free(header);
+  if (secret && !header->reserved) {
+    size_t allocatedWords = header->allocatedWords;
+    runtime_zeroMemory((size_t*)header, RN_HEADER_WORDS + allocatedWords);
+    header->allocatedWords = allocatedWords;
+  }
+  freeHeapBuffer(header);
   array->data = NULL;
   array->numElements = 0;
 }
 
+// Free any memory used by the array, wiping it only if it is marked secret.
+static inline void resetArray(runtime_array *array) {
+  wipeAndResetArray(array, false);
+}
+
 // Free the array.
 void runtime_freeArray(runtime_array *array) {
   if (array->numElements == 0) {
@@ -224,6 +697,30 @@ void runtime_freeArray(runtime_array *array) {
   resetArray(array);
 }
 
+// Free an array of a secret type, wiping it and any sub-arrays.
+void runtime_freeSecretArray(runtime_array *array) {
+  if (array->numElements == 0) {
+    return;
+  }
+  wipeAndResetArray(array, true);
+}
+
+// Mark the array's buffer secret, and if |markSubArrays| is true, its
+// sub-arrays.  Buffers are never unmarked.
+void runtime_markSecretArray(runtime_array *array, bool markSubArrays) {
+  if (array->data == NULL) {
+    return;
+  }
+  runtime_heapHeader *header = runtime_getArrayHeader(array);
+  header->secret = true;
+  if (markSubArrays && header->hasSubArrays) {
+    runtime_array *childArray = (runtime_array*)(array->data);
+    for (size_t i = 0; i < array->numElements; i++) {
+      runtime_markSecretArray(childArray + i, true);
+    }
+  }
+}
+
 // Index an object in an array, given the array and reference width.
 static uint64_t indexArrayObject(runtime_array *array, size_t index, uint32_t refWidth) {
   switch (refWidth) {
@@ -307,6 +804,27 @@ void runtime_foreachArrayObject(runtime_array *array, void *callback, uint32_t r
   }
 }
 
+// Write the array heap statistics as one line of JSON to the file named by
+// $RUNE_HEAP_STATS, for benchmarks/bench.py.
+static void writeHeapStats(void) {
+  const char *fileName = getenv("RUNE_HEAP_STATS");
+  FILE *file = fopen(fileName, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Unable to write heap stats to %s\n", fileName);
+    return;
+  }
+  runtime_arrayHeapStats stats;
+  runtime_getArrayHeapStats(&stats);
+  uint64_t allocations = stats.largeAllocations;
+  for (uint32_t i = 0; i < RN_POOL_NUM_CLASSES; i++) {
+    allocations += stats.poolAllocations[i];
+  }
+  fprintf(file, "{\"allocations\": %llu, \"maxLiveBytes\": %llu, \"compactions\": %llu}\n",
+      (unsigned long long)allocations, (unsigned long long)stats.maxLiveBytes,
+      (unsigned long long)stats.compactions);
+  fclose(file);
+}
+
 // Initialize dynamic array heap memory.
 void runtime_arrayStart(void) {
   static_assert(sizeof(runtime_heapHeader) == RN_HEADER_WORDS * sizeof(size_t),
@@ -317,6 +835,15 @@ void runtime_arrayStart(void) {
   static_assert(RN_SIZET_SHIFT != UINT32_MAX, "Unsupported size_t size");
   static_assert(sizeof(char) == 1 && sizeof(uint8_t) == 1,
                 "Unsupported char or uint8_t size");
+  // Generated code finds the capacity of an array by masking the flag bits off
+  // the header word before the back pointer, when inlining append.
+  runtime_heapHeader header = {0};
+  header.secret = true;
+  header.allocatedWords = 5;
+  size_t *headerWords = (size_t*)&header;
+  if (headerWords[RN_HEADER_WORDS - 2] != ((5 << 3) | 4)) {
+    runtime_panicCstr("Unexpected heap header layout");
+  }
 #ifdef _WIN32
   MEMORYSTATUSEX statex;
   statex.dwLength = sizeof (statex);
@@ -334,10 +861,35 @@ void runtime_arrayStart(void) {
         "Not enough memory to allocate arrays");
   }
   runtime_totalRam -= sizeof(runtime_heapHeader);
+  reserveHeap();
+  if (getenv("RUNE_HEAP_STATS") != NULL) {
+    atexit(writeHeapStats);
+  }
+  runtime_startMemoryStats();
 }
 
 // Clean up array heap memory.
 void runtime_arrayStop(void) {
+  runtime_freeTempBigints();
+  while (runtime_poolSlabs != NULL) {
+    size_t *slab = runtime_poolSlabs;
+    runtime_poolSlabs = *(size_t**)slab;
+    free(slab);
+  }
+  runtime_poolSlabPos = NULL;
+  runtime_poolSlabEnd = NULL;
+  for (uint32_t i = 0; i < RN_POOL_NUM_CLASSES; i++) {
+    runtime_poolFreeLists[i] = NULL;
+  }
+#ifndef _WIN32
+  if (runtime_heapStart != NULL) {
+    munmap(runtime_heapStart, (runtime_heapEnd - runtime_heapStart) << RN_SIZET_SHIFT);
+  }
+#endif
+  runtime_heapStart = NULL;
+  runtime_heapTop = NULL;
+  runtime_heapEnd = NULL;
+  runtime_heapMaxTop = NULL;
 }
 
 // Resize the array.
@@ -357,17 +909,15 @@ static void arrayResize(runtime_array *array, size_t numElements, size_t element
     runtime_raiseExceptionCstr("OutOfMemory", __FILE__, __LINE__, "Out of memory");
   }
   size_t oldAllocatedWords = header->allocatedWords;
-  size_t allocatedWords = runtime_bytesToWords(allocatedBytes);
-  if (allocateExtra) {
-    // Make the array 50% larger than the requested size.
-    allocatedWords += allocatedWords >> 1;
-  }
-  header->allocatedWords = allocatedWords;
-  // If shrinking the array, zero out the deleted elements.
-  if (allocatedWords < oldAllocatedWords) {
+  size_t numWords = runtime_bytesToWords(allocatedBytes);
+  // If shrinking the array, zero out the deleted elements, so that the space
+  // past the end of the array is always zero.
+  if (numElements < oldNumElements) {
     if (!hasSubArrays) {
-      // Zero out the deleted elements.
-      runtime_zeroMemory(array->data + allocatedWords, oldAllocatedWords - allocatedWords);
+      size_t tailBytes = (numWords << RN_SIZET_SHIFT) - allocatedBytes;
+      size_t oldNumWords = runtime_bytesToWords(oldNumElements * elementSize);
+      memset((uint8_t*)array->data + allocatedBytes, 0, tailBytes);
+      runtime_zeroMemory(array->data + numWords, oldNumWords - numWords);
     } else {
       // Free the sub-arrays at the end of the array.
       runtime_array *p = (runtime_array*)(array->data + numElements * RN_ARRAY_WORDS);
@@ -377,13 +927,21 @@ static void arrayResize(runtime_array *array, size_t numElements, size_t element
       }
     }
   }
-  header = realloc(header, (allocatedWords + RN_HEADER_WORDS) << RN_SIZET_SHIFT);
-  array->data = (size_t*)header + RN_HEADER_WORDS;
-  array->numElements = numElements;
-  if (allocatedWords > oldAllocatedWords) {
-    // Zero out the new elements.
-    runtime_zeroMemory(array->data + oldAllocatedWords, allocatedWords - oldAllocatedWords);
+  size_t allocatedWords = numWords;
+  if (allocateExtra) {
+    if (numWords <= oldAllocatedWords) {
+      // There is still room in the buffer.
+      array->numElements = numElements;
+      return;
+    }
+    // Make the array 50% larger than the requested size.
+    allocatedWords += allocatedWords >> 1;
   }
+  if (findBufferCapacity(allocatedWords) != oldAllocatedWords) {
+    header = resizeHeapBuffer(header, allocatedWords);
+    array->data = (size_t*)header + RN_HEADER_WORDS;
+  }
+  array->numElements = numElements;
   if (hasSubArrays) {
     updateSubArrayBackPointers(array);
   }
@@ -391,12 +949,121 @@ static void arrayResize(runtime_array *array, size_t numElements, size_t element
 
 // Resize the array.  This will resize in-place if there is available room
 // allocated on the heap for the array.  Otherwise, it will move the array to
-// the end of the heap and resize it there.  If there is not enough space, the
-// heap will first be compacted.
+// the end of the heap and resize it there.  Holes left behind are reclaimed by
+// runtime_compactArrayHeap.
 void runtime_resizeArray(runtime_array *array, size_t numElements, size_t elementSize, bool hasSubArrays) {
   arrayResize(array, numElements, elementSize, hasSubArrays, false);
 }
 
+// Resize the array, but keep its buffer when it shrinks, and grow it by 50% when
+// it does not fit.  This suits buffers that are refilled over and over, such as
+// the line buffer of FilePtr.lines.  Shrinking to empty still frees the buffer,
+// since empty arrays never have one.
+void runtime_resizeArrayKeepBuffer(runtime_array *array, size_t numElements, size_t elementSize,
+    bool hasSubArrays) {
+  arrayResize(array, numElements, elementSize, hasSubArrays, true);
+}
+
+// Reserve room for |numElements| without changing the length of the array, so
+// it can grow that far without moving.  Large reservations are mapped outside
+// of the heap and committed lazily, and are limited to RN_RESERVE_MAX_BYTES and
+// the size of RAM.  If the mapping fails, the array is left as it is, and grows
+// as usual.  Empty arrays have no buffer to hold the reservation, so this does
+// nothing for them.
+void runtime_reserveArray(runtime_array *array, size_t numElements, size_t elementSize,
+    bool hasSubArrays) {
+  if (array->numElements == 0 || elementSize == 0) {
+    return;
+  }
+  size_t maxBytes = RN_RESERVE_MAX_BYTES;
+  if (maxBytes > runtime_totalRam) {
+    maxBytes = runtime_totalRam;
+  }
+  if (numElements > maxBytes / elementSize) {
+    numElements = maxBytes / elementSize;
+  }
+  size_t numWords = runtime_bytesToWords(numElements * elementSize);
+  runtime_heapHeader *header = runtime_getArrayHeader(array);
+  size_t oldWords = header->allocatedWords;
+  if (numWords <= oldWords) {
+    return;
+  }
+  if (numWords < RN_RESERVE_MIN_WORDS) {
+    header = resizeHeapBuffer(header, numWords);
+  } else {
+    runtime_heapHeader *newHeader = mapReservedBuffer(numWords);
+    if (newHeader == NULL) {
+      return;
+    }
+    size_t newWords = newHeader->allocatedWords;
+    *newHeader = *header;
+    newHeader->reserved = true;
+    newHeader->allocatedWords = newWords;
+    runtime_copyWords((size_t*)newHeader + RN_HEADER_WORDS, array->data, oldWords);
+    if (!header->reserved && header->secret) {
+      runtime_zeroMemory((size_t*)header, RN_HEADER_WORDS + oldWords);
+      header->allocatedWords = oldWords;
+    }
+    freeHeapBuffer(header);
+    header = newHeader;
+  }
+  array->data = (size_t*)header + RN_HEADER_WORDS;
+  if (hasSubArrays) {
+    updateSubArrayBackPointers(array);
+  }
+}
+
+// Map |numBytes| of the open file |fd| into |array| as a string, copy-on-write,
+// so reading a whole file costs one mmap rather than a copy per chunk.  The
+// first page of the mapping is anonymous and holds the header just before the
+// file data.  The result is a reserved buffer like any other: it can be written,
+// moves to the heap if it grows, and is unmapped when freed.  Return false if
+// the file cannot be mapped, e.g. if it is a pipe.
+bool runtime_mapFileArray(runtime_array *array, int fd, size_t numBytes) {
+  return runtime_mapFileArrayAt(array, fd, 0, numBytes, sizeof(uint8_t));
+}
+
+// Map |numElements| elements of |elementSize| bytes from the open file |fd|,
+// starting at |offset|, into |array|, like runtime_mapFileArray.  |offset|
+// must be a multiple of the page size.
+bool runtime_mapFileArrayAt(runtime_array *array, int fd, uint64_t offset, size_t numElements,
+    size_t elementSize) {
+#ifndef _WIN32
+  if (array->numElements != 0) {
+    runtime_freeArray(array);
+  }
+  size_t numBytes = numElements * elementSize;
+  if (numBytes == 0 || numBytes / elementSize != numElements || numBytes > runtime_totalRam) {
+    return false;
+  }
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  if (offset & (pageSize - 1)) {
+    return false;
+  }
+  size_t fileBytes = (numBytes + pageSize - 1) & ~(pageSize - 1);
+  uint8_t *buffer = mmap(NULL, pageSize + fileBytes, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (buffer == MAP_FAILED) {
+    return false;
+  }
+  if (mmap(buffer + pageSize, fileBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+      fd, offset) == MAP_FAILED) {
+    munmap(buffer, pageSize + fileBytes);
+    return false;
+  }
+  runtime_heapHeader *header = (runtime_heapHeader*)(buffer + pageSize) - 1;
+  header->reserved = true;
+  header->allocatedWords = fileBytes >> RN_SIZET_SHIFT;
+  addHeapStat(&runtime_heapStats.reservedBytes, pageSize + fileBytes);
+  array->data = (size_t*)(buffer + pageSize);
+  array->numElements = numElements;
+  updateArrayBackPointer(array);
+  return true;
+#else
+  return false;
+#endif
+}
+
 // Make a copy of the array's data.  |dest| should be empty.  |source| cannot be empty.
 static void replicateArrayData(runtime_array *dest, runtime_array *source, size_t numBytes, bool hasSubArrays) {
   size_t numElements = source->numElements;
@@ -415,8 +1082,12 @@ static void replicateArrayData(runtime_array *dest, runtime_array *source, size_
       if (subSourceArray->data != NULL) {
         runtime_heapHeader *subHeader = runtime_getArrayHeader(subSourceArray);
         runtime_array *subDestArray = (runtime_array*)dest->data + i;
+        bool secret = subHeader->secret;
         replicateArrayData(subDestArray, subSourceArray,
             subHeader->allocatedWords << RN_SIZET_SHIFT, subHeader->hasSubArrays);
+        if (secret) {
+          runtime_markSecretArray(subDestArray, false);
+        }
       }
     }
   }
@@ -508,6 +1179,17 @@ void runtime_moveArray(runtime_array *dest, runtime_array *source) {
 void runtime_appendArrayElement(runtime_array *array, uint8_t *data, size_t elementSize,
       bool isArray, bool hasSubArrays) {
   size_t numElements = array->numElements;
+  if (!isArray && numElements != 0) {
+    // When the buffer has room, skip arrayResize and its overflow checks: the
+    // used bytes already fit in the buffer, so they cannot overflow.
+    size_t usedBytes = numElements * elementSize;
+    size_t capacity = runtime_getArrayHeader(array)->allocatedWords << RN_SIZET_SHIFT;
+    if (capacity - usedBytes >= elementSize) {
+      runtime_memcopy((uint8_t*)array->data + usedBytes, data, elementSize);
+      array->numElements = numElements + 1;
+      return;
+    }
+  }
   arrayResize(array, array->numElements + 1, elementSize, isArray, true);
   uint8_t *dest = ((uint8_t*)array->data) + runtime_multCheckForOverflow(numElements, elementSize);
   if (!isArray) {
@@ -521,9 +1203,57 @@ void runtime_appendArrayElement(runtime_array *array, uint8_t *data, size_t elem
     runtime_array *destArray = (runtime_array*)dest;
     size_t numBytes = runtime_multCheckForOverflow(sourceArray->numElements, elementSize);
     replicateArrayData(destArray, sourceArray, numBytes, hasSubArrays);
+    if (runtime_getArrayHeader(array)->secret) {
+      // Copies into a secret array are secret, too.
+      runtime_markSecretArray((runtime_array*)array->data + numElements, true);
+    }
+  }
+}
+
+// Set |dest| to |left| followed by |right|, for arrays without sub-arrays.  This
+// allocates |dest| once at its final size, where a copy followed by a concat
+// would usually allocate a short string twice as it moves up a size class.
+void runtime_joinArrays(runtime_array *dest, runtime_array *left, runtime_array *right,
+    size_t elementSize) {
+  resetArray(dest);
+  size_t leftElements = left->numElements;
+  size_t rightElements = right->numElements;
+  if (leftElements + rightElements == 0) {
+    return;
+  }
+  size_t leftBytes = runtime_multCheckForOverflow(leftElements, elementSize);
+  runtime_allocArray(dest, leftElements + rightElements, elementSize, false);
+  if (leftElements != 0) {
+    runtime_memcopy(dest->data, left->data, leftBytes);
+  }
+  if (rightElements != 0) {
+    runtime_memcopy((uint8_t*)dest->data + leftBytes, right->data, rightElements * elementSize);
   }
 }
 
+// Make |view| refer to elements lower .. upper-1 of |source| without copying.
+// The view has no heap header, like a constant array, so it must only be read,
+// must not be freed, and must not be used after anything can move or resize
+// |source|.  The generated code uses it for comparing slices.
+void runtime_viewArraySlice(runtime_array *view, runtime_array *source, size_t lower,
+    size_t upper, size_t elementSize) {
+  if (lower > upper) {
+    runtime_raiseExceptionCstr("OutOfMemory", __FILE__, __LINE__,
+        "Left index of slice is greater than right index");
+  }
+  if (upper > source->numElements) {
+    runtime_raiseExceptionCstr("OutOfMemory", __FILE__, __LINE__,
+        "Attempting to index beyond end of array in slice operation");
+  }
+  if (upper == lower) {
+    view->data = NULL;
+    view->numElements = 0;
+    return;
+  }
+  view->data = (size_t*)((uint8_t*)source->data + lower * elementSize);
+  view->numElements = upper - lower;
+}
+
 // Copy |source| to the end of |dest|.
 void runtime_concatArrays(runtime_array *dest, runtime_array *source, size_t elementSize, bool hasSubArrays) {
   size_t sourceNumElements = source->numElements;
@@ -555,6 +1285,55 @@ void runtime_concatArrays(runtime_array *dest, runtime_array *source, size_t ele
   }
 }
 
+// Append |text| to the current chunk of a StringBuilder.  Each chunk reserves
+// |chunkSize| bytes when it is started, so appending to it neither moves nor
+// zero-fills the text before it.  When the text does not fit, the current
+// chunk is moved, not copied, onto |chunks|, and a new one is started.
+void stringBuilderAppend(runtime_array *chunks, runtime_array *current, const runtime_array *text,
+    uint64_t chunkSize) {
+  size_t len = text->numElements;
+  if (len == 0) {
+    return;
+  }
+  size_t used = current->numElements;
+  if (used != 0 && used + len > chunkSize) {
+    size_t numChunks = chunks->numElements;
+    arrayResize(chunks, numChunks + 1, sizeof(runtime_array), true, true);
+    runtime_moveArray((runtime_array*)chunks->data + numChunks, current);
+    used = 0;
+  }
+  if (used == 0) {
+    runtime_allocArray(current, len, sizeof(uint8_t), false);
+    runtime_reserveArray(current, len > chunkSize? len : chunkSize, sizeof(uint8_t), false);
+  } else {
+    arrayResize(current, used + len, sizeof(uint8_t), false, true);
+  }
+  // Read text->data only now, since allocating may have compacted the heap.
+  runtime_memcopy((uint8_t*)current->data + used, (uint8_t*)text->data, len);
+}
+
+// Join a StringBuilder's chunks into one string, copying each byte once.
+void stringBuilderToString(runtime_array *string, const runtime_array *chunks,
+    const runtime_array *current) {
+  size_t numChunks = chunks->numElements;
+  size_t length = current->numElements;
+  for (size_t i = 0; i < numChunks; i++) {
+    length += ((runtime_array*)chunks->data)[i].numElements;
+  }
+  runtime_freeArray(string);
+  if (length == 0) {
+    return;
+  }
+  runtime_allocArray(string, length, sizeof(uint8_t), false);
+  uint8_t *p = (uint8_t*)string->data;
+  for (size_t i = 0; i < numChunks; i++) {
+    runtime_array *chunk = (runtime_array*)chunks->data + i;
+    runtime_memcopy(p, (uint8_t*)chunk->data, chunk->numElements);
+    p += chunk->numElements;
+  }
+  runtime_memcopy(p, (uint8_t*)current->data, current->numElements);
+}
+
 // Reverse the array by words.
 static void reverseWords(size_t *data, size_t numElements, size_t elementWords) {
   size_t *first = data;
@@ -598,6 +1377,78 @@ void runtime_reverseArray(runtime_array *array, size_t elementSize, bool hasSubA
   }
 }
 
+// Array comparison scans for the first differing byte a vector at a time.
+// Secret arrays are instead compared with kernels that always read every byte,
+// and accumulate differences with OR, so timing only depends on the lengths,
+// which are public.
+#if defined(__AVX2__)
+#define RN_COMPARE_BLOCK 32
+static inline uint32_t findDifferenceMask(const uint8_t *a, const uint8_t *b) {
+  __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)a),
+      _mm256_loadu_si256((const __m256i*)b));
+  return ~(uint32_t)_mm256_movemask_epi8(eq);
+}
+#elif defined(__SSE2__)
+#define RN_COMPARE_BLOCK 16
+static inline uint32_t findDifferenceMask(const uint8_t *a, const uint8_t *b) {
+  __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)a),
+      _mm_loadu_si128((const __m128i*)b));
+  return ~(uint32_t)_mm_movemask_epi8(eq) & 0xffff;
+}
+#endif
+
+// Return the offset of the first byte that differs, or |numBytes| if none do.
+static size_t findFirstDifferentByte(const uint8_t *a, const uint8_t *b, size_t numBytes) {
+  size_t i = 0;
+#ifdef RN_COMPARE_BLOCK
+  for (; i + RN_COMPARE_BLOCK <= numBytes; i += RN_COMPARE_BLOCK) {
+    uint32_t mask = findDifferenceMask(a + i, b + i);
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; i + sizeof(uint64_t) <= numBytes; i += sizeof(uint64_t)) {
+    uint64_t aWord, bWord;
+    memcpy(&aWord, a + i, sizeof(uint64_t));
+    memcpy(&bWord, b + i, sizeof(uint64_t));
+    if (aWord != bWord) {
+      break;
+    }
+  }
+  while (i < numBytes && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+// Return non-zero if any byte differs.  This reads every byte, and has no
+// data dependent branches.
+static uint64_t accumulateDifferences(const uint8_t *a, const uint8_t *b, size_t numBytes) {
+  size_t i = 0;
+  uint64_t diff = 0;
+#if defined(__SSE2__)
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 16 <= numBytes; i += 16) {
+    acc = _mm_or_si128(acc, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)),
+        _mm_loadu_si128((const __m128i*)(b + i))));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i*)lanes, acc);
+  diff = lanes[0] | lanes[1];
+#endif
+  for (; i + sizeof(uint64_t) <= numBytes; i += sizeof(uint64_t)) {
+    uint64_t aWord, bWord;
+    memcpy(&aWord, a + i, sizeof(uint64_t));
+    memcpy(&bWord, b + i, sizeof(uint64_t));
+    diff |= aWord ^ bWord;
+  }
+  for (; i < numBytes; i++) {
+    diff |= a[i] ^ b[i];
+  }
+  return diff;
+}
+
 // Set |aElemPtr| and |bElemPtr| to point to the first elements in the array that
 // are different.
 static void findArrayFirstDifferentElements(const runtime_array *a, const runtime_array *b,
@@ -605,21 +1456,17 @@ static void findArrayFirstDifferentElements(const runtime_array *a, const runtim
   uint8_t *aPtr = (uint8_t*)(a->data);
   uint8_t *bPtr = (uint8_t*)(b->data);
   size_t numElements = a->numElements <= b->numElements? a->numElements : b->numElements;
-  while (numElements > 0 && !memcmp(aPtr, bPtr, elementSize)) {
-    numElements--;
-    aPtr += elementSize;
-    bPtr += elementSize;
-  }
-  if (numElements == 0) {
+  size_t index = findFirstDifferentByte(aPtr, bPtr, numElements * elementSize) / elementSize;
+  if (index == numElements) {
     if (a->numElements > b->numElements) {
-      *aElemPtr = aPtr;
+      *aElemPtr = aPtr + index * elementSize;
     } else if (b->numElements > a->numElements) {
-      *bElemPtr = bPtr;
+      *bElemPtr = bPtr + index * elementSize;
     }
     return;
   }
-  *aElemPtr = aPtr;
-  *bElemPtr = bPtr;
+  *aElemPtr = aPtr + index * elementSize;
+  *bElemPtr = bPtr + index * elementSize;
 }
 
 // Set |aElemPtr| and |bElemPtr| to point to the first elements in the array that
@@ -635,7 +1482,7 @@ static void findSubArrayFirstDifferentElements(const runtime_array *a, const run
     if (hasSubArrays) {
       findSubArrayFirstDifferentElements(aPtr, bPtr, elementSize, aElemPtr, bElemPtr);
     } else {
-      findArrayFirstDifferentElements(a, b, elementSize, aElemPtr, bElemPtr);
+      findArrayFirstDifferentElements(aPtr, bPtr, elementSize, aElemPtr, bElemPtr);
     }
     if (*aElemPtr != NULL || *bElemPtr != NULL) {
       return;
@@ -645,9 +1492,35 @@ static void findSubArrayFirstDifferentElements(const runtime_array *a, const run
   }
   if (a->numElements > b->numElements) {
     *aElemPtr = aPtr;
-  } else if (b->numElements > numElements) {
-    *aElemPtr = aPtr;
+  } else if (b->numElements > a->numElements) {
+    *bElemPtr = bPtr;
+  }
+}
+
+// Read an integer element of 1, 2, 4, or 8 bytes.
+static inline size_t readElement(const void *ptr, size_t elementSize) {
+  switch (elementSize) {
+    case 1:
+      return *(const uint8_t *)ptr;
+    case 2:
+      return *(const uint16_t *)ptr;
+    case 4:
+      return *(const uint32_t *)ptr;
+    case 8:
+      return *(const size_t *)ptr;
+    default:
+      runtime_panicCstr("Unsupported integer width");
   }
+  return 0;  // Dummy return.
+}
+
+// Return -1 if a < b, 0 if a == b, and 1 if a > b, without branches.  Signed
+// values must have their sign bits toggled.
+static inline int32_t compareWordsConstantTime(size_t a, size_t b) {
+  uint32_t shift = sizeof(size_t) * 8 - 1;
+  size_t aLTb = ((~a & b) | ((~a | b) & (a - b))) >> shift;
+  size_t bLTa = ((~b & a) | ((~b | a) & (b - a))) >> shift;
+  return (int32_t)bLTa - (int32_t)aLTb;
 }
 
 // Compare two basic types.  Return -1 if a < b, 0 if a == b, and 1 if a > b.
@@ -662,80 +1535,111 @@ static int32_t compareElements(runtime_type elementType, void *aPtr, void *bPtr,
     }
     return 1;
   }
-  size_t a = 0;
-  size_t b = 0;
-  switch (elementSize) {
-    case 1:
-      a = *(uint8_t *)aPtr;
-      b = *(uint8_t *)bPtr;
-      break;
-    case 2:
-      a = *(uint16_t *)aPtr;
-      b = *(uint16_t *)bPtr;
-      break;
-    case 4:
-      a = *(uint32_t *)aPtr;
-      b = *(uint32_t *)bPtr;
-      break;
-    case 8:
-      a = *(size_t *)aPtr;
-      b = *(size_t *)bPtr;
-      break;
-    default:
-      runtime_panicCstr("Unsupported integer width");
-  }
-  if (a == b) {
-    return 0;
-  }
+  size_t a = readElement(aPtr, elementSize);
+  size_t b = readElement(bPtr, elementSize);
   if (!secret) {
+    if (a == b) {
+      return 0;
+    }
     switch (elementType) {
       case RN_UINT:
         return a < b ? -1 : 1;
-      case RN_INT:
-        return (int64_t)a < (int64_t)b ? -1 : 1;
+      case RN_INT: {
+        // Sign extend narrow elements.
+        uint32_t shift = (sizeof(size_t) - elementSize) * 8;
+        return (int64_t)(a << shift) < (int64_t)(b << shift) ? -1 : 1;
+      }
       default:
         runtime_panicCstr("Unsupported type in array comparison");
     }
   } else {
-    uint32_t shift = sizeof(size_t) * 8 - 1;
     if (elementType == RN_INT) {
       // If sign bits are equal, then toggling sign bits does not change the
       // outcome.  If they are different, then toggling the sign big corrects
       // the interpretation of which is larger when viewed as unsigned.
-      a ^= (size_t)1 << shift;
-      b ^= (size_t)1 << shift;
+      size_t signBit = (size_t)1 << (elementSize * 8 - 1);
+      a ^= signBit;
+      b ^= signBit;
     } else if (elementType != RN_UINT) {
       runtime_panicCstr("Unsupported type in array comparison");
     }
-    size_t aGTb = (b - a) >> shift;
-    size_t bGTa = (a - b) >> shift;
-    return aGTb - bGTa;
+    return compareWordsConstantTime(a, b);
   }
   return 0;  // Dummy return.
 }
 
+// Compare the first |numElements| elements of secret integer arrays lexically.
+// Every element is compared, and the result of the first difference is kept
+// with masks, so timing does not depend on where the arrays differ.
+static int32_t compareSecretElements(runtime_type elementType, const uint8_t *a,
+    const uint8_t *b, size_t numElements, size_t elementSize) {
+  uint32_t result = 0;
+  for (size_t i = 0; i < numElements; i++) {
+    uint32_t cmp = (uint32_t)compareElements(elementType, (void*)(a + i * elementSize),
+        (void*)(b + i * elementSize), elementSize, true);
+    // All ones while no difference has been found.
+    uint32_t undecided = ((result | -result) >> 31) - 1;
+    result |= cmp & undecided;
+  }
+  return (int32_t)result;
+}
+
+// Return true if the arrays have the same length and contents.  For secret
+// arrays, every byte is read no matter where they differ.  This is the fast path
+// for == and != on arrays without sub-arrays, such as string keys in hash
+// tables.
+bool runtime_arraysEqual(const runtime_array *a, const runtime_array *b, size_t elementSize,
+    bool secret) {
+  if (a->numElements != b->numElements) {
+    return false;
+  }
+  size_t numBytes = a->numElements * elementSize;
+  if (secret) {
+    return accumulateDifferences((const uint8_t*)a->data, (const uint8_t*)b->data, numBytes) == 0;
+  }
+  return a->data == b->data || numBytes == 0 || !memcmp(a->data, b->data, numBytes);
+}
+
 // Compare two arrays lexically.  Return true or false according to the operator
 // selected with lessThan and OrEqual.  If |secret| is true, use constant-time
-// comparison.
-// TODO: Finish making this constant time for secrets!
+// comparison.  Array lengths are not secret.
+// TODO: Finish making this constant time for secret arrays with sub-arrays!
 bool runtime_compareArrays(runtime_comparisonType compareType, runtime_type elementType, const runtime_array *a,
     const runtime_array *b, size_t elementSize, bool hasSubArrays, bool secret) {
-  void *aPtr = NULL;
-  void *bPtr = NULL;
-  if (hasSubArrays) {
-    findSubArrayFirstDifferentElements(a, b, elementSize, &aPtr, &bPtr);
-  } else {
-    findArrayFirstDifferentElements(a, b, elementSize, &aPtr, &bPtr);
+  bool bigintElements = (elementType == RN_UINT || elementType == RN_INT) &&
+      elementSize == sizeof(runtime_array);
+  if (!hasSubArrays && !bigintElements) {
+    if (compareType == RN_EQUAL) {
+      return runtime_arraysEqual(a, b, elementSize, secret);
+    } else if (compareType == RN_NOTEQUAL) {
+      return !runtime_arraysEqual(a, b, elementSize, secret);
+    }
   }
   int32_t result;
-  if (aPtr == NULL && bPtr == NULL) {
-    result = 0;
-  } else if (aPtr == NULL) {
-    result = -1;
-  } else if (bPtr == NULL) {
-    result = 1;
+  if (secret && !hasSubArrays && !bigintElements) {
+    size_t numElements = a->numElements <= b->numElements? a->numElements : b->numElements;
+    result = compareSecretElements(elementType, (const uint8_t*)a->data,
+        (const uint8_t*)b->data, numElements, elementSize);
+    if (result == 0 && a->numElements != b->numElements) {
+      result = a->numElements < b->numElements? -1 : 1;
+    }
   } else {
-    result = compareElements(elementType, aPtr, bPtr, elementSize, secret);
+    void *aPtr = NULL;
+    void *bPtr = NULL;
+    if (hasSubArrays) {
+      findSubArrayFirstDifferentElements(a, b, elementSize, &aPtr, &bPtr);
+    } else {
+      findArrayFirstDifferentElements(a, b, elementSize, &aPtr, &bPtr);
+    }
+    if (aPtr == NULL && bPtr == NULL) {
+      result = 0;
+    } else if (aPtr == NULL) {
+      result = -1;
+    } else if (bPtr == NULL) {
+      result = 1;
+    } else {
+      result = compareElements(elementType, aPtr, bPtr, elementSize, secret);
+    }
   }
   switch (compareType) {
     case RN_LT:
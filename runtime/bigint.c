@@ -18,6 +18,8 @@
 // them after any operation that effects the heap.
 #include "runtime.h"
 #include "../../CTTK/cttk.h"
+#include <pthread.h>  // For freeing temporaries when threads exit.
+#include <stdlib.h>  // For calloc and free.
 #include <sys/types.h>
 
 // TODO: disable this.
@@ -114,6 +116,7 @@ void runtime_bigintSetSecret(runtime_array *bigint, bool value) {
   }
   if (value) {
     *data |= RN_SECRET_BIT;
+    runtime_markSecretArray(bigint, false);
   } else {
     *data &= ~RN_SECRET_BIT;
   }
@@ -173,13 +176,16 @@ runtime_bool runtime_bigintZero(const runtime_array *a) {
   for (uint64_t i = 2; i < a->numElements; i++) {
     result |= data[i];
   }
+  RN_VALUE_BARRIER(result);
   return runtime_boolToRnBool(result == 0);
 }
 
 // Return true of the bigint is < 0.
 runtime_bool runtime_bigintNegative(const runtime_array *a) {
   const uint32_t *data =  getConstBigintData(a);
-  return runtime_boolToRnBool((data[a->numElements - 1] >> 30) != 0);
+  uint32_t sign = (data[a->numElements - 1] >> 30) & 1;
+  RN_VALUE_BARRIER(sign);
+  return runtime_boolToRnBool(sign);
 }
 
 // Resize a bigint in place.
@@ -215,16 +221,111 @@ static inline void setSecret(uint32_t *data, bool secret) {
 
 // Initialize a bigint in an array.  Bigints are stored in arrays on the array heap.
 static void initBigint(runtime_array *bigint, uint32_t width, bool isSigned, bool secret) {
-  if (runtime_bigintWidth(bigint) != width) {
+  // Unsigned bigints have a hidden extra bit, so a change of signedness needs
+  // a new CTTK header even at the same width.
+  if (runtime_bigintWidth(bigint) != width || runtime_bigintSigned(bigint) != isSigned) {
     resizeBigint(bigint, width, isSigned);
   }
   uint32_t *data = getBigintData(bigint);
   setSigned(data, isSigned);
   setSecret(data, secret);
+  if (secret) {
+    runtime_markSecretArray(bigint, false);
+  }
   // Clear the NaN bit.
   data[1] &= ~RN_NAN_BIT;
 }
 
+// Temporary bigints are declared with RN_TEMP_BIGINT, so each call site keeps
+// its own scratch buffers, already sized by the last call.  Reusing them saves
+// an allocation and a wipe per temporary on every call.  Each thread frees its
+// temporaries when it exits, and runtime_arrayStop frees the main thread's.
+#define RN_TEMP_BIGINT(name) \
+  static _Thread_local runtime_array name; \
+  static _Thread_local bool name##Registered; \
+  if (!name##Registered) { \
+    registerTempBigint(&name); \
+    name##Registered = true; \
+  }
+
+// The most temporaries a thread can have.  There are fewer RN_TEMP_BIGINTs.
+#define RN_MAX_TEMP_BIGINTS 64
+
+typedef struct {
+  uint32_t numTemps;
+  runtime_array *temps[RN_MAX_TEMP_BIGINTS];
+} runtime_tempBigints;
+
+static _Thread_local runtime_tempBigints runtime_threadTempBigints;
+static pthread_key_t runtime_tempBigintKey;
+static pthread_once_t runtime_tempBigintOnce = PTHREAD_ONCE_INIT;
+
+// Free the exiting thread's temporaries.  Secret ones are wiped.
+static void freeTempBigints(void *tempBigints) {
+  runtime_tempBigints *list = tempBigints;
+  for (uint32_t i = 0; i < list->numTemps; i++) {
+    runtime_freeArray(list->temps[i]);
+  }
+  list->numTemps = 0;
+}
+
+// Free the calling thread's temporaries, which live in the array heap, before
+// runtime_arrayStop unmaps it.  They stay registered, and are reallocated if
+// used again after runtime_arrayStart.
+void runtime_freeTempBigints(void) {
+  runtime_tempBigints *list = &runtime_threadTempBigints;
+  for (uint32_t i = 0; i < list->numTemps; i++) {
+    runtime_freeArray(list->temps[i]);
+  }
+}
+
+// Create the key whose destructor frees each thread's temporaries.
+static void createTempBigintKey(void) {
+  pthread_key_create(&runtime_tempBigintKey, freeTempBigints);
+}
+
+// Remember the temporary, so it is freed when the thread exits.
+static void registerTempBigint(runtime_array *temp) {
+  runtime_tempBigints *list = &runtime_threadTempBigints;
+  if (list->numTemps == 0) {
+    pthread_once(&runtime_tempBigintOnce, createTempBigintKey);
+    // Key destructors only run for threads that set a non-NULL value.
+    pthread_setspecific(runtime_tempBigintKey, list);
+  }
+  if (list->numTemps == RN_MAX_TEMP_BIGINTS) {
+    runtime_panicCstr("Too many temporary bigints");
+  }
+  list->temps[list->numTemps++] = temp;
+}
+
+// Copy |source| into |dest|, reusing dest's buffer when it has the right size.
+static void setBigint(runtime_array *dest, const runtime_array *source) {
+  if (dest == source) {
+    return;
+  }
+  if (dest->numElements != source->numElements) {
+    runtime_resizeArray(dest, source->numElements, sizeof(uint32_t), false);
+  }
+  memcpy(dest->data, source->data, source->numElements * sizeof(uint32_t));
+  if (runtime_bigintSecret(source)) {
+    runtime_markSecretArray(dest, false);
+  }
+}
+
+// Wipe limbs which may hold secrets, in a way the compiler will not elide.
+static void wipeLimbs(uint32_t *limbs, uint32_t numLimbs) {
+  memset(limbs, 0, numLimbs * sizeof(uint32_t));
+  __asm__ __volatile__("" : : "r"(limbs) : "memory");
+}
+
+// Done with a temporary bigint.  Its buffer is kept for the next call, so
+// wipe its value now if it was secret.
+static void releaseTempBigint(runtime_array *temp) {
+  if (runtime_bigintSecret(temp)) {
+    wipeLimbs(getBigintData(temp) + 2, temp->numElements - 2);
+  }
+}
+
 // Cast a bigint.  If truncate is true, don't raise an exception if we lose bits.
 // and truncate is false.
 void runtime_bigintCast(runtime_array *dest, runtime_array *source, uint32_t newWidth,
@@ -237,6 +338,7 @@ void runtime_bigintCast(runtime_array *dest, runtime_array *source, uint32_t new
   }
   if (secret) {
     *destData |= RN_SECRET_BIT;
+    runtime_markSecretArray(dest, false);
   }
   if (truncate) {
     cti_set_trunc(destData + 1, sourceData + 1);
@@ -295,6 +397,78 @@ uint64_t runtime_bigintToIntegerTrunc(const runtime_array *source) {
   return result;
 }
 
+// Return the 31 bits at bit |pos| of a native integer of |numWords| little
+// endian 64-bit words.  Bits past the end are |fill|: all ones for negative
+// signed integers, else 0.
+static inline uint32_t getNativeIntLimb(const uint64_t *words, uint32_t numWords,
+    uint32_t pos, uint64_t fill) {
+  uint32_t index = pos >> 6;
+  uint32_t shift = pos & 63;
+  uint64_t low = index < numWords? words[index] : fill;
+  uint64_t high = index + 1 < numWords? words[index + 1] : fill;
+  uint64_t bits = low >> shift;
+  if (shift != 0) {
+    bits |= high << (64 - shift);
+  }
+  return bits & 0x7fffffff;
+}
+
+// Convert a native LLVM integer, used for integers of up to 512 bits with
+// -nativeints, to a bigint.  The value is stored as little endian 64-bit
+// words, and bits above |width| in the last word are ignored, since LLVM does
+// not define them.  This runs in constant time, since only the width
+// determines the loop bounds.
+void runtime_nativeIntToBigint(runtime_array *dest, const uint64_t *words, uint32_t width,
+    bool isSigned, bool secret) {
+  if (width > runtime_maxNativeWideIntWidth) {
+    runtime_panicCstr("Native integer wider than %u bits", runtime_maxNativeWideIntWidth);
+  }
+  uint64_t value[runtime_maxNativeWideIntWidth >> 6];
+  uint32_t numNativeWords = (width + 63) >> 6;
+  memcpy(value, words, numNativeWords * sizeof(uint64_t));
+  uint32_t topBits = width & 63;
+  uint64_t *top = value + numNativeWords - 1;
+  if (topBits != 0) {
+    uint64_t mask = ((uint64_t)1 << topBits) - 1;
+    uint64_t signBits = isSigned? -((*top >> (topBits - 1)) & 1) : 0;
+    *top = (*top & mask) | (signBits & ~mask);
+  }
+  uint64_t fill = isSigned? -(*top >> 63) : 0;
+  initBigint(dest, width, isSigned, secret);
+  uint32_t *data = getBigintData(dest);
+  uint32_t numWords = dest->numElements;
+  for (uint32_t i = 2; i < numWords; i++) {
+    data[i] = getNativeIntLimb(value, numNativeWords, (i - 2)*31, fill);
+  }
+  if (secret) {
+    wipeLimbs((uint32_t *)value, numNativeWords * 2);
+  }
+}
+
+// Convert a bigint to a native LLVM integer of |width| bits, written as
+// little endian 64-bit words.  Bits above |width| in the last word are
+// undefined.  Throw an exception if it does not fit, unless |truncate| is set.
+void runtime_bigintToNativeInt(uint64_t *words, runtime_array *source, uint32_t width,
+    bool isSigned, bool truncate) {
+  RN_TEMP_BIGINT(t);
+  runtime_bigintCast(&t, source, width, isSigned, runtime_bigintSecret(source), truncate);
+  const uint32_t *data = getConstBigintData(&t);
+  uint32_t numNativeWords = (width + 63) >> 6;
+  memset(words, 0, numNativeWords * sizeof(uint64_t));
+  for (uint32_t i = 2; i < t.numElements; i++) {
+    uint32_t pos = (i - 2)*31;
+    uint32_t index = pos >> 6;
+    uint32_t shift = pos & 63;
+    if (index < numNativeWords) {
+      words[index] |= (uint64_t)data[i] << shift;
+    }
+    if (shift > 64 - 31 && index + 1 < numNativeWords) {
+      words[index + 1] |= (uint64_t)data[i] >> (64 - shift);
+    }
+  }
+  releaseTempBigint(&t);
+}
+
 // Convert a string (u8 array) to a bigint, little-endian.
 void runtime_bigintDecodeLittleEndian(runtime_array *dest, runtime_array *byteArray,
     uint32_t width, bool isSigned, bool secret) {
@@ -472,27 +646,277 @@ void runtime_bigintMod(runtime_array *dest, runtime_array *a, runtime_array *b)
   binaryOperation(cti_mod, dest, a, b);
 }
 
+// Public bigints are converted to sign and magnitude in 64-bit limbs for the
+// variable time engine in pubbigint.c.  Each thread keeps one scratch buffer
+// for the operands, results and the engine's scratch space.
+static _Thread_local uint64_t *runtime_publicScratch;
+static _Thread_local uint64_t runtime_publicScratchLimbs;
+
+// Return the thread's public scratch buffer, with at least |numLimbs| limbs.
+static uint64_t *getPublicScratch(uint64_t numLimbs) {
+  if (numLimbs > runtime_publicScratchLimbs) {
+    free(runtime_publicScratch);
+    runtime_publicScratch = calloc(numLimbs, sizeof(uint64_t));
+    if (runtime_publicScratch == NULL) {
+      runtime_panicCstr("Out of memory for public bigint scratch space");
+    }
+    runtime_publicScratchLimbs = numLimbs;
+  }
+  return runtime_publicScratch;
+}
+
+// Return the number of 64-bit limbs that hold the CTTK words of a bigint.
+static inline uint32_t findPublicLimbs(const runtime_array *bigint) {
+  return ((bigint->numElements - 2) * 31 + 63) / 64;
+}
+
+// Negate the two's complement value in |limbs|.
+static void negateLimbs(uint64_t *limbs, uint32_t numLimbs) {
+  uint64_t carry = 1;
+  for (uint32_t i = 0; i < numLimbs; i++) {
+    uint64_t limb = ~limbs[i] + carry;
+    carry = carry && limb == 0;
+    limbs[i] = limb;
+  }
+}
+
+// Read the 31-bit CTTK words of |bigint| into |numLimbs| 64-bit limbs as a
+// magnitude, set |negative| to the sign, and return the length without high
+// zero limbs.
+static uint32_t readPublicBigint(const runtime_array *bigint, uint64_t *limbs,
+    uint32_t numLimbs, bool *negative) {
+  const uint32_t *data = getConstBigintData(bigint);
+  uint32_t numWords = bigint->numElements - 2;
+  uint64_t acc = 0;
+  uint32_t accBits = 0;
+  uint32_t pos = 0;
+  for (uint32_t i = 0; i < numWords; i++) {
+    uint64_t word = data[i + 2] & 0x7fffffff;
+    acc |= word << accBits;
+    accBits += 31;
+    if (accBits >= 64) {
+      limbs[pos++] = acc;
+      accBits -= 64;
+      acc = accBits == 0? 0 : word >> (31 - accBits);
+    }
+  }
+  // The top CTTK word is already sign extended through bit 30.
+  *negative = (data[numWords + 1] >> 30) & 1;
+  if (pos < numLimbs) {
+    limbs[pos++] = *negative? acc | (~(uint64_t)0 << accBits) : acc;
+  }
+  if (*negative) {
+    negateLimbs(limbs, numLimbs);
+  }
+  while (numLimbs > 0 && limbs[numLimbs - 1] == 0) {
+    numLimbs--;
+  }
+  return numLimbs;
+}
+
+// Return true if the magnitude in |limbs| with the given sign fits in a
+// two's complement integer of |width| bits.
+static bool publicMagnitudeFits(const uint64_t *limbs, uint32_t len, bool negative,
+    uint32_t width) {
+  if (len == 0) {
+    return true;
+  }
+  uint64_t top = limbs[len - 1];
+  uint64_t numBits = 64*((uint64_t)len - 1) + 64 - __builtin_clzll(top);
+  if (numBits < width) {
+    return true;
+  }
+  if (!negative || numBits > width || (top & (top - 1)) != 0) {
+    return false;
+  }
+  // Only -2^(width-1) has a magnitude of width bits.
+  for (uint32_t i = 0; i + 1 < len; i++) {
+    if (limbs[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Write the magnitude in |limbs| with the given sign to |dest|, which already
+// has its type.  |limbs| must have room for findPublicLimbs(dest) limbs.  If
+// the result does not fit, truncate it when |truncate| is true, and otherwise
+// set dest to NaN.
+static void writePublicBigint(runtime_array *dest, uint64_t *limbs, uint32_t len,
+    bool negative, bool truncate) {
+  uint32_t *data = getBigintData(dest);
+  uint32_t width = getBigintWidth(data);
+  if (!truncate && !publicMagnitudeFits(limbs, len, negative, width)) {
+    data[1] |= RN_NAN_BIT;
+    return;
+  }
+  uint32_t numLimbs = findPublicLimbs(dest);
+  for (uint32_t i = len; i < numLimbs; i++) {
+    limbs[i] = 0;
+  }
+  if (negative) {
+    negateLimbs(limbs, numLimbs);
+  }
+  uint32_t numWords = dest->numElements - 2;
+  for (uint32_t i = 0; i < numWords; i++) {
+    uint32_t bit = i * 31;
+    uint32_t limb = bit / 64;
+    uint32_t shift = bit % 64;
+    uint64_t word = limbs[limb] >> shift;
+    if (shift > 33 && limb + 1 < numLimbs) {
+      word |= limbs[limb + 1] << (64 - shift);
+    }
+    data[i + 2] = word & 0x7fffffff;
+  }
+  // Sign extend the top word from the sign bit, which truncates the value.
+  uint32_t signPos = getSignBitPosition(data);
+  uint32_t lowMask = (1u << signPos) - 1;
+  uint32_t top = data[numWords + 1];
+  data[numWords + 1] = (top >> signPos) & 1? top | (0x7fffffff & ~lowMask) : top & lowMask;
+}
+
+typedef enum {
+  RN_PUBLIC_MUL,
+  RN_PUBLIC_MUL_TRUNC,
+  RN_PUBLIC_DIVREM,
+} runtime_publicBigintOp;
+
+// Multiply or divide public bigints.  For RN_PUBLIC_DIVREM, either of |dest|
+// and |rem| can be NULL.  Like CTTK, division rounds toward zero, the
+// remainder has the sign of |a|, and dividing by zero yields NaN.
+static void publicOperation(runtime_publicBigintOp op, runtime_array *dest, runtime_array *rem,
+    runtime_array *a, runtime_array *b) {
+  if (a->data == NULL || b->data == NULL) {
+    runtime_panicCstr("Null array passed to publicOperation");
+  }
+  checkBigintsHaveSameType(a, b);
+  uint32_t n = findPublicLimbs(a);
+  uint64_t engineScratch = op == RN_PUBLIC_DIVREM? 2*(uint64_t)n + 1 :
+      runtime_limbsMulScratchSize(n, n);
+  uint64_t *aLimbs = getPublicScratch(6*(uint64_t)n + engineScratch);
+  uint64_t *bLimbs = aLimbs + n;
+  uint64_t *result = bLimbs + n;
+  uint64_t *remLimbs = result + 2*n;
+  uint64_t *scratch = remLimbs + 2*n;
+  bool aNegative, bNegative;
+  uint32_t aLen = readPublicBigint(a, aLimbs, n, &aNegative);
+  uint32_t bLen = readPublicBigint(b, bLimbs, n, &bNegative);
+  uint32_t width = runtime_bigintWidth(a);
+  bool isSigned = runtime_bigintSigned(a);
+  // Initializing the destination may resize it, so both operands are read first.
+  if (op != RN_PUBLIC_DIVREM) {
+    runtime_limbsMul(result, aLimbs, aLen, bLimbs, bLen, scratch);
+    uint32_t len = aLen + bLen;
+    while (len > 0 && result[len - 1] == 0) {
+      len--;
+    }
+    initBigint(dest, width, isSigned, false);
+    writePublicBigint(dest, result, len, aNegative != bNegative, op == RN_PUBLIC_MUL_TRUNC);
+    checkForNAN(dest);
+    return;
+  }
+  if (dest != NULL) {
+    initBigint(dest, width, isSigned, false);
+  }
+  if (rem != NULL) {
+    initBigint(rem, width, isSigned, false);
+  }
+  if (bLen == 0) {
+    runtime_array *nanResult = dest != NULL? dest : rem;
+    getBigintData(nanResult)[1] |= RN_NAN_BIT;
+    checkForNAN(nanResult);
+    return;
+  }
+  runtime_limbsDivRem(result, remLimbs, aLimbs, aLen, bLimbs, bLen, scratch);
+  if (dest != NULL) {
+    uint32_t len = aLen;
+    while (len > 0 && result[len - 1] == 0) {
+      len--;
+    }
+    writePublicBigint(dest, result, len, aNegative != bNegative, false);
+    checkForNAN(dest);
+  }
+  if (rem != NULL) {
+    uint32_t len = bLen;
+    while (len > 0 && remLimbs[len - 1] == 0) {
+      len--;
+    }
+    writePublicBigint(rem, remLimbs, len, aNegative, false);
+    checkForNAN(rem);
+  }
+}
+
+// Multiply two public bigints in variable time.  Throw an exception on overflow.
+void runtime_publicBigintMul(runtime_array *dest, runtime_array *a, runtime_array *b) {
+  if (runtime_bigintSecret(a) || runtime_bigintSecret(b)) {
+    runtime_bigintMul(dest, a, b);
+    return;
+  }
+  publicOperation(RN_PUBLIC_MUL, dest, NULL, a, b);
+}
+
+// Multiply two public bigints in variable time.  Truncate the result if it is
+// too big.
+void runtime_publicBigintMulTrunc(runtime_array *dest, runtime_array *a, runtime_array *b) {
+  if (runtime_bigintSecret(a) || runtime_bigintSecret(b)) {
+    runtime_bigintMulTrunc(dest, a, b);
+    return;
+  }
+  publicOperation(RN_PUBLIC_MUL_TRUNC, dest, NULL, a, b);
+  fixUnderflow(dest);
+}
+
+// Divide two public bigints in variable time.  Throw an exception if |b| is 0.
+void runtime_publicBigintDiv(runtime_array *dest, runtime_array *a, runtime_array *b) {
+  if (runtime_bigintSecret(a) || runtime_bigintSecret(b)) {
+    runtime_bigintDiv(dest, a, b);
+    return;
+  }
+  publicOperation(RN_PUBLIC_DIVREM, dest, NULL, a, b);
+}
+
+// Compute the remainder of two public bigints in variable time.  Throw an
+// exception if |b| is 0.
+void runtime_publicBigintMod(runtime_array *dest, runtime_array *a, runtime_array *b) {
+  if (runtime_bigintSecret(a) || runtime_bigintSecret(b)) {
+    runtime_bigintMod(dest, a, b);
+    return;
+  }
+  publicOperation(RN_PUBLIC_DIVREM, NULL, dest, a, b);
+}
+
+// Compute the quotient and remainder of two public bigints in variable time.
+void runtime_publicBigintDivRem(runtime_array *q, runtime_array *r, runtime_array *a, runtime_array *b) {
+  if (runtime_bigintSecret(a) || runtime_bigintSecret(b)) {
+    runtime_bigintDivRem(q, r, a, b);
+    return;
+  }
+  publicOperation(RN_PUBLIC_DIVREM, q, r, a, b);
+}
+
 // Variable time non-modular exponentiation.  The base may be secret, but not
 // the exponent, which must be unsigned.  |dest| and |base| can be the same.
 void runtime_bigintExp(runtime_array *dest, runtime_array *base, uint32_t exponent) {
   uint32_t width = runtime_bigintWidth(base);
   bool isSigned = runtime_bigintSigned(base);
   bool secret = runtime_bigintSecret(base);
-  runtime_array t = runtime_makeEmptyArray();
-  runtime_copyBigint(&t, base);
+  void (*mul)(runtime_array *dest, runtime_array *a, runtime_array *b) =
+      secret? runtime_bigintMul : runtime_publicBigintMul;
+  RN_TEMP_BIGINT(t);
+  setBigint(&t, base);
   // Set dest to 1 after initializing t in case dest == base.
   runtime_integerToBigint(dest, 1, width, isSigned, secret);
   while (exponent != 0) {
     if (exponent & 1) {
-      runtime_bigintMul(dest, dest, &t);
+      mul(dest, dest, &t);
     }
     exponent >>= 1;
     if (exponent != 0) {
       // Be careful not to overflow t with an extra squaring.
-      runtime_bigintMul(&t, &t, &t);
+      mul(&t, &t, &t);
     }
   }
-  runtime_freeArray(&t);
+  releaseTempBigint(&t);
 }
 
 typedef void (*runtime_unaryBigintFunc)(cti_elt *d, const cti_elt *a);
@@ -544,13 +968,13 @@ static void rotateBigint(runtime_array *dest, runtime_array *source, uint32_t di
   if (!rotateLeft) {
     dist = width - dist;
   }
-  runtime_array tmp = runtime_makeEmptyArray();
+  RN_TEMP_BIGINT(tmp);
   initBigint(&tmp, width, false, runtime_bigintSecret(source));
   runtime_bigintShl(&tmp, source, dist);
   runtime_bigintShr(dest, source, (width - dist));
   runtime_bigintBitwiseOr(dest, dest, &tmp);
   fixUnderflow(dest);
-  runtime_freeArray(&tmp);
+  releaseTempBigint(&tmp);
 }
 
 // Rotate a bigint left by |dist| bits.
@@ -617,23 +1041,23 @@ void runtime_bigintBitwiseXor(runtime_array *dest, runtime_array *a, runtime_arr
 // value < 0.
 static void subtractModulusIfNeeded(runtime_array *value, runtime_array *modulus) {
   uint32_t width = runtime_bigintWidth(modulus);
-  runtime_array tmp = runtime_makeEmptyArray();
+  RN_TEMP_BIGINT(tmp);
   initBigint(&tmp, width, false, runtime_bigintSecret(value));
   binaryOperation(cti_sub_trunc, &tmp, value, modulus);
   runtime_bool ctl = runtime_boolToRnBool(runtime_compareBigints(RN_GE, value, modulus));
   ctl = runtime_boolOr(ctl, runtime_bigintNegative(value));
   runtime_bigintCondCopy(ctl, value, &tmp);
-  runtime_freeArray(&tmp);
+  releaseTempBigint(&tmp);
 }
 
 // Constant-time add modulus to X if X < 0.
 static void addModulusIfNeeded(runtime_array *value, runtime_array *modulus) {
   uint32_t width = runtime_bigintWidth(modulus);
-  runtime_array tmp = runtime_makeEmptyArray();
+  RN_TEMP_BIGINT(tmp);
   initBigint(&tmp, width, false, runtime_bigintSecret(value));
   binaryOperation(cti_add_trunc, &tmp, value, modulus);
   runtime_bigintCondCopy(runtime_bigintNegative(value), value, &tmp);
-  runtime_freeArray(&tmp);
+  releaseTempBigint(&tmp);
 }
 
 // Constant time modular addition.
@@ -652,17 +1076,17 @@ void runtime_bigintModularSub(runtime_array *dest, runtime_array *a, runtime_arr
 static uint64_t secretSmallnumBinaryOp(
     void (*func)(runtime_array *dest, runtime_array *a, runtime_array *b), uint64_t a,
     uint64_t b, bool aIsSigned, bool bIsSigned) {
-  runtime_array bigA = runtime_makeEmptyArray();
+  RN_TEMP_BIGINT(bigA);
   runtime_integerToBigint(&bigA, a, sizeof(uint64_t)*8, aIsSigned, true);
-  runtime_array bigB = runtime_makeEmptyArray();
+  RN_TEMP_BIGINT(bigB);
   runtime_integerToBigint(&bigB, b, sizeof(uint64_t)*8, false, false);
-  runtime_array bigResult = runtime_makeEmptyArray();
+  RN_TEMP_BIGINT(bigResult);
   initBigint(&bigResult, sizeof(uint64_t)*8, false, true);
   func(&bigResult, &bigA, &bigB);
   uint64_t result = runtime_bigintToInteger(&bigResult);
-  runtime_freeArray(&bigA);
-  runtime_freeArray(&bigB);
-  runtime_freeArray(&bigResult);
+  releaseTempBigint(&bigA);
+  releaseTempBigint(&bigB);
+  releaseTempBigint(&bigResult);
   return result;
 }
 
@@ -695,6 +1119,175 @@ uint64_t runtime_smallnumModularNegate(uint64_t a, uint64_t modulus, bool secret
   return modulus - a;
 }
 
+// Montgomery arithmetic works directly on the 31-bit limbs of CTTK integers,
+// least significant first, which follow the CTTK header word.  The context for
+// the most recent odd modulus is cached, since modular code tends to use one
+// modulus over and over.  Moduli are never secret, but the values are, so all
+// operations on values are constant time.
+#define RN_LIMB_MASK 0x7fffffffu
+#define RN_MONTY_WINDOW_BITS 4u
+#define RN_MONTY_WINDOW_SIZE (1u << RN_MONTY_WINDOW_BITS)
+
+typedef struct {
+  uint32_t numLimbs;
+  uint32_t m0i;  // -1/m mod 2^31.
+  uint32_t *modulus;
+  uint32_t *r2;  // R^2 mod m, where R = 2^(31*numLimbs).
+  uint32_t *scratch;  // Room for the exponentiation window table and temporaries.
+} runtime_montyContext;
+
+static _Thread_local runtime_montyContext runtime_monty;
+
+// Return the number of limbs in a CTTK integer with the given header word.
+static inline uint32_t findNumLimbs(uint32_t header) {
+  return ((header & ~RN_NAN_BIT) + 31) >> 5;
+}
+
+// Set |d| to |d| - |m| if |ctl| is 1, and leave it alone if |ctl| is 0.  Return
+// the borrow of the subtraction, whether or not it was applied.
+static uint32_t condSubLimbs(uint32_t *d, const uint32_t *m, uint32_t numLimbs, uint32_t ctl) {
+  uint32_t mask = -ctl;
+  uint32_t borrow = 0;
+  for (uint32_t i = 0; i < numLimbs; i++) {
+    uint32_t diff = d[i] - m[i] - borrow;
+    borrow = diff >> 31;
+    d[i] ^= (d[i] ^ (diff & RN_LIMB_MASK)) & mask;
+  }
+  return borrow;
+}
+
+// Set |d| to |x| * |y| / R mod m, in constant time.  |d| must not overlap |x|
+// or |y|.  If |x| < m and |y| < R, or the other way around, |d| is fully
+// reduced.
+static void montyMul(uint32_t *d, const uint32_t *x, const uint32_t *y,
+    const runtime_montyContext *context) {
+  uint32_t numLimbs = context->numLimbs;
+  const uint32_t *m = context->modulus;
+  memset(d, 0, numLimbs * sizeof(uint32_t));
+  uint32_t dh = 0;
+  for (uint32_t u = 0; u < numLimbs; u++) {
+    uint64_t xu = x[u];
+    uint64_t f = (uint32_t)((d[0] + xu * y[0]) * context->m0i) & RN_LIMB_MASK;
+    uint64_t carry = 0;
+    for (uint32_t v = 0; v < numLimbs; v++) {
+      uint64_t z = (uint64_t)d[v] + xu * y[v] + f * m[v] + carry;
+      carry = z >> 31;
+      if (v != 0) {
+        d[v - 1] = (uint32_t)z & RN_LIMB_MASK;
+      }
+    }
+    uint64_t zh = dh + carry;
+    d[numLimbs - 1] = (uint32_t)zh & RN_LIMB_MASK;
+    dh = (uint32_t)(zh >> 31);
+  }
+  // d < 2m, so one conditional subtraction finishes it.  Subtract if there was
+  // a carry out, or if there is no borrow when subtracting m.
+  uint32_t borrow = condSubLimbs(d, m, numLimbs, 0);
+  condSubLimbs(d, m, numLimbs, dh | (borrow ^ 1));
+}
+
+// Make the Montgomery context current for the odd modulus, reusing the cached
+// one when the modulus has not changed.
+static runtime_montyContext *findMontyContext(const uint32_t *modulus, uint32_t numLimbs) {
+  runtime_montyContext *context = &runtime_monty;
+  if (context->numLimbs == numLimbs &&
+      !memcmp(context->modulus, modulus, numLimbs * sizeof(uint32_t))) {
+    return context;
+  }
+  free(context->modulus);
+  context->numLimbs = numLimbs;
+  // Modulus, R^2, the window table, and two temporaries.
+  context->modulus = calloc((3 + RN_MONTY_WINDOW_SIZE + 2) * numLimbs, sizeof(uint32_t));
+  if (context->modulus == NULL) {
+    runtime_raiseExceptionCstr("OutOfMemory", __FILE__, __LINE__, "Out of memory");
+  }
+  context->r2 = context->modulus + numLimbs;
+  context->scratch = context->r2 + numLimbs;
+  memcpy(context->modulus, modulus, numLimbs * sizeof(uint32_t));
+  // Newton's iteration doubles the bits of the inverse each time.
+  uint32_t m0 = modulus[0];
+  uint32_t inverse = m0;
+  for (uint32_t i = 0; i < 4; i++) {
+    inverse *= 2 - m0 * inverse;
+  }
+  context->m0i = -inverse & RN_LIMB_MASK;
+  // Find R^2 mod m by doubling 1 mod m.  The modulus is public, so this need not
+  // be constant time, but it is simple enough that it is.
+  uint32_t *r2 = context->r2;
+  r2[0] = 1;
+  uint32_t borrow = condSubLimbs(r2, modulus, numLimbs, 0);
+  condSubLimbs(r2, modulus, numLimbs, borrow ^ 1);
+  for (uint32_t i = 0; i < 62 * numLimbs; i++) {
+    uint32_t carry = 0;
+    for (uint32_t j = 0; j < numLimbs; j++) {
+      uint32_t w = (r2[j] << 1) | carry;
+      carry = w >> 31;
+      r2[j] = w & RN_LIMB_MASK;
+    }
+    borrow = condSubLimbs(r2, modulus, numLimbs, 0);
+    condSubLimbs(r2, modulus, numLimbs, carry | (borrow ^ 1));
+  }
+  return context;
+}
+
+// Copy the limbs of the bigint into |limbs|, zero-extending them to |numLimbs|.
+// The bigint must not have more limbs than that.
+static void getLimbs(uint32_t *limbs, const runtime_array *bigint, uint32_t numLimbs) {
+  const uint32_t *data = getConstBigintData(bigint);
+  uint32_t sourceLimbs = findNumLimbs(data[1]);
+  memcpy(limbs, data + 2, sourceLimbs * sizeof(uint32_t));
+  memset(limbs + sourceLimbs, 0, (numLimbs - sourceLimbs) * sizeof(uint32_t));
+}
+
+// Copy |limbs| into the bigint, and zero any limbs above them.
+static void setLimbs(runtime_array *bigint, const uint32_t *limbs, uint32_t numLimbs) {
+  uint32_t *data = getBigintData(bigint);
+  uint32_t destLimbs = findNumLimbs(data[1]);
+  memcpy(data + 2, limbs, numLimbs * sizeof(uint32_t));
+  memset(data + 2 + numLimbs, 0, (destLimbs - numLimbs) * sizeof(uint32_t));
+}
+
+// Return the Montgomery context for the modulus if it is odd, and unsigned
+// values with up to |valueLimbs| limbs fit in it.  Otherwise return NULL.
+static runtime_montyContext *findMontyContextIfOdd(const runtime_array *modulus, uint32_t valueLimbs) {
+  const uint32_t *modulusData = getConstBigintData(modulus);
+  uint32_t numLimbs = findNumLimbs(modulusData[1]);
+  if ((modulusData[2] & 1) == 0 || valueLimbs > numLimbs || runtime_bigintSigned(modulus)) {
+    return NULL;
+  }
+  return findMontyContext(modulusData + 2, numLimbs);
+}
+
+// Multiply in Montgomery form, as a * R^2 / R * b / R = a * b mod m.  This
+// needs no temporary arrays or division.  Return false if the modulus is even
+// or the operands do not fit, in which case the caller falls back on
+// multiplying and reducing.
+static bool montyModularMul(runtime_array *dest, runtime_array *a, runtime_array *b,
+    runtime_array *modulus) {
+  uint32_t aLimbs = findNumLimbs(getConstBigintData(a)[1]);
+  uint32_t bLimbs = findNumLimbs(getConstBigintData(b)[1]);
+  if (runtime_bigintSigned(a) || runtime_bigintSigned(b) || bLimbs > aLimbs) {
+    return false;
+  }
+  runtime_montyContext *context = findMontyContextIfOdd(modulus, aLimbs);
+  if (context == NULL || context->numLimbs != aLimbs) {
+    return false;
+  }
+  uint32_t numLimbs = context->numLimbs;
+  uint32_t *x = context->scratch;
+  uint32_t *y = x + numLimbs;
+  uint32_t *t = y + numLimbs;
+  bool secret = runtime_bigintSecret(a) || runtime_bigintSecret(b);
+  getLimbs(x, a, numLimbs);
+  getLimbs(y, b, numLimbs);
+  montyMul(t, x, context->r2, context);
+  montyMul(x, t, y, context);
+  initBigint(dest, runtime_bigintWidth(a), false, secret);
+  setLimbs(dest, x, numLimbs);
+  wipeLimbs(context->scratch, 3 * numLimbs);
+  return true;
+}
+
 // Constant time modular multiplication.
 void runtime_bigintModularMul(runtime_array *dest, runtime_array *a, runtime_array *b, runtime_array *modulus) {
   if (runtime_bigintSecret(modulus)) {
@@ -703,9 +1296,12 @@ void runtime_bigintModularMul(runtime_array *dest, runtime_array *a, runtime_arr
   if (runtime_bigintSigned(modulus)) {
     runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__,"Modulus must be unsigned");
   }
-  runtime_array bigA = runtime_makeEmptyArray();
-  runtime_array bigB = runtime_makeEmptyArray();
-  runtime_array result = runtime_makeEmptyArray();
+  if (montyModularMul(dest, a, b, modulus)) {
+    return;
+  }
+  RN_TEMP_BIGINT(bigA);
+  RN_TEMP_BIGINT(bigB);
+  RN_TEMP_BIGINT(result);
   uint32_t width = runtime_bigintWidth(a);
   uint32_t width2x = width << 1;
   bool isSigned = runtime_bigintSigned(a);
@@ -716,66 +1312,360 @@ void runtime_bigintModularMul(runtime_array *dest, runtime_array *a, runtime_arr
   initBigint(dest, width, isSigned, secret);
   cti_set(getBigintData(&bigA) + 1, getBigintData(a) + 1);
   cti_set(getBigintData(&bigB) + 1, getBigintData(b) + 1);
-  runtime_bigintMul(&result, &bigA, &bigB);
+  if (secret) {
+    runtime_bigintMul(&result, &bigA, &bigB);
+  } else {
+    runtime_publicBigintMul(&result, &bigA, &bigB);
+  }
   cti_set(getBigintData(&bigA) + 1, getBigintData(modulus) + 1);
-  runtime_bigintMod(&result, &result, &bigA);
+  if (secret) {
+    runtime_bigintMod(&result, &result, &bigA);
+  } else {
+    runtime_publicBigintMod(&result, &result, &bigA);
+  }
   cti_set(getBigintData(dest) + 1, getBigintData(&result) + 1);
-  runtime_freeArray(&bigA);
-  runtime_freeArray(&bigB);
-  runtime_freeArray(&result);
+  releaseTempBigint(&bigA);
+  releaseTempBigint(&bigB);
+  releaseTempBigint(&result);
+}
+
+// Modular inversion for odd moduli uses Bernstein and Yang's safegcd.  Each
+// round runs RN_DIVSTEPS divsteps on just the low bits of f and g, and then
+// applies the resulting 2x2 matrix to all of f and g, and to the cofactors d
+// and e mod the modulus.  Numbers are held in signed 30-bit limbs so that the
+// matrix products fit in 64 bits.  Only the top limb carries the sign.
+#define RN_DIVSTEPS 30
+#define RN_LIMB30_MASK 0x3fffffff
+
+// A divstep transition matrix, scaled by 2^RN_DIVSTEPS so it is integral.
+typedef struct {
+  int32_t u, v, q, r;
+} runtime_divstepMatrix;
+
+// Return the number of signed 30-bit limbs used for inverses mod a |width|
+// bit modulus.  The cofactors range over (-2m, m), so leave room for a sign.
+static inline uint32_t findNumLimbs30(uint32_t width) {
+  return width / 30 + 2;
+}
+
+// Return the number of divsteps that is sure to reach g = 0 when f and g are
+// less than 2^width, from Theorem 11.2 of the safegcd paper.
+static uint32_t findNumDivsteps(uint32_t width) {
+  return width < 46? (49 * width + 80) / 17 : (49 * width + 57) / 17;
+}
+
+// Convert unsigned 31-bit limbs to |n30| signed 30-bit limbs.
+static void limbs31ToLimbs30(int32_t *out, uint32_t n30, const uint32_t *in, uint32_t n31) {
+  uint64_t acc = 0;
+  uint32_t accBits = 0;
+  uint32_t j = 0;
+  for (uint32_t i = 0; i < n30; i++) {
+    if (accBits < 30 && j < n31) {
+      acc |= (uint64_t)in[j++] << accBits;
+      accBits += 31;
+    }
+    out[i] = (int32_t)(acc & RN_LIMB30_MASK);
+    acc >>= 30;
+    accBits = accBits >= 30? accBits - 30 : 0;
+  }
 }
 
-// WARNING: Not constant constant time!
-// TODO: Make this constant time.
-bool runtime_bigintModularInverse(runtime_array *dest, runtime_array *source, runtime_array *modulus) {
-  if (runtime_bigintSecret(modulus)) {
-    runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__,"Modulus cannot be secret");
-  }
-  if (runtime_bigintSigned(modulus) || runtime_bigintSigned(source)) {
-    runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__,"Modular values must be unsigned");
+// Convert normalized, non-negative 30-bit limbs to |n31| 31-bit limbs.
+static void limbs30ToLimbs31(uint32_t *out, uint32_t n31, const int32_t *in, uint32_t n30) {
+  uint64_t acc = 0;
+  uint32_t accBits = 0;
+  uint32_t j = 0;
+  for (uint32_t i = 0; i < n31; i++) {
+    while (accBits < 31 && j < n30) {
+      acc |= (uint64_t)(uint32_t)in[j++] << accBits;
+      accBits += 30;
+    }
+    out[i] = (uint32_t)acc & RN_LIMB_MASK;
+    acc >>= 31;
+    accBits = accBits >= 31? accBits - 31 : 0;
+  }
+}
+
+// Run RN_DIVSTEPS divsteps in constant time on the low bits of f and g,
+// where eta = -delta, and return the new eta.  Entries of the matrix are
+// modulo 2^32 here, but lie in [-2^30, 2^30].
+static int32_t divsteps30(int32_t eta, uint32_t f, uint32_t g, runtime_divstepMatrix *t) {
+  uint32_t u = 1, v = 0, q = 0, r = 1;
+  for (uint32_t i = 0; i < RN_DIVSTEPS; i++) {
+    // mask1 is set if delta > 0, and mask2 if g is odd.
+    uint32_t mask1 = (uint32_t)(eta >> 31);
+    uint32_t mask2 = -(g & 1);
+    uint32_t x = (f ^ mask1) - mask1;
+    uint32_t y = (u ^ mask1) - mask1;
+    uint32_t z = (v ^ mask1) - mask1;
+    g += x & mask2;
+    q += y & mask2;
+    r += z & mask2;
+    // When both are set, delta becomes 1 - delta and f gets the old g.
+    // Otherwise delta becomes 1 + delta.
+    mask1 &= mask2;
+    eta = (eta ^ (int32_t)mask1) - 1 - (int32_t)mask1;
+    f += g & mask1;
+    u += q & mask1;
+    v += r & mask1;
+    g >>= 1;
+    u <<= 1;
+    v <<= 1;
+  }
+  t->u = (int32_t)u;
+  t->v = (int32_t)v;
+  t->q = (int32_t)q;
+  t->r = (int32_t)r;
+  return eta;
+}
+
+// The variable time version of divsteps30, which skips runs of even g.
+static int32_t divsteps30Var(int32_t eta, uint32_t f, uint32_t g, runtime_divstepMatrix *t) {
+  uint32_t u = 1, v = 0, q = 0, r = 1;
+  uint32_t left = RN_DIVSTEPS;
+  while (true) {
+    uint32_t zeros = __builtin_ctz(g | (UINT32_MAX << left));
+    g >>= zeros;
+    u <<= zeros;
+    v <<= zeros;
+    eta -= zeros;
+    left -= zeros;
+    if (left == 0) {
+      break;
+    }
+    if (eta < 0) {
+      eta = ~eta;
+      uint32_t x = f;
+      f = g;
+      g -= x;
+      x = u;
+      u = q;
+      q -= x;
+      x = v;
+      v = r;
+      r -= x;
+    } else {
+      eta--;
+      g += f;
+      q += u;
+      r += v;
+    }
+    g >>= 1;
+    u <<= 1;
+    v <<= 1;
+    left--;
+  }
+  t->u = (int32_t)u;
+  t->v = (int32_t)v;
+  t->q = (int32_t)q;
+  t->r = (int32_t)r;
+  return eta;
+}
+
+// Set [f, g] = t * [f, g] / 2^30, over the low |len| limbs.
+static void updateFG30(int32_t *f, int32_t *g, uint32_t len, const runtime_divstepMatrix *t) {
+  int64_t cf = (int64_t)t->u * f[0] + (int64_t)t->v * g[0];
+  int64_t cg = (int64_t)t->q * f[0] + (int64_t)t->r * g[0];
+  // The low 30 bits are zero by construction of the matrix.
+  cf >>= 30;
+  cg >>= 30;
+  for (uint32_t i = 1; i < len; i++) {
+    cf += (int64_t)t->u * f[i] + (int64_t)t->v * g[i];
+    cg += (int64_t)t->q * f[i] + (int64_t)t->r * g[i];
+    f[i - 1] = (int32_t)cf & RN_LIMB30_MASK;
+    g[i - 1] = (int32_t)cg & RN_LIMB30_MASK;
+    cf >>= 30;
+    cg >>= 30;
+  }
+  f[len - 1] = (int32_t)cf;
+  g[len - 1] = (int32_t)cg;
+}
+
+// Set [d, e] = t * [d, e] / 2^30 mod m, keeping both in (-2m, m).  Multiples
+// of m are added so the low 30 bits are zero before dividing.  |mInv| is
+// 1/m mod 2^30.
+static void updateDE30(int32_t *d, int32_t *e, const runtime_divstepMatrix *t,
+    const int32_t *m, uint32_t mInv, uint32_t n) {
+  int32_t u = t->u, v = t->v, q = t->q, r = t->r;
+  // Start with m times [u, q] if d is negative, plus [v, r] if e is negative.
+  int32_t sd = d[n - 1] >> 31;
+  int32_t se = e[n - 1] >> 31;
+  int32_t md = (u & sd) + (v & se);
+  int32_t me = (q & sd) + (r & se);
+  int64_t cd = (int64_t)u * d[0] + (int64_t)v * e[0];
+  int64_t ce = (int64_t)q * d[0] + (int64_t)r * e[0];
+  md -= (mInv * (uint32_t)cd + md) & RN_LIMB30_MASK;
+  me -= (mInv * (uint32_t)ce + me) & RN_LIMB30_MASK;
+  cd += (int64_t)m[0] * md;
+  ce += (int64_t)m[0] * me;
+  cd >>= 30;
+  ce >>= 30;
+  for (uint32_t i = 1; i < n; i++) {
+    cd += (int64_t)u * d[i] + (int64_t)v * e[i] + (int64_t)m[i] * md;
+    ce += (int64_t)q * d[i] + (int64_t)r * e[i] + (int64_t)m[i] * me;
+    d[i - 1] = (int32_t)cd & RN_LIMB30_MASK;
+    e[i - 1] = (int32_t)ce & RN_LIMB30_MASK;
+    cd >>= 30;
+    ce >>= 30;
+  }
+  d[n - 1] = (int32_t)cd;
+  e[n - 1] = (int32_t)ce;
+}
+
+// Carry each limb's high bits into the next, leaving limbs in [0, 2^30)
+// below the top one.
+static void carryLimbs30(int32_t *r, uint32_t n) {
+  for (uint32_t i = 0; i + 1 < n; i++) {
+    r[i + 1] += r[i] >> 30;
+    r[i] &= RN_LIMB30_MASK;
+  }
+}
+
+// Bring r from (-2m, m) into [0, m), negating it first if |sign| is negative.
+static void normalizeLimbs30(int32_t *r, int32_t sign, const int32_t *m, uint32_t n) {
+  int32_t condAdd = r[n - 1] >> 31;
+  int32_t condNegate = sign >> 31;
+  for (uint32_t i = 0; i < n; i++) {
+    r[i] += m[i] & condAdd;
+    r[i] = (r[i] ^ condNegate) - condNegate;
+  }
+  carryLimbs30(r, n);
+  condAdd = r[n - 1] >> 31;
+  for (uint32_t i = 0; i < n; i++) {
+    r[i] += m[i] & condAdd;
+  }
+  carryLimbs30(r, n);
+}
+
+// Return 1 if f is 1 or -1, in constant time, and 0 otherwise.
+static uint32_t limbs30AreUnit(const int32_t *f, uint32_t len) {
+  uint32_t notOne = (uint32_t)f[0] ^ 1;
+  uint32_t notMinusOne = (uint32_t)f[0] ^ RN_LIMB30_MASK;
+  for (uint32_t i = 1; i + 1 < len; i++) {
+    notOne |= (uint32_t)f[i];
+    notMinusOne |= (uint32_t)f[i] ^ RN_LIMB30_MASK;
+  }
+  if (len > 1) {
+    notOne |= (uint32_t)f[len - 1];
+    notMinusOne |= (uint32_t)f[len - 1] ^ UINT32_MAX;
+  } else {
+    notMinusOne = (uint32_t)f[0] ^ UINT32_MAX;
+  }
+  return ((notOne == 0) | (notMinusOne == 0));
+}
+
+// Set |inverse| to 1/x mod m, where m is odd.  x and m are unsigned 31-bit
+// limbs, and both are less than 2^width.  Return false if there is no inverse.
+// In constant time mode, the run time depends only on the limb counts and the
+// width.  Otherwise, stop once g reaches 0, and drop high limbs as f and g
+// shrink.  All temporaries are on the stack.
+static bool safegcdInverse(uint32_t *inverse, uint32_t inverseLimbs, const uint32_t *x,
+    uint32_t xLimbs, const uint32_t *modulus, uint32_t modulusLimbs, uint32_t width,
+    bool constantTime) {
+  uint32_t n = findNumLimbs30(width);
+  int32_t m[n], f[n], g[n], d[n], e[n];
+  limbs31ToLimbs30(m, n, modulus, modulusLimbs);
+  limbs31ToLimbs30(g, n, x, xLimbs);
+  memcpy(f, m, n * sizeof(int32_t));
+  memset(d, 0, n * sizeof(int32_t));
+  memset(e, 0, n * sizeof(int32_t));
+  e[0] = 1;
+  // Newton's iteration doubles the bits of 1/m mod 2^30 each time.
+  uint32_t mInv = (uint32_t)m[0];
+  for (uint32_t i = 0; i < 4; i++) {
+    mInv *= 2 - (uint32_t)m[0] * mInv;
+  }
+  mInv &= RN_LIMB30_MASK;
+  uint32_t numRounds = (findNumDivsteps(width) + RN_DIVSTEPS - 1) / RN_DIVSTEPS;
+  uint32_t len = n;
+  int32_t eta = -1;
+  runtime_divstepMatrix t;
+  for (uint32_t round = 0; round < numRounds; round++) {
+    if (constantTime) {
+      eta = divsteps30(eta, f[0], g[0], &t);
+    } else {
+      eta = divsteps30Var(eta, f[0], g[0], &t);
+    }
+    updateDE30(d, e, &t, m, mInv, n);
+    updateFG30(f, g, len, &t);
+    if (!constantTime) {
+      uint32_t nonZero = 0;
+      for (uint32_t i = 0; i < len; i++) {
+        nonZero |= (uint32_t)g[i];
+      }
+      if (nonZero == 0) {
+        break;
+      }
+      // If the top limbs of f and g are just sign, fold them into the limbs below.
+      int32_t fTop = f[len - 1];
+      int32_t gTop = g[len - 1];
+      if (len > 1 && (fTop ^ (fTop >> 31)) == 0 && (gTop ^ (gTop >> 31)) == 0) {
+        f[len - 2] |= (int32_t)((uint32_t)fTop << 30);
+        g[len - 2] |= (int32_t)((uint32_t)gTop << 30);
+        len--;
+      }
+    }
   }
-  runtime_array signedModulus = runtime_makeEmptyArray();
-  runtime_array a = runtime_makeEmptyArray();
-  runtime_array b = runtime_makeEmptyArray();
+  // f is now +/-gcd(x, m), and d * x = f mod m.
+  bool exists = limbs30AreUnit(f, len);
+  normalizeLimbs30(d, f[len - 1], m, n);
+  limbs30ToLimbs31(inverse, inverseLimbs, d, n);
+  if (constantTime) {
+    wipeLimbs((uint32_t*)f, n);
+    wipeLimbs((uint32_t*)g, n);
+    wipeLimbs((uint32_t*)d, n);
+    wipeLimbs((uint32_t*)e, n);
+  }
+  return exists;
+}
+
+// Find the inverse with the extended Euclidean algorithm.  This is only used
+// for even moduli.
+// WARNING: Not constant time!
+static bool euclidModularInverse(runtime_array *dest, runtime_array *source, runtime_array *modulus) {
+  RN_TEMP_BIGINT(signedModulus);
+  RN_TEMP_BIGINT(a);
+  RN_TEMP_BIGINT(b);
   uint32_t width = runtime_bigintWidth(modulus);
   bool secret = runtime_bigintSecret(source);
   // We need 1 more bit for the sign bit.
   runtime_bigintCast(&signedModulus, modulus, width + 1, true, false, false);
-  runtime_bigintCast(&a, source, width + 1, true, false, false);
-  runtime_copyBigint(&b, &signedModulus);
-  runtime_array x = runtime_makeEmptyArray();
-  runtime_array y = runtime_makeEmptyArray();
-  runtime_array u = runtime_makeEmptyArray();
-  runtime_array v = runtime_makeEmptyArray();
-  runtime_array q = runtime_makeEmptyArray();
-  runtime_array r = runtime_makeEmptyArray();
-  runtime_array n = runtime_makeEmptyArray();
-  runtime_array m = runtime_makeEmptyArray();
-  runtime_array t = runtime_makeEmptyArray();
+  runtime_bigintCast(&a, source, width + 1, true, secret, false);
+  setBigint(&b, &signedModulus);
+  RN_TEMP_BIGINT(x);
+  RN_TEMP_BIGINT(y);
+  RN_TEMP_BIGINT(u);
+  RN_TEMP_BIGINT(v);
+  RN_TEMP_BIGINT(q);
+  RN_TEMP_BIGINT(r);
+  RN_TEMP_BIGINT(n);
+  RN_TEMP_BIGINT(m);
+  RN_TEMP_BIGINT(t);
   runtime_integerToBigint(&x, 0, width + 1, true, false);
   runtime_integerToBigint(&y, 1, width + 1, true, false);
   runtime_integerToBigint(&u, 1, width + 1, true, false);
   runtime_integerToBigint(&v, 0, width + 1, true, false);
   while (!runtime_rnBoolToBool(runtime_bigintZero(&a))) {
-    runtime_bigintDivRem(&q, &r, &b, &a);
+    // The public versions fall back on CTTK when an operand is secret.
+    runtime_publicBigintDivRem(&q, &r, &b, &a);
     // m = x - u*q
-    runtime_bigintMul(&t, &u, &q);
+    runtime_publicBigintMul(&t, &u, &q);
     runtime_bigintSub(&m, &x, &t);
     // n = y - v*q
-    runtime_bigintMul(&t, &v, &q);
+    runtime_publicBigintMul(&t, &v, &q);
     runtime_bigintSub(&n, &y, &t);
-    runtime_copyBigint(&t, &b);
-    runtime_copyBigint(&b, &a);
-    runtime_copyBigint(&a, &r);
-    runtime_copyBigint(&r, &t);
-    runtime_copyBigint(&t, &x);
-    runtime_copyBigint(&x, &u);
-    runtime_copyBigint(&u, &m);
-    runtime_copyBigint(&m, &t);
-    runtime_copyBigint(&t, &y);
-    runtime_copyBigint(&y, &v);
-    runtime_copyBigint(&v, &n);
-    runtime_copyBigint(&n, &t);
+    setBigint(&t, &b);
+    setBigint(&b, &a);
+    setBigint(&a, &r);
+    setBigint(&r, &t);
+    setBigint(&t, &x);
+    setBigint(&x, &u);
+    setBigint(&u, &m);
+    setBigint(&m, &t);
+    setBigint(&t, &y);
+    setBigint(&y, &v);
+    setBigint(&v, &n);
+    setBigint(&n, &t);
   }
   if (runtime_rnBoolToBool(runtime_bigintNegative(&x))) {
     runtime_bigintAdd(&x, &x, &signedModulus);
@@ -784,29 +1674,61 @@ bool runtime_bigintModularInverse(runtime_array *dest, runtime_array *source, ru
   // If GCD(a, m) != 1, there is no inverse.
   runtime_integerToBigint(&t, 1, width, false, false);
   bool inverseExists = runtime_compareBigints(RN_EQUAL, &b, &t);
-  runtime_freeArray(&signedModulus);
-  runtime_freeArray(&a);
-  runtime_freeArray(&b);
-  runtime_freeArray(&x);
-  runtime_freeArray(&y);
-  runtime_freeArray(&u);
-  runtime_freeArray(&v);
-  runtime_freeArray(&q);
-  runtime_freeArray(&r);
-  runtime_freeArray(&n);
-  runtime_freeArray(&m);
-  runtime_freeArray(&t);
+  releaseTempBigint(&signedModulus);
+  releaseTempBigint(&a);
+  releaseTempBigint(&b);
+  releaseTempBigint(&x);
+  releaseTempBigint(&y);
+  releaseTempBigint(&u);
+  releaseTempBigint(&v);
+  releaseTempBigint(&q);
+  releaseTempBigint(&r);
+  releaseTempBigint(&n);
+  releaseTempBigint(&m);
+  releaseTempBigint(&t);
   return inverseExists;
 }
 
-// WARNING: Not yet constant time!
-// TODO: Make this constant time.
+// Compute 1/source mod modulus, and return false if there is no inverse.  Odd
+// moduli use safegcd, in constant time when the source is secret.
+bool runtime_bigintModularInverse(runtime_array *dest, runtime_array *source, runtime_array *modulus) {
+  if (runtime_bigintSecret(modulus)) {
+    runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__,"Modulus cannot be secret");
+  }
+  if (runtime_bigintSigned(modulus) || runtime_bigintSigned(source)) {
+    runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__,"Modular values must be unsigned");
+  }
+  const uint32_t *modulusData = getConstBigintData(modulus);
+  if ((modulusData[2] & 1) == 0) {
+    return euclidModularInverse(dest, source, modulus);
+  }
+  uint32_t width = runtime_bigintWidth(modulus);
+  uint32_t sourceWidth = runtime_bigintWidth(source);
+  bool secret = runtime_bigintSecret(source);
+  uint32_t modulusLimbs = findNumLimbs(modulusData[1]);
+  uint32_t sourceLimbs = findNumLimbs(getConstBigintData(source)[1]);
+  // Copy the operands before initializing dest, which may be the source.
+  uint32_t m[modulusLimbs], x[sourceLimbs], inverse[modulusLimbs];
+  memcpy(m, modulusData + 2, modulusLimbs * sizeof(uint32_t));
+  memcpy(x, getConstBigintData(source) + 2, sourceLimbs * sizeof(uint32_t));
+  bool exists = safegcdInverse(inverse, modulusLimbs, x, sourceLimbs, m, modulusLimbs,
+      width > sourceWidth? width : sourceWidth, secret);
+  initBigint(dest, width, false, secret);
+  setLimbs(dest, inverse, modulusLimbs);
+  if (secret) {
+    wipeLimbs(x, sourceLimbs);
+    wipeLimbs(inverse, modulusLimbs);
+  }
+  return exists;
+}
+
+// Modular division, which is constant time for odd moduli.
 void runtime_bigintModularDiv(runtime_array *dest, runtime_array *a, runtime_array *b, runtime_array *modulus) {
-  runtime_array bInverse = runtime_makeEmptyArray();
+  RN_TEMP_BIGINT(bInverse);
   initBigint(&bInverse, runtime_bigintWidth(modulus), false, false);
   runtime_bigintModularInverse(&bInverse, b, modulus);
   runtime_bigintModularMul(dest, a, &bInverse, modulus);
-  runtime_freeArray(&bInverse);
+  releaseTempBigint(&bInverse);
 }
 
 // Convert an integer width in bits to number of CTTK words.
@@ -814,20 +1736,97 @@ static uint32_t widthToCTTKWords(uint32_t width) {
   return 1 + (width + 30) / 31;
 }
 
-// Modular exponentiation.  TODO: speed this up.
+// Return the RN_MONTY_WINDOW_BITS bits of |limbs| starting at bit |pos|.  Bits
+// past |numBits| are zero.
+static inline uint32_t getExponentWindow(const uint32_t *limbs, uint32_t numBits, uint32_t pos) {
+  uint32_t window = 0;
+  for (uint32_t i = 0; i < RN_MONTY_WINDOW_BITS; i++) {
+    uint32_t bit = pos + i;
+    if (bit < numBits) {
+      window |= ((limbs[bit / 31] >> (bit % 31)) & 1) << i;
+    }
+  }
+  return window;
+}
+
+// Fixed-window exponentiation in Montgomery form.  Each window of the exponent
+// costs four squarings and one multiplication by a table entry, which is
+// selected by scanning the whole table, so the time does not depend on the
+// exponent.  Return false if the modulus is even or the base does not fit.
+static bool montyModularExp(runtime_array *dest, runtime_array *base, runtime_array *exponent,
+    runtime_array *modulus, bool isSecret) {
+  const uint32_t *baseData = getConstBigintData(base);
+  if (runtime_bigintSigned(base)) {
+    return false;
+  }
+  runtime_montyContext *context = findMontyContextIfOdd(modulus, findNumLimbs(baseData[1]));
+  if (context == NULL) {
+    return false;
+  }
+  uint32_t numLimbs = context->numLimbs;
+  uint32_t *table = context->scratch;
+  uint32_t *acc = table + RN_MONTY_WINDOW_SIZE * numLimbs;
+  uint32_t *t = acc + numLimbs;
+  uint32_t *product = t + numLimbs;
+  // table[0] = R mod m, which is 1 in Montgomery form, and table[1] = base * R.
+  memset(t, 0, numLimbs * sizeof(uint32_t));
+  t[0] = 1;
+  montyMul(table, t, context->r2, context);
+  getLimbs(t, base, numLimbs);
+  montyMul(table + numLimbs, t, context->r2, context);
+  for (uint32_t i = 2; i < RN_MONTY_WINDOW_SIZE; i++) {
+    montyMul(table + i * numLimbs, table + (i - 1) * numLimbs, table + numLimbs, context);
+  }
+  const uint32_t *expData = getConstBigintData(exponent);
+  uint32_t expBits = getBigintWidth(expData);
+  const uint32_t *expLimbs = expData + 2;
+  memcpy(acc, table, numLimbs * sizeof(uint32_t));
+  uint32_t numWindows = (expBits + RN_MONTY_WINDOW_BITS - 1) / RN_MONTY_WINDOW_BITS;
+  for (uint32_t w = numWindows; w-- != 0;) {
+    for (uint32_t i = 0; i < RN_MONTY_WINDOW_BITS; i++) {
+      montyMul(t, acc, acc, context);
+      memcpy(acc, t, numLimbs * sizeof(uint32_t));
+    }
+    uint32_t window = getExponentWindow(expLimbs, expBits, w * RN_MONTY_WINDOW_BITS);
+    memset(t, 0, numLimbs * sizeof(uint32_t));
+    for (uint32_t i = 0; i < RN_MONTY_WINDOW_SIZE; i++) {
+      uint32_t mask = -(uint32_t)(((i ^ window) - 1) >> 31);
+      const uint32_t *entry = table + i * numLimbs;
+      for (uint32_t j = 0; j < numLimbs; j++) {
+        t[j] |= entry[j] & mask;
+      }
+    }
+    montyMul(product, acc, t, context);
+    memcpy(acc, product, numLimbs * sizeof(uint32_t));
+  }
+  // Convert out of Montgomery form by multiplying by 1.
+  memset(t, 0, numLimbs * sizeof(uint32_t));
+  t[0] = 1;
+  montyMul(product, acc, t, context);
+  initBigint(dest, getBigintWidth(getConstBigintData(modulus)) - 1, false, isSecret);
+  setLimbs(dest, product, numLimbs);
+  wipeLimbs(context->scratch, (RN_MONTY_WINDOW_SIZE + 3) * numLimbs);
+  return true;
+}
+
+// Modular exponentiation.  Odd moduli use Montgomery multiplication.
 void runtime_bigintModularExp(runtime_array *dest, runtime_array *base, runtime_array *exponent, runtime_array *modulus) {
   if (runtime_rnBoolToBool(runtime_bigintNegative(exponent))) {
     runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__,
         "Tried to exponentiate with negative exponent");
   }
+  if (montyModularExp(dest, base, exponent, modulus,
+      runtime_bigintSecret(base) || runtime_bigintSecret(exponent))) {
+    return;
+  }
   uint32_t baseWidth = getBigintWidth(getBigintData(modulus));
   uint32_t expWidth = getBigintWidth(getBigintData(exponent));
   uint32_t width2x = baseWidth << 1;
   bool isSecret = runtime_bigintSecret(base) || runtime_bigintSecret(exponent);
-  runtime_array modBuf = runtime_makeEmptyArray();
-  runtime_array resBuf = runtime_makeEmptyArray();
-  runtime_array tOr1 = runtime_makeEmptyArray();
-  runtime_array t = runtime_makeEmptyArray();
+  RN_TEMP_BIGINT(modBuf);
+  RN_TEMP_BIGINT(resBuf);
+  RN_TEMP_BIGINT(tOr1);
+  RN_TEMP_BIGINT(t);
   initBigint(&modBuf, width2x, false, false);
   initBigint(&resBuf, width2x, false, false);
   initBigint(&tOr1, width2x, false, false);
@@ -869,10 +1868,10 @@ void runtime_bigintModularExp(runtime_array *dest, runtime_array *base, runtime_
   uint32_t *destData = getBigintData(dest) + 1;
   cti_set(destData, resBufData);
   checkForNAN(dest);
-  runtime_freeArray(&modBuf);
-  runtime_freeArray(&resBuf);
-  runtime_freeArray(&tOr1);
-  runtime_freeArray(&t);
+  releaseTempBigint(&modBuf);
+  releaseTempBigint(&resBuf);
+  releaseTempBigint(&tOr1);
+  releaseTempBigint(&t);
 }
 
 // Perform a smallnum multiplication.
@@ -921,14 +1920,14 @@ uint64_t runtime_smallnumMod(uint64_t a, uint64_t b, bool isSigned, bool secret)
 // Perform a smallnum exponentiation operation.
 uint64_t runtime_smallnumExp(uint64_t base, uint32_t exponent, bool isSigned, bool secret) {
   if (secret) {
-    runtime_array bigBase = runtime_makeEmptyArray();
+    RN_TEMP_BIGINT(bigBase);
     runtime_integerToBigint(&bigBase, base, sizeof(uint64_t) * 8, isSigned, true);
-    runtime_array bigResult = runtime_makeEmptyArray();
+    RN_TEMP_BIGINT(bigResult);
     initBigint(&bigResult, sizeof(uint64_t) * 8, false, true);
     runtime_bigintExp(&bigResult, &bigBase, exponent);
     uint64_t result = runtime_bigintToInteger(&bigResult);
-    runtime_freeArray(&bigBase);
-    runtime_freeArray(&bigResult);
+    releaseTempBigint(&bigBase);
+    releaseTempBigint(&bigResult);
     return result;
   }
   uint64_t result = 1;
@@ -956,6 +1955,7 @@ uint64_t runtime_smallnumModularAdd(uint64_t a, uint64_t b, uint64_t modulus, bo
     } else {
       ctl = cttk_or(cttk_s64_lt(result, a), cttk_s64_lt(modulus, result));
     }
+    RN_VALUE_BARRIER(ctl.v);
     return result - (modulus & (int64_t)-cttk_bool_to_int(ctl));
   }
   if (result < a || result >= modulus) {
@@ -974,6 +1974,7 @@ uint64_t runtime_smallnumModularSub(uint64_t a, uint64_t b, uint64_t modulus, bo
     } else {
       ctl = cttk_s64_lt0(result);
     }
+    RN_VALUE_BARRIER(ctl.v);
     return result + (modulus & (int64_t)-cttk_bool_to_int(ctl));
   }
   if ((int64_t)result < 0) {
@@ -986,25 +1987,38 @@ uint64_t runtime_smallnumModularSub(uint64_t a, uint64_t b, uint64_t modulus, bo
 static uint64_t secretSmallnumModularBinaryOp(
     void (*func)(runtime_array *dest, runtime_array *a, runtime_array *b, runtime_array *modulus),
     uint64_t a, uint64_t b, uint64_t modulus) {
-  runtime_array bigA = runtime_makeEmptyArray();
+  RN_TEMP_BIGINT(bigA);
   runtime_integerToBigint(&bigA, a, sizeof(uint64_t)*8, false, true);
-  runtime_array bigB = runtime_makeEmptyArray();
+  RN_TEMP_BIGINT(bigB);
   runtime_integerToBigint(&bigB, b, sizeof(uint64_t)*8, false, false);
-  runtime_array bigModulus = runtime_makeEmptyArray();
+  RN_TEMP_BIGINT(bigModulus);
   runtime_integerToBigint(&bigModulus, modulus, sizeof(uint64_t)*8, false, false);
-  runtime_array bigResult = runtime_makeEmptyArray();
+  RN_TEMP_BIGINT(bigResult);
   initBigint(&bigResult, sizeof(uint64_t)*8, false, true);
   func(&bigResult, &bigA, &bigB, &bigModulus);
   uint64_t result = runtime_bigintToInteger(&bigResult);
-  runtime_freeArray(&bigA);
-  runtime_freeArray(&bigB);
-  runtime_freeArray(&bigModulus);
-  runtime_freeArray(&bigResult);
+  releaseTempBigint(&bigA);
+  releaseTempBigint(&bigB);
+  releaseTempBigint(&bigModulus);
+  releaseTempBigint(&bigResult);
   return result;
 }
 
-// TODO: Have the code generator generate this directly when not secret.
+// Multiply reduced public smallnums mod the modulus without going through bigints.
+static inline uint64_t publicSmallnumModularMul(uint64_t a, uint64_t b, uint64_t modulus) {
+#ifdef __SIZEOF_INT128__
+  return (uint64_t)(((unsigned __int128)a * b) % modulus);
+#else
+  return secretSmallnumModularBinaryOp(runtime_bigintModularMul, a, b, modulus);
+#endif
+}
+
+// The code generator inlines public modular multiplication, so this is mostly
+// called for secret values.
 uint64_t runtime_smallnumModularMul(uint64_t a, uint64_t b, uint64_t modulus, bool secret) {
+  if (!secret) {
+    return publicSmallnumModularMul(a, b, modulus);
+  }
   return secretSmallnumModularBinaryOp(runtime_bigintModularMul, a, b, modulus);
 }
 
@@ -1013,13 +2027,29 @@ uint64_t runtime_smallnumModularDiv(uint64_t a, uint64_t b, uint64_t modulus, bo
   return secretSmallnumModularBinaryOp(runtime_bigintModularDiv, a, b, modulus);
 }
 
-// TODO: Speed this up for small integers.
+// Public exponents and bases use square-and-multiply, which leaks the
+// exponent through timing.  Secret ones use the constant-time bigint path.
 uint64_t runtime_smallnumModularExp(uint64_t base, uint64_t exponent, uint64_t modulus, bool secret) {
-  return secretSmallnumModularBinaryOp(runtime_bigintModularExp, base, exponent, modulus);
+  if (secret) {
+    return secretSmallnumModularBinaryOp(runtime_bigintModularExp, base, exponent, modulus);
+  }
+  uint64_t result = 1 % modulus;
+  while (exponent != 0) {
+    if (exponent & 1) {
+      result = publicSmallnumModularMul(result, base, modulus);
+    }
+    exponent >>= 1;
+    if (exponent != 0) {
+      base = publicSmallnumModularMul(base, base, modulus);
+    }
+  }
+  return result;
 }
 
 // Compute the logical AND of two runtime_bools in constant time.
 runtime_bool runtime_boolAnd(runtime_bool a, runtime_bool b) {
+  RN_VALUE_BARRIER(a.v);
+  RN_VALUE_BARRIER(b.v);
   return cttk_and(a, b);
 }
 
@@ -1037,18 +2067,21 @@ bool runtime_rnBoolToBool(runtime_bool a) {
 
 // Compute the logical OR of two runtime_bools in constant time.
 runtime_bool runtime_boolOr(runtime_bool a, runtime_bool b) {
+  RN_VALUE_BARRIER(a.v);
+  RN_VALUE_BARRIER(b.v);
   return cttk_or(a, b);
 }
 
 // Compute the logical NOT of an runtime_bool in constant time.
 runtime_bool runtime_boolNot(runtime_bool a) {
+  RN_VALUE_BARRIER(a.v);
   return cttk_not(a);
 }
 
 // Select one of two uint32s in constant time.
 uint64_t runtime_selectUint32(runtime_bool select, uint64_t data1, uint64_t data0) {
+  RN_VALUE_BARRIER(select.v);
   return cttk_u32_mux(select, data1, data0);
-  return data0 ^ (-select.v & (data1 ^ data0));
 }
 
 // Conditionally copy a bigint in constant time.
@@ -1058,6 +2091,7 @@ void runtime_bigintCondCopy(runtime_bool doCopy, runtime_array *dest, const runt
         "Tried to cond-copy to different size bigint");
   }
   uint64_t len = source->numElements*sizeof(uint32_t);
+  RN_VALUE_BARRIER(doCopy.v);
   cttk_cond_copy(doCopy, dest->data, source->data, len);
 }
 
@@ -0,0 +1,1045 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Symmetric crypto primitives: SHA-256, SHA3-256, AES-GCM and
+// ChaCha20-Poly1305.  Each has a portable constant-time implementation.  On
+// x86-64, SHA-256 uses the SHA extensions, and AES-GCM uses AES-NI and
+// PCLMULQDQ, when the CPU has them.  The choice is made once, with cpuid, and
+// the API is the same either way.  The portable AES computes the S-box from the
+// GF(2^8) inverse eight bytes at a time, rather than with a table, so it makes
+// no secret dependent memory accesses.  It is slow, but correct.
+//
+// Ciphertexts have the 16 byte authentication tag appended.  Decryption checks
+// the tag in constant time before writing any plaintext.  Digests and
+// plaintexts are marked secret, so they are wiped when freed, and key schedules
+// and other temporary state are wiped before returning.
+
+#include "runtime.h"
+#include <pthread.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define RN_CRYPTO_X86 1
+#endif
+
+#define RN_SHA256_BLOCK_BYTES 64
+#define RN_SHA256_DIGEST_BYTES 32
+#define RN_SHA3_256_RATE_BYTES 136
+#define RN_SHA3_256_DIGEST_BYTES 32
+#define RN_AES_BLOCK_BYTES 16
+#define RN_AES_MAX_ROUNDS 14
+#define RN_GCM_NONCE_BYTES 12
+#define RN_AEAD_TAG_BYTES 16
+#define RN_CHACHA20_KEY_BYTES 32
+#define RN_CHACHA20_NONCE_BYTES 12
+#define RN_CHACHA20_BLOCK_BYTES 64
+
+typedef struct {
+  uint8_t roundKeys[RN_AES_MAX_ROUNDS + 1][RN_AES_BLOCK_BYTES];
+  uint32_t numRounds;
+} runtime_aesKey;
+
+static bool runtime_cryptoHasAesni;
+static bool runtime_cryptoHasShani;
+static bool runtime_cryptoHardwareDisabled;
+static pthread_once_t runtime_cryptoDetectOnce = PTHREAD_ONCE_INIT;
+
+// Wipe bytes which may hold secrets, in a way the compiler will not elide.
+static inline void wipeBytes(void *p, uint64_t numBytes) {
+  memset(p, 0, numBytes);
+  __asm__ __volatile__("" : : "r"(p) : "memory");
+}
+
+static inline uint32_t readBigEndian32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void writeBigEndian32(uint8_t *p, uint32_t value) {
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+static inline uint64_t readBigEndian64(const uint8_t *p) {
+  return ((uint64_t)readBigEndian32(p) << 32) | readBigEndian32(p + 4);
+}
+
+static inline void writeBigEndian64(uint8_t *p, uint64_t value) {
+  writeBigEndian32(p, value >> 32);
+  writeBigEndian32(p + 4, value);
+}
+
+static inline uint32_t readLittleEndian32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void writeLittleEndian32(uint8_t *p, uint32_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+  p[3] = value >> 24;
+}
+
+static inline uint64_t readLittleEndian64(const uint8_t *p) {
+  return readLittleEndian32(p) | ((uint64_t)readLittleEndian32(p + 4) << 32);
+}
+
+static inline void writeLittleEndian64(uint8_t *p, uint64_t value) {
+  writeLittleEndian32(p, value);
+  writeLittleEndian32(p + 4, value >> 32);
+}
+
+static inline uint32_t rotl32(uint32_t value, uint32_t dist) {
+  return (value << dist) | (value >> (32 - dist));
+}
+
+static inline uint32_t rotr32(uint32_t value, uint32_t dist) {
+  return (value >> dist) | (value << (32 - dist));
+}
+
+static inline uint64_t rotl64(uint64_t value, uint32_t dist) {
+  return (value << dist) | (value >> ((64 - dist) & 63));
+}
+
+// Compare two byte strings in time independent of their contents.
+static bool constantTimeEqual(const uint8_t *a, const uint8_t *b, uint32_t numBytes) {
+  uint8_t diff = 0;
+  for (uint32_t i = 0; i < numBytes; i++) {
+    diff |= a[i] ^ b[i];
+  }
+  return (((uint32_t)diff - 1) >> 31) & 1;
+}
+
+// Throw an InvalidArgument exception unless |array| has |numBytes| bytes.
+static void checkLength(const runtime_array *array, uint64_t numBytes, const char *name) {
+  if (array->numElements != numBytes) {
+    runtime_raiseExceptionCstr("InvalidArgument", __FILE__, __LINE__,
+        "%s must be %llu bytes long", name, (unsigned long long)numBytes);
+  }
+}
+
+// Look for CPU extensions with cpuid.
+static void detectCpuFeatures(void) {
+#ifdef RN_CRYPTO_X86
+  uint32_t eax, ebx, ecx, edx;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    bool sse41 = (ecx & bit_SSE4_1) != 0;
+    runtime_cryptoHasAesni = sse41 && (ecx & bit_AES) && (ecx & bit_PCLMUL);
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+      runtime_cryptoHasShani = sse41 && (ebx & bit_SHA);
+    }
+  }
+#endif
+}
+
+static inline bool useAesni(void) {
+  pthread_once(&runtime_cryptoDetectOnce, detectCpuFeatures);
+  return runtime_cryptoHasAesni && !runtime_cryptoHardwareDisabled;
+}
+
+static inline bool useShani(void) {
+  pthread_once(&runtime_cryptoDetectOnce, detectCpuFeatures);
+  return runtime_cryptoHasShani && !runtime_cryptoHardwareDisabled;
+}
+
+// For testing the portable code on CPUs with the extensions.  Returns true if
+// hardware acceleration is available.
+bool runtime_setCryptoHardwareEnabled(bool enabled) {
+  pthread_once(&runtime_cryptoDetectOnce, detectCpuFeatures);
+  runtime_cryptoHardwareDisabled = !enabled;
+  return runtime_cryptoHasAesni || runtime_cryptoHasShani;
+}
+
+// SHA-256, FIPS 180-4.
+
+static const uint32_t sha256RoundConstants[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Hash |numBlocks| 64 byte blocks into |state|.
+static void sha256BlocksPortable(uint32_t *state, const uint8_t *data, uint64_t numBlocks) {
+  uint32_t w[64];
+  for (uint64_t block = 0; block < numBlocks; block++) {
+    for (uint32_t i = 0; i < 16; i++) {
+      w[i] = readBigEndian32(data + 4 * i);
+    }
+    for (uint32_t i = 16; i < 64; i++) {
+      uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (uint32_t i = 0; i < 64; i++) {
+      uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+      uint32_t ch = (e & f) ^ (~e & g);
+      uint32_t t1 = h + s1 + ch + sha256RoundConstants[i] + w[i];
+      uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+      uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + s0 + maj;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+    data += RN_SHA256_BLOCK_BYTES;
+  }
+  wipeBytes(w, sizeof(w));
+}
+
+#ifdef RN_CRYPTO_X86
+// The same, with the SHA extensions.  The state is kept as ABEF and CDGH, the
+// layout sha256rnds2 wants.
+__attribute__((target("sha,sse4.1")))
+static void sha256BlocksShani(uint32_t *state, const uint8_t *data, uint64_t numBlocks) {
+  const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0xb1);
+  __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(state + 4)), 0x1b);
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+  __m128i w[4];
+  for (uint64_t block = 0; block < numBlocks; block++) {
+    __m128i savedState0 = state0;
+    __m128i savedState1 = state1;
+    for (uint32_t i = 0; i < 16; i++) {
+      __m128i words;
+      if (i < 4) {
+        words = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * i)), byteSwap);
+      } else {
+        // w[i & 3] holds the words from 4 groups ago, and w[(i + 3) & 3] the last.
+        words = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+        words = _mm_add_epi32(words, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+        words = _mm_sha256msg2_epu32(words, w[(i + 3) & 3]);
+      }
+      w[i & 3] = words;
+      __m128i message = _mm_add_epi32(words,
+          _mm_loadu_si128((const __m128i*)(sha256RoundConstants + 4 * i)));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(message, 0x0e));
+    }
+    state0 = _mm_add_epi32(state0, savedState0);
+    state1 = _mm_add_epi32(state1, savedState1);
+    data += RN_SHA256_BLOCK_BYTES;
+  }
+  tmp = _mm_shuffle_epi32(state0, 0x1b);
+  state1 = _mm_shuffle_epi32(state1, 0xb1);
+  _mm_storeu_si128((__m128i*)state, _mm_blend_epi16(tmp, state1, 0xf0));
+  _mm_storeu_si128((__m128i*)(state + 4), _mm_alignr_epi8(state1, tmp, 8));
+  wipeBytes(w, sizeof(w));
+}
+#endif
+
+static void sha256Blocks(uint32_t *state, const uint8_t *data, uint64_t numBlocks) {
+#ifdef RN_CRYPTO_X86
+  if (useShani()) {
+    sha256BlocksShani(state, data, numBlocks);
+    return;
+  }
+#endif
+  sha256BlocksPortable(state, data, numBlocks);
+}
+
+// Compute the SHA-256 digest of |numBytes| bytes of |data|.
+static void sha256(uint8_t *digest, const uint8_t *data, uint64_t numBytes) {
+  uint32_t state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  uint64_t numBlocks = numBytes / RN_SHA256_BLOCK_BYTES;
+  sha256Blocks(state, data, numBlocks);
+  uint8_t last[2 * RN_SHA256_BLOCK_BYTES] = {0};
+  uint32_t remaining = numBytes % RN_SHA256_BLOCK_BYTES;
+  memcpy(last, data + numBlocks * RN_SHA256_BLOCK_BYTES, remaining);
+  last[remaining] = 0x80;
+  uint32_t lastBytes = remaining < RN_SHA256_BLOCK_BYTES - 8? RN_SHA256_BLOCK_BYTES :
+      2 * RN_SHA256_BLOCK_BYTES;
+  writeBigEndian64(last + lastBytes - 8, numBytes << 3);
+  sha256Blocks(state, last, lastBytes / RN_SHA256_BLOCK_BYTES);
+  for (uint32_t i = 0; i < 8; i++) {
+    writeBigEndian32(digest + 4 * i, state[i]);
+  }
+  wipeBytes(last, sizeof(last));
+  wipeBytes(state, sizeof(state));
+}
+
+// SHA3-256, FIPS 202.
+
+static const uint64_t keccakRoundConstants[24] = {
+  0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+  0x000000000000808bULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+  0x000000000000008aULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+  0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+  0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800aULL, 0x800000008000000aULL,
+  0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+// Rotation distances and lane order of the combined rho and pi steps.
+static const uint8_t keccakRotations[24] = {
+  1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44
+};
+static const uint8_t keccakLanes[24] = {
+  10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4, 15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1
+};
+
+// The Keccak-f[1600] permutation.
+static void keccakPermute(uint64_t *state) {
+  uint64_t c[5];
+  for (uint32_t round = 0; round < 24; round++) {
+    for (uint32_t i = 0; i < 5; i++) {
+      c[i] = state[i] ^ state[i + 5] ^ state[i + 10] ^ state[i + 15] ^ state[i + 20];
+    }
+    for (uint32_t i = 0; i < 5; i++) {
+      uint64_t d = c[(i + 4) % 5] ^ rotl64(c[(i + 1) % 5], 1);
+      for (uint32_t j = 0; j < 25; j += 5) {
+        state[j + i] ^= d;
+      }
+    }
+    uint64_t lane = state[1];
+    for (uint32_t i = 0; i < 24; i++) {
+      uint32_t j = keccakLanes[i];
+      uint64_t next = state[j];
+      state[j] = rotl64(lane, keccakRotations[i]);
+      lane = next;
+    }
+    for (uint32_t j = 0; j < 25; j += 5) {
+      for (uint32_t i = 0; i < 5; i++) {
+        c[i] = state[j + i];
+      }
+      for (uint32_t i = 0; i < 5; i++) {
+        state[j + i] ^= ~c[(i + 1) % 5] & c[(i + 2) % 5];
+      }
+    }
+    state[0] ^= keccakRoundConstants[round];
+  }
+  wipeBytes(c, sizeof(c));
+}
+
+// XOR a block of |numBytes| bytes into the state, and permute it.
+static void keccakAbsorb(uint64_t *state, const uint8_t *data, uint32_t numBytes) {
+  for (uint32_t i = 0; i < numBytes / 8; i++) {
+    state[i] ^= readLittleEndian64(data + 8 * i);
+  }
+  keccakPermute(state);
+}
+
+// Compute the SHA3-256 digest of |numBytes| bytes of |data|.
+static void sha3_256(uint8_t *digest, const uint8_t *data, uint64_t numBytes) {
+  uint64_t state[25] = {0};
+  while (numBytes >= RN_SHA3_256_RATE_BYTES) {
+    keccakAbsorb(state, data, RN_SHA3_256_RATE_BYTES);
+    data += RN_SHA3_256_RATE_BYTES;
+    numBytes -= RN_SHA3_256_RATE_BYTES;
+  }
+  uint8_t last[RN_SHA3_256_RATE_BYTES] = {0};
+  memcpy(last, data, numBytes);
+  last[numBytes] = 0x06;
+  last[RN_SHA3_256_RATE_BYTES - 1] |= 0x80;
+  keccakAbsorb(state, last, RN_SHA3_256_RATE_BYTES);
+  for (uint32_t i = 0; i < RN_SHA3_256_DIGEST_BYTES / 8; i++) {
+    writeLittleEndian64(digest + 8 * i, state[i]);
+  }
+  wipeBytes(last, sizeof(last));
+  wipeBytes(state, sizeof(state));
+}
+
+// AES, FIPS 197.  The portable code works on eight bytes at a time, packed
+// into a uint64_t, so the byte order of the packing does not matter.
+
+#define RN_LOW_BITS 0x0101010101010101ULL
+#define RN_HIGH_BITS 0x8080808080808080ULL
+
+// Multiply each byte by x in GF(2^8).
+static inline uint64_t gfDouble8(uint64_t a) {
+  uint64_t high = (a & RN_HIGH_BITS) >> 7;
+  return ((a << 1) & ~RN_LOW_BITS) ^ (high * 0x1b);
+}
+
+// Multiply each byte of |a| by the same byte of |b| in GF(2^8).
+static uint64_t gfMultiply8(uint64_t a, uint64_t b) {
+  uint64_t product = 0;
+  for (uint32_t i = 0; i < 8; i++) {
+    product ^= a & (((b >> i) & RN_LOW_BITS) * 0xff);
+    a = gfDouble8(a);
+  }
+  return product;
+}
+
+// Rotate each byte left |dist| bits.
+static inline uint64_t rotateBytes8(uint64_t a, uint32_t dist) {
+  uint64_t lowMask = (RN_LOW_BITS << dist) - RN_LOW_BITS;
+  return ((a << dist) & ~lowMask) | ((a >> (8 - dist)) & lowMask);
+}
+
+// Apply the AES S-box to each byte: invert in GF(2^8) as x^254, then apply the
+// affine transform.
+static uint64_t subBytes8(uint64_t a) {
+  uint64_t inverse = a;
+  for (uint32_t i = 0; i < 6; i++) {
+    inverse = gfMultiply8(gfMultiply8(inverse, inverse), a);
+  }
+  inverse = gfMultiply8(inverse, inverse);
+  return inverse ^ rotateBytes8(inverse, 1) ^ rotateBytes8(inverse, 2) ^
+      rotateBytes8(inverse, 3) ^ rotateBytes8(inverse, 4) ^ (RN_LOW_BITS * 0x63);
+}
+
+// Expand a 16 or 32 byte key into the round keys, which both implementations
+// use.
+static void aesExpandKey(runtime_aesKey *aesKey, const uint8_t *key, uint32_t keyBytes) {
+  uint32_t keyWords = keyBytes / 4;
+  aesKey->numRounds = keyWords + 6;
+  uint32_t numWords = 4 * (aesKey->numRounds + 1);
+  uint8_t *w = aesKey->roundKeys[0];
+  memcpy(w, key, keyBytes);
+  uint8_t rcon = 1;
+  for (uint32_t i = keyWords; i < numWords; i++) {
+    uint8_t temp[8] = {0};
+    memcpy(temp, w + 4 * (i - 1), 4);
+    if (i % keyWords == 0 || (keyWords > 6 && i % keyWords == 4)) {
+      uint64_t packed;
+      memcpy(&packed, temp, 8);
+      packed = subBytes8(packed);
+      memcpy(temp, &packed, 8);
+      if (i % keyWords == 0) {
+        uint8_t first = temp[0];
+        temp[0] = temp[1] ^ rcon;
+        temp[1] = temp[2];
+        temp[2] = temp[3];
+        temp[3] = first;
+        rcon = (rcon << 1) ^ ((rcon >> 7) * 0x1b);
+      }
+    }
+    for (uint32_t j = 0; j < 4; j++) {
+      w[4 * i + j] = w[4 * (i - keyWords) + j] ^ temp[j];
+    }
+    wipeBytes(temp, sizeof(temp));
+  }
+}
+
+// Encrypt one block with the portable code.  The state is in column order, as
+// in FIPS 197.
+static void aesEncryptBlockPortable(const runtime_aesKey *aesKey, uint8_t *out, const uint8_t *in) {
+  uint8_t s[RN_AES_BLOCK_BYTES];
+  uint8_t t[RN_AES_BLOCK_BYTES];
+  for (uint32_t i = 0; i < RN_AES_BLOCK_BYTES; i++) {
+    s[i] = in[i] ^ aesKey->roundKeys[0][i];
+  }
+  for (uint32_t round = 1; round <= aesKey->numRounds; round++) {
+    uint64_t halves[2];
+    memcpy(halves, s, RN_AES_BLOCK_BYTES);
+    halves[0] = subBytes8(halves[0]);
+    halves[1] = subBytes8(halves[1]);
+    memcpy(s, halves, RN_AES_BLOCK_BYTES);
+    wipeBytes(halves, sizeof(halves));
+    // ShiftRows.
+    for (uint32_t col = 0; col < 4; col++) {
+      for (uint32_t row = 0; row < 4; row++) {
+        t[4 * col + row] = s[4 * ((col + row) & 3) + row];
+      }
+    }
+    if (round != aesKey->numRounds) {
+      // MixColumns.
+      for (uint32_t col = 0; col < 4; col++) {
+        uint8_t *c = t + 4 * col;
+        uint8_t all = c[0] ^ c[1] ^ c[2] ^ c[3];
+        uint8_t first = c[0];
+        for (uint32_t row = 0; row < 4; row++) {
+          uint8_t next = row == 3? first : c[row + 1];
+          c[row] ^= all ^ (uint8_t)gfDouble8(c[row] ^ next);
+        }
+      }
+    }
+    for (uint32_t i = 0; i < RN_AES_BLOCK_BYTES; i++) {
+      s[i] = t[i] ^ aesKey->roundKeys[round][i];
+    }
+  }
+  memcpy(out, s, RN_AES_BLOCK_BYTES);
+  wipeBytes(s, sizeof(s));
+  wipeBytes(t, sizeof(t));
+}
+
+// GCM, NIST SP 800-38D.  Field elements are kept as two big endian halves.
+
+typedef struct {
+  uint64_t high, low;
+} runtime_gcmElement;
+
+// Multiply |x| by |h| in GF(2^128), one bit at a time, without branches.
+static runtime_gcmElement gcmMultiplyPortable(runtime_gcmElement x, runtime_gcmElement h) {
+  runtime_gcmElement z = {0, 0};
+  runtime_gcmElement v = h;
+  for (uint32_t i = 0; i < 128; i++) {
+    uint64_t bit = i < 64? x.high >> (63 - i) : x.low >> (127 - i);
+    uint64_t mask = -(bit & 1);
+    z.high ^= v.high & mask;
+    z.low ^= v.low & mask;
+    uint64_t reduce = -(v.low & 1);
+    v.low = (v.low >> 1) | (v.high << 63);
+    v.high = (v.high >> 1) ^ (0xe100000000000000ULL & reduce);
+  }
+  return z;
+}
+
+// Hash |numBytes| bytes into |y|, zero padding the last block.
+static void ghashPortable(runtime_gcmElement *y, runtime_gcmElement h, const uint8_t *data,
+    uint64_t numBytes) {
+  while (numBytes != 0) {
+    uint8_t block[RN_AES_BLOCK_BYTES] = {0};
+    uint32_t blockBytes = numBytes < RN_AES_BLOCK_BYTES? numBytes : RN_AES_BLOCK_BYTES;
+    memcpy(block, data, blockBytes);
+    y->high ^= readBigEndian64(block);
+    y->low ^= readBigEndian64(block + 8);
+    *y = gcmMultiplyPortable(*y, h);
+    data += blockBytes;
+    numBytes -= blockBytes;
+    wipeBytes(block, sizeof(block));
+  }
+}
+
+// Increment the last 32 bits of a counter block.
+static inline void gcmIncrementCounter(uint8_t *counter) {
+  writeBigEndian32(counter + 12, readBigEndian32(counter + 12) + 1);
+}
+
+// XOR the CTR mode keystream starting at |counter| into |numBytes| bytes.
+static void aesCtrPortable(const runtime_aesKey *aesKey, uint8_t *counter, uint8_t *out,
+    const uint8_t *in, uint64_t numBytes) {
+  uint8_t keystream[RN_AES_BLOCK_BYTES];
+  while (numBytes != 0) {
+    uint32_t blockBytes = numBytes < RN_AES_BLOCK_BYTES? numBytes : RN_AES_BLOCK_BYTES;
+    aesEncryptBlockPortable(aesKey, keystream, counter);
+    gcmIncrementCounter(counter);
+    for (uint32_t i = 0; i < blockBytes; i++) {
+      out[i] = in[i] ^ keystream[i];
+    }
+    in += blockBytes;
+    out += blockBytes;
+    numBytes -= blockBytes;
+  }
+  wipeBytes(keystream, sizeof(keystream));
+}
+
+// Compute the GCM tag over the associated data and ciphertext with portable
+// code, and encrypt or decrypt.  When decrypting, the tag is computed before
+// |out| is written.
+static void aesGcmPortable(const runtime_aesKey *aesKey, const uint8_t *nonce, uint8_t *out,
+    const uint8_t *in, uint64_t numBytes, const uint8_t *ad, uint64_t adBytes, uint8_t *tag,
+    bool encrypt) {
+  uint8_t block[RN_AES_BLOCK_BYTES] = {0};
+  aesEncryptBlockPortable(aesKey, block, block);
+  runtime_gcmElement h = {readBigEndian64(block), readBigEndian64(block + 8)};
+  runtime_gcmElement y = {0, 0};
+  uint8_t counter[RN_AES_BLOCK_BYTES];
+  memcpy(counter, nonce, RN_GCM_NONCE_BYTES);
+  writeBigEndian32(counter + 12, 1);
+  aesEncryptBlockPortable(aesKey, block, counter);
+  gcmIncrementCounter(counter);
+  ghashPortable(&y, h, ad, adBytes);
+  if (encrypt) {
+    aesCtrPortable(aesKey, counter, out, in, numBytes);
+    ghashPortable(&y, h, out, numBytes);
+  } else {
+    ghashPortable(&y, h, in, numBytes);
+  }
+  y.high ^= adBytes << 3;
+  y.low ^= numBytes << 3;
+  y = gcmMultiplyPortable(y, h);
+  writeBigEndian64(tag, y.high);
+  writeBigEndian64(tag + 8, y.low);
+  for (uint32_t i = 0; i < RN_AEAD_TAG_BYTES; i++) {
+    tag[i] ^= block[i];
+  }
+  if (!encrypt) {
+    aesCtrPortable(aesKey, counter, out, in, numBytes);
+  }
+  wipeBytes(block, sizeof(block));
+  wipeBytes(&h, sizeof(h));
+  wipeBytes(&y, sizeof(y));
+}
+
+#ifdef RN_CRYPTO_X86
+#define RN_AESNI_TARGET __attribute__((target("aes,pclmul,sse4.1")))
+
+RN_AESNI_TARGET
+static inline __m128i aesniEncryptBlock(const __m128i *roundKeys, uint32_t numRounds,
+    __m128i block) {
+  block = _mm_xor_si128(block, roundKeys[0]);
+  for (uint32_t round = 1; round < numRounds; round++) {
+    block = _mm_aesenc_si128(block, roundKeys[round]);
+  }
+  return _mm_aesenclast_si128(block, roundKeys[numRounds]);
+}
+
+// Multiply byte reflected field elements with carry-less multiplication, and
+// reduce the 256 bit product, as in Intel's GCM white paper.
+RN_AESNI_TARGET
+static __m128i gcmMultiplyClmul(__m128i a, __m128i b) {
+  __m128i low = _mm_clmulepi64_si128(a, b, 0x00);
+  __m128i middle = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10),
+      _mm_clmulepi64_si128(a, b, 0x01));
+  __m128i high = _mm_clmulepi64_si128(a, b, 0x11);
+  low = _mm_xor_si128(low, _mm_slli_si128(middle, 8));
+  high = _mm_xor_si128(high, _mm_srli_si128(middle, 8));
+  // Shift the product left one bit, since the operands are bit reflected.
+  __m128i lowCarry = _mm_srli_epi32(low, 31);
+  __m128i highCarry = _mm_srli_epi32(high, 31);
+  low = _mm_slli_epi32(low, 1);
+  high = _mm_slli_epi32(high, 1);
+  high = _mm_or_si128(high, _mm_srli_si128(lowCarry, 12));
+  high = _mm_or_si128(high, _mm_slli_si128(highCarry, 4));
+  low = _mm_or_si128(low, _mm_slli_si128(lowCarry, 4));
+  // Reduce modulo x^128 + x^7 + x^2 + x + 1.
+  __m128i t = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(low, 31), _mm_slli_epi32(low, 30)),
+      _mm_slli_epi32(low, 25));
+  __m128i carry = _mm_srli_si128(t, 4);
+  low = _mm_xor_si128(low, _mm_slli_si128(t, 12));
+  t = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(low, 1), _mm_srli_epi32(low, 2)),
+      _mm_srli_epi32(low, 7));
+  t = _mm_xor_si128(t, carry);
+  low = _mm_xor_si128(low, t);
+  return _mm_xor_si128(high, low);
+}
+
+RN_AESNI_TARGET
+static inline __m128i loadPartialBlock(const uint8_t *data, uint32_t numBytes) {
+  uint8_t block[RN_AES_BLOCK_BYTES] = {0};
+  memcpy(block, data, numBytes);
+  __m128i result = _mm_loadu_si128((const __m128i*)block);
+  wipeBytes(block, sizeof(block));
+  return result;
+}
+
+RN_AESNI_TARGET
+static void ghashClmul(__m128i *y, __m128i h, const uint8_t *data, uint64_t numBytes) {
+  const __m128i byteSwap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  while (numBytes != 0) {
+    uint32_t blockBytes = numBytes < RN_AES_BLOCK_BYTES? numBytes : RN_AES_BLOCK_BYTES;
+    __m128i block = blockBytes == RN_AES_BLOCK_BYTES?
+        _mm_loadu_si128((const __m128i*)data) : loadPartialBlock(data, blockBytes);
+    *y = gcmMultiplyClmul(_mm_xor_si128(*y, _mm_shuffle_epi8(block, byteSwap)), h);
+    data += blockBytes;
+    numBytes -= blockBytes;
+  }
+}
+
+RN_AESNI_TARGET
+static void aesCtrAesni(const __m128i *roundKeys, uint32_t numRounds, uint8_t *counter,
+    uint8_t *out, const uint8_t *in, uint64_t numBytes) {
+  while (numBytes != 0) {
+    uint32_t blockBytes = numBytes < RN_AES_BLOCK_BYTES? numBytes : RN_AES_BLOCK_BYTES;
+    __m128i keystream = aesniEncryptBlock(roundKeys, numRounds,
+        _mm_loadu_si128((const __m128i*)counter));
+    gcmIncrementCounter(counter);
+    if (blockBytes == RN_AES_BLOCK_BYTES) {
+      __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), keystream);
+      _mm_storeu_si128((__m128i*)out, block);
+    } else {
+      uint8_t block[RN_AES_BLOCK_BYTES];
+      _mm_storeu_si128((__m128i*)block, keystream);
+      for (uint32_t i = 0; i < blockBytes; i++) {
+        out[i] = in[i] ^ block[i];
+      }
+      wipeBytes(block, sizeof(block));
+    }
+    in += blockBytes;
+    out += blockBytes;
+    numBytes -= blockBytes;
+  }
+}
+
+// The same as aesGcmPortable, with AES-NI and PCLMULQDQ.
+RN_AESNI_TARGET
+static void aesGcmAesni(const runtime_aesKey *aesKey, const uint8_t *nonce, uint8_t *out,
+    const uint8_t *in, uint64_t numBytes, const uint8_t *ad, uint64_t adBytes, uint8_t *tag,
+    bool encrypt) {
+  const __m128i byteSwap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  __m128i roundKeys[RN_AES_MAX_ROUNDS + 1];
+  uint32_t numRounds = aesKey->numRounds;
+  for (uint32_t i = 0; i <= numRounds; i++) {
+    roundKeys[i] = _mm_loadu_si128((const __m128i*)aesKey->roundKeys[i]);
+  }
+  __m128i h = _mm_shuffle_epi8(aesniEncryptBlock(roundKeys, numRounds, _mm_setzero_si128()),
+      byteSwap);
+  __m128i y = _mm_setzero_si128();
+  uint8_t counter[RN_AES_BLOCK_BYTES];
+  memcpy(counter, nonce, RN_GCM_NONCE_BYTES);
+  writeBigEndian32(counter + 12, 1);
+  __m128i tagMask = aesniEncryptBlock(roundKeys, numRounds,
+      _mm_loadu_si128((const __m128i*)counter));
+  gcmIncrementCounter(counter);
+  ghashClmul(&y, h, ad, adBytes);
+  if (encrypt) {
+    aesCtrAesni(roundKeys, numRounds, counter, out, in, numBytes);
+    ghashClmul(&y, h, out, numBytes);
+  } else {
+    ghashClmul(&y, h, in, numBytes);
+  }
+  __m128i lengths = _mm_set_epi64x(adBytes << 3, numBytes << 3);
+  y = gcmMultiplyClmul(_mm_xor_si128(y, lengths), h);
+  _mm_storeu_si128((__m128i*)tag, _mm_xor_si128(_mm_shuffle_epi8(y, byteSwap), tagMask));
+  if (!encrypt) {
+    aesCtrAesni(roundKeys, numRounds, counter, out, in, numBytes);
+  }
+  wipeBytes(roundKeys, sizeof(roundKeys));
+  wipeBytes(&h, sizeof(h));
+  wipeBytes(&y, sizeof(y));
+  wipeBytes(&tagMask, sizeof(tagMask));
+}
+#endif
+
+// Set up the key, and run AES-GCM with the best implementation we have.
+static void aesGcm(const uint8_t *key, uint32_t keyBytes, const uint8_t *nonce, uint8_t *out,
+    const uint8_t *in, uint64_t numBytes, const uint8_t *ad, uint64_t adBytes, uint8_t *tag,
+    bool encrypt) {
+  runtime_aesKey aesKey;
+  aesExpandKey(&aesKey, key, keyBytes);
+#ifdef RN_CRYPTO_X86
+  if (useAesni()) {
+    aesGcmAesni(&aesKey, nonce, out, in, numBytes, ad, adBytes, tag, encrypt);
+    wipeBytes(&aesKey, sizeof(aesKey));
+    return;
+  }
+#endif
+  aesGcmPortable(&aesKey, nonce, out, in, numBytes, ad, adBytes, tag, encrypt);
+  wipeBytes(&aesKey, sizeof(aesKey));
+}
+
+// Throw an exception if the AES-GCM key or nonce have the wrong size.
+static void checkAesGcmParameters(const runtime_array *key, const runtime_array *nonce) {
+  if (key->numElements != 16 && key->numElements != 32) {
+    runtime_raiseExceptionCstr("InvalidArgument", __FILE__, __LINE__,
+        "AES key must be 16 or 32 bytes long");
+  }
+  checkLength(nonce, RN_GCM_NONCE_BYTES, "AES-GCM nonce");
+}
+
+// ChaCha20 and Poly1305, RFC 8439.
+
+#define RN_QUARTER_ROUND(a, b, c, d) \
+  a += b; d = rotl32(d ^ a, 16); \
+  c += d; b = rotl32(b ^ c, 12); \
+  a += b; d = rotl32(d ^ a, 8); \
+  c += d; b = rotl32(b ^ c, 7);
+
+// Compute the ChaCha20 block for |counter|.
+static void chacha20Block(uint8_t *out, const uint8_t *key, const uint8_t *nonce,
+    uint32_t counter) {
+  uint32_t input[16];
+  input[0] = 0x61707865;
+  input[1] = 0x3320646e;
+  input[2] = 0x79622d32;
+  input[3] = 0x6b206574;
+  for (uint32_t i = 0; i < 8; i++) {
+    input[4 + i] = readLittleEndian32(key + 4 * i);
+  }
+  input[12] = counter;
+  for (uint32_t i = 0; i < 3; i++) {
+    input[13 + i] = readLittleEndian32(nonce + 4 * i);
+  }
+  uint32_t x[16];
+  memcpy(x, input, sizeof(x));
+  for (uint32_t i = 0; i < 10; i++) {
+    RN_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+    RN_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+    RN_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+    RN_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+    RN_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+    RN_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+    RN_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+    RN_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+  }
+  for (uint32_t i = 0; i < 16; i++) {
+    writeLittleEndian32(out + 4 * i, x[i] + input[i]);
+  }
+  wipeBytes(input, sizeof(input));
+  wipeBytes(x, sizeof(x));
+}
+
+// XOR the keystream starting at block |counter| into |numBytes| bytes.
+static void chacha20Xor(const uint8_t *key, const uint8_t *nonce, uint32_t counter, uint8_t *out,
+    const uint8_t *in, uint64_t numBytes) {
+  uint8_t keystream[RN_CHACHA20_BLOCK_BYTES];
+  while (numBytes != 0) {
+    uint32_t blockBytes = numBytes < RN_CHACHA20_BLOCK_BYTES? numBytes : RN_CHACHA20_BLOCK_BYTES;
+    chacha20Block(keystream, key, nonce, counter++);
+    for (uint32_t i = 0; i < blockBytes; i++) {
+      out[i] = in[i] ^ keystream[i];
+    }
+    in += blockBytes;
+    out += blockBytes;
+    numBytes -= blockBytes;
+  }
+  wipeBytes(keystream, sizeof(keystream));
+}
+
+#define RN_MASK44 0xfffffffffffULL
+#define RN_MASK42 0x3ffffffffffULL
+
+// Poly1305 state, with the accumulator and key in radix 2^44.
+typedef struct {
+  uint64_t r[3];
+  uint64_t h[3];
+} runtime_poly1305;
+
+static void poly1305Init(runtime_poly1305 *poly, const uint8_t *key) {
+  uint64_t t0 = readLittleEndian64(key);
+  uint64_t t1 = readLittleEndian64(key + 8);
+  poly->r[0] = t0 & 0xffc0fffffffULL;
+  poly->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+  poly->r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+  poly->h[0] = poly->h[1] = poly->h[2] = 0;
+}
+
+// Absorb |numBytes| bytes, zero padded to a multiple of 16, as RFC 8439 does
+// for the AEAD construction.
+static void poly1305Update(runtime_poly1305 *poly, const uint8_t *data, uint64_t numBytes) {
+  uint64_t r0 = poly->r[0], r1 = poly->r[1], r2 = poly->r[2];
+  uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+  uint64_t h0 = poly->h[0], h1 = poly->h[1], h2 = poly->h[2];
+  while (numBytes != 0) {
+    uint8_t block[16] = {0};
+    uint32_t blockBytes = numBytes < 16? numBytes : 16;
+    memcpy(block, data, blockBytes);
+    uint64_t t0 = readLittleEndian64(block);
+    uint64_t t1 = readLittleEndian64(block + 8);
+    h0 += t0 & RN_MASK44;
+    h1 += ((t0 >> 44) | (t1 << 20)) & RN_MASK44;
+    h2 += ((t1 >> 24) & RN_MASK42) | (1ULL << 40);
+    unsigned __int128 d0 = (unsigned __int128)h0 * r0 + (unsigned __int128)h1 * s2 +
+        (unsigned __int128)h2 * s1;
+    unsigned __int128 d1 = (unsigned __int128)h0 * r1 + (unsigned __int128)h1 * r0 +
+        (unsigned __int128)h2 * s2;
+    unsigned __int128 d2 = (unsigned __int128)h0 * r2 + (unsigned __int128)h1 * r1 +
+        (unsigned __int128)h2 * r0;
+    uint64_t c = (uint64_t)(d0 >> 44);
+    h0 = (uint64_t)d0 & RN_MASK44;
+    d1 += c;
+    c = (uint64_t)(d1 >> 44);
+    h1 = (uint64_t)d1 & RN_MASK44;
+    d2 += c;
+    c = (uint64_t)(d2 >> 42);
+    h2 = (uint64_t)d2 & RN_MASK42;
+    h0 += c * 5;
+    c = h0 >> 44;
+    h0 &= RN_MASK44;
+    h1 += c;
+    data += blockBytes;
+    numBytes -= blockBytes;
+    wipeBytes(block, sizeof(block));
+  }
+  poly->h[0] = h0;
+  poly->h[1] = h1;
+  poly->h[2] = h2;
+}
+
+// Fully reduce the accumulator, add s, and write the tag.
+static void poly1305Finish(runtime_poly1305 *poly, const uint8_t *key, uint8_t *tag) {
+  uint64_t h0 = poly->h[0], h1 = poly->h[1], h2 = poly->h[2];
+  uint64_t c = h1 >> 44;
+  h1 &= RN_MASK44;
+  h2 += c;
+  c = h2 >> 42;
+  h2 &= RN_MASK42;
+  h0 += c * 5;
+  c = h0 >> 44;
+  h0 &= RN_MASK44;
+  h1 += c;
+  c = h1 >> 44;
+  h1 &= RN_MASK44;
+  h2 += c;
+  c = h2 >> 42;
+  h2 &= RN_MASK42;
+  h0 += c * 5;
+  c = h0 >> 44;
+  h0 &= RN_MASK44;
+  h1 += c;
+  // Compute h - p, and select it if it did not underflow.
+  uint64_t g0 = h0 + 5;
+  c = g0 >> 44;
+  g0 &= RN_MASK44;
+  uint64_t g1 = h1 + c;
+  c = g1 >> 44;
+  g1 &= RN_MASK44;
+  uint64_t g2 = h2 + c - (1ULL << 42);
+  uint64_t mask = (g2 >> 63) - 1;
+  h0 = (h0 & ~mask) | (g0 & mask);
+  h1 = (h1 & ~mask) | (g1 & mask);
+  h2 = (h2 & ~mask) | (g2 & mask);
+  uint64_t t0 = readLittleEndian64(key + 16);
+  uint64_t t1 = readLittleEndian64(key + 24);
+  h0 += t0 & RN_MASK44;
+  c = h0 >> 44;
+  h0 &= RN_MASK44;
+  h1 += (((t0 >> 44) | (t1 << 20)) & RN_MASK44) + c;
+  c = h1 >> 44;
+  h1 &= RN_MASK44;
+  h2 += ((t1 >> 24) & RN_MASK42) + c;
+  writeLittleEndian64(tag, h0 | (h1 << 44));
+  writeLittleEndian64(tag + 8, (h1 >> 20) | (h2 << 24));
+  wipeBytes(poly, sizeof(runtime_poly1305));
+}
+
+// Compute the ChaCha20-Poly1305 tag, and encrypt or decrypt.  When decrypting,
+// the tag is computed before |out| is written.
+static void chacha20Poly1305(const uint8_t *key, uint32_t keyBytes, const uint8_t *nonce,
+    uint8_t *out, const uint8_t *in, uint64_t numBytes, const uint8_t *ad, uint64_t adBytes,
+    uint8_t *tag, bool encrypt) {
+  uint8_t polyKey[RN_CHACHA20_BLOCK_BYTES];
+  chacha20Block(polyKey, key, nonce, 0);
+  runtime_poly1305 poly;
+  poly1305Init(&poly, polyKey);
+  poly1305Update(&poly, ad, adBytes);
+  if (encrypt) {
+    chacha20Xor(key, nonce, 1, out, in, numBytes);
+    poly1305Update(&poly, out, numBytes);
+  } else {
+    poly1305Update(&poly, in, numBytes);
+  }
+  uint8_t lengths[16];
+  writeLittleEndian64(lengths, adBytes);
+  writeLittleEndian64(lengths + 8, numBytes);
+  poly1305Update(&poly, lengths, sizeof(lengths));
+  poly1305Finish(&poly, polyKey, tag);
+  if (!encrypt) {
+    chacha20Xor(key, nonce, 1, out, in, numBytes);
+  }
+  wipeBytes(polyKey, sizeof(polyKey));
+}
+
+// Throw an exception if the ChaCha20-Poly1305 key or nonce have the wrong size.
+static void checkChacha20Poly1305Parameters(const runtime_array *key, const runtime_array *nonce) {
+  checkLength(key, RN_CHACHA20_KEY_BYTES, "ChaCha20-Poly1305 key");
+  checkLength(nonce, RN_CHACHA20_NONCE_BYTES, "ChaCha20-Poly1305 nonce");
+}
+
+// The Rune interface.
+
+// An AEAD: aesGcm or chacha20Poly1305.
+typedef void (*runtime_aead)(const uint8_t *key, uint32_t keyBytes, const uint8_t *nonce,
+    uint8_t *out, const uint8_t *in, uint64_t numBytes, const uint8_t *ad, uint64_t adBytes,
+    uint8_t *tag, bool encrypt);
+
+static inline const uint8_t *getBytes(const runtime_array *array) {
+  return (const uint8_t*)array->data;
+}
+
+// Resize |dest| to |numBytes|, marking it secret first if |secret|.  This can
+// move other arrays, so call it before reading the inputs.
+static uint8_t *resizeOutput(runtime_array *dest, uint64_t numBytes, bool secret) {
+  runtime_freeArray(dest);
+  runtime_allocArray(dest, numBytes, sizeof(uint8_t), false);
+  if (secret) {
+    runtime_markSecretArray(dest, false);
+  }
+  return (uint8_t*)dest->data;
+}
+
+// Encrypt |plaintext|, and append the tag.
+static void aeadEncrypt(runtime_aead aead, runtime_array *ciphertext, const runtime_array *key,
+    const runtime_array *nonce, const runtime_array *plaintext,
+    const runtime_array *associatedData) {
+  uint64_t numBytes = plaintext->numElements;
+  uint8_t *p = resizeOutput(ciphertext, numBytes + RN_AEAD_TAG_BYTES, false);
+  aead(getBytes(key), key->numElements, getBytes(nonce), p, getBytes(plaintext), numBytes,
+      getBytes(associatedData), associatedData->numElements, p + numBytes, true);
+}
+
+// Check the tag and decrypt |ciphertext|.  On failure, |plaintext| is left
+// empty.
+static bool aeadDecrypt(runtime_aead aead, runtime_array *plaintext, const runtime_array *key,
+    const runtime_array *nonce, const runtime_array *ciphertext,
+    const runtime_array *associatedData) {
+  if (ciphertext->numElements < RN_AEAD_TAG_BYTES) {
+    runtime_freeArray(plaintext);
+    return false;
+  }
+  uint64_t numBytes = ciphertext->numElements - RN_AEAD_TAG_BYTES;
+  uint8_t *p = resizeOutput(plaintext, numBytes, true);
+  const uint8_t *c = getBytes(ciphertext);
+  uint8_t tag[RN_AEAD_TAG_BYTES];
+  aead(getBytes(key), key->numElements, getBytes(nonce), p, c, numBytes,
+      getBytes(associatedData), associatedData->numElements, tag, false);
+  bool valid = constantTimeEqual(tag, c + numBytes, RN_AEAD_TAG_BYTES);
+  wipeBytes(tag, sizeof(tag));
+  if (!valid) {
+    runtime_freeArray(plaintext);
+  }
+  return valid;
+}
+
+// Compute the SHA-256 digest of |message|.
+void runtime_sha256(runtime_array *digest, const runtime_array *message) {
+  uint8_t *p = resizeOutput(digest, RN_SHA256_DIGEST_BYTES, true);
+  sha256(p, getBytes(message), message->numElements);
+}
+
+// Compute the SHA3-256 digest of |message|.
+void runtime_sha3_256(runtime_array *digest, const runtime_array *message) {
+  uint8_t *p = resizeOutput(digest, RN_SHA3_256_DIGEST_BYTES, true);
+  sha3_256(p, getBytes(message), message->numElements);
+}
+
+// Encrypt |plaintext| with AES-GCM, using a 16 or 32 byte key and a 12 byte
+// nonce, which must never be reused with the same key.
+void runtime_aesGcmEncrypt(runtime_array *ciphertext, const runtime_array *key,
+    const runtime_array *nonce, const runtime_array *plaintext,
+    const runtime_array *associatedData) {
+  checkAesGcmParameters(key, nonce);
+  aeadEncrypt(aesGcm, ciphertext, key, nonce, plaintext, associatedData);
+}
+
+// Authenticate and decrypt an AES-GCM ciphertext.  Return false, with
+// |plaintext| empty, if the tag does not match.
+bool runtime_aesGcmDecrypt(runtime_array *plaintext, const runtime_array *key,
+    const runtime_array *nonce, const runtime_array *ciphertext,
+    const runtime_array *associatedData) {
+  checkAesGcmParameters(key, nonce);
+  return aeadDecrypt(aesGcm, plaintext, key, nonce, ciphertext, associatedData);
+}
+
+// Encrypt |plaintext| with ChaCha20-Poly1305, using a 32 byte key and a 12 byte
+// nonce, which must never be reused with the same key.
+void runtime_chacha20Poly1305Encrypt(runtime_array *ciphertext, const runtime_array *key,
+    const runtime_array *nonce, const runtime_array *plaintext,
+    const runtime_array *associatedData) {
+  checkChacha20Poly1305Parameters(key, nonce);
+  aeadEncrypt(chacha20Poly1305, ciphertext, key, nonce, plaintext, associatedData);
+}
+
+// Authenticate and decrypt a ChaCha20-Poly1305 ciphertext.  Return false, with
+// |plaintext| empty, if the tag does not match.
+bool runtime_chacha20Poly1305Decrypt(runtime_array *plaintext, const runtime_array *key,
+    const runtime_array *nonce, const runtime_array *ciphertext,
+    const runtime_array *associatedData) {
+  checkChacha20Poly1305Parameters(key, nonce);
+  return aeadDecrypt(chacha20Poly1305, plaintext, key, nonce, ciphertext, associatedData);
+}
@@ -17,26 +17,322 @@
 #include <stdio.h>
 #include <float.h>
 #include <string.h>
+#include <math.h>
 
-#define MAX_FLOAT_STRING_SIZE (64)
+// Shortest round-trip digit generation, using Grisu2 by Florian Loitsch,
+// "Printing Floating-Point Numbers Quickly and Accurately with Integers".  The
+// digits always read back as the same value, and are the shortest such
+// digits in all but a tiny fraction of cases.
 
-#if defined(DBL_DECIMAL_DIG)
-#  define DBL_SIG_DIGITS (DBL_DECIMAL_DIG)
-#  define FLT_SIG_DIGITS (FLT_DECIMAL_DIG)
-#elif defined(DECIMAL_DIG)
-#  define DBL_SIG_DIGITS (DECIMAL_DIG)
-#  define FLT_SIG_DIGITS (DECIMAL_DIG)
-#else
-#  define DBL_SIG_DIGITS (DBL_DIG + 3)
-#  define FLT_SIG_DIGITS (FLT_DIG + 3)
-#endif
+// A floating point number f * 2^e with a 64-bit significand.
+typedef struct {
+  uint64_t f;
+  int32_t e;
+} runtime_diyFp;
 
+// A cached power of 10, f * 2^e ~= 10^k.
+typedef struct {
+  uint64_t f;
+  int32_t e;
+  int32_t k;
+} runtime_cachedPower;
+
+// Normalized powers of 10 from 10^-300 to 10^324, in steps of 10^8.
+static const runtime_cachedPower runtime_cachedPowers[] = {
+  {0xab70fe17c79ac6caull, -1060, -300}, {0xff77b1fcbebcdc4full, -1034, -292},
+  {0xbe5691ef416bd60cull, -1007, -284}, {0x8dd01fad907ffc3cull, -980, -276},
+  {0xd3515c2831559a83ull, -954, -268}, {0x9d71ac8fada6c9b5ull, -927, -260},
+  {0xea9c227723ee8bcbull, -901, -252}, {0xaecc49914078536dull, -874, -244},
+  {0x823c12795db6ce57ull, -847, -236}, {0xc21094364dfb5637ull, -821, -228},
+  {0x9096ea6f3848984full, -794, -220}, {0xd77485cb25823ac7ull, -768, -212},
+  {0xa086cfcd97bf97f4ull, -741, -204}, {0xef340a98172aace5ull, -715, -196},
+  {0xb23867fb2a35b28eull, -688, -188}, {0x84c8d4dfd2c63f3bull, -661, -180},
+  {0xc5dd44271ad3cdbaull, -635, -172}, {0x936b9fcebb25c996ull, -608, -164},
+  {0xdbac6c247d62a584ull, -582, -156}, {0xa3ab66580d5fdaf6ull, -555, -148},
+  {0xf3e2f893dec3f126ull, -529, -140}, {0xb5b5ada8aaff80b8ull, -502, -132},
+  {0x87625f056c7c4a8bull, -475, -124}, {0xc9bcff6034c13053ull, -449, -116},
+  {0x964e858c91ba2655ull, -422, -108}, {0xdff9772470297ebdull, -396, -100},
+  {0xa6dfbd9fb8e5b88full, -369, -92}, {0xf8a95fcf88747d94ull, -343, -84},
+  {0xb94470938fa89bcfull, -316, -76}, {0x8a08f0f8bf0f156bull, -289, -68},
+  {0xcdb02555653131b6ull, -263, -60}, {0x993fe2c6d07b7facull, -236, -52},
+  {0xe45c10c42a2b3b06ull, -210, -44}, {0xaa242499697392d3ull, -183, -36},
+  {0xfd87b5f28300ca0eull, -157, -28}, {0xbce5086492111aebull, -130, -20},
+  {0x8cbccc096f5088ccull, -103, -12}, {0xd1b71758e219652cull, -77, -4},
+  {0x9c40000000000000ull, -50, 4}, {0xe8d4a51000000000ull, -24, 12},
+  {0xad78ebc5ac620000ull, 3, 20}, {0x813f3978f8940984ull, 30, 28},
+  {0xc097ce7bc90715b3ull, 56, 36}, {0x8f7e32ce7bea5c70ull, 83, 44},
+  {0xd5d238a4abe98068ull, 109, 52}, {0x9f4f2726179a2245ull, 136, 60},
+  {0xed63a231d4c4fb27ull, 162, 68}, {0xb0de65388cc8ada8ull, 189, 76},
+  {0x83c7088e1aab65dbull, 216, 84}, {0xc45d1df942711d9aull, 242, 92},
+  {0x924d692ca61be758ull, 269, 100}, {0xda01ee641a708deaull, 295, 108},
+  {0xa26da3999aef774aull, 322, 116}, {0xf209787bb47d6b85ull, 348, 124},
+  {0xb454e4a179dd1877ull, 375, 132}, {0x865b86925b9bc5c2ull, 402, 140},
+  {0xc83553c5c8965d3dull, 428, 148}, {0x952ab45cfa97a0b3ull, 455, 156},
+  {0xde469fbd99a05fe3ull, 481, 164}, {0xa59bc234db398c25ull, 508, 172},
+  {0xf6c69a72a3989f5cull, 534, 180}, {0xb7dcbf5354e9beceull, 561, 188},
+  {0x88fcf317f22241e2ull, 588, 196}, {0xcc20ce9bd35c78a5ull, 614, 204},
+  {0x98165af37b2153dfull, 641, 212}, {0xe2a0b5dc971f303aull, 667, 220},
+  {0xa8d9d1535ce3b396ull, 694, 228}, {0xfb9b7cd9a4a7443cull, 720, 236},
+  {0xbb764c4ca7a44410ull, 747, 244}, {0x8bab8eefb6409c1aull, 774, 252},
+  {0xd01fef10a657842cull, 800, 260}, {0x9b10a4e5e9913129ull, 827, 268},
+  {0xe7109bfba19c0c9dull, 853, 276}, {0xac2820d9623bf429ull, 880, 284},
+  {0x80444b5e7aa7cf85ull, 907, 292}, {0xbf21e44003acdd2dull, 933, 300},
+  {0x8e679c2f5e44ff8full, 960, 308}, {0xd433179d9c8cb841ull, 986, 316},
+  {0x9e19db92b4e31ba9ull, 1013, 324},
+};
+
+#define RN_CACHED_POWERS_MIN_DEC_EXP (-300)
+#define RN_CACHED_POWERS_DEC_STEP 8
+// The scaled value has a binary exponent in [RN_GRISU_ALPHA, RN_GRISU_GAMMA],
+// so its integer part fits in 32 bits.
+#define RN_GRISU_ALPHA (-60)
+#define RN_GRISU_GAMMA (-32)
+
+// Return x - y.  Both must have the same exponent, and x.f >= y.f.
+static inline runtime_diyFp diyFpSub(runtime_diyFp x, runtime_diyFp y) {
+  runtime_diyFp result = {x.f - y.f, x.e};
+  return result;
+}
+
+// Return x * y, rounded to 64 bits.
+static inline runtime_diyFp diyFpMul(runtime_diyFp x, runtime_diyFp y) {
+  unsigned __int128 p = (unsigned __int128)x.f * y.f;
+  uint64_t high = (uint64_t)(p >> 64);
+  uint64_t low = (uint64_t)p;
+  runtime_diyFp result = {high + (low >> 63), x.e + y.e + 64};
+  return result;
+}
+
+// Shift x left until its top bit is set.
+static inline runtime_diyFp diyFpNormalize(runtime_diyFp x) {
+  uint32_t shift = __builtin_clzll(x.f);
+  runtime_diyFp result = {x.f << shift, x.e - (int32_t)shift};
+  return result;
+}
+
+// Shift x left to give it the exponent e, which must not be greater than x.e.
+static inline runtime_diyFp diyFpNormalizeTo(runtime_diyFp x, int32_t e) {
+  runtime_diyFp result = {x.f << (x.e - e), e};
+  return result;
+}
+
+// Find the normalized value and its normalized rounding boundaries, half way
+// to the neighboring values.  |significandBits| includes the hidden bit, 53
+// for doubles and 24 for floats, so floats get their own wider boundaries.
+static void computeBoundaries(double value, bool isFloat, runtime_diyFp *w,
+    runtime_diyFp *minus, runtime_diyFp *plus) {
+  uint32_t significandBits;
+  int32_t bias;
+  uint64_t bits;
+  if (isFloat) {
+    float floatValue = value;
+    uint32_t floatBits;
+    memcpy(&floatBits, &floatValue, sizeof(floatBits));
+    bits = floatBits;
+    significandBits = FLT_MANT_DIG;
+    bias = FLT_MAX_EXP - 1 + FLT_MANT_DIG - 1;
+  } else {
+    memcpy(&bits, &value, sizeof(bits));
+    significandBits = DBL_MANT_DIG;
+    bias = DBL_MAX_EXP - 1 + DBL_MANT_DIG - 1;
+  }
+  uint64_t hiddenBit = (uint64_t)1 << (significandBits - 1);
+  uint64_t fraction = bits & (hiddenBit - 1);
+  uint64_t biasedExponent = bits >> (significandBits - 1);
+  if (isFloat) {
+    biasedExponent &= (FLT_MAX_EXP << 1) - 1;
+  } else {
+    biasedExponent &= (DBL_MAX_EXP << 1) - 1;
+  }
+  runtime_diyFp v;
+  if (biasedExponent == 0) {
+    // Subnormal.
+    v.f = fraction;
+    v.e = 1 - bias;
+  } else {
+    v.f = fraction + hiddenBit;
+    v.e = (int32_t)biasedExponent - bias;
+  }
+  // At a power of 2, the lower neighbor is twice as close.
+  bool lowerBoundaryIsCloser = fraction == 0 && biasedExponent > 1;
+  runtime_diyFp mPlus = {(v.f << 1) + 1, v.e - 1};
+  runtime_diyFp mMinus;
+  if (lowerBoundaryIsCloser) {
+    mMinus.f = (v.f << 2) - 1;
+    mMinus.e = v.e - 2;
+  } else {
+    mMinus.f = (v.f << 1) - 1;
+    mMinus.e = v.e - 1;
+  }
+  *plus = diyFpNormalize(mPlus);
+  *minus = diyFpNormalizeTo(mMinus, plus->e);
+  *w = diyFpNormalize(v);
+}
+
+// Find a cached power of 10 which scales a value with binary exponent e into
+// the range [RN_GRISU_ALPHA, RN_GRISU_GAMMA].
+static const runtime_cachedPower *findCachedPower(int32_t e) {
+  // 78913 / 2^18 ~= log10(2).
+  int32_t f = RN_GRISU_ALPHA - e - 1;
+  int32_t k = (f * 78913) / (1 << 18) + (f > 0);
+  uint32_t index = (-RN_CACHED_POWERS_MIN_DEC_EXP + k + (RN_CACHED_POWERS_DEC_STEP - 1)) /
+      RN_CACHED_POWERS_DEC_STEP;
+  return runtime_cachedPowers + index;
+}
+
+// Return the number of decimal digits in n, and set |pow10| to 10^(digits - 1).
+static uint32_t findLargestPow10(uint32_t n, uint32_t *pow10) {
+  uint32_t digits = 10;
+  uint32_t p = 1000000000;
+  while (digits > 1 && n < p) {
+    p /= 10;
+    digits--;
+  }
+  *pow10 = p;
+  return digits;
+}
+
+// Move the last digit towards the exact value, while staying within the
+// rounding interval.
+static void grisuRound(uint8_t *digits, uint32_t numDigits, uint64_t dist, uint64_t delta,
+    uint64_t rest, uint64_t tenK) {
+  while (rest < dist && delta - rest >= tenK &&
+      (rest + tenK < dist || dist - rest > rest + tenK - dist)) {
+    digits[numDigits - 1]--;
+    rest += tenK;
+  }
+}
+
+// Generate the shortest digits in the interval (minus, plus) that are closest
+// to w.  All three are scaled by the same cached power of 10.
+static uint32_t grisuGenerateDigits(uint8_t *digits, int32_t *decimalExponent,
+    runtime_diyFp minus, runtime_diyFp w, runtime_diyFp plus) {
+  uint64_t delta = diyFpSub(plus, minus).f;
+  uint64_t dist = diyFpSub(plus, w).f;
+  uint32_t shift = -plus.e;
+  uint64_t one = (uint64_t)1 << shift;
+  uint32_t p1 = (uint32_t)(plus.f >> shift);
+  uint64_t p2 = plus.f & (one - 1);
+  uint32_t pow10;
+  uint32_t n = findLargestPow10(p1, &pow10);
+  uint32_t numDigits = 0;
+  while (n > 0) {
+    digits[numDigits++] = '0' + p1 / pow10;
+    p1 %= pow10;
+    n--;
+    uint64_t rest = ((uint64_t)p1 << shift) + p2;
+    if (rest <= delta) {
+      *decimalExponent += n;
+      grisuRound(digits, numDigits, dist, delta, rest, (uint64_t)pow10 << shift);
+      return numDigits;
+    }
+    pow10 /= 10;
+  }
+  uint32_t m = 0;
+  do {
+    p2 *= 10;
+    digits[numDigits++] = '0' + (p2 >> shift);
+    p2 &= one - 1;
+    m++;
+    delta *= 10;
+    dist *= 10;
+  } while (p2 > delta);
+  *decimalExponent -= m;
+  grisuRound(digits, numDigits, dist, delta, p2, one);
+  return numDigits;
+}
+
+// Find the shortest digits which read back as |value|, which must be finite and
+// greater than 0.  If |isFloat|, the digits only have to read back as the same
+// f32.  Write up to RN_MAX_DOUBLE_DIGITS ASCII digits, and return how many were
+// written.  The value is digits * 10^decimalExponent.
+uint32_t runtime_findShortestDigits(uint8_t *digits, int32_t *decimalExponent, double value,
+    bool isFloat) {
+  runtime_diyFp w, minus, plus;
+  computeBoundaries(value, isFloat, &w, &minus, &plus);
+  const runtime_cachedPower *cached = findCachedPower(plus.e);
+  runtime_diyFp c = {cached->f, cached->e};
+  runtime_diyFp scaledW = diyFpMul(w, c);
+  runtime_diyFp scaledMinus = diyFpMul(minus, c);
+  runtime_diyFp scaledPlus = diyFpMul(plus, c);
+  // Shrink the interval by 1 ulp on each side to allow for rounding in diyFpMul.
+  scaledMinus.f++;
+  scaledPlus.f--;
+  *decimalExponent = -cached->k;
+  return grisuGenerateDigits(digits, decimalExponent, scaledMinus, scaledW, scaledPlus);
+}
+
+// Write |value| like printf's %.<precision>g, but with the shortest digits that
+// read back as the same value.  Return the length.  |buf| needs room for
+// RN_MAX_DOUBLE_DIGITS plus 8 characters of sign, point and exponent, or
+// for the leading zeros of small fixed-point values, up to 4.
+static uint32_t formatShortest(char *buf, double value, bool isFloat, int32_t precision) {
+  char *p = buf;
+  if (signbit(value)) {
+    *p++ = '-';
+    value = -value;
+  }
+  if (isnan(value)) {
+    memcpy(p, "nan", 3);
+    return p + 3 - buf;
+  }
+  if (isinf(value)) {
+    memcpy(p, "inf", 3);
+    return p + 3 - buf;
+  }
+  if (value == 0.0) {
+    *p++ = '0';
+    return p - buf;
+  }
+  uint8_t digits[RN_MAX_DOUBLE_DIGITS];
+  int32_t decimalExponent;
+  int32_t numDigits = runtime_findShortestDigits(digits, &decimalExponent, value, isFloat);
+  // The exponent of the first digit in scientific notation.
+  int32_t exponent = numDigits + decimalExponent - 1;
+  if (exponent < -4 || exponent >= precision) {
+    *p++ = digits[0];
+    if (numDigits > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, numDigits - 1);
+      p += numDigits - 1;
+    }
+    *p++ = 'e';
+    *p++ = exponent < 0? '-' : '+';
+    uint32_t absExponent = exponent < 0? -exponent : exponent;
+    if (absExponent >= 100) {
+      *p++ = '0' + absExponent / 100;
+    }
+    *p++ = '0' + absExponent / 10 % 10;
+    *p++ = '0' + absExponent % 10;
+  } else if (exponent < 0) {
+    *p++ = '0';
+    *p++ = '.';
+    for (int32_t i = exponent + 1; i < 0; i++) {
+      *p++ = '0';
+    }
+    memcpy(p, digits, numDigits);
+    p += numDigits;
+  } else if (exponent + 1 >= numDigits) {
+    memcpy(p, digits, numDigits);
+    p += numDigits;
+    for (int32_t i = numDigits; i <= exponent; i++) {
+      *p++ = '0';
+    }
+  } else {
+    memcpy(p, digits, exponent + 1);
+    p += exponent + 1;
+    *p++ = '.';
+    memcpy(p, digits + exponent + 1, numDigits - exponent - 1);
+    p += numDigits - exponent - 1;
+  }
+  return p - buf;
+}
+
+#define MAX_FLOAT_STRING_SIZE (32)
 
 void runtime_f32tostring(runtime_array *dest, float value) {
   char tmp[MAX_FLOAT_STRING_SIZE];
-  memset(tmp, 0, sizeof(tmp));
-  int len = snprintf(tmp, sizeof(tmp), "%.*g", FLT_SIG_DIGITS, value);
-
+  uint32_t len = formatShortest(tmp, value, true, FLT_DECIMAL_DIG);
   runtime_freeArray(dest);
   runtime_allocArray(dest, len, sizeof(uint8_t), false);
   memcpy((char*)dest->data, tmp, len);
@@ -44,9 +340,7 @@ void runtime_f32tostring(runtime_array *dest, float value) {
 
 void runtime_f64tostring(runtime_array *dest, double value) {
   char tmp[MAX_FLOAT_STRING_SIZE];
-  memset(tmp, 0, sizeof(tmp));
-  int len = snprintf(tmp, sizeof(tmp), "%.*g", DBL_SIG_DIGITS, value);
-
+  uint32_t len = formatShortest(tmp, value, false, DBL_DECIMAL_DIG);
   runtime_freeArray(dest);
   runtime_allocArray(dest, len, sizeof(uint8_t), false);
   memcpy((char*)dest->data, tmp, len);
@@ -0,0 +1,101 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// String hashing for hashValue, in the style of wyhash.  Each step mixes 16
+// bytes with one 64x64->128 bit multiply, folding the high half into the low
+// half.  Strings over 48 bytes are hashed in three independent lanes, so the
+// multiplies overlap rather than forming one long dependency chain.  This is
+// fast, but not a keyed PRF: with seed 0 an attacker can find collisions.
+// Hash tables keyed by attacker-controlled strings should pass a random seed.
+
+#include "runtime.h"
+
+static const uint64_t hashSecret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+// Multiply a and b, and return the xor of the high and low halves of the product.
+static inline uint64_t hashMix(uint64_t a, uint64_t b) {
+  __uint128_t product = (__uint128_t)a * b;
+  return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+// Little endian loads.  The runtime only runs on little endian machines.
+static inline uint64_t read64(const uint8_t *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(uint64_t));
+  return value;
+}
+
+static inline uint64_t read32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(uint32_t));
+  return value;
+}
+
+// Read 1 to 3 bytes into one word, touching each byte at least once.
+static inline uint64_t readSmall(const uint8_t *p, uint64_t len) {
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+}
+
+// Hash len bytes at p, with the given seed.
+uint64_t runtime_hashBytes(const uint8_t *p, uint64_t len, uint64_t seed) {
+  seed ^= hashMix(seed ^ hashSecret[0], hashSecret[1]);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      // Two possibly overlapping 4 byte reads from each end.
+      uint64_t offset = (len >> 3) << 2;
+      a = (read32(p) << 32) | read32(p + offset);
+      b = (read32(p + len - 4) << 32) | read32(p + len - 4 - offset);
+    } else if (len > 0) {
+      a = readSmall(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    uint64_t remaining = len;
+    if (remaining > 48) {
+      uint64_t lane1 = seed;
+      uint64_t lane2 = seed;
+      do {
+        seed = hashMix(read64(p) ^ hashSecret[1], read64(p + 8) ^ seed);
+        lane1 = hashMix(read64(p + 16) ^ hashSecret[2], read64(p + 24) ^ lane1);
+        lane2 = hashMix(read64(p + 32) ^ hashSecret[3], read64(p + 40) ^ lane2);
+        p += 48;
+        remaining -= 48;
+      } while (remaining > 48);
+      seed ^= lane1 ^ lane2;
+    }
+    while (remaining > 16) {
+      seed = hashMix(read64(p) ^ hashSecret[1], read64(p + 8) ^ seed);
+      p += 16;
+      remaining -= 16;
+    }
+    // The last 16 bytes, which may overlap bytes already hashed.
+    a = read64(p + remaining - 16);
+    b = read64(p + remaining - 8);
+  }
+  a ^= hashSecret[1];
+  b ^= seed;
+  __uint128_t product = (__uint128_t)a * b;
+  a = (uint64_t)product;
+  b = (uint64_t)(product >> 64);
+  return hashMix(a ^ hashSecret[0] ^ len, b ^ hashSecret[1]);
+}
+
+// Hash a string, for hashValue.  Pass seed 0 for the default hash.
+uint64_t hashStringBytes(const runtime_array *string, uint64_t seed) {
+  return runtime_hashBytes((const uint8_t*)string->data, string->numElements, seed);
+}
@@ -16,22 +16,119 @@
 // This is meant to port easily to a microcontroller environment where we might
 // have a uart for stdin/stdout.
 
+// For fileno, fseeko and ftello under -std=c11.
+#define _DEFAULT_SOURCE
 #include "runtime.h"
 
 #include <ctype.h>
+#include <errno.h>  // For EINTR.
+#include <limits.h>  // For INT_MAX.
 #include <stdarg.h>
 #include <stdio.h>  // For access to stdin and stdout.
 #include <stdlib.h>  // For exit and getenv.
-#include <unistd.h>  // For getcwd.
+#include <sys/stat.h>  // For fstat.
+#include <unistd.h>  // For getcwd and read.
+#include <unwind.h>  // For _Unwind_ForcedUnwind.
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>  // For vectorized substring search.
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Console output is collected here and written to stdout at explicit flush
+// points: when full, before reading stdin, and on exit, panic, or uncaught
+// exception.  When stdout is a terminal, it is also flushed after each line.
+#define RN_STDOUT_BUFFER_SIZE (1 << 15)
+static uint8_t runtime_stdoutBuffer[RN_STDOUT_BUFFER_SIZE];
+static uint32_t runtime_stdoutPos;
+static bool runtime_stdoutStarted;
+static bool runtime_stdoutIsTerminal;
+
+// Stdin is read a buffer-full at a time, rather than a byte at a time with
+// getchar, so readln can find the end of each line with memchr.
+#define RN_STDIN_BUFFER_SIZE (1 << 16)
+static uint8_t runtime_stdinBuffer[RN_STDIN_BUFFER_SIZE];
+static uint32_t runtime_stdinPos;
+static uint32_t runtime_stdinLen;
 
 // Used in Linux for testing purposes.
 #define runtime_setJmp() (runtime_jmpBufSet = true, setjmp(runtime_jmpBuf))
-jmp_buf runtime_jmpBuf;
-bool runtime_jmpBufSet = false;
+_Thread_local jmp_buf runtime_jmpBuf;
+_Thread_local bool runtime_jmpBufSet = false;
+// Set at the top of the generated main from the compiler flags.
+bool runtime_unwindExceptions;
+bool runtime_nativeWideInts;
+
+// Write all of |p| to stdout, and flush it.
+static void fwriteStdout(const uint8_t *p, uint64_t len) {
+  while (len != 0) {
+    size_t bytesWritten = fwrite(p, sizeof(uint8_t), len, stdout);
+    if (bytesWritten == 0) {
+      break;
+    }
+    p += bytesWritten;
+    len -= bytesWritten;
+  }
+  fflush(stdout);
+}
+
+// Write any buffered console output to stdout.
+void runtime_flushStdout(void) {
+  uint32_t len = runtime_stdoutPos;
+  runtime_stdoutPos = 0;
+  fwriteStdout(runtime_stdoutBuffer, len);
+}
+
+// Make sure buffered output is written when the program exits.
+static void startStdout(void) {
+  runtime_stdoutStarted = true;
+  runtime_stdoutIsTerminal = isatty(STDOUT_FILENO);
+  atexit(runtime_flushStdout);
+}
+
+// Append bytes to the stdout buffer.  Writes larger than the buffer go straight
+// to stdout, after what is already buffered, so output stays in order.
+static void writeStdout(const uint8_t *p, uint64_t len) {
+  if (!runtime_stdoutStarted) {
+    startStdout();
+  }
+  if (len >= RN_STDOUT_BUFFER_SIZE) {
+    runtime_flushStdout();
+    fwriteStdout(p, len);
+    return;
+  }
+  if (len > RN_STDOUT_BUFFER_SIZE - runtime_stdoutPos) {
+    runtime_flushStdout();
+  }
+  memcpy(runtime_stdoutBuffer + runtime_stdoutPos, p, len);
+  runtime_stdoutPos += len;
+  if (runtime_stdoutIsTerminal && len != 0 && p[len - 1] == '\n') {
+    runtime_flushStdout();
+  }
+}
+
+// Read up to |len| bytes of stdin into |p|.  Return 0 at EOF or on error.
+static size_t readStdin(uint8_t *p, size_t len) {
+  ssize_t bytesRead;
+  do {
+    bytesRead = read(STDIN_FILENO, p, len);
+  } while (bytesRead < 0 && errno == EINTR);
+  return bytesRead < 0? 0 : bytesRead;
+}
+
+// Refill the empty stdin buffer.  Return false at EOF.  Console output is
+// flushed first, so prompts appear before we block.
+static bool fillStdin(void) {
+  runtime_flushStdout();
+  runtime_stdinPos = 0;
+  runtime_stdinLen = readStdin(runtime_stdinBuffer, RN_STDIN_BUFFER_SIZE);
+  return runtime_stdinLen != 0;
+}
 
 // This will exit if runtime_setLongJmp() has not been called.  Otherwise, it will
 // long-jump to runtime_jmpBuf.
 static void exitOrLongjmp() {
+  runtime_flushStdout();
   if (runtime_jmpBufSet) {
     runtime_jmpBufSet = false;
     longjmp(runtime_jmpBuf, 1);
@@ -100,6 +197,72 @@ uint64_t io_file_freadInternal(uint64_t ptr, runtime_array *buf) {
   return bytesRead;
 }
 
+// Map the rest of the file into |buf|, if the file is a regular file that has
+// not been read from yet.  Return false if it cannot be mapped, in which case
+// the caller should fall back on freadInternal.
+bool io_file_mmapInternal(uint64_t ptr, runtime_array *buf) {
+  FILE *file = (FILE*)(uintptr_t)ptr;
+  if (file == NULL || ftello(file) != 0) {
+    return false;
+  }
+  int fd = fileno(file);
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+    return false;
+  }
+  if (!runtime_mapFileArray(buf, fd, fileStat.st_size)) {
+    return false;
+  }
+  // Leave the file at EOF, as if it had been read.
+  fseeko(file, 0, SEEK_END);
+  return true;
+}
+
+// Read the next line of the file into |line|, without the '\n'.  The line's
+// buffer is reused, so reading a file line by line takes constant memory.
+// Return false if the file is at EOF.
+bool io_file_readlnInternal(uint64_t ptr, runtime_array *line) {
+  FILE *file = (FILE*)(uintptr_t)ptr;
+  uint64_t length = 0;
+  bool foundData = false;
+  for (;;) {
+    if (line->numElements - length < 2) {
+      runtime_resizeArrayKeepBuffer(line, length < 32? 64 : length << 1, sizeof(uint8_t), false);
+    }
+    uint8_t *p = (uint8_t*)line->data + length;
+    uint64_t room = line->numElements - length;
+    int size = room > INT_MAX? INT_MAX : room;
+    // fgets scans a block of the stream's buffer for the '\n', but '\0' bytes
+    // in the line hide how much it read.  Filling the room with '\n' first
+    // means the first '\n' is either the line's own, followed by fgets' '\0',
+    // or the fill just past that '\0'.
+    memset(p, '\n', size);
+    if (fgets((char*)p, size, file) == NULL) {
+      break;
+    }
+    foundData = true;
+    uint8_t *newline = memchr(p, '\n', size);
+    if (newline == NULL) {
+      // The line is longer than the room.
+      length += size - 1;
+    } else if (newline + 1 < p + size && newline[1] == '\0') {
+      length += newline - p;
+      break;
+    } else {
+      // The last line has no '\n'.
+      length += newline - p - 1;
+      break;
+    }
+  }
+  if (!foundData) {
+    runtime_freeArray(line);
+    return false;
+  }
+  // This zeroes the fill past the end of the line.
+  runtime_resizeArrayKeepBuffer(line, length, sizeof(uint8_t), false);
+  return true;
+}
+
 // Write the data to the file.
 bool io_file_fwriteInternal(uint64_t ptr, runtime_array *buf) {
   uint64_t len = buf->numElements;
@@ -112,102 +275,175 @@ bool io_file_ferrorInternal(uint64_t ptr) {
   return ferror((FILE*)(uintptr_t)ptr) != 0;
 }
 
-// Return one byte from stdin.
+// Return one byte from stdin, or 0xff at EOF.
 uint8_t readByte() {
-  return getchar();
+  if (runtime_stdinPos == runtime_stdinLen && !fillStdin()) {
+    return (uint8_t)EOF;
+  }
+  return runtime_stdinBuffer[runtime_stdinPos++];
 }
 
 // Write one character to stdout.
 void writeByte(uint8_t c) {
-  putchar(c);
+  if (runtime_stdoutStarted && !runtime_stdoutIsTerminal && runtime_stdoutPos < RN_STDOUT_BUFFER_SIZE) {
+    runtime_stdoutBuffer[runtime_stdoutPos++] = c;
+    return;
+  }
+  writeStdout(&c, 1);
 }
 
-// Read |numBytes| bytes from stdin.  Block until all are read.
+// Read |numBytes| bytes from stdin.  Block until all are read, or stdin
+// reaches EOF, in which case the array holds just the bytes read.
 void readBytes(runtime_array *array, uint64_t numBytes) {
-  if (array->numElements != 0) {
+  if (array->data != NULL) {
     runtime_freeArray(array);
   }
+  if (numBytes == 0) {
+    return;
+  }
   runtime_allocArray(array, numBytes, sizeof(uint8_t), false);
-  size_t totalRead = fread(array->data, sizeof(uint8_t), numBytes, stdin);
-  while (totalRead < numBytes) {
-    totalRead += fread((uint8_t*)array->data + totalRead, sizeof(uint8_t),
-        numBytes - totalRead, stdin);
+  uint8_t *p = (uint8_t*)array->data;
+  uint64_t totalRead = runtime_stdinLen - runtime_stdinPos;
+  if (totalRead > numBytes) {
+    totalRead = numBytes;
+  }
+  memcpy(p, runtime_stdinBuffer + runtime_stdinPos, totalRead);
+  runtime_stdinPos += totalRead;
+  if (totalRead < numBytes) {
+    // The buffer is empty, so read the rest straight into the array.
+    runtime_flushStdout();
+    while (totalRead < numBytes) {
+      size_t len = readStdin(p + totalRead, numBytes - totalRead);
+      if (len == 0) {
+        runtime_resizeArray(array, totalRead, sizeof(uint8_t), false);
+        return;
+      }
+      totalRead += len;
+    }
   }
 }
+
 // Write |numBytes| bytes from the array to stdout, starting at |offset| in the
 // array.  Block until all bytes are written.
 void writeBytes(const runtime_array *array, uint64_t numBytes, uint64_t offset) {
   if (numBytes == 0) {
     numBytes = array->numElements;
   }
-  uint8_t *p = (uint8_t*)array->data + offset;
-  size_t bytesWritten = fwrite(p, sizeof(uint8_t), numBytes, stdout);
-  size_t totalWritten = bytesWritten;
-  while (totalWritten < numBytes) {
-    p += bytesWritten;
-    bytesWritten = fwrite(p, sizeof(uint8_t), numBytes - totalWritten, stdout);
-    totalWritten += bytesWritten;
-  }
+  writeStdout((uint8_t*)array->data + offset, numBytes);
 }
 
-// Read a line of text from stdin.  Only return up to |maxBytes|.  Do not
-// include the '\n' in the returned string.
-void readln(runtime_array *array, uint64_t maxBytes) {
-  if (array->numElements != 0) {
-    runtime_freeArray(array);
-  }
-  // Allocate array large enough to maybe fit a line, but not too big for a
-  // microcontroller.
-  uint32_t allocated = 16;
+// Read a line of stdin into |array|, without the '\n', appending a buffer-full
+// at a time with memchr finding the end of the line.  Only read up to
+// |maxBytes|, if non-zero; the rest of the line is left for the next read.
+// With |keepBuffer|, the array's buffer is reused rather than reallocated.
+// Return false if stdin is at EOF.
+static bool readStdinLine(runtime_array *array, uint64_t maxBytes, bool keepBuffer) {
   if (maxBytes == 0) {
     maxBytes = UINT64_MAX;
   }
-  if (allocated > maxBytes) {
-    allocated = maxBytes;
-  }
-  runtime_allocArray(array, allocated, sizeof(uint8_t), false);
-  uint32_t pos = 0;
-  // Avoid using getline, since it calls malloc.
-  int c = getchar();
-  uint8_t *p = (uint8_t*)array->data;
-  while (c != EOF && c != '\n') {
-    if (pos == allocated) {
-      if (pos == maxBytes) {
-        array->numElements = pos;
-        return;
-      }
-      allocated <<= 1;
-      if (allocated > maxBytes) {
-        allocated = maxBytes;
+  uint64_t length = 0;
+  bool foundData = false;
+  while (length < maxBytes) {
+    if (runtime_stdinPos == runtime_stdinLen && !fillStdin()) {
+      break;
+    }
+    foundData = true;
+    uint8_t *start = runtime_stdinBuffer + runtime_stdinPos;
+    uint64_t available = runtime_stdinLen - runtime_stdinPos;
+    if (available > maxBytes - length) {
+      available = maxBytes - length;
+    }
+    uint8_t *newline = memchr(start, '\n', available);
+    uint64_t chunkLen = newline != NULL? newline - start : available;
+    if (chunkLen != 0) {
+      if (keepBuffer) {
+        runtime_resizeArrayKeepBuffer(array, length + chunkLen, sizeof(uint8_t), false);
+      } else {
+        runtime_resizeArray(array, length + chunkLen, sizeof(uint8_t), false);
       }
-      runtime_resizeArray(array, allocated, sizeof(uint8_t), false);
-      p = (uint8_t*)array->data + pos;
+      memcpy((uint8_t*)array->data + length, start, chunkLen);
+      length += chunkLen;
     }
-    p[pos++] = c;
-    c = getchar();
+    runtime_stdinPos += chunkLen;
+    if (newline != NULL) {
+      runtime_stdinPos++;
+      break;
+    }
+  }
+  if (keepBuffer) {
+    runtime_resizeArrayKeepBuffer(array, length, sizeof(uint8_t), false);
+  } else {
+    array->numElements = length;
+  }
+  return foundData;
+}
+
+// Read a line of text from stdin.  Only return up to |maxBytes|.  Do not
+// include the '\n' in the returned string.
+void readln(runtime_array *array, uint64_t maxBytes) {
+  if (array->data != NULL) {
+    runtime_freeArray(array);
   }
-  array->numElements = pos;
+  readStdinLine(array, maxBytes, false);
+}
+
+// Read a line of text from stdin into |line|, reusing its buffer, so reading
+// stdin line by line takes constant memory.  Return false at EOF.
+bool readlnInto(runtime_array *line, uint64_t maxBytes) {
+  return readStdinLine(line, maxBytes, true);
 }
 
 // Print a string to stdout, without the \n that puts writes.
 void runtime_puts(const runtime_array *string) {
-  uint64_t len = string->numElements;
-  const char *p = (const char*)string->data;
-  while (len-- != 0) {
-    // fputc can write \0 and is buffered on Linux, unlike write.
-    fputc(*p, stdout);
-    p++;
-  }
+  writeStdout((const uint8_t*)string->data, string->numElements);
 }
 
 // Print a C string string to stdout, without the \n that puts writes.
 void runtime_putsCstr(const char *string) {
-  const char *p = string;
-  char c;
-  while ((c = *p++) != '\0') {
-    // fputc can write \0 and is buffered on Linux, unlike write.
-    fputc(c, stdout);
+  writeStdout((const uint8_t*)string, strlen(string));
+}
+
+// With -unwind, exceptions are raised by a forced unwind of this object.  The
+// personality of each function with a try statement stops at its landing pad.
+static _Thread_local struct _Unwind_Exception runtime_unwindException;
+
+// Print an uncaught exception and exit.  |cMessage| is the message of an
+// exception raised from C, or NULL if the message is in runtimeException.
+static void printUncaughtException(const char *cMessage) {
+  if (cMessage != NULL) {
+    runtime_putsCstr("Exception: ");
+    runtime_putsCstr(cMessage);
+    runtime_putsCstr("\n");
+    exitOrLongjmp();
+  }
+  if (runtime_jmpBufSet) {
+    runtime_putsCstr("Expected ");
+  }
+  runtime_putsCstr("******************** Exception: ");
+  runtime_puts(&runtimeException.errorMessage);
+  runtime_putsCstr("\n");
+  runtime_freeArray(&runtimeException.errorMessage);
+  exitOrLongjmp();
+}
+
+// Called for each frame while unwinding.  Keep going until a landing pad is
+// found, and if the stack runs out first, the exception was not caught.
+static _Unwind_Reason_Code unwindStop(int version, _Unwind_Action actions,
+    _Unwind_Exception_Class exceptionClass, struct _Unwind_Exception *exception,
+    struct _Unwind_Context *context, void *cMessage) {
+  if (actions & _UA_END_OF_STACK) {
+    printUncaughtException(cMessage);
   }
+  return _URC_NO_REASON;
+}
+
+// Unwind the stack to the innermost try statement's landing pad.
+static void unwindToLandingPad(const char *cMessage) {
+  runtime_unwindException.exception_class = 0x52554e4500000000ull;  // "RUNE".
+  runtime_unwindException.exception_cleanup = NULL;
+  _Unwind_ForcedUnwind(&runtime_unwindException, unwindStop, (void*)cMessage);
+  // Only reached if the unwinder could not walk the stack.
+  printUncaughtException(cMessage);
 }
 
 // Throw an exception.  For now, just print the message and exit.  enumClassName
@@ -221,45 +457,45 @@ void runtime_raiseException(const runtime_array *enumClassName, const runtime_ar
   runtimeException.errorMessage = runtime_makeEmptyArray();
   runtime_vsprintf(&runtimeException.errorMessage, format, ap);
   va_end(ap);
-  if (runtime_firstSetjmpBuffer != NULL) {
+  if (runtime_firstSetjmpBuffer != NULL || runtime_unwindExceptions) {
     runtimeException.errorEnumName = *enumClassName;
     runtimeException.errorValueName = *enumValueName;
     runtimeException.filePath = *filePath;
     runtimeException.line = line;
+  }
+  if (runtime_firstSetjmpBuffer != NULL) {
     longjmp(runtime_firstSetjmpBuffer->buf, 1);
   }
-  if (runtime_jmpBufSet) {
-    printf("Expected ");
+  if (runtime_unwindExceptions) {
+    unwindToLandingPad(NULL);
   }
-  runtime_putsCstr("******************** Exception: ");
-  runtime_puts(&runtimeException.errorMessage);
-  runtime_putsCstr("\n");
-  runtime_freeArray(&runtimeException.errorMessage);
-  exitOrLongjmp();
+  printUncaughtException(NULL);
 }
 
 // Throw an exception from C.  For now, just print the message and exit.
 void runtime_raiseExceptionCstr(const char *exceptionName, const char *fileName, uint32_t line,
     const char *format, ...) {
   if (runtime_jmpBufSet) {
-    printf("Expected ");
+    runtime_putsCstr("Expected ");
   }
   va_list ap;
   va_start(ap, format);
   char buf[RN_MAX_CSTRING];
   vsnprintf(buf, RN_MAX_CSTRING, format, ap);
   va_end(ap);
-  if (runtime_firstSetjmpBuffer != NULL) {
+  if (runtime_firstSetjmpBuffer != NULL || runtime_unwindExceptions) {
     runtime_arrayInitCstr(&runtimeException.errorEnumName, "Exception");
     runtime_arrayInitCstr(&runtimeException.errorValueName, exceptionName);
     runtime_arrayInitCstr(&runtimeException.filePath, fileName);
     runtimeException.line = line;
+  }
+  if (runtime_firstSetjmpBuffer != NULL) {
     longjmp(runtime_firstSetjmpBuffer->buf, 1);
   }
-  runtime_putsCstr("Exception: ");
-  runtime_putsCstr(buf);
-  runtime_putsCstr("\n");
-  exitOrLongjmp();
+  if (runtime_unwindExceptions) {
+    unwindToLandingPad(buf);
+  }
+  printUncaughtException(buf);
 }
 
 // Throw an overflow exception.
@@ -278,7 +514,7 @@ void runtime_panic(const runtime_array *format, ...) {
   runtime_putsCstr("Panic: ");
   runtime_puts(&buf);
   runtime_putsCstr("\n");
-  fflush(stdout);
+  runtime_flushStdout();
   runtime_freeArray(&buf);
 #ifdef RN_DEBUG
   if (!runtime_jmpBufSet) {
@@ -294,11 +530,13 @@ void runtime_panic(const runtime_array *format, ...) {
 void runtime_panicCstr(const char *format, ...) {
   va_list ap;
   va_start(ap, format);
-  printf("Panic: ");
-  vprintf(format, ap);
-  printf("\n");
+  char buf[RN_MAX_CSTRING];
+  vsnprintf(buf, RN_MAX_CSTRING, format, ap);
   va_end(ap);
-  fflush(stdout);
+  runtime_putsCstr("Panic: ");
+  runtime_putsCstr(buf);
+  runtime_putsCstr("\n");
+  runtime_flushStdout();
 #ifdef RN_DEBUG
   // Generate a core file.
   uint8_t *p = NULL;
@@ -344,14 +582,98 @@ static uint32_t readUint32(const uint8_t **p, const uint8_t *end) {
   return value;
 }
 
-// Append a C string to a string array.
-static inline void appendArrayCstr(runtime_array *array, const char *string) {
-  uint64_t len = strlen(string);
-  uint8_t *p = (uint8_t*)string;
-  for (uint64_t i = 0; i < len; i++) {
-    runtime_appendArrayElement(array, p, sizeof(uint8_t), false, false);
-    p++;
+// Formatting runs twice over the same format and arguments: first with a NULL
+// array to measure the output, and then to write it into an array allocated
+// once at the exact size.
+typedef struct {
+  runtime_array *array;
+  uint64_t pos;
+} runtime_formatter;
+
+// Write bytes to the formatter's array, or just count them when measuring.
+static inline void putBytes(runtime_formatter *formatter, const uint8_t *p, uint64_t len) {
+  if (formatter->array != NULL) {
+    memcpy((uint8_t*)formatter->array->data + formatter->pos, p, len);
+  }
+  formatter->pos += len;
+}
+
+// Write one byte to the formatter.
+static inline void putByte(runtime_formatter *formatter, uint8_t c) {
+  putBytes(formatter, &c, 1);
+}
+
+// Write a C string to the formatter.
+static inline void putCstr(runtime_formatter *formatter, const char *string) {
+  putBytes(formatter, (const uint8_t*)string, strlen(string));
+}
+
+// Write a string array to the formatter.
+static inline void putString(runtime_formatter *formatter, const runtime_array *string) {
+  putBytes(formatter, (const uint8_t*)string->data, string->numElements);
+}
+
+// Big enough for a 64-bit integer in base 2 with a sign.
+#define RN_INT_STRING_SIZE 66
+
+// Pairs of decimal digits, from "00" to "99".
+static const char runtime_decimalDigitPairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Write the digits of an integer backwards from |bufEnd|, and return a pointer
+// to the first character.  Decimal is written two digits at a time, and hex
+// a nibble at a time, avoiding division.
+static uint8_t *formatNativeInt(uint8_t *bufEnd, uint64_t value, uint32_t base, bool isSigned) {
+  bool negative = isSigned && (int64_t)value < 0;
+  if (negative) {
+    value = -value;
+  }
+  uint8_t *p = bufEnd;
+  if (base == 10) {
+    while (value >= 100) {
+      const char *pair = runtime_decimalDigitPairs + (value % 100) * 2;
+      value /= 100;
+      p -= 2;
+      p[0] = pair[0];
+      p[1] = pair[1];
+    }
+    if (value >= 10) {
+      const char *pair = runtime_decimalDigitPairs + value * 2;
+      p -= 2;
+      p[0] = pair[0];
+      p[1] = pair[1];
+    } else {
+      *--p = '0' + value;
+    }
+  } else if (base == 16) {
+    do {
+      *--p = "0123456789abcdef"[value & 0xf];
+      value >>= 4;
+    } while (value != 0);
+  } else {
+    do {
+      uint64_t digit = value % base;
+      value /= base;
+      *--p = digit > 9? 'a' + digit - 10 : '0' + digit;
+    } while (value != 0);
+  }
+  if (negative) {
+    *--p = '-';
   }
+  return p;
+}
+
+// Write an integer to the formatter.
+static void putNativeInt(runtime_formatter *formatter, uint64_t value, uint32_t base,
+    bool isSigned) {
+  uint8_t buf[RN_INT_STRING_SIZE];
+  uint8_t *end = buf + sizeof(buf);
+  uint8_t *p = formatNativeInt(end, value, base, isSigned);
+  putBytes(formatter, p, end - p);
 }
 
 typedef enum {
@@ -375,7 +697,7 @@ static runtime_doubleType explodeDouble(double val, bool *negative, int32_t *exp
     }
     // Subnormals case.
   } else if (biasedExponent == 0x7ff) {
-    if (fraction == 0) {
+    if (*fraction == 0) {
       return kDoubleInf;
     }
     return kDoubleNan;
@@ -387,102 +709,77 @@ static runtime_doubleType explodeDouble(double val, bool *negative, int32_t *exp
   return kDoubleNormal;
 }
 
-// Multiply or divide by powers of 10 until val >= 1.0 and < 10.0.  Return the
-// base 10 exponent needed to do this.  |val| should already be positive.
-static double normalizeBase10(double val, int32_t *base10Exponent) {
-  // TODO: Speed this up.
-  int32_t exp = 0;
-  while (val < 1.0) {
-    val *= 10.0;
-    exp--;
-  }
-  while (val >= 10.0) {
-    val /= 10.0;
-    exp++;
-  }
-  *base10Exponent = exp;
-  return val;
-}
+// The number of significant digits println shows for floats.
+#define RN_PRINT_DIGITS 7
 
-// Write the double value in ASCII to the buffer.  Write in scientific notation.
-// See IEEE-754 for double precision encoding.
-static void doubleToString(runtime_array *array, double val) {
-  runtime_freeArray(array);
+// Write the double value in ASCII to the formatter.  Write in scientific
+// notation, with the shortest digits rounded to RN_PRINT_DIGITS.
+static void putDouble(runtime_formatter *formatter, double val) {
   bool negative;
   int32_t exponent;  // Base 2 exponent.
   uint64_t fraction;  // 53 bit fraction.  Value is 0.<53 binary fraction bits>
   runtime_doubleType type = explodeDouble(val, &negative, &exponent, &fraction);
   switch(type) {
     case kDoubleZero:
-      appendArrayCstr(array, "0.0");
+      putCstr(formatter, "0.0");
       return;
     case kDoubleInf:
-      appendArrayCstr(array, "Inf");
+      putCstr(formatter, "Inf");
       return;
     case kDoubleNan:
-      appendArrayCstr(array, "NaN");
+      putCstr(formatter, "NaN");
       return;
     case kDoubleNormal:
       break;
   }
   if (negative) {
     val = -val;
+    putByte(formatter, '-');
+  }
+  uint8_t digits[RN_MAX_DOUBLE_DIGITS];
+  int32_t decimalExponent;
+  uint32_t numDigits = runtime_findShortestDigits(digits, &decimalExponent, val, false);
+  int32_t base10Exponent = numDigits + decimalExponent - 1;
+  // Round half up to RN_PRINT_DIGITS significant digits.
+  if (numDigits > RN_PRINT_DIGITS) {
+    bool roundUp = digits[RN_PRINT_DIGITS] >= '5';
+    numDigits = RN_PRINT_DIGITS;
+    for (int32_t i = numDigits - 1; roundUp && i >= 0; i--) {
+      roundUp = digits[i] == '9';
+      digits[i] = roundUp? '0' : digits[i] + 1;
+    }
+    if (roundUp) {
+      digits[0] = '1';
+      base10Exponent++;
+    }
+  }
+  // Strip trailing 0's, but print at least one digit after the decimal point.
+  while (numDigits > 1 && digits[numDigits - 1] == '0') {
+    numDigits--;
+  }
+  putByte(formatter, digits[0]);
+  putByte(formatter, '.');
+  if (numDigits == 1) {
+    putByte(formatter, '0');
+  } else {
+    putBytes(formatter, digits + 1, numDigits - 1);
   }
-  if (negative) {
-    appendArrayCstr(array, "-");
-  }
-  int32_t base10Exponent;
-  val = normalizeBase10(val, &base10Exponent);
-  // Round based on the number of digits printed.
-  char fractionDigits[] = "000000";
-  uint64_t pow10 = 1;
-  for (uint32_t i = 0; i < sizeof(fractionDigits) - 1; i++) {
-    pow10 *= 10;
-  }
-  val += 0.5/pow10;
-  if (val >= 10.0) {
-    val /= 10.0;
-    base10Exponent += 1;
-  }
-  // Print the leading digit before the decimal point.
-  char digit[] = "d.";
-  digit[0] = '0' + (uint32_t)val;
-  appendArrayCstr(array, digit);
-  val -= (uint32_t)val;  // Now only fractional digits remain.
-  explodeDouble(val, &negative, &exponent, &fraction);
-  // Adjust fraction to be fixed-point with the fixed point at position 53.
-  fraction >>= -exponent;
-  uint64_t mask = ((uint64_t)1 << 53) - 1;
-  for (uint32_t i = 0; i < sizeof(fractionDigits) - 1; i++) {
-    fraction *= 10;
-    fractionDigits[i] = '0' + (fraction >> 53);
-    fraction &= mask;
-  }
-  // Strip trailing 0's.
-  uint32_t lastDigitIndex = sizeof(fractionDigits) - 2;
-  while (lastDigitIndex != 0 && fractionDigits[lastDigitIndex] == '0') {
-    fractionDigits[lastDigitIndex--] = '\0';
-  }
-  appendArrayCstr(array, fractionDigits);
   if (base10Exponent != 0) {
-    appendArrayCstr(array, "e");
-    runtime_array buf = runtime_makeEmptyArray();
-    runtime_nativeIntToString(&buf, base10Exponent, 10, true);
-    runtime_concatArrays(array, &buf, sizeof(uint8_t), false);
-    runtime_freeArray(&buf);
+    putByte(formatter, 'e');
+    putNativeInt(formatter, (int64_t)base10Exponent, 10, true);
   }
 }
 
 // Forward declaration for recursion.
-static const uint8_t *appendFormattedElement(runtime_array *array, bool topLevel,
+static const uint8_t *appendFormattedElement(runtime_formatter *formatter, bool topLevel,
     const uint8_t *p, const uint8_t *end, va_list ap);
 
 // Varargs wrapper for appendFormattedElement.
-static const uint8_t *appendFormattedArg(runtime_array *array, bool topLevel,
+static const uint8_t *appendFormattedArg(runtime_formatter *formatter, bool topLevel,
     const uint8_t *p, const uint8_t *end, ...) {
   va_list ap;
   va_start(ap, end);
-  const uint8_t *result = appendFormattedElement(array, topLevel, p, end, ap);
+  const uint8_t *result = appendFormattedElement(formatter, topLevel, p, end, ap);
   va_end(ap);
   return result;
 }
@@ -559,7 +856,13 @@ static const uint8_t *findEndOfSpec(const uint8_t *p, const uint8_t *end,
   } else if (c == 'i' || c == 'u' || c == 'x') {
     *width = readUint32(&p, end);
     if (*width > sizeof(uint64_t) * 8) {
-      *elementSize = sizeof(runtime_array);
+      if (runtime_nativeWideInts && *width <= runtime_maxNativeWideIntWidth) {
+        // LLVM stores these as whole 64-bit words.
+        *elementSize = ((*width + 63) >> 6) * sizeof(uint64_t);
+        *deref = true;
+      } else {
+        *elementSize = sizeof(runtime_array);
+      }
       return p;
     } else {
       *deref = true;
@@ -599,42 +902,50 @@ static const uint8_t *findEndOfSpec(const uint8_t *p, const uint8_t *end,
   return p;
 }
 
-// Dereference a pointer to the element, and append it to |dest|, formatted
+// Dereference a pointer to the element, and append it to |formatter|, formatted
 // according to the spec pointed to by |p|.
-static void derefAndAppendFormattedArg(runtime_array *dest, bool topLevel, const uint8_t *p,
+static void derefAndAppendFormattedArg(runtime_formatter *formatter, bool topLevel, const uint8_t *p,
     const uint8_t *end, const uint8_t *elementPtr, uint32_t elementSize, uint32_t width) {
   // Assumes compiler aligns stack elements on 32-bit boundaries or courser.
   switch (elementSize) {
     case 1: {
       uint8_t value = *(uint8_t *)elementPtr;
-      appendFormattedArg(dest, topLevel, p, end, value);
+      appendFormattedArg(formatter, topLevel, p, end, value);
       break;
     }
     case 2: {
       uint16_t value = *(uint16_t *)elementPtr;
-      appendFormattedArg(dest, topLevel, p, end, value);
+      appendFormattedArg(formatter, topLevel, p, end, value);
       break;
     }
     case 4: {
       uint32_t value = *(uint32_t *)elementPtr;
-      appendFormattedArg(dest, topLevel, p, end, value);
+      appendFormattedArg(formatter, topLevel, p, end, value);
       break;
     }
     case 8: {
       uint64_t value = *(uint64_t *)elementPtr;
-      appendFormattedArg(dest, topLevel, p, end, value);
+      appendFormattedArg(formatter, topLevel, p, end, value);
       break;
     }
-    default:
-      runtime_panicCstr("Unexpected element width");
+    default: {
+      if (elementSize <= sizeof(uint64_t)) {
+        runtime_panicCstr("Unexpected element width");
+      }
+      // This is a native integer wider than 64 bits, so print it as a bigint.
+      runtime_array bigint = runtime_makeEmptyArray();
+      runtime_nativeIntToBigint(&bigint, (const uint64_t *)elementPtr, width, *p == 'i', false);
+      appendFormattedArg(formatter, topLevel, p, end, &bigint);
+      runtime_freeArray(&bigint);
+    }
   }
 }
 
 // Print an array to a string.  |p| points the element type specifier.  Return
 // a pointer to the character just past the end of the array format specifier.
-static const uint8_t *printArray(runtime_array *dest, const uint8_t *p, const uint8_t *end,
+static const uint8_t *printArray(runtime_formatter *formatter, const uint8_t *p, const uint8_t *end,
     const runtime_array *source) {
-  appendArrayCstr(dest, "[");
+  putByte(formatter, '[');
   uint32_t elementSize, width;
   bool deref;
   const uint8_t *elementSpecEnd = findEndOfSpec(p, end, &elementSize, &width, &deref);
@@ -648,32 +959,32 @@ static const uint8_t *printArray(runtime_array *dest, const uint8_t *p, const ui
   bool firstTime = true;
   for (uint64_t i = 0; i < source->numElements; i++) {
     if (!firstTime) {
-      appendArrayCstr(dest, ", ");
+      putCstr(formatter, ", ");
     }
     firstTime = false;
     const uint8_t *elementPtr = (const uint8_t*)(source->data) + elementIndex;
     if (!deref) {
-      appendFormattedArg(dest, false, p, end, elementPtr);
+      appendFormattedArg(formatter, false, p, end, elementPtr);
     } else {
-      derefAndAppendFormattedArg(dest, false, p, end, elementPtr, elementSize, width);
+      derefAndAppendFormattedArg(formatter, false, p, end, elementPtr, elementSize, width);
     }
     elementIndex += elementSize;
   }
-  appendArrayCstr(dest, "]");
+  putByte(formatter, ']');
   return elementSpecEnd;
 }
 
 // Print a tuple to a string.  |p| points the element type specifier.  Return a
 // pointer to the character just past the end of the tuple format specifier.
-static const uint8_t *printTuple(runtime_array *dest, const uint8_t *p,
+static const uint8_t *printTuple(runtime_formatter *formatter, const uint8_t *p,
     const uint8_t *end, const uint8_t *tuple) {
-  appendArrayCstr(dest, "(");
+  putByte(formatter, '(');
   uint32_t elementPos = 0;
   uint8_t c = *p;
   bool firstTime = true;
   while (c != ')') {
     if (!firstTime) {
-      appendArrayCstr(dest, ", ");
+      putCstr(formatter, ", ");
     }
     firstTime = false;
     uint32_t elementSize, width;
@@ -681,9 +992,9 @@ static const uint8_t *printTuple(runtime_array *dest, const uint8_t *p,
     const uint8_t *specEnd = findEndOfSpec(p, end, &elementSize, &width, &deref);
     elementPos = alignToElement(elementPos, elementSize);
     if (!deref) {
-      appendFormattedArg(dest, false, p, end, tuple + elementPos);
+      appendFormattedArg(formatter, false, p, end, tuple + elementPos);
     } else {
-      derefAndAppendFormattedArg(dest, false, p, end, tuple + elementPos, elementSize, width);
+      derefAndAppendFormattedArg(formatter, false, p, end, tuple + elementPos, elementSize, width);
     }
     elementPos += elementSize;
     c = *specEnd;
@@ -694,7 +1005,7 @@ static const uint8_t *printTuple(runtime_array *dest, const uint8_t *p,
     }
     p = specEnd;
   }
-  appendArrayCstr(dest, ")");
+  putByte(formatter, ')');
   return p + 1;
 }
 
@@ -711,21 +1022,30 @@ static uint64_t extendToUpperBits(uint64_t value, bool isSigned, uint32_t width)
   return value | ~(((uint64_t)1 << width) - 1);
 }
 
-// Append a formatted element to the string array.  The first character is the
+// Print an integer of up to 64 bits to stdout in decimal.  This is the fast
+// path for println of integers, which skips building a temporary string.
+void runtime_putInteger(uint64_t value, uint32_t width, bool isSigned) {
+  value = extendToUpperBits(value, isSigned, width);
+  uint8_t buf[RN_INT_STRING_SIZE];
+  uint8_t *end = buf + sizeof(buf);
+  uint8_t *p = formatNativeInt(end, value, 10, isSigned);
+  writeStdout(p, end - p);
+}
+
+// Append a formatted element to the formatter.  The first character is the
 // format specifier, e.g. s for string.  Consume the entire format specifier and
 // return a pointer to the character after the specifier.
-static const uint8_t *appendFormattedElement(runtime_array *array, bool topLevel,
+static const uint8_t *appendFormattedElement(runtime_formatter *formatter, bool topLevel,
     const uint8_t *p, const uint8_t *end, va_list ap) {
   uint8_t c = *p++;
   if (c == 's') {
-    uint8_t quote = '"';
     runtime_array *string = va_arg(ap, runtime_array *);
     if (!topLevel) {
-      runtime_appendArrayElement(array, &quote, sizeof(uint8_t), false, false);
+      putByte(formatter, '"');
     }
-    runtime_concatArrays(array, string, sizeof(uint8_t), false);
+    putString(formatter, string);
     if (!topLevel) {
-      runtime_appendArrayElement(array, &quote, sizeof(uint8_t), false, false);
+      putByte(formatter, '"');
     }
   } else if (c == 'i' || c == 'u' || c == 'x') {
     uint8_t *typeStart = (uint8_t*)(p - 1);
@@ -735,11 +1055,10 @@ static const uint8_t *appendFormattedElement(runtime_array *array, bool topLevel
       runtime_array buf = runtime_makeEmptyArray();
       runtime_array *bigint = va_arg(ap, runtime_array *);
       runtime_bigintToString(&buf, bigint, c == 'x' ? 16 : 10);
-      runtime_concatArrays(array, &buf, sizeof(uint8_t), false);
+      putString(formatter, &buf);
       runtime_freeArray(&buf);
     } else {
       bool isSigned = c == 'i';
-      runtime_array buf = runtime_makeEmptyArray();
       uint64_t value;
       if (width > sizeof(uint32_t) * 8) {
         value = va_arg(ap, uint64_t);
@@ -752,14 +1071,10 @@ static const uint8_t *appendFormattedElement(runtime_array *array, bool topLevel
         // Sign extend.
         value |= ((uint64_t)-1) << width;
       }
-      runtime_nativeIntToString(&buf, value, c == 'x' ? 16 : 10, isSigned);
-      runtime_concatArrays(array, &buf, sizeof(uint8_t), false);
-      runtime_freeArray(&buf);
+      putNativeInt(formatter, value, c == 'x' ? 16 : 10, isSigned);
     }
     if (!topLevel) {
-      while (typeStart < p) {
-        runtime_appendArrayElement(array, typeStart++, sizeof(uint8_t), false, false);
-      }
+      putBytes(formatter, typeStart, p - typeStart);
     }
   } else if (c == 'f') {
     uint8_t *typeStart = (uint8_t*)(p - 1);
@@ -790,62 +1105,42 @@ static const uint8_t *appendFormattedElement(runtime_array *array, bool topLevel
       runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__,
           "Unsupported floating point width: %u", width);
     }
-    runtime_array buf = runtime_makeEmptyArray();
-    doubleToString(&buf, value);
-    runtime_concatArrays(array, &buf, sizeof(uint8_t), false);
-    runtime_freeArray(&buf);
+    putDouble(formatter, value);
     if (!topLevel) {
-      while (typeStart < p) {
-        runtime_appendArrayElement(array, typeStart++, sizeof(uint8_t), false, false);
-      }
+      putBytes(formatter, typeStart, p - typeStart);
     }
   } else if (c == 'b') {
     bool boolVal = va_arg(ap, int);
-    char *boolText = boolVal ? "true" : "false";
-    uint64_t numElements = boolVal ? 4 : 5;
-    runtime_array string = {(uint64_t *)boolText, numElements};
-    runtime_concatArrays(array, &string, sizeof(uint8_t), false);
+    putCstr(formatter, boolVal ? "true" : "false");
   } else if (c == '[') {
-    runtime_array buf = runtime_makeEmptyArray();
     runtime_array *arrayArg = va_arg(ap, runtime_array *);
-    p = printArray(&buf, p, end, arrayArg);
-    runtime_concatArrays(array, &buf, sizeof(uint8_t), false);
-    runtime_freeArray(&buf);
+    p = printArray(formatter, p, end, arrayArg);
   } else if (c == '(') {
-    runtime_array buf = runtime_makeEmptyArray();
     uint8_t *tuplePtr = va_arg(ap, uint8_t *);
-    p = printTuple(&buf, p, end, tuplePtr);
-    runtime_concatArrays(array, &buf, sizeof(uint8_t), false);
-    runtime_freeArray(&buf);
+    p = printTuple(formatter, p, end, tuplePtr);
   } else {
     runtime_panicCstr("Unsupported format specifier: %c", c);
   }
   return p;
 }
 
-// Like sprintf, but use format specifiers specific to Rune types.
-// Currently, we support:
-//
-//   %b        - Match an bool value: prints true or false
-//   %i<width> - Match an Int value
-//   %u<width> - Match a Uint value
-//   %f<width> - Match a float or double.
-//   %s        - Match a string value
-//   %x<width> - Match an Int or Uint value, print in lower-case-hex.
-//   %[<spec>] - Match a list of the spec type, eg %[u32]
-//   %(<spec>, ...) - Match a tuple of the spec type, eg %(s, u32)
-//
-// Escapes can be \" \\ \n, \t, or \xx, where xx is a hex encoding of the byte.
-//
-// TODO: Add support for format modifiers, e.g. %12s, %-12s, %$1d, %8d, %08u...
-void runtime_vsprintf(runtime_array *array, const runtime_array *format, va_list ap) {
-  if (array->numElements != 0) {
-    runtime_freeArray(array);
-  }
+// Run the format string through the formatter once.
+static void formatString(runtime_formatter *formatter, const runtime_array *format, va_list ap) {
   const uint8_t *p = (const uint8_t*)format->data;
   const uint8_t *end = p + format->numElements;
   while (p != end) {
-    uint8_t c = *p++;
+    uint8_t c = *p;
+    if (c != '\\' && c != '%') {
+      // Copy the run of literal bytes up to the next escape or specifier.
+      const uint8_t *q = p + 1;
+      while (q != end && *q != '\\' && *q != '%') {
+        q++;
+      }
+      putBytes(formatter, p, q - p);
+      p = q;
+      continue;
+    }
+    p++;
     if (c == '\\') {
       c = *p++;
       if (c == 'x') {
@@ -872,15 +1167,47 @@ void runtime_vsprintf(runtime_array *array, const runtime_array *format, va_list
       } else if (c == 'v') {
         c = 0xb;
       }
-      runtime_appendArrayElement(array, &c, sizeof(uint8_t), false, false);
-    } else if (c == '%') {
-      p = appendFormattedElement(array, true, p, end, ap);
+      putByte(formatter, c);
     } else {
-      runtime_appendArrayElement(array, &c, sizeof(uint8_t), false, false);
+      p = appendFormattedElement(formatter, true, p, end, ap);
     }
   }
 }
 
+// Like sprintf, but use format specifiers specific to Rune types.
+// Currently, we support:
+//
+//   %b        - Match an bool value: prints true or false
+//   %i<width> - Match an Int value
+//   %u<width> - Match a Uint value
+//   %f<width> - Match a float or double.
+//   %s        - Match a string value
+//   %x<width> - Match an Int or Uint value, print in lower-case-hex.
+//   %[<spec>] - Match a list of the spec type, eg %[u32]
+//   %(<spec>, ...) - Match a tuple of the spec type, eg %(s, u32)
+//
+// Escapes can be \" \\ \n, \t, or \xx, where xx is a hex encoding of the byte.
+//
+// The first pass measures the output, so the result is allocated once.
+//
+// TODO: Add support for format modifiers, e.g. %12s, %-12s, %$1d, %8d, %08u...
+void runtime_vsprintf(runtime_array *array, const runtime_array *format, va_list ap) {
+  if (array->data != NULL) {
+    runtime_freeArray(array);
+  }
+  runtime_formatter measurer = {NULL, 0};
+  va_list measureAp;
+  va_copy(measureAp, ap);
+  formatString(&measurer, format, measureAp);
+  va_end(measureAp);
+  if (measurer.pos == 0) {
+    return;
+  }
+  runtime_allocArray(array, measurer.pos, sizeof(uint8_t), false);
+  runtime_formatter writer = {array, 0};
+  formatString(&writer, format, ap);
+}
+
 // Like sprintf, but with Rune's data types.
 void runtime_sprintf(runtime_array *array, const runtime_array *format, ...) {
   va_list ap;
@@ -901,40 +1228,17 @@ void runtime_printf(const char *format, ...) {
   runtime_vsprintf(&array, &formatArray, ap);
   va_end(ap);
   runtime_puts(&array);
-  fflush(stdout);
   runtime_freeArray(&array);
-  runtime_freeArray(&formatArray);
 }
 
 // Convert an integer to a string.
 void runtime_nativeIntToString(runtime_array *string, uint64_t value, uint32_t base, bool isSigned) {
   runtime_freeArray(string);
-  bool negated = false;
-  if (isSigned && (int64_t)value < 0) {
-    negated = true;
-    value = -value;
-  }
-  if (value == 0) {
-    uint8_t c = '0';
-    runtime_appendArrayElement(string, &c, sizeof(uint8_t), false, false);
-    return;
-  }
-  while (value != 0) {
-    uint64_t digit = value % base;
-    value /= base;
-    uint8_t c;
-    if (digit > 9) {
-      c = 'a' + digit - 10;
-    } else {
-      c = '0' + digit;
-    }
-    runtime_appendArrayElement(string, &c, sizeof(uint8_t), false, false);
-  }
-  if (negated) {
-    uint8_t c = '-';
-    runtime_appendArrayElement(string, &c, sizeof(uint8_t), false, false);
-  }
-  runtime_reverseArray(string, sizeof(uint8_t), false);
+  uint8_t buf[RN_INT_STRING_SIZE];
+  uint8_t *end = buf + sizeof(buf);
+  uint8_t *p = formatNativeInt(end, value, base, isSigned);
+  runtime_allocArray(string, end - p, sizeof(uint8_t), false);
+  memcpy(string->data, p, end - p);
 }
 
 // Convert a bigint to ASCII, using the base.
@@ -1004,35 +1308,91 @@ static inline char *getStringData(const runtime_array *string) {
 void runtime_printBigint(runtime_array *val) {
   runtime_array string = runtime_makeEmptyArray();
   runtime_bigintToString(&string, val, 10);
-  printf("%s", getStringData(&string));
+  runtime_puts(&string);
   runtime_freeArray(&string);
-  fflush(stdout);
 }
 
 // For debugging.
 void runtime_printHexBigint(runtime_array *val) {
   runtime_array string = runtime_makeEmptyArray();
   runtime_bigintToString(&string, val, 16);
-  printf("%s", getStringData(&string));
+  runtime_puts(&string);
   runtime_freeArray(&string);
-  fflush(stdout);
 }
 
-// Convert a binary string to a hexadecimal string.
+// The hex and base64 codecs below are constant time: they never branch on or
+// index memory with the data, so they are safe for secret strings.  Decoding
+// validates each digit in the same pass, ORing an invalid flag that is only
+// checked at the end.
+
+// Decode a hex digit in constant time.  Set *invalid if it is not a hex digit.
+static inline uint8_t decodeHexDigit(uint8_t c, uint8_t *invalid) {
+  uint8_t digit = c - '0';
+  uint8_t letter = (c | 0x20) - 'a';
+  // These are 1 if in range, else 0.
+  uint8_t isDigit = ((uint32_t)digit - 10) >> 31;
+  uint8_t isLetter = ((uint32_t)letter - 6) >> 31;
+  *invalid |= 1 ^ (isDigit | isLetter);
+  return (digit & -isDigit) | ((letter + 10) & -isLetter);
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+// Convert 16 nibbles to lower case hex digits.
+static inline __m128i nibblesToHex(__m128i nibbles) {
+  __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)),
+      _mm_set1_epi8('a' - '0' - 10));
+  return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+// Decode 16 hex digits to nibbles.  OR 0xff into the bytes of *invalid that
+// were not hex digits.
+static inline __m128i hexToNibbles(__m128i chars, __m128i *invalid) {
+  __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+  __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  // There is no unsigned byte compare, but x <= max iff min(x, max) == x.
+  __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+  __m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+  *invalid = _mm_or_si128(*invalid, _mm_xor_si128(_mm_or_si128(isDigit, isLetter),
+      _mm_set1_epi8(-1)));
+  return _mm_or_si128(_mm_and_si128(digit, isDigit),
+      _mm_and_si128(_mm_add_epi8(letter, _mm_set1_epi8(10)), isLetter));
+}
+
+// Combine 16 nibbles, high nibble first, into the low bytes of 8 16-bit lanes.
+static inline __m128i packNibbles(__m128i nibbles) {
+  __m128i high = _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0xff)), 4);
+  return _mm_or_si128(high, _mm_srli_epi16(nibbles, 8));
+}
+#endif
+
+// Convert a binary string to a hexadecimal string.  SSE2 converts 16 bytes at a
+// time.
 void runtime_stringToHex(runtime_array *destHexString, const runtime_array *sourceBinString) {
   uint64_t numElements = sourceBinString->numElements;
   runtime_resizeArray(destHexString, numElements << 1, sizeof(uint8_t), false);
   uint8_t *p = (uint8_t*)(destHexString->data);
   uint8_t *q = (uint8_t*)(sourceBinString->data);
-  for (uint64_t i = 0; i < numElements; i++) {
-    uint8_t c = *q++;
-    *p++ = toHex(c >> 4);
-    *p++ = toHex(c & 0xf);
+  uint64_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+  __m128i lowMask = _mm_set1_epi8(0xf);
+  for (; i + 16 <= numElements; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)(q + i));
+    __m128i high = nibblesToHex(_mm_and_si128(_mm_srli_epi16(bytes, 4), lowMask));
+    __m128i low = nibblesToHex(_mm_and_si128(bytes, lowMask));
+    _mm_storeu_si128((__m128i*)(p + 2 * i), _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128((__m128i*)(p + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+  }
+#endif
+  for (; i < numElements; i++) {
+    uint8_t c = q[i];
+    p[2 * i] = toHex(c >> 4);
+    p[2 * i + 1] = toHex(c & 0xf);
   }
 }
 
 // Convert a hex string to a binary string.  It is an error for there to be an
-// odd number of digits.
+// odd number of digits, or for any character not to be a hex digit.  SSE2
+// converts 32 digits at a time.
 void runtime_hexToString(runtime_array *destBinString, const runtime_array *sourceHexString) {
   uint64_t numElements = sourceHexString->numElements;
   if (numElements & 1) {
@@ -1040,26 +1400,370 @@ void runtime_hexToString(runtime_array *destBinString, const runtime_array *sour
     runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__,
         "Invalid hex string: should have even number of hex digits");
   }
-  runtime_resizeArray(destBinString, numElements >> 1, sizeof(uint8_t), false);
+  uint64_t numBytes = numElements >> 1;
+  runtime_resizeArray(destBinString, numBytes, sizeof(uint8_t), false);
   uint8_t *p = (uint8_t*)(destBinString->data);
   uint8_t *q = (uint8_t*)(sourceHexString->data);
-  for (uint64_t i = 0; i < numElements >> 1; i++) {
-    uint8_t upper = *q++;
-    if (!isxdigit(upper)) {
-      runtime_panicCstr("Invalid hex digit: %c", upper);
+  uint8_t invalid = 0;
+  uint64_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+  __m128i invalidMask = _mm_setzero_si128();
+  for (; i + 16 <= numBytes; i += 16) {
+    __m128i first = hexToNibbles(_mm_loadu_si128((const __m128i*)(q + 2 * i)), &invalidMask);
+    __m128i second = hexToNibbles(_mm_loadu_si128((const __m128i*)(q + 2 * i + 16)), &invalidMask);
+    _mm_storeu_si128((__m128i*)(p + i), _mm_packus_epi16(packNibbles(first), packNibbles(second)));
+  }
+  invalid = _mm_movemask_epi8(invalidMask) != 0;
+#endif
+  for (; i < numBytes; i++) {
+    uint8_t upper = decodeHexDigit(q[2 * i], &invalid);
+    p[i] = (upper << 4) | decodeHexDigit(q[2 * i + 1], &invalid);
+  }
+  if (invalid) {
+    runtime_freeArray(destBinString);
+    runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__,
+        "Invalid hex string: found a character that is not a hex digit");
+  }
+}
+
+// Return 0xff if a < b, else 0, in constant time.
+static inline uint8_t lessThanMask(uint32_t a, uint32_t b) {
+  return (a - b) >> 24;
+}
+
+// Return 0xff if a == b, else 0, in constant time.
+static inline uint8_t equalMask(uint32_t a, uint32_t b) {
+  return ~((0u - (a ^ b)) >> 24);
+}
+
+// Encode 6 bits as a base64 digit in constant time.  URL-safe base64 uses '-'
+// and '_' for 62 and 63 rather than '+' and '/'.
+static inline uint8_t encodeBase64Digit(uint32_t v, bool urlSafe) {
+  uint32_t c = v + 'A';
+  c += lessThanMask(25, v) & ('a' - 'A' - 26);
+  c -= lessThanMask(51, v) & ('a' - 26 - ('0' - 52));
+  uint8_t is62 = equalMask(v, 62);
+  uint8_t is63 = equalMask(v, 63);
+  uint8_t c62 = urlSafe? '-' : '+';
+  uint8_t c63 = urlSafe? '_' : '/';
+  return (c & ~(is62 | is63)) | (c62 & is62) | (c63 & is63);
+}
+
+// Decode a base64 digit in constant time.  Set *invalid if it is not a digit
+// of the chosen alphabet.
+static inline uint8_t decodeBase64Digit(uint32_t c, bool urlSafe, uint8_t *invalid) {
+  uint8_t upper = ~lessThanMask(c, 'A') & lessThanMask(c, 'Z' + 1);
+  uint8_t lower = ~lessThanMask(c, 'a') & lessThanMask(c, 'z' + 1);
+  uint8_t digit = ~lessThanMask(c, '0') & lessThanMask(c, '9' + 1);
+  uint8_t is62 = equalMask(c, urlSafe? '-' : '+');
+  uint8_t is63 = equalMask(c, urlSafe? '_' : '/');
+  *invalid |= ~(upper | lower | digit | is62 | is63) & 1;
+  return ((c - 'A') & upper) | ((c - 'a' + 26) & lower) | ((c - '0' + 52) & digit) |
+      (62 & is62) | (63 & is63);
+}
+
+// Convert a binary string to base64.  Standard base64 is padded with '=' to a
+// multiple of 4 digits, and URL-safe base64 is not padded.
+void runtime_stringToBase64(runtime_array *destBase64String,
+    const runtime_array *sourceBinString, bool urlSafe) {
+  uint64_t numElements = sourceBinString->numElements;
+  uint64_t numGroups = numElements / 3;
+  uint64_t extra = numElements - numGroups * 3;
+  uint64_t numDigits = numGroups * 4;
+  if (extra != 0) {
+    numDigits += urlSafe? extra + 1 : 4;
+  }
+  runtime_resizeArray(destBase64String, numDigits, sizeof(uint8_t), false);
+  uint8_t *p = (uint8_t*)(destBase64String->data);
+  const uint8_t *q = (const uint8_t*)(sourceBinString->data);
+  for (uint64_t i = 0; i < numGroups; i++) {
+    uint32_t value = ((uint32_t)q[0] << 16) | ((uint32_t)q[1] << 8) | q[2];
+    p[0] = encodeBase64Digit(value >> 18, urlSafe);
+    p[1] = encodeBase64Digit((value >> 12) & 0x3f, urlSafe);
+    p[2] = encodeBase64Digit((value >> 6) & 0x3f, urlSafe);
+    p[3] = encodeBase64Digit(value & 0x3f, urlSafe);
+    p += 4;
+    q += 3;
+  }
+  if (extra != 0) {
+    uint32_t value = (uint32_t)q[0] << 16;
+    if (extra == 2) {
+      value |= (uint32_t)q[1] << 8;
     }
-    uint8_t lower = *q++;
-    if (!isxdigit(lower)) {
-      runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__,
-          "Invalid hex digit: %c", lower);
+    p[0] = encodeBase64Digit(value >> 18, urlSafe);
+    p[1] = encodeBase64Digit((value >> 12) & 0x3f, urlSafe);
+    if (extra == 2) {
+      p[2] = encodeBase64Digit((value >> 6) & 0x3f, urlSafe);
     }
-    if (!isxdigit(upper) || !isxdigit(lower)) {
-      runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__, "Invalid hex digit: ");
+    if (!urlSafe) {
+      if (extra == 1) {
+        p[2] = '=';
+      }
+      p[3] = '=';
     }
-    *p++ = (fromHex(upper) << 4) | fromHex(lower);
   }
 }
 
+// Convert a base64 string to a binary string.  Padding is optional for both
+// alphabets.  It is an error for the string to contain a character not in the
+// alphabet, or to have a length that no binary string encodes to.
+void runtime_base64ToString(runtime_array *destBinString,
+    const runtime_array *sourceBase64String, bool urlSafe) {
+  uint64_t numElements = sourceBase64String->numElements;
+  const uint8_t *q = (const uint8_t*)(sourceBase64String->data);
+  // Padding depends only on the length, so checking it does not leak secrets.
+  if ((numElements & 3) == 0 && numElements != 0 && q[numElements - 1] == '=') {
+    numElements -= q[numElements - 2] == '='? 2 : 1;
+  }
+  if ((numElements & 3) == 1) {
+    runtime_freeArray(destBinString);
+    runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__,
+        "Invalid base64 string: bad length");
+  }
+  uint64_t numGroups = numElements >> 2;
+  uint64_t extra = numElements & 3;
+  uint64_t numBytes = numGroups * 3 + (extra == 0? 0 : extra - 1);
+  runtime_resizeArray(destBinString, numBytes, sizeof(uint8_t), false);
+  uint8_t *p = (uint8_t*)(destBinString->data);
+  uint8_t invalid = 0;
+  for (uint64_t i = 0; i < numGroups; i++) {
+    uint32_t value = ((uint32_t)decodeBase64Digit(q[0], urlSafe, &invalid) << 18) |
+        ((uint32_t)decodeBase64Digit(q[1], urlSafe, &invalid) << 12) |
+        ((uint32_t)decodeBase64Digit(q[2], urlSafe, &invalid) << 6) |
+        decodeBase64Digit(q[3], urlSafe, &invalid);
+    p[0] = value >> 16;
+    p[1] = value >> 8;
+    p[2] = value;
+    p += 3;
+    q += 4;
+  }
+  if (extra != 0) {
+    uint32_t value = ((uint32_t)decodeBase64Digit(q[0], urlSafe, &invalid) << 18) |
+        ((uint32_t)decodeBase64Digit(q[1], urlSafe, &invalid) << 12);
+    if (extra == 3) {
+      value |= (uint32_t)decodeBase64Digit(q[2], urlSafe, &invalid) << 6;
+      p[1] = value >> 8;
+    }
+    p[0] = value >> 16;
+  }
+  if (invalid) {
+    runtime_freeArray(destBinString);
+    runtime_raiseExceptionCstr("Internal", __FILE__, __LINE__,
+        "Invalid base64 string: found a character that is not a base64 digit");
+  }
+}
+
+// Substring search filters candidate positions a block at a time, comparing
+// the first and last bytes of the needle against two unaligned loads from the
+// haystack.  Only positions where both match are compared in full.  findMask
+// returns RN_FIND_MASK_BITS bits per candidate position.
+#if defined(__AVX2__)
+#define RN_FIND_BLOCK 32
+#define RN_FIND_MASK_BITS 1
+typedef __m256i runtime_findVector;
+static inline runtime_findVector splatByte(uint8_t c) {
+  return _mm256_set1_epi8((char)c);
+}
+static inline uint64_t findMask(const uint8_t *p, const uint8_t *q,
+    runtime_findVector first, runtime_findVector last) {
+  __m256i eqFirst = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), first);
+  __m256i eqLast = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)q), last);
+  return (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(eqFirst, eqLast));
+}
+#elif defined(__SSE2__)
+#define RN_FIND_BLOCK 16
+#define RN_FIND_MASK_BITS 1
+typedef __m128i runtime_findVector;
+static inline runtime_findVector splatByte(uint8_t c) {
+  return _mm_set1_epi8((char)c);
+}
+static inline uint64_t findMask(const uint8_t *p, const uint8_t *q,
+    runtime_findVector first, runtime_findVector last) {
+  __m128i eqFirst = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), first);
+  __m128i eqLast = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)q), last);
+  return (uint32_t)_mm_movemask_epi8(_mm_and_si128(eqFirst, eqLast));
+}
+#elif defined(__ARM_NEON)
+#define RN_FIND_BLOCK 16
+#define RN_FIND_MASK_BITS 4
+typedef uint8x16_t runtime_findVector;
+static inline runtime_findVector splatByte(uint8_t c) {
+  return vdupq_n_u8(c);
+}
+// NEON has no movemask, so narrow each byte of the comparison to a nibble.
+static inline uint64_t findMask(const uint8_t *p, const uint8_t *q,
+    runtime_findVector first, runtime_findVector last) {
+  uint8x16_t eq = vandq_u8(vceqq_u8(vld1q_u8(p), first), vceqq_u8(vld1q_u8(q), last));
+  return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+}
+#else
+#define RN_FIND_BLOCK 8
+#define RN_FIND_MASK_BITS 1
+typedef uint8_t runtime_findVector;
+static inline runtime_findVector splatByte(uint8_t c) {
+  return c;
+}
+static inline uint64_t findMask(const uint8_t *p, const uint8_t *q,
+    runtime_findVector first, runtime_findVector last) {
+  uint64_t mask = 0;
+  for (uint32_t i = 0; i < RN_FIND_BLOCK; i++) {
+    mask |= (uint64_t)(p[i] == first && q[i] == last) << i;
+  }
+  return mask;
+}
+#endif
+
+// Needles at least this long are searched with the Two-Way algorithm, which is
+// linear in the worst case.  Shorter needles rarely pass the filter by accident.
+#define RN_TWO_WAY_MIN_NEEDLE 32
+
+// The bits for one candidate position in a findMask result.
+#define RN_FIND_CANDIDATE_MASK (((uint64_t)1 << RN_FIND_MASK_BITS) - 1)
+
+// Read byte |i| of |s|, which has |length| bytes, from the end if |reverse|.
+// The Two-Way code uses this to search backwards without a copy.
+static inline uint8_t byteAt(const uint8_t *s, uint64_t length, int64_t i, bool reverse) {
+  return reverse? s[length - 1 - i] : s[i];
+}
+
+// Find the maximal suffix of the needle under byte order, or reversed byte order
+// if |invert|.  Return the position before it starts, and set |period| to its
+// period.
+static int64_t findMaximalSuffix(const uint8_t *needle, uint64_t needleLength,
+    bool reverse, bool invert, int64_t *period) {
+  int64_t ms = -1;
+  int64_t j = 0;
+  int64_t k = 1;
+  int64_t p = 1;
+  while (j + k < (int64_t)needleLength) {
+    uint8_t a = byteAt(needle, needleLength, j + k, reverse);
+    uint8_t b = byteAt(needle, needleLength, ms + k, reverse);
+    if (invert? a > b : a < b) {
+      j += k;
+      k = 1;
+      p = j - ms;
+    } else if (a == b) {
+      if (k != p) {
+        k++;
+      } else {
+        j += p;
+        k = 1;
+      }
+    } else {
+      ms = j;
+      j = ms + 1;
+      k = p = 1;
+    }
+  }
+  *period = p;
+  return ms;
+}
+
+// Find the first match of the needle in the haystack with the Two-Way algorithm
+// of Crochemore and Perrin.  If |reverse|, both are read from the end, and the
+// result counts from the end of the haystack.  Return |haystackLength| if not
+// found.
+static uint64_t twoWayFind(const uint8_t *haystack, uint64_t haystackLength,
+    const uint8_t *needle, uint64_t needleLength, bool reverse) {
+  int64_t m = needleLength;
+  int64_t n = haystackLength;
+  int64_t period1, period2, period;
+  int64_t ms1 = findMaximalSuffix(needle, needleLength, reverse, false, &period1);
+  int64_t ms2 = findMaximalSuffix(needle, needleLength, reverse, true, &period2);
+  int64_t ell = ms1 > ms2? ms1 : ms2;
+  period = ms1 > ms2? period1 : period2;
+  bool periodic = ell + 1 + period <= m;
+  for (int64_t i = 0; periodic && i <= ell; i++) {
+    if (byteAt(needle, needleLength, i, reverse) != byteAt(needle, needleLength, i + period, reverse)) {
+      periodic = false;
+    }
+  }
+  if (!periodic) {
+    period = (ell + 1 > m - ell - 1? ell + 1 : m - ell - 1) + 1;
+  }
+  int64_t memory = -1;
+  int64_t j = 0;
+  while (j <= n - m) {
+    int64_t i = (ell > memory? ell : memory) + 1;
+    while (i < m && byteAt(needle, needleLength, i, reverse) ==
+        byteAt(haystack, haystackLength, i + j, reverse)) {
+      i++;
+    }
+    if (i < m) {
+      j += i - ell;
+      memory = -1;
+    } else {
+      i = ell;
+      while (i > memory && byteAt(needle, needleLength, i, reverse) ==
+          byteAt(haystack, haystackLength, i + j, reverse)) {
+        i--;
+      }
+      if (i <= memory) {
+        return j;
+      }
+      j += period;
+      if (periodic) {
+        memory = m - period - 1;
+      }
+    }
+  }
+  return haystackLength;
+}
+
+// Return the first position in [start, end] where the needle matches, or
+// UINT64_MAX if there is none.  The needle must have at least two bytes.
+static uint64_t findFirstMatch(const uint8_t *haystack, const uint8_t *needle,
+    uint64_t needleLength, uint64_t start, uint64_t end) {
+  runtime_findVector first = splatByte(needle[0]);
+  runtime_findVector last = splatByte(needle[needleLength - 1]);
+  uint64_t pos = start;
+  for (; pos <= end && end - pos >= RN_FIND_BLOCK - 1; pos += RN_FIND_BLOCK) {
+    const uint8_t *p = haystack + pos;
+    uint64_t mask = findMask(p, p + needleLength - 1, first, last);
+    while (mask != 0) {
+      uint32_t bit = __builtin_ctzll(mask) / RN_FIND_MASK_BITS;
+      if (!memcmp(p + bit + 1, needle + 1, needleLength - 2)) {
+        return pos + bit;
+      }
+      mask &= ~(RN_FIND_CANDIDATE_MASK << (bit * RN_FIND_MASK_BITS));
+    }
+  }
+  for (; pos <= end; pos++) {
+    if (haystack[pos] == needle[0] && !memcmp(haystack + pos + 1, needle + 1, needleLength - 1)) {
+      return pos;
+    }
+  }
+  return UINT64_MAX;
+}
+
+// Return the last position in [start, end] where the needle matches, or
+// UINT64_MAX if there is none.  The needle must have at least two bytes.
+static uint64_t findLastMatch(const uint8_t *haystack, const uint8_t *needle,
+    uint64_t needleLength, uint64_t start, uint64_t end) {
+  runtime_findVector first = splatByte(needle[0]);
+  runtime_findVector last = splatByte(needle[needleLength - 1]);
+  // |limit| is one past the last position left to check.
+  uint64_t limit = end + 1;
+  for (; limit - start >= RN_FIND_BLOCK; limit -= RN_FIND_BLOCK) {
+    uint64_t pos = limit - RN_FIND_BLOCK;
+    const uint8_t *p = haystack + pos;
+    uint64_t mask = findMask(p, p + needleLength - 1, first, last);
+    while (mask != 0) {
+      uint32_t bit = (63 - __builtin_clzll(mask)) / RN_FIND_MASK_BITS;
+      if (!memcmp(p + bit + 1, needle + 1, needleLength - 2)) {
+        return pos + bit;
+      }
+      mask &= ~(RN_FIND_CANDIDATE_MASK << (bit * RN_FIND_MASK_BITS));
+    }
+  }
+  while (limit-- > start) {
+    if (haystack[limit] == needle[0] && !memcmp(haystack + limit + 1, needle + 1, needleLength - 1)) {
+      return limit;
+    }
+  }
+  return UINT64_MAX;
+}
+
 // Find a sub-string in a string, starting at the offset.  Return the length of
 // the string if |needle| is not found in |haystack|.
 uint64_t runtime_stringFind(const runtime_array *haystack, const runtime_array *needle, uint64_t offset) {
@@ -1068,42 +1772,51 @@ uint64_t runtime_stringFind(const runtime_array *haystack, const runtime_array *
   if (needleLength > length || offset > length - needleLength) {
     return length;
   }
-  const char *p = (const char*)haystack->data + offset;
-  const char *q = (const char*)needle->data;
-  for (uint64_t i = offset; i < length; i++) {
-    if (*p++ == *q) {
-      const char *r = p;
-      const char *s = q + 1;
-      uint64_t j;
-      for (j = 1; j < needleLength && *r++ == *s++; j++);
-      if (j == needleLength) {
-        return i;
-      }
-    }
+  if (needleLength == 0) {
+    return offset;
+  }
+  const uint8_t *p = (const uint8_t*)haystack->data;
+  const uint8_t *q = (const uint8_t*)needle->data;
+  if (needleLength == 1) {
+    const uint8_t *match = memchr(p + offset, *q, length - offset);
+    return match == NULL? length : match - p;
   }
-  return length;
+  if (needleLength >= RN_TWO_WAY_MIN_NEEDLE) {
+    uint64_t pos = twoWayFind(p + offset, length - offset, q, needleLength, false);
+    return pos == length - offset? length : offset + pos;
+  }
+  uint64_t pos = findFirstMatch(p, q, needleLength, offset, length - needleLength);
+  return pos == UINT64_MAX? length : pos;
 }
 
 // Reverse-find a sub-string in a string, starting at the offset.  Return the
-// length of the string if |needle| is not found in |haystack|.
+// length of the string if |needle| is not found in |haystack|.  The match must
+// end at or after the offset, so it may start up to needleLength - 1 bytes before it.
 uint64_t runtime_stringRfind(const runtime_array *haystack, const runtime_array *needle, uint64_t offset) {
   uint64_t length = haystack->numElements;
   uint64_t needleLength = needle->numElements;
   if (needleLength > length || offset > length - needleLength) {
     return length;
   }
-  const char *p = (const char*)haystack->data + length - needleLength;
-  const char *q = (const char*)needle->data;
-  for (uint64_t i = offset; i < length; i++) {
-    if (*p-- == *q) {
-      const char *r = p + 2;
-      const char *s = q + 1;
-      uint64_t j;
-      for (j = 1; j < needleLength && *r++ == *s++; j++);
-      if (j == needleLength) {
-        return length - needleLength - (i - offset);
+  if (needleLength == 0) {
+    return length;
+  }
+  const uint8_t *p = (const uint8_t*)haystack->data;
+  const uint8_t *q = (const uint8_t*)needle->data;
+  uint64_t start = offset + 1 >= needleLength? offset + 1 - needleLength : 0;
+  uint64_t end = length - needleLength;
+  if (needleLength == 1) {
+    for (uint64_t pos = end + 1; pos-- > start;) {
+      if (p[pos] == *q) {
+        return pos;
       }
     }
+    return length;
+  }
+  if (needleLength >= RN_TWO_WAY_MIN_NEEDLE) {
+    uint64_t pos = twoWayFind(p + start, length - start, q, needleLength, true);
+    return pos == length - start? length : length - needleLength - pos;
   }
-  return length;
+  uint64_t pos = findLastMatch(p, q, needleLength, start, end);
+  return pos == UINT64_MAX? length : pos;
 }
@@ -0,0 +1,386 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Memory stats: how many objects of each class are live, how many slots its
+// arrays have room for, and how many bytes each of its global data member
+// arrays takes, including sub-arrays such as strings, along with array heap
+// totals by size class.  The compiler registers a table of each class's
+// counters and arrays.  memoryStats returns the report as one line of JSON,
+// and if $RUNE_MEMORY_STATS names a file, a line is appended to it at exit,
+// and on the first array allocation after a SIGUSR1.
+//
+// With $RUNE_ALLOC_SAMPLE set to N, or after sampleAllocations(N), the array
+// allocation that crosses each multiple of N bytes allocated by a thread is
+// sampled, and charged to the Rune file and line in runtime_allocFile and
+// runtime_allocLine, which code compiled with -heapprofile sets at the start
+// of each statement.  Each sample stands for N bytes.
+
+#include "runtime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// The size of the table of allocation sites, a power of 2.
+#define RN_ALLOC_SITES 4096u
+
+typedef struct {
+  const runtime_array *file;  // NULL if the line is not known.
+  uint32_t line;
+  uint64_t samples;
+  uint64_t bytes;  // Estimated bytes allocated: samples times the sample size.
+} allocSite;
+
+typedef struct {
+  char *text;
+  size_t len;
+  size_t allocated;
+} statsBuffer;
+
+_Thread_local const runtime_array *runtime_allocFile;
+_Thread_local uint32_t runtime_allocLine;
+uint64_t runtime_allocSampleBytes;
+volatile sig_atomic_t runtime_memoryStatsRequested;
+
+static const runtime_classStatsEntry *runtime_classStats;
+static uint32_t runtime_numClassStats;
+static const runtime_array **runtime_classStatsArrays;
+static const char *runtime_classStatsNames;
+static const char *runtime_memoryStatsFileName;
+// Bytes left before this thread's next sample.
+static _Thread_local int64_t runtime_allocSampleCountdown;
+static allocSite runtime_allocSites[RN_ALLOC_SITES];
+static uint32_t runtime_numAllocSites;
+// Samples charged to sites after the table fills up.
+static allocSite runtime_otherAllocSite;
+static bool runtime_allocSitesLock;
+
+// Called at the start of main with the compiler's table of classes.
+void runtime_registerClassStats(const runtime_classStatsEntry *classes, uint32_t numClasses,
+    const runtime_array **arrays, const char *names) {
+  runtime_classStats = classes;
+  runtime_numClassStats = numClasses;
+  runtime_classStatsArrays = arrays;
+  runtime_classStatsNames = names;
+}
+
+// Append formatted text to the buffer.
+static void statsPrintf(statsBuffer *buf, const char *format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  int len = vsnprintf(NULL, 0, format, ap);
+  va_end(ap);
+  if (buf->len + len + 1 > buf->allocated) {
+    size_t allocated = buf->allocated == 0? 256 : buf->allocated;
+    while (buf->len + len + 1 > allocated) {
+      allocated <<= 1;
+    }
+    buf->text = realloc(buf->text, allocated);
+    if (buf->text == NULL) {
+      runtime_panicCstr("Out of memory");
+    }
+    buf->allocated = allocated;
+  }
+  va_start(ap, format);
+  vsnprintf(buf->text + buf->len, len + 1, format, ap);
+  va_end(ap);
+  buf->len += len;
+}
+
+// Read a counter or nextFree link that is |refWidth| bits wide.  Elements
+// are a power of two bytes, like LLVM's i<refWidth>.
+static uint64_t readRef(const uint8_t *p, uint32_t refWidth) {
+  uint32_t refBytes = 1;
+  while (refBytes << 3 < refWidth) {
+    refBytes <<= 1;
+  }
+  uint64_t value = 0;
+  memcpy(&value, p, refBytes);  // Little endian.
+  if (refWidth < 64) {
+    value &= ((uint64_t)1 << refWidth) - 1;
+  }
+  return value;
+}
+
+// Return the number of objects on the class's free list.  Stats can be taken
+// while the class is growing its arrays, so stop at links out of range rather
+// than panicking.
+static uint64_t countFreeObjects(const runtime_classStatsEntry *entry, uint64_t used) {
+  uint32_t refWidth = entry->refWidth;
+  uint32_t refBytes = 1;
+  while (refBytes << 3 < refWidth) {
+    refBytes <<= 1;
+  }
+  const uint8_t *links = (const uint8_t*)entry->nextFree->data;
+  uint64_t numElements = entry->nextFree->numElements;
+  uint64_t numFree = 0;
+  uint64_t object = readRef(entry->firstFree, refWidth);
+  while (object != 0 && object < used && object < numElements && numFree < used) {
+    numFree++;
+    object = readRef(links + object * refBytes, refWidth);
+  }
+  return numFree;
+}
+
+// Return the bytes of heap the array's buffer takes, including its header,
+// and the buffers of any sub-arrays.
+static uint64_t arrayBytes(const runtime_array *array) {
+  if (array->data == NULL) {
+    return 0;
+  }
+  runtime_heapHeader *header = runtime_getArrayHeader(array);
+  uint64_t numBytes = sizeof(runtime_heapHeader) + ((uint64_t)header->allocatedWords << RN_SIZET_SHIFT);
+  if (header->hasSubArrays) {
+    const runtime_array *subArrays = (const runtime_array*)array->data;
+    for (size_t i = 0; i < array->numElements; i++) {
+      numBytes += arrayBytes(subArrays + i);
+    }
+  }
+  return numBytes;
+}
+
+// Print the next newline terminated name in the list, as a JSON string.
+static const char *printName(statsBuffer *buf, const char *name) {
+  const char *end = strchr(name, '\n');
+  statsPrintf(buf, "\"%.*s\"", (int)(end - name), name);
+  return end + 1;
+}
+
+// Print the per-class stats.
+static void printClassStats(statsBuffer *buf) {
+  statsPrintf(buf, "\"classes\": [");
+  const char *name = runtime_classStatsNames;
+  const runtime_array **arrays = runtime_classStatsArrays;
+  for (uint32_t i = 0; i < runtime_numClassStats; i++) {
+    const runtime_classStatsEntry *entry = runtime_classStats + i;
+    uint64_t allocated = readRef(entry->allocated, entry->refWidth);
+    uint64_t used = readRef(entry->used, entry->refWidth);
+    // Object 0 is null.
+    uint64_t liveObjects = used <= 1? 0 : used - 1 - countFreeObjects(entry, used);
+    statsPrintf(buf, "%s{\"name\": ", i == 0? "" : ", ");
+    name = printName(buf, name);
+    statsPrintf(buf, ", \"liveObjects\": %llu, \"allocatedSlots\": %llu, \"arrays\": [",
+        (unsigned long long)liveObjects, (unsigned long long)allocated);
+    uint64_t totalBytes = 0;
+    for (uint32_t j = 0; j < entry->numArrays; j++) {
+      uint64_t numBytes = arrayBytes(*arrays++);
+      totalBytes += numBytes;
+      statsPrintf(buf, "%s{\"name\": ", j == 0? "" : ", ");
+      name = printName(buf, name);
+      statsPrintf(buf, ", \"bytes\": %llu}", (unsigned long long)numBytes);
+    }
+    statsPrintf(buf, "], \"bytes\": %llu}", (unsigned long long)totalBytes);
+  }
+  statsPrintf(buf, "]");
+}
+
+// Print the array heap totals by size class.
+static void printHeapStats(statsBuffer *buf) {
+  runtime_arrayHeapStats stats;
+  runtime_getArrayHeapStats(&stats);
+  statsPrintf(buf, "\"heap\": {\"liveBytes\": %llu, \"maxLiveBytes\": %llu, "
+      "\"reservedBytes\": %llu, \"compactions\": %llu, \"sizeClasses\": [",
+      (unsigned long long)stats.liveBytes, (unsigned long long)stats.maxLiveBytes,
+      (unsigned long long)stats.reservedBytes, (unsigned long long)stats.compactions);
+  uint64_t pooledBytes = 0;
+  for (uint32_t i = 0; i < RN_POOL_NUM_CLASSES; i++) {
+    uint64_t bufferBytes = sizeof(runtime_heapHeader) + ((uint64_t)1 << (i + RN_SIZET_SHIFT));
+    uint64_t liveBytes = stats.poolLiveBuffers[i] * bufferBytes;
+    pooledBytes += liveBytes;
+    statsPrintf(buf, "%s{\"words\": %u, \"allocations\": %llu, \"liveBuffers\": %llu, "
+        "\"liveBytes\": %llu}", i == 0? "" : ", ", 1u << i,
+        (unsigned long long)stats.poolAllocations[i], (unsigned long long)stats.poolLiveBuffers[i],
+        (unsigned long long)liveBytes);
+  }
+  // The counters are updated separately, so they can briefly disagree.
+  uint64_t largeBytes = stats.liveBytes > pooledBytes? stats.liveBytes - pooledBytes : 0;
+  statsPrintf(buf, "], \"large\": {\"allocations\": %llu, \"liveBytes\": %llu}}",
+      (unsigned long long)stats.largeAllocations, (unsigned long long)largeBytes);
+}
+
+// Lock the table of allocation sites, if threads are running.
+static inline void lockAllocSites(void) {
+  if (runtime_multiThreaded) {
+    while (__atomic_test_and_set(&runtime_allocSitesLock, __ATOMIC_ACQUIRE)) {
+    }
+  }
+}
+
+// Unlock the table of allocation sites, if threads are running.
+static inline void unlockAllocSites(void) {
+  if (runtime_multiThreaded) {
+    __atomic_clear(&runtime_allocSitesLock, __ATOMIC_RELEASE);
+  }
+}
+
+// Print a sampled allocation site.
+static void printAllocSite(statsBuffer *buf, const allocSite *site, bool first) {
+  statsPrintf(buf, "%s{\"file\": \"", first? "" : ", ");
+  if (site->file != NULL) {
+    statsPrintf(buf, "%.*s", (int)site->file->numElements, (const char*)site->file->data);
+  }
+  statsPrintf(buf, "\", \"line\": %u, \"samples\": %llu, \"bytes\": %llu}", site->line,
+      (unsigned long long)site->samples, (unsigned long long)site->bytes);
+}
+
+// Print the sampled allocation sites, in no particular order.
+static void printAllocSites(statsBuffer *buf) {
+  statsPrintf(buf, "\"sampleBytes\": %llu, \"allocationSites\": [",
+      (unsigned long long)runtime_allocSampleBytes);
+  lockAllocSites();
+  bool first = true;
+  for (uint32_t i = 0; i < RN_ALLOC_SITES; i++) {
+    if (runtime_allocSites[i].samples != 0) {
+      printAllocSite(buf, runtime_allocSites + i, first);
+      first = false;
+    }
+  }
+  if (runtime_otherAllocSite.samples != 0) {
+    printAllocSite(buf, &runtime_otherAllocSite, first);
+  }
+  unlockAllocSites();
+  statsPrintf(buf, "]");
+}
+
+// Build the report as one line of JSON.  The caller frees buf->text.
+static void buildMemoryStats(statsBuffer *buf) {
+  statsPrintf(buf, "{");
+  printClassStats(buf);
+  statsPrintf(buf, ", ");
+  printHeapStats(buf);
+  statsPrintf(buf, ", ");
+  printAllocSites(buf);
+  statsPrintf(buf, "}\n");
+}
+
+// Set |report| to the memory stats, as one line of JSON.
+void memoryStats(runtime_array *report) {
+  statsBuffer buf = {NULL, 0, 0};
+  buildMemoryStats(&buf);
+  runtime_arrayInitCstr(report, buf.text);
+  free(buf.text);
+}
+
+// Append the memory stats to the file.  Return false if it cannot be written.
+static bool appendMemoryStats(const char *fileName) {
+  FILE *file = fopen(fileName, "a");
+  if (file == NULL) {
+    return false;
+  }
+  statsBuffer buf = {NULL, 0, 0};
+  buildMemoryStats(&buf);
+  bool passed = fputs(buf.text, file) >= 0;
+  free(buf.text);
+  return fclose(file) == 0 && passed;
+}
+
+// Append the memory stats to the file.  Return false if it cannot be written.
+bool writeMemoryStats(const runtime_array *fileName) {
+  size_t len = fileName->numElements;
+  char fileNameCstr[len + 1];
+  memcpy(fileNameCstr, fileName->data, len);
+  fileNameCstr[len] = '\0';
+  return appendMemoryStats(fileNameCstr);
+}
+
+// Append the memory stats to $RUNE_MEMORY_STATS.
+static void writeMemoryStatsFile(void) {
+  if (!appendMemoryStats(runtime_memoryStatsFileName)) {
+    fprintf(stderr, "Unable to write memory stats to %s\n", runtime_memoryStatsFileName);
+  }
+}
+
+#ifdef SIGUSR1
+// Ask for the stats to be written on the next array allocation, where it is
+// safe to call stdio.
+static void requestMemoryStats(int signalNumber) {
+  (void)signalNumber;
+  runtime_memoryStatsRequested = 1;
+}
+#endif
+
+// Sample allocations once per |sampleBytes| bytes allocated, or stop sampling
+// if it is 0.  Sites sampled so far are kept.
+void sampleAllocations(uint64_t sampleBytes) {
+  runtime_allocSampleBytes = sampleBytes;
+  runtime_allocSampleCountdown = sampleBytes;
+}
+
+// Charge |samples| samples to the allocation site.
+static void recordAllocSite(const runtime_array *file, uint32_t line, uint64_t samples,
+    uint64_t numBytes) {
+  uint64_t hash = ((uint64_t)(uintptr_t)file ^ ((uint64_t)line << 32)) * 0x9e3779b97f4a7c15ULL;
+  uint32_t index = (uint32_t)(hash >> 52) & (RN_ALLOC_SITES - 1);
+  lockAllocSites();
+  allocSite *site = runtime_allocSites + index;
+  while (site->samples != 0 && (site->file != file || site->line != line)) {
+    index = (index + 1) & (RN_ALLOC_SITES - 1);
+    site = runtime_allocSites + index;
+  }
+  if (site->samples == 0) {
+    // Keep a quarter of the table empty, so probes stay short.
+    if (runtime_numAllocSites >= RN_ALLOC_SITES - RN_ALLOC_SITES / 4) {
+      site = &runtime_otherAllocSite;
+    } else {
+      runtime_numAllocSites++;
+      site->file = file;
+      site->line = line;
+    }
+  }
+  site->samples += samples;
+  site->bytes += numBytes;
+  unlockAllocSites();
+}
+
+// Called by the array heap for each buffer it allocates, when sampling or when
+// SIGUSR1 has asked for stats.
+void runtime_noteAllocation(uint64_t numBytes) {
+  if (runtime_memoryStatsRequested &&
+      __atomic_exchange_n(&runtime_memoryStatsRequested, 0, __ATOMIC_RELAXED)) {
+    writeMemoryStatsFile();
+  }
+  uint64_t sampleBytes = runtime_allocSampleBytes;
+  if (sampleBytes == 0) {
+    return;
+  }
+  runtime_allocSampleCountdown -= numBytes;
+  if (runtime_allocSampleCountdown > 0) {
+    return;
+  }
+  uint64_t samples = 1 + (uint64_t)-runtime_allocSampleCountdown / sampleBytes;
+  runtime_allocSampleCountdown += samples * sampleBytes;
+  recordAllocSite(runtime_allocFile, runtime_allocLine, samples, samples * sampleBytes);
+}
+
+// Read $RUNE_MEMORY_STATS and $RUNE_ALLOC_SAMPLE.  Called by runtime_arrayStart.
+void runtime_startMemoryStats(void) {
+  const char *sampleBytes = getenv("RUNE_ALLOC_SAMPLE");
+  if (sampleBytes != NULL) {
+    sampleAllocations(strtoull(sampleBytes, NULL, 10));
+  }
+  runtime_memoryStatsFileName = getenv("RUNE_MEMORY_STATS");
+  if (runtime_memoryStatsFileName == NULL) {
+    return;
+  }
+  // Each run starts a new file.
+  FILE *file = fopen(runtime_memoryStatsFileName, "w");
+  if (file != NULL) {
+    fclose(file);
+  }
+  if (atexit(writeMemoryStatsFile) != 0) {
+    runtime_panicCstr("Unable to register the memory stats writer!");
+  }
+#ifdef SIGUSR1
+  signal(SIGUSR1, requestMemoryStats);
+#endif
+}
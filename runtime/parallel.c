@@ -0,0 +1,312 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A work-stealing thread pool for parallel for statements.  The iteration
+// space is split evenly into one share per thread.  Each thread claims chunks
+// from the front of its own share, with chunks shrinking as the share runs
+// down, and when its share is empty, steals the back half of the largest
+// remaining share.  The threads are started on first use, one per online CPU,
+// or $RUNE_THREADS if set.  The calling thread works on share 0, and returns
+// once every iteration has run.  Parallel for statements inside a parallel
+// for body run serially on the thread executing them.
+
+#include "runtime.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define RN_MAX_THREADS 64
+// A thread claims 1/RN_PARALLEL_CHUNK_DIVISOR of its remaining share at a time.
+#define RN_PARALLEL_CHUNK_DIVISOR 8
+
+struct runtime_parallelJobStruct;
+typedef void (*runtime_parallelRun)(struct runtime_parallelJobStruct *job,
+    uint64_t first, uint64_t last);
+
+typedef struct runtime_parallelJobStruct {
+  runtime_parallelRun run;
+  runtime_parallelBody body;
+  void *context;
+  const uint8_t *live;  // For object loops, non-zero for allocated objects.
+} runtime_parallelJob;
+
+// The remaining iterations [next, end) of one thread's share.  Each share is
+// on its own cache line, so threads claiming chunks do not contend.
+typedef struct {
+  _Alignas(64) pthread_mutex_t mutex;
+  uint64_t next;
+  uint64_t end;
+} runtime_parallelShare;
+
+static runtime_parallelShare runtime_shares[RN_MAX_THREADS];
+static uint32_t runtime_numThreads;
+static pthread_once_t runtime_poolOnce = PTHREAD_ONCE_INIT;
+// Only one parallel region runs on the pool at a time.
+static pthread_mutex_t runtime_regionMutex = PTHREAD_MUTEX_INITIALIZER;
+// Protects the fields below, which wake up workers, and report when they are done.
+static pthread_mutex_t runtime_poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t runtime_workCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t runtime_doneCond = PTHREAD_COND_INITIALIZER;
+static uint64_t runtime_generation;
+static uint32_t runtime_numRunning;
+static runtime_parallelJob *runtime_currentJob;
+// Set on threads running parallel for bodies.
+static _Thread_local bool runtime_inParallelRegion;
+
+// Claim a chunk from the front of the share.  Return false if it is empty.
+static bool claimChunk(runtime_parallelShare *share, uint64_t *first, uint64_t *last) {
+  pthread_mutex_lock(&share->mutex);
+  uint64_t remaining = share->end - share->next;
+  if (remaining == 0) {
+    pthread_mutex_unlock(&share->mutex);
+    return false;
+  }
+  uint64_t chunk = remaining / RN_PARALLEL_CHUNK_DIVISOR;
+  if (chunk == 0) {
+    chunk = 1;
+  }
+  *first = share->next;
+  share->next += chunk;
+  *last = share->next;
+  pthread_mutex_unlock(&share->mutex);
+  return true;
+}
+
+// Move the back half of the largest other share into this thread's share.
+// Return false if there was nothing left to steal.
+static bool stealWork(uint32_t worker) {
+  for (;;) {
+    uint32_t victim = worker;
+    uint64_t largest = 0;
+    for (uint32_t i = 0; i < runtime_numThreads; i++) {
+      if (i != worker) {
+        runtime_parallelShare *share = runtime_shares + i;
+        pthread_mutex_lock(&share->mutex);
+        uint64_t remaining = share->end - share->next;
+        pthread_mutex_unlock(&share->mutex);
+        if (remaining > largest) {
+          largest = remaining;
+          victim = i;
+        }
+      }
+    }
+    if (largest == 0) {
+      return false;
+    }
+    runtime_parallelShare *share = runtime_shares + victim;
+    pthread_mutex_lock(&share->mutex);
+    uint64_t remaining = share->end - share->next;
+    uint64_t first = share->end - (remaining + 1) / 2;
+    uint64_t last = share->end;
+    share->end = first;
+    pthread_mutex_unlock(&share->mutex);
+    if (first != last) {
+      runtime_parallelShare *own = runtime_shares + worker;
+      pthread_mutex_lock(&own->mutex);
+      own->next = first;
+      own->end = last;
+      pthread_mutex_unlock(&own->mutex);
+      return true;
+    }
+    // The victim ran out before we locked it.  Look again.
+  }
+}
+
+// Run chunks of the job until no iterations are left to claim or steal.
+static void runWorker(runtime_parallelJob *job, uint32_t worker) {
+  runtime_parallelShare *own = runtime_shares + worker;
+  uint64_t first, last;
+  do {
+    while (claimChunk(own, &first, &last)) {
+      job->run(job, first, last);
+    }
+  } while (stealWork(worker));
+}
+
+// The main loop of pool threads.
+static void *workerMain(void *arg) {
+  uint32_t worker = (uint32_t)(uintptr_t)arg;
+  runtime_inParallelRegion = true;
+  // The pool starts before the first job is posted, which may happen before
+  // this thread gets here.
+  uint64_t generation = 0;
+  pthread_mutex_lock(&runtime_poolMutex);
+  for (;;) {
+    while (runtime_generation == generation) {
+      pthread_cond_wait(&runtime_workCond, &runtime_poolMutex);
+    }
+    generation = runtime_generation;
+    runtime_parallelJob *job = runtime_currentJob;
+    pthread_mutex_unlock(&runtime_poolMutex);
+    runWorker(job, worker);
+    pthread_mutex_lock(&runtime_poolMutex);
+    if (--runtime_numRunning == 0) {
+      pthread_cond_signal(&runtime_doneCond);
+    }
+  }
+  return NULL;
+}
+
+// Start the pool threads.  If threads cannot be created, parallel for
+// statements run on the calling thread.
+static void startPool(void) {
+  long numThreads = 0;
+  const char *threads = getenv("RUNE_THREADS");
+  if (threads != NULL) {
+    numThreads = strtol(threads, NULL, 10);
+  }
+  if (numThreads <= 0) {
+    numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (numThreads <= 0) {
+    numThreads = 1;
+  } else if (numThreads > RN_MAX_THREADS) {
+    numThreads = RN_MAX_THREADS;
+  }
+  for (uint32_t i = 0; i < RN_MAX_THREADS; i++) {
+    pthread_mutex_init(&runtime_shares[i].mutex, NULL);
+  }
+  runtime_numThreads = 1;
+  if (numThreads > 1) {
+    runtime_multiThreaded = true;
+  }
+  for (uint32_t i = 1; i < numThreads; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, workerMain, (void*)(uintptr_t)i) != 0) {
+      break;
+    }
+    pthread_detach(thread);
+    runtime_numThreads++;
+  }
+}
+
+// Run the job's iterations [0, numIterations) on the pool, with the calling
+// thread working on share 0.
+static void runOnPool(runtime_parallelJob *job, uint64_t numIterations) {
+  pthread_mutex_lock(&runtime_regionMutex);
+  uint64_t perThread = numIterations / runtime_numThreads;
+  uint64_t extra = numIterations % runtime_numThreads;
+  uint64_t next = 0;
+  for (uint32_t i = 0; i < runtime_numThreads; i++) {
+    runtime_shares[i].next = next;
+    next += perThread + (i < extra? 1 : 0);
+    runtime_shares[i].end = next;
+  }
+  pthread_mutex_lock(&runtime_poolMutex);
+  runtime_currentJob = job;
+  runtime_numRunning = runtime_numThreads - 1;
+  runtime_generation++;
+  pthread_cond_broadcast(&runtime_workCond);
+  pthread_mutex_unlock(&runtime_poolMutex);
+  runWorker(job, 0);
+  pthread_mutex_lock(&runtime_poolMutex);
+  while (runtime_numRunning != 0) {
+    pthread_cond_wait(&runtime_doneCond, &runtime_poolMutex);
+  }
+  pthread_mutex_unlock(&runtime_poolMutex);
+  pthread_mutex_unlock(&runtime_regionMutex);
+}
+
+// Run the job's iterations [0, numIterations), on the pool if it has more
+// than one thread.
+static void runParallelJob(runtime_parallelJob *job, uint64_t numIterations) {
+  if (numIterations == 0) {
+    return;
+  }
+  pthread_once(&runtime_poolOnce, startPool);
+  if (runtime_inParallelRegion) {
+    job->run(job, 0, numIterations);
+    return;
+  }
+  // Exceptions cannot unwind across threads, so any raised by the body are
+  // reported as uncaught, even when it runs on this thread.
+  struct jmpbuf_wrapped *savedSetjmpBuffer = runtime_firstSetjmpBuffer;
+  bool savedUnwindExceptions = runtime_unwindExceptions;
+  runtime_firstSetjmpBuffer = NULL;
+  runtime_unwindExceptions = false;
+  runtime_inParallelRegion = true;
+  if (runtime_numThreads == 1 || numIterations == 1) {
+    job->run(job, 0, numIterations);
+  } else {
+    runOnPool(job, numIterations);
+  }
+  runtime_inParallelRegion = false;
+  runtime_firstSetjmpBuffer = savedSetjmpBuffer;
+  runtime_unwindExceptions = savedUnwindExceptions;
+}
+
+// Determine if the calling thread is running a parallel for body.
+bool runtime_inParallelBody(void) {
+  return runtime_inParallelRegion;
+}
+
+// Run a chunk of a range loop.
+static void runRange(runtime_parallelJob *job, uint64_t first, uint64_t last) {
+  job->body(job->context, first, last);
+}
+
+// Call body(context, first, last) on disjoint sub-ranges covering [0,
+// numIterations), in parallel.
+void runtime_parallelFor(runtime_parallelBody body, void *context, uint64_t numIterations) {
+  runtime_parallelJob job = {runRange, body, context, NULL};
+  runParallelJob(&job, numIterations);
+}
+
+// Run a chunk of an object loop, calling the body on each run of allocated objects.
+static void runObjects(runtime_parallelJob *job, uint64_t first, uint64_t last) {
+  uint64_t i = first;
+  while (i < last) {
+    while (i < last && !job->live[i]) {
+      i++;
+    }
+    uint64_t start = i;
+    while (i < last && job->live[i]) {
+      i++;
+    }
+    if (start != i) {
+      job->body(job->context, start, i);
+    }
+  }
+}
+
+// Call the body on every allocated object of a class, in parallel.  Objects
+// [1, used) have been allocated at some point, and the freed ones are on the
+// free list starting at firstFree, linked through nextFree, whose elements
+// are refBytes wide.
+void runtime_parallelForObjects(runtime_parallelBody body, void *context,
+    const runtime_array *nextFree, size_t refBytes, uint64_t used, uint64_t firstFree) {
+  if (used <= 1) {
+    return;
+  }
+  uint8_t *live = malloc(used);
+  if (live == NULL) {
+    runtime_panicCstr("Out of memory");
+  }
+  memset(live, 1, used);
+  live[0] = 0;  // Object 0 is null.
+  const uint8_t *links = (const uint8_t*)nextFree->data;
+  uint64_t object = firstFree;
+  while (object != 0) {
+    if (object >= used || object >= nextFree->numElements || !live[object]) {
+      runtime_panicCstr("Corrupt free list");
+    }
+    live[object] = 0;
+    uint64_t next = 0;
+    memcpy(&next, links + object * refBytes, refBytes);  // Little endian.
+    object = next;
+  }
+  runtime_parallelJob job = {runObjects, body, context, live};
+  runParallelJob(&job, used);
+  free(live);
+}
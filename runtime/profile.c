@@ -0,0 +1,139 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Field access profiling for programs compiled with rune -profile.  The
+// compiler passes a newline separated list of <Class>_<field> names, and one
+// counter per name that generated code increments on each access.  At exit,
+// we write "<name> <count>" lines to $RUNE_PROFILE, or rune.profile if it is
+// not set.  The names also include each class's <Class>_used global, whose
+// count is the number of object slots in use at exit, which a compiler
+// generated function stores just before the profile is written.  Pass the
+// file to rune -useprofile to group hot fields, and pick reference widths.
+
+#include "runtime.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *runtime_fieldNames;
+static uint64_t *runtime_fieldAccessCounts;
+static uint32_t runtime_numProfiledFields;
+static void (*runtime_recordObjectCounts)(void);
+
+// Write the field access counts.
+static void writeFieldProfile(void) {
+  const char *fileName = getenv("RUNE_PROFILE");
+  if (fileName == NULL) {
+    fileName = "rune.profile";
+  }
+  FILE *file = fopen(fileName, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Unable to write profile to %s\n", fileName);
+    return;
+  }
+  runtime_recordObjectCounts();
+  const char *name = runtime_fieldNames;
+  for (uint32_t i = 0; i < runtime_numProfiledFields; i++) {
+    const char *end = strchr(name, '\n');
+    fprintf(file, "%.*s %llu\n", (int)(end - name), name,
+        (unsigned long long)runtime_fieldAccessCounts[i]);
+    name = end + 1;
+  }
+  fclose(file);
+}
+
+// Start counting field accesses.  The counts are written when the program exits.
+void runtime_startFieldProfile(const char *names, uint64_t *counts, uint32_t numFields,
+    void (*recordObjectCounts)(void)) {
+  runtime_fieldNames = names;
+  runtime_recordObjectCounts = recordObjectCounts;
+  runtime_fieldAccessCounts = counts;
+  runtime_numProfiledFields = numFields;
+  if (atexit(writeFieldProfile) != 0) {
+    runtime_panicCstr("Unable to register the field profile writer!");
+  }
+}
+
+// Counters for programs compiled with rune -instrument.  Each counter has a
+// "<kind> <file>:<line> <function>" line in the newline separated names.  At
+// exit, the counters that ran are written as "<count> <name>" lines, most
+// frequent first, to $RUNE_INSTRUMENT, or rune.instrument if it is not set.
+static const char *runtime_instrumentNames;
+static uint64_t **runtime_instrumentCounters;
+static uint32_t runtime_numInstrumentCounters;
+
+typedef struct {
+  uint64_t count;
+  const char *name;
+  uint32_t nameLen;
+} instrumentLine;
+
+// Order lines by decreasing count, and then by name.
+static int compareInstrumentLines(const void *a, const void *b) {
+  const instrumentLine *lineA = a;
+  const instrumentLine *lineB = b;
+  if (lineA->count != lineB->count) {
+    return lineA->count < lineB->count? 1 : -1;
+  }
+  uint32_t len = lineA->nameLen < lineB->nameLen? lineA->nameLen : lineB->nameLen;
+  int result = memcmp(lineA->name, lineB->name, len);
+  if (result != 0) {
+    return result;
+  }
+  return (int)lineA->nameLen - (int)lineB->nameLen;
+}
+
+// Write the instrumentation counters.
+static void writeInstrumentCounts(void) {
+  const char *fileName = getenv("RUNE_INSTRUMENT");
+  if (fileName == NULL) {
+    fileName = "rune.instrument";
+  }
+  FILE *file = fopen(fileName, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Unable to write instrumentation counts to %s\n", fileName);
+    return;
+  }
+  instrumentLine *lines = calloc(runtime_numInstrumentCounters + 1, sizeof(instrumentLine));
+  if (lines == NULL) {
+    runtime_panicCstr("Out of memory");
+  }
+  uint32_t numLines = 0;
+  const char *name = runtime_instrumentNames;
+  for (uint32_t i = 0; i < runtime_numInstrumentCounters; i++) {
+    const char *end = strchr(name, '\n');
+    uint64_t count = *runtime_instrumentCounters[i];
+    if (count != 0) {
+      instrumentLine line = {count, name, (uint32_t)(end - name)};
+      lines[numLines++] = line;
+    }
+    name = end + 1;
+  }
+  qsort(lines, numLines, sizeof(instrumentLine), compareInstrumentLines);
+  for (uint32_t i = 0; i < numLines; i++) {
+    fprintf(file, "%llu %.*s\n", (unsigned long long)lines[i].count, (int)lines[i].nameLen,
+        lines[i].name);
+  }
+  free(lines);
+  fclose(file);
+}
+
+// Start counting.  The counts are written when the program exits.
+void runtime_startInstrumentation(const char *names, uint64_t **counters, uint32_t numCounters) {
+  runtime_instrumentNames = names;
+  runtime_instrumentCounters = counters;
+  runtime_numInstrumentCounters = numCounters;
+  if (atexit(writeInstrumentCounts) != 0) {
+    runtime_panicCstr("Unable to register the instrumentation writer!");
+  }
+}
@@ -0,0 +1,251 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Variable time arithmetic for public bigints, which need no protection from
+// timing side-channels.  Numbers are little-endian arrays of 64-bit limbs.
+// The caller provides all scratch space, so nothing here allocates.
+#include "runtime.h"
+
+// Operands with at least this many limbs are multiplied with Karatsuba.
+#define RN_KARATSUBA_LIMBS 32
+
+typedef unsigned __int128 runtime_doubleLimb;
+
+// Set r = a + b, where all have |n| limbs, and return the carry.
+static uint64_t addLimbs(uint64_t *r, const uint64_t *a, const uint64_t *b, uint32_t n) {
+  uint64_t carry = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    runtime_doubleLimb sum = (runtime_doubleLimb)a[i] + b[i] + carry;
+    r[i] = (uint64_t)sum;
+    carry = (uint64_t)(sum >> 64);
+  }
+  return carry;
+}
+
+// Set r = r - a, where r has |rLen| limbs and a has |aLen| <= rLen limbs.
+// Return the borrow.
+static uint64_t subLimbsInPlace(uint64_t *r, uint32_t rLen, const uint64_t *a, uint32_t aLen) {
+  uint64_t borrow = 0;
+  uint32_t i;
+  for (i = 0; i < aLen; i++) {
+    uint64_t ri = r[i];
+    uint64_t d = ri - a[i] - borrow;
+    borrow = (ri < a[i]) || (ri - a[i] < borrow);
+    r[i] = d;
+  }
+  for (; borrow && i < rLen; i++) {
+    borrow = r[i] == 0;
+    r[i]--;
+  }
+  return borrow;
+}
+
+// Set r = r + a, where r has |rLen| limbs and a has |aLen| <= rLen limbs.
+// Return the carry.
+static uint64_t addLimbsInPlace(uint64_t *r, uint32_t rLen, const uint64_t *a, uint32_t aLen) {
+  uint64_t carry = addLimbs(r, r, a, aLen);
+  for (uint32_t i = aLen; carry && i < rLen; i++) {
+    carry = ++r[i] == 0;
+  }
+  return carry;
+}
+
+// Set r[0 .. aLen+bLen) = a * b with the schoolbook method.
+static void mulSchoolbook(uint64_t *r, const uint64_t *a, uint32_t aLen,
+    const uint64_t *b, uint32_t bLen) {
+  memset(r, 0, (aLen + bLen) * sizeof(uint64_t));
+  for (uint32_t i = 0; i < bLen; i++) {
+    uint64_t bi = b[i];
+    if (bi == 0) {
+      continue;
+    }
+    uint64_t carry = 0;
+    for (uint32_t j = 0; j < aLen; j++) {
+      runtime_doubleLimb p = (runtime_doubleLimb)a[j] * bi + r[i + j] + carry;
+      r[i + j] = (uint64_t)p;
+      carry = (uint64_t)(p >> 64);
+    }
+    r[i + aLen] = carry;
+  }
+}
+
+// Return the scratch limbs karatsuba needs for |n| limb operands.
+static uint64_t karatsubaScratchSize(uint32_t n) {
+  if (n < RN_KARATSUBA_LIMBS) {
+    return 0;
+  }
+  uint32_t h = n - n/2;
+  return 4*((uint64_t)h + 1) + karatsubaScratchSize(h + 1);
+}
+
+// Set r[0 .. 2n) = a * b, where both have |n| limbs.  With a = a1*B + a0 and
+// b = b1*B + b0, the middle product a0*b1 + a1*b0 is (a0 + a1)*(b0 + b1) -
+// a0*b0 - a1*b1, which saves one of the four half-sized multiplications.
+static void karatsuba(uint64_t *r, const uint64_t *a, const uint64_t *b, uint32_t n,
+    uint64_t *scratch) {
+  if (n < RN_KARATSUBA_LIMBS) {
+    mulSchoolbook(r, a, n, b, n);
+    return;
+  }
+  uint32_t m = n/2;
+  uint32_t h = n - m;
+  karatsuba(r, a, b, m, scratch);
+  karatsuba(r + 2*m, a + m, b + m, h, scratch);
+  uint64_t *aSum = scratch;
+  uint64_t *bSum = aSum + h + 1;
+  uint64_t *middle = bSum + h + 1;
+  // The low halves may be one limb shorter than the high halves.
+  memcpy(aSum, a + m, h * sizeof(uint64_t));
+  memcpy(bSum, b + m, h * sizeof(uint64_t));
+  aSum[h] = addLimbsInPlace(aSum, h, a, m);
+  bSum[h] = addLimbsInPlace(bSum, h, b, m);
+  karatsuba(middle, aSum, bSum, h + 1, middle + 2*(h + 1));
+  subLimbsInPlace(middle, 2*(h + 1), r, 2*m);
+  subLimbsInPlace(middle, 2*(h + 1), r + 2*m, 2*h);
+  // The middle product fits in 2h + 1 limbs, and the top limbs are 0.
+  addLimbsInPlace(r + m, 2*n - m, middle, 2*h + 1);
+}
+
+// Return the number of scratch limbs runtime_limbsMul needs.
+uint64_t runtime_limbsMulScratchSize(uint32_t aLen, uint32_t bLen) {
+  if (aLen < bLen) {
+    uint32_t t = aLen;
+    aLen = bLen;
+    bLen = t;
+  }
+  if (bLen < RN_KARATSUBA_LIMBS) {
+    return 0;
+  }
+  uint64_t size = karatsubaScratchSize(bLen);
+  uint32_t rem = aLen % bLen;
+  uint64_t remSize = rem == 0? 0 : runtime_limbsMulScratchSize(bLen, rem);
+  return 2*(uint64_t)bLen + (size > remSize? size : remSize);
+}
+
+// Set r[0 .. aLen+bLen) = a * b.  |r| must not overlap a or b.  Balanced
+// operands use Karatsuba above RN_KARATSUBA_LIMBS, and a much longer operand
+// is multiplied in pieces the length of the shorter one.
+void runtime_limbsMul(uint64_t *r, const uint64_t *a, uint32_t aLen,
+    const uint64_t *b, uint32_t bLen, uint64_t *scratch) {
+  if (aLen < bLen) {
+    const uint64_t *t = a;
+    a = b;
+    b = t;
+    uint32_t tLen = aLen;
+    aLen = bLen;
+    bLen = tLen;
+  }
+  if (bLen < RN_KARATSUBA_LIMBS) {
+    mulSchoolbook(r, a, aLen, b, bLen);
+    return;
+  }
+  if (aLen == bLen) {
+    karatsuba(r, a, b, aLen, scratch);
+    return;
+  }
+  memset(r, 0, (aLen + bLen) * sizeof(uint64_t));
+  uint64_t *piece = scratch;
+  scratch += 2*bLen;
+  uint32_t i;
+  for (i = 0; i + bLen <= aLen; i += bLen) {
+    karatsuba(piece, a + i, b, bLen, scratch);
+    addLimbsInPlace(r + i, aLen + bLen - i, piece, 2*bLen);
+  }
+  if (i < aLen) {
+    uint32_t rem = aLen - i;
+    runtime_limbsMul(piece, b, bLen, a + i, rem, scratch);
+    addLimbsInPlace(r + i, aLen + bLen - i, piece, bLen + rem);
+  }
+}
+
+// Set q = a / d for the single limb d, where a and q have |n| limbs, and
+// return the remainder.
+static uint64_t divLimbsBySmall(uint64_t *q, const uint64_t *a, uint32_t n, uint64_t d) {
+  runtime_doubleLimb rem = 0;
+  for (uint32_t i = n; i-- > 0;) {
+    runtime_doubleLimb cur = (rem << 64) | a[i];
+    q[i] = (uint64_t)(cur / d);
+    rem = cur % d;
+  }
+  return (uint64_t)rem;
+}
+
+// Compute q = a / b and r = a % b with Knuth's algorithm D.  The top limb of
+// b must be non-zero.  q gets aLen limbs, r gets bLen limbs, and the scratch
+// space must have aLen + bLen + 1 limbs.
+void runtime_limbsDivRem(uint64_t *q, uint64_t *r, const uint64_t *a, uint32_t aLen,
+    const uint64_t *b, uint32_t bLen, uint64_t *scratch) {
+  memset(q, 0, aLen * sizeof(uint64_t));
+  if (aLen < bLen) {
+    memcpy(r, a, aLen * sizeof(uint64_t));
+    memset(r + aLen, 0, (bLen - aLen) * sizeof(uint64_t));
+    return;
+  }
+  if (bLen == 1) {
+    r[0] = divLimbsBySmall(q, a, aLen, b[0]);
+    return;
+  }
+  // Normalize so the divisor's top bit is set, which keeps each quotient
+  // limb estimate at most 2 too big.
+  uint32_t shift = __builtin_clzll(b[bLen - 1]);
+  uint64_t *u = scratch;
+  uint64_t *v = u + aLen + 1;
+  for (uint32_t i = bLen - 1; i > 0; i--) {
+    v[i] = shift == 0? b[i] : (b[i] << shift) | (b[i - 1] >> (64 - shift));
+  }
+  v[0] = b[0] << shift;
+  u[aLen] = shift == 0? 0 : a[aLen - 1] >> (64 - shift);
+  for (uint32_t i = aLen - 1; i > 0; i--) {
+    u[i] = shift == 0? a[i] : (a[i] << shift) | (a[i - 1] >> (64 - shift));
+  }
+  u[0] = a[0] << shift;
+  uint64_t vTop = v[bLen - 1];
+  uint64_t vNext = v[bLen - 2];
+  for (uint32_t j = aLen - bLen + 1; j-- > 0;) {
+    runtime_doubleLimb num = ((runtime_doubleLimb)u[j + bLen] << 64) | u[j + bLen - 1];
+    runtime_doubleLimb qHat = num / vTop;
+    runtime_doubleLimb rHat = num % vTop;
+    while ((qHat >> 64) != 0 ||
+        qHat * vNext > ((rHat << 64) | u[j + bLen - 2])) {
+      qHat--;
+      rHat += vTop;
+      if ((rHat >> 64) != 0) {
+        break;
+      }
+    }
+    // Multiply and subtract qHat * v from u[j .. j+bLen].
+    uint64_t carry = 0;
+    uint64_t borrow = 0;
+    for (uint32_t i = 0; i < bLen; i++) {
+      runtime_doubleLimb p = qHat * v[i] + carry;
+      carry = (uint64_t)(p >> 64);
+      uint64_t pLow = (uint64_t)p;
+      uint64_t ui = u[i + j];
+      u[i + j] = ui - pLow - borrow;
+      borrow = (ui < pLow) || (ui - pLow < borrow);
+    }
+    uint64_t top = u[j + bLen];
+    u[j + bLen] = top - carry - borrow;
+    if (top < carry || top - carry < borrow) {
+      // qHat was one too big, so add v back.
+      qHat--;
+      u[j + bLen] += addLimbs(u + j, u + j, v, bLen);
+    }
+    q[j] = (uint64_t)qHat;
+  }
+  for (uint32_t i = 0; i < bLen - 1; i++) {
+    r[i] = shift == 0? u[i] : (u[i] >> shift) | (u[i + 1] << (64 - shift));
+  }
+  r[bLen - 1] = u[bLen - 1] >> shift;
+}
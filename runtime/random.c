@@ -12,41 +12,195 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+// A ChaCha20 based CSPRNG, in the style of OpenBSD's arc4random.  Each thread
+// seeds its own keystream from getrandom, and hands out bytes from a large
+// buffer of keystream, so most calls are a memcpy.  After each refill, the key
+// is replaced with the first bytes of the new keystream, and handed out bytes
+// are wiped, so a later compromise of the state does not reveal past output.
+// The child of a fork reseeds before it generates any values.
+
 #include "runtime.h"
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/random.h>
+
+#define RN_CHACHA_KEY_BYTES 32
+#define RN_CHACHA_NONCE_BYTES 8
+#define RN_CHACHA_SEED_BYTES (RN_CHACHA_KEY_BYTES + RN_CHACHA_NONCE_BYTES)
+#define RN_CHACHA_BLOCK_BYTES 64
+// Keystream generated per refill.
+#define RN_RANDOM_BUFFER_SIZE (RN_CHACHA_BLOCK_BYTES * 64)
+// Mix in fresh entropy from the kernel after this many bytes.
+#define RN_RANDOM_RESEED_BYTES (1 << 20)
+
+typedef struct {
+  uint32_t input[16];
+  uint8_t buf[RN_RANDOM_BUFFER_SIZE];
+  // The unused bytes are at the end of buf.
+  uint32_t available;
+  uint64_t bytesUntilReseed;
+  bool seeded;
+} runtime_randomState;
+
+static _Thread_local runtime_randomState runtime_random;
+static pthread_once_t runtime_randomAtforkOnce = PTHREAD_ONCE_INIT;
+
+// Wipe bytes which may hold secrets, in a way the compiler will not elide.
+static inline void wipeBytes(uint8_t *p, uint64_t numBytes) {
+  memset(p, 0, numBytes);
+  __asm__ __volatile__("" : : "r"(p) : "memory");
+}
+
+// Read a little endian uint32_t.
+static inline uint32_t readLittleEndian32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Write a little endian uint32_t.
+static inline void writeLittleEndian32(uint8_t *p, uint32_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+  p[3] = value >> 24;
+}
+
+static inline uint32_t rotl32(uint32_t value, uint32_t dist) {
+  return (value << dist) | (value >> (32 - dist));
+}
+
+#define RN_QUARTER_ROUND(a, b, c, d) \
+  a += b; d = rotl32(d ^ a, 16); \
+  c += d; b = rotl32(b ^ c, 12); \
+  a += b; d = rotl32(d ^ a, 8); \
+  c += d; b = rotl32(b ^ c, 7);
+
+// Set the key and nonce, and zero the block counter.
+static void chachaSetKey(uint32_t *input, const uint8_t *seed) {
+  input[0] = 0x61707865;  // "expand 32-byte k"
+  input[1] = 0x3320646e;
+  input[2] = 0x79622d32;
+  input[3] = 0x6b206574;
+  for (uint32_t i = 0; i < 8; i++) {
+    input[4 + i] = readLittleEndian32(seed + 4 * i);
+  }
+  input[12] = 0;
+  input[13] = 0;
+  input[14] = readLittleEndian32(seed + RN_CHACHA_KEY_BYTES);
+  input[15] = readLittleEndian32(seed + RN_CHACHA_KEY_BYTES + 4);
+}
+
+// Write one block of keystream, and advance the 64-bit block counter.
+static void chachaBlock(uint32_t *input, uint8_t *out) {
+  uint32_t x[16];
+  memcpy(x, input, sizeof(x));
+  for (uint32_t i = 0; i < 10; i++) {
+    RN_QUARTER_ROUND(x[0], x[4], x[8], x[12])
+    RN_QUARTER_ROUND(x[1], x[5], x[9], x[13])
+    RN_QUARTER_ROUND(x[2], x[6], x[10], x[14])
+    RN_QUARTER_ROUND(x[3], x[7], x[11], x[15])
+    RN_QUARTER_ROUND(x[0], x[5], x[10], x[15])
+    RN_QUARTER_ROUND(x[1], x[6], x[11], x[12])
+    RN_QUARTER_ROUND(x[2], x[7], x[8], x[13])
+    RN_QUARTER_ROUND(x[3], x[4], x[9], x[14])
+  }
+  for (uint32_t i = 0; i < 16; i++) {
+    writeLittleEndian32(out + 4 * i, x[i] + input[i]);
+  }
+  wipeBytes((uint8_t*)x, sizeof(x));
+  if (++input[12] == 0) {
+    input[13]++;
+  }
+}
 
-// Read from /dev/urandom.
+// Read |numBytes| of entropy from the kernel.
+static void readKernelEntropy(uint8_t *dest, uint64_t numBytes) {
+  while (numBytes != 0) {
+    ssize_t len = getrandom(dest, numBytes, 0);
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      runtime_panicCstr("Unable to read from getrandom!");
+    }
+    dest += len;
+    numBytes -= len;
+  }
+}
 
-static FILE *deUrandomFile = NULL;
+// Refill the keystream buffer.  XOR |extra| into the first keystream bytes,
+// which then become the new key and nonce.
+static void refillRandomBuffer(runtime_randomState *state, const uint8_t *extra,
+    uint32_t extraLen) {
+  for (uint32_t i = 0; i < RN_RANDOM_BUFFER_SIZE; i += RN_CHACHA_BLOCK_BYTES) {
+    chachaBlock(state->input, state->buf + i);
+  }
+  for (uint32_t i = 0; i < extraLen; i++) {
+    state->buf[i] ^= extra[i];
+  }
+  chachaSetKey(state->input, state->buf);
+  wipeBytes(state->buf, RN_CHACHA_SEED_BYTES);
+  state->available = RN_RANDOM_BUFFER_SIZE - RN_CHACHA_SEED_BYTES;
+}
+
+// After a fork, the child must not repeat the parent's keystream.
+static void reseedAfterFork(void) {
+  runtime_random.seeded = false;
+}
+
+// Register reseedAfterFork once per process.
+static void registerAtfork(void) {
+  if (pthread_atfork(NULL, NULL, reseedAfterFork) != 0) {
+    runtime_panicCstr("Unable to register the random number fork handler!");
+  }
+}
 
-// Open /dev/urandom.
-static inline void openUrandom(void) {
-  if (deUrandomFile == NULL) {
-    deUrandomFile = fopen("/dev/urandom", "r");
-    if (deUrandomFile == NULL) {
-      runtime_panicCstr("Unable to open /dev/urandom!");
+// Seed the keystream from the kernel the first time, and mix in fresh entropy
+// after that.
+static void seedRandomState(runtime_randomState *state) {
+  pthread_once(&runtime_randomAtforkOnce, registerAtfork);
+  uint8_t seed[RN_CHACHA_SEED_BYTES];
+  readKernelEntropy(seed, sizeof(seed));
+  if (!state->seeded) {
+    chachaSetKey(state->input, seed);
+    refillRandomBuffer(state, NULL, 0);
+    state->seeded = true;
+  } else {
+    refillRandomBuffer(state, seed, sizeof(seed));
+  }
+  wipeBytes(seed, sizeof(seed));
+  state->bytesUntilReseed = RN_RANDOM_RESEED_BYTES;
+}
+
+// Generate random bytes.
+void runtime_generateTrueRandomBytes(uint8_t *dest, uint64_t numBytes) {
+  runtime_randomState *state = &runtime_random;
+  if (!state->seeded || state->bytesUntilReseed <= numBytes) {
+    seedRandomState(state);
+  } else {
+    state->bytesUntilReseed -= numBytes;
+  }
+  while (numBytes != 0) {
+    if (state->available == 0) {
+      refillRandomBuffer(state, NULL, 0);
     }
+    uint32_t len = numBytes < state->available? numBytes : state->available;
+    uint8_t *p = state->buf + RN_RANDOM_BUFFER_SIZE - state->available;
+    memcpy(dest, p, len);
+    wipeBytes(p, len);
+    dest += len;
+    numBytes -= len;
+    state->available -= len;
   }
 }
 
 // Generate random bits.
 uint64_t runtime_generateTrueRandomValue(uint32_t width) {
-  openUrandom();
   uint64_t bits;
-  if (fread(&bits, sizeof(bits), 1, deUrandomFile) != 1) {
-    runtime_panicCstr("Unable to read from /dev/urandom!");
-  }
+  runtime_generateTrueRandomBytes((uint8_t*)&bits, sizeof(bits));
   if (width < sizeof(uint64_t) * 8) {
     bits = bits & (((uint64_t)1 << width) - 1);
   }
   return bits;
 }
-
-// Generate a random bigint.
-void runtime_generateTrueRandomBytes(uint8_t *dest, uint64_t numBytes) {
-  openUrandom();
-  if (fread(dest, numBytes, 1, deUrandomFile) != 1) {
-    runtime_panicCstr("Unable to read from /dev/urandom!");
-  }
-}
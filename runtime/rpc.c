@@ -0,0 +1,132 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Decode Sealed Computing RPC messages in place, for request decoders
+// generated by rpcgen.  Scalars are little-endian, of their natural width, and
+// bools are one byte, 0 or 1.  Strings and arrays are a 32-bit little-endian
+// element count followed by the elements.  Structs and tuples are just their
+// fields in order.  Public strings and byte arrays become views into the wire
+// buffer, which has no heap header, like a constant array.  Everything else
+// that needs a buffer is copied to the array heap, and secret data only ever
+// goes to buffers marked secret.
+
+#include "runtime.h"
+
+// Point the decoder at |len| bytes of wire data.
+void runtime_rpcInitDecoder(runtime_rpcDecoder *decoder, const uint8_t *data, size_t len) {
+  decoder->pos = data;
+  decoder->end = data + len;
+}
+
+// Determine if every byte of the message has been decoded.
+bool runtime_rpcFinishDecoder(const runtime_rpcDecoder *decoder) {
+  return decoder->pos == decoder->end;
+}
+
+// Decode a |numBytes| wide integer or float into |dest|, which must be that wide.
+bool runtime_rpcDecodeScalar(runtime_rpcDecoder *decoder, void *dest, size_t numBytes) {
+  if ((size_t)(decoder->end - decoder->pos) < numBytes) {
+    return false;
+  }
+  uint64_t value = 0;
+  for (size_t i = 0; i < numBytes; i++) {
+    value |= (uint64_t)decoder->pos[i] << (i << 3);
+  }
+  decoder->pos += numBytes;
+  switch (numBytes) {
+    case 1: *(uint8_t*)dest = value; break;
+    case 2: *(uint16_t*)dest = value; break;
+    case 4: *(uint32_t*)dest = value; break;
+    case 8: *(uint64_t*)dest = value; break;
+    default:
+      runtime_panicCstr("Invalid scalar width in RPC decoder");
+  }
+  return true;
+}
+
+// Decode a bool, rejecting anything but 0 or 1.
+bool runtime_rpcDecodeBool(runtime_rpcDecoder *decoder, bool *dest) {
+  uint8_t value;
+  if (!runtime_rpcDecodeScalar(decoder, &value, 1) || value > 1) {
+    return false;
+  }
+  *dest = value;
+  return true;
+}
+
+// Decode the element count of a string or array.  Every element takes at least
+// one byte on the wire, so a count larger than the rest of the message is
+// rejected before anything is allocated for it.
+bool runtime_rpcDecodeLength(runtime_rpcDecoder *decoder, uint64_t *len) {
+  uint32_t value;
+  if (!runtime_rpcDecodeScalar(decoder, &value, sizeof(uint32_t)) ||
+      value > (size_t)(decoder->end - decoder->pos)) {
+    return false;
+  }
+  *len = value;
+  return true;
+}
+
+// Make |view| refer to the next |len| bytes of the message without copying.
+// Like runtime_viewArraySlice, the view must only be read, must not be freed,
+// and must not be used after the wire buffer is released.
+bool runtime_rpcViewBytes(runtime_rpcDecoder *decoder, runtime_array *view, uint64_t len) {
+  if ((uint64_t)(decoder->end - decoder->pos) < len) {
+    return false;
+  }
+  if (len == 0) {
+    *view = runtime_makeEmptyArray();
+    return true;
+  }
+  view->data = (size_t*)decoder->pos;
+  view->numElements = len;
+  decoder->pos += len;
+  return true;
+}
+
+// Allocate |array| for |len| elements, marking it secret if it will hold
+// secret data.  |array| must be empty.
+void runtime_rpcAllocArray(runtime_array *array, uint64_t len, size_t elementSize,
+    bool hasSubArrays, bool secret) {
+  if (len == 0) {
+    return;
+  }
+  runtime_allocArray(array, len, elementSize, hasSubArrays);
+  if (secret) {
+    runtime_markSecretArray(array, false);
+  }
+}
+
+// Copy |len| scalars of |elementBytes| each from the message into a new heap
+// array.  Single bytes are copied directly.
+bool runtime_rpcCopyScalars(runtime_rpcDecoder *decoder, runtime_array *dest, uint64_t len,
+    size_t elementBytes, bool secret) {
+  if ((uint64_t)(decoder->end - decoder->pos) / elementBytes < len) {
+    return false;
+  }
+  runtime_rpcAllocArray(dest, len, elementBytes, false, secret);
+  if (elementBytes == 1) {
+    if (len != 0) {
+      runtime_memcopy(dest->data, decoder->pos, len);
+      decoder->pos += len;
+    }
+    return true;
+  }
+  uint8_t *p = (uint8_t*)dest->data;
+  for (uint64_t i = 0; i < len; i++) {
+    runtime_rpcDecodeScalar(decoder, p, elementBytes);
+    p += elementBytes;
+  }
+  return true;
+}
@@ -15,5 +15,5 @@
 // Define global that normally are linked into the rune output .o file.
 #include "runtime.h"
 
-struct ExceptionStruct runtimeException;
-struct jmpbuf_wrapped *runtime_firstSetjmpBuffer;
+_Thread_local struct ExceptionStruct runtimeException;
+_Thread_local struct jmpbuf_wrapped *runtime_firstSetjmpBuffer;
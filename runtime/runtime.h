@@ -21,6 +21,7 @@
 // callable from Rune, since they are declared as extern "C" in package.rn.
 
 #include <setjmp.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -80,10 +81,28 @@ typedef struct {
                    // initialized.
 #endif
   bool hasSubArrays: 1;
-  size_t allocatedWords : sizeof(size_t) * 8 - 1;
+  bool reserved: 1;  // The buffer has its own mapping, e.g. from runtime_reserveArray.
+  bool secret: 1;  // The buffer is wiped when freed or moved.
+  size_t allocatedWords : sizeof(size_t) * 8 - 3;
   runtime_array *backPointer;
 } runtime_heapHeader;
 
+// Array buffers of up to 1 << (RN_POOL_NUM_CLASSES - 1) words are allocated
+// from power-of-two size-class pools.
+#define RN_POOL_NUM_CLASSES 8u
+
+// Counters describing array heap usage, returned by runtime_getArrayHeapStats.
+// Byte counts include heap headers.
+typedef struct {
+  uint64_t poolAllocations[RN_POOL_NUM_CLASSES];  // Allocations per size class.
+  uint64_t poolLiveBuffers[RN_POOL_NUM_CLASSES];  // Buffers in use per size class.
+  uint64_t largeAllocations;  // Allocations too large to be pooled.
+  uint64_t liveBytes;  // Bytes currently allocated to arrays.
+  uint64_t maxLiveBytes;  // High-water mark of liveBytes.
+  uint64_t compactions;  // Calls to runtime_compactArrayHeap.
+  uint64_t reservedBytes;  // Address space mapped for reserved buffers.
+} runtime_arrayHeapStats;
+
 static inline runtime_array runtime_makeEmptyArray(void) {
   runtime_array array = {NULL, 0};
   return array;
@@ -101,12 +120,25 @@ void runtime_allocArray(runtime_array *array, size_t numElements, size_t element
 void runtime_arrayInitCstr(runtime_array *array, const char *text);
 void runtime_resizeArray(runtime_array *array, uint64_t numElements, size_t elementSize,
     bool hasSubArrays);
+void runtime_resizeArrayKeepBuffer(runtime_array *array, size_t numElements, size_t elementSize,
+    bool hasSubArrays);
+void runtime_reserveArray(runtime_array *array, uint64_t numElements, size_t elementSize,
+    bool hasSubArrays);
+bool runtime_mapFileArray(runtime_array *array, int fd, size_t numBytes);
+bool runtime_mapFileArrayAt(runtime_array *array, int fd, uint64_t offset, size_t numElements,
+    size_t elementSize);
 void runtime_copyArray(runtime_array *dest, runtime_array *source, size_t elementSize,
     bool hasSubArrays);
 void runtime_moveArray(runtime_array *dest, runtime_array *source);
+void stringBuilderAppend(runtime_array *chunks, runtime_array *current, const runtime_array *text,
+    uint64_t chunkSize);
+void stringBuilderToString(runtime_array *string, const runtime_array *chunks,
+    const runtime_array *current);
 void runtime_sliceArray(runtime_array *dest, runtime_array *source, uint64_t lower,
     uint64_t upper, size_t elementSize, bool hasSubArrays);
 void runtime_freeArray(runtime_array *array);
+void runtime_freeSecretArray(runtime_array *array);
+void runtime_markSecretArray(runtime_array *array, bool markSubArrays);
 void runtime_foreachArrayObject(runtime_array *array, void *callback, uint32_t refWidth,
     uint32_t depth);
 void runtime_updateArrayBackPointer(runtime_array *array);
@@ -115,12 +147,19 @@ void runtime_appendArrayElement(runtime_array *array, uint8_t *data, size_t elem
     bool isArray, bool hasSubArrays);
 void runtime_concatArrays(runtime_array *dest, runtime_array *source, size_t elementSize,
     bool hasSubArrays);
+void runtime_joinArrays(runtime_array *dest, runtime_array *left, runtime_array *right,
+    size_t elementSize);
+void runtime_viewArraySlice(runtime_array *view, runtime_array *source, size_t lower,
+    size_t upper, size_t elementSize);
 void runtime_xorStrings(runtime_array *dest, runtime_array *a, runtime_array *b);
 void runtime_reverseArray(runtime_array *array, size_t elementSize, bool hasSubArrays);
 bool runtime_compareArrays(runtime_comparisonType compareType, runtime_type elementType,
     const runtime_array *a, const runtime_array *b, size_t elementSize,
     bool hasSubArrays, bool secret);
+bool runtime_arraysEqual(const runtime_array *a, const runtime_array *b, size_t elementSize,
+    bool secret);
 void runtime_memcopy(void *dest, const void *source, size_t len);
+void runtime_getArrayHeapStats(runtime_arrayHeapStats *stats);
 // For debugging.
 void runtime_printBigint(runtime_array *val);
 void runtime_printHexBigint(runtime_array *val);
@@ -137,15 +176,20 @@ void writeByte(uint8_t c);
 void readBytes(runtime_array *array, uint64_t numBytes);
 void writeBytes(const runtime_array *array, uint64_t numBytes, uint64_t offset);
 void readln(runtime_array *array, uint64_t maxBytes);
+bool readlnInto(runtime_array *line, uint64_t maxBytes);
 void io_getcwd(runtime_array *array);
 void io_getenv(runtime_array *value, const runtime_array *name);
 uint64_t io_file_fopenInternal(runtime_array *fileName, runtime_array *mode);
 bool io_file_fcloseInternal(uint64_t ptr);
 uint64_t io_file_freadInternal(uint64_t ptr, runtime_array *buf);
+bool io_file_mmapInternal(uint64_t ptr, runtime_array *buf);
+bool io_file_readlnInternal(uint64_t ptr, runtime_array *line);
 bool io_file_fwriteInternal(uint64_t ptr, runtime_array *buf);
 bool io_file_ferrorInternal(uint64_t ptr);
 void runtime_puts(const runtime_array *string);
 void runtime_putsCstr(const char *string);
+void runtime_putInteger(uint64_t value, uint32_t width, bool isSigned);
+void runtime_flushStdout(void);
 void runtime_sprintf(runtime_array *array, const runtime_array *format, ...);
 void runtime_printf(const char *format, ...);
 void runtime_vsprintf(runtime_array *array, const runtime_array *format, va_list ap);
@@ -162,9 +206,20 @@ void runtime_nativeIntToString(runtime_array *string, uint64_t value, uint32_t b
 void runtime_bigintToString(runtime_array *string, runtime_array *bigint, uint32_t base);
 void runtime_stringToHex(runtime_array *destHexString, const runtime_array *sourceBinString);
 void runtime_hexToString(runtime_array *destBinString, const runtime_array *sourceHexString);
+void runtime_stringToBase64(runtime_array *destBase64String,
+    const runtime_array *sourceBinString, bool urlSafe);
+void runtime_base64ToString(runtime_array *destBinString,
+    const runtime_array *sourceBase64String, bool urlSafe);
 uint64_t runtime_stringFind(const runtime_array *haystack, const runtime_array *needle, uint64_t offset);
 uint64_t runtime_stringRfind(const runtime_array *haystack, const runtime_array *needle, uint64_t offset);
 
+// Floating point to string conversion.
+#define RN_MAX_DOUBLE_DIGITS 17
+uint32_t runtime_findShortestDigits(uint8_t *digits, int32_t *decimalExponent, double value,
+    bool isFloat);
+void runtime_f32tostring(runtime_array *dest, float value);
+void runtime_f64tostring(runtime_array *dest, double value);
+
 // Operating system function wrappers.
 int32_t os_system(runtime_array *command);
 
@@ -173,14 +228,120 @@ int32_t os_system(runtime_array *command);
 uint64_t runtime_generateTrueRandomValue(uint32_t width);
 void runtime_generateTrueRandomBytes(uint8_t *dest, uint64_t numBytes);
 
+// Symmetric crypto primitives, in crypto.c.
+void runtime_sha256(runtime_array *digest, const runtime_array *message);
+void runtime_sha3_256(runtime_array *digest, const runtime_array *message);
+void runtime_aesGcmEncrypt(runtime_array *ciphertext, const runtime_array *key,
+    const runtime_array *nonce, const runtime_array *plaintext,
+    const runtime_array *associatedData);
+bool runtime_aesGcmDecrypt(runtime_array *plaintext, const runtime_array *key,
+    const runtime_array *nonce, const runtime_array *ciphertext,
+    const runtime_array *associatedData);
+void runtime_chacha20Poly1305Encrypt(runtime_array *ciphertext, const runtime_array *key,
+    const runtime_array *nonce, const runtime_array *plaintext,
+    const runtime_array *associatedData);
+bool runtime_chacha20Poly1305Decrypt(runtime_array *plaintext, const runtime_array *key,
+    const runtime_array *nonce, const runtime_array *ciphertext,
+    const runtime_array *associatedData);
+bool runtime_setCryptoHardwareEnabled(bool enabled);
+
+// Parallel for statements, in parallel.c.  The body runs iterations [first, last).
+typedef void (*runtime_parallelBody)(void *context, uint64_t first, uint64_t last);
+void runtime_parallelFor(runtime_parallelBody body, void *context, uint64_t numIterations);
+void runtime_parallelForObjects(runtime_parallelBody body, void *context,
+    const runtime_array *nextFree, size_t refBytes, uint64_t used, uint64_t firstFree);
+// Determine if the calling thread is running a parallel for body.
+bool runtime_inParallelBody(void);
+// Set when the thread pool starts, after which the array heap is shared by threads.
+extern bool runtime_multiThreaded;
+
+// In-place RPC decoding for generated request decoders, in rpc.c.
+typedef struct {
+  const uint8_t *pos;
+  const uint8_t *end;
+} runtime_rpcDecoder;
+void runtime_rpcInitDecoder(runtime_rpcDecoder *decoder, const uint8_t *data, size_t len);
+bool runtime_rpcFinishDecoder(const runtime_rpcDecoder *decoder);
+bool runtime_rpcDecodeScalar(runtime_rpcDecoder *decoder, void *dest, size_t numBytes);
+bool runtime_rpcDecodeBool(runtime_rpcDecoder *decoder, bool *dest);
+bool runtime_rpcDecodeLength(runtime_rpcDecoder *decoder, uint64_t *len);
+bool runtime_rpcViewBytes(runtime_rpcDecoder *decoder, runtime_array *view, uint64_t len);
+void runtime_rpcAllocArray(runtime_array *array, uint64_t len, size_t elementSize,
+    bool hasSubArrays, bool secret);
+bool runtime_rpcCopyScalars(runtime_rpcDecoder *decoder, runtime_array *dest, uint64_t len,
+    size_t elementBytes, bool secret);
+
+// String hashing, in hash.c.
+uint64_t runtime_hashBytes(const uint8_t *p, uint64_t len, uint64_t seed);
+uint64_t hashStringBytes(const runtime_array *string, uint64_t seed);
+
+// Array sorting, in sort.c.
+void sortU8Array(runtime_array *array);
+void sortU16Array(runtime_array *array);
+void sortU32Array(runtime_array *array);
+void sortU64Array(runtime_array *array);
+void sortI8Array(runtime_array *array);
+void sortI16Array(runtime_array *array);
+void sortI32Array(runtime_array *array);
+void sortI64Array(runtime_array *array);
+void sortF32Array(runtime_array *array);
+void sortF64Array(runtime_array *array);
+void sortStringArray(runtime_array *array);
+void sortU64Pairs(runtime_array *keys, runtime_array *values);
+void sortF64Pairs(runtime_array *keys, runtime_array *values);
+void sortStringPairs(runtime_array *keys, runtime_array *values);
+
+// Field access profiling, enabled by rune -profile.
+void runtime_startFieldProfile(const char *names, uint64_t *counts, uint32_t numFields,
+    void (*recordObjectCounts)(void));
+// Call, loop, and runtime overhead counters, enabled by rune -instrument.
+void runtime_startInstrumentation(const char *names, uint64_t **counters, uint32_t numCounters);
+
+// Class database snapshots.  The compiler emits the table of entries.
+typedef struct {
+  void *address;  // A runtime_array for arrays, else the scalar itself.
+  uint64_t elementSize;
+  uint32_t kind;
+} runtime_snapshotEntry;
+void runtime_registerSnapshot(runtime_snapshotEntry *entries, uint32_t numEntries,
+    uint64_t layoutHash);
+bool saveSnapshot(const runtime_array *fileName);
+bool loadSnapshot(const runtime_array *fileName);
+
+// Memory stats, in memstats.c.  The compiler registers a table of every class's
+// object counters, which are refWidth bits wide, and global data member arrays.
+typedef struct {
+  const runtime_array *nextFree;
+  const void *allocated;
+  const void *used;
+  const void *firstFree;
+  uint32_t refWidth;
+  uint32_t numArrays;  // How many of the table's arrays belong to this class.
+} runtime_classStatsEntry;
+void runtime_registerClassStats(const runtime_classStatsEntry *classes, uint32_t numClasses,
+    const runtime_array **arrays, const char *names);
+void runtime_startMemoryStats(void);
+void runtime_noteAllocation(uint64_t numBytes);
+void memoryStats(runtime_array *report);
+bool writeMemoryStats(const runtime_array *fileName);
+void sampleAllocations(uint64_t sampleBytes);
+// Code compiled with rune -heapprofile stores the line each statement starts
+// at here, so sampled allocations are charged to it.
+extern _Thread_local const runtime_array *runtime_allocFile;
+extern _Thread_local uint32_t runtime_allocLine;
+// Allocations are sampled once per this many bytes, if it is not 0.
+extern uint64_t runtime_allocSampleBytes;
+// Set by SIGUSR1 to write memory stats on the next array allocation.
+extern volatile sig_atomic_t runtime_memoryStatsRequested;
+
 // Small integer exponentiation, with overflow checking.
 
-// Zero memory securely.
+// Zero memory securely.  The empty asm statement tells the compiler the memory
+// may still be read, so it cannot drop the memset as a dead store, while the
+// memset itself stays vectorized.
 static inline void runtime_zeroMemory(uint64_t *p, uint64_t numWords) {
-  volatile uint64_t *q = p;
-  while (numWords--) {
-    *q++ = 0;
-  }
+  memset(p, 0, numWords * sizeof(uint64_t));
+  __asm__ __volatile__("" : : "r"(p) : "memory");
 }
 
 // Copy memory by uint64_t sized words. |src| and |dest| may overlap, as long as |src| < |dest|.
@@ -223,6 +384,15 @@ static inline size_t runtime_addCheckForOverflow(size_t a, size_t b) {
 // Constant-time Boolean type based on cttk_book.
 typedef cttk_bool runtime_bool;
 
+// Constant-time helpers are never inlined, even when -inlineruntime links the
+// runtime's bitcode into the program.
+#define RN_CONSTANT_TIME __attribute__((noinline))
+
+// Hide a secret value from the optimizer by passing it through an empty asm
+// statement, so it cannot learn that a mask is all zeros or all ones and turn
+// the masking into a branch.
+#define RN_VALUE_BARRIER(value) __asm__("" : "+r"(value))
+
 // Constant time bigints, currently based on CTTK.  When Rune is rewritten in
 // Rune, we should build a constant time CTTK-like constant-time bigint library
 // in Rune.  It should use 32/64 bit arithmetic, and get access to the carry bit
@@ -239,14 +409,20 @@ uint32_t runtime_bigintWidth(const runtime_array *bigint);
 bool runtime_bigintSigned(const runtime_array *bigint);
 bool runtime_bigintSecret(const runtime_array *bigint);
 void runtime_bigintSetSecret(runtime_array *bigint, bool value);
-runtime_bool runtime_bigintZero(const runtime_array *a);
-runtime_bool runtime_bigintNegative(const runtime_array *a);
+// Free the calling thread's temporary bigints.  Called by runtime_arrayStop.
+void runtime_freeTempBigints(void);
+RN_CONSTANT_TIME runtime_bool runtime_bigintZero(const runtime_array *a);
+RN_CONSTANT_TIME runtime_bool runtime_bigintNegative(const runtime_array *a);
 void runtime_bigintCast(runtime_array *dest, runtime_array *source, uint32_t newWidth,
     bool isSigned, bool isSecret, bool truncate);
 void runtime_bigintSet(runtime_array *dest, runtime_array *source);
 void runtime_integerToBigint(runtime_array *dest, uint64_t value, uint32_t width, bool isSigned, bool secret);
 uint64_t runtime_bigintToInteger(const runtime_array *source);
 uint64_t runtime_bigintToIntegerTrunc(const runtime_array *source);
+void runtime_nativeIntToBigint(runtime_array *dest, const uint64_t *words, uint32_t width,
+    bool isSigned, bool secret);
+void runtime_bigintToNativeInt(uint64_t *words, runtime_array *source, uint32_t width,
+    bool isSigned, bool truncate);
 void runtime_bigintDecodeLittleEndian(runtime_array *dest, runtime_array *byteArray,
     uint32_t width, bool isSigned, bool secret);
 void runtime_bigintDecodeBigEndian(runtime_array *dest, runtime_array *byteArray,
@@ -276,6 +452,18 @@ void runtime_bigintBitwiseAnd(runtime_array *dest, runtime_array *a, runtime_arr
 void runtime_bigintBitwiseOr(runtime_array *dest, runtime_array *a, runtime_array *b);
 void runtime_bigintBitwiseXor(runtime_array *dest, runtime_array *a, runtime_array *b);
 void runtime_bigintDivRem(runtime_array *q, runtime_array *r, runtime_array *a, runtime_array *b);
+// Variable time versions for public bigints, selected when the type is not secret.
+void runtime_publicBigintMul(runtime_array *dest, runtime_array *a, runtime_array *b);
+void runtime_publicBigintMulTrunc(runtime_array *dest, runtime_array *a, runtime_array *b);
+void runtime_publicBigintDiv(runtime_array *dest, runtime_array *a, runtime_array *b);
+void runtime_publicBigintMod(runtime_array *dest, runtime_array *a, runtime_array *b);
+void runtime_publicBigintDivRem(runtime_array *q, runtime_array *r, runtime_array *a, runtime_array *b);
+// The public bigint engine in pubbigint.c, on little-endian 64-bit limbs.
+uint64_t runtime_limbsMulScratchSize(uint32_t aLen, uint32_t bLen);
+void runtime_limbsMul(uint64_t *r, const uint64_t *a, uint32_t aLen,
+    const uint64_t *b, uint32_t bLen, uint64_t *scratch);
+void runtime_limbsDivRem(uint64_t *q, uint64_t *r, const uint64_t *a, uint32_t aLen,
+    const uint64_t *b, uint32_t bLen, uint64_t *scratch);
 // Modular operations on bigints.
 void runtime_bigintModularAdd(runtime_array *dest, runtime_array *a, runtime_array *b, runtime_array *modulus);
 void runtime_bigintModularSub(runtime_array *dest, runtime_array *a, runtime_array *b, runtime_array *modulus);
@@ -296,8 +484,8 @@ uint64_t runtime_smallnumModReduce(uint64_t value, uint64_t modulus, bool isSign
 uint64_t runtime_smallnumExp(uint64_t base, uint32_t exponent, bool isSigned, bool secret);
 
 // Small integer modular operations.
-uint64_t runtime_smallnumModularAdd(uint64_t a, uint64_t b, uint64_t modulus, bool secret);
-uint64_t runtime_smallnumModularSub(uint64_t a, uint64_t b, uint64_t modulus, bool secret);
+RN_CONSTANT_TIME uint64_t runtime_smallnumModularAdd(uint64_t a, uint64_t b, uint64_t modulus, bool secret);
+RN_CONSTANT_TIME uint64_t runtime_smallnumModularSub(uint64_t a, uint64_t b, uint64_t modulus, bool secret);
 uint64_t runtime_smallnumModularMul(uint64_t a, uint64_t b, uint64_t modulus, bool secret);
 uint64_t runtime_smallnumModularDiv(uint64_t a, uint64_t b, uint64_t modulus, bool secret);
 uint64_t runtime_smallnumModularExp(uint64_t base, uint64_t exponent, uint64_t modulus, bool secret);
@@ -306,24 +494,34 @@ uint64_t runtime_smallnumModularNegate(uint64_t a, uint64_t modulus, bool secret
 // runtime_bool API, for secret Boolean values.
 runtime_bool runtime_boolToRnBool(bool a);
 bool runtime_rnBoolToBool(runtime_bool a);
-runtime_bool runtime_boolAnd(runtime_bool a, runtime_bool b);
-runtime_bool runtime_boolOr(runtime_bool a, runtime_bool b);
+RN_CONSTANT_TIME runtime_bool runtime_boolAnd(runtime_bool a, runtime_bool b);
+RN_CONSTANT_TIME runtime_bool runtime_boolOr(runtime_bool a, runtime_bool b);
 void runtime_bigintXor(runtime_array *dest, runtime_array *a, runtime_array *b);
-runtime_bool runtime_boolNot(runtime_bool a);
-uint64_t runtime_selectUint32(runtime_bool select, uint64_t data1, uint64_t data0);
-void runtime_bigintCondCopy(runtime_bool doCopy, runtime_array *dest, const runtime_array *source);
+RN_CONSTANT_TIME runtime_bool runtime_boolNot(runtime_bool a);
+RN_CONSTANT_TIME uint64_t runtime_selectUint32(runtime_bool select, uint64_t data1, uint64_t data0);
+RN_CONSTANT_TIME void runtime_bigintCondCopy(runtime_bool doCopy, runtime_array *dest, const runtime_array *source);
 
+// Exception state is per-thread, so each thread of a parallel for statement
+// raises its own exceptions.
 // Used in Linux for testing purposes.
 #define runtime_setJmp() (runtime_jmpBufSet = true, setjmp(runtime_jmpBuf))
-extern jmp_buf runtime_jmpBuf;
-extern bool runtime_jmpBufSet;
+extern _Thread_local jmp_buf runtime_jmpBuf;
+extern _Thread_local bool runtime_jmpBufSet;
 
 // Used for exception handling.
 struct jmpbuf_wrapped {
   jmp_buf buf;
   struct jmpbuf_wrapped *wrapped_buf;
 };
-extern struct jmpbuf_wrapped *runtime_firstSetjmpBuffer;
+extern _Thread_local struct jmpbuf_wrapped *runtime_firstSetjmpBuffer;
+// Set when the program was compiled with -unwind, so try statements are
+// entered by unwinding the stack to their landing pads.
+extern bool runtime_unwindExceptions;
+// Set when the program was compiled with -nativeints, so integers of up to
+// runtime_maxNativeWideIntWidth bits in arrays and tuples are LLVM integers,
+// not bigints.
+extern bool runtime_nativeWideInts;
+#define runtime_maxNativeWideIntWidth 512
 
 // Declare the type of runtimeException so we can fill it out.
 struct ExceptionStruct {
@@ -334,6 +532,6 @@ struct ExceptionStruct {
   uint32_t line;
 };
 
-extern struct ExceptionStruct runtimeException;
+extern _Thread_local struct ExceptionStruct runtimeException;
 
 #endif  // EXPERIMENTAL_WAYWARDGEEK_RUNE_RUNTIME_RUNE_RUNTIME_H_
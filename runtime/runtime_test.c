@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+// For mkstemp under -std=c11.
+#define _DEFAULT_SOURCE
 #include "runtime.h"
 
 #include <mcheck.h>
@@ -20,6 +22,7 @@
 #include <string.h>
 #include <assert.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #define RN_HEAP_SIZE (1u << 15)
 
@@ -118,6 +121,330 @@ static void testCompareArrays(void) {
   runtime_freeArray(&d);
 }
 
+// Test runtime_compareArrays and runtime_arraysEqual on long arrays, differing
+// at every position, with and without the secret kernels.
+static void testCompareLongArrays(void) {
+  runtime_array a = runtime_makeEmptyArray();
+  runtime_array b = runtime_makeEmptyArray();
+  runtime_allocArray(&a, 100, sizeof(uint16_t), false);
+  runtime_allocArray(&b, 100, sizeof(uint16_t), false);
+  uint16_t *aData = (uint16_t*)a.data;
+  uint16_t *bData = (uint16_t*)b.data;
+  for (uint32_t i = 0; i < 100; i++) {
+    aData[i] = bData[i] = i * 7919;
+  }
+  for (uint32_t secret = 0; secret < 2; secret++) {
+    assert(runtime_arraysEqual(&a, &b, sizeof(uint16_t), secret));
+    assert(runtime_compareArrays(RN_GE, RN_INT, &a, &b, sizeof(uint16_t), false, secret));
+    for (uint32_t i = 0; i < 100; i++) {
+      // -1 is less than 1 as a signed integer, but greater when unsigned.
+      aData[i] = 0xffff;
+      bData[i] = 1;
+      assert(!runtime_arraysEqual(&a, &b, sizeof(uint16_t), secret));
+      assert(runtime_compareArrays(RN_NOTEQUAL, RN_UINT, &a, &b, sizeof(uint16_t), false, secret));
+      assert(runtime_compareArrays(RN_GT, RN_UINT, &a, &b, sizeof(uint16_t), false, secret));
+      assert(runtime_compareArrays(RN_LT, RN_INT, &a, &b, sizeof(uint16_t), false, secret));
+      aData[i] = bData[i] = i * 7919;
+    }
+  }
+  b.numElements = 99;
+  assert(!runtime_arraysEqual(&a, &b, sizeof(uint16_t), true));
+  assert(runtime_compareArrays(RN_GT, RN_UINT, &a, &b, sizeof(uint16_t), false, true));
+  assert(runtime_compareArrays(RN_LT, RN_UINT, &b, &a, sizeof(uint16_t), false, false));
+  b.numElements = 100;
+  runtime_freeArray(&a);
+  runtime_freeArray(&b);
+}
+
+// Test that small arrays are pooled, and that heap statistics are tracked.
+static void testArrayHeapStats(void) {
+  runtime_arrayHeapStats before, after;
+  runtime_getArrayHeapStats(&before);
+  runtime_array a = runtime_makeEmptyArray();
+  runtime_allocArray(&a, 3, 1, false);
+  size_t *data = a.data;
+  runtime_getArrayHeapStats(&after);
+  assert(after.poolAllocations[0] == before.poolAllocations[0] + 1);
+  assert(after.poolLiveBuffers[0] == before.poolLiveBuffers[0] + 1);
+  assert(after.liveBytes > before.liveBytes);
+  assert(after.maxLiveBytes >= after.liveBytes);
+  runtime_freeArray(&a);
+  runtime_getArrayHeapStats(&after);
+  assert(after.poolLiveBuffers[0] == before.poolLiveBuffers[0]);
+  // The freed buffer should be reused for the next array in its class.
+  runtime_allocArray(&a, 5, 1, false);
+  assert(a.data == data);
+  assert(*(uint8_t*)a.data == 0);
+  runtime_freeArray(&a);
+  runtime_allocArray(&a, 1 << 16, 1, false);
+  runtime_getArrayHeapStats(&after);
+  assert(after.largeAllocations == before.largeAllocations + 1);
+  runtime_freeArray(&a);
+  runtime_getArrayHeapStats(&after);
+  assert(after.liveBytes == before.liveBytes);
+}
+
+// Test joining two arrays into a new one, as string concatenation does.
+static void testJoinArrays(void) {
+  runtime_array a = runtime_makeEmptyArray();
+  runtime_array b = runtime_makeEmptyArray();
+  runtime_array c = runtime_makeEmptyArray();
+  runtime_arrayInitCstr(&a, "Hello, ");
+  runtime_arrayInitCstr(&b, "World!");
+  runtime_arrayHeapStats before, after;
+  runtime_getArrayHeapStats(&before);
+  runtime_joinArrays(&c, &a, &b, sizeof(uint8_t));
+  runtime_getArrayHeapStats(&after);
+  // The 13 bytes fit in the 2 word size class, and are allocated just once.
+  assert(after.poolAllocations[1] == before.poolAllocations[1] + 1);
+  assert(after.poolAllocations[0] == before.poolAllocations[0]);
+  assert(c.numElements == 13);
+  assert(!memcmp(c.data, "Hello, World!", 13));
+  // Joining with an empty array copies the other one.
+  runtime_freeArray(&b);
+  runtime_joinArrays(&c, &b, &a, sizeof(uint8_t));
+  assert(c.numElements == 7);
+  assert(!memcmp(c.data, "Hello, ", 7));
+  runtime_joinArrays(&c, &b, &b, sizeof(uint8_t));
+  assert(c.numElements == 0);
+  runtime_freeArray(&a);
+}
+
+// Test the memory stats of a class with 4 allocated objects, 2 of which are on
+// the free list, and a string data member, and sampling allocations.
+static void testMemoryStats(void) {
+  uint32_t allocated = 8, used = 5, firstFree = 3;
+  runtime_array nextFree = runtime_makeEmptyArray();
+  runtime_array names = runtime_makeEmptyArray();
+  runtime_allocArray(&nextFree, 8, sizeof(uint32_t), false);
+  runtime_allocArray(&names, 8, sizeof(runtime_array), true);
+  ((uint32_t*)nextFree.data)[3] = 1;
+  runtime_arrayInitCstr((runtime_array*)names.data + 2, "hello");
+  runtime_classStatsEntry entry = {&nextFree, &allocated, &used, &firstFree, 32, 2};
+  const runtime_array *arrays[] = {&nextFree, &names};
+  runtime_registerClassStats(&entry, 1, arrays, "Node\nNode_nextFree\nNode_name\n");
+  runtime_array report = runtime_makeEmptyArray();
+  memoryStats(&report);
+  runtime_array expected = runtime_makeEmptyArray();
+  // Each buffer has a header: 4 words of links, 16 of strings, and 1 for "hello".
+  uint64_t headerBytes = sizeof(runtime_heapHeader);
+  char text[256];
+  snprintf(text, sizeof(text), "{\"classes\": [{\"name\": \"Node\", \"liveObjects\": 2, "
+      "\"allocatedSlots\": 8, \"arrays\": [{\"name\": \"Node_nextFree\", \"bytes\": %llu}, "
+      "{\"name\": \"Node_name\", \"bytes\": %llu}]",
+      (unsigned long long)(headerBytes + 32), (unsigned long long)(2 * headerBytes + 136));
+  runtime_arrayInitCstr(&expected, text);
+  assert(runtime_stringFind(&report, &expected, 0) == 0);
+  runtime_arrayInitCstr(&expected, "\"sizeClasses\": [{\"words\": 1, ");
+  assert(runtime_stringFind(&report, &expected, 0) != report.numElements);
+  // Every 64 bytes allocated, a sample is taken.  This line is not known.
+  sampleAllocations(64);
+  runtime_array a = runtime_makeEmptyArray();
+  runtime_allocArray(&a, 128, 1, false);
+  memoryStats(&report);
+  sampleAllocations(0);
+  runtime_arrayInitCstr(&expected, "\"allocationSites\": [{\"file\": \"\", \"line\": 0, \"samples\": ");
+  assert(runtime_stringFind(&report, &expected, 0) != report.numElements);
+  runtime_registerClassStats(NULL, 0, NULL, NULL);
+  runtime_freeArray(&a);
+  runtime_freeArray(&report);
+  runtime_freeArray(&expected);
+  runtime_freeArray(&names);
+  runtime_freeArray(&nextFree);
+}
+
+// Test that slice views compare like copied slices without allocating.
+static void testViewArraySlice(void) {
+  runtime_array a = runtime_makeEmptyArray();
+  runtime_array b = runtime_makeEmptyArray();
+  runtime_arrayInitCstr(&a, "testing");
+  runtime_arrayInitCstr(&b, "ting");
+  runtime_array view;
+  runtime_arrayHeapStats before, after;
+  runtime_getArrayHeapStats(&before);
+  runtime_viewArraySlice(&view, &a, 3, 7, sizeof(uint8_t));
+  runtime_getArrayHeapStats(&after);
+  assert(!memcmp(&before, &after, sizeof(before)));
+  assert(view.numElements == 4);
+  assert(runtime_compareArrays(RN_EQUAL, RN_UINT, &view, &b, 1, false, false));
+  runtime_viewArraySlice(&view, &a, 0, 4, sizeof(uint8_t));
+  assert(runtime_compareArrays(RN_LT, RN_UINT, &view, &b, 1, false, false));
+  runtime_viewArraySlice(&view, &a, 2, 2, sizeof(uint8_t));
+  assert(view.numElements == 0 && view.data == NULL);
+  runtime_freeArray(&a);
+  runtime_freeArray(&b);
+}
+
+// Test appending elements one at a time, which moves the array through the size classes.
+static void testAppendArrayElement(void) {
+  runtime_array a = runtime_makeEmptyArray();
+  for (uint32_t i = 0; i < 4096; i++) {
+    uint8_t c = i;
+    runtime_appendArrayElement(&a, &c, sizeof(uint8_t), false, false);
+    assert(runtime_getArrayHeader(&a)->backPointer == &a);
+  }
+  for (uint32_t i = 0; i < 4096; i++) {
+    assert(((uint8_t*)a.data)[i] == (uint8_t)i);
+  }
+  runtime_resizeArray(&a, 3, sizeof(uint8_t), false);
+  runtime_resizeArray(&a, 8, sizeof(uint8_t), false);
+  assert(((uint8_t*)a.data)[2] == 2 && ((uint8_t*)a.data)[3] == 0);
+  runtime_freeArray(&a);
+  // Elements that do not divide the buffer evenly must not overrun it.
+  for (uint32_t i = 0; i < 1000; i++) {
+    uint8_t element[3] = {i, i >> 8, 0x5a};
+    runtime_appendArrayElement(&a, element, sizeof(element), false, false);
+    assert(runtime_getArrayHeader(&a)->allocatedWords * sizeof(size_t) >= a.numElements * 3);
+  }
+  for (uint32_t i = 0; i < 1000; i++) {
+    uint8_t *element = (uint8_t*)a.data + 3 * i;
+    assert(element[0] == (uint8_t)i && element[1] == (uint8_t)(i >> 8) && element[2] == 0x5a);
+  }
+  runtime_freeArray(&a);
+}
+
+// Test that compacting the heap moves large arrays and their sub-arrays.
+static void testCompactArrayHeap(void) {
+  runtime_array hole = runtime_makeEmptyArray();
+  runtime_array a = runtime_makeEmptyArray();
+  runtime_array b = runtime_makeEmptyArray();
+  runtime_allocArray(&hole, 4096, 8, false);
+  runtime_allocArray(&a, 4096, 8, false);
+  runtime_allocArray(&b, 512, sizeof(runtime_array), true);
+  for (uint32_t i = 0; i < 4096; i++) {
+    a.data[i] = i;
+  }
+  runtime_array *subArrays = (runtime_array*)b.data;
+  for (uint32_t i = 0; i < 512; i++) {
+    runtime_allocArray(subArrays + i, 256 + i, 8, false);
+    subArrays[i].data[0] = i;
+  }
+  size_t *oldData = a.data;
+  runtime_freeArray(&hole);
+  runtime_compactArrayHeap();
+  assert(a.data != oldData);
+  assert(runtime_getArrayHeader(&a)->backPointer == &a);
+  for (uint32_t i = 0; i < 4096; i++) {
+    assert(a.data[i] == i);
+  }
+  assert(runtime_getArrayHeader(&b)->backPointer == &b);
+  subArrays = (runtime_array*)b.data;
+  for (uint32_t i = 0; i < 512; i++) {
+    assert(runtime_getArrayHeader(subArrays + i)->backPointer == subArrays + i);
+    assert(subArrays[i].data[0] == i);
+  }
+  runtime_freeArray(&a);
+  runtime_freeArray(&b);
+}
+
+// Test that arrays grow within their reservation without moving.
+static void testReserveArray(void) {
+  runtime_array a = runtime_makeEmptyArray();
+  runtime_allocArray(&a, 1, 8, false);
+  a.data[0] = 42;
+  runtime_reserveArray(&a, 1 << 24, 8, false);
+  runtime_heapHeader *header = runtime_getArrayHeader(&a);
+  assert(header->reserved && header->backPointer == &a);
+  assert(a.numElements == 1 && a.data[0] == 42);
+  size_t *data = a.data;
+  for (uint32_t numElements = 2; numElements <= 1 << 20; numElements <<= 1) {
+    runtime_resizeArray(&a, numElements, 8, false);
+    assert(a.data == data);
+  }
+  assert(a.data[0] == 42 && a.data[(1 << 20) - 1] == 0);
+  runtime_freeArray(&a);
+  runtime_arrayHeapStats stats;
+  runtime_getArrayHeapStats(&stats);
+  assert(stats.reservedBytes == 0);
+  // Huge reservations are capped, rather than mapping all of RAM.
+  runtime_allocArray(&a, 1, 8, false);
+  runtime_reserveArray(&a, (size_t)1 << 40, 8, false);
+  runtime_getArrayHeapStats(&stats);
+  assert(stats.reservedBytes <= ((size_t)1 << 30) + (1 << 16));
+  runtime_freeArray(&a);
+}
+
+// Test that line buffers are kept when a line shrinks, and freed when it is
+// empty, since empty arrays have no buffer.
+static void testResizeArrayKeepBuffer(void) {
+  runtime_array line = runtime_makeEmptyArray();
+  runtime_arrayInitCstr(&line, "a line");
+  size_t *data = line.data;
+  runtime_resizeArrayKeepBuffer(&line, 3, sizeof(uint8_t), false);
+  assert(line.numElements == 3 && line.data == data);
+  assert(((uint8_t*)data)[3] == 0);
+  runtime_resizeArrayKeepBuffer(&line, 0, sizeof(uint8_t), false);
+  assert(line.numElements == 0 && line.data == NULL);
+  runtime_resizeArrayKeepBuffer(&line, 2, sizeof(uint8_t), false);
+  assert(line.numElements == 2 && line.data != NULL);
+  runtime_freeArray(&line);
+  assert(line.data == NULL);
+}
+
+// Test that secret arrays stay marked when they move, and are wiped when freed.
+static void testSecretArray(void) {
+  runtime_array a = runtime_makeEmptyArray();
+  runtime_allocArray(&a, 4, 8, false);
+  runtime_markSecretArray(&a, false);
+  runtime_resizeArray(&a, 1000, 8, false);
+  assert(runtime_getArrayHeader(&a)->secret);
+  runtime_resizeArray(&a, 4, 8, false);
+  assert(runtime_getArrayHeader(&a)->secret);
+  // Pooled buffers stay mapped after they are freed, so we can check the wipe.
+  size_t *data = a.data;
+  for (uint32_t i = 0; i < 4; i++) {
+    data[i] = i + 1;
+  }
+  runtime_freeSecretArray(&a);
+  assert(a.data == NULL && a.numElements == 0);
+  for (uint32_t i = 0; i < 4; i++) {
+    assert(data[i] == 0);
+  }
+}
+
+// Test that marking a string secret, as generated code does for secret types,
+// wipes its old buffer when it grows and moves.
+static void testMoveSecretString(void) {
+  runtime_array s = runtime_makeEmptyArray();
+  runtime_arrayInitCstr(&s, "password");
+  runtime_markSecretArray(&s, false);
+  uint8_t *oldData = (uint8_t*)s.data;
+  runtime_resizeArray(&s, 1000, sizeof(uint8_t), false);
+  assert(s.data != (size_t*)oldData && !memcmp(s.data, "password", 8));
+  assert(runtime_getArrayHeader(&s)->secret);
+  // The old pooled buffer is still mapped, so we can check the wipe.
+  for (uint32_t i = 0; i < 8; i++) {
+    assert(oldData[i] == 0);
+  }
+  runtime_freeSecretArray(&s);
+}
+
+// Test mapping a file into a string, and growing it out of its mapping.
+static void testMapFileArray(void) {
+  char fileName[] = "/tmp/runtime_testXXXXXX";
+  int fd = mkstemp(fileName);
+  assert(fd >= 0);
+  const char text[] = "This is a mapped file.";
+  assert(write(fd, text, sizeof(text) - 1) == sizeof(text) - 1);
+  runtime_array a = runtime_makeEmptyArray();
+  assert(runtime_mapFileArray(&a, fd, sizeof(text) - 1));
+  close(fd);
+  unlink(fileName);
+  assert(runtime_getArrayHeader(&a)->reserved);
+  assert(a.numElements == sizeof(text) - 1 && !memcmp(a.data, text, sizeof(text) - 1));
+  runtime_array b = runtime_makeEmptyArray();
+  runtime_arrayInitCstr(&b, " More text.");
+  runtime_concatArrays(&a, &b, sizeof(uint8_t), false);
+  assert(!memcmp(a.data, "This is a mapped file. More text.", a.numElements));
+  runtime_resizeArray(&a, 1 << 16, sizeof(uint8_t), false);
+  assert(!runtime_getArrayHeader(&a)->reserved);
+  runtime_arrayHeapStats stats;
+  runtime_getArrayHeapStats(&stats);
+  assert(stats.reservedBytes == 0);
+  runtime_freeArray(&a);
+  runtime_freeArray(&b);
+}
+
 // Test converting a uint64_t integer to/from a bigint.
 static void testIntegerConversion(void) {
   uint64_t value = 0xbadc0ffee0ddf00dLL;
@@ -127,6 +454,37 @@ static void testIntegerConversion(void) {
   runtime_freeArray(&array);
 }
 
+// Test converting native integers wider than 64 bits to/from bigints.
+static void testNativeIntConversion(void) {
+  // -2^129 + 5 as an i130, with garbage above bit 130 as LLVM may leave.
+  uint64_t words[3] = {5, 0, 0xab00000000000002ll};
+  runtime_array array = runtime_makeEmptyArray();
+  runtime_nativeIntToBigint(&array, words, 130, true, false);
+  assert(runtime_rnBoolToBool(runtime_bigintNegative(&array)));
+  uint64_t result[3];
+  runtime_bigintToNativeInt(result, &array, 130, true, false);
+  assert(result[0] == 5 && result[1] == 0 && (result[2] & 3) == 2);
+  uint64_t uwords[4] = {0x0123456789abcdefll, 0xfedcba9876543210ll, 0xdeadbeefll, 0x8000000000000000ll};
+  runtime_nativeIntToBigint(&array, uwords, 256, false, true);
+  assert(runtime_bigintWidth(&array) == 256);
+  assert(runtime_getArrayHeader(&array)->secret);
+  runtime_bigintToNativeInt(result, &array, 192, false, true);
+  assert(result[0] == uwords[0] && result[1] == uwords[1] && result[2] == uwords[2]);
+  if (!runtime_setJmp()) {
+    runtime_bigintToNativeInt(result, &array, 192, false, false);
+    assert(false);
+  }
+  runtime_freeArray(&array);
+}
+
+// Test that secret bigints are marked to be wiped when freed.
+static void testSecretBigint(void) {
+  runtime_array array = runtime_makeEmptyArray();
+  runtime_integerToBigint(&array, 1234, 256, false, true);
+  assert(runtime_getArrayHeader(&array)->secret);
+  runtime_freeArray(&array);
+}
+
 // Test runtime_bigintEncodeLittleEndian and runtime_bigintDecodeLittleEndian.
 static void testEncodeDecode(void) {
   runtime_array byteArray = runtime_makeEmptyArray();
@@ -203,6 +561,17 @@ static void testDynamicArrays(void) {
   testMoveArray();
   testReverseArray();
   testCompareArrays();
+  testCompareLongArrays();
+  testArrayHeapStats();
+  testJoinArrays();
+  testViewArraySlice();
+  testAppendArrayElement();
+  testCompactArrayHeap();
+  testReserveArray();
+  testResizeArrayKeepBuffer();
+  testSecretArray();
+  testMoveSecretString();
+  testMapFileArray();
 }
 
 // Test the exponentiate function.
@@ -270,6 +639,38 @@ static void testBigintModularInverse(void) {
   runtime_freeArray(&modulus);
 }
 
+// Test that modular inverse still works when its temporaries are reused at
+// a different width, again at the original width, and after the heap is
+// restarted.
+static void testBigintTemporaries(void) {
+  runtime_array modulus = runtime_makeEmptyArray();
+  runtime_array value = runtime_makeEmptyArray();
+  runtime_array inverse = runtime_makeEmptyArray();
+  for (uint32_t i = 0; i < 2; i++) {
+    runtime_integerToBigint(&modulus, 7, 3, false, false);
+    runtime_integerToBigint(&value, 3, 3, false, true);
+    runtime_bigintModularInverse(&inverse, &value, &modulus);
+    assert(runtime_bigintToInteger(&inverse) == 5);
+    runtime_integerToBigint(&modulus, ((uint64_t)1 << 61) - 1, 61, false, false);
+    runtime_integerToBigint(&value, 3, 61, false, false);
+    runtime_bigintModularInverse(&inverse, &value, &modulus);
+    assert(runtime_bigintToInteger(&inverse) == 1537228672809129301ull);
+  }
+  runtime_freeArray(&modulus);
+  runtime_freeArray(&value);
+  runtime_freeArray(&inverse);
+  // The temporaries live in the heap, so restarting it must free them first.
+  runtime_arrayStop();
+  runtime_arrayStart();
+  runtime_integerToBigint(&modulus, 7, 3, false, false);
+  runtime_integerToBigint(&value, 3, 3, false, true);
+  runtime_bigintModularInverse(&inverse, &value, &modulus);
+  assert(runtime_bigintToInteger(&inverse) == 5);
+  runtime_freeArray(&modulus);
+  runtime_freeArray(&value);
+  runtime_freeArray(&inverse);
+}
+
 // Test modular multiplication.
 static void testBigintModularDiv(void) {
   runtime_array modulus = runtime_makeEmptyArray();
@@ -318,9 +719,191 @@ static void testBigintModularExp(void) {
   runtime_freeArray(&res);
 }
 
+// Test safegcd inverses mod 2^255 - 19 for public and secret values, and the
+// Euclidean fallback for even moduli.
+static void testBigintSafegcdInverse(void) {
+  runtime_array modulus = runtime_makeEmptyArray();
+  initBigintTo25519(&modulus);
+  runtime_array value = runtime_makeEmptyArray();
+  runtime_array inverse = runtime_makeEmptyArray();
+  runtime_array one = runtime_makeEmptyArray();
+  runtime_integerToBigint(&one, 1, 255, false, false);
+  for (uint32_t secret = 0; secret < 2; secret++) {
+    runtime_integerToBigint(&value, 0xdeadbeefcafef00dll, 255, false, secret);
+    assert(runtime_bigintModularInverse(&inverse, &value, &modulus));
+    assert(runtime_bigintSecret(&inverse) == secret);
+    runtime_bigintModularMul(&inverse, &inverse, &value, &modulus);
+    assert(runtime_compareBigints(RN_EQUAL, &inverse, &one));
+    runtime_integerToBigint(&value, 0, 255, false, secret);
+    assert(!runtime_bigintModularInverse(&inverse, &value, &modulus));
+  }
+  // 3 * 5 = 1 mod 14.
+  runtime_integerToBigint(&modulus, 14, 4, false, false);
+  runtime_integerToBigint(&value, 3, 4, false, true);
+  assert(runtime_bigintModularInverse(&inverse, &value, &modulus));
+  assert(runtime_bigintToInteger(&inverse) == 5);
+  runtime_freeArray(&modulus);
+  runtime_freeArray(&value);
+  runtime_freeArray(&inverse);
+  runtime_freeArray(&one);
+}
+
+// Initialize an array to 2^width - c, of the given width.
+static void initBigintToPowerMinus(runtime_array *dest, uint32_t width, uint64_t c) {
+  runtime_array power = runtime_makeEmptyArray();
+  runtime_array small = runtime_makeEmptyArray();
+  runtime_integerToBigint(&power, 2, width + 1, false, false);
+  runtime_bigintExp(&power, &power, width);
+  runtime_integerToBigint(&small, c, width + 1, false, false);
+  runtime_bigintSub(&power, &power, &small);
+  runtime_bigintCast(dest, &power, width, false, false, false);
+  runtime_freeArray(&power);
+  runtime_freeArray(&small);
+}
+
+// Set |dest| to a random value mod |modulus|, drawn from all of its width.
+static void randomModularValue(runtime_array *dest, runtime_array *modulus, bool secret) {
+  uint32_t width = runtime_bigintWidth(modulus);
+  runtime_array bits = runtime_makeEmptyArray();
+  runtime_generateTrueRandomBigint(&bits, width);
+  runtime_bigintCast(dest, &bits, width, false, false, false);
+  runtime_bigintMod(dest, dest, modulus);
+  runtime_bigintSetSecret(dest, secret);
+  runtime_freeArray(&bits);
+}
+
+// Check |numValues| random inverses mod the prime |modulus|, on both the
+// constant time path for secrets and the variable time path for public values.
+static void checkRandomInverses(runtime_array *modulus, uint32_t numValues) {
+  uint32_t width = runtime_bigintWidth(modulus);
+  runtime_array value = runtime_makeEmptyArray();
+  runtime_array inverse = runtime_makeEmptyArray();
+  runtime_array product = runtime_makeEmptyArray();
+  runtime_array one = runtime_makeEmptyArray();
+  runtime_integerToBigint(&one, 1, width, false, false);
+  for (uint32_t secret = 0; secret < 2; secret++) {
+    for (uint32_t i = 0; i < numValues; i++) {
+      randomModularValue(&value, modulus, secret);
+      bool isZero = runtime_rnBoolToBool(runtime_bigintZero(&value));
+      assert(runtime_bigintModularInverse(&inverse, &value, modulus) == !isZero);
+      assert(runtime_bigintSecret(&inverse) == secret);
+      if (!isZero) {
+        runtime_bigintModularMul(&product, &inverse, &value, modulus);
+        runtime_bigintSetSecret(&product, false);
+        assert(runtime_compareBigints(RN_EQUAL, &product, &one));
+      }
+    }
+  }
+  runtime_freeArray(&value);
+  runtime_freeArray(&inverse);
+  runtime_freeArray(&product);
+  runtime_freeArray(&one);
+}
+
+// Test safegcd on random full width values mod 2^255 - 19 and the Mersenne
+// prime 2^2203 - 1, and that multiples of 3 have no inverse mod 3(2^255 - 19).
+static void testBigintRandomInverses(void) {
+  runtime_array modulus = runtime_makeEmptyArray();
+  initBigintTo25519(&modulus);
+  checkRandomInverses(&modulus, 64);
+  runtime_array three = runtime_makeEmptyArray();
+  runtime_array composite = runtime_makeEmptyArray();
+  runtime_integerToBigint(&three, 3, 257, false, false);
+  runtime_bigintCast(&composite, &modulus, 257, false, false, false);
+  runtime_bigintMul(&composite, &composite, &three);
+  runtime_array value = runtime_makeEmptyArray();
+  runtime_array bits = runtime_makeEmptyArray();
+  runtime_array inverse = runtime_makeEmptyArray();
+  for (uint32_t secret = 0; secret < 2; secret++) {
+    for (uint32_t i = 0; i < 16; i++) {
+      // 3 times a value below 2^254 is below the modulus.
+      runtime_generateTrueRandomBigint(&bits, 254);
+      runtime_bigintCast(&value, &bits, 257, false, false, false);
+      runtime_bigintMul(&value, &value, &three);
+      runtime_bigintSetSecret(&value, secret);
+      assert(!runtime_bigintModularInverse(&inverse, &value, &composite));
+    }
+    // A common factor of 2^255 - 19 has no inverse either.
+    runtime_bigintCast(&value, &modulus, 257, false, secret, false);
+    assert(!runtime_bigintModularInverse(&inverse, &value, &composite));
+  }
+  initBigintToPowerMinus(&modulus, 2203, 1);
+  checkRandomInverses(&modulus, 8);
+  runtime_freeArray(&modulus);
+  runtime_freeArray(&three);
+  runtime_freeArray(&composite);
+  runtime_freeArray(&value);
+  runtime_freeArray(&bits);
+  runtime_freeArray(&inverse);
+}
+
+// Test Montgomery multiplication with a multi-limb modulus, and the fallback
+// for even moduli.
+static void testBigintMontgomeryMul(void) {
+  runtime_array modulus = runtime_makeEmptyArray();
+  initBigintTo25519(&modulus);
+  runtime_array value = runtime_makeEmptyArray();
+  runtime_array one = runtime_makeEmptyArray();
+  runtime_integerToBigint(&one, 1, 255, false, false);
+  runtime_bigintSub(&value, &modulus, &one);
+  runtime_bigintSetSecret(&value, true);
+  // (p - 1)^2 = 1 mod p.
+  runtime_bigintModularMul(&value, &value, &value, &modulus);
+  assert(runtime_compareBigints(RN_EQUAL, &value, &one));
+  runtime_integerToBigint(&modulus, 14, 4, false, false);
+  runtime_integerToBigint(&value, 5, 4, false, true);
+  runtime_bigintModularMul(&value, &value, &value, &modulus);
+  assert(runtime_bigintToInteger(&value) == 11);
+  runtime_freeArray(&modulus);
+  runtime_freeArray(&value);
+  runtime_freeArray(&one);
+}
+
+// Test that the variable time engine for public bigints matches CTTK on
+// values large enough for Karatsuba, and on a negative divisor.
+static void testPublicBigint(void) {
+  runtime_array a = runtime_makeEmptyArray();
+  runtime_array b = runtime_makeEmptyArray();
+  runtime_array slow = runtime_makeEmptyArray();
+  runtime_array fast = runtime_makeEmptyArray();
+  runtime_integerToBigint(&a, 0xfedcba987654321ll, 8192, true, false);
+  runtime_bigintExp(&a, &a, 60);
+  runtime_integerToBigint(&b, -0x123456789abcdefll, 8192, true, false);
+  runtime_bigintExp(&b, &b, 45);
+  assert(runtime_rnBoolToBool(runtime_bigintNegative(&b)));
+  runtime_bigintMul(&slow, &a, &b);
+  runtime_publicBigintMul(&fast, &a, &b);
+  assert(runtime_compareBigints(RN_EQUAL, &slow, &fast));
+  runtime_bigintMulTrunc(&slow, &slow, &a);
+  runtime_publicBigintMulTrunc(&fast, &fast, &a);
+  assert(runtime_compareBigints(RN_EQUAL, &slow, &fast));
+  runtime_bigintDiv(&slow, &a, &b);
+  runtime_publicBigintDiv(&fast, &a, &b);
+  assert(runtime_compareBigints(RN_EQUAL, &slow, &fast));
+  runtime_bigintMod(&slow, &a, &b);
+  runtime_publicBigintMod(&fast, &a, &b);
+  assert(runtime_compareBigints(RN_EQUAL, &slow, &fast));
+  if (!runtime_setJmp()) {
+    runtime_publicBigintMul(&fast, &a, &a);
+    runtime_publicBigintMul(&fast, &fast, &a);
+    assert(false);
+  }
+  runtime_integerToBigint(&b, 0, 8192, true, false);
+  if (!runtime_setJmp()) {
+    runtime_publicBigintDiv(&fast, &a, &b);
+    assert(false);
+  }
+  runtime_freeArray(&a);
+  runtime_freeArray(&b);
+  runtime_freeArray(&slow);
+  runtime_freeArray(&fast);
+}
+
 // Test the Bigint API.
 static void testBigints(void) {
   testIntegerConversion();
+  testNativeIntConversion();
+  testSecretBigint();
   testEncodeDecode();
   testCompareBigints();
   testBigintCast();
@@ -330,8 +913,13 @@ static void testBigints(void) {
   testBigintModularSub();
   testBigintModularMul();
   testBigintModularInverse();
+  testBigintTemporaries();
   testBigintModularDiv();
   testBigintModularExp();
+  testBigintMontgomeryMul();
+  testBigintSafegcdInverse();
+  testBigintRandomInverses();
+  testPublicBigint();
 }
 
 // Test the Smallnum API.
@@ -339,6 +927,12 @@ static void testSmallnums(void) {
   int64_t minVal = (int64_t)1 << ((sizeof(int64_t)*8) - 1);
   assert(runtime_smallnumModReduce(minVal, 13, true, false) == 5);
   assert(runtime_smallnumModularMul(3, 4, 7, true) == 5);
+  assert(runtime_smallnumModularMul(3, 4, 7, false) == 5);
+  uint64_t bigPrime = 0xffffffffffffffc5;  // 2^64 - 59.
+  assert(runtime_smallnumModularMul(bigPrime - 1, bigPrime - 1, bigPrime, false) == 1);
+  assert(runtime_smallnumModularExp(3, 5, 7, false) == 5);
+  assert(runtime_smallnumModularExp(3, 5, 7, true) == 5);
+  assert(runtime_smallnumModularExp(bigPrime - 1, 3, bigPrime, false) == bigPrime - 1);
 }
 
 struct testTupleStruct {
@@ -384,6 +978,52 @@ static void testSprintf(void) {
   runtime_freeArray(&list);
 }
 
+// Test runtime_sprintf with escapes and scalar arguments, which are measured
+// before the result is allocated.
+static void testSprintfScalars(void) {
+  runtime_array buf = runtime_makeEmptyArray();
+  runtime_array format = runtime_makeEmptyArray();
+  runtime_array string = runtime_makeEmptyArray();
+  runtime_arrayInitCstr(&string, "abc");
+  runtime_arrayInitCstr(&format, "a\\x41\\t%i32 %x64 %b %s\\%%f64\\n");
+  runtime_sprintf(&buf, &format, (uint32_t)-7, (uint64_t)0xbeef, true, &string, 2.5);
+  char expected[] = "aA\t-7 beef true abc%2.5\n";
+  uint64_t len = sizeof(expected) - 1;
+  assert(buf.numElements == len && !memcmp(buf.data, expected, len));
+  runtime_freeArray(&format);
+  runtime_sprintf(&buf, &format);
+  assert(buf.numElements == 0);
+  runtime_nativeIntToString(&buf, (uint64_t)INT64_MIN, 10, true);
+  assert(buf.numElements == 20 && !memcmp(buf.data, "-9223372036854775808", 20));
+  runtime_nativeIntToString(&buf, 0, 2, false);
+  assert(buf.numElements == 1 && *(uint8_t*)buf.data == '0');
+  runtime_freeArray(&buf);
+  runtime_freeArray(&format);
+  runtime_freeArray(&string);
+}
+
+// Test that floats convert to the shortest strings that read back the same.
+static void testFloatToString(void) {
+  runtime_array buf = runtime_makeEmptyArray();
+  runtime_f64tostring(&buf, 0.1);
+  assert(buf.numElements == 3 && !memcmp(buf.data, "0.1", 3));
+  runtime_f64tostring(&buf, 1e-5);
+  assert(buf.numElements == 5 && !memcmp(buf.data, "1e-05", 5));
+  runtime_f64tostring(&buf, -1.5e300);
+  assert(buf.numElements == 9 && !memcmp(buf.data, "-1.5e+300", 9));
+  runtime_f32tostring(&buf, 2.7182818f);
+  assert(buf.numElements == 9 && !memcmp(buf.data, "2.7182817", 9));
+  runtime_array format = runtime_makeEmptyArray();
+  runtime_arrayInitCstr(&format, "%f64");
+  // println rounds to 7 significant digits.
+  runtime_sprintf(&buf, &format, 0.1 * 15.0);
+  assert(buf.numElements == 3 && !memcmp(buf.data, "1.5", 3));
+  runtime_sprintf(&buf, &format, 9.9999999);
+  assert(buf.numElements == 5 && !memcmp(buf.data, "1.0e1", 5));
+  runtime_freeArray(&buf);
+  runtime_freeArray(&format);
+}
+
 // Test the runtime_initArrayOfStringsFromC function.
 static void testInitArrayOfStringFromC(void) {
   char *argvC[] = {"one", "two", "three"};
@@ -415,6 +1055,546 @@ static void testXorStrings(void) {
   runtime_freeArray(&c);
 }
 
+// Find the needle the slow way, to check runtime_stringFind and runtime_stringRfind.
+static uint64_t slowFind(const char *haystack, uint64_t length, const char *needle,
+    uint64_t needleLength, uint64_t start, bool reverse) {
+  uint64_t result = length;
+  for (uint64_t i = start; i + needleLength <= length; i++) {
+    if (!memcmp(haystack + i, needle, needleLength)) {
+      if (!reverse) {
+        return i;
+      }
+      result = i;
+    }
+  }
+  return result;
+}
+
+// Check runtime_stringFind and runtime_stringRfind against slowFind at the offset.
+static void checkStringFind(const runtime_array *haystack, const runtime_array *needle,
+    const char *text, uint64_t length, const char *needleText, uint64_t offset) {
+  uint64_t needleLength = needle->numElements;
+  uint64_t start = offset + 1 >= needleLength? offset + 1 - needleLength : 0;
+  assert(runtime_stringFind(haystack, needle, offset) ==
+      slowFind(text, length, needleText, needleLength, offset, false));
+  assert(runtime_stringRfind(haystack, needle, offset) ==
+      slowFind(text, length, needleText, needleLength, start, true));
+}
+
+// Test runtime_stringFind and runtime_stringRfind on short and long needles,
+// including periodic needles that defeat the first/last byte filter.
+static void testStringFind(void) {
+  char text[600];
+  for (uint32_t i = 0; i < sizeof(text); i++) {
+    text[i] = i % 97 == 13? 'b' : 'a';
+  }
+  runtime_array haystack = runtime_makeEmptyArray();
+  runtime_array needle = runtime_makeEmptyArray();
+  runtime_allocArray(&haystack, sizeof(text), sizeof(uint8_t), false);
+  memcpy(haystack.data, text, sizeof(text));
+  const uint64_t needleLengths[] = {1, 2, 3, 17, 40, 100};
+  for (uint32_t i = 0; i < sizeof(needleLengths) / sizeof(uint64_t); i++) {
+    uint64_t needleLength = needleLengths[i];
+    for (uint64_t source = 0; source + needleLength <= 120; source += 7) {
+      runtime_resizeArray(&needle, needleLength, sizeof(uint8_t), false);
+      memcpy(needle.data, text + source, needleLength);
+      for (uint64_t offset = 0; offset + needleLength <= sizeof(text); offset += 29) {
+        checkStringFind(&haystack, &needle, text, sizeof(text), text + source, offset);
+      }
+      // Offsets at the edges of the rfind window.
+      checkStringFind(&haystack, &needle, text, sizeof(text), text + source, needleLength - 1);
+      checkStringFind(&haystack, &needle, text, sizeof(text), text + source, needleLength);
+      checkStringFind(&haystack, &needle, text, sizeof(text), text + source,
+          sizeof(text) - needleLength);
+    }
+  }
+  // Reverse matches must end at or after the offset.
+  runtime_array s = runtime_makeEmptyArray();
+  runtime_arrayInitCstr(&s, "abcxxx");
+  runtime_arrayInitCstr(&needle, "abc");
+  assert(runtime_stringRfind(&s, &needle, 2) == 0);
+  assert(runtime_stringRfind(&s, &needle, 3) == 6);
+  runtime_arrayInitCstr(&needle, "a");
+  assert(runtime_stringRfind(&s, &needle, 0) == 0);
+  assert(runtime_stringRfind(&s, &needle, 1) == 6);
+  runtime_freeArray(&s);
+  runtime_freeArray(&haystack);
+  runtime_freeArray(&needle);
+}
+
+// Test the hex and base64 codecs on every length up to 100, so both the
+// vectorized loops and their tails are covered, and on RFC 4648's vectors.
+static void testCodecs(void) {
+  runtime_array bin = runtime_makeEmptyArray();
+  runtime_array encoded = runtime_makeEmptyArray();
+  runtime_array decoded = runtime_makeEmptyArray();
+  for (uint32_t len = 0; len <= 100; len++) {
+    runtime_resizeArray(&bin, len, sizeof(uint8_t), false);
+    for (uint32_t i = 0; i < len; i++) {
+      ((uint8_t*)bin.data)[i] = i * 151 + len;
+    }
+    runtime_stringToHex(&encoded, &bin);
+    assert(encoded.numElements == 2 * len);
+    for (uint32_t i = 0; i < len; i++) {
+      char digits[3];
+      snprintf(digits, sizeof(digits), "%02x", ((uint8_t*)bin.data)[i]);
+      assert(!memcmp((uint8_t*)encoded.data + 2 * i, digits, 2));
+    }
+    runtime_hexToString(&decoded, &encoded);
+    assert(runtime_arraysEqual(&decoded, &bin, sizeof(uint8_t), false));
+    for (uint32_t urlSafe = 0; urlSafe <= 1; urlSafe++) {
+      runtime_stringToBase64(&encoded, &bin, urlSafe);
+      runtime_base64ToString(&decoded, &encoded, urlSafe);
+      assert(runtime_arraysEqual(&decoded, &bin, sizeof(uint8_t), false));
+    }
+  }
+  const char *vectors[] = {"", "", "f", "Zg==", "fo", "Zm8=", "foo", "Zm9v", "foob", "Zm9vYg==",
+      "fooba", "Zm9vYmE=", "foobar", "Zm9vYmFy", "\xfb\xff", "+/8="};
+  for (uint32_t i = 0; i < sizeof(vectors) / sizeof(char*); i += 2) {
+    runtime_arrayInitCstr(&bin, vectors[i]);
+    runtime_stringToBase64(&encoded, &bin, false);
+    assert(encoded.numElements == strlen(vectors[i + 1]));
+    assert(!memcmp(encoded.data, vectors[i + 1], encoded.numElements));
+  }
+  runtime_stringToBase64(&encoded, &bin, true);
+  assert(encoded.numElements == 3 && !memcmp(encoded.data, "-_8", 3));
+  runtime_freeArray(&bin);
+  runtime_freeArray(&encoded);
+  runtime_freeArray(&decoded);
+}
+
+// Build a string from many small appends with a small chunk size, so several
+// chunks fill, and check that it matches.
+static void testStringBuilder(void) {
+  runtime_array chunks = runtime_makeEmptyArray();
+  runtime_array current = runtime_makeEmptyArray();
+  runtime_array text = runtime_makeEmptyArray();
+  runtime_array string = runtime_makeEmptyArray();
+  char expected[4000];
+  size_t length = 0;
+  for (uint32_t i = 0; i < 500; i++) {
+    char buf[16];
+    size_t len = snprintf(buf, sizeof(buf), "%u,", i);
+    runtime_arrayInitCstr(&text, buf);
+    stringBuilderAppend(&chunks, &current, &text, 100);
+    memcpy(expected + length, buf, len);
+    length += len;
+  }
+  assert(chunks.numElements > 10);
+  stringBuilderToString(&string, &chunks, &current);
+  assert(string.numElements == length);
+  assert(!memcmp(string.data, expected, length));
+  runtime_freeArray(&chunks);
+  runtime_freeArray(&current);
+  runtime_freeArray(&text);
+  runtime_freeArray(&string);
+}
+
+// Test runtime_hashBytes on every length up to 200, so each code path and tail
+// size is covered, and check that nearby keys spread over a table's low bits.
+static void testHashBytes(void) {
+  uint8_t text[200];
+  for (uint32_t i = 0; i < sizeof(text); i++) {
+    text[i] = 'a' + i % 7;
+  }
+  uint64_t hashes[sizeof(text) + 1];
+  for (uint32_t len = 0; len <= sizeof(text); len++) {
+    // Copy to an exact-size buffer so overreads are caught under ASan.
+    uint8_t *key = malloc(len + 1);
+    memcpy(key, text, len);
+    hashes[len] = runtime_hashBytes(key, len, 0);
+    assert(runtime_hashBytes(key, len, 0) == hashes[len]);
+    assert(runtime_hashBytes(key, len, 1) != hashes[len]);
+    for (uint32_t i = 0; i < len; i++) {
+      key[i] ^= 1;
+      assert(runtime_hashBytes(key, len, 0) != hashes[len]);
+      key[i] ^= 1;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+      assert(hashes[i] != hashes[len]);
+    }
+    free(key);
+  }
+  runtime_array string = runtime_makeEmptyArray();
+  runtime_allocArray(&string, 3, sizeof(uint8_t), false);
+  memcpy(string.data, "abc", 3);
+  assert(hashStringBytes(&string, 7) == runtime_hashBytes((const uint8_t*)"abc", 3, 7));
+  runtime_freeArray(&string);
+  uint32_t buckets[1024] = {0};
+  for (uint32_t i = 0; i < 1024; i++) {
+    char name[16];
+    int len = snprintf(name, sizeof(name), "bar%u", i);
+    buckets[runtime_hashBytes((const uint8_t*)name, len, 0) & 1023]++;
+  }
+  for (uint32_t i = 0; i < 1024; i++) {
+    assert(buckets[i] < 10);
+  }
+}
+
+static int compareU32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return x < y? -1 : x > y;
+}
+
+static int compareI64(const void *a, const void *b) {
+  int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+  return x < y? -1 : x > y;
+}
+
+// NaNs last, as in sortF64Array.
+static int compareF64(const void *a, const void *b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  if (x != x) {
+    return y == y;
+  }
+  return y != y? -1 : x < y? -1 : x > y;
+}
+
+// Generate test input in one of several patterns that are hard on quicksort
+// pivot selection, and on radix sort pass skipping.
+static uint64_t sortInput(uint32_t pattern, uint64_t i, uint64_t n) {
+  switch (pattern) {
+    case 0: return ((uint64_t)rand() << 32) ^ rand();
+    case 1: return 42;
+    case 2: return i;
+    case 3: return n - i;
+    case 4: return rand() % 4;
+    default: return i < n / 2? i : n - i;  // Organ pipe.
+  }
+}
+
+// Test the integer radix sorts and float quicksort against qsort.
+static void testSortNumbers(void) {
+  const uint64_t sizes[] = {0, 1, 2, 23, 24, 63, 64, 65, 129, 1000, 20000};
+  for (uint32_t i = 0; i < sizeof(sizes) / sizeof(uint64_t); i++) {
+    uint64_t n = sizes[i];
+    for (uint32_t pattern = 0; pattern < 6; pattern++) {
+      runtime_array u32s = runtime_makeEmptyArray();
+      runtime_array i64s = runtime_makeEmptyArray();
+      runtime_array f64s = runtime_makeEmptyArray();
+      runtime_allocArray(&u32s, n, sizeof(uint32_t), false);
+      runtime_allocArray(&i64s, n, sizeof(int64_t), false);
+      runtime_allocArray(&f64s, n, sizeof(double), false);
+      uint32_t *u32Data = (uint32_t*)u32s.data;
+      int64_t *i64Data = (int64_t*)i64s.data;
+      double *f64Data = (double*)f64s.data;
+      for (uint64_t j = 0; j < n; j++) {
+        uint64_t value = sortInput(pattern, j, n);
+        u32Data[j] = value;
+        i64Data[j] = (int64_t)value - (int64_t)(n / 2);
+        f64Data[j] = j % 97 == 5? 0.0 / 0.0 : (double)i64Data[j] / 3.0;
+      }
+      // Keep an extra element, so empty arrays are not NULL.
+      uint32_t *u32Expected = calloc(n + 1, sizeof(uint32_t));
+      int64_t *i64Expected = calloc(n + 1, sizeof(int64_t));
+      double *f64Expected = calloc(n + 1, sizeof(double));
+      for (uint64_t j = 0; j < n; j++) {
+        u32Expected[j] = u32Data[j];
+        i64Expected[j] = i64Data[j];
+        f64Expected[j] = f64Data[j];
+      }
+      qsort(u32Expected, n, sizeof(uint32_t), compareU32);
+      qsort(i64Expected, n, sizeof(int64_t), compareI64);
+      qsort(f64Expected, n, sizeof(double), compareF64);
+      sortU32Array(&u32s);
+      sortI64Array(&i64s);
+      sortF64Array(&f64s);
+      for (uint64_t j = 0; j < n; j++) {
+        assert(u32Data[j] == u32Expected[j]);
+        assert(i64Data[j] == i64Expected[j]);
+        assert(!compareF64(f64Data + j, f64Expected + j));
+      }
+      free(u32Expected);
+      free(i64Expected);
+      free(f64Expected);
+      runtime_freeArray(&u32s);
+      runtime_freeArray(&i64s);
+      runtime_freeArray(&f64s);
+    }
+  }
+}
+
+// Test sorting strings, and that the sorted strings can still be moved by the heap.
+static void testSortStrings(void) {
+  const uint32_t n = 500;
+  runtime_array strings = runtime_makeEmptyArray();
+  runtime_allocArray(&strings, n, sizeof(runtime_array), true);
+  runtime_array *stringData = (runtime_array*)strings.data;
+  for (uint32_t i = 0; i < n; i++) {
+    char text[16];
+    // Includes prefixes of other strings, such as "a1" and "a12".
+    snprintf(text, sizeof(text), "a%u", (i * 7919) % n);
+    runtime_arrayInitCstr(stringData + i, text);
+  }
+  sortStringArray(&strings);
+  for (uint32_t i = 1; i < n; i++) {
+    runtime_array *a = stringData + i - 1;
+    runtime_array *b = stringData + i;
+    size_t len = a->numElements < b->numElements? a->numElements : b->numElements;
+    int result = memcmp(a->data, b->data, len);
+    assert(result < 0 || (result == 0 && a->numElements < b->numElements));
+  }
+  runtime_compactArrayHeap();
+  assert(stringData[0].numElements == 2 && !memcmp(stringData[0].data, "a0", 2));
+  runtime_freeArray(&strings);
+}
+
+// Test that pair sorts move the values with their keys, and are stable.
+static void testSortPairs(void) {
+  const uint64_t n = 3000;
+  runtime_array keys = runtime_makeEmptyArray();
+  runtime_array floatKeys = runtime_makeEmptyArray();
+  runtime_array values = runtime_makeEmptyArray();
+  runtime_array floatValues = runtime_makeEmptyArray();
+  runtime_allocArray(&keys, n, sizeof(uint64_t), false);
+  runtime_allocArray(&floatKeys, n, sizeof(double), false);
+  runtime_allocArray(&values, n, sizeof(uint64_t), false);
+  runtime_allocArray(&floatValues, n, sizeof(uint64_t), false);
+  uint64_t *keyData = (uint64_t*)keys.data;
+  double *floatKeyData = (double*)floatKeys.data;
+  uint64_t *valueData = (uint64_t*)values.data;
+  uint64_t *floatValueData = (uint64_t*)floatValues.data;
+  for (uint64_t i = 0; i < n; i++) {
+    keyData[i] = (i * 7919) % 100;
+    floatKeyData[i] = -(double)keyData[i];
+    valueData[i] = i;
+    floatValueData[i] = i;
+  }
+  sortU64Pairs(&keys, &values);
+  sortF64Pairs(&floatKeys, &floatValues);
+  for (uint64_t i = 0; i < n; i++) {
+    assert(keyData[i] == (valueData[i] * 7919) % 100);
+    assert(floatKeyData[i] == -(double)((floatValueData[i] * 7919) % 100));
+    if (i > 0) {
+      assert(keyData[i - 1] < keyData[i] ||
+          (keyData[i - 1] == keyData[i] && valueData[i - 1] < valueData[i]));
+      assert(floatKeyData[i - 1] < floatKeyData[i] || (floatKeyData[i - 1] ==
+          floatKeyData[i] && floatValueData[i - 1] < floatValueData[i]));
+    }
+  }
+  runtime_freeArray(&keys);
+  runtime_freeArray(&floatKeys);
+  runtime_freeArray(&values);
+  runtime_freeArray(&floatValues);
+}
+
+// Test the CSPRNG, including requests which span several keystream refills.
+static void testTrueRandom(void) {
+  for (uint32_t i = 0; i < 100; i++) {
+    assert(runtime_generateTrueRandomValue(3) < 8);
+  }
+  assert(runtime_generateTrueRandomValue(64) != runtime_generateTrueRandomValue(64));
+  uint8_t bytes[10000];
+  memset(bytes, 0, sizeof(bytes));
+  runtime_generateTrueRandomBytes(bytes, sizeof(bytes));
+  uint32_t numZeros = 0;
+  for (uint32_t i = 0; i < sizeof(bytes); i++) {
+    numZeros += bytes[i] == 0;
+  }
+  // Expect about 39 zero bytes.
+  assert(numZeros < 100);
+}
+
+// Set |array| to the bytes of a hex string.
+static void initFromHex(runtime_array *array, const char *hexString) {
+  runtime_array hex = runtime_makeEmptyArray();
+  runtime_arrayInitCstr(&hex, hexString);
+  runtime_hexToString(array, &hex);
+  runtime_freeArray(&hex);
+}
+
+// Check that |array| holds the bytes of a hex string.
+static void checkHex(const runtime_array *array, const char *hexString) {
+  runtime_array hex = runtime_makeEmptyArray();
+  runtime_stringToHex(&hex, array);
+  assert(hex.numElements == strlen(hexString));
+  assert(!memcmp(hex.data, hexString, hex.numElements));
+  runtime_freeArray(&hex);
+}
+
+// Check an AEAD against a known answer, and check that decryption rejects a
+// modified ciphertext.
+static void checkAead(bool isAesGcm, const char *key, const char *nonce, const char *plaintext,
+    const char *associatedData, const char *ciphertext) {
+  runtime_array k = runtime_makeEmptyArray();
+  runtime_array n = runtime_makeEmptyArray();
+  runtime_array p = runtime_makeEmptyArray();
+  runtime_array a = runtime_makeEmptyArray();
+  runtime_array c = runtime_makeEmptyArray();
+  runtime_array decrypted = runtime_makeEmptyArray();
+  initFromHex(&k, key);
+  initFromHex(&n, nonce);
+  initFromHex(&p, plaintext);
+  initFromHex(&a, associatedData);
+  if (isAesGcm) {
+    runtime_aesGcmEncrypt(&c, &k, &n, &p, &a);
+  } else {
+    runtime_chacha20Poly1305Encrypt(&c, &k, &n, &p, &a);
+  }
+  checkHex(&c, ciphertext);
+  bool valid = isAesGcm? runtime_aesGcmDecrypt(&decrypted, &k, &n, &c, &a) :
+      runtime_chacha20Poly1305Decrypt(&decrypted, &k, &n, &c, &a);
+  assert(valid);
+  assert(runtime_getArrayHeader(&decrypted)->secret);
+  checkHex(&decrypted, plaintext);
+  ((uint8_t*)c.data)[3] ^= 1;
+  valid = isAesGcm? runtime_aesGcmDecrypt(&decrypted, &k, &n, &c, &a) :
+      runtime_chacha20Poly1305Decrypt(&decrypted, &k, &n, &c, &a);
+  assert(!valid && decrypted.numElements == 0);
+  runtime_freeArray(&k);
+  runtime_freeArray(&n);
+  runtime_freeArray(&p);
+  runtime_freeArray(&a);
+  runtime_freeArray(&c);
+  runtime_freeArray(&decrypted);
+}
+
+// Check the crypto primitives against published test vectors.
+static void checkCryptoVectors(void) {
+  runtime_array message = runtime_makeEmptyArray();
+  runtime_array digest = runtime_makeEmptyArray();
+  runtime_arrayInitCstr(&message, "abc");
+  runtime_sha256(&digest, &message);
+  checkHex(&digest, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  runtime_sha3_256(&digest, &message);
+  checkHex(&digest, "3a985da74fe225b2045c172d6bd390bd855f086e3e9d525b46bfe24511431532");
+  runtime_freeArray(&message);
+  runtime_freeArray(&digest);
+  // Test case 4 from the GCM spec.
+  checkAead(true, "feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+      "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+      "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+      "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+      "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+      "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091"
+      "5bc94fbc3221a5db94fae95ae7121a47");
+  // RFC 8439, section 2.8.2.
+  checkAead(false, "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f",
+      "070000004041424344454647",
+      "4c616469657320616e642047656e746c656d656e206f662074686520636c6173"
+      "73206f66202739393a204966204920636f756c64206f6666657220796f75206f"
+      "6e6c79206f6e652074697020666f7220746865206675747572652c2073756e73"
+      "637265656e20776f756c642062652069742e",
+      "50515253c0c1c2c3c4c5c6c7",
+      "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+      "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+      "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+      "3ff4def08e4b7a9de576d26586cec64b6116"
+      "1ae10b594f09e26a7e902ecbd0600691");
+}
+
+// Test the crypto primitives, with and without the CPU extensions.
+static void testCrypto(void) {
+  if (runtime_setCryptoHardwareEnabled(true)) {
+    checkCryptoVectors();
+  }
+  runtime_setCryptoHardwareEnabled(false);
+  checkCryptoVectors();
+  runtime_setCryptoHardwareEnabled(true);
+}
+
+// Count the visits to each iteration in the range.
+static void countIterations(void *context, uint64_t first, uint64_t last) {
+  uint8_t *counts = context;
+  assert(first < last);
+  for (uint64_t i = first; i < last; i++) {
+    __atomic_fetch_add(counts + i, 1, __ATOMIC_RELAXED);
+  }
+}
+
+// Test that parallel for loops run every iteration exactly once, and that
+// object loops skip objects on the free list.
+static void testParallelFor(void) {
+  uint64_t numIterations = 100000;
+  uint8_t *counts = calloc(numIterations, 1);
+  runtime_parallelFor(countIterations, counts, 0);
+  runtime_parallelFor(countIterations, counts, 1);
+  assert(counts[0] == 1 && counts[1] == 0);
+  counts[0] = 0;
+  runtime_parallelFor(countIterations, counts, numIterations);
+  for (uint64_t i = 0; i < numIterations; i++) {
+    assert(counts[i] == 1);
+  }
+  memset(counts, 0, numIterations);
+  runtime_array nextFree = runtime_makeEmptyArray();
+  runtime_allocArray(&nextFree, 16, sizeof(uint32_t), false);
+  uint32_t *links = (uint32_t*)nextFree.data;
+  // Objects 7 and 3 are free, and 10 through 15 were never allocated.
+  links[7] = 3;
+  links[3] = 0;
+  runtime_parallelForObjects(countIterations, counts, &nextFree, sizeof(uint32_t), 10, 7);
+  for (uint64_t i = 0; i < 16; i++) {
+    assert(counts[i] == (i != 0 && i != 3 && i != 7 && i < 10));
+  }
+  runtime_freeArray(&nextFree);
+  free(counts);
+}
+
+// Allocate, grow and free arrays of pooled and large sizes in each iteration.
+static void allocateInParallel(void *context, uint64_t first, uint64_t last) {
+  runtime_array *arrays = context;
+  for (uint64_t i = first; i < last; i++) {
+    runtime_array temp = runtime_makeEmptyArray();
+    runtime_allocArray(&temp, 1 + i % 300, sizeof(uint64_t), false);
+    runtime_allocArray(arrays + i, 1 + i % 5000, 1, false);
+    runtime_resizeArray(arrays + i, 7000, 1, false);
+    arrays[i].data[0] = i;
+    runtime_freeArray(&temp);
+    // This is ignored while other threads may be using arrays.
+    runtime_compactArrayHeap();
+  }
+}
+
+// Test that threads of parallel for loops can share the array heap.
+static void testParallelHeap(void) {
+  uint64_t numArrays = 4096;
+  runtime_array *arrays = calloc(numArrays, sizeof(runtime_array));
+  runtime_arrayHeapStats before, after;
+  runtime_getArrayHeapStats(&before);
+  runtime_parallelFor(allocateInParallel, arrays, numArrays);
+  for (uint64_t i = 0; i < numArrays; i++) {
+    assert(arrays[i].numElements == 7000 && arrays[i].data[0] == i);
+    runtime_freeArray(arrays + i);
+  }
+  runtime_getArrayHeapStats(&after);
+  assert(after.liveBytes == before.liveBytes);
+  assert(after.compactions == before.compactions);
+  runtime_compactArrayHeap();
+  free(arrays);
+}
+
+static void testRpcDecoder(void) {
+  // (7u16, "abc", secret([1u32, 2u32])), with the secret array in its own stream.
+  const uint8_t publicData[] = {7, 0, 3, 0, 0, 0, 'a', 'b', 'c'};
+  const uint8_t secretData[] = {2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0};
+  runtime_rpcDecoder public_decoder, secret_decoder;
+  runtime_rpcInitDecoder(&public_decoder, publicData, sizeof(publicData));
+  runtime_rpcInitDecoder(&secret_decoder, secretData, sizeof(secretData));
+  uint16_t small;
+  runtime_array string = runtime_makeEmptyArray();
+  runtime_array secretArray = runtime_makeEmptyArray();
+  uint64_t len;
+  assert(runtime_rpcDecodeScalar(&public_decoder, &small, sizeof(small)) && small == 7);
+  assert(runtime_rpcDecodeLength(&public_decoder, &len) && len == 3);
+  assert(runtime_rpcViewBytes(&public_decoder, &string, len));
+  assert((const uint8_t*)string.data == publicData + 6 && string.numElements == 3);
+  assert(runtime_rpcFinishDecoder(&public_decoder));
+  assert(runtime_rpcDecodeLength(&secret_decoder, &len) && len == 2);
+  assert(runtime_rpcCopyScalars(&secret_decoder, &secretArray, len, sizeof(uint32_t), true));
+  assert(runtime_getArrayHeader(&secretArray)->secret);
+  assert(((uint32_t*)secretArray.data)[0] == 1 && ((uint32_t*)secretArray.data)[1] == 2);
+  assert(runtime_rpcFinishDecoder(&secret_decoder));
+  runtime_freeSecretArray(&secretArray);
+  // Truncated messages and lengths beyond the end are rejected.
+  runtime_rpcInitDecoder(&public_decoder, publicData, 8);
+  assert(runtime_rpcDecodeScalar(&public_decoder, &small, sizeof(small)));
+  assert(!runtime_rpcDecodeLength(&public_decoder, &len));
+  const uint8_t badBool[] = {2};
+  bool value;
+  runtime_rpcInitDecoder(&public_decoder, badBool, sizeof(badBool));
+  assert(!runtime_rpcDecodeBool(&public_decoder, &value));
+}
+
 int main(int argc, char **argv) {
   mcheck(NULL);
   runtime_arrayStart();
@@ -422,8 +1602,23 @@ int main(int argc, char **argv) {
   testBigints();
   testSmallnums();
   testSprintf();
+  testSprintfScalars();
+  testFloatToString();
   testInitArrayOfStringFromC();
   testXorStrings();
+  testStringFind();
+  testCodecs();
+  testStringBuilder();
+  testMemoryStats();
+  testHashBytes();
+  testSortNumbers();
+  testSortStrings();
+  testSortPairs();
+  testTrueRandom();
+  testCrypto();
+  testParallelFor();
+  testParallelHeap();
+  testRpcDecoder();
   runtime_arrayStop();
   printf("passed\n");
 }
@@ -0,0 +1,308 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Snapshots of the class database, for programs that call saveSnapshot and
+// loadSnapshot.  The compiler registers a table of every class's global data
+// member arrays and object counters.  A snapshot file has a header, a
+// directory with one entry per table entry, and each array's data, aligned to
+// RN_SNAPSHOT_ALIGN so loadSnapshot can map it in place, copy-on-write.
+// Arrays of arrays, such as string data members, are copied instead.  The
+// header holds a hash of the table's names and types, so a snapshot only
+// loads into the program that wrote it, or one with the same classes.
+
+// For pwrite and pread under -std=c11.
+#define _DEFAULT_SOURCE
+#include "runtime.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RN_SNAPSHOT_VERSION 1
+// At least the page size of any machine we run on.
+#define RN_SNAPSHOT_ALIGN 65536
+// These match the LL_SNAPSHOT_* kinds in the compiler.
+#define RN_SNAPSHOT_SCALAR 0
+#define RN_SNAPSHOT_ARRAY 1
+#define RN_SNAPSHOT_SUBARRAYS 2
+
+static const char runtime_snapshotMagic[8] = {'R', 'U', 'N', 'E', 'S', 'N', 'A', 'P'};
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t numEntries;
+  uint64_t layoutHash;
+} snapshotHeader;
+
+typedef struct {
+  uint64_t offset;  // Where the data starts, for arrays.
+  uint64_t numBytes;  // Bytes of data, for arrays.
+  uint64_t value;  // The number of elements of an array, or a scalar's value.
+} snapshotDirEntry;
+
+static runtime_snapshotEntry *runtime_snapshotEntries;
+static uint32_t runtime_numSnapshotEntries;
+static uint64_t runtime_snapshotLayoutHash;
+
+// Called at the start of main with the compiler's table of class globals.
+void runtime_registerSnapshot(runtime_snapshotEntry *entries, uint32_t numEntries,
+    uint64_t layoutHash) {
+  runtime_snapshotEntries = entries;
+  runtime_numSnapshotEntries = numEntries;
+  runtime_snapshotLayoutHash = layoutHash;
+}
+
+// Round up to a multiple of |align|, which is a power of 2.
+static inline uint64_t roundUp(uint64_t value, uint64_t align) {
+  return (value + align - 1) & ~(align - 1);
+}
+
+// Return the number of bytes the entry's data takes in the file.  Each
+// sub-array is its length followed by its data, padded to 8 bytes.
+static uint64_t entryDataBytes(runtime_snapshotEntry *entry) {
+  runtime_array *array = entry->address;
+  if (entry->kind == RN_SNAPSHOT_ARRAY) {
+    return array->numElements * entry->elementSize;
+  }
+  uint64_t numBytes = 0;
+  runtime_array *subArrays = (runtime_array*)array->data;
+  for (size_t i = 0; i < array->numElements; i++) {
+    numBytes += sizeof(uint64_t) + roundUp(subArrays[i].numElements * entry->elementSize, 8);
+  }
+  return numBytes;
+}
+
+// Write all of |numBytes| at |offset|.  Return false on failure.
+static bool writeAll(int fd, const void *data, uint64_t numBytes, uint64_t offset) {
+  const uint8_t *p = data;
+  while (numBytes != 0) {
+    ssize_t written = pwrite(fd, p, numBytes, offset);
+    if (written <= 0) {
+      return false;
+    }
+    p += written;
+    numBytes -= written;
+    offset += written;
+  }
+  return true;
+}
+
+// Read all of |numBytes| at |offset|.  Return false on failure.
+static bool readAll(int fd, void *data, uint64_t numBytes, uint64_t offset) {
+  uint8_t *p = data;
+  while (numBytes != 0) {
+    ssize_t bytesRead = pread(fd, p, numBytes, offset);
+    if (bytesRead <= 0) {
+      return false;
+    }
+    p += bytesRead;
+    numBytes -= bytesRead;
+    offset += bytesRead;
+  }
+  return true;
+}
+
+// Write the entry's sub-arrays starting at |offset|.
+static bool writeSubArrays(int fd, runtime_snapshotEntry *entry, uint64_t offset) {
+  runtime_array *array = entry->address;
+  runtime_array *subArrays = (runtime_array*)array->data;
+  static const uint8_t padding[8] = {0,};
+  for (size_t i = 0; i < array->numElements; i++) {
+    uint64_t length = subArrays[i].numElements;
+    uint64_t numBytes = length * entry->elementSize;
+    uint64_t padBytes = roundUp(numBytes, 8) - numBytes;
+    if (!writeAll(fd, &length, sizeof(uint64_t), offset) ||
+        !writeAll(fd, subArrays[i].data, numBytes, offset + sizeof(uint64_t)) ||
+        !writeAll(fd, padding, padBytes, offset + sizeof(uint64_t) + numBytes)) {
+      return false;
+    }
+    offset += sizeof(uint64_t) + numBytes + padBytes;
+  }
+  return true;
+}
+
+// Write the snapshot to a temporary file, and rename it over |fileName|, so a
+// failed save never leaves a partial snapshot.
+static bool writeSnapshot(const char *fileName) {
+  size_t tmpNameLen = strlen(fileName) + sizeof(".tmp");
+  char tmpName[tmpNameLen];
+  snprintf(tmpName, tmpNameLen, "%s.tmp", fileName);
+  int fd = open(tmpName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  uint32_t numEntries = runtime_numSnapshotEntries;
+  snapshotHeader header;
+  memcpy(header.magic, runtime_snapshotMagic, sizeof(header.magic));
+  header.version = RN_SNAPSHOT_VERSION;
+  header.numEntries = numEntries;
+  header.layoutHash = runtime_snapshotLayoutHash;
+  snapshotDirEntry directory[numEntries];
+  uint64_t offset = roundUp(sizeof(snapshotHeader) + sizeof(directory), RN_SNAPSHOT_ALIGN);
+  for (uint32_t i = 0; i < numEntries; i++) {
+    runtime_snapshotEntry *entry = runtime_snapshotEntries + i;
+    directory[i].offset = 0;
+    directory[i].numBytes = 0;
+    if (entry->kind == RN_SNAPSHOT_SCALAR) {
+      directory[i].value = 0;
+      memcpy(&directory[i].value, entry->address, entry->elementSize);
+    } else if (entry->kind == RN_SNAPSHOT_ARRAY || entry->kind == RN_SNAPSHOT_SUBARRAYS) {
+      directory[i].offset = offset;
+      directory[i].numBytes = entryDataBytes(entry);
+      directory[i].value = ((runtime_array*)entry->address)->numElements;
+      offset = roundUp(offset + directory[i].numBytes, RN_SNAPSHOT_ALIGN);
+    } else {
+      close(fd);
+      remove(tmpName);
+      runtime_panicCstr("Cannot snapshot data members holding arrays of arrays");
+    }
+  }
+  bool passed = writeAll(fd, &header, sizeof(header), 0) &&
+      writeAll(fd, directory, sizeof(directory), sizeof(header));
+  for (uint32_t i = 0; i < numEntries && passed; i++) {
+    runtime_snapshotEntry *entry = runtime_snapshotEntries + i;
+    if (entry->kind == RN_SNAPSHOT_ARRAY) {
+      passed = writeAll(fd, ((runtime_array*)entry->address)->data, directory[i].numBytes,
+          directory[i].offset);
+    } else if (entry->kind == RN_SNAPSHOT_SUBARRAYS) {
+      passed = writeSubArrays(fd, entry, directory[i].offset);
+    }
+  }
+  // Extend the file to the aligned end of the last array, so it can be mapped.
+  passed = passed && ftruncate(fd, offset) == 0;
+  passed = close(fd) == 0 && passed;
+  if (passed) {
+    passed = rename(tmpName, fileName) == 0;
+  }
+  if (!passed) {
+    remove(tmpName);
+  }
+  return passed;
+}
+
+// Restore the entry's sub-arrays.  Each is allocated in a
+// temporary first, since allocating can move the outer array's buffer.
+static bool readSubArrays(int fd, runtime_snapshotEntry *entry, snapshotDirEntry *dirEntry) {
+  runtime_array *array = entry->address;
+  uint64_t numElements = dirEntry->value;
+  runtime_allocArray(array, numElements, sizeof(runtime_array), true);
+  uint64_t offset = dirEntry->offset;
+  uint64_t end = offset + dirEntry->numBytes;
+  for (uint64_t i = 0; i < numElements; i++) {
+    uint64_t length;
+    if (offset + sizeof(uint64_t) > end || !readAll(fd, &length, sizeof(uint64_t), offset)) {
+      return false;
+    }
+    offset += sizeof(uint64_t);
+    uint64_t numBytes = length * entry->elementSize;
+    if (length != 0 && (numBytes / length != entry->elementSize || numBytes > end - offset)) {
+      return false;
+    }
+    if (length != 0) {
+      runtime_array subArray = runtime_makeEmptyArray();
+      runtime_allocArray(&subArray, length, entry->elementSize, false);
+      if (!readAll(fd, subArray.data, numBytes, offset)) {
+        runtime_freeArray(&subArray);
+        return false;
+      }
+      runtime_moveArray((runtime_array*)array->data + i, &subArray);
+    }
+    offset += roundUp(numBytes, 8);
+  }
+  return true;
+}
+
+// Restore the entry's array, mapping it from the file if possible.
+static bool readArray(int fd, runtime_snapshotEntry *entry, snapshotDirEntry *dirEntry) {
+  runtime_array *array = entry->address;
+  uint64_t numElements = dirEntry->value;
+  if (numElements == 0) {
+    return true;
+  }
+  if (dirEntry->numBytes != numElements * entry->elementSize) {
+    return false;
+  }
+  if (runtime_mapFileArrayAt(array, fd, dirEntry->offset, numElements, entry->elementSize)) {
+    return true;
+  }
+  runtime_allocArray(array, numElements, entry->elementSize, false);
+  return readAll(fd, array->data, dirEntry->numBytes, dirEntry->offset);
+}
+
+// Read the snapshot file into the registered globals.
+static bool readSnapshot(const char *fileName) {
+  int fd = open(fileName, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  uint32_t numEntries = runtime_numSnapshotEntries;
+  snapshotHeader header;
+  snapshotDirEntry directory[numEntries];
+  if (!readAll(fd, &header, sizeof(header), 0) ||
+      memcmp(header.magic, runtime_snapshotMagic, sizeof(header.magic)) ||
+      header.version != RN_SNAPSHOT_VERSION || header.numEntries != numEntries ||
+      header.layoutHash != runtime_snapshotLayoutHash ||
+      !readAll(fd, directory, sizeof(directory), sizeof(header))) {
+    close(fd);
+    return false;
+  }
+  // Free everything first, so arrays being restored do not compete with the
+  // current ones for heap space.
+  for (uint32_t i = 0; i < numEntries; i++) {
+    runtime_snapshotEntry *entry = runtime_snapshotEntries + i;
+    if (entry->kind != RN_SNAPSHOT_SCALAR) {
+      runtime_freeArray(entry->address);
+    }
+  }
+  bool passed = true;
+  for (uint32_t i = 0; i < numEntries && passed; i++) {
+    runtime_snapshotEntry *entry = runtime_snapshotEntries + i;
+    if (entry->kind == RN_SNAPSHOT_SCALAR) {
+      memcpy(entry->address, &directory[i].value, entry->elementSize);
+    } else if (entry->kind == RN_SNAPSHOT_ARRAY) {
+      passed = readArray(fd, entry, directory + i);
+    } else {
+      passed = readSubArrays(fd, entry, directory + i);
+    }
+  }
+  // Mappings stay valid after the file is closed.
+  close(fd);
+  if (!passed) {
+    runtime_panicCstr("Snapshot %s is truncated or corrupt", fileName);
+  }
+  return true;
+}
+
+// Write every class's data members and object counters to |fileName|.
+// Return false if the file cannot be written.
+bool saveSnapshot(const runtime_array *fileName) {
+  size_t len = fileName->numElements;
+  char fileNameCstr[len + 1];
+  memcpy(fileNameCstr, fileName->data, len);
+  fileNameCstr[len] = '\0';
+  return writeSnapshot(fileNameCstr);
+}
+
+// Replace every class's data members and object counters with those saved in
+// |fileName|.  Return false, leaving them as they were, if the file does not
+// exist, or was written by a program with different classes.
+bool loadSnapshot(const runtime_array *fileName) {
+  size_t len = fileName->numElements;
+  char fileNameCstr[len + 1];
+  memcpy(fileNameCstr, fileName->data, len);
+  fileNameCstr[len] = '\0';
+  return readSnapshot(fileNameCstr);
+}
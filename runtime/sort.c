@@ -0,0 +1,521 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// In-place sorts for arrays of primitive types, called from Array.sort, and
+// key/value pair sorts for Array.sortBy.  Integers are sorted with an LSD
+// radix sort, one byte per pass, skipping passes where every element has the
+// same byte.  Floats and strings are sorted with pattern-defeating quicksort:
+// introsort with median-of-3 or ninther pivots, a partial insertion sort that
+// finishes already sorted runs early, a partition that groups elements equal to
+// the previous pivot, and a heapsort fallback after too many bad partitions.
+// NaNs sort after every other float.
+
+#include "runtime.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Radix sort is not worth its passes over the data for small arrays.
+#define RN_RADIX_MIN_ELEMENTS 64
+// Quicksort partitions smaller than this are insertion sorted.
+#define RN_INSERTION_SORT_THRESHOLD 24
+// Use the ninther of 9 elements rather than the median of 3 above this size.
+#define RN_NINTHER_THRESHOLD 128
+// A partial insertion sort gives up after moving this many elements.
+#define RN_PARTIAL_INSERTION_SORT_LIMIT 8
+
+static void *allocSortBuffer(size_t numBytes) {
+  void *buf = malloc(numBytes);
+  if (buf == NULL) {
+    runtime_panicCstr("Out of memory");
+  }
+  return buf;
+}
+
+// Define name##Sort(type *a, size_t n), a pattern-defeating quicksort using the
+// strict weak ordering less(a, b).  Its arguments have side effects, so less
+// must be a function, not a macro.
+#define RN_DEFINE_PDQSORT(name, type, less) \
+static void name##InsertionSort(type *a, size_t n) { \
+  for (size_t i = 1; i < n; i++) { \
+    type x = a[i]; \
+    size_t j = i; \
+    while (j > 0 && less(x, a[j - 1])) { \
+      a[j] = a[j - 1]; \
+      j--; \
+    } \
+    a[j] = x; \
+  } \
+} \
+\
+/* Insertion sort a, unless that takes too many moves.  Return true if sorted. */ \
+static bool name##PartialInsertionSort(type *a, size_t n) { \
+  size_t moves = 0; \
+  for (size_t i = 1; i < n; i++) { \
+    if (less(a[i], a[i - 1])) { \
+      type x = a[i]; \
+      size_t j = i; \
+      do { \
+        a[j] = a[j - 1]; \
+        j--; \
+      } while (j > 0 && less(x, a[j - 1])); \
+      a[j] = x; \
+      moves += i - j; \
+      if (moves > RN_PARTIAL_INSERTION_SORT_LIMIT) { \
+        return false; \
+      } \
+    } \
+  } \
+  return true; \
+} \
+\
+static void name##SiftDown(type *a, size_t root, size_t n) { \
+  type x = a[root]; \
+  size_t child; \
+  while ((child = 2 * root + 1) < n) { \
+    if (child + 1 < n && less(a[child], a[child + 1])) { \
+      child++; \
+    } \
+    if (!less(x, a[child])) { \
+      break; \
+    } \
+    a[root] = a[child]; \
+    root = child; \
+  } \
+  a[root] = x; \
+} \
+\
+static void name##HeapSort(type *a, size_t n) { \
+  for (size_t i = n / 2; i-- > 0;) { \
+    name##SiftDown(a, i, n); \
+  } \
+  for (size_t i = n; i-- > 1;) { \
+    type x = a[0]; \
+    a[0] = a[i]; \
+    a[i] = x; \
+    name##SiftDown(a, 0, i); \
+  } \
+} \
+\
+static inline void name##Swap(type *x, type *y) { \
+  type t = *x; \
+  *x = *y; \
+  *y = t; \
+} \
+\
+static inline void name##Sort2(type *x, type *y) { \
+  if (less(*y, *x)) { \
+    name##Swap(x, y); \
+  } \
+} \
+\
+/* Leave the median of *x, *y and *z in *y. */ \
+static inline void name##Sort3(type *x, type *y, type *z) { \
+  name##Sort2(x, y); \
+  name##Sort2(y, z); \
+  name##Sort2(x, y); \
+} \
+\
+/* Partition around a[0], with elements < pivot on the left.  a[n-1] must be */ \
+/* >= the pivot.  Return the pivot's final position, and set *alreadyPartitioned */ \
+/* if no elements were swapped. */ \
+static size_t name##PartitionRight(type *a, size_t n, bool *alreadyPartitioned) { \
+  type pivot = a[0]; \
+  size_t first = 0; \
+  size_t last = n; \
+  while (less(a[++first], pivot)); \
+  if (first == 1) { \
+    while (first < last && !less(a[--last], pivot)); \
+  } else { \
+    while (!less(a[--last], pivot)); \
+  } \
+  *alreadyPartitioned = first >= last; \
+  while (first < last) { \
+    name##Swap(a + first, a + last); \
+    while (less(a[++first], pivot)); \
+    while (!less(a[--last], pivot)); \
+  } \
+  size_t pivotPos = first - 1; \
+  a[0] = a[pivotPos]; \
+  a[pivotPos] = pivot; \
+  return pivotPos; \
+} \
+\
+/* Partition around a[0], with elements equal to the pivot on the left, */ \
+/* when the element before a is known to be <= every element of a. */ \
+static size_t name##PartitionLeft(type *a, size_t n) { \
+  type pivot = a[0]; \
+  size_t first = 0; \
+  size_t last = n; \
+  while (less(pivot, a[--last])); \
+  if (last + 1 == n) { \
+    while (first < last && !less(pivot, a[++first])); \
+  } else { \
+    while (!less(pivot, a[++first])); \
+  } \
+  while (first < last) { \
+    name##Swap(a + first, a + last); \
+    while (less(pivot, a[--last])); \
+    while (!less(pivot, a[++first])); \
+  } \
+  a[0] = a[last]; \
+  a[last] = pivot; \
+  return last; \
+} \
+\
+static void name##SortLoop(type *a, size_t n, uint32_t badAllowed, bool leftmost) { \
+  while (n >= RN_INSERTION_SORT_THRESHOLD) { \
+    size_t half = n / 2; \
+    if (n > RN_NINTHER_THRESHOLD) { \
+      name##Sort3(a, a + half, a + n - 1); \
+      name##Sort3(a + 1, a + half - 1, a + n - 2); \
+      name##Sort3(a + 2, a + half + 1, a + n - 3); \
+      name##Sort3(a + half - 1, a + half, a + half + 1); \
+      name##Swap(a, a + half); \
+    } else { \
+      name##Sort3(a + half, a, a + n - 1); \
+    } \
+    /* Equal to the last pivot: skip the run of elements equal to it. */ \
+    if (!leftmost && !less(a[-1], a[0])) { \
+      size_t pivotPos = name##PartitionLeft(a, n); \
+      a += pivotPos + 1; \
+      n -= pivotPos + 1; \
+      continue; \
+    } \
+    bool alreadyPartitioned; \
+    size_t pivotPos = name##PartitionRight(a, n, &alreadyPartitioned); \
+    size_t leftSize = pivotPos; \
+    size_t rightSize = n - pivotPos - 1; \
+    if (leftSize < n / 8 || rightSize < n / 8) { \
+      if (--badAllowed == 0) { \
+        name##HeapSort(a, n); \
+        return; \
+      } \
+      /* Break up patterns that produce bad pivots. */ \
+      if (leftSize >= RN_INSERTION_SORT_THRESHOLD) { \
+        name##Swap(a, a + leftSize / 4); \
+        name##Swap(a + pivotPos - 1, a + pivotPos - leftSize / 4); \
+      } \
+      if (rightSize >= RN_INSERTION_SORT_THRESHOLD) { \
+        name##Swap(a + pivotPos + 1, a + pivotPos + 1 + rightSize / 4); \
+        name##Swap(a + n - 1, a + n - rightSize / 4); \
+      } \
+    } else if (alreadyPartitioned && \
+        name##PartialInsertionSort(a, pivotPos) && \
+        name##PartialInsertionSort(a + pivotPos + 1, rightSize)) { \
+      return; \
+    } \
+    /* Recurse into the smaller side, and loop on the larger, to bound the stack. */ \
+    if (leftSize < rightSize) { \
+      name##SortLoop(a, leftSize, badAllowed, leftmost); \
+      a += pivotPos + 1; \
+      n = rightSize; \
+      leftmost = false; \
+    } else { \
+      name##SortLoop(a + pivotPos + 1, rightSize, badAllowed, false); \
+      n = leftSize; \
+    } \
+  } \
+  name##InsertionSort(a, n); \
+} \
+\
+static void name##Sort(type *a, size_t n) { \
+  uint32_t badAllowed = 1; \
+  while (((size_t)1 << badAllowed) < n) { \
+    badAllowed++; \
+  } \
+  name##SortLoop(a, n, badAllowed, true); \
+}
+
+// Define name(utype *a, size_t n, utype flip), an LSD radix sort of unsigned
+// integers, comparing each element xor flip, so signed integers are sorted by
+// passing their sign bit.
+#define RN_DEFINE_RADIX_SORT(name, utype) \
+static inline bool name##Less(utype a, utype b, utype flip) { \
+  return (a ^ flip) < (b ^ flip); \
+} \
+\
+static void name(utype *a, size_t n, utype flip) { \
+  if (n < RN_RADIX_MIN_ELEMENTS) { \
+    for (size_t i = 1; i < n; i++) { \
+      utype x = a[i]; \
+      size_t j = i; \
+      while (j > 0 && name##Less(x, a[j - 1], flip)) { \
+        a[j] = a[j - 1]; \
+        j--; \
+      } \
+      a[j] = x; \
+    } \
+    return; \
+  } \
+  size_t (*counts)[256] = calloc(sizeof(utype), sizeof(size_t[256])); \
+  utype *buf = allocSortBuffer(n * sizeof(utype)); \
+  if (counts == NULL) { \
+    runtime_panicCstr("Out of memory"); \
+  } \
+  for (size_t i = 0; i < n; i++) { \
+    utype x = a[i] ^ flip; \
+    for (uint32_t pass = 0; pass < sizeof(utype); pass++) { \
+      counts[pass][(x >> (8 * pass)) & 0xff]++; \
+    } \
+  } \
+  utype *src = a; \
+  utype *dest = buf; \
+  for (uint32_t pass = 0; pass < sizeof(utype); pass++) { \
+    uint32_t shift = 8 * pass; \
+    size_t *count = counts[pass]; \
+    if (count[((src[0] ^ flip) >> shift) & 0xff] == n) { \
+      continue;  /* Every element has the same byte here. */ \
+    } \
+    size_t offset = 0; \
+    for (uint32_t digit = 0; digit < 256; digit++) { \
+      size_t c = count[digit]; \
+      count[digit] = offset; \
+      offset += c; \
+    } \
+    for (size_t i = 0; i < n; i++) { \
+      utype x = src[i]; \
+      dest[count[((x ^ flip) >> shift) & 0xff]++] = x; \
+    } \
+    utype *t = src; \
+    src = dest; \
+    dest = t; \
+  } \
+  if (src != a) { \
+    memcpy(a, src, n * sizeof(utype)); \
+  } \
+  free(buf); \
+  free(counts); \
+}
+
+RN_DEFINE_RADIX_SORT(radixSortU8, uint8_t)
+RN_DEFINE_RADIX_SORT(radixSortU16, uint16_t)
+RN_DEFINE_RADIX_SORT(radixSortU32, uint32_t)
+RN_DEFINE_RADIX_SORT(radixSortU64, uint64_t)
+
+// NaNs compare greater than everything else, and equal to each other.
+static inline bool f32Less(float a, float b) {
+  return a < b || (isnan(b) && !isnan(a));
+}
+
+static inline bool f64Less(double a, double b) {
+  return a < b || (isnan(b) && !isnan(a));
+}
+
+RN_DEFINE_PDQSORT(f32, float, f32Less)
+RN_DEFINE_PDQSORT(f64, double, f64Less)
+
+// Compare strings byte by byte, with a prefix before longer strings.
+static inline int compareStrings(const runtime_array *a, const runtime_array *b) {
+  size_t len = a->numElements < b->numElements? a->numElements : b->numElements;
+  int result = len == 0? 0 : memcmp(a->data, b->data, len);
+  if (result != 0) {
+    return result;
+  }
+  return a->numElements < b->numElements? -1 : a->numElements > b->numElements;
+}
+
+static inline bool stringLess(runtime_array a, runtime_array b) {
+  return compareStrings(&a, &b) < 0;
+}
+
+RN_DEFINE_PDQSORT(string, runtime_array, stringLess)
+
+// Sorting moves the strings' runtime_array structs, so the heap's back pointers
+// to them must be updated.
+static void updateStringBackPointers(runtime_array *strings, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    runtime_updateArrayBackPointer(strings + i);
+  }
+}
+
+void sortU8Array(runtime_array *array) {
+  radixSortU8((uint8_t*)array->data, array->numElements, 0);
+}
+
+void sortU16Array(runtime_array *array) {
+  radixSortU16((uint16_t*)array->data, array->numElements, 0);
+}
+
+void sortU32Array(runtime_array *array) {
+  radixSortU32((uint32_t*)array->data, array->numElements, 0);
+}
+
+void sortU64Array(runtime_array *array) {
+  radixSortU64((uint64_t*)array->data, array->numElements, 0);
+}
+
+void sortI8Array(runtime_array *array) {
+  radixSortU8((uint8_t*)array->data, array->numElements, (uint8_t)1 << 7);
+}
+
+void sortI16Array(runtime_array *array) {
+  radixSortU16((uint16_t*)array->data, array->numElements, (uint16_t)1 << 15);
+}
+
+void sortI32Array(runtime_array *array) {
+  radixSortU32((uint32_t*)array->data, array->numElements, (uint32_t)1 << 31);
+}
+
+void sortI64Array(runtime_array *array) {
+  radixSortU64((uint64_t*)array->data, array->numElements, (uint64_t)1 << 63);
+}
+
+void sortF32Array(runtime_array *array) {
+  f32Sort((float*)array->data, array->numElements);
+}
+
+void sortF64Array(runtime_array *array) {
+  f64Sort((double*)array->data, array->numElements);
+}
+
+void sortStringArray(runtime_array *array) {
+  stringSort((runtime_array*)array->data, array->numElements);
+  updateStringBackPointers((runtime_array*)array->data, array->numElements);
+}
+
+// Pairs sorted by key, then by value.  Values are the elements' original
+// indexes, which makes the sorts stable.
+typedef struct {
+  double key;
+  uint64_t value;
+} runtime_f64Pair;
+
+typedef struct {
+  runtime_array key;
+  uint64_t value;
+} runtime_stringPair;
+
+static inline bool f64PairLess(runtime_f64Pair a, runtime_f64Pair b) {
+  return f64Less(a.key, b.key) || (!f64Less(b.key, a.key) && a.value < b.value);
+}
+
+static inline bool stringPairLess(runtime_stringPair a, runtime_stringPair b) {
+  int result = compareStrings(&a.key, &b.key);
+  return result < 0 || (result == 0 && a.value < b.value);
+}
+
+RN_DEFINE_PDQSORT(f64Pair, runtime_f64Pair, f64PairLess)
+RN_DEFINE_PDQSORT(stringPair, runtime_stringPair, stringPairLess)
+
+static void checkPairLengths(const runtime_array *keys, const runtime_array *values) {
+  if (keys->numElements != values->numElements) {
+    runtime_panicCstr("Sorting %lu keys with %lu values", keys->numElements, values->numElements);
+  }
+}
+
+// Sort keys, moving values along with them.  The sort is stable.
+void sortU64Pairs(runtime_array *keys, runtime_array *values) {
+  checkPairLengths(keys, values);
+  size_t n = keys->numElements;
+  uint64_t *k = (uint64_t*)keys->data;
+  uint64_t *v = (uint64_t*)values->data;
+  if (n < RN_RADIX_MIN_ELEMENTS) {
+    for (size_t i = 1; i < n; i++) {
+      uint64_t key = k[i];
+      uint64_t value = v[i];
+      size_t j = i;
+      while (j > 0 && key < k[j - 1]) {
+        k[j] = k[j - 1];
+        v[j] = v[j - 1];
+        j--;
+      }
+      k[j] = key;
+      v[j] = value;
+    }
+    return;
+  }
+  size_t (*counts)[256] = calloc(sizeof(uint64_t), sizeof(size_t[256]));
+  uint64_t *buf = allocSortBuffer(2 * n * sizeof(uint64_t));
+  if (counts == NULL) {
+    runtime_panicCstr("Out of memory");
+  }
+  for (size_t i = 0; i < n; i++) {
+    for (uint32_t pass = 0; pass < sizeof(uint64_t); pass++) {
+      counts[pass][(k[i] >> (8 * pass)) & 0xff]++;
+    }
+  }
+  uint64_t *srcKeys = k, *srcValues = v;
+  uint64_t *destKeys = buf, *destValues = buf + n;
+  for (uint32_t pass = 0; pass < sizeof(uint64_t); pass++) {
+    uint32_t shift = 8 * pass;
+    size_t *count = counts[pass];
+    if (count[(srcKeys[0] >> shift) & 0xff] == n) {
+      continue;
+    }
+    size_t offset = 0;
+    for (uint32_t digit = 0; digit < 256; digit++) {
+      size_t c = count[digit];
+      count[digit] = offset;
+      offset += c;
+    }
+    for (size_t i = 0; i < n; i++) {
+      size_t pos = count[(srcKeys[i] >> shift) & 0xff]++;
+      destKeys[pos] = srcKeys[i];
+      destValues[pos] = srcValues[i];
+    }
+    uint64_t *t = srcKeys;
+    srcKeys = destKeys;
+    destKeys = t;
+    t = srcValues;
+    srcValues = destValues;
+    destValues = t;
+  }
+  if (srcKeys != k) {
+    memcpy(k, srcKeys, n * sizeof(uint64_t));
+    memcpy(v, srcValues, n * sizeof(uint64_t));
+  }
+  free(buf);
+  free(counts);
+}
+
+// Sort keys, moving values along with them.  Values must be distinct, as they
+// break ties.
+void sortF64Pairs(runtime_array *keys, runtime_array *values) {
+  checkPairLengths(keys, values);
+  size_t n = keys->numElements;
+  double *k = (double*)keys->data;
+  uint64_t *v = (uint64_t*)values->data;
+  runtime_f64Pair *pairs = allocSortBuffer(n * sizeof(runtime_f64Pair));
+  for (size_t i = 0; i < n; i++) {
+    pairs[i].key = k[i];
+    pairs[i].value = v[i];
+  }
+  f64PairSort(pairs, n);
+  for (size_t i = 0; i < n; i++) {
+    k[i] = pairs[i].key;
+    v[i] = pairs[i].value;
+  }
+  free(pairs);
+}
+
+// Sort keys, moving values along with them.  Values must be distinct, as they
+// break ties.
+void sortStringPairs(runtime_array *keys, runtime_array *values) {
+  checkPairLengths(keys, values);
+  size_t n = keys->numElements;
+  runtime_array *k = (runtime_array*)keys->data;
+  uint64_t *v = (uint64_t*)values->data;
+  runtime_stringPair *pairs = allocSortBuffer(n * sizeof(runtime_stringPair));
+  for (size_t i = 0; i < n; i++) {
+    pairs[i].key = k[i];
+    pairs[i].value = v[i];
+  }
+  stringPairSort(pairs, n);
+  for (size_t i = 0; i < n; i++) {
+    k[i] = pairs[i].key;
+    v[i] = pairs[i].value;
+  }
+  free(pairs);
+  updateStringBackPointers(k, n);
+}
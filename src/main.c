@@ -18,11 +18,29 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#ifndef _WIN32
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
 
 #include "llexport.h"
 
+// The number of parts -incremental splits the LLVM module into, unless -j asks
+// for more.
+#define DE_INCREMENTAL_PARTS 32
+// The -incremental cache keeps this many objects per part, least recently used
+// first out, so builds with a few sets of flags or versions all hit.
+#define DE_INCREMENTAL_CACHED_PER_PART 8
+
 static char *deClangPath = "clang";
 static char *deExtraClangParams = NULL;
+// Clang's profile-guided optimization flags, from -profile-generate or
+// -profile-use.
+static char *deClangProfileFlags = "";
 
 // Run the Clang compiler on the LLVM code we generated.
 static int runClangCompiler(char *llvmFileName, bool debugMode, bool optimized) {
@@ -31,8 +49,8 @@ static int runClangCompiler(char *llvmFileName, bool debugMode, bool optimized)
   if (debugMode) {
     optFlag = "-g -O0";
   }
-  char *command = utSprintf("%s %s -fPIC -o %s %s %s/librune.a %s/libcttk.a",
-      deClangPath, optFlag, outFileName, llvmFileName, deLibDir, deLibDir);
+  char *command = utSprintf("%s %s%s -fPIC -o %s %s %s/librune.a %s/libcttk.a -lpthread",
+      deClangPath, optFlag, deClangProfileFlags, outFileName, llvmFileName, deLibDir, deLibDir);
   if (deExtraClangParams != NULL) {
     command = utSprintf("%s %s", command, deExtraClangParams);
   }
@@ -40,21 +58,485 @@ static int runClangCompiler(char *llvmFileName, bool debugMode, bool optimized)
   return system(command);
 }
 
+// Optimize the LLVM module and emit its object file in process with the LLVM C
+// API, and then just run clang to link it.  If |moduleText| is not NULL, it is
+// the module's text, which is parsed rather than the file.  PGO builds still
+// use clang, which adds the instrumentation passes.
+static int runInProcessCompiler(char *llvmFileName, char *moduleText, size_t moduleLength,
+    bool debugMode, bool optimized) {
+  char *outFileName = utAllocString(utReplaceSuffix(llvmFileName, ""));
+  char *objectFileName = utAllocString(utSprintf("%s.o", outFileName));
+  if (!llCompileToObject(llvmFileName, moduleText, moduleLength, objectFileName, optimized,
+      debugMode)) {
+    utFree(outFileName);
+    utFree(objectFileName);
+    return 1;
+  }
+  char *command = utSprintf("%s -fPIC -o %s %s %s/librune.a %s/libcttk.a -lpthread",
+      deClangPath, outFileName, objectFileName, deLibDir, deLibDir);
+  if (deExtraClangParams != NULL) {
+    command = utSprintf("%s %s", command, deExtraClangParams);
+  }
+  utDebug("Executing: %s\n", command);
+  int rc = system(command);
+  remove(objectFileName);
+  utFree(outFileName);
+  utFree(objectFileName);
+  return rc;
+}
+
+// Return the named LLVM tool from the same directory as clang.
+static char *findLlvmToolPath(char *tool) {
+  if (strchr(deClangPath, '/') == NULL) {
+    return tool;
+  }
+  return utSprintf("%s/%s", utDirName(deClangPath), tool);
+}
+
+// Merge the runtime's bitcode, librune.bc, into the generated module with
+// llvm-link, so clang can inline runtime helpers into Rune code.  Only the
+// runtime functions the module uses are linked, and they are internalized so
+// the optimizer can drop them once inlined.  Return the name of the merged
+// bitcode file, or NULL if llvm-link fails.
+static char *linkRuntimeBitcode(char *llvmFileName) {
+  char *bitcodeFileName = utAllocString(utReplaceSuffix(llvmFileName, ".bc"));
+  char *command = utSprintf("%s --only-needed --internalize -o %s %s %s/librune.bc",
+      findLlvmToolPath("llvm-link"), bitcodeFileName, llvmFileName, deLibDir);
+  utDebug("Executing: %s\n", command);
+  if (system(command) != 0) {
+    utFree(bitcodeFileName);
+    return NULL;
+  }
+  return bitcodeFileName;
+}
+
+#ifndef _WIN32
+
+// Run the shell commands, at most |maxProcesses| at a time, and return the
+// number that failed.
+static uint32 runCommandsInParallel(char **commands, uint32 numCommands, uint32 maxProcesses) {
+  uint32 numFailed = 0;
+  uint32 numRunning = 0;
+  for (uint32 i = 0; i < numCommands; i++) {
+    if (numRunning == maxProcesses) {
+      int status;
+      if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        numFailed++;
+      }
+      numRunning--;
+    }
+    utDebug("Executing: %s\n", commands[i]);
+    pid_t pid = fork();
+    if (pid == 0) {
+      execl("/bin/sh", "sh", "-c", commands[i], (char*)NULL);
+      _exit(127);
+    }
+    if (pid < 0) {
+      numFailed++;
+    } else {
+      numRunning++;
+    }
+  }
+  while (numRunning != 0) {
+    int status;
+    if (wait(&status) < 0) {
+      numFailed += numRunning;
+      break;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      numFailed++;
+    }
+    numRunning--;
+  }
+  return numFailed;
+}
+
+// Determine if the character can be part of an unquoted LLVM identifier.
+static bool isLlvmNameChar(char c) {
+  return isalnum((uint8)c) || c == '-' || c == '$' || c == '.' || c == '_';
+}
+
+// A private or internal global defined in a part, and its number in the part.
+typedef struct {
+  char *name;
+  int32 number;
+} dePartGlobal;
+
+// Compare part globals by name, for qsort and bsearch.
+static int comparePartGlobals(const void *a, const void *b) {
+  return strcmp(((const dePartGlobal*)a)->name, ((const dePartGlobal*)b)->name);
+}
+
+// Find the end of the identifier starting at |name|.
+static char *skipLlvmName(char *name) {
+  while (isLlvmNameChar(*name)) {
+    name++;
+  }
+  return name;
+}
+
+// Rewrite the part file so its private and internal globals, like @.str12, and
+// its metadata nodes, like !34, are numbered in order of appearance in the
+// part.  genllvm numbers them across the whole module, so otherwise adding a
+// string constant anywhere would change every later part, and its hash.
+// Globals shared with other parts have external linkage, and keep their names.
+// Return false if the file cannot be rewritten.
+static bool canonicalizePartFile(char *fileName) {
+  FILE *file = fopen(fileName, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char *text = utNewA(char, length + 1);
+  size_t numRead = fread(text, 1, length, file);
+  fclose(file);
+  text[numRead] = '\0';
+  uint32 numGlobals = 0, globalsAllocated = 64;
+  dePartGlobal *globals = utNewA(dePartGlobal, globalsAllocated);
+  uint32 maxMetadata = 0;
+  char *line = text;
+  while (*line != '\0') {
+    if (*line == '@') {
+      char *end = skipLlvmName(line + 1);
+      if (!strncmp(end, " = private ", 11) || !strncmp(end, " = internal ", 12)) {
+        if (numGlobals == globalsAllocated) {
+          globalsAllocated <<= 1;
+          utResizeArray(globals, globalsAllocated);
+        }
+        char saved = *end;
+        *end = '\0';
+        globals[numGlobals].name = utAllocString(line + 1);
+        globals[numGlobals++].number = -1;
+        *end = saved;
+      }
+    } else if (*line == '!' && isdigit((uint8)line[1])) {
+      uint32 number = atoi(line + 1);
+      if (number > maxMetadata) {
+        maxMetadata = number;
+      }
+    }
+    line += strcspn(line, "\n");
+    if (*line == '\n') {
+      line++;
+    }
+  }
+  qsort(globals, numGlobals, sizeof(dePartGlobal), comparePartGlobals);
+  int32 *metadataNumbers = utNewA(int32, maxMetadata + 1);
+  for (uint32 i = 0; i <= maxMetadata; i++) {
+    metadataNumbers[i] = -1;
+  }
+  char *tmpName = utAllocString(utSprintf("%s.canonical", fileName));
+  file = fopen(tmpName, "wb");
+  bool success = file != NULL;
+  int32 nextGlobal = 0, nextMetadata = 0;
+  bool inQuote = false;
+  for (char *p = text; success && *p != '\0'; p++) {
+    char c = *p;
+    if (c == '"') {
+      inQuote = !inQuote;  // Quotes in IR strings are escaped as \22.
+    } else if (!inQuote && c == '@' && isLlvmNameChar(p[1])) {
+      char *end = skipLlvmName(p + 1);
+      char saved = *end;
+      *end = '\0';
+      dePartGlobal key = {p + 1, 0};
+      dePartGlobal *global = bsearch(&key, globals, numGlobals, sizeof(dePartGlobal),
+          comparePartGlobals);
+      if (global != NULL) {
+        if (global->number < 0) {
+          global->number = nextGlobal++;
+        }
+        fprintf(file, "@.part%d", global->number);
+      } else {
+        fprintf(file, "@%s", p + 1);
+      }
+      *end = saved;
+      p = end - 1;
+      continue;
+    } else if (!inQuote && c == '!' && isdigit((uint8)p[1])) {
+      char *end;
+      uint32 number = strtoul(p + 1, &end, 10);
+      if (number <= maxMetadata) {
+        if (metadataNumbers[number] < 0) {
+          metadataNumbers[number] = nextMetadata++;
+        }
+        number = metadataNumbers[number];
+      }
+      fprintf(file, "!%u", number);
+      p = end - 1;
+      continue;
+    }
+    putc(c, file);
+  }
+  if (file != NULL && fclose(file) != 0) {
+    success = false;
+  }
+  if (success) {
+    success = rename(tmpName, fileName) == 0;
+  } else {
+    remove(tmpName);
+  }
+  for (uint32 i = 0; i < numGlobals; i++) {
+    utFree(globals[i].name);
+  }
+  utFree(globals);
+  utFree(metadataNumbers);
+  utFree(tmpName);
+  utFree(text);
+  return success;
+}
+
+// A cached object and when it was last used.
+typedef struct {
+  char *name;
+  time_t lastUsed;
+} deCachedObject;
+
+// Compare cached objects, most recently used first, for qsort.
+static int compareCachedObjects(const void *a, const void *b) {
+  time_t timeA = ((const deCachedObject*)a)->lastUsed;
+  time_t timeB = ((const deCachedObject*)b)->lastUsed;
+  return timeA > timeB? -1 : timeA < timeB;
+}
+
+// Remove all but the |maxObjects| most recently used objects from the cache.
+// Objects are touched each time they are linked, so their modification time is
+// when they were last used.
+static void pruneCache(char *cacheDir, uint32 maxObjects) {
+  DIR *dir = opendir(cacheDir);
+  if (dir == NULL) {
+    return;
+  }
+  uint32 numObjects = 0, objectsAllocated = 64;
+  deCachedObject *objects = utNewA(deCachedObject, objectsAllocated);
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    size_t length = strlen(entry->d_name);
+    struct stat info;
+    char *path = utSprintf("%s/%s", cacheDir, entry->d_name);
+    if (length < 2 || strcmp(entry->d_name + length - 2, ".o") || stat(path, &info) != 0) {
+      continue;
+    }
+    if (numObjects == objectsAllocated) {
+      objectsAllocated <<= 1;
+      utResizeArray(objects, objectsAllocated);
+    }
+    objects[numObjects].name = utAllocString(path);
+    objects[numObjects++].lastUsed = info.st_mtime;
+  }
+  closedir(dir);
+  qsort(objects, numObjects, sizeof(deCachedObject), compareCachedObjects);
+  for (uint32 i = 0; i < numObjects; i++) {
+    if (i >= maxObjects) {
+      remove(objects[i].name);
+    }
+    utFree(objects[i].name);
+  }
+  utFree(objects);
+}
+
+// Return a hash of the file's contents and the flags it is compiled with, or 0
+// if it cannot be read.
+static uint64 hashPartFile(char *fileName, char *flags) {
+  FILE *file = fopen(fileName, "rb");
+  if (file == NULL) {
+    return 0;
+  }
+  uint64 hash = 0xcbf29ce484222325ULL;
+  int c;
+  while ((c = getc(file)) != EOF) {
+    hash = (hash ^ (uint8)c) * 0x100000001b3ULL;
+  }
+  fclose(file);
+  for (char *p = flags; *p != '\0'; p++) {
+    hash = (hash ^ (uint8)*p) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Split the LLVM module into |numParts| modules with llvm-split, compile them
+// with up to |numProcesses| concurrent clang processes, and link the objects.
+// With |lto|, the objects are ThinLTO bitcode, and the link step optimizes
+// across them.  If |cacheDir| is not NULL, objects are kept there, named by
+// the hash of their canonicalized part, and only parts with no cached object
+// are compiled.  llvm-split assigns functions to parts by a hash of their
+// name, so an edit to one function only changes the parts that define or call
+// it.  The cache keeps DE_INCREMENTAL_CACHED_PER_PART objects per part.
+static int runParallelClangCompiler(char *llvmFileName, bool debugMode, bool optimized,
+    uint32 numParts, uint32 numProcesses, bool lto, char *cacheDir) {
+  char *outFileName = utAllocString(utReplaceSuffix(llvmFileName, ""));
+  char *partPrefix = utAllocString(utSprintf("%s.part", outFileName));
+  char *optFlag = optimized? "-O3" : "";
+  if (debugMode) {
+    optFlag = "-g -O0";
+  }
+  char *ltoFlag = lto? " -flto=thin" : "";
+  char *command = utSprintf("%s -j %u -o %s %s", findLlvmToolPath("llvm-split"), numParts, partPrefix,
+      llvmFileName);
+  utDebug("Executing: %s\n", command);
+  int rc = system(command);
+  if (rc != 0) {
+    return rc;
+  }
+  if (cacheDir != NULL) {
+    mkdir(cacheDir, 0755);
+  }
+  char *compileFlags = utAllocString(utSprintf("%s %s%s%s", deClangPath, optFlag, ltoFlag,
+      deClangProfileFlags));
+  char **commands = utNewA(char*, numParts);
+  char **objectNames = utNewA(char*, numParts);
+  char **tmpNames = utNewA(char*, numParts);
+  uint32 numCommands = 0;
+  char *objects = utAllocString("");
+  for (uint32 i = 0; i < numParts; i++) {
+    char *partName = utSprintf("%s%u", partPrefix, i);
+    uint64 hash = 0;
+    if (cacheDir != NULL && canonicalizePartFile(partName)) {
+      hash = hashPartFile(partName, compileFlags);
+    }
+    tmpNames[i] = NULL;
+    if (hash != 0) {
+      objectNames[i] = utAllocString(utSprintf("%s/%016llx.o", cacheDir, (unsigned long long)hash));
+    } else {
+      objectNames[i] = utAllocString(utSprintf("%s.o", partName));
+    }
+    if (hash == 0 || access(objectNames[i], R_OK) != 0) {
+      // Compile cached objects to a temporary name, so a failed or concurrent
+      // build never leaves a partial object in the cache.
+      tmpNames[i] = utAllocString(hash == 0? objectNames[i] :
+          utSprintf("%s.%d", objectNames[i], (int)getpid()));
+      commands[numCommands++] = utAllocString(utSprintf("%s -fPIC -c -x ir -o %s %s",
+          compileFlags, tmpNames[i], partName));
+    } else {
+      utime(objectNames[i], NULL);  // Mark it recently used, so pruning keeps it.
+    }
+    char *newObjects = utAllocString(utSprintf("%s %s", objects, objectNames[i]));
+    utFree(objects);
+    objects = newObjects;
+  }
+  if (cacheDir != NULL) {
+    printf("Compiling %u of %u parts\n", numCommands, numParts);
+    fflush(stdout);
+  }
+  rc = runCommandsInParallel(commands, numCommands, numProcesses);
+  for (uint32 i = 0; i < numParts; i++) {
+    if (tmpNames[i] != NULL && strcmp(tmpNames[i], objectNames[i])) {
+      if (rc == 0) {
+        rename(tmpNames[i], objectNames[i]);
+      } else {
+        remove(tmpNames[i]);
+      }
+    }
+  }
+  if (rc == 0) {
+    command = utSprintf("%s -fPIC -o %s%s %s/librune.a %s/libcttk.a -lpthread",
+        compileFlags, outFileName, objects, deLibDir, deLibDir);
+    if (deExtraClangParams != NULL) {
+      command = utSprintf("%s %s", command, deExtraClangParams);
+    }
+    utDebug("Executing: %s\n", command);
+    rc = system(command);
+  }
+  if (cacheDir != NULL) {
+    pruneCache(cacheDir, numParts * DE_INCREMENTAL_CACHED_PER_PART);
+  }
+  for (uint32 i = 0; i < numParts; i++) {
+    remove(utSprintf("%s%u", partPrefix, i));
+    if (cacheDir == NULL) {
+      remove(objectNames[i]);
+    }
+    utFree(objectNames[i]);
+    if (tmpNames[i] != NULL) {
+      utFree(tmpNames[i]);
+    }
+  }
+  for (uint32 i = 0; i < numCommands; i++) {
+    utFree(commands[i]);
+  }
+  utFree(commands);
+  utFree(objectNames);
+  utFree(tmpNames);
+  utFree(objects);
+  utFree(compileFlags);
+  utFree(partPrefix);
+  utFree(outFileName);
+  return rc;
+}
+#endif
+
 // Print usage and exit.
 static void usage(void) {
   printf("Usage: rune [options] file\n"
          "    -b        - Don't load builtin Rune files.\n"
+         "    -B        - Report how many array bounds checks were eliminated.\n"
+         "    -bytefields - Store bool and small integer data members in a byte per\n"
+         "                object, rather than bit-packing them.\n"
+         "    -cache <dir> - Cache syntax trees of builtin and package modules in <dir>,\n"
+         "                and skip parsing them when unchanged.  Defaults to $RUNE_CACHE.\n"
+         "    -coroutines - Call large iterators, and iterators with more than one yield,\n"
+         "                as LLVM coroutines instead of inlining them.\n"
          "    -e <extra params> - Pass extra parameters to clang, such as a .a or .o file name.\n"
          "    -g        - Include debug information for gdb.  Implies -l.\n"
+         "    -heapprofile - Record the line each statement starts at, so the sampled\n"
+         "                allocation profile enabled by $RUNE_ALLOC_SAMPLE reports the\n"
+         "                Rune lines allocating array memory.\n"
+         "    -incremental <dir> - Split the LLVM module into parts, and keep their\n"
+         "                objects in <dir>.  Only parts that changed are recompiled,\n"
+         "                and the least recently used objects are removed.\n"
+         "    -inlineruntime - Link the runtime's LLVM bitcode into the module before\n"
+         "                optimizing, so small runtime helpers are inlined.  Needs\n"
+         "                lib/librune.bc, built by make bitcode.\n"
+         "    -inprocess - Optimize the LLVM module and emit its object file with the\n"
+         "                LLVM C API, and only run clang to link.  The IR text is parsed\n"
+         "                from memory, and the .ll file is still written.  Needs a rune\n"
+         "                built with make LLVM_CAPI=1.\n"
+         "    -instrument - Count function calls, loop trips, bounds checks, ref and unref\n"
+         "                operations, array resizes and bigint temporaries, and write the\n"
+         "                counts with their file and line to rune.instrument, or\n"
+         "                $RUNE_INSTRUMENT, when the program exits.\n"
+         "    -j <N>    - Split the LLVM module into N parts with llvm-split, and compile\n"
+         "                them with N concurrent clang processes.  With -cache, also\n"
+         "                parse a module's imports in N processes.\n"
          "    -l <llvmfile> - Write LLVM IR to <llvmfile>.\n"
+         "    -layout <soa|aos> - Store class data members in one array each (soa), or\n"
+         "                interleave scalar members in one array of tuples (aos),\n"
+         "                regardless of which classes are declared packed.\n"
          "    -L        - Log tokens parsed to rune.log.\n"
+         "    -lto      - With -j or -incremental, compile the parts to ThinLTO\n"
+         "                bitcode, and optimize across them when linking.\n"
          "    -n        - No clang.  Don't compile the resulting .ll output.\n"
+         "    -nativeints - Lower integers of 65 to 512 bits to LLVM integers instead of\n"
+         "                bigints.  Only wider integers use the bigint runtime.\n"
          "    -O        - Optimized build.  Passes -O3 to clang.\n"
          "    -p <dir>  - Use <dir> as the root directory for Rune's builtin packages.\n"
+         "    -prefetch <N> - Prefetch the next element's data N links ahead when for\n"
+         "                loops walk linked relations.  Defaults to 1.  0 disables it.\n"
+         "    -profile  - Count data member accesses, and write them to rune.profile, or\n"
+         "                $RUNE_PROFILE, when the program exits.\n"
+         "    -profile-generate - Build with clang's PGO instrumentation, and -profile.\n"
+         "                Running the program writes default*.profraw and rune.profile.\n"
+         "    -profile-use=<file> - Optimize with clang's PGO data merged into <file> by\n"
+         "                llvm-profdata.  Unless -useprofile is given, also read\n"
+         "                rune.profile from the directory of <file>, if it exists.\n"
          "    -r <dir>  - Use <dir> as the root directory for the project's packages.\n"
+         "    -R        - Reserve up to 1GiB of address space for each class field\n"
+         "                array up front, so objects rarely move when the arrays grow.\n"
          "    -t        - Execute unit tests for all modules.\n"
+         "    -time-report - Print the wall time and peak memory of each compiler phase,\n"
+         "                parse time per module, and counts of signatures bound,\n"
+         "                datatypes interned, iterators inlined, and IR lines.\n"
+         "    -time-report-json <file> - Write the -time-report data to <file> as JSON.\n"
+         "    -useprofile <file> - Interleave the hot scalar data members of profiled\n"
+         "                classes in one array of tuples, using counts from -profile.\n"
+         "                Classes without a declared reference width get the narrowest\n"
+         "                with room for 4X the objects the profiled run created.\n"
+         "    -u <modules> - Compile the comma separated list of modules in unsafe mode.\n"
+         "    -unwind   - Raise exceptions by unwinding the stack to landing pads, so\n"
+         "                entering a try statement costs nothing, instead of setjmp.\n"
          "    -U        - Unsafe mode.  Don't generate bounds checking, overflow\n"
-         "                detection, and destroyed object access detection.\n"
+         "                detection, and destroyed object access detection.  Use\n"
+         "                unsafe func or unsafe { ... } to do this locally.\n"
          "    -x        - Invert the return code: 0 if we fail, and 1 if we pass.\n");
   exit(1);
 }
@@ -68,36 +550,120 @@ int main(int argc, char** argv) {
   deInvertReturnCode = false;
   deTestMode = false;
   deUnsafeMode = false;
+  deUnsafeModules = NULL;
+  deReserveFieldArrays = false;
+  deBitPackFields = true;
+  dePrefetchDistance = 1;
+  deClassLayout = DE_LAYOUT_DECLARED;
+  deProfileFields = false;
+  deHeapProfile = false;
+  deInstrumentCode = false;
+  deTimeReport = false;
+  deCoroutineIterators = false;
+  deUnwindExceptions = false;
+  deNativeWideInts = false;
+  deParseCacheDir = getenv("RUNE_CACHE");
+  char *timeReportFileName = NULL;
+  char *profileFileName = NULL;
+  char *clangProfileFileName = NULL;
   deRunePackageDir = NULL;
   deProjectPackageDir = NULL;
   bool noClang = false;
   bool optimized = false;
   deLLVMFileName = NULL;
   bool parseBuiltinFunctions = true;
+  bool reportBoundsChecks = false;
+  uint32 numJobs = 1;
+  bool lto = false;
+  bool inlineRuntime = false;
+  bool inProcess = false;
+  char *incrementalDir = NULL;
   uint32 xArg = 1;
   while (xArg < argc && argv[xArg][0] == '-') {
     if (!strcmp(argv[xArg], "-g")) {
       deDebugMode = true;
     } else if (!strcmp(argv[xArg], "-b")) {
       parseBuiltinFunctions = false;
+    } else if (!strcmp(argv[xArg], "-B")) {
+      reportBoundsChecks = true;
+    } else if (!strcmp(argv[xArg], "-coroutines")) {
+      deCoroutineIterators = true;
+    } else if (!strcmp(argv[xArg], "-cache")) {
+      if (++xArg == argc) {
+        usage();
+      }
+      deParseCacheDir = argv[xArg];
     } else if (!strcmp(argv[xArg], "-e")) {
       if (++xArg == argc) {
         printf("-e must be followed by a clang parameter");
         return 1;
       }
       deExtraClangParams = argv[xArg];
+    } else if (!strcmp(argv[xArg], "-unwind")) {
+      deUnwindExceptions = true;
     } else if (!strcmp(argv[xArg], "-t")) {
       deTestMode = true;
+    } else if (!strcmp(argv[xArg], "-time-report")) {
+      deTimeReport = true;
+    } else if (!strcmp(argv[xArg], "-time-report-json")) {
+      if (++xArg == argc) {
+        usage();
+      }
+      deTimeReport = true;
+      timeReportFileName = argv[xArg];
+    } else if (!strcmp(argv[xArg], "-nativeints")) {
+      deNativeWideInts = true;
     } else if (!strcmp(argv[xArg], "-O")) {
       optimized = true;
+    } else if (!strcmp(argv[xArg], "-R")) {
+      deReserveFieldArrays = true;
+    } else if (!strcmp(argv[xArg], "-bytefields")) {
+      deBitPackFields = false;
     } else if (!strcmp(argv[xArg], "-U")) {
       deUnsafeMode = true;
+    } else if (!strcmp(argv[xArg], "-u")) {
+      if (++xArg == argc) {
+        printf("-u requires a comma separated list of module names");
+        return 1;
+      }
+      deUnsafeModules = argv[xArg];
     } else if (!strcmp(argv[xArg], "-l")) {
       if (++xArg == argc) {
         printf("-l requires the output LLVM IR file name");
         return 1;
       }
       deLLVMFileName = argv[xArg];
+    } else if (!strcmp(argv[xArg], "-layout")) {
+      if (++xArg == argc) {
+        printf("-layout requires soa or aos");
+        return 1;
+      }
+      if (!strcmp(argv[xArg], "soa")) {
+        deClassLayout = DE_LAYOUT_SOA;
+      } else if (!strcmp(argv[xArg], "aos")) {
+        deClassLayout = DE_LAYOUT_AOS;
+      } else {
+        usage();
+      }
+    } else if (!strcmp(argv[xArg], "-incremental")) {
+      if (++xArg == argc) {
+        usage();
+      }
+      incrementalDir = argv[xArg];
+    } else if (!strcmp(argv[xArg], "-j")) {
+      if (++xArg == argc || atoi(argv[xArg]) <= 0) {
+        printf("-j requires a positive number of parallel jobs");
+        return 1;
+      }
+      numJobs = atoi(argv[xArg]);
+    } else if (!strcmp(argv[xArg], "-inlineruntime")) {
+      inlineRuntime = true;
+    } else if (!strcmp(argv[xArg], "-instrument")) {
+      deInstrumentCode = true;
+    } else if (!strcmp(argv[xArg], "-inprocess")) {
+      inProcess = true;
+    } else if (!strcmp(argv[xArg], "-lto")) {
+      lto = true;
     } else if (!strcmp(argv[xArg], "-L")) {
       deLogTokens = true;
     } else if (!strcmp(argv[xArg], "-n")) {
@@ -108,6 +674,32 @@ int main(int argc, char** argv) {
         return 1;
       }
       deRunePackageDir = argv[xArg];
+    } else if (!strcmp(argv[xArg], "-prefetch")) {
+      if (++xArg == argc || atoi(argv[xArg]) < 0) {
+        printf("-prefetch requires a link distance, or 0 to disable prefetching");
+        return 1;
+      }
+      dePrefetchDistance = atoi(argv[xArg]);
+    } else if (!strcmp(argv[xArg], "-heapprofile")) {
+      deHeapProfile = true;
+    } else if (!strcmp(argv[xArg], "-profile")) {
+      deProfileFields = true;
+    } else if (!strcmp(argv[xArg], "-profile-generate")) {
+      deProfileFields = true;
+      deClangProfileFlags = " -fprofile-generate";
+    } else if (!strncmp(argv[xArg], "-profile-use=", sizeof("-profile-use=") - 1)) {
+      clangProfileFileName = argv[xArg] + sizeof("-profile-use=") - 1;
+      if (*clangProfileFileName == '\0') {
+        printf("-profile-use= requires the profile data file name");
+        return 1;
+      }
+      deClangProfileFlags = utAllocString(utSprintf(" -fprofile-use=%s", clangProfileFileName));
+    } else if (!strcmp(argv[xArg], "-useprofile")) {
+      if (++xArg == argc) {
+        printf("-useprofile requires the profile file name");
+        return 1;
+      }
+      profileFileName = argv[xArg];
     } else if (!strcmp(argv[xArg], "-r")) {
       if (++xArg == argc) {
         printf("-p requires a path to the root package directory");
@@ -131,20 +723,62 @@ int main(int argc, char** argv) {
     usage();
   }
   char* fileName = argv[xArg];
+  if (clangProfileFileName != NULL && profileFileName == NULL) {
+    // Keep one profiling workflow: the field profile from -profile-generate
+    // sits next to the merged clang profile.
+    char *runeProfileName = utSprintf("%s/rune.profile",
+        utDirName(utFullPath(clangProfileFileName)));
+    FILE *file = fopen(runeProfileName, "r");
+    if (file != NULL) {
+      fclose(file);
+      profileFileName = utAllocString(runeProfileName);
+    }
+  }
+  deParseJobs = numJobs;
   deStart(fileName);
   if (!utSetjmp()) {
     if (parseBuiltinFunctions) {
+      deTimeReportBeginPhase("parse builtins");
       deParseBuiltinFunctions();
+      deTimeReportEndPhase();
     } else {
     }
     deBlock rootBlock = deRootGetBlock(deTheRoot);
+    deTimeReportBeginPhase("parse");
     deParseModule(fileName, rootBlock, true, deLineNull);
+    deTimeReportEndPhase();
+    if (profileFileName != NULL) {
+      deReadFieldProfile(profileFileName);
+      deChooseRefWidths();
+    }
+    deTimeReportBeginPhase("bind");
     deCallFinalInDestructors();
+    deAddBulkAllocators();
     deCreateLocalAndGlobalVariables();
     deBind();
     deVerifyRelationshipGraph();
+    deTimeReportEndPhase();
+    deTimeReportBeginPhase("memory management");
     deAddMemoryManagement();
+    deTimeReportEndPhase();
+    deTimeReportBeginPhase("arena expansion");
+    deExpandArenaStatements();
+    deTimeReportEndPhase();
+    deTimeReportBeginPhase("bounds check elimination");
+    deEliminateBoundsChecks(reportBoundsChecks);
+    deTimeReportEndPhase();
+    deTimeReportBeginPhase("iterator inlining");
     deInlineIterators();
+    deTimeReportEndPhase();
+    deTimeReportBeginPhase("constant propagation");
+    dePropagateConstantsAcrossSignatures();
+    deTimeReportEndPhase();
+    deTimeReportBeginPhase("borrow analysis");
+    deMarkBorrowedVariables();
+    deTimeReportEndPhase();
+    deTimeReportBeginPhase("parallel for checking");
+    deCheckParallelStatements();
+    deTimeReportEndPhase();
     // We generate new code in memory management and such, so check binding
     // succeeded.
     deReportEvents();
@@ -154,13 +788,61 @@ int main(int argc, char** argv) {
       // Since we call utFree on this below.
       deLLVMFileName = utAllocString(deLLVMFileName);
     }
-    llGenerateLLVMAssemblyCode(deLLVMFileName, deDebugMode);
+    if (*deClangProfileFlags != '\0') {
+      inProcess = false;
+    }
+    // When the module itself is compiled in process, keep its text in memory.
+    char *moduleText = NULL;
+    size_t moduleLength = 0;
+    bool keepModuleText = inProcess && !noClang && !inlineRuntime && incrementalDir == NULL &&
+        numJobs <= 1;
+    deTimeReportBeginPhase("LLVM IR generation");
+    llGenerateLLVMAssemblyCode(deLLVMFileName, deDebugMode, keepModuleText? &moduleText : NULL,
+        &moduleLength);
+    deTimeReportEndPhase();
+    deTimeReportCountIRLines(deLLVMFileName);
     if (!noClang) {
-      int rc = runClangCompiler(deLLVMFileName, deDebugMode, optimized);
+      deTimeReportBeginPhase("clang");
+      char *compileFileName = deLLVMFileName;
+      if (inlineRuntime) {
+        compileFileName = linkRuntimeBitcode(deLLVMFileName);
+        if (compileFileName == NULL) {
+          printf("Could not link %s/librune.bc into %s\n", deLibDir, deLLVMFileName);
+          return 1;
+        }
+      }
+#ifndef _WIN32
+      int rc;
+      if (incrementalDir != NULL) {
+        // Use enough parts that an edit recompiles a small fraction of the program.
+        uint32 numProcesses = numJobs > 1? numJobs : sysconf(_SC_NPROCESSORS_ONLN);
+        uint32 numParts = numJobs > DE_INCREMENTAL_PARTS? numJobs : DE_INCREMENTAL_PARTS;
+        rc = runParallelClangCompiler(compileFileName, deDebugMode, optimized, numParts,
+            numProcesses == 0? 1 : numProcesses, lto, incrementalDir);
+      } else if (numJobs > 1) {
+        rc = runParallelClangCompiler(compileFileName, deDebugMode, optimized, numJobs,
+            numJobs, lto, NULL);
+      } else if (inProcess) {
+        rc = runInProcessCompiler(compileFileName, moduleText, moduleLength, deDebugMode,
+            optimized);
+      } else {
+        rc = runClangCompiler(compileFileName, deDebugMode, optimized);
+      }
+#else
+      int rc = inProcess? runInProcessCompiler(compileFileName, moduleText, moduleLength,
+          deDebugMode, optimized) : runClangCompiler(compileFileName, deDebugMode, optimized);
+#endif
+      free(moduleText);
+      if (compileFileName != deLLVMFileName) {
+        remove(compileFileName);
+        utFree(compileFileName);
+      }
+      deTimeReportEndPhase();
       if (rc != 0) {
         return rc;
       }
     }
+    deTimeReportPrint(timeReportFileName);
     utFree(deLLVMFileName);
     utUnsetjmp();
   } else {
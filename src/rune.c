@@ -87,6 +87,7 @@ void deStart(char *fileName) {
   deRootInsertBlock(deTheRoot, rootBlock);
   deFilepathInsertModuleBlock(rootFilepath, rootBlock);
   deDatatypeStart();
+  deSignatureStart();
   deBuiltinStart();
   deClassStart();
   deUtilStart();
@@ -102,6 +103,8 @@ void deStop(void) {
   deUtilStop();
   deClassStop();
   deBuiltinStop();
+  deSignatureStop();
+  deTimeReportStop();
   deDatatypeStop();
   deDatabaseStop();
   utStop(false);
@@ -0,0 +1,228 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compile time profiling for -time-report.  Each driver phase records its wall
+// time, and the peak resident set size of the compiler when it finished.
+// Parsing is also broken down per module, so slow imports stand out.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "de.h"
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Counted by deInlineIterator.
+uint32 deNumInlinedIterators;
+
+typedef struct {
+  char *name;
+  double seconds;
+  uint64 peakKbytes;
+} deTimedItem;
+
+static deTimedItem *dePhases;
+static uint32 deNumPhases, deAllocatedPhases;
+static deTimedItem *deModules;
+static uint32 deNumModules, deAllocatedModules;
+static double dePhaseStartTime;
+static char *dePhaseName;
+static uint64 deNumIRLines;
+
+// Return the current time in seconds from an arbitrary starting point.
+double deWallTime(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Return the peak resident set size of the compiler so far, in KiB.
+static uint64 peakKbytes(void) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+  return usage.ru_maxrss;
+}
+
+// Append an item to a growable array of timed items.
+static void appendItem(deTimedItem **items, uint32 *numItems, uint32 *allocated,
+    char *name, double seconds) {
+  if (*numItems == *allocated) {
+    *allocated = *allocated == 0? 16 : *allocated << 1;
+    if (*items == NULL) {
+      *items = utNewA(deTimedItem, *allocated);
+    } else {
+      utResizeArray(*items, *allocated);
+    }
+  }
+  deTimedItem *item = *items + (*numItems)++;
+  item->name = utAllocString(name);
+  item->seconds = seconds;
+  item->peakKbytes = peakKbytes();
+}
+
+// Start timing a phase of the compiler.  Phases do not nest.
+void deTimeReportBeginPhase(char *name) {
+  if (!deTimeReport) {
+    return;
+  }
+  dePhaseName = name;
+  dePhaseStartTime = deWallTime();
+}
+
+// Finish timing the current phase.
+void deTimeReportEndPhase(void) {
+  if (!deTimeReport || dePhaseName == NULL) {
+    return;
+  }
+  appendItem(&dePhases, &deNumPhases, &deAllocatedPhases, dePhaseName,
+      deWallTime() - dePhaseStartTime);
+  dePhaseName = NULL;
+}
+
+// Record how long it took to parse one module, not counting its imports.
+void deTimeReportAddModule(char *fileName, double seconds) {
+  appendItem(&deModules, &deNumModules, &deAllocatedModules, fileName, seconds);
+}
+
+// Count the lines of LLVM IR we wrote to |llvmFileName|.
+void deTimeReportCountIRLines(char *llvmFileName) {
+  if (!deTimeReport) {
+    return;
+  }
+  FILE *file = fopen(llvmFileName, "r");
+  if (file == NULL) {
+    return;
+  }
+  deNumIRLines = 0;
+  int c;
+  while ((c = getc(file)) != EOF) {
+    if (c == '\n') {
+      deNumIRLines++;
+    }
+  }
+  fclose(file);
+}
+
+// Return the number of signatures the binder bound.
+static uint32 countBoundSignatures(void) {
+  uint32 count = 0;
+  deSignature signature;
+  deForeachRootSignature(deTheRoot, signature) {
+    if (deSignatureBound(signature)) {
+      count++;
+    }
+  } deEndRootSignature;
+  return count;
+}
+
+// Write |string| as a JSON string literal.
+static void writeJsonString(FILE *file, char *string) {
+  putc('"', file);
+  for (char *p = string; *p != '\0'; p++) {
+    if (*p == '"' || *p == '\\') {
+      fprintf(file, "\\%c", *p);
+    } else if ((uint8)*p < ' ') {
+      fprintf(file, "\\u%04x", (uint8)*p);
+    } else {
+      putc(*p, file);
+    }
+  }
+  putc('"', file);
+}
+
+// Write an array of timed items as JSON.
+static void writeJsonItems(FILE *file, char *key, deTimedItem *items, uint32 numItems) {
+  fprintf(file, "  \"%s\": [", key);
+  for (uint32 i = 0; i < numItems; i++) {
+    fputs(i == 0? "\n    {\"name\": " : ",\n    {\"name\": ", file);
+    writeJsonString(file, items[i].name);
+    fprintf(file, ", \"seconds\": %.6f, \"peakKbytes\": %llu}", items[i].seconds,
+        (unsigned long long)items[i].peakKbytes);
+  }
+  fputs(numItems == 0? "],\n" : "\n  ],\n", file);
+}
+
+// Write the report in JSON to |fileName|.
+static void writeJsonReport(char *fileName) {
+  FILE *file = fopen(fileName, "w");
+  if (file == NULL) {
+    utExit("Unable to write time report to %s", fileName);
+  }
+  fputs("{\n", file);
+  writeJsonItems(file, "phases", dePhases, deNumPhases);
+  writeJsonItems(file, "modules", deModules, deNumModules);
+  fprintf(file, "  \"counts\": {\"signaturesBound\": %u, \"datatypesInterned\": %u, "
+      "\"iteratorsInlined\": %u, \"irLines\": %llu}\n}\n", countBoundSignatures(),
+      deCountDatatypes(), deNumInlinedIterators, (unsigned long long)deNumIRLines);
+  fclose(file);
+}
+
+// Print the report in human readable form.
+static void printTextReport(void) {
+  double total = 0.0;
+  printf("===-------------------------------------------------------------===\n");
+  printf("                      Rune compile time report\n");
+  printf("===-------------------------------------------------------------===\n");
+  printf("  %-28s %12s %15s\n", "Phase", "Wall (s)", "Peak RSS (MiB)");
+  for (uint32 i = 0; i < deNumPhases; i++) {
+    deTimedItem *phase = dePhases + i;
+    printf("  %-28s %12.4f %15.1f\n", phase->name, phase->seconds, phase->peakKbytes / 1024.0);
+    total += phase->seconds;
+  }
+  printf("  %-28s %12.4f\n\n", "Total", total);
+  printf("  %-50s %12s\n", "Module", "Parse (s)");
+  for (uint32 i = 0; i < deNumModules; i++) {
+    printf("  %-50s %12.4f\n", deModules[i].name, deModules[i].seconds);
+  }
+  printf("\n  %-28s %12u\n", "Signatures bound", countBoundSignatures());
+  printf("  %-28s %12u\n", "Datatypes interned", deCountDatatypes());
+  printf("  %-28s %12u\n", "Iterators inlined", deNumInlinedIterators);
+  printf("  %-28s %12llu\n", "LLVM IR lines", (unsigned long long)deNumIRLines);
+}
+
+// Print the report to stdout, or write it as JSON if |jsonFileName| is not NULL.
+void deTimeReportPrint(char *jsonFileName) {
+  if (!deTimeReport) {
+    return;
+  }
+  if (jsonFileName != NULL) {
+    writeJsonReport(jsonFileName);
+  } else {
+    printTextReport();
+  }
+}
+
+// Free memory used by the report.
+void deTimeReportStop(void) {
+  for (uint32 i = 0; i < deNumPhases; i++) {
+    utFree(dePhases[i].name);
+  }
+  for (uint32 i = 0; i < deNumModules; i++) {
+    utFree(deModules[i].name);
+  }
+  if (dePhases != NULL) {
+    utFree(dePhases);
+  }
+  if (deModules != NULL) {
+    utFree(deModules);
+  }
+  dePhases = NULL;
+  deModules = NULL;
+  deNumPhases = deAllocatedPhases = 0;
+  deNumModules = deAllocatedModules = 0;
+  deNumIRLines = 0;
+}
@@ -0,0 +1,589 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Arena blocks.  Objects created while
+//
+//   arena {
+//     request = Request(text)
+//     handle(request)
+//   }
+//
+// runs, including in functions it calls, are freed together when it ends.
+// While any arena block runs, class allocators take new objects from the end
+// of their field arrays rather than from the free list, so the objects created
+// inside are those past the class's _used count at the start.  The block is
+// expanded to:
+//
+//   rune_arenaDepth += 1u32
+//   arena<n>_<Class>_used = <Class>_used  // For each class.
+//   arena<n>_<Class>_firstFree = <Class>_firstFree
+//   <body>
+//   request = null(request)  // Each variable assigned objects in the body.
+//   <Class>_arenaFinalize(...)  // For each class with a final method.
+//   rune_arenaDepth -= 1u32
+//   <Class>_arenaRelease(...)  // Zero the fields and reset <Class>_used.
+//
+// Nothing is destroyed one object at a time, so relations between objects in
+// the arena are not updated, and only final methods run.  References to arena
+// objects must not outlive the block, so variables assigned objects in the
+// body cannot be used outside it, and the body cannot store objects in data
+// members or array elements reached from variables it did not assign, pass
+// them to methods or relations of objects it did not assign, or return.
+// References arena objects hold to outside objects are not checked.
+//
+// An exception raised out of an arena body skips the code that decrements
+// rune_arenaDepth, so each try statement saves the depth, and its except
+// statement restores it:
+//
+//   arenaTry<n>_depth = rune_arenaDepth
+//   try { ... } except e {
+//     <case> => { rune_arenaDepth = arenaTry<n>_depth; ... }
+//   }
+//   rune_arenaDepth = arenaTry<n>_depth
+#include "de.h"
+
+static uint32 deNumArenas;
+// Variables assigned objects in the arena body.
+static deVariable *deArenaAssigned;
+static uint32 deNumArenaAssigned, deArenaAssignedAllocated;
+// Assignments storing objects through variables, checked once all assigned
+// variables are known.
+static deExpression *deArenaStores;
+static uint32 deNumArenaStores, deArenaStoresAllocated;
+// Calls of methods passing objects, checked once all assigned variables are known.
+static deExpression *deArenaCalls;
+static uint32 deNumArenaCalls, deArenaCallsAllocated;
+// Try statements that already save and restore the arena depth.
+static deStatement *deArenaTries;
+static uint32 deNumArenaTries, deArenaTriesAllocated;
+static uint32 deNumArenaTryDepths;
+
+// Determine if the block contains an arena block.
+static bool blockHasArenaStatements(deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (deStatementInstantiated(statement) && deStatementArena(statement)) {
+      return true;
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull && blockHasArenaStatements(subBlock)) {
+      return true;
+    }
+  } deEndBlockStatement;
+  return false;
+}
+
+// Determine if the program has arena blocks, which memory management needs to
+// know when generating allocators.
+bool deProgramUsesArenas(void) {
+  deBlock rootBlock = deRootGetBlock(deTheRoot);
+  if (blockHasArenaStatements(rootBlock)) {
+    return true;
+  }
+  deSignature signature;
+  deForeachRootSignature(deTheRoot, signature) {
+    if (deSignatureInstantiated(signature) &&
+        blockHasArenaStatements(deSignatureGetBlock(signature))) {
+      return true;
+    }
+  } deEndRootSignature;
+  return false;
+}
+
+// Determine if a value of the datatype can refer to an object, directly or in
+// an array, tuple or struct.
+static bool holdsObjects(deDatatype datatype) {
+  if (datatype == deDatatypeNull) {
+    return false;
+  }
+  switch (deDatatypeGetType(datatype)) {
+    case DE_TYPE_CLASS:
+      return true;
+    case DE_TYPE_ARRAY:
+      return holdsObjects(deArrayDatatypeGetBaseDatatype(datatype));
+    case DE_TYPE_TUPLE:
+    case DE_TYPE_STRUCT:
+      for (uint32 i = 0; i < deDatatypeGetNumTypeList(datatype); i++) {
+        if (holdsObjects(deDatatypeGetiTypeList(datatype, i))) {
+          return true;
+        }
+      }
+      return false;
+    default:
+      return false;
+  }
+}
+
+// Return the variable the expression names, if it is an identifier.
+static deVariable findIdentVariable(deExpression expression) {
+  if (deExpressionGetType(expression) != DE_EXPR_IDENT) {
+    return deVariableNull;
+  }
+  deIdent ident = deExpressionGetIdent(expression);
+  if (ident == deIdentNull || deIdentGetType(ident) != DE_IDENT_VARIABLE) {
+    return deVariableNull;
+  }
+  return deIdentGetVariable(ident);
+}
+
+// Return the variable at the root of a chain of member accesses and indexing,
+// like a in a.b[i].c, or deVariableNull if there is none.
+static deVariable findRootVariable(deExpression access) {
+  deExpressionType type = deExpressionGetType(access);
+  while (type == DE_EXPR_DOT || type == DE_EXPR_INDEX || type == DE_EXPR_NOTNULL) {
+    access = deExpressionGetFirstExpression(access);
+    type = deExpressionGetType(access);
+  }
+  return findIdentVariable(access);
+}
+
+// Determine if the statement is inside the arena block.
+static bool statementInArena(deStatement statement, deStatement arena) {
+  while (statement != deStatementNull) {
+    if (statement == arena) {
+      return true;
+    }
+    statement = deBlockGetOwningStatement(deStatementGetBlock(statement));
+  }
+  return false;
+}
+
+// Record a variable assigned objects in the arena body.
+static void addAssignedVariable(deVariable variable) {
+  for (uint32 i = 0; i < deNumArenaAssigned; i++) {
+    if (deArenaAssigned[i] == variable) {
+      return;
+    }
+  }
+  if (deNumArenaAssigned == deArenaAssignedAllocated) {
+    deArenaAssignedAllocated <<= 1;
+    utResizeArray(deArenaAssigned, deArenaAssignedAllocated);
+  }
+  deArenaAssigned[deNumArenaAssigned++] = variable;
+}
+
+// Record an assignment or append storing objects through a data member or array.
+static void addStore(deExpression expression) {
+  if (deNumArenaStores == deArenaStoresAllocated) {
+    deArenaStoresAllocated <<= 1;
+    utResizeArray(deArenaStores, deArenaStoresAllocated);
+  }
+  deArenaStores[deNumArenaStores++] = expression;
+}
+
+// Record a call of a method that passes objects.
+static void addCall(deExpression expression) {
+  if (deNumArenaCalls == deArenaCallsAllocated) {
+    deArenaCallsAllocated <<= 1;
+    utResizeArray(deArenaCalls, deArenaCallsAllocated);
+  }
+  deArenaCalls[deNumArenaCalls++] = expression;
+}
+
+// Determine if the call is of a method of an object, like parent.appendChild(x),
+// which includes the methods generated for relations.
+static bool isObjectMethodCall(deExpression call) {
+  deExpression access = deExpressionGetFirstExpression(call);
+  deDatatype callType = deExpressionGetDatatype(access);
+  if (deExpressionGetType(access) != DE_EXPR_DOT || callType == deDatatypeNull ||
+      deDatatypeGetType(callType) != DE_TYPE_FUNCTION ||
+      deFunctionBuiltin(deDatatypeGetFunction(callType))) {
+    return false;
+  }
+  deDatatype objectType = deExpressionGetDatatype(deExpressionGetFirstExpression(access));
+  return objectType != deDatatypeNull && deDatatypeGetType(objectType) == DE_TYPE_CLASS;
+}
+
+// Determine if any parameter of the call can refer to an object.
+static bool callPassesObjects(deExpression call) {
+  deExpression parameters = deExpressionGetNextExpression(deExpressionGetFirstExpression(call));
+  deExpression parameter;
+  deForeachExpressionExpression(parameters, parameter) {
+    if (holdsObjects(deExpressionGetDatatype(parameter))) {
+      return true;
+    }
+  } deEndExpressionExpression;
+  return false;
+}
+
+// Determine if the call appends to an array, like a.append(x).
+static bool isArrayAppend(deExpression call) {
+  deDatatype callType = deExpressionGetDatatype(deExpressionGetFirstExpression(call));
+  if (callType == deDatatypeNull || deDatatypeGetType(callType) != DE_TYPE_FUNCTION) {
+    return false;
+  }
+  deFunction function = deDatatypeGetFunction(callType);
+  if (!deFunctionBuiltin(function)) {
+    return false;
+  }
+  deBuiltinFuncType type = deFunctionGetBuiltinType(function);
+  return type == DE_BUILTINFUNC_ARRAYAPPEND || type == DE_BUILTINFUNC_ARRAYCONCAT;
+}
+
+// Find the variables assigned objects in the expression, and the stores of
+// objects through other variables.
+static void scanExpression(deExpression expression) {
+  if (deExpressionIsType(expression)) {
+    return;
+  }
+  deExpressionType type = deExpressionGetType(expression);
+  if (type == DE_EXPR_EQUALS) {
+    deExpression access = deExpressionGetFirstExpression(expression);
+    deVariable variable = findIdentVariable(access);
+    if (variable != deVariableNull) {
+      if (holdsObjects(deVariableGetDatatype(variable))) {
+        addAssignedVariable(variable);
+      }
+    } else if (holdsObjects(deExpressionGetDatatype(access))) {
+      addStore(expression);
+    }
+  } else if (type == DE_EXPR_CALL && isArrayAppend(expression)) {
+    deExpression access = deExpressionGetFirstExpression(expression);
+    if (holdsObjects(deExpressionGetDatatype(deExpressionGetFirstExpression(access)))) {
+      addStore(expression);
+    }
+  } else if (type == DE_EXPR_CALL && isObjectMethodCall(expression) &&
+      callPassesObjects(expression)) {
+    addCall(expression);
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    scanExpression(child);
+  } deEndExpressionExpression;
+}
+
+// Scan the statements of the arena body, reporting returns and yields, which
+// would skip freeing the arena.
+static void scanBlock(deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (!deStatementInstantiated(statement)) {
+      continue;
+    }
+    deStatementType type = deStatementGetType(statement);
+    if (type == DE_STATEMENT_RETURN) {
+      deError(deStatementGetLine(statement), "Cannot return from inside an arena block");
+    } else if (type == DE_STATEMENT_YIELD) {
+      deError(deStatementGetLine(statement), "Cannot yield from inside an arena block");
+    }
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull) {
+      scanExpression(expression);
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      scanBlock(subBlock);
+    }
+  } deEndBlockStatement;
+}
+
+// Determine if the variable is used only inside the arena block.
+static bool usedOnlyInArena(deVariable variable, deStatement arena) {
+  deIdent ident = deVariableGetIdent(variable);
+  if (deVariableGetType(variable) != DE_VAR_LOCAL || ident == deIdentNull) {
+    return false;
+  }
+  deExpression expression;
+  deForeachIdentExpression(ident, expression) {
+    deStatement statement = deFindExpressionStatement(expression);
+    if (statement == deStatementNull || !statementInArena(statement, arena)) {
+      return false;
+    }
+  } deEndIdentExpression;
+  return true;
+}
+
+// Determine if the variable was assigned objects in the arena body.
+static bool isArenaVariable(deVariable variable) {
+  for (uint32 i = 0; i < deNumArenaAssigned; i++) {
+    if (deArenaAssigned[i] == variable) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Report variables and stores that let references to arena objects outlive
+// the arena block.
+static void checkEscapes(deStatement arena) {
+  deLine line = deStatementGetLine(arena);
+  for (uint32 i = 0; i < deNumArenaAssigned; i++) {
+    deVariable variable = deArenaAssigned[i];
+    deDatatypeType type = deDatatypeGetType(deVariableGetDatatype(variable));
+    if (!usedOnlyInArena(variable, arena)) {
+      deError(line, "Variable %s is assigned objects in an arena block, so it cannot "
+          "be used outside the block", deVariableGetName(variable));
+    } else if (type == DE_TYPE_TUPLE || type == DE_TYPE_STRUCT) {
+      deError(line, "Arena blocks cannot assign tuples or structs holding objects to %s",
+          deVariableGetName(variable));
+    }
+  }
+  for (uint32 i = 0; i < deNumArenaStores; i++) {
+    deExpression expression = deArenaStores[i];
+    deExpression access = deExpressionGetFirstExpression(expression);
+    if (deExpressionGetType(expression) == DE_EXPR_CALL) {
+      access = deExpressionGetFirstExpression(access);  // The array in a.append(x).
+    }
+    deVariable root = findRootVariable(access);
+    if (root == deVariableNull || !isArenaVariable(root)) {
+      deExprError(expression, "Arena blocks cannot store objects in data members or "
+          "arrays reached from variables assigned outside the block");
+    }
+  }
+  for (uint32 i = 0; i < deNumArenaCalls; i++) {
+    deExpression call = deArenaCalls[i];
+    deExpression access = deExpressionGetFirstExpression(call);
+    deVariable object = findRootVariable(deExpressionGetFirstExpression(access));
+    if (object != deVariableNull && isArenaVariable(object)) {
+      continue;  // Both objects are freed with the arena.
+    }
+    deExpression parameters = deExpressionGetNextExpression(access);
+    deExpression parameter;
+    deForeachExpressionExpression(parameters, parameter) {
+      deVariable root = findRootVariable(parameter);
+      if (holdsObjects(deExpressionGetDatatype(parameter)) &&
+          (root == deVariableNull || isArenaVariable(root))) {
+        deExprError(call, "Arena blocks cannot pass objects created in the block to "
+            "methods or relations of objects assigned outside the block");
+      }
+    } deEndExpressionExpression;
+  }
+}
+
+// Move the statements after |lastStatement| to the start of the block.
+static void moveNewStatementsToStart(deBlock block, deStatement lastStatement) {
+  if (lastStatement == deStatementNull) {
+    return;  // The block was empty.
+  }
+  deStatement statement = deBlockGetLastStatement(block);
+  while (statement != lastStatement) {
+    deStatement prevStatement = deStatementGetPrevBlockStatement(statement);
+    deBlockRemoveStatement(block, statement);
+    deBlockInsertStatement(block, statement);
+    statement = prevStatement;
+  }
+}
+
+// Queue the statements from |first| up to |stop| for binding.
+static void queueNewStatements(deSignature signature, deStatement first, deStatement stop) {
+  for (deStatement statement = first; statement != stop;
+      statement = deStatementGetNextBlockStatement(statement)) {
+    deQueueStatement(signature, statement, true);
+  }
+}
+
+// Add the code saving the class allocators at the start of the arena body,
+// and the code releasing the objects created inside at the end.
+static void expandArenaStatement(deSignature signature, deStatement arena) {
+  deBlock body = deStatementGetSubBlock(arena);
+  uint32 arenaNum = deNumArenas++;
+  deStatement originalFirstStatement = deBlockGetFirstStatement(body);
+  deStatement originalLastStatement = deBlockGetLastStatement(body);
+  deStringPos = 0;
+  deSprintToString("rune_arenaDepth += 1u32\n");
+  deClass theClass;
+  deForeachRootClass(deTheRoot, theClass) {
+    if (deClassBound(theClass)) {
+      char *path = deGetBlockPath(deClassGetSubBlock(theClass), true);
+      deSprintToString(
+          "arena%1$u_%2$s_used = %2$s_used\n"
+          "arena%1$u_%2$s_firstFree = %2$s_firstFree\n",
+          arenaNum, path);
+    }
+  } deEndRootClass;
+  deGenerating = true;
+  deParseString(deStringVal, body);
+  moveNewStatementsToStart(body, originalLastStatement);
+  queueNewStatements(signature, deBlockGetFirstStatement(body), originalFirstStatement);
+  deStatement lastStatement = deBlockGetLastStatement(body);
+  deStringPos = 0;
+  for (uint32 i = 0; i < deNumArenaAssigned; i++) {
+    deSprintToString("%1$s = null(%1$s)\n", deVariableGetName(deArenaAssigned[i]));
+  }
+  deForeachRootClass(deTheRoot, theClass) {
+    if (deClassBound(theClass) && deTemplateHasFinalMethod(deClassGetTemplate(theClass))) {
+      char *path = deGetBlockPath(deClassGetSubBlock(theClass), true);
+      deSprintToString("%2$s_arenaFinalize(arena%1$u_%2$s_used, arena%1$u_%2$s_firstFree)\n",
+          arenaNum, path);
+    }
+  } deEndRootClass;
+  deSprintToString("rune_arenaDepth -= 1u32\n");
+  deForeachRootClass(deTheRoot, theClass) {
+    if (deClassBound(theClass)) {
+      char *path = deGetBlockPath(deClassGetSubBlock(theClass), true);
+      deSprintToString("%2$s_arenaRelease(arena%1$u_%2$s_used, arena%1$u_%2$s_firstFree)\n",
+          arenaNum, path);
+    }
+  } deEndRootClass;
+  deParseString(deStringVal, body);
+  deGenerating = false;
+  queueNewStatements(signature, deStatementGetNextBlockStatement(lastStatement), deStatementNull);
+}
+
+// Check and expand the arena blocks in the block, outer ones first.
+static void expandBlockArenaStatements(deSignature signature, deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (deStatementInstantiated(statement) && deStatementArena(statement)) {
+      deNumArenaAssigned = 0;
+      deNumArenaStores = 0;
+      deNumArenaCalls = 0;
+      scanBlock(deStatementGetSubBlock(statement));
+      checkEscapes(statement);
+      expandArenaStatement(signature, statement);
+      // Signatures may share the block, so expand it once.
+      deStatementSetArena(statement, false);
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      expandBlockArenaStatements(signature, subBlock);
+    }
+  } deEndBlockStatement;
+}
+
+// Determine if the try statement already saves and restores the arena depth.
+static bool tryRestoresArenaDepth(deStatement tryStatement) {
+  for (uint32 i = 0; i < deNumArenaTries; i++) {
+    if (deArenaTries[i] == tryStatement) {
+      return true;
+    }
+  }
+  if (deNumArenaTries == deArenaTriesAllocated) {
+    deArenaTriesAllocated <<= 1;
+    utResizeArray(deArenaTries, deArenaTriesAllocated);
+  }
+  deArenaTries[deNumArenaTries++] = tryStatement;
+  return false;
+}
+
+// Parse the statement in deStringVal into the block after |destStatement|, or
+// at the start of the block if it is null, and queue it for binding.
+static void insertStatement(deSignature signature, deBlock block, deStatement destStatement) {
+  deParseString(deStringVal, block);
+  deStatement statement = deBlockGetLastStatement(block);
+  if (deStatementGetPrevBlockStatement(statement) != destStatement) {
+    deBlockRemoveStatement(block, statement);
+    if (destStatement == deStatementNull) {
+      deBlockInsertStatement(block, statement);
+    } else {
+      deBlockInsertAfterStatement(block, destStatement, statement);
+    }
+  }
+  deQueueStatement(signature, statement, true);
+}
+
+// Save the arena depth before the try statement, and restore it in each case of
+// its except statement, and after it.
+static void restoreArenaDepthInTry(deSignature signature, deStatement tryStatement) {
+  deStatement exceptStatement = deStatementGetNextBlockStatement(tryStatement);
+  utAssert(exceptStatement != deStatementNull &&
+      deStatementGetType(exceptStatement) == DE_STATEMENT_EXCEPT);
+  deBlock block = deStatementGetBlock(tryStatement);
+  uint32 tryNum = deNumArenaTryDepths++;
+  deGenerating = true;
+  deStringPos = 0;
+  deSprintToString("arenaTry%u_depth = rune_arenaDepth\n", tryNum);
+  insertStatement(signature, block, deStatementGetPrevBlockStatement(tryStatement));
+  deStatement caseStatement;
+  deForeachBlockStatement(deStatementGetSubBlock(exceptStatement), caseStatement) {
+    deStringPos = 0;
+    deSprintToString("rune_arenaDepth = arenaTry%u_depth\n", tryNum);
+    insertStatement(signature, deStatementGetSubBlock(caseStatement), deStatementNull);
+  } deEndBlockStatement;
+  deStringPos = 0;
+  deSprintToString("rune_arenaDepth = arenaTry%u_depth\n", tryNum);
+  insertStatement(signature, block, exceptStatement);
+  deGenerating = false;
+}
+
+// Restore the arena depth after exceptions in the try statements of the block.
+static void restoreBlockArenaDepths(deSignature signature, deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (deStatementInstantiated(statement) &&
+        deStatementGetType(statement) == DE_STATEMENT_TRY &&
+        !tryRestoresArenaDepth(statement)) {
+      restoreArenaDepthInTry(signature, statement);
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      restoreBlockArenaDepths(signature, subBlock);
+    }
+  } deEndBlockStatement;
+}
+
+// Check that references to objects created in arena blocks do not escape, and
+// add the code that frees them at the end.  Run this after memory management,
+// which generates the release functions, and before iterators are inlined, so
+// loop variables are still visible.
+void deExpandArenaStatements(void) {
+  if (!deProgramUsesArenas()) {
+    return;
+  }
+  deArenaAssignedAllocated = 16;
+  deArenaAssigned = utNewA(deVariable, deArenaAssignedAllocated);
+  deArenaStoresAllocated = 16;
+  deArenaStores = utNewA(deExpression, deArenaStoresAllocated);
+  deArenaCallsAllocated = 16;
+  deArenaCalls = utNewA(deExpression, deArenaCallsAllocated);
+  deBlock rootBlock = deRootGetBlock(deTheRoot);
+  deFunction function = deBlockGetOwningFunction(rootBlock);
+  if (blockHasArenaStatements(rootBlock)) {
+    expandBlockArenaStatements(deFunctionGetUniquifiedSignature(function), rootBlock);
+    deBindAllSignatures();
+  }
+  // Binding the expanded blocks creates signatures, so find the ones to
+  // expand first.
+  uint32 numSignatures = 0, signaturesAllocated = 16;
+  deSignature *signatures = utNewA(deSignature, signaturesAllocated);
+  deSignature signature;
+  deForeachRootSignature(deTheRoot, signature) {
+    if (deSignatureInstantiated(signature) && deSignatureGetBlock(signature) != rootBlock &&
+        blockHasArenaStatements(deSignatureGetBlock(signature))) {
+      if (numSignatures == signaturesAllocated) {
+        signaturesAllocated <<= 1;
+        utResizeArray(signatures, signaturesAllocated);
+      }
+      signatures[numSignatures++] = signature;
+    }
+  } deEndRootSignature;
+  for (uint32 i = 0; i < numSignatures; i++) {
+    expandBlockArenaStatements(signatures[i], deSignatureGetBlock(signatures[i]));
+    deBindAllSignatures();
+  }
+  // Any try statement may catch an exception raised out of an arena block.
+  deArenaTriesAllocated = 16;
+  deArenaTries = utNewA(deStatement, deArenaTriesAllocated);
+  deNumArenaTries = 0;
+  restoreBlockArenaDepths(deFunctionGetUniquifiedSignature(function), rootBlock);
+  numSignatures = 0;
+  deForeachRootSignature(deTheRoot, signature) {
+    if (deSignatureInstantiated(signature) && deSignatureGetBlock(signature) != rootBlock) {
+      if (numSignatures == signaturesAllocated) {
+        signaturesAllocated <<= 1;
+        utResizeArray(signatures, signaturesAllocated);
+      }
+      signatures[numSignatures++] = signature;
+    }
+  } deEndRootSignature;
+  for (uint32 i = 0; i < numSignatures; i++) {
+    restoreBlockArenaDepths(signatures[i], deSignatureGetBlock(signatures[i]));
+  }
+  deBindAllSignatures();
+  utFree(signatures);
+  utFree(deArenaAssigned);
+  utFree(deArenaStores);
+  utFree(deArenaCalls);
+  utFree(deArenaTries);
+}
@@ -0,0 +1,278 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Borrowed reference elimination.  A local variable of a reference counted
+// class is borrowed if every object it holds is kept alive by some other
+// reference for as long as the variable holds it.  genllvm does not reference
+// count borrowed variables, so loops that walk objects, like
+//
+//   node = head
+//   while !isnull(node) {
+//     total += node.value
+//     node = node.next
+//   }
+//
+// do no reference count updates at all.  A variable is borrowed if it is only
+// assigned variables, data members, array elements or null, and its function
+// contains nothing that could release a reference: no calls, no ref or unref
+// statements, and no assignments of objects other than to borrowed
+// variables.  Run this after iterators are inlined, since inlined iterator code
+// is generated, and does no reference counting.
+#include "de.h"
+
+// Determine if the datatype is a reference counted class.
+static bool isRefCountedClass(deDatatype datatype) {
+  return datatype != deDatatypeNull && deDatatypeGetType(datatype) == DE_TYPE_CLASS &&
+      deTemplateRefCounted(deClassGetTemplate(deDatatypeGetClass(datatype)));
+}
+
+// Determine if a value of the datatype can hold a reference to an object,
+// directly or in an array, tuple or struct.
+static bool canHoldObject(deDatatype datatype) {
+  if (datatype == deDatatypeNull) {
+    return false;
+  }
+  switch (deDatatypeGetType(datatype)) {
+    case DE_TYPE_CLASS:
+      return isRefCountedClass(datatype);
+    case DE_TYPE_ARRAY:
+      return canHoldObject(deArrayDatatypeGetBaseDatatype(datatype));
+    case DE_TYPE_TUPLE:
+    case DE_TYPE_STRUCT:
+      for (uint32 i = 0; i < deDatatypeGetNumTypeList(datatype); i++) {
+        if (canHoldObject(deDatatypeGetiTypeList(datatype, i))) {
+          return true;
+        }
+      }
+      return false;
+    default:
+      return false;
+  }
+}
+
+// Return the variable assigned by the access expression, if it is a plain
+// identifier.
+static deVariable findAssignedVariable(deExpression access) {
+  if (deExpressionGetType(access) != DE_EXPR_IDENT) {
+    return deVariableNull;
+  }
+  deIdent ident = deExpressionGetIdent(access);
+  if (ident == deIdentNull || deIdentGetType(ident) != DE_IDENT_VARIABLE) {
+    return deVariableNull;
+  }
+  return deIdentGetVariable(ident);
+}
+
+// Determine if the variable could be borrowed: a user-declared local of a
+// function, holding a reference counted object.
+static bool isCandidate(deVariable variable) {
+  if (variable == deVariableNull || deVariableGetType(variable) != DE_VAR_LOCAL ||
+      deVariableGenerated(variable) || !isRefCountedClass(deVariableGetDatatype(variable))) {
+    return false;
+  }
+  deFunctionType type = deFunctionGetType(deBlockGetOwningFunction(deVariableGetBlock(variable)));
+  return type != DE_FUNC_MODULE && type != DE_FUNC_PACKAGE;
+}
+
+// Determine if the value refers to an object owned by something that outlives
+// the assignment: a variable, a data member, an array element, or null.
+static bool isBorrowableValue(deExpression value) {
+  switch (deExpressionGetType(value)) {
+    case DE_EXPR_IDENT:
+    case DE_EXPR_NULL:
+      return true;
+    case DE_EXPR_NOTNULL:
+      return isBorrowableValue(deExpressionGetFirstExpression(value));
+    case DE_EXPR_DOT:
+    case DE_EXPR_INDEX: {
+      // Not members of temporaries, which are freed after the statement.
+      deExpression left = deExpressionGetFirstExpression(value);
+      deExpressionType leftType = deExpressionGetType(left);
+      return (leftType == DE_EXPR_IDENT || leftType == DE_EXPR_DOT ||
+          leftType == DE_EXPR_INDEX) && isBorrowableValue(left);
+    }
+    default:
+      return false;
+  }
+}
+
+// Mark candidate variables assigned in the expression as borrowed.  Later
+// passes clear the ones that do not qualify.
+static void markExpressionCandidates(deExpression expression) {
+  if (deExpressionGetType(expression) == DE_EXPR_EQUALS) {
+    deVariable variable = findAssignedVariable(deExpressionGetFirstExpression(expression));
+    if (isCandidate(variable)) {
+      deVariableSetBorrowed(variable, true);
+    }
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    markExpressionCandidates(child);
+  } deEndExpressionExpression;
+}
+
+// Mark candidate variables assigned in the block as borrowed.
+static void markBlockCandidates(deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull) {
+      markExpressionCandidates(expression);
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      markBlockCandidates(subBlock);
+    }
+  } deEndBlockStatement;
+}
+
+// Clear borrowed on variables assigned values that may not be kept alive by
+// anything else, such as the results of calls.  Assignments in generated
+// statements do no reference counting, so they can assign anything.
+static void clearExpressionUnborrowable(deExpression expression, bool generated) {
+  if (!generated && deExpressionGetType(expression) == DE_EXPR_EQUALS) {
+    deExpression access = deExpressionGetFirstExpression(expression);
+    deVariable variable = findAssignedVariable(access);
+    if (variable != deVariableNull && deVariableBorrowed(variable) &&
+        !isBorrowableValue(deExpressionGetNextExpression(access))) {
+      deVariableSetBorrowed(variable, false);
+    }
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    clearExpressionUnborrowable(child, generated);
+  } deEndExpressionExpression;
+}
+
+// Clear borrowed on variables in the block assigned unborrowable values.
+static void clearBlockUnborrowable(deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull) {
+      clearExpressionUnborrowable(expression, deStatementGenerated(statement));
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      clearBlockUnborrowable(subBlock);
+    }
+  } deEndBlockStatement;
+}
+
+// Determine if the expression could release a reference to an object.
+static bool expressionCanRelease(deExpression expression, bool generated) {
+  deExpressionType type = deExpressionGetType(expression);
+  if (type == DE_EXPR_CALL || deExpressionGetSignature(expression) != deSignatureNull) {
+    return true;  // Calls, and operators bound to functions, could do anything.
+  }
+  if (!generated && type >= DE_EXPR_EQUALS && type <= DE_EXPR_MULTRUNC_EQUALS) {
+    deExpression access = deExpressionGetFirstExpression(expression);
+    deVariable variable = findAssignedVariable(access);
+    if ((variable == deVariableNull || !deVariableBorrowed(variable)) &&
+        canHoldObject(deExpressionGetDatatype(access))) {
+      return true;  // This releases the object it overwrites.
+    }
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    if (expressionCanRelease(child, generated)) {
+      return true;
+    }
+  } deEndExpressionExpression;
+  return false;
+}
+
+// Determine if anything in the block could release a reference to an object.
+static bool blockCanRelease(deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    deStatementType type = deStatementGetType(statement);
+    if (type == DE_STATEMENT_REF || type == DE_STATEMENT_UNREF || type == DE_STATEMENT_YIELD) {
+      return true;
+    }
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull &&
+        expressionCanRelease(expression, deStatementGenerated(statement))) {
+      return true;
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull && blockCanRelease(subBlock)) {
+      return true;
+    }
+  } deEndBlockStatement;
+  return false;
+}
+
+// Clear borrowed on all variables assigned in the expression.
+static bool clearExpressionBorrowed(deExpression expression) {
+  bool changed = false;
+  if (deExpressionGetType(expression) == DE_EXPR_EQUALS) {
+    deVariable variable = findAssignedVariable(deExpressionGetFirstExpression(expression));
+    if (variable != deVariableNull && deVariableBorrowed(variable)) {
+      deVariableSetBorrowed(variable, false);
+      changed = true;
+    }
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    changed |= clearExpressionBorrowed(child);
+  } deEndExpressionExpression;
+  return changed;
+}
+
+// Clear borrowed on all variables assigned in the block.  Return true if any
+// were cleared.
+static bool clearBlockBorrowed(deBlock block) {
+  bool changed = false;
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull) {
+      changed |= clearExpressionBorrowed(expression);
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      changed |= clearBlockBorrowed(subBlock);
+    }
+  } deEndBlockStatement;
+  return changed;
+}
+
+// Mark local variables that need no reference counting as borrowed.
+void deMarkBorrowedVariables(void) {
+  deSignature signature;
+  deForeachRootSignature(deTheRoot, signature) {
+    if (deSignatureInstantiated(signature)) {
+      markBlockCandidates(deSignatureGetBlock(signature));
+    }
+  } deEndRootSignature;
+  deForeachRootSignature(deTheRoot, signature) {
+    if (deSignatureInstantiated(signature)) {
+      clearBlockUnborrowable(deSignatureGetBlock(signature));
+    }
+  } deEndRootSignature;
+  // Clearing a variable turns assignments to it into releases, which can
+  // disqualify variables in other functions sharing the block, so repeat until
+  // nothing changes.
+  bool changed;
+  do {
+    changed = false;
+    deForeachRootSignature(deTheRoot, signature) {
+      deBlock block = deSignatureGetBlock(signature);
+      if (deSignatureInstantiated(signature) && blockCanRelease(block)) {
+        changed |= clearBlockBorrowed(block);
+      }
+    } deEndRootSignature;
+  } while (changed);
+}
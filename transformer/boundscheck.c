@@ -0,0 +1,372 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Bounds check elimination.  Index expressions of the form a[i] inside
+//
+//   for i in range(a.length()) { ... }
+//
+// are marked inBounds when nothing in the loop body can resize a or change i,
+// so genllvm skips their bounds checks.  This keeps safe mode cheap for the
+// most common loops.  Run this after binding, and before iterators are inlined,
+// since we recognize the loop by its call to the builtin range iterator.
+#include "de.h"
+
+static uint32 deNumIndexExpressions, deNumInBoundsIndexExpressions;
+
+// Determine if the expression is an array or string.
+static bool isArrayOrString(deExpression expression) {
+  deDatatype datatype = deExpressionGetDatatype(expression);
+  if (datatype == deDatatypeNull) {
+    return false;
+  }
+  deDatatypeType type = deDatatypeGetType(datatype);
+  return type == DE_TYPE_ARRAY || type == DE_TYPE_STRING;
+}
+
+// Find the variable an identifier expression refers to, if any.
+static deVariable findIdentVariable(deExpression expression) {
+  if (deExpressionGetType(expression) != DE_EXPR_IDENT) {
+    return deVariableNull;
+  }
+  deIdent ident = deExpressionGetIdent(expression);
+  if (ident == deIdentNull || deIdentGetType(ident) != DE_IDENT_VARIABLE) {
+    return deVariableNull;
+  }
+  return deIdentGetVariable(ident);
+}
+
+// Determine if the variable is a local variable of a function, rather than a
+// parameter or a global.
+static bool isLocalVariable(deVariable variable) {
+  if (variable == deVariableNull || deVariableGetType(variable) != DE_VAR_LOCAL) {
+    return false;
+  }
+  deFunctionType type = deFunctionGetType(deBlockGetOwningFunction(deVariableGetBlock(variable)));
+  return type != DE_FUNC_MODULE && type != DE_FUNC_PACKAGE;
+}
+
+// Determine if the two access expressions, made of identifiers and dots, refer
+// to the same thing.
+static bool accessesMatch(deExpression a, deExpression b) {
+  deExpressionType type = deExpressionGetType(a);
+  if (type != deExpressionGetType(b)) {
+    return false;
+  }
+  if (type == DE_EXPR_IDENT) {
+    deIdent ident = deExpressionGetIdent(a);
+    return ident != deIdentNull && ident == deExpressionGetIdent(b);
+  }
+  if (type != DE_EXPR_DOT) {
+    return false;
+  }
+  deExpression leftA = deExpressionGetFirstExpression(a);
+  deExpression leftB = deExpressionGetFirstExpression(b);
+  return accessesMatch(leftA, leftB) &&
+      accessesMatch(deExpressionGetNextExpression(leftA), deExpressionGetNextExpression(leftB));
+}
+
+// Determine if the expression is a call to the builtin length method.  If so,
+// return the array expression.
+static deExpression findLengthCallArray(deExpression expression) {
+  if (deExpressionGetType(expression) != DE_EXPR_CALL) {
+    return deExpressionNull;
+  }
+  deExpression access = deExpressionGetFirstExpression(expression);
+  deDatatype callType = deExpressionGetDatatype(access);
+  if (deExpressionGetType(access) != DE_EXPR_DOT || callType == deDatatypeNull ||
+      deDatatypeGetType(callType) != DE_TYPE_FUNCTION) {
+    return deExpressionNull;
+  }
+  deFunction function = deDatatypeGetFunction(callType);
+  if (!deFunctionBuiltin(function)) {
+    return deExpressionNull;
+  }
+  deBuiltinFuncType type = deFunctionGetBuiltinType(function);
+  if (type != DE_BUILTINFUNC_ARRAYLENGTH && type != DE_BUILTINFUNC_STRINGLENGTH) {
+    return deExpressionNull;
+  }
+  return deExpressionGetFirstExpression(access);
+}
+
+// Determine if the call is to the builtin range iterator.
+bool deIsRangeCall(deExpression call) {
+  deSignature signature = deExpressionGetSignature(call);
+  if (deExpressionGetType(call) != DE_EXPR_CALL || signature == deSignatureNull) {
+    return false;
+  }
+  deFunction iterator = deSignatureGetUniquifiedFunction(signature);
+  if (deFunctionGetType(iterator) != DE_FUNC_ITERATOR ||
+      deFunctionGetSym(iterator) != utSymCreate("range")) {
+    return false;
+  }
+  deFilepath filepath = deBlockGetFilepath(deFunctionGetSubBlock(iterator));
+  return filepath != deFilepathNull &&
+      !strcmp(utBaseName(deFilepathGetName(filepath)), "rangeitr.rn");
+}
+
+// If the foreach statement loops over range(a.length()), or range(first,
+// a.length()) with an unsigned first, return the array expression a.
+static deExpression findRangeArray(deStatement statement) {
+  deExpression assignment = deStatementGetExpression(statement);
+  deExpression call = deExpressionGetNextExpression(deExpressionGetFirstExpression(assignment));
+  if (!deIsRangeCall(call)) {
+    return deExpressionNull;
+  }
+  deExpression parameters = deExpressionGetNextExpression(deExpressionGetFirstExpression(call));
+  deExpression first = deExpressionGetFirstExpression(parameters);
+  uint32 numParams = deExpressionCountExpressions(parameters);
+  deExpression limit;
+  if (numParams == 1) {
+    limit = first;
+  } else if (numParams == 2) {
+    deDatatype firstType = deExpressionGetDatatype(first);
+    if (firstType == deDatatypeNull || deDatatypeGetType(firstType) != DE_TYPE_UINT) {
+      return deExpressionNull;
+    }
+    limit = deExpressionGetNextExpression(first);
+  } else {
+    return deExpressionNull;
+  }
+  deExpression array = findLengthCallArray(limit);
+  if (array == deExpressionNull || !isArrayOrString(array)) {
+    return deExpressionNull;
+  }
+  // Only simple access paths like a or self.table can be tracked.
+  for (deExpression access = array; deExpressionGetType(access) != DE_EXPR_IDENT;
+       access = deExpressionGetFirstExpression(access)) {
+    if (deExpressionGetType(access) != DE_EXPR_DOT) {
+      return deExpressionNull;
+    }
+  }
+  return array;
+}
+
+// Determine if the datatype is a reference counted class.  Overwriting such a
+// reference can call the destructor of the object it referred to.
+static bool isRefCountedClass(deDatatype datatype) {
+  return datatype != deDatatypeNull && deDatatypeGetType(datatype) == DE_TYPE_CLASS &&
+      deTemplateRefCounted(deClassGetTemplate(deDatatypeGetClass(datatype)));
+}
+
+// Determine if the assignment writes the array or one of the objects on its
+// access path, such as node in node.items.
+static bool assignsArrayPath(deExpression lhs, deExpression array) {
+  for (deExpression access = array; access != deExpressionNull;
+       access = deExpressionGetFirstExpression(access)) {
+    if (accessesMatch(lhs, access)) {
+      return true;
+    }
+    if (deExpressionGetType(access) == DE_EXPR_IDENT) {
+      return false;
+    }
+  }
+  return false;
+}
+
+// Determine if the expression calls a function, either explicitly or through
+// an overloaded operator.
+static inline bool isCall(deExpression expression) {
+  return deExpressionGetType(expression) == DE_EXPR_CALL ||
+      deExpressionGetSignature(expression) != deSignatureNull;
+}
+
+// Determine if the expression is an assignment, including op-assignments.
+static inline bool isAssignment(deExpressionType type) {
+  return type >= DE_EXPR_EQUALS && type <= DE_EXPR_MULTRUNC_EQUALS;
+}
+
+// Find the variable at the root of an access expression like a.b[c].d.
+static deVariable findRootVariable(deExpression access) {
+  while (deExpressionGetType(access) == DE_EXPR_DOT ||
+         deExpressionGetType(access) == DE_EXPR_INDEX) {
+    access = deExpressionGetFirstExpression(access);
+  }
+  return findIdentVariable(access);
+}
+
+// Determine if the array can be read-only mentioned here: indexed, or asked
+// for its length.
+static bool isReadOnlyArrayUse(deExpression arrayUse) {
+  deExpression parent = deExpressionGetExpression(arrayUse);
+  if (parent == deExpressionNull || deExpressionGetFirstExpression(parent) != arrayUse) {
+    return false;
+  }
+  if (deExpressionGetType(parent) == DE_EXPR_INDEX) {
+    return true;
+  }
+  deExpression call = deExpressionGetExpression(parent);
+  return deExpressionGetType(parent) == DE_EXPR_DOT && call != deExpressionNull &&
+      findLengthCallArray(call) == arrayUse;
+}
+
+// Check that the expression cannot resize the array or change the loop
+// variable.  If the array is a local variable, only its own uses have to be
+// checked, since nothing else can refer to it.  Otherwise, calls could modify
+// it through some other path, so they are not allowed.  This includes
+// overloaded operators, and assignments to reference counted objects, which
+// can run a destructor.
+static bool expressionPreservesBounds(deExpression expression, deExpression array,
+    deVariable loopVar, bool arrayIsLocal) {
+  deExpressionType type = deExpressionGetType(expression);
+  if (isAssignment(type)) {
+    deExpression lhs = deExpressionGetFirstExpression(expression);
+    if (findRootVariable(lhs) == loopVar || assignsArrayPath(lhs, array)) {
+      return false;
+    }
+    deDatatype datatype = deExpressionGetDatatype(lhs);
+    if (!arrayIsLocal && (datatype == deExpressionGetDatatype(array) ||
+        isRefCountedClass(datatype))) {
+      return false;
+    }
+  }
+  if (arrayIsLocal) {
+    if (accessesMatch(expression, array) && !isReadOnlyArrayUse(expression)) {
+      return false;
+    }
+  } else if (isCall(expression) && findLengthCallArray(expression) == deExpressionNull) {
+    return false;
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    if (!expressionPreservesBounds(child, array, loopVar, arrayIsLocal)) {
+      return false;
+    }
+  } deEndExpressionExpression;
+  return true;
+}
+
+// Check every statement in the block.  Yield statements are not allowed, since
+// the code they yield to could do anything.
+static bool blockPreservesBounds(deBlock block, deExpression array, deVariable loopVar,
+    bool arrayIsLocal) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (deStatementGetType(statement) == DE_STATEMENT_YIELD) {
+      return false;
+    }
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull &&
+        !expressionPreservesBounds(expression, array, loopVar, arrayIsLocal)) {
+      return false;
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull &&
+        !blockPreservesBounds(subBlock, array, loopVar, arrayIsLocal)) {
+      return false;
+    }
+  } deEndBlockStatement;
+  return true;
+}
+
+// Mark a[i] expressions in the expression as in bounds.
+static void markExpressionIndexes(deExpression expression, deExpression array, deVariable loopVar) {
+  if (deExpressionGetType(expression) == DE_EXPR_INDEX && !deExpressionInBounds(expression)) {
+    deExpression left = deExpressionGetFirstExpression(expression);
+    deExpression index = deExpressionGetNextExpression(left);
+    if (accessesMatch(left, array) && findIdentVariable(index) == loopVar) {
+      deExpressionSetInBounds(expression, true);
+      deNumInBoundsIndexExpressions++;
+    }
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    markExpressionIndexes(child, array, loopVar);
+  } deEndExpressionExpression;
+}
+
+// Mark a[i] expressions in the block as in bounds.
+static void markBlockIndexes(deBlock block, deExpression array, deVariable loopVar) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull) {
+      markExpressionIndexes(expression, array, loopVar);
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      markBlockIndexes(subBlock, array, loopVar);
+    }
+  } deEndBlockStatement;
+}
+
+// Look for index expressions we can prove are in bounds in the foreach loop.
+static void analyzeForeachStatement(deStatement statement) {
+  deExpression array = findRangeArray(statement);
+  if (array == deExpressionNull) {
+    return;
+  }
+  deExpression assignment = deStatementGetExpression(statement);
+  deVariable loopVar = findIdentVariable(deExpressionGetFirstExpression(assignment));
+  if (loopVar == deVariableNull) {
+    return;
+  }
+  bool arrayIsLocal = isLocalVariable(findIdentVariable(array));
+  deBlock body = deStatementGetSubBlock(statement);
+  if (blockPreservesBounds(body, array, loopVar, arrayIsLocal)) {
+    markBlockIndexes(body, array, loopVar);
+  }
+}
+
+// Count array index expressions, for the report.
+static void countIndexExpressions(deExpression expression) {
+  if (deExpressionGetType(expression) == DE_EXPR_INDEX &&
+      isArrayOrString(deExpressionGetFirstExpression(expression))) {
+    deNumIndexExpressions++;
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    countIndexExpressions(child);
+  } deEndExpressionExpression;
+}
+
+// Analyze foreach loops in the block, including nested ones.
+static void analyzeBlock(deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (!deStatementInstantiated(statement)) {
+      continue;
+    }
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull) {
+      countIndexExpressions(expression);
+    }
+    if (deStatementGetType(statement) == DE_STATEMENT_FOREACH) {
+      analyzeForeachStatement(statement);
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      analyzeBlock(subBlock);
+    }
+  } deEndBlockStatement;
+}
+
+// Mark index expressions that are provably in bounds.  If |report| is true,
+// print how many bounds checks were eliminated.
+void deEliminateBoundsChecks(bool report) {
+  if (deUnsafeMode) {
+    return;  // There are no bounds checks to eliminate.
+  }
+  deNumIndexExpressions = 0;
+  deNumInBoundsIndexExpressions = 0;
+  deSignature signature;
+  deForeachRootSignature(deTheRoot, signature) {
+    if (deSignatureInstantiated(signature)) {
+      analyzeBlock(deSignatureGetBlock(signature));
+    }
+  } deEndRootSignature;
+  if (report) {
+    printf("Eliminated %u of %u array bounds checks\n",
+        deNumInBoundsIndexExpressions, deNumIndexExpressions);
+  }
+}
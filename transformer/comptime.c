@@ -0,0 +1,1343 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compile-time evaluation of calls to pure functions.  After binding and
+// iterator inlining, a call whose arguments are all constants is interpreted
+// directly over the bound code, and replaced with its result.  This lets
+// functions which compute lookup tables, such as CRC tables or S-boxes, run
+// once in the compiler, with their results embedded as constant arrays.
+//
+// The interpreter is conservative.  Anything it does not understand, or which
+// could have a side effect, such as printing, raising exceptions, reading
+// globals, or touching objects, makes it give up, and the call is left to run
+// at runtime.  Overflow, division by zero, and out-of-bounds indexes also make
+// it give up, so the runtime still reports them.  Results are memoized per
+// signature and argument values, including failures.
+
+#include "de.h"
+
+#include <gmp.h>
+
+// Give up on a call after this many steps, and stop evaluating calls entirely
+// after the total is used up.
+#define DE_COMPTIME_MAX_STEPS (1 << 22)
+#define DE_COMPTIME_MAX_TOTAL_STEPS (1 << 26)
+// Maximum call depth, so runaway recursion gives up quickly.
+#define DE_COMPTIME_MAX_DEPTH 256
+#define DE_COMPTIME_MAX_PARAMS 16
+// Largest array we build, or embed in the program.
+#define DE_COMPTIME_MAX_ELEMENTS (1 << 16)
+
+typedef enum {
+  DE_FLOW_NEXT,
+  DE_FLOW_RETURN,
+  DE_FLOW_FAIL,
+} deFlow;
+
+// A memoized call.  The result is deValueNull if the call failed, or returns
+// none.
+typedef struct {
+  deSignature signature;
+  uint32 hash;
+  uint32 numArgs;
+  deValue args[DE_COMPTIME_MAX_PARAMS];
+  deValue result;
+  bool failed;
+} deComptimeCall;
+
+static deComptimeCall *deComptimeCalls;
+static uint32 deNumComptimeCalls, deAllocatedComptimeCalls;
+// Open addressed hash table of indexes into deComptimeCalls, plus one.
+static uint32 *deComptimeCallTable;
+static uint32 deComptimeCallTableSize;
+static int64 deComptimeStepsLeft;
+static uint64 deComptimeTotalSteps;
+static uint32 deComptimeDepth;
+// The block of the function being interpreted.
+static deBlock deComptimeFrame;
+// Set by return statements.
+static deValue deComptimeReturnValue;
+
+static deValue evaluate(deExpression expression);
+static bool evaluateCall(deExpression call, deValue *result);
+static deFlow executeBlock(deBlock block);
+
+// Determine if the interpreter can represent values of the datatype.
+static bool datatypeSupported(deDatatype datatype) {
+  if (datatype == deDatatypeNull || deDatatypeSecret(datatype)) {
+    return false;
+  }
+  deDatatypeType type = deDatatypeGetType(datatype);
+  if (type == DE_TYPE_ARRAY) {
+    return datatypeSupported(deDatatypeGetElementType(datatype));
+  }
+  return type == DE_TYPE_BOOL || type == DE_TYPE_UINT || type == DE_TYPE_INT;
+}
+
+// Create an empty array value.
+static deValue createArrayValue(void) {
+  deValue value = deValueAlloc();
+  deValueSetType(value, DE_TYPE_ARRAY);
+  return value;
+}
+
+// Destroy the value, and the elements of arrays.
+static void destroyValue(deValue value) {
+  if (value == deValueNull) {
+    return;
+  }
+  if (deValueGetType(value) == DE_TYPE_ARRAY) {
+    for (uint32 i = 0; i < deValueGetNumTupleValue(value); i++) {
+      destroyValue(deValueGetiTupleValue(value, i));
+    }
+  }
+  deValueDestroy(value);
+}
+
+// Make a deep copy of the value.  Rune arrays have value semantics.
+static deValue copyValue(deValue value) {
+  switch (deValueGetType(value)) {
+    case DE_TYPE_BOOL:
+      return deBoolValueCreate(deValueBoolVal(value));
+    case DE_TYPE_UINT:
+    case DE_TYPE_INT:
+      return deIntegerValueCreate(deValueGetBigintVal(value));
+    case DE_TYPE_ARRAY: {
+      uint32 numElements = deValueGetNumTupleValue(value);
+      deComptimeStepsLeft -= numElements;
+      deValue copy = createArrayValue();
+      for (uint32 i = 0; i < numElements; i++) {
+        deValueAppendTupleValue(copy, copyValue(deValueGetiTupleValue(value, i)));
+      }
+      return copy;
+    }
+    default:
+      utExit("Unexpected compile-time value type");
+  }
+  return deValueNull;  // Dummy return.
+}
+
+// Read a bigint into |result|.  Bigints are two's complement in all of their
+// bytes.
+static void bigintToMpz(mpz_t result, deBigint bigint) {
+  uint32 numBytes = deBigintGetNumData(bigint);
+  mpz_import(result, numBytes, -1, 1, 0, 0, deBigintGetData(bigint));
+  if (deBigintNegative(bigint)) {
+    mpz_t range;
+    mpz_init(range);
+    mpz_setbit(range, 8 * numBytes);
+    mpz_sub(result, result, range);
+    mpz_clear(range);
+  }
+}
+
+// Create an integer value of the datatype.  If |truncate| is false, return
+// deValueNull if |value| does not fit.
+static deValue createIntegerValue(mpz_t value, deDatatype datatype, bool truncate) {
+  bool isSigned = deDatatypeSigned(datatype);
+  uint32 width = deDatatypeGetWidth(datatype);
+  mpz_t bits;
+  mpz_init(bits);
+  mpz_fdiv_r_2exp(bits, value, width);
+  if (isSigned && mpz_tstbit(bits, width - 1)) {
+    mpz_t range;
+    mpz_init(range);
+    mpz_setbit(range, width);
+    mpz_sub(bits, bits, range);
+    mpz_clear(range);
+  }
+  if (!truncate && mpz_cmp(bits, value) != 0) {
+    mpz_clear(bits);
+    return deValueNull;
+  }
+  deBigint bigint = deZeroBigintCreate(isSigned, width);
+  if (mpz_sgn(bits) < 0) {
+    mpz_t range;
+    mpz_init(range);
+    mpz_setbit(range, 8 * deBigintGetNumData(bigint));
+    mpz_add(bits, bits, range);
+    mpz_clear(range);
+  }
+  mpz_export(deBigintGetData(bigint), NULL, -1, 1, 0, 0, bits);
+  mpz_clear(bits);
+  deValue result = deValueAlloc();
+  deValueSetType(result, isSigned? DE_TYPE_INT : DE_TYPE_UINT);
+  deValueSetBigintVal(result, bigint);
+  return result;
+}
+
+// Determine if the value is an integer.
+static inline bool isIntegerValue(deValue value) {
+  deDatatypeType type = deValueGetType(value);
+  return type == DE_TYPE_UINT || type == DE_TYPE_INT;
+}
+
+// Compare two integer values, which may differ in width.
+static int compareIntegers(deValue a, deValue b) {
+  mpz_t x, y;
+  mpz_init(x);
+  mpz_init(y);
+  bigintToMpz(x, deValueGetBigintVal(a));
+  bigintToMpz(y, deValueGetBigintVal(b));
+  int result = mpz_cmp(x, y);
+  mpz_clear(x);
+  mpz_clear(y);
+  return result;
+}
+
+// Determine if the values are equal.
+static bool valuesEqual(deValue a, deValue b) {
+  if (a == deValueNull || b == deValueNull) {
+    return a == b;
+  }
+  if (isIntegerValue(a) && isIntegerValue(b)) {
+    return compareIntegers(a, b) == 0;
+  }
+  if (deValueGetType(a) != deValueGetType(b)) {
+    return false;
+  }
+  if (deValueGetType(a) == DE_TYPE_BOOL) {
+    return deValueBoolVal(a) == deValueBoolVal(b);
+  }
+  uint32 numElements = deValueGetNumTupleValue(a);
+  if (numElements != deValueGetNumTupleValue(b)) {
+    return false;
+  }
+  for (uint32 i = 0; i < numElements; i++) {
+    if (!valuesEqual(deValueGetiTupleValue(a, i), deValueGetiTupleValue(b, i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Hash a value for the memo table.
+static uint32 hashValue(deValue value) {
+  if (value == deValueNull) {
+    return 0;
+  }
+  switch (deValueGetType(value)) {
+    case DE_TYPE_BOOL:
+      return deValueBoolVal(value)? 2 : 1;
+    case DE_TYPE_UINT:
+    case DE_TYPE_INT:
+      return deHashBigint(deValueGetBigintVal(value));
+    default: {
+      uint32 hash = deValueGetNumTupleValue(value);
+      for (uint32 i = 0; i < deValueGetNumTupleValue(value); i++) {
+        hash = utHashValues(hash, hashValue(deValueGetiTupleValue(value, i)));
+      }
+      return hash;
+    }
+  }
+}
+
+// Find a memoized call.
+static deComptimeCall *findComptimeCall(deSignature signature, deValue *args,
+    uint32 numArgs, uint32 hash) {
+  if (deComptimeCallTableSize == 0) {
+    return NULL;
+  }
+  uint32 mask = deComptimeCallTableSize - 1;
+  for (uint32 slot = hash & mask; deComptimeCallTable[slot] != 0; slot = (slot + 1) & mask) {
+    deComptimeCall *call = deComptimeCalls + deComptimeCallTable[slot] - 1;
+    if (call->hash == hash && call->signature == signature && call->numArgs == numArgs) {
+      bool same = true;
+      for (uint32 xArg = 0; xArg < numArgs && same; xArg++) {
+        same = valuesEqual(call->args[xArg], args[xArg]);
+      }
+      if (same) {
+        return call;
+      }
+    }
+  }
+  return NULL;
+}
+
+// Insert the call at |xCall| into the hash table.
+static void insertComptimeCall(uint32 xCall) {
+  uint32 mask = deComptimeCallTableSize - 1;
+  uint32 slot = deComptimeCalls[xCall].hash & mask;
+  while (deComptimeCallTable[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+  deComptimeCallTable[slot] = xCall + 1;
+}
+
+// Double the size of the hash table, keeping it at most half full.
+static void growComptimeCallTable(void) {
+  if (deComptimeCallTable != NULL) {
+    utFree(deComptimeCallTable);
+  }
+  deComptimeCallTableSize = deComptimeCallTableSize == 0? 128 : deComptimeCallTableSize << 1;
+  deComptimeCallTable = utNewA(uint32, deComptimeCallTableSize);
+  memset(deComptimeCallTable, 0, deComptimeCallTableSize * sizeof(uint32));
+  for (uint32 xCall = 0; xCall < deNumComptimeCalls; xCall++) {
+    insertComptimeCall(xCall);
+  }
+}
+
+// Memoize a call.  The table takes ownership of the arguments and result.
+static void memoizeCall(deSignature signature, deValue *args, uint32 numArgs,
+    uint32 hash, deValue result, bool failed) {
+  if (deNumComptimeCalls == deAllocatedComptimeCalls) {
+    deAllocatedComptimeCalls = deAllocatedComptimeCalls == 0? 64 : deAllocatedComptimeCalls << 1;
+    if (deComptimeCalls == NULL) {
+      deComptimeCalls = utNewA(deComptimeCall, deAllocatedComptimeCalls);
+    } else {
+      utResizeArray(deComptimeCalls, deAllocatedComptimeCalls);
+    }
+  }
+  deComptimeCall *call = deComptimeCalls + deNumComptimeCalls++;
+  call->signature = signature;
+  call->hash = hash;
+  call->numArgs = numArgs;
+  for (uint32 xArg = 0; xArg < numArgs; xArg++) {
+    call->args[xArg] = args[xArg];
+  }
+  call->result = result;
+  call->failed = failed;
+  if (deNumComptimeCalls << 1 > deComptimeCallTableSize) {
+    growComptimeCallTable();
+  } else {
+    insertComptimeCall(deNumComptimeCalls - 1);
+  }
+}
+
+// Return the variable the identifier refers to, if it is local to the
+// function being interpreted.
+static deVariable findLocalVariable(deExpression expression) {
+  if (deExpressionGetType(expression) != DE_EXPR_IDENT) {
+    return deVariableNull;
+  }
+  deIdent ident = deExpressionGetIdent(expression);
+  if (ident == deIdentNull || deIdentGetType(ident) != DE_IDENT_VARIABLE) {
+    return deVariableNull;
+  }
+  deVariable variable = deIdentGetVariable(ident);
+  if (deComptimeFrame == deBlockNull || deVariableGetBlock(variable) != deComptimeFrame) {
+    return deVariableNull;
+  }
+  return variable;
+}
+
+// Evaluate an index, and check it against the length of the array.  Return
+// false if it is out of bounds.
+static bool evaluateArrayIndex(deExpression expression, deValue array, uint32 *index) {
+  deValue value = evaluate(expression);
+  if (value == deValueNull) {
+    return false;
+  }
+  bool inBounds = false;
+  if (isIntegerValue(value)) {
+    mpz_t x;
+    mpz_init(x);
+    bigintToMpz(x, deValueGetBigintVal(value));
+    if (mpz_sgn(x) >= 0 && mpz_cmp_ui(x, deValueGetNumTupleValue(array)) < 0) {
+      *index = mpz_get_ui(x);
+      inBounds = true;
+    }
+    mpz_clear(x);
+  }
+  destroyValue(value);
+  return inBounds;
+}
+
+// Return the array stored in a local variable, or an element of one, without
+// copying it.  Return deValueNull if the expression is not such an access.
+static deValue findArray(deExpression expression) {
+  deValue value = deValueNull;
+  deExpressionType type = deExpressionGetType(expression);
+  if (type == DE_EXPR_IDENT) {
+    deVariable variable = findLocalVariable(expression);
+    if (variable != deVariableNull) {
+      value = deVariableGetValue(variable);
+    }
+  } else if (type == DE_EXPR_INDEX && deExpressionGetSignature(expression) == deSignatureNull) {
+    deExpression left = deExpressionGetFirstExpression(expression);
+    deValue array = findArray(left);
+    uint32 index;
+    if (array != deValueNull &&
+        evaluateArrayIndex(deExpressionGetNextExpression(left), array, &index)) {
+      value = deValueGetiTupleValue(array, index);
+    }
+  }
+  if (value == deValueNull || deValueGetType(value) != DE_TYPE_ARRAY) {
+    return deValueNull;
+  }
+  return value;
+}
+
+// Store |value| in a local variable, or an element of a local array.  The
+// variable takes ownership of the value.
+static bool assignValue(deExpression access, deValue value) {
+  deExpressionType type = deExpressionGetType(access);
+  if (type == DE_EXPR_IDENT) {
+    deVariable variable = findLocalVariable(access);
+    if (variable != deVariableNull) {
+      destroyValue(deVariableGetValue(variable));
+      deVariableSetValue(variable, value);
+      return true;
+    }
+  } else if (type == DE_EXPR_INDEX && deExpressionGetSignature(access) == deSignatureNull) {
+    deExpression left = deExpressionGetFirstExpression(access);
+    deValue array = findArray(left);
+    uint32 index;
+    if (array != deValueNull &&
+        evaluateArrayIndex(deExpressionGetNextExpression(left), array, &index)) {
+      destroyValue(deValueGetiTupleValue(array, index));
+      deValueSetiTupleValue(array, index, value);
+      return true;
+    }
+  }
+  destroyValue(value);
+  return false;
+}
+
+// Raise an integer to a power.  Return false if the result clearly cannot fit
+// in |width| bits, before computing it.
+static bool integerPower(mpz_t result, mpz_t base, mpz_t exponent, uint32 width) {
+  if (mpz_sgn(exponent) < 0 || !mpz_fits_ulong_p(exponent)) {
+    return false;
+  }
+  unsigned long power = mpz_get_ui(exponent);
+  if (mpz_cmpabs_ui(base, 1) > 0 && power > width) {
+    return false;
+  }
+  mpz_pow_ui(result, base, power);
+  return true;
+}
+
+// Rotate the low |width| bits of |value| left by |dist|.
+static void rotateLeft(mpz_t result, mpz_t value, uint32 width, uint32 dist) {
+  mpz_t bits, high;
+  mpz_init(bits);
+  mpz_init(high);
+  mpz_fdiv_r_2exp(bits, value, width);
+  mpz_fdiv_q_2exp(high, bits, width - dist);
+  mpz_mul_2exp(result, bits, dist);
+  mpz_ior(result, result, high);
+  mpz_clear(bits);
+  mpz_clear(high);
+}
+
+// Apply an integer operator.  The result has the datatype of the expression.
+static deValue applyIntegerOperator(deExpressionType type, deDatatype datatype,
+    deValue left, deValue right) {
+  uint32 width = deDatatypeGetWidth(datatype);
+  mpz_t x, y, r;
+  mpz_init(x);
+  mpz_init(y);
+  mpz_init(r);
+  bigintToMpz(x, deValueGetBigintVal(left));
+  bigintToMpz(y, deValueGetBigintVal(right));
+  bool ok = true;
+  bool truncate = false;
+  switch (type) {
+    case DE_EXPR_ADDTRUNC:
+      truncate = true;
+      // Fall through.
+    case DE_EXPR_ADD:
+      mpz_add(r, x, y);
+      break;
+    case DE_EXPR_SUBTRUNC:
+      truncate = true;
+      // Fall through.
+    case DE_EXPR_SUB:
+      mpz_sub(r, x, y);
+      break;
+    case DE_EXPR_MULTRUNC:
+      truncate = true;
+      // Fall through.
+    case DE_EXPR_MUL:
+      mpz_mul(r, x, y);
+      break;
+    case DE_EXPR_DIV:
+      ok = mpz_sgn(y) != 0;
+      if (ok) {
+        mpz_tdiv_q(r, x, y);
+      }
+      break;
+    case DE_EXPR_MOD:
+      // The sign of a remainder of negative operands is left to the runtime.
+      ok = mpz_sgn(y) > 0 && mpz_sgn(x) >= 0;
+      if (ok) {
+        mpz_tdiv_r(r, x, y);
+      }
+      break;
+    case DE_EXPR_BITAND:
+      mpz_and(r, x, y);
+      truncate = true;
+      break;
+    case DE_EXPR_BITOR:
+      mpz_ior(r, x, y);
+      truncate = true;
+      break;
+    case DE_EXPR_BITXOR:
+      mpz_xor(r, x, y);
+      truncate = true;
+      break;
+    case DE_EXPR_EXP:
+      ok = integerPower(r, x, y, width);
+      break;
+    case DE_EXPR_SHL:
+    case DE_EXPR_SHR:
+    case DE_EXPR_ROTL:
+    case DE_EXPR_ROTR: {
+      ok = mpz_sgn(y) >= 0 && mpz_cmp_ui(y, width) < 0;
+      if (!ok) {
+        break;
+      }
+      uint32 dist = mpz_get_ui(y);
+      truncate = true;
+      if (type == DE_EXPR_SHL) {
+        mpz_mul_2exp(r, x, dist);
+      } else if (type == DE_EXPR_SHR) {
+        mpz_fdiv_q_2exp(r, x, dist);
+      } else if (type == DE_EXPR_ROTL) {
+        rotateLeft(r, x, width, dist);
+      } else {
+        rotateLeft(r, x, width, (width - dist) % width);
+      }
+      break;
+    }
+    default:
+      ok = false;
+      break;
+  }
+  deValue result = ok? createIntegerValue(r, datatype, truncate) : deValueNull;
+  mpz_clear(x);
+  mpz_clear(y);
+  mpz_clear(r);
+  return result;
+}
+
+// Apply a binary operator to two values.
+static deValue applyBinaryOperator(deExpressionType type, deDatatype datatype,
+    deValue left, deValue right) {
+  switch (type) {
+    case DE_EXPR_EQUAL:
+      return deBoolValueCreate(valuesEqual(left, right));
+    case DE_EXPR_NOTEQUAL:
+      return deBoolValueCreate(!valuesEqual(left, right));
+    case DE_EXPR_LT:
+    case DE_EXPR_LE:
+    case DE_EXPR_GT:
+    case DE_EXPR_GE: {
+      if (!isIntegerValue(left) || !isIntegerValue(right)) {
+        return deValueNull;
+      }
+      int comparison = compareIntegers(left, right);
+      bool result = type == DE_EXPR_LT? comparison < 0 : type == DE_EXPR_LE? comparison <= 0 :
+          type == DE_EXPR_GT? comparison > 0 : comparison >= 0;
+      return deBoolValueCreate(result);
+    }
+    case DE_EXPR_AND:
+    case DE_EXPR_OR:
+    case DE_EXPR_XOR: {
+      if (deValueGetType(left) != DE_TYPE_BOOL || deValueGetType(right) != DE_TYPE_BOOL) {
+        return deValueNull;
+      }
+      bool a = deValueBoolVal(left);
+      bool b = deValueBoolVal(right);
+      return deBoolValueCreate(type == DE_EXPR_AND? a && b : type == DE_EXPR_OR? a || b : a != b);
+    }
+    default:
+      break;
+  }
+  if (!isIntegerValue(left) || !isIntegerValue(right) || !deDatatypeIsInteger(datatype) ||
+      deDatatypeGetType(datatype) == DE_TYPE_MODINT) {
+    return deValueNull;
+  }
+  return applyIntegerOperator(type, datatype, left, right);
+}
+
+// Evaluate a binary expression as operator |type|.  Assignment operators such
+// as += are evaluated this way too.
+static deValue evaluateBinary(deExpressionType type, deExpression expression) {
+  deExpression left = deExpressionGetFirstExpression(expression);
+  deValue leftValue = evaluate(left);
+  if (leftValue == deValueNull) {
+    return deValueNull;
+  }
+  deValue rightValue = evaluate(deExpressionGetNextExpression(left));
+  deValue result = deValueNull;
+  if (rightValue != deValueNull) {
+    result = applyBinaryOperator(type, deExpressionGetDatatype(expression), leftValue, rightValue);
+  }
+  destroyValue(leftValue);
+  destroyValue(rightValue);
+  return result;
+}
+
+// Evaluate a short-circuit && or || expression.
+static deValue evaluateLogical(deExpression expression) {
+  deExpression left = deExpressionGetFirstExpression(expression);
+  deValue leftValue = evaluate(left);
+  if (leftValue == deValueNull || deValueGetType(leftValue) != DE_TYPE_BOOL) {
+    destroyValue(leftValue);
+    return deValueNull;
+  }
+  bool isAnd = deExpressionGetType(expression) == DE_EXPR_AND;
+  if (deValueBoolVal(leftValue) != isAnd) {
+    return leftValue;
+  }
+  destroyValue(leftValue);
+  return evaluate(deExpressionGetNextExpression(left));
+}
+
+// Evaluate a unary expression.
+static deValue evaluateUnary(deExpression expression) {
+  deExpressionType type = deExpressionGetType(expression);
+  deDatatype datatype = deExpressionGetDatatype(expression);
+  deValue value = evaluate(deExpressionGetLastExpression(expression));
+  if (value == deValueNull) {
+    return deValueNull;
+  }
+  deValue result = deValueNull;
+  if (type == DE_EXPR_NOT) {
+    if (deValueGetType(value) == DE_TYPE_BOOL) {
+      result = deBoolValueCreate(!deValueBoolVal(value));
+    }
+  } else if (isIntegerValue(value) && deDatatypeIsInteger(datatype) &&
+      deDatatypeGetType(datatype) != DE_TYPE_MODINT) {
+    mpz_t x;
+    mpz_init(x);
+    bigintToMpz(x, deValueGetBigintVal(value));
+    switch (type) {
+      case DE_EXPR_NEGATE:
+        mpz_neg(x, x);
+        result = createIntegerValue(x, datatype, false);
+        break;
+      case DE_EXPR_NEGATETRUNC:
+        mpz_neg(x, x);
+        result = createIntegerValue(x, datatype, true);
+        break;
+      case DE_EXPR_BITNOT:
+        mpz_com(x, x);
+        result = createIntegerValue(x, datatype, true);
+        break;
+      case DE_EXPR_CAST:
+        result = createIntegerValue(x, datatype, false);
+        break;
+      case DE_EXPR_CASTTRUNC:
+        result = createIntegerValue(x, datatype, true);
+        break;
+      default:
+        break;
+    }
+    mpz_clear(x);
+  }
+  destroyValue(value);
+  return result;
+}
+
+// Evaluate a select expression.
+static deValue evaluateSelect(deExpression expression) {
+  deExpression select = deExpressionGetFirstExpression(expression);
+  deExpression data1 = deExpressionGetNextExpression(select);
+  deExpression data0 = deExpressionGetNextExpression(data1);
+  deValue selectValue = evaluate(select);
+  if (selectValue == deValueNull || deValueGetType(selectValue) != DE_TYPE_BOOL) {
+    destroyValue(selectValue);
+    return deValueNull;
+  }
+  bool selected = deValueBoolVal(selectValue);
+  destroyValue(selectValue);
+  return evaluate(selected? data1 : data0);
+}
+
+// Evaluate an array literal.
+static deValue evaluateArray(deExpression expression) {
+  if (deExpressionCountExpressions(expression) > DE_COMPTIME_MAX_ELEMENTS) {
+    return deValueNull;
+  }
+  deValue array = createArrayValue();
+  deExpression child;
+  for (child = deExpressionGetFirstExpression(expression); child != deExpressionNull;
+       child = deExpressionGetNextExpression(child)) {
+    deValue value = evaluate(child);
+    if (value == deValueNull) {
+      destroyValue(array);
+      return deValueNull;
+    }
+    deValueAppendTupleValue(array, value);
+  }
+  return array;
+}
+
+// Evaluate an index expression.  Local arrays are indexed in place, rather
+// than copied.
+static deValue evaluateIndex(deExpression expression) {
+  deExpression left = deExpressionGetFirstExpression(expression);
+  deValue array = findArray(left);
+  deValue temp = deValueNull;
+  if (array == deValueNull) {
+    temp = array = evaluate(left);
+    if (array == deValueNull || deValueGetType(array) != DE_TYPE_ARRAY) {
+      destroyValue(temp);
+      return deValueNull;
+    }
+  }
+  uint32 index;
+  deValue result = deValueNull;
+  if (evaluateArrayIndex(deExpressionGetNextExpression(left), array, &index)) {
+    result = copyValue(deValueGetiTupleValue(array, index));
+  }
+  destroyValue(temp);
+  return result;
+}
+
+// Evaluate the expression.  Return deValueNull if we cannot.
+static deValue evaluate(deExpression expression) {
+  if (--deComptimeStepsLeft < 0) {
+    return deValueNull;
+  }
+  deExpressionType type = deExpressionGetType(expression);
+  if (!datatypeSupported(deExpressionGetDatatype(expression)) ||
+      (type != DE_EXPR_CALL && deExpressionGetSignature(expression) != deSignatureNull)) {
+    // Operator overloads are not evaluated.
+    return deValueNull;
+  }
+  switch (type) {
+    case DE_EXPR_INTEGER: {
+      mpz_t x;
+      mpz_init(x);
+      bigintToMpz(x, deExpressionGetBigint(expression));
+      deValue value = createIntegerValue(x, deExpressionGetDatatype(expression), false);
+      mpz_clear(x);
+      return value;
+    }
+    case DE_EXPR_BOOL:
+      return deBoolValueCreate(deExpressionBoolVal(expression));
+    case DE_EXPR_IDENT: {
+      deVariable variable = findLocalVariable(expression);
+      if (variable == deVariableNull || deVariableGetValue(variable) == deValueNull) {
+        return deValueNull;
+      }
+      return copyValue(deVariableGetValue(variable));
+    }
+    case DE_EXPR_ARRAY:
+      return evaluateArray(expression);
+    case DE_EXPR_ARRAYOF:
+      return createArrayValue();
+    case DE_EXPR_INDEX:
+      return evaluateIndex(expression);
+    case DE_EXPR_AND:
+    case DE_EXPR_OR:
+      return evaluateLogical(expression);
+    case DE_EXPR_ADD:
+    case DE_EXPR_SUB:
+    case DE_EXPR_MUL:
+    case DE_EXPR_DIV:
+    case DE_EXPR_MOD:
+    case DE_EXPR_XOR:
+    case DE_EXPR_BITAND:
+    case DE_EXPR_BITOR:
+    case DE_EXPR_BITXOR:
+    case DE_EXPR_EXP:
+    case DE_EXPR_SHL:
+    case DE_EXPR_SHR:
+    case DE_EXPR_ROTL:
+    case DE_EXPR_ROTR:
+    case DE_EXPR_ADDTRUNC:
+    case DE_EXPR_SUBTRUNC:
+    case DE_EXPR_MULTRUNC:
+    case DE_EXPR_LT:
+    case DE_EXPR_LE:
+    case DE_EXPR_GT:
+    case DE_EXPR_GE:
+    case DE_EXPR_EQUAL:
+    case DE_EXPR_NOTEQUAL:
+      return evaluateBinary(type, expression);
+    case DE_EXPR_NEGATE:
+    case DE_EXPR_NEGATETRUNC:
+    case DE_EXPR_BITNOT:
+    case DE_EXPR_NOT:
+    case DE_EXPR_CAST:
+    case DE_EXPR_CASTTRUNC:
+      return evaluateUnary(expression);
+    case DE_EXPR_SELECT:
+      return evaluateSelect(expression);
+    case DE_EXPR_CALL: {
+      deValue result;
+      if (!evaluateCall(expression, &result)) {
+        return deValueNull;
+      }
+      return result;
+    }
+    default:
+      return deValueNull;
+  }
+}
+
+// Evaluate a call to a builtin array method.  Only methods without side
+// effects outside of local arrays are supported.
+static bool evaluateBuiltinCall(deExpression call, deFunction function, deValue *result) {
+  deExpression access = deExpressionGetFirstExpression(call);
+  deExpression parameters = deExpressionGetNextExpression(access);
+  deExpression self = deExpressionGetFirstExpression(access);
+  deExpression parameter = deExpressionGetFirstExpression(parameters);
+  if (deExpressionGetType(access) != DE_EXPR_DOT ||
+      !datatypeSupported(deExpressionGetDatatype(self))) {
+    return false;
+  }
+  deBuiltinFuncType type = deFunctionGetBuiltinType(function);
+  if (type == DE_BUILTINFUNC_ARRAYLENGTH) {
+    deValue array = findArray(self);
+    deValue temp = deValueNull;
+    if (array == deValueNull) {
+      temp = array = evaluate(self);
+      if (array == deValueNull || deValueGetType(array) != DE_TYPE_ARRAY) {
+        destroyValue(temp);
+        return false;
+      }
+    }
+    mpz_t length;
+    mpz_init_set_ui(length, deValueGetNumTupleValue(array));
+    *result = createIntegerValue(length, deExpressionGetDatatype(call), false);
+    mpz_clear(length);
+    destroyValue(temp);
+    return *result != deValueNull;
+  }
+  if (type != DE_BUILTINFUNC_ARRAYAPPEND && type != DE_BUILTINFUNC_ARRAYRESERVE &&
+      type != DE_BUILTINFUNC_ARRAYRESIZE) {
+    return false;
+  }
+  deValue array = findArray(self);
+  if (array == deValueNull || parameter == deExpressionNull ||
+      deExpressionGetNextExpression(parameter) != deExpressionNull) {
+    return false;
+  }
+  deValue value = evaluate(parameter);
+  if (value == deValueNull) {
+    return false;
+  }
+  uint32 numElements = deValueGetNumTupleValue(array);
+  if (type == DE_BUILTINFUNC_ARRAYAPPEND) {
+    if (numElements >= DE_COMPTIME_MAX_ELEMENTS) {
+      destroyValue(value);
+      return false;
+    }
+    deValueAppendTupleValue(array, value);
+    return true;
+  }
+  bool ok = isIntegerValue(value);
+  uint64 size = 0;
+  if (ok) {
+    mpz_t x;
+    mpz_init(x);
+    bigintToMpz(x, deValueGetBigintVal(value));
+    ok = mpz_sgn(x) >= 0 && mpz_cmp_ui(x, DE_COMPTIME_MAX_ELEMENTS) <= 0;
+    size = ok? mpz_get_ui(x) : 0;
+    mpz_clear(x);
+  }
+  destroyValue(value);
+  if (!ok || type == DE_BUILTINFUNC_ARRAYRESERVE) {
+    return ok;
+  }
+  // Resize pads with zeros of the element type.
+  deDatatype elementType = deDatatypeGetElementType(deExpressionGetDatatype(self));
+  if (size > numElements && deDatatypeGetType(elementType) == DE_TYPE_ARRAY) {
+    return false;
+  }
+  while (deValueGetNumTupleValue(array) > size) {
+    uint32 last = deValueGetNumTupleValue(array) - 1;
+    destroyValue(deValueGetiTupleValue(array, last));
+    deValueResizeTupleValues(array, last);
+  }
+  deComptimeStepsLeft -= size;
+  for (uint64 i = numElements; i < size; i++) {
+    if (deDatatypeGetType(elementType) == DE_TYPE_BOOL) {
+      deValueAppendTupleValue(array, deBoolValueCreate(false));
+    } else {
+      mpz_t zero;
+      mpz_init(zero);
+      deValueAppendTupleValue(array, createIntegerValue(zero, elementType, false));
+      mpz_clear(zero);
+    }
+  }
+  return true;
+}
+
+// Determine if the interpreter can run the signature's body.  Only plain
+// functions without var parameters are supported.
+static bool signatureCanBeEvaluated(deSignature signature) {
+  deFunction function = deSignatureGetFunction(signature);
+  deLinkage linkage = deFunctionGetLinkage(function);
+  if (!deSignatureInstantiated(signature) || deFunctionGetType(function) != DE_FUNC_PLAIN ||
+      (linkage != DE_LINK_MODULE && linkage != DE_LINK_PACKAGE) ||
+      deSignatureGetUsedParamspec(signature) > DE_COMPTIME_MAX_PARAMS) {
+    return false;
+  }
+  deDatatype returnType = deSignatureGetReturnType(signature);
+  if (returnType != deNoneDatatypeCreate() && !datatypeSupported(returnType)) {
+    return false;
+  }
+  deVariable variable = deBlockGetFirstVariable(deSignatureGetBlock(signature));
+  for (uint32 xParam = 0; xParam < deSignatureGetUsedParamspec(signature); xParam++) {
+    if (deSignatureParamInstantiated(signature, xParam) &&
+        (!deVariableConst(variable) || !datatypeSupported(deSignatureGetiType(signature, xParam)))) {
+      return false;
+    }
+    variable = deVariableGetNextBlockVariable(variable);
+  }
+  return true;
+}
+
+// Run the signature's body with the arguments.  Variables of the block are
+// saved and restored, so recursive calls work.
+static bool runSignature(deSignature signature, deValue *args, deValue *result) {
+  deBlock block = deSignatureGetBlock(signature);
+  uint32 numVariables = 0;
+  deVariable variable;
+  deForeachBlockVariable(block, variable) {
+    numVariables++;
+  } deEndBlockVariable;
+  deValue *savedValues = utNewA(deValue, numVariables + 1);
+  uint32 xVariable = 0;
+  deForeachBlockVariable(block, variable) {
+    savedValues[xVariable++] = deVariableGetValue(variable);
+    deVariableSetValue(variable, deValueNull);
+  } deEndBlockVariable;
+  variable = deBlockGetFirstVariable(block);
+  for (uint32 xParam = 0; xParam < deSignatureGetUsedParamspec(signature); xParam++) {
+    utAssert(deVariableGetType(variable) == DE_VAR_PARAMETER);
+    if (args[xParam] != deValueNull) {
+      deVariableSetValue(variable, copyValue(args[xParam]));
+    }
+    variable = deVariableGetNextBlockVariable(variable);
+  }
+  deBlock savedFrame = deComptimeFrame;
+  deComptimeFrame = block;
+  deComptimeDepth++;
+  deFlow flow = executeBlock(block);
+  deComptimeDepth--;
+  deComptimeFrame = savedFrame;
+  *result = deComptimeReturnValue;
+  deComptimeReturnValue = deValueNull;
+  if (flow == DE_FLOW_FAIL) {
+    destroyValue(*result);
+    *result = deValueNull;
+  }
+  xVariable = 0;
+  deForeachBlockVariable(block, variable) {
+    destroyValue(deVariableGetValue(variable));
+    deVariableSetValue(variable, savedValues[xVariable++]);
+  } deEndBlockVariable;
+  utFree(savedValues);
+  return flow != DE_FLOW_FAIL;
+}
+
+// Evaluate a call.  |result| is set to deValueNull for calls returning none.
+static bool evaluateCall(deExpression call, deValue *result) {
+  *result = deValueNull;
+  deExpression access = deExpressionGetFirstExpression(call);
+  deExpression parameters = deExpressionGetNextExpression(access);
+  deDatatype callType = deExpressionGetDatatype(access);
+  if (deDatatypeGetType(callType) != DE_TYPE_FUNCTION) {
+    return false;
+  }
+  deFunction function = deDatatypeGetFunction(callType);
+  if (deFunctionBuiltin(function)) {
+    return evaluateBuiltinCall(call, function, result);
+  }
+  deSignature signature = deExpressionGetSignature(call);
+  if (signature == deSignatureNull || deExpressionIsMethodCall(access) ||
+      deComptimeDepth >= DE_COMPTIME_MAX_DEPTH || !signatureCanBeEvaluated(signature)) {
+    return false;
+  }
+  // Parameters are evaluated by the caller, including omitted default values.
+  uint32 numParams = deSignatureGetUsedParamspec(signature);
+  deValue args[DE_COMPTIME_MAX_PARAMS];
+  uint32 numArgs = 0;
+  bool ok = true;
+  deExpression parameter = deExpressionGetFirstExpression(parameters);
+  for (uint32 xParam = 0; xParam < numParams && ok; xParam++) {
+    deExpression value = parameter;
+    if (parameter == deExpressionNull) {
+      deVariable variable = deParamspecGetVariable(deSignatureGetiParamspec(signature, xParam));
+      value = deVariableGetInitializerExpression(variable);
+    } else {
+      parameter = deExpressionGetNextExpression(parameter);
+    }
+    args[numArgs] = deValueNull;
+    if (value == deExpressionNull || deExpressionGetType(value) == DE_EXPR_NAMEDPARAM) {
+      ok = false;
+    } else if (deSignatureParamInstantiated(signature, xParam)) {
+      args[numArgs] = evaluate(value);
+      ok = args[numArgs] != deValueNull;
+    }
+    numArgs++;
+  }
+  if (!ok || parameter != deExpressionNull) {
+    for (uint32 xArg = 0; xArg < numArgs; xArg++) {
+      destroyValue(args[xArg]);
+    }
+    return false;
+  }
+  uint32 hash = deSignature2Index(signature);
+  for (uint32 xArg = 0; xArg < numArgs; xArg++) {
+    hash = utHashValues(hash, hashValue(args[xArg]));
+  }
+  deComptimeCall *memoized = findComptimeCall(signature, args, numArgs, hash);
+  if (memoized != NULL) {
+    for (uint32 xArg = 0; xArg < numArgs; xArg++) {
+      destroyValue(args[xArg]);
+    }
+    if (memoized->result != deValueNull) {
+      *result = copyValue(memoized->result);
+    }
+    return !memoized->failed;
+  }
+  ok = runSignature(signature, args, result);
+  memoizeCall(signature, args, numArgs, hash,
+      *result == deValueNull? deValueNull : copyValue(*result), !ok);
+  return ok;
+}
+
+// Execute an assignment or call used as a statement, or in a for-loop.
+static bool executeExpression(deExpression expression) {
+  deExpressionType type = deExpressionGetType(expression);
+  if (type == DE_EXPR_CALL) {
+    deValue result;
+    if (!evaluateCall(expression, &result)) {
+      return false;
+    }
+    destroyValue(result);
+    return true;
+  }
+  deExpression access = deExpressionGetFirstExpression(expression);
+  deValue value;
+  if (type == DE_EXPR_EQUALS) {
+    value = evaluate(deExpressionGetNextExpression(access));
+  } else if (type >= DE_EXPR_ADD_EQUALS && type <= DE_EXPR_MULTRUNC_EQUALS &&
+      deExpressionGetSignature(expression) == deSignatureNull) {
+    value = evaluateBinary(type + DE_EXPR_ADD - DE_EXPR_ADD_EQUALS, expression);
+  } else {
+    return false;
+  }
+  if (value == deValueNull) {
+    return false;
+  }
+  return assignValue(access, value);
+}
+
+// Evaluate a condition.  Return false if it is not a Boolean we can compute.
+static bool evaluateCondition(deExpression expression, bool *condition) {
+  deValue value = evaluate(expression);
+  if (value == deValueNull || deValueGetType(value) != DE_TYPE_BOOL) {
+    destroyValue(value);
+    return false;
+  }
+  *condition = deValueBoolVal(value);
+  destroyValue(value);
+  return true;
+}
+
+// Execute an if statement, and its else-if and else clauses.
+static deFlow executeIfStatement(deStatement statement) {
+  while (true) {
+    deExpression expression = deStatementGetExpression(statement);
+    bool taken = true;
+    if (expression != deExpressionNull && !evaluateCondition(expression, &taken)) {
+      return DE_FLOW_FAIL;
+    }
+    if (taken) {
+      return executeBlock(deStatementGetSubBlock(statement));
+    }
+    statement = deStatementGetNextBlockStatement(statement);
+    if (statement == deStatementNull || (deStatementGetType(statement) != DE_STATEMENT_ELSEIF &&
+        deStatementGetType(statement) != DE_STATEMENT_ELSE)) {
+      return DE_FLOW_NEXT;
+    }
+  }
+}
+
+// Execute a switch statement on an integer or Boolean value.
+static deFlow executeSwitchStatement(deStatement statement) {
+  deValue target = evaluate(deStatementGetExpression(statement));
+  if (target == deValueNull) {
+    return DE_FLOW_FAIL;
+  }
+  deFlow flow = DE_FLOW_NEXT;
+  deStatement caseStatement;
+  deForeachBlockStatement(deStatementGetSubBlock(statement), caseStatement) {
+    if (deStatementInstantiated(caseStatement)) {
+      bool matches = deStatementGetType(caseStatement) == DE_STATEMENT_DEFAULT;
+      deExpression expression = deStatementGetExpression(caseStatement);
+      deExpression caseExpression;
+      for (caseExpression = expression == deExpressionNull? deExpressionNull :
+           deExpressionGetFirstExpression(expression);
+           caseExpression != deExpressionNull && !matches;
+           caseExpression = deExpressionGetNextExpression(caseExpression)) {
+        deValue value = evaluate(caseExpression);
+        if (value == deValueNull) {
+          destroyValue(target);
+          return DE_FLOW_FAIL;
+        }
+        matches = valuesEqual(target, value);
+        destroyValue(value);
+      }
+      if (matches) {
+        flow = executeBlock(deStatementGetSubBlock(caseStatement));
+        break;
+      }
+    }
+  } deEndBlockStatement;
+  destroyValue(target);
+  return flow;
+}
+
+// Execute the case of a typeswitch the binder selected.
+static deFlow executeSelectedSwitchCase(deStatement statement) {
+  deStatement caseStatement;
+  deForeachBlockStatement(deStatementGetSubBlock(statement), caseStatement) {
+    if (deStatementInstantiated(caseStatement)) {
+      return executeBlock(deStatementGetSubBlock(caseStatement));
+    }
+  } deEndBlockStatement;
+  return DE_FLOW_NEXT;
+}
+
+// Execute a do-while or while loop.
+static deFlow executeWhileStatement(deStatement statement) {
+  deStatement prevStatement = deStatementGetPrevBlockStatement(statement);
+  if (prevStatement != deStatementNull && deStatementGetType(prevStatement) == DE_STATEMENT_DO) {
+    // Already executed with the do statement.
+    return DE_FLOW_NEXT;
+  }
+  deBlock doBlock = deBlockNull;
+  if (deStatementGetType(statement) == DE_STATEMENT_DO) {
+    doBlock = deStatementGetSubBlock(statement);
+    statement = deStatementGetNextBlockStatement(statement);
+    if (statement == deStatementNull || deStatementGetType(statement) != DE_STATEMENT_WHILE) {
+      return DE_FLOW_FAIL;
+    }
+  }
+  deBlock whileBlock = deStatementGetSubBlock(statement);
+  while (true) {
+    if (doBlock != deBlockNull) {
+      deFlow flow = executeBlock(doBlock);
+      if (flow != DE_FLOW_NEXT) {
+        return flow;
+      }
+    }
+    bool condition;
+    if (!evaluateCondition(deStatementGetExpression(statement), &condition)) {
+      return DE_FLOW_FAIL;
+    }
+    if (!condition) {
+      return DE_FLOW_NEXT;
+    }
+    if (whileBlock != deBlockNull) {
+      deFlow flow = executeBlock(whileBlock);
+      if (flow != DE_FLOW_NEXT) {
+        return flow;
+      }
+    }
+  }
+}
+
+// Execute a for-loop.
+static deFlow executeForStatement(deStatement statement) {
+  deExpression expression = deStatementGetExpression(statement);
+  deExpression init = deExpressionGetFirstExpression(expression);
+  deExpression test = deExpressionGetNextExpression(init);
+  deExpression update = deExpressionGetNextExpression(test);
+  if (!executeExpression(init)) {
+    return DE_FLOW_FAIL;
+  }
+  while (true) {
+    bool condition;
+    if (!evaluateCondition(test, &condition)) {
+      return DE_FLOW_FAIL;
+    }
+    if (!condition) {
+      return DE_FLOW_NEXT;
+    }
+    deFlow flow = executeBlock(deStatementGetSubBlock(statement));
+    if (flow != DE_FLOW_NEXT) {
+      return flow;
+    }
+    if (!executeExpression(update)) {
+      return DE_FLOW_FAIL;
+    }
+  }
+}
+
+// Execute a statement.
+static deFlow executeStatement(deStatement statement) {
+  if (--deComptimeStepsLeft < 0) {
+    return DE_FLOW_FAIL;
+  }
+  deExpression expression = deStatementGetExpression(statement);
+  switch (deStatementGetType(statement)) {
+    case DE_STATEMENT_IF:
+      return executeIfStatement(statement);
+    case DE_STATEMENT_ELSEIF:
+    case DE_STATEMENT_ELSE:
+      // Executed by the if statement.
+      return DE_FLOW_NEXT;
+    case DE_STATEMENT_SWITCH:
+      return executeSwitchStatement(statement);
+    case DE_STATEMENT_TYPESWITCH:
+      return executeSelectedSwitchCase(statement);
+    case DE_STATEMENT_DO:
+    case DE_STATEMENT_WHILE:
+      return executeWhileStatement(statement);
+    case DE_STATEMENT_FOR:
+      return executeForStatement(statement);
+    case DE_STATEMENT_ASSIGN:
+    case DE_STATEMENT_CALL:
+      return executeExpression(expression)? DE_FLOW_NEXT : DE_FLOW_FAIL;
+    case DE_STATEMENT_RETURN:
+      if (expression != deExpressionNull) {
+        deComptimeReturnValue = evaluate(expression);
+        if (deComptimeReturnValue == deValueNull) {
+          return DE_FLOW_FAIL;
+        }
+      }
+      return DE_FLOW_RETURN;
+    default:
+      // Printing, raising, reference counting, etc.
+      return DE_FLOW_FAIL;
+  }
+}
+
+// Execute the block's instantiated statements.
+static deFlow executeBlock(deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (deStatementInstantiated(statement)) {
+      deFlow flow = executeStatement(statement);
+      if (flow != DE_FLOW_NEXT) {
+        return flow;
+      }
+    }
+  } deEndBlockStatement;
+  return DE_FLOW_NEXT;
+}
+
+// Determine if the expression is a literal constant, or an array of them.
+static bool isConstantArgument(deExpression expression) {
+  switch (deExpressionGetType(expression)) {
+    case DE_EXPR_INTEGER:
+    case DE_EXPR_BOOL:
+      return true;
+    case DE_EXPR_ARRAY: {
+      deExpression child;
+      deForeachExpressionExpression(expression, child) {
+        if (!isConstantArgument(child)) {
+          return false;
+        }
+      } deEndExpressionExpression;
+      return true;
+    }
+    default:
+      return deExpressionIsType(expression);
+  }
+}
+
+// Determine if a value of the datatype can be embedded as a constant.  Arrays
+// must be of integers, which genllvm emits as constant globals.
+static bool canEmbedDatatype(deDatatype datatype) {
+  if (!datatypeSupported(datatype)) {
+    return false;
+  }
+  deDatatypeType type = deDatatypeGetType(datatype);
+  if (type == DE_TYPE_ARRAY) {
+    type = deDatatypeGetType(deDatatypeGetElementType(datatype));
+    return type == DE_TYPE_UINT || type == DE_TYPE_INT;
+  }
+  return true;
+}
+
+// Morph the call into the constant |value|.
+static bool embedValue(deExpression call, deValue value) {
+  deDatatype datatype = deExpressionGetDatatype(call);
+  if (deDatatypeGetType(datatype) != DE_TYPE_ARRAY) {
+    deSetExpressionToValue(call, value);
+    deExpressionSetSignature(call, deSignatureNull);
+    return true;
+  }
+  uint32 numElements = deValueGetNumTupleValue(value);
+  if (numElements == 0 || numElements > DE_COMPTIME_MAX_ELEMENTS) {
+    return false;
+  }
+  deExpression child;
+  deSafeForeachExpressionExpression(call, child) {
+    deExpressionDestroy(child);
+  } deEndSafeExpressionExpression;
+  deExpressionSetType(call, DE_EXPR_ARRAY);
+  deExpressionSetSignature(call, deSignatureNull);
+  deDatatype elementType = deDatatypeGetElementType(datatype);
+  deLine line = deExpressionGetLine(call);
+  for (uint32 i = 0; i < numElements; i++) {
+    deBigint bigint = deCopyBigint(deValueGetBigintVal(deValueGetiTupleValue(value, i)));
+    deExpression element = deIntegerExpressionCreate(bigint, line);
+    deExpressionSetDatatype(element, elementType);
+    deExpressionAppendExpression(call, element);
+  }
+  return true;
+}
+
+// Try to evaluate a call with constant arguments, and replace it with its
+// result.  Return true if the call was replaced.
+bool deEvaluateCallAtCompileTime(deExpression call) {
+  deExpression access = deExpressionGetFirstExpression(call);
+  deDatatype callType = deExpressionGetDatatype(access);
+  if (deComptimeTotalSteps >= DE_COMPTIME_MAX_TOTAL_STEPS ||
+      deExpressionGetSignature(call) == deSignatureNull ||
+      deDatatypeGetType(callType) != DE_TYPE_FUNCTION ||
+      deFunctionBuiltin(deDatatypeGetFunction(callType)) ||
+      !canEmbedDatatype(deExpressionGetDatatype(call))) {
+    return false;
+  }
+  deExpression parameter;
+  deForeachExpressionExpression(deExpressionGetNextExpression(access), parameter) {
+    if (!isConstantArgument(parameter)) {
+      return false;
+    }
+  } deEndExpressionExpression;
+  deComptimeStepsLeft = DE_COMPTIME_MAX_STEPS;
+  deComptimeFrame = deBlockNull;
+  deValue result;
+  bool ok = evaluateCall(call, &result);
+  if (deComptimeStepsLeft < 0) {
+    deComptimeStepsLeft = 0;
+  }
+  deComptimeTotalSteps += DE_COMPTIME_MAX_STEPS - deComptimeStepsLeft;
+  ok = ok && result != deValueNull && embedValue(call, result);
+  destroyValue(result);
+  return ok;
+}
+
+// Free the memoized results.
+void deClearCompileTimeResults(void) {
+  for (uint32 i = 0; i < deNumComptimeCalls; i++) {
+    deComptimeCall *call = deComptimeCalls + i;
+    for (uint32 xArg = 0; xArg < call->numArgs; xArg++) {
+      destroyValue(call->args[xArg]);
+    }
+    destroyValue(call->result);
+  }
+  if (deComptimeCalls != NULL) {
+    utFree(deComptimeCalls);
+    utFree(deComptimeCallTable);
+  }
+  deComptimeCalls = NULL;
+  deComptimeCallTable = NULL;
+  deNumComptimeCalls = deAllocatedComptimeCalls = deComptimeCallTableSize = 0;
+}
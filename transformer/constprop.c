@@ -20,6 +20,102 @@
 // Forward declaration for recursion.
 static bool propagateExpressionConstants(deBlock scopeBlock, deExpression expression, deBigint modulus);
 
+// Count how many expressions and statements have been folded, so the
+// interprocedural pass knows when it is done.
+static uint32 deNumFolds;
+// Set while propagating constants across signatures, when calls with constant
+// arguments are evaluated at compile time.
+static bool deEvaluateCalls;
+
+// Morph the expression into a bool constant.
+static void setExpressionToBool(deExpression expression, bool value) {
+  deValue boolValue = deBoolValueCreate(value);
+  deSetExpressionToValue(expression, boolValue);
+  deValueDestroy(boolValue);
+  deNumFolds++;
+}
+
+// Determine if the expression is computed on secrets, or calls an overloaded
+// operator, either of which we must not fold.
+static bool cannotFold(deExpression expression) {
+  deDatatype datatype = deExpressionGetDatatype(expression);
+  return deExpressionGetSignature(expression) != deSignatureNull ||
+      (datatype != deDatatypeNull && deDatatypeSecret(datatype));
+}
+
+// Fold a logical expression if its result is known.  The right side of && and
+// || is not evaluated when the left side decides the result, so it need not be
+// constant.  Return true if the expression is now constant.
+static bool foldLogicalExpression(deExpression expression) {
+  deExpression left = deExpressionGetFirstExpression(expression);
+  deExpression right = deExpressionGetNextExpression(left);
+  deExpressionType type = deExpressionGetType(expression);
+  if (cannotFold(expression) || deExpressionGetType(left) != DE_EXPR_BOOL) {
+    return false;
+  }
+  bool leftVal = deExpressionBoolVal(left);
+  if ((type == DE_EXPR_AND && !leftVal) || (type == DE_EXPR_OR && leftVal)) {
+    setExpressionToBool(expression, leftVal);
+    return true;
+  }
+  if (deExpressionGetType(right) != DE_EXPR_BOOL) {
+    return false;
+  }
+  bool rightVal = deExpressionBoolVal(right);
+  setExpressionToBool(expression, type == DE_EXPR_XOR? leftVal != rightVal : rightVal);
+  return true;
+}
+
+// Fold a comparison of integer or bool constants.  Return true if the
+// expression is now constant.
+static bool foldComparison(deExpression expression) {
+  deExpression left = deExpressionGetFirstExpression(expression);
+  deExpression right = deExpressionGetNextExpression(left);
+  deExpressionType leftType = deExpressionGetType(left);
+  if (cannotFold(expression) || leftType != deExpressionGetType(right)) {
+    return false;
+  }
+  deExpressionType type = deExpressionGetType(expression);
+  int32 order;
+  if (leftType == DE_EXPR_INTEGER) {
+    deBigint leftVal = deExpressionGetBigint(left);
+    deBigint rightVal = deExpressionGetBigint(right);
+    if (deBigintGetWidth(leftVal) != deBigintGetWidth(rightVal) ||
+        deBigintSigned(leftVal) != deBigintSigned(rightVal)) {
+      return false;
+    }
+    order = deBigintCompare(leftVal, rightVal);
+  } else if (leftType == DE_EXPR_BOOL && (type == DE_EXPR_EQUAL || type == DE_EXPR_NOTEQUAL)) {
+    order = deExpressionBoolVal(left) == deExpressionBoolVal(right)? 0 : 1;
+  } else {
+    return false;
+  }
+  bool result = false;
+  switch (type) {
+    case DE_EXPR_LT: result = order < 0; break;
+    case DE_EXPR_LE: result = order <= 0; break;
+    case DE_EXPR_GT: result = order > 0; break;
+    case DE_EXPR_GE: result = order >= 0; break;
+    case DE_EXPR_EQUAL: result = order == 0; break;
+    case DE_EXPR_NOTEQUAL: result = order != 0; break;
+    default:
+      utExit("Unexpected comparison type");
+  }
+  setExpressionToBool(expression, result);
+  return true;
+}
+
+// Fold a logical not of a bool constant.  Return true if the expression is
+// now constant.
+static bool foldNotExpression(deExpression expression) {
+  deExpression child = deExpressionGetFirstExpression(expression);
+  if (cannotFold(expression) || deExpressionGetType(child) != DE_EXPR_BOOL) {
+    return false;
+  }
+  setExpressionToBool(expression, !deExpressionBoolVal(child));
+  return true;
+}
+
 // Perform constant propagation for all child expressions.  Return true if all
 // children are constant.
 static bool propagateChildConstants(deBlock scopeBlock, deExpression expression, deBigint modulus) {
@@ -49,8 +145,10 @@ static bool propagateModularConstants(deBlock scopeBlock, deExpression expressio
 // then use modular arithmetic when propagating constants.  Return true if the
 // expression is constant.
 //
-// This is just the beginning of constant propagation.  So far, only negation is
-// actually propagated.
+// So far, negation, comparisons, and logical operators are propagated.
+// Arithmetic is left to LLVM, so overflow is still reported at runtime.  When
+// propagating across signatures, calls with constant arguments are run by the
+// compile-time interpreter in comptime.c.
 // TODO(waywardgeek): Flesh out constant propagation.
 static bool propagateExpressionConstants(deBlock scopeBlock, deExpression expression, deBigint modulus) {
   switch (deExpressionGetType(expression)) {
@@ -72,9 +170,6 @@ static bool propagateExpressionConstants(deBlock scopeBlock, deExpression expres
     case DE_EXPR_DIV:
     case DE_EXPR_MOD:
     case DE_EXPR_BITAND:
-    case DE_EXPR_AND:
-    case DE_EXPR_OR :
-    case DE_EXPR_XOR:
     case DE_EXPR_BITOR :
     case DE_EXPR_BITXOR:
     case DE_EXPR_EXP:
@@ -86,17 +181,9 @@ static bool propagateExpressionConstants(deBlock scopeBlock, deExpression expres
     case DE_EXPR_SUBTRUNC:
     case DE_EXPR_MULTRUNC:
     case DE_EXPR_BITNOT:
-    case DE_EXPR_LT:
-    case DE_EXPR_LE:
-    case DE_EXPR_GT:
-    case DE_EXPR_GE:
-    case DE_EXPR_EQUAL:
-    case DE_EXPR_NOTEQUAL:
-    case DE_EXPR_NOT:
     case DE_EXPR_CAST:
     case DE_EXPR_CASTTRUNC:
     case DE_EXPR_SELECT:
-    case DE_EXPR_CALL:
     case DE_EXPR_INDEX:
     case DE_EXPR_SLICE:
     case DE_EXPR_SECRET:
@@ -131,6 +218,7 @@ static bool propagateExpressionConstants(deBlock scopeBlock, deExpression expres
     case DE_EXPR_NOTNULL:
     case DE_EXPR_FUNCADDR:
     case DE_EXPR_ARRAYOF:
+    case DE_EXPR_VECTOROF:
     case DE_EXPR_TYPEOF:
     case DE_EXPR_UNSIGNED:
     case DE_EXPR_SIGNED:
@@ -149,6 +237,33 @@ static bool propagateExpressionConstants(deBlock scopeBlock, deExpression expres
       // TODO: Write code to evaluate these expressions.
       propagateChildConstants(scopeBlock, expression, modulus);
       return false;
+    case DE_EXPR_AND:
+    case DE_EXPR_OR:
+    case DE_EXPR_XOR:
+      propagateChildConstants(scopeBlock, expression, modulus);
+      return foldLogicalExpression(expression);
+    case DE_EXPR_LT:
+    case DE_EXPR_LE:
+    case DE_EXPR_GT:
+    case DE_EXPR_GE:
+    case DE_EXPR_EQUAL:
+    case DE_EXPR_NOTEQUAL:
+      if (!propagateChildConstants(scopeBlock, expression, modulus)) {
+        return false;
+      }
+      return foldComparison(expression);
+    case DE_EXPR_CALL:
+      propagateChildConstants(scopeBlock, expression, modulus);
+      if (!deEvaluateCalls || modulus != deBigintNull || !deEvaluateCallAtCompileTime(expression)) {
+        return false;
+      }
+      deNumFolds++;
+      return true;
+    case DE_EXPR_NOT:
+      if (!propagateChildConstants(scopeBlock, expression, modulus)) {
+        return false;
+      }
+      return foldNotExpression(expression);
     case DE_EXPR_NEGATE:
       if (!propagateChildConstants(scopeBlock, expression, modulus)) {
         return false;
@@ -178,3 +293,481 @@ void deConstantPropagation(deBlock scopeBlock, deBlock block) {
     }
   } deEndBlockStatement;
 }
+
+// Destroy the statement and every statement after it in its block.  These are
+// unreachable after a return or raise.
+static void destroyStatementsFrom(deStatement statement) {
+  while (statement != deStatementNull) {
+    deStatement nextStatement = deStatementGetNextBlockStatement(statement);
+    deStatementDestroy(statement);
+    statement = nextStatement;
+  }
+}
+
+// Replace |statement| with the statements of |subBlock|, which is the
+// statement's sub-block, or one of its case blocks.  Return the first moved
+// statement, or the statement that followed |statement| if there are none.
+static deStatement replaceStatementWithBlock(deStatement statement, deBlock subBlock) {
+  deStatement lastStatement = deBlockGetLastStatement(subBlock);
+  deMoveBlockStatementsAfterStatement(subBlock, statement);
+  deStatement nextStatement = deStatementGetNextBlockStatement(statement);
+  if (lastStatement != deStatementNull) {
+    deStatementType type = deStatementGetType(lastStatement);
+    if (type == DE_STATEMENT_RETURN || type == DE_STATEMENT_RAISE) {
+      destroyStatementsFrom(deStatementGetNextBlockStatement(lastStatement));
+    }
+  }
+  deStatementDestroy(statement);
+  deNumFolds++;
+  return nextStatement;
+}
+
+// Return the next clause of an if-else-if chain, or deStatementNull.
+static deStatement nextIfClause(deStatement statement) {
+  deStatement nextStatement = deStatementGetNextBlockStatement(statement);
+  if (nextStatement == deStatementNull) {
+    return deStatementNull;
+  }
+  deStatementType type = deStatementGetType(nextStatement);
+  if (type != DE_STATEMENT_ELSEIF && type != DE_STATEMENT_ELSE) {
+    return deStatementNull;
+  }
+  return nextStatement;
+}
+
+// Destroy |statement| and the rest of the clauses in its if chain.
+static void destroyIfClauses(deStatement statement) {
+  while (statement != deStatementNull) {
+    deStatement nextStatement = nextIfClause(statement);
+    deStatementDestroy(statement);
+    statement = nextStatement;
+  }
+}
+
+// Remove clauses with a constant false condition from the if chain.  A clause
+// with a constant true condition becomes the last one, and if it is the first,
+// the chain is replaced with its body.  Return the statement to fold next.
+static deStatement foldIfStatement(deStatement ifStatement) {
+  deStatement statement = ifStatement;
+  while (statement != deStatementNull && deStatementGetType(statement) != DE_STATEMENT_ELSE) {
+    deStatement nextClause = nextIfClause(statement);
+    deExpression condition = deStatementGetExpression(statement);
+    if (deExpressionGetType(condition) != DE_EXPR_BOOL) {
+      statement = nextClause;
+      continue;
+    }
+    bool isFirst = statement == ifStatement;
+    if (deExpressionBoolVal(condition)) {
+      destroyIfClauses(nextClause);
+      if (isFirst) {
+        return replaceStatementWithBlock(statement, deStatementGetSubBlock(statement));
+      }
+      deStatementSetType(statement, DE_STATEMENT_ELSE);
+      deExpressionDestroy(condition);
+      deNumFolds++;
+      return ifStatement;
+    }
+    deStatement nextStatement = deStatementGetNextBlockStatement(statement);
+    deStatementDestroy(statement);
+    deNumFolds++;
+    if (isFirst) {
+      if (nextClause == deStatementNull) {
+        return nextStatement;
+      }
+      if (deStatementGetType(nextClause) == DE_STATEMENT_ELSE) {
+        return replaceStatementWithBlock(nextClause, deStatementGetSubBlock(nextClause));
+      }
+      deStatementSetType(nextClause, DE_STATEMENT_IF);
+      ifStatement = nextClause;
+    }
+    statement = nextClause;
+  }
+  return ifStatement;
+}
+
+// Replace a switch on an integer constant with the selected case.  Return the
+// statement to fold next.
+static deStatement foldSwitchStatement(deStatement statement) {
+  deExpression target = deStatementGetExpression(statement);
+  if (deExpressionGetType(target) != DE_EXPR_INTEGER) {
+    return statement;
+  }
+  deBigint targetVal = deExpressionGetBigint(target);
+  deStatement selectedCase = deStatementNull;
+  deStatement defaultCase = deStatementNull;
+  deStatement caseStatement;
+  deForeachBlockStatement(deStatementGetSubBlock(statement), caseStatement) {
+    if (!deStatementInstantiated(caseStatement)) {
+      continue;
+    }
+    if (deStatementGetType(caseStatement) == DE_STATEMENT_DEFAULT) {
+      defaultCase = caseStatement;
+      continue;
+    }
+    deExpression caseExpression;
+    deForeachExpressionExpression(deStatementGetExpression(caseStatement), caseExpression) {
+      if (deExpressionGetType(caseExpression) != DE_EXPR_INTEGER) {
+        return statement;
+      }
+      deBigint caseVal = deExpressionGetBigint(caseExpression);
+      if (deBigintGetWidth(caseVal) != deBigintGetWidth(targetVal) ||
+          deBigintSigned(caseVal) != deBigintSigned(targetVal)) {
+        return statement;
+      }
+      if (selectedCase == deStatementNull && deBigintCompare(caseVal, targetVal) == 0) {
+        selectedCase = caseStatement;
+      }
+    } deEndExpressionExpression;
+  } deEndBlockStatement;
+  if (selectedCase == deStatementNull) {
+    selectedCase = defaultCase;
+  }
+  if (selectedCase == deStatementNull) {
+    deStatement nextStatement = deStatementGetNextBlockStatement(statement);
+    deStatementDestroy(statement);
+    deNumFolds++;
+    return nextStatement;
+  }
+  return replaceStatementWithBlock(statement, deStatementGetSubBlock(selectedCase));
+}
+
+// Remove while loops that never run, and unroll do-while loops that run once.
+// Return the statement to fold next.
+static deStatement foldWhileStatement(deBlock scopeBlock, deStatement statement) {
+  deStatement whileStatement = statement;
+  if (deStatementGetType(statement) == DE_STATEMENT_DO) {
+    whileStatement = deStatementGetNextBlockStatement(statement);
+    propagateExpressionConstants(scopeBlock, deStatementGetExpression(whileStatement), deBigintNull);
+  } else {
+    deStatement prevStatement = deStatementGetPrevBlockStatement(statement);
+    if (prevStatement != deStatementNull && deStatementGetType(prevStatement) == DE_STATEMENT_DO) {
+      // Folded along with its do statement.
+      return statement;
+    }
+  }
+  deExpression condition = deStatementGetExpression(whileStatement);
+  if (deExpressionGetType(condition) != DE_EXPR_BOOL || deExpressionBoolVal(condition)) {
+    return statement;
+  }
+  deStatement nextStatement = deStatementGetNextBlockStatement(whileStatement);
+  deStatementDestroy(whileStatement);
+  deNumFolds++;
+  if (whileStatement != statement) {
+    return replaceStatementWithBlock(statement, deStatementGetSubBlock(statement));
+  }
+  return nextStatement;
+}
+
+// Fold the statement if its control flow is decided by a constant.  Return the
+// statement to fold next, which is |statement| if it was not replaced.
+static deStatement foldStatement(deBlock scopeBlock, deStatement statement) {
+  if (!deStatementInstantiated(statement)) {
+    return statement;
+  }
+  switch (deStatementGetType(statement)) {
+    case DE_STATEMENT_IF:
+      return foldIfStatement(statement);
+    case DE_STATEMENT_SWITCH:
+      return foldSwitchStatement(statement);
+    case DE_STATEMENT_DO:
+    case DE_STATEMENT_WHILE:
+      return foldWhileStatement(scopeBlock, statement);
+    default:
+      return statement;
+  }
+}
+
+// Propagate constants in the block, and fold statements whose control flow
+// becomes constant.
+static void foldBlock(deBlock scopeBlock, deBlock block) {
+  deStatement statement = deBlockGetFirstStatement(block);
+  while (statement != deStatementNull) {
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull && deStatementInstantiated(statement)) {
+      propagateExpressionConstants(scopeBlock, expression, deBigintNull);
+    }
+    deStatement nextStatement = foldStatement(scopeBlock, statement);
+    if (nextStatement == statement) {
+      deBlock subBlock = deStatementGetSubBlock(statement);
+      if (subBlock != deBlockNull) {
+        foldBlock(scopeBlock, subBlock);
+      }
+      nextStatement = deStatementGetNextBlockStatement(statement);
+    }
+    statement = nextStatement;
+  }
+}
+
+// Determine if we see every call to the signature, so constants passed to it
+// can be propagated into its body.  Only plain functions and methods qualify.
+static bool signatureTakesConstants(deSignature signature) {
+  deFunction function = deSignatureGetFunction(signature);
+  deLinkage linkage = deFunctionGetLinkage(function);
+  return deSignatureInstantiated(signature) && deFunctionGetType(function) == DE_FUNC_PLAIN &&
+      (linkage == DE_LINK_MODULE || linkage == DE_LINK_PACKAGE);
+}
+
+// Clear what we learned about the signature's parameters last round.
+static void resetParamspecs(void) {
+  deSignature signature;
+  deForeachRootSignature(deTheRoot, signature) {
+    for (uint32 xParam = 0; xParam < deSignatureGetUsedParamspec(signature); xParam++) {
+      deParamspec paramspec = deSignatureGetiParamspec(signature, xParam);
+      deParamspecSetConstant(paramspec, deExpressionNull);
+      deParamspecSetVaries(paramspec, false);
+    }
+  } deEndRootSignature;
+}
+
+// Record that the parameter is passed |value|, which is deExpressionNull if
+// unknown.
+static void recordParamValue(deSignature signature, uint32 xParam, deExpression value) {
+  deParamspec paramspec = deSignatureGetiParamspec(signature, xParam);
+  if (deParamspecVaries(paramspec)) {
+    return;
+  }
+  deExpressionType type = value == deExpressionNull? DE_EXPR_NULL : deExpressionGetType(value);
+  if ((type != DE_EXPR_INTEGER && type != DE_EXPR_BOOL) ||
+      deExpressionGetDatatype(value) != deParamspecGetDatatype(paramspec)) {
+    deParamspecSetVaries(paramspec, true);
+    return;
+  }
+  deExpression constant = deParamspecGetConstant(paramspec);
+  if (constant == deExpressionNull) {
+    deParamspecSetConstant(paramspec, value);
+    return;
+  }
+  bool same;
+  if (type == DE_EXPR_INTEGER) {
+    // Auto-cast constants keep the width they were parsed with.
+    deBigint constantVal = deExpressionGetBigint(constant);
+    deBigint bigint = deExpressionGetBigint(value);
+    same = deExpressionGetType(constant) == DE_EXPR_INTEGER &&
+        deBigintGetWidth(constantVal) == deBigintGetWidth(bigint) &&
+        deBigintSigned(constantVal) == deBigintSigned(bigint) &&
+        deBigintCompare(constantVal, bigint) == 0;
+  } else {
+    same = deExpressionGetType(constant) == DE_EXPR_BOOL &&
+        deExpressionBoolVal(constant) == deExpressionBoolVal(value);
+  }
+  if (!same) {
+    deParamspecSetVaries(paramspec, true);
+  }
+}
+
+// Record that nothing is known about the signature's parameters.
+static void recordAllParamsVary(deSignature signature) {
+  for (uint32 xParam = 0; xParam < deSignatureGetUsedParamspec(signature); xParam++) {
+    deParamspecSetVaries(deSignatureGetiParamspec(signature, xParam), true);
+  }
+}
+
+// Record the values passed by a call.  Omitted parameters take their default
+// values.
+static void recordCallValues(deExpression expression, deSignature signature) {
+  deExpression access = deExpressionGetFirstExpression(expression);
+  deExpression parameters = deExpressionGetNextExpression(access);
+  uint32 numParams = deSignatureGetUsedParamspec(signature);
+  uint32 xParam = 0;
+  if (deExpressionIsMethodCall(access)) {
+    // The self parameter is not a constant.
+    recordParamValue(signature, xParam++, deExpressionNull);
+  }
+  deExpression parameter;
+  deForeachExpressionExpression(parameters, parameter) {
+    if (xParam >= numParams || deExpressionGetType(parameter) == DE_EXPR_NAMEDPARAM) {
+      recordAllParamsVary(signature);
+      return;
+    }
+    recordParamValue(signature, xParam++, parameter);
+  } deEndExpressionExpression;
+  while (xParam < numParams) {
+    deVariable variable = deParamspecGetVariable(deSignatureGetiParamspec(signature, xParam));
+    recordParamValue(signature, xParam++, deVariableGetInitializerExpression(variable));
+  }
+}
+
+// Record the values passed by calls in the expression.  A signature whose
+// address is taken can be called from anywhere.
+static void recordExpressionCalls(deExpression expression) {
+  deSignature signature = deExpressionGetSignature(expression);
+  if (signature != deSignatureNull && signatureTakesConstants(signature)) {
+    if (deExpressionGetType(expression) == DE_EXPR_CALL) {
+      recordCallValues(expression, signature);
+    } else {
+      recordAllParamsVary(signature);
+    }
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    recordExpressionCalls(child);
+  } deEndExpressionExpression;
+}
+
+// Record the values passed by calls in the block's instantiated statements.
+static void recordBlockCalls(deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (deStatementInstantiated(statement)) {
+      deExpression expression = deStatementGetExpression(statement);
+      if (expression != deExpressionNull) {
+        recordExpressionCalls(expression);
+      }
+      deBlock subBlock = deStatementGetSubBlock(statement);
+      if (subBlock != deBlockNull) {
+        recordBlockCalls(subBlock);
+      }
+    }
+  } deEndBlockStatement;
+  // Default parameter values are evaluated by callers.
+  deVariable variable;
+  deForeachBlockVariable(block, variable) {
+    deExpression initializer = deVariableGetInitializerExpression(variable);
+    if (deVariableGetType(variable) == DE_VAR_PARAMETER && initializer != deExpressionNull) {
+      recordExpressionCalls(initializer);
+    }
+  } deEndBlockVariable;
+}
+
+// Determine if the expression reads |variable|.
+static bool readsVariable(deExpression expression, deVariable variable) {
+  if (deExpressionGetType(expression) != DE_EXPR_IDENT) {
+    return false;
+  }
+  deIdent ident = deExpressionGetIdent(expression);
+  return ident != deIdentNull && deIdentGetType(ident) == DE_IDENT_VARIABLE &&
+      deIdentGetVariable(ident) == variable;
+}
+
+// Determine if the expression, or any sub-expression, assigns |variable|.
+static bool expressionAssignsVariable(deExpression expression, deVariable variable) {
+  if (readsVariable(expression, variable)) {
+    deExpression parent = deExpressionGetExpression(expression);
+    if (deExpressionLhs(expression)) {
+      return true;
+    }
+    if (parent != deExpressionNull && deExpressionGetFirstExpression(parent) == expression) {
+      deExpressionType type = deExpressionGetType(parent);
+      return type >= DE_EXPR_EQUALS && type <= DE_EXPR_MULTRUNC_EQUALS;
+    }
+    return false;
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    if (expressionAssignsVariable(child, variable)) {
+      return true;
+    }
+  } deEndExpressionExpression;
+  return false;
+}
+
+// Determine if any statement in the block assigns |variable|.
+static bool blockAssignsVariable(deBlock block, deVariable variable) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull && expressionAssignsVariable(expression, variable)) {
+      return true;
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull && blockAssignsVariable(subBlock, variable)) {
+      return true;
+    }
+  } deEndBlockStatement;
+  return false;
+}
+
+// Replace reads of |variable| in the expression with |constant|.
+static void substituteExpressionConstant(deExpression expression, deVariable variable,
+    deExpression constant) {
+  if (readsVariable(expression, variable)) {
+    deIdentRemoveExpression(deExpressionGetIdent(expression), expression);
+    deValue value;
+    if (deExpressionGetType(constant) == DE_EXPR_INTEGER) {
+      value = deIntegerValueCreate(deExpressionGetBigint(constant));
+    } else {
+      value = deBoolValueCreate(deExpressionBoolVal(constant));
+    }
+    deSetExpressionToValue(expression, value);
+    deValueDestroy(value);
+    deNumFolds++;
+    return;
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    substituteExpressionConstant(child, variable, constant);
+  } deEndExpressionExpression;
+}
+
+// Replace reads of |variable| in the block with |constant|.
+static void substituteBlockConstant(deBlock block, deVariable variable, deExpression constant) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull) {
+      substituteExpressionConstant(expression, variable, constant);
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      substituteBlockConstant(subBlock, variable, constant);
+    }
+  } deEndBlockStatement;
+}
+
+// Substitute the constants every call passes into the signature's body.  The
+// parameters are still passed, but the body no longer reads them.
+static void substituteSignatureConstants(deSignature signature) {
+  deBlock block = deSignatureGetBlock(signature);
+  deVariable variable = deBlockGetFirstVariable(block);
+  for (uint32 xParam = 0; xParam < deSignatureGetUsedParamspec(signature); xParam++) {
+    utAssert(variable != deVariableNull && deVariableGetType(variable) == DE_VAR_PARAMETER);
+    deParamspec paramspec = deSignatureGetiParamspec(signature, xParam);
+    deExpression constant = deParamspecGetConstant(paramspec);
+    if (constant != deExpressionNull && !deParamspecVaries(paramspec) &&
+        deParamspecInstantiated(paramspec) && !deDatatypeSecret(deParamspecGetDatatype(paramspec)) &&
+        !blockAssignsVariable(block, variable)) {
+      substituteBlockConstant(block, variable, constant);
+    }
+    variable = deVariableGetNextBlockVariable(variable);
+  }
+}
+
+// Propagate constants across the whole program, after binding and iterator
+// inlining.  When every call to a function passes the same constant for a
+// parameter, the constant is substituted into the function's signature, which
+// is already specialized on parameter types.  Conditions that become constant
+// are folded, and unreachable statements deleted, so generic code instantiated
+// with constants does not carry dead branches.  Calls to pure functions with
+// constant arguments are replaced with their results.  Deleting dead calls can
+// make more parameters constant, so repeat until nothing changes.
+void dePropagateConstantsAcrossSignatures(void) {
+  deBlock rootBlock = deRootGetBlock(deTheRoot);
+  deEvaluateCalls = true;
+  uint32 numFolds;
+  do {
+    numFolds = deNumFolds;
+    resetParamspecs();
+    recordBlockCalls(rootBlock);
+    deSignature signature;
+    deForeachRootSignature(deTheRoot, signature) {
+      if (deSignatureInstantiated(signature)) {
+        recordBlockCalls(deSignatureGetBlock(signature));
+      }
+    } deEndRootSignature;
+    deForeachRootSignature(deTheRoot, signature) {
+      if (signatureTakesConstants(signature)) {
+        substituteSignatureConstants(signature);
+      }
+    } deEndRootSignature;
+    foldBlock(rootBlock, rootBlock);
+    deForeachRootSignature(deTheRoot, signature) {
+      deBlock block = deSignatureGetBlock(signature);
+      if (deSignatureInstantiated(signature) && block != rootBlock) {
+        foldBlock(block, block);
+      }
+    } deEndRootSignature;
+  } while (deNumFolds != numFolds);
+  resetParamspecs();
+  deEvaluateCalls = false;
+  deClearCompileTimeResults();
+}
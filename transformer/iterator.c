@@ -14,6 +14,10 @@
 
 #include "de.h"
 
+// With -coroutines, iterators with at least this many statements and
+// expressions are called as coroutines rather than inlined.
+#define DE_COROUTINE_MIN_SIZE 64
+
 // Generate an assignment statement, after |statement|.
 static deStatement assignVariable(deStatement statement, deVariable variable, deExpression value) {
   deExpression valueCopy = deCopyExpression(value);
@@ -177,11 +181,23 @@ static void queueStatements(deStatement firstStatement, deStatement lastStatemen
   } while (firstStatement != lastStatement);
 }
 
-// Inline the iterator.  The statement should already be bound.  Return the
-// statement replacing the one passed in.
-deStatement deInlineIterator(deBlock scopeBlock, deStatement statement) {
+// Create the local variables assigned in the inlined statements, so that
+// iterators inlined later in the same round see their names as taken.
+static void createInlinedVariables(deBlock scopeBlock, deStatement firstStatement,
+    deStatement lastStatement) {
+  do {
+    deCreateStatementVariables(scopeBlock, firstStatement);
+    firstStatement = deStatementGetNextBlockStatement(firstStatement);
+  } while (firstStatement != lastStatement);
+}
+
+// Inline the iterator, and queue the inlined statements for binding.  If
+// |bindNow| is false, the caller must call deBindAllSignatures before binding
+// anything that depends on them.  Return the statement replacing the one passed in.
+static deStatement inlineIterator(deBlock scopeBlock, deStatement statement, bool bindNow) {
   bool savedInIterator = deInIterator;
   deInIterator = true;
+  deNumInlinedIterators++;
   deExpression assignment = deStatementGetExpression(statement);
   deExpression access = deExpressionGetFirstExpression(assignment);
   deExpression call = deExpressionGetNextExpression(access);
@@ -223,8 +239,13 @@ deStatement deInlineIterator(deBlock scopeBlock, deStatement statement) {
   deBlockDestroy(body);
   flattenSwitchTypeStatements(firstStatement, lastStatement);
   if (firstStatement != deStatementNull) {
+    if (!bindNow) {
+      createInlinedVariables(scopeBlock, firstStatement, lastStatement);
+    }
     queueStatements(firstStatement, lastStatement);
-    deBindAllSignatures();
+    if (bindNow) {
+      deBindAllSignatures();
+    }
   }
   deRestoreBlockVariableNames(iteratorBlock);
   if (prevStatement == deStatementNull) {
@@ -234,7 +255,124 @@ deStatement deInlineIterator(deBlock scopeBlock, deStatement statement) {
   return deStatementGetNextBlockStatement(prevStatement);
 }
 
-// Inline iterators in the block.  Return true if any iterators were inlined.
+// Inline the iterator.  The statement should already be bound.  Return the
+// statement replacing the one passed in.
+deStatement deInlineIterator(deBlock scopeBlock, deStatement statement) {
+  return inlineIterator(scopeBlock, statement, true);
+}
+
+// Count the statements and expressions in the block, as a measure of how much
+// code inlining it would copy.
+static uint32 countBlockSize(deBlock block) {
+  uint32 size = 0;
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    size++;
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull) {
+      size += deExpressionCountExpressions(expression) + 1;
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      size += countBlockSize(subBlock);
+    }
+  } deEndBlockStatement;
+  return size;
+}
+
+// Count the instantiated statements of the given type in the block, including
+// sub-blocks.
+static uint32 countBlockStatements(deBlock block, deStatementType type) {
+  uint32 count = 0;
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (deStatementInstantiated(statement)) {
+      if (deStatementGetType(statement) == type) {
+        count++;
+      }
+      deBlock subBlock = deStatementGetSubBlock(statement);
+      if (subBlock != deBlockNull) {
+        count += countBlockStatements(subBlock, type);
+      }
+    }
+  } deEndBlockStatement;
+  return count;
+}
+
+// Determine if values of the datatype can be passed from a coroutine to its
+// caller with a plain load and store.
+static bool datatypeIsCoroutineValue(deDatatype datatype) {
+  switch (deDatatypeGetType(datatype)) {
+    case DE_TYPE_BOOL:
+    case DE_TYPE_FLOAT:
+      return true;
+    case DE_TYPE_UINT:
+    case DE_TYPE_INT:
+      return !deIntegerWidthIsBigint(deDatatypeGetWidth(datatype));
+    case DE_TYPE_CLASS:
+      return !deTemplateRefCounted(deClassGetTemplate(deDatatypeGetClass(datatype)));
+    default:
+      return false;
+  }
+}
+
+// Forward declaration for recursion.
+static void inlineBlockIterators(deBlock scopeBlock, deBlock block);
+
+// Decide whether to generate the iterator signature as a coroutine.  Small
+// iterators with one yield are always inlined.  Iterators that return, or
+// yield inside a try statement, are too.
+static bool iteratorIsCoroutine(deSignature signature) {
+  if (deSignatureIsCoroutine(signature)) {
+    return true;
+  }
+  deBlock block = deSignatureGetBlock(signature);
+  if (!deCoroutineIterators || !deSignatureInstantiated(signature) ||
+      !datatypeIsCoroutineValue(deSignatureGetReturnType(signature)) ||
+      countBlockStatements(block, DE_STATEMENT_RETURN) != 0 ||
+      countBlockStatements(block, DE_STATEMENT_TRY) != 0) {
+    return false;
+  }
+  if (countBlockStatements(block, DE_STATEMENT_YIELD) <= 1 &&
+      countBlockSize(block) < DE_COROUTINE_MIN_SIZE) {
+    return false;
+  }
+  deSignatureSetIsCoroutine(signature, true);
+  // The coroutine's own foreach statements are inlined, or called as coroutines.
+  deSignature savedSignature = deCurrentSignature;
+  deCurrentSignature = signature;
+  inlineBlockIterators(block, block);
+  deCurrentSignature = savedSignature;
+  return true;
+}
+
+// Determine if the foreach statement can call its iterator as a coroutine.  The
+// loop variable must have the yielded type, and the body must not return,
+// since nothing would destroy the coroutine.
+static bool callIteratorAsCoroutine(deStatement statement) {
+  deExpression assignment = deStatementGetExpression(statement);
+  deExpression access = deExpressionGetFirstExpression(assignment);
+  deExpression call = deExpressionGetNextExpression(access);
+  if (deExpressionGetType(access) != DE_EXPR_IDENT || deExpressionGetType(call) != DE_EXPR_CALL) {
+    return false;
+  }
+  deSignature signature = deExpressionGetSignature(call);
+  deIdent ident = deExpressionGetIdent(access);
+  if (signature == deSignatureNull || ident == deIdentNull ||
+      deIdentGetType(ident) != DE_IDENT_VARIABLE ||
+      deVariableGetDatatype(deIdentGetVariable(ident)) != deSignatureGetReturnType(signature) ||
+      countBlockStatements(deStatementGetSubBlock(statement), DE_STATEMENT_RETURN) != 0) {
+    return false;
+  }
+  return iteratorIsCoroutine(signature);
+}
+
+// Inline iterators in the block.  Each round inlines every bound foreach
+// statement in the block, and then binds all the inlined code at once.
+// Foreach statements the inlined code contains are inlined in the next round.
+// With -coroutines, large iterators are instead called as coroutines.  Parallel
+// for statements are not inlined: the code generator splits their range across
+// threads.
 static void inlineBlockIterators(deBlock scopeBlock, deBlock block) {
   bool inlinedIterator;
   deStatement statement;
@@ -242,11 +380,22 @@ static void inlineBlockIterators(deBlock scopeBlock, deBlock block) {
     inlinedIterator = false;
     deSafeForeachBlockStatement(block, statement) {
       if (deStatementGetType(statement) == DE_STATEMENT_FOREACH &&
-          deStatementInstantiated(statement)) {
-        deInlineIterator(scopeBlock, statement);
-        inlinedIterator = true;
+          deStatementInstantiated(statement) && !deStatementCallsCoroutine(statement) &&
+          !deStatementParallel(statement)) {
+        if (callIteratorAsCoroutine(statement)) {
+          deStatementSetCallsCoroutine(statement, true);
+        } else {
+          inlineIterator(scopeBlock, statement, false);
+          inlinedIterator = true;
+        }
       }
     } deEndSafeBlockStatement;
+    if (inlinedIterator) {
+      bool savedInIterator = deInIterator;
+      deInIterator = true;
+      deBindAllSignatures();
+      deInIterator = savedInIterator;
+    }
   } while (inlinedIterator);
   deSafeForeachBlockStatement(block, statement) {
     deBlock subBlock = deStatementGetSubBlock(statement);
@@ -15,6 +15,199 @@
 #include "de.h"
 #include <stdarg.h>
 
+// Determine if the data member can be interleaved with others in the class's
+// tuple array.  The first variable is nextFree, which the allocator uses, and
+// members containing arrays keep their own arrays, since the runtime only
+// updates back-pointers of sub-arrays in arrays of arrays.
+static bool canPackVariable(deBlock block, deVariable variable) {
+  return variable != deBlockGetFirstVariable(block) &&
+      !deDatatypeContainsArray(deVariableGetDatatype(variable));
+}
+
+// A profiled data member is hot if it is accessed at least 1/DE_HOT_FIELD_RATIO
+// as often as the hottest data member of its class.
+#define DE_HOT_FIELD_RATIO 8
+
+// Read the "<Class>_<field> <count>" lines written by a program built with
+// -profile.  Counts for the same data member add up.
+void deReadFieldProfile(char *fileName) {
+  FILE *file = fopen(fileName, "r");
+  if (file == NULL) {
+    utExit("Unable to read profile %s", fileName);
+  }
+  char name[1024];
+  unsigned long long count;
+  while (fscanf(file, "%1023s %llu", name, &count) == 2) {
+    utSym sym = utSymCreate(name);
+    deFieldProfile profile = deRootFindFieldProfile(deTheRoot, sym);
+    if (profile == deFieldProfileNull) {
+      profile = deFieldProfileAlloc();
+      deFieldProfileSetSym(profile, sym);
+      deRootInsertFieldProfile(deTheRoot, profile);
+    }
+    deFieldProfileSetAccessCount(profile, deFieldProfileGetAccessCount(profile) + count);
+  }
+  fclose(file);
+}
+
+// Find the profiled access count of the data member, if it has one.
+static deFieldProfile findFieldProfile(deBlock block, deVariable variable) {
+  utSym name = utSymCreateFormatted("%s_%s", deGetBlockPath(block, true),
+      deVariableGetName(variable));
+  return deRootFindFieldProfile(deTheRoot, name);
+}
+
+// Profiled classes get the narrowest reference width that leaves room for
+// DE_REF_WIDTH_HEADROOM times as many objects as the profile run used.
+#define DE_REF_WIDTH_HEADROOM 4
+
+// Return the narrowest of 8, 16, 32 and 64 bit references with room for the
+// objects.
+static uint32 chooseRefWidth(uint64 numObjects) {
+  for (uint32 width = 8; width < 64; width <<= 1) {
+    if (numObjects <= (((uint64)1 << width) - 1) / DE_REF_WIDTH_HEADROOM) {
+      return width;
+    }
+  }
+  return 64;
+}
+
+// Set the reference width of classes that do not declare one from the
+// "<Class>_used" counts of the -useprofile file, which are how many object
+// slots the profiled run used, so references to small classes shrink, and
+// classes that outgrow 32 bits widen.  Call this before binding, which
+// creates datatypes with the width.  Template classes with template
+// parameters keep the default, since their classes share the width.
+void deChooseRefWidths(void) {
+  deTemplate templ;
+  deForeachRootTemplate(deTheRoot, templ) {
+    deFunction constructor = deTemplateGetFunction(templ);
+    if (deTemplateRefWidthDeclared(templ) || deTemplateIsTemplate(templ) ||
+        deFunctionBuiltin(constructor)) {
+      continue;
+    }
+    utSym name = utSymCreateFormatted("%s_used",
+        deGetBlockPath(deFunctionGetSubBlock(constructor), true));
+    deFieldProfile profile = deRootFindFieldProfile(deTheRoot, name);
+    if (profile != deFieldProfileNull) {
+      deTemplateSetRefWidth(templ, chooseRefWidth(deFieldProfileGetAccessCount(profile)));
+    }
+  } deEndRootTemplate;
+}
+
+// Determine if the data member goes in the class's tuple array.  When the class
+// was profiled, only hot data members do, and cold ones keep their own arrays.
+static bool shouldPackVariable(deBlock block, deVariable variable, bool profiled,
+    uint64 maxCount) {
+  if (!canPackVariable(block, variable)) {
+    return false;
+  }
+  if (!profiled) {
+    return true;
+  }
+  deFieldProfile profile = findFieldProfile(block, variable);
+  if (profile == deFieldProfileNull) {
+    return false;
+  }
+  uint64 count = deFieldProfileGetAccessCount(profile);
+  return count != 0 && count >= maxCount / DE_HOT_FIELD_RATIO;
+}
+
+// Decide if the class is stored as an array of structures.  If so, its scalar
+// data members are fields of one global array of tuples, and the rest keep
+// the default structure-of-arrays layout.  Classes found in the -useprofile
+// file are packed with just their hot data members.  It takes at least two
+// packed data members to be worth it.
+static void chooseClassLayout(deClass theClass) {
+  deBlock block = deClassGetSubBlock(theClass);
+  bool packed = deTemplatePacked(deClassGetTemplate(theClass));
+  bool profiled = false;
+  uint64 maxCount = 0;
+  deVariable variable;
+  if (deClassLayout != DE_LAYOUT_DECLARED) {
+    packed = deClassLayout == DE_LAYOUT_AOS;
+  } else {
+    deForeachBlockVariable(block, variable) {
+      deFieldProfile profile = findFieldProfile(block, variable);
+      if (canPackVariable(block, variable) && profile != deFieldProfileNull) {
+        profiled = true;
+        uint64 count = deFieldProfileGetAccessCount(profile);
+        if (count > maxCount) {
+          maxCount = count;
+        }
+      }
+    } deEndBlockVariable;
+    packed |= profiled;
+  }
+  uint32 numPacked = 0;
+  deForeachBlockVariable(block, variable) {
+    if (shouldPackVariable(block, variable, profiled, maxCount)) {
+      numPacked++;
+    }
+  } deEndBlockVariable;
+  if (!packed || numPacked < 2) {
+    return;
+  }
+  deClassSetPacked(theClass, true);
+  uint32 index = 0;
+  deForeachBlockVariable(block, variable) {
+    if (shouldPackVariable(block, variable, profiled, maxCount)) {
+      deVariableSetPacked(variable, true);
+      deVariableSetPackedIndex(variable, index++);
+    }
+  } deEndBlockVariable;
+}
+
+// Return the bits per object of a bit-packed data member of the datatype: 1
+// for bools, and 1, 2 or 4 for integers of up to 4 bits, so no object's bits
+// straddle two bytes.  Return 0 if the datatype is not worth bit-packing.
+static uint32 findPackedBits(deDatatype datatype) {
+  switch (deDatatypeGetType(datatype)) {
+    case DE_TYPE_BOOL:
+      return 1;
+    case DE_TYPE_UINT:
+    case DE_TYPE_INT: {
+      uint32 width = deDatatypeGetWidth(datatype);
+      if (width <= 2) {
+        return width;
+      }
+      return width <= 4? 4 : 0;
+    }
+    default:
+      return 0;
+  }
+}
+
+// Bit-pack the bool and small integer data members that keep their own
+// arrays, so each byte of the array holds 8/bits objects, rather than one.
+static void chooseBitPackedVariables(deClass theClass) {
+  if (!deBitPackFields) {
+    return;
+  }
+  deBlock block = deClassGetSubBlock(theClass);
+  deVariable variable;
+  deForeachBlockVariable(block, variable) {
+    if (variable != deBlockGetFirstVariable(block) && !deVariablePacked(variable)) {
+      deVariableSetPackedBits(variable, findPackedBits(deVariableGetDatatype(variable)));
+    }
+  } deEndBlockVariable;
+}
+
+// Return the statement resizing the data member's own array to hold |count|
+// objects.  Bit-packed arrays are bytes, each holding 8/bits objects.
+static char *resizeFieldArrayString(deVariable variable, char *count, uint32 refWidth) {
+  char *path = deGetBlockPath(deVariableGetBlock(variable), true);
+  uint32 bits = deVariableGetPackedBits(variable);
+  if (bits == 0) {
+    return utSprintf("%s_%s.resize(%s)", path, deVariableGetName(variable), count);
+  }
+  return utSprintf("%1$s_%2$s.resize(%3$s / %4$uu%5$u + 1u%5$u)",
+      path, deVariableGetName(variable), count, 8 / bits, refWidth);
+}
+
+// Set when the program has arena blocks.
+static bool deArenasUsed;
+
 // Allocate the self object for this constructor.  Also change return statements
 // to return self.  Bind all new/modified statements.
 static void generateConstructorString(deClass theClass) {
@@ -22,21 +215,38 @@ static void generateConstructorString(deClass theClass) {
   char *theClassPath = utAllocString(deGetBlockPath(deClassGetSubBlock(theClass), true));
   char* selfType = deDatatypeGetTypeString(deClassGetDatatype(theClass));
   uint32 refWidth = deClassGetRefWidth(theClass);
+  uint64 maxObjects = refWidth >= 64? ~(uint64)0 : ((uint64)1 << refWidth) - 1;
+  // The arrays double until the next doubling would overflow a reference, and
+  // then grow to the largest size references can index.
   deSprintToString(
       "appendcode {\n"
       "  func %1$s_allocate() {\n"
-      "    if %1$s_firstFree != 0u%3$u {\n"
+      "    if %1$s_firstFree != 0u%3$u%4$s {\n"
       "      object = !< %2$s >%1$s_firstFree\n"
       "      %1$s_firstFree = %1$s_nextFree[!<u%3$u>object]\n"
       "    } else {\n"
       "      if %1$s_used == %1$s_allocated {\n"
-      "        %1$s_allocated <<= 1u%3$u\n",
-      theClassPath, selfType, refWidth);
+      "        if %1$s_allocated == %6$lluu%3$u {\n"
+      "          panic \"Too many %5$s objects for u%3$u references: declare a wider class %5$s:u<width>\"\n"
+      "        } else if %1$s_allocated == %7$lluu%3$u {\n"
+      "          %1$s_allocated = %6$lluu%3$u\n"
+      "        } else {\n"
+      "          %1$s_allocated <<= 1u%3$u\n"
+      "        }\n",
+      theClassPath, selfType, refWidth,
+      // Objects created in arena blocks come from the end of the arrays.
+      deArenasUsed? " && rune_arenaDepth == 0u32" : "",
+      deTemplateGetName(deClassGetTemplate(theClass)), (unsigned long long)maxObjects,
+      (unsigned long long)(maxObjects / 2 + 1));
+  if (deClassPacked(theClass)) {
+    deSprintToString("        %1$s_packed.resize(%1$s_allocated)\n", theClassPath);
+  }
   deVariable variable;
   deForeachBlockVariable(deClassGetSubBlock(theClass), variable) {
-    deSprintToString(
-          "        %1$s_%2$s.resize(%1$s_allocated)\n",
-        theClassPath, deVariableGetName(variable));
+    if (!deVariablePacked(variable)) {
+      deSprintToString("        %s\n", resizeFieldArrayString(variable,
+          utSprintf("%s_allocated", theClassPath), refWidth));
+    }
   } deEndBlockVariable;
   deSprintToString(
       "      }\n"
@@ -52,6 +262,21 @@ static void generateConstructorString(deClass theClass) {
   utFree(theClassPath);
 }
 
+// Return the default value of the class's packed tuple, such as (0u32, false).
+static char *packedDefaultValueString(deClass theClass) {
+  char *tuple = "(";
+  bool firstTime = true;
+  deVariable variable;
+  deForeachBlockVariable(deClassGetSubBlock(theClass), variable) {
+    if (deVariablePacked(variable)) {
+      char *defaultValue = deDatatypeGetDefaultValueString(deVariableGetDatatype(variable));
+      tuple = utSprintf("%s%s%s", tuple, firstTime? "" : ", ", defaultValue);
+      firstTime = false;
+    }
+  } deEndBlockVariable;
+  return utSprintf("%s)", tuple);
+}
+
 // Free the self object in the destructor.
 static void generateDestructorString(deClass theClass) {
   deStringPos = 0;
@@ -63,8 +288,15 @@ static void generateDestructorString(deClass theClass) {
   uint32 refWidth = deClassGetRefWidth(theClass);
   bool firstTime = true;
   deVariable variable;
+  if (deClassPacked(theClass)) {
+    deSprintToString("    %1$s_packed[!<u%3$u>object] = %2$s\n",
+        theClassPath, packedDefaultValueString(theClass), refWidth);
+  }
   deForeachBlockVariable(deClassGetSubBlock(theClass), variable) {
-    if (!firstTime) {
+    if (!firstTime && deVariableGetPackedBits(variable) != 0) {
+      char* zero = deDatatypeGetDefaultValueString(deVariableGetDatatype(variable));
+      deSprintToString("    object.%1$s = %2$s\n", deVariableGetName(variable), zero);
+    } else if (!firstTime && !deVariablePacked(variable)) {
       deVariable globalArrayVar = deVariableGetGlobalArrayVariable(variable);
       char* zero = deDatatypeGetDefaultValueString(deVariableGetDatatype(variable));
       deSprintToString("    %1$s[!<u%3$u>object] = %2$s\n",
@@ -87,20 +319,42 @@ static void generateRootBlockArrays(deClass theClass) {
   deStringPos = 0;
   deBlock block = deClassGetSubBlock(theClass);
   char *path = utAllocString(deGetBlockPath(block, true));
+  uint32 refWidth = deClassGetRefWidth(theClass);
+  uint64 maxObjects = refWidth >= 64? ~(uint64)0 : ((uint64)1 << refWidth) - 1;
+  char *maxObjectsString = utAllocString(utSprintf("%lluu64", (unsigned long long)maxObjects));
   deSprintToString(
       "prependcode {\n"
       "  %1$s_allocated = 1u%2$u\n"
       "  %1$s_used = 1u%2$u\n"
       "  %1$s_firstFree = 0u%2$u\n",
-      path, deClassGetRefWidth(theClass));
+      path, refWidth);
+  if (deClassPacked(theClass)) {
+    deSprintToString("  %1$s_packed = [%2$s]\n", path, packedDefaultValueString(theClass));
+    if (deReserveFieldArrays) {
+      deSprintToString("  %1$s_packed.reserve(%2$s)\n", path, maxObjectsString);
+    }
+  }
   deVariable variable;
   deForeachBlockVariable(block, variable) {
     utAssert(!deVariableIsType(variable));
-    char *defaultValue = deDatatypeGetDefaultValueString(deVariableGetDatatype(variable));
+    if (deVariablePacked(variable)) {
+      continue;
+    }
+    uint32 bits = deVariableGetPackedBits(variable);
+    char *defaultValue = bits != 0? "0u8" :
+        deDatatypeGetDefaultValueString(deVariableGetDatatype(variable));
     deSprintToString("  %1$s_%2$s = [%3$s]\n",
         path, deVariableGetName(variable), defaultValue);
+    if (deReserveFieldArrays) {
+      // The runtime caps the reservation at 1GiB, or the size of RAM.
+      char *reserve = bits == 0? maxObjectsString :
+          utSprintf("%lluu64", (unsigned long long)(maxObjects / (8 / bits) + 1));
+      deSprintToString("  %1$s_%2$s.reserve(%3$s)\n",
+          path, deVariableGetName(variable), reserve);
+    }
   } deEndBlockVariable;
   deAddString("}\n");
+  utFree(maxObjectsString);
   utFree(path);
 }
 
@@ -122,7 +376,8 @@ static void setGlobalArrayVariables(deClass theClass) {
   deVariable variable;
   deForeachBlockVariable(block, variable) {
     char *path = deGetBlockPath(block, true);
-    utSym name = utSymCreateFormatted("%s_%s", path, deVariableGetName(variable));
+    utSym name = utSymCreateFormatted("%s_%s", path,
+        deVariablePacked(variable)? "packed" : deVariableGetName(variable));
     deIdent ident = deBlockFindIdent(globalBlock, name);
     utAssert(ident != deIdentNull && deIdentGetType(ident) == DE_IDENT_VARIABLE);
     deVariable globalVar = deIdentGetVariable(ident);
@@ -138,6 +393,8 @@ static void bindNewSignature(deSignature signature) {
 
 // Add statements to the constructor and to the root block for managing memory.
 static void allocateSelfInConstructor(deClass theClass) {
+  chooseClassLayout(theClass);
+  chooseBitPackedVariables(theClass);
   generateRootBlockArrays(theClass);
   deBlock rootBlock = deRootGetBlock(deTheRoot);
   deStatement originalFirstStatement = deBlockGetFirstStatement(rootBlock);
@@ -174,18 +431,14 @@ static void freeSelfInDestructor(deClass theClass) {
   bindNewSignature(signature);
 }
 
-// Generate code for referencing and defreferencing the class.
-static void generateRefAndUnrefString(deClass theClass) {
+// Generate code for releasing a reference to the class.  References are taken,
+// and released while others remain, by inline code in the LLVM backend, which
+// calls this for the rest.
+static void generateUnrefString(deClass theClass) {
   deStringPos = 0;
   char* theClassPath = deGetBlockPath(deClassGetSubBlock(theClass), true);
   deSprintToString(
       "appendcode {\n"
-      "  func %1$s_ref(object) {\n"
-      "    if !isnull(object) && %1$s_nextFree[!<u%2$u>object] != 0u%2$u {\n"
-      "      %1$s_nextFree[!<u%2$u>object] += 1u%2$u\n"
-      "    }\n"
-      "  }\n"
-      "\n"
       "  func %1$s_unref(object) {\n"
       "    if !isnull(object) && %1$s_nextFree[!<u%2$u>object] != 0u%2$u {\n"
       "      %1$s_nextFree[!<u%2$u>object] !-= 1u%2$u\n"
@@ -198,10 +451,10 @@ static void generateRefAndUnrefString(deClass theClass) {
       , theClassPath, deClassGetRefWidth(theClass));
 }
 
-// Add ref() and deref() methods to the class.  Return the unref function.
-static void addRefAndUnref(deClass theClass) {
+// Add the unref() method to the class.
+static void addUnref(deClass theClass) {
   deBlock rootBlock = deRootGetBlock(deTheRoot);
-  generateRefAndUnrefString(theClass);
+  generateUnrefString(theClass);
   deGenerating = true;
   deParseString(deStringVal, rootBlock);
   deGenerating = false;
@@ -213,11 +466,543 @@ static void addRefAndUnref(deClass theClass) {
   deSignatureSetInstantiated(signature, true);
   deSignatureSetReturnType(signature, deNoneDatatypeCreate());
   bindNewSignature(signature);
-  deFunction refFunc = deFunctionGetPrevBlockFunction(unrefFunc);
-  signature = deSignatureCreate(refFunc, parameterTypes, 0);
+}
+
+// Return the global array element holding the data member of object |index|.
+// Bit-packed data members have no element of their own, so access them
+// through the object.
+static char *fieldElementString(deVariable variable, char *index) {
+  deBlock block = deVariableGetBlock(variable);
+  char *path = deGetBlockPath(block, true);
+  if (deVariableGetPackedBits(variable) != 0) {
+    deDatatype selfType = deClassGetDatatype(deBlockGetOwningClass(block));
+    return utSprintf("(!< %s >%s).%s", deDatatypeGetTypeString(selfType), index,
+        deVariableGetName(variable));
+  }
+  if (deVariablePacked(variable)) {
+    return utSprintf("%s_packed[%s][%u]", path, index, deVariableGetPackedIndex(variable));
+  }
+  return utSprintf("%s_%s[%s]", path, deVariableGetName(variable), index);
+}
+
+// Determine if the datatype is a reference to an object of the class.
+static bool refersToClass(deDatatype datatype, deClass theClass) {
+  return deDatatypeGetType(datatype) == DE_TYPE_CLASS &&
+      deDatatypeGetClass(datatype) == theClass;
+}
+
+// Renumber references to theClass held in data members of |otherClass|, either
+// directly, or as elements of an array, as relations such as ArrayList and
+// Hashed use.  Each loop gets its own variable, since ref widths can differ.
+// checkCompactable has already rejected references in tuples and structs.
+static void generateReferenceUpdates(deClass theClass, deClass otherClass, uint32 *numLoops) {
+  char *selfType = utAllocString(deDatatypeGetTypeString(deClassGetDatatype(theClass)));
+  uint32 refWidth = deClassGetRefWidth(theClass);
+  deBlock block = deClassGetSubBlock(otherClass);
+  char *otherPath = utAllocString(deGetBlockPath(block, true));
+  uint32 otherRefWidth = deClassGetRefWidth(otherClass);
+  deVariable variable;
+  deForeachBlockVariable(block, variable) {
+    deDatatype datatype = deVariableGetDatatype(variable);
+    bool isRef = refersToClass(datatype, theClass);
+    bool isRefArray = deDatatypeGetType(datatype) == DE_TYPE_ARRAY &&
+        refersToClass(deDatatypeGetElementType(datatype), theClass);
+    if (variable == deBlockGetFirstVariable(block) || (!isRef && !isRefArray)) {
+      continue;
+    }
+    uint32 loop = (*numLoops)++;
+    deSprintToString(
+        "    for o%1$u = 1u%2$u, o%1$u < %3$s_used, o%1$u += 1u%2$u {\n",
+        loop, otherRefWidth, otherPath);
+    char *element = utAllocString(fieldElementString(variable, utSprintf("o%u", loop)));
+    if (isRef) {
+      deSprintToString("      %1$s = !<%2$s>(newIndex[!<u%3$u>(%1$s)])\n",
+          element, selfType, refWidth);
+    } else {
+      deSprintToString(
+          "      for i%1$u in range(%2$s.length()) {\n"
+          "        %2$s[i%1$u] = !<%3$s>(newIndex[!<u%4$u>(%2$s[i%1$u])])\n"
+          "      }\n",
+          loop, element, selfType, refWidth);
+    }
+    deSprintToString("    }\n");
+    utFree(element);
+  } deEndBlockVariable;
+  utFree(otherPath);
+  utFree(selfType);
+}
+
+// Generate the function that compacts the class.  Live objects slide down to
+// fill free slots, in order, so objects before the first free slot do not move.
+// We then update references in data members of all classes, and shrink the
+// arrays.  References held elsewhere, such as in local variables, are not
+// updated, so compact() must be called when objects are only reachable
+// through data members.
+static void generateCompactString(deClass theClass) {
+  deStringPos = 0;
+  deBlock block = deClassGetSubBlock(theClass);
+  char *path = utAllocString(deGetBlockPath(block, true));
+  uint32 refWidth = deClassGetRefWidth(theClass);
+  deSprintToString(
+      "appendcode {\n"
+      "  func %1$s_compact() {\n"
+      "    isFree = [false]\n"
+      "    isFree.resize(%1$s_used)\n"
+      "    object = %1$s_firstFree\n"
+      "    while object != 0u%2$u {\n"
+      "      isFree[object] = true\n"
+      "      object = %1$s_nextFree[object]\n"
+      "    }\n"
+      "    newIndex = [0u%2$u]\n"
+      "    newIndex.resize(%1$s_used)\n"
+      "    used = 1u%2$u\n"
+      "    for old = 1u%2$u, old < %1$s_used, old += 1u%2$u {\n"
+      "      if !isFree[old] {\n"
+      "        newIndex[old] = used\n"
+      "        if used != old {\n",
+      path, refWidth);
+  bool firstTime = true;
+  if (deClassPacked(theClass)) {
+    deSprintToString(
+        "          %1$s_packed[used] = %1$s_packed[old]\n"
+        "          %1$s_packed[old] = %2$s\n",
+        path, packedDefaultValueString(theClass));
+  }
+  deVariable variable;
+  deForeachBlockVariable(block, variable) {
+    if (!deVariablePacked(variable)) {
+      char *newElement = utAllocString(fieldElementString(variable, "used"));
+      char *oldElement = utAllocString(fieldElementString(variable, "old"));
+      deSprintToString("          %s = %s\n", newElement, oldElement);
+      if (!firstTime) {
+        char* zero = deDatatypeGetDefaultValueString(deVariableGetDatatype(variable));
+        deSprintToString("          %s = %s\n", oldElement, zero);
+      }
+      utFree(oldElement);
+      utFree(newElement);
+    }
+    firstTime = false;
+  } deEndBlockVariable;
+  deSprintToString(
+      "        }\n"
+      "        used += 1u%1$u\n"
+      "      }\n"
+      "    }\n",
+      refWidth);
+  uint32 numLoops = 0;
+  deClass otherClass;
+  deForeachRootClass(deTheRoot, otherClass) {
+    if (deClassBound(otherClass)) {
+      generateReferenceUpdates(theClass, otherClass, &numLoops);
+    }
+  } deEndRootClass;
+  deSprintToString(
+      "    %1$s_used = used\n"
+      "    %1$s_allocated = used\n"
+      "    %1$s_firstFree = 0u%2$u\n",
+      path, refWidth);
+  if (deClassPacked(theClass)) {
+    deSprintToString("    %1$s_packed.resize(%1$s_allocated)\n", path);
+  }
+  deForeachBlockVariable(block, variable) {
+    if (!deVariablePacked(variable)) {
+      deSprintToString("    %s\n", resizeFieldArrayString(variable,
+          utSprintf("%s_allocated", path), refWidth));
+    }
+  } deEndBlockVariable;
+  deSprintToString(
+      "  }\n"
+      "}\n");
+  utFree(path);
+}
+
+// Find the template's compact() function, if the program calls it.
+static deFunction findCalledCompactor(deTemplate templ) {
+  deBlock block = deFunctionGetSubBlock(deTemplateGetFunction(templ));
+  deIdent ident = deBlockFindIdent(block, utSymCreate("compact"));
+  if (ident == deIdentNull || deIdentGetType(ident) != DE_IDENT_FUNCTION) {
+    return deFunctionNull;
+  }
+  deFunction function = deIdentGetFunction(ident);
+  if (!deFunctionCompactor(function) || deFunctionGetFirstSignature(function) == deSignatureNull) {
+    return deFunctionNull;
+  }
+  return function;
+}
+
+// Determine if a value of the datatype can hold a reference to theClass,
+// directly, or in an array, tuple or struct.
+static bool holdsClassRefs(deDatatype datatype, deClass theClass) {
+  switch (deDatatypeGetType(datatype)) {
+    case DE_TYPE_CLASS:
+      return deDatatypeGetClass(datatype) == theClass;
+    case DE_TYPE_ARRAY:
+      return holdsClassRefs(deDatatypeGetElementType(datatype), theClass);
+    case DE_TYPE_TUPLE:
+    case DE_TYPE_STRUCT:
+      for (uint32 i = 0; i < deDatatypeGetNumTypeList(datatype); i++) {
+        if (holdsClassRefs(deDatatypeGetiTypeList(datatype, i), theClass)) {
+          return true;
+        }
+      }
+      return false;
+    default:
+      return false;
+  }
+}
+
+// Determine if the class has a data member, other than the ones relations
+// generate, that can hold a reference to theClass.
+static bool classHasUserRefs(deClass otherClass, deClass theClass) {
+  deVariable variable;
+  deForeachBlockVariable(deClassGetSubBlock(otherClass), variable) {
+    if (!deVariableGenerated(variable) &&
+        holdsClassRefs(deVariableGetDatatype(variable), theClass)) {
+      return true;
+    }
+  } deEndBlockVariable;
+  return false;
+}
+
+// Determine if the relation keeps its children in a hash table.
+static bool isHashedRelation(deRelation relation) {
+  char *name = deTransformerGetName(deRelationGetTransformer(relation));
+  return !strcmp(name, "Hashed") || !strcmp(name, "OpenHashed") || !strcmp(name, "HashedClass");
+}
+
+// Report an error if compacting the class would leave references it cannot
+// update: those in tuple and struct data members, and hash tables whose
+// children may be hashed by an index of the class, which would need rehashing.
+static void checkCompactable(deClass theClass, deLine line) {
+  char *name = deTemplateGetName(deClassGetTemplate(theClass));
+  deClass otherClass;
+  deForeachRootClass(deTheRoot, otherClass) {
+    if (!deClassBound(otherClass)) {
+      continue;
+    }
+    deVariable variable;
+    deForeachBlockVariable(deClassGetSubBlock(otherClass), variable) {
+      deDatatype datatype = deVariableGetDatatype(variable);
+      while (deDatatypeGetType(datatype) == DE_TYPE_ARRAY) {
+        datatype = deDatatypeGetElementType(datatype);
+      }
+      deDatatypeType type = deDatatypeGetType(datatype);
+      if ((type == DE_TYPE_TUPLE || type == DE_TYPE_STRUCT) &&
+          holdsClassRefs(datatype, theClass)) {
+        deError(line, "Cannot compact %s: data member %s holds references to it in a %s",
+            name, deVariableGetName(variable), type == DE_TYPE_TUPLE? "tuple" : "struct");
+      }
+    } deEndBlockVariable;
+  } deEndRootClass;
+  deTemplate templ;
+  deForeachRootTemplate(deTheRoot, templ) {
+    deRelation relation;
+    deForeachTemplateChildRelation(templ, relation) {
+      if (!isHashedRelation(relation)) {
+        continue;
+      }
+      deTemplate childTemplate = deRelationGetChildTemplate(relation);
+      bool keyedByClass = childTemplate == deClassGetTemplate(theClass) &&
+          !strcmp(deTransformerGetName(deRelationGetTransformer(relation)), "HashedClass");
+      deClass childClass;
+      deForeachTemplateClass(childTemplate, childClass) {
+        if (deClassBound(childClass) && classHasUserRefs(childClass, theClass)) {
+          keyedByClass = true;
+        }
+      } deEndTemplateClass;
+      if (keyedByClass) {
+        deError(line, "Cannot compact %s: %s objects in a %s relation may be hashed by "
+            "references to it", name, deTemplateGetName(childTemplate),
+            deTransformerGetName(deRelationGetTransformer(relation)));
+      }
+    } deEndTemplateChildRelation;
+  } deEndRootTemplate;
+}
+
+// Generate the class's compact function, and call it from Class.compact().
+static void addCompaction(deClass theClass) {
+  deFunction compactor = findCalledCompactor(deClassGetTemplate(theClass));
+  if (compactor == deFunctionNull) {
+    return;
+  }
+  checkCompactable(theClass, deFunctionGetLine(compactor));
+  deBlock rootBlock = deRootGetBlock(deTheRoot);
+  generateCompactString(theClass);
+  deGenerating = true;
+  deParseString(deStringVal, rootBlock);
+  deFunction compactFunc = deBlockGetLastFunction(rootBlock);
+  deSignature signature = deSignatureCreate(compactFunc, deDatatypeArrayAlloc(), 0);
   deSignatureSetInstantiated(signature, true);
   deSignatureSetReturnType(signature, deNoneDatatypeCreate());
   bindNewSignature(signature);
+  deBlock block = deFunctionGetSubBlock(compactor);
+  deLine line = deFunctionGetLine(compactor);
+  deStatement callStatement = deStatementCreate(block, DE_STATEMENT_CALL, line);
+  deGenerating = false;
+  deExpression funcExpr = deIdentExpressionCreate(deFunctionGetSym(compactFunc), line);
+  deExpression paramList = deExpressionCreate(DE_EXPR_LIST, line);
+  deExpression callExpr = deBinaryExpressionCreate(DE_EXPR_CALL, funcExpr, paramList, line);
+  deStatementInsertExpression(callStatement, callExpr);
+  deForeachFunctionSignature(compactor, signature) {
+    deQueueStatement(signature, callStatement, true);
+  } deEndFunctionSignature;
+  deBindAllSignatures();
+}
+
+// Generate the functions that free the objects of the class created in an
+// arena block, which are those from savedUsed on.  The final method, if any,
+// is called on the live ones first, for all classes, before any are released.
+// Objects freed inside the arena are unlinked from the free list, which the
+// allocator does not pop from in arenas, so the entries pushed since the arena
+// started are those before savedFirstFree.
+static void generateArenaReleaseString(deClass theClass) {
+  deStringPos = 0;
+  deBlock block = deClassGetSubBlock(theClass);
+  char *path = utAllocString(deGetBlockPath(block, true));
+  char *selfType = utAllocString(deDatatypeGetTypeString(deClassGetDatatype(theClass)));
+  uint32 refWidth = deClassGetRefWidth(theClass);
+  deSprintToString("appendcode {\n");
+  if (deTemplateHasFinalMethod(deClassGetTemplate(theClass))) {
+    // Finalizers can destroy other objects, which we then skip.
+    deSprintToString(
+        "  func %1$s_arenaFinalize(savedUsed, savedFirstFree) {\n"
+        "    used = %1$s_used\n"
+        "    isFree = [false]\n"
+        "    isFree.resize(used)\n"
+        "    head = %1$s_firstFree\n"
+        "    object = head\n"
+        "    while object != savedFirstFree {\n"
+        "      isFree[object] = true\n"
+        "      object = %1$s_nextFree[object]\n"
+        "    }\n"
+        "    for o = savedUsed, o < used, o += 1u%3$u {\n"
+        "      if !isFree[o] {\n"
+        "        obj = !<%2$s>o\n"
+        "        obj.final()\n"
+        "        object = %1$s_firstFree\n"
+        "        while object != head {\n"
+        "          if object < used {\n"
+        "            isFree[object] = true\n"
+        "          }\n"
+        "          object = %1$s_nextFree[object]\n"
+        "        }\n"
+        "        head = %1$s_firstFree\n"
+        "      }\n"
+        "    }\n"
+        "  }\n",
+        path, selfType, refWidth);
+  }
+  deSprintToString(
+      "  func %1$s_arenaRelease(savedUsed, savedFirstFree) {\n"
+      "    head = savedFirstFree\n"
+      "    object = %1$s_firstFree\n"
+      "    while object != savedFirstFree {\n"
+      "      next = %1$s_nextFree[object]\n"
+      "      if object < savedUsed {\n"
+      "        %1$s_nextFree[object] = head\n"
+      "        head = object\n"
+      "      }\n"
+      "      object = next\n"
+      "    }\n"
+      "    %1$s_firstFree = head\n"
+      "    for o = savedUsed, o < %1$s_used, o += 1u%2$u {\n",
+      path, refWidth);
+  if (deClassPacked(theClass)) {
+    deSprintToString("      %1$s_packed[o] = %2$s\n", path, packedDefaultValueString(theClass));
+  }
+  bool firstTime = true;
+  deVariable variable;
+  deForeachBlockVariable(block, variable) {
+    if (!firstTime && !deVariablePacked(variable)) {
+      char* zero = deDatatypeGetDefaultValueString(deVariableGetDatatype(variable));
+      deSprintToString("      %s = %s\n", fieldElementString(variable, "o"), zero);
+    }
+    firstTime = false;
+  } deEndBlockVariable;
+  deSprintToString(
+      "      %1$s_nextFree[o] = 0u%2$u\n"
+      "    }\n"
+      "    %1$s_used = savedUsed\n"
+      "  }\n"
+      "}\n",
+      path, refWidth);
+  utFree(selfType);
+  utFree(path);
+}
+
+// Add the functions arena blocks call to release the class's objects.  They
+// are bound when the expanded arena blocks calling them are.
+static void addArenaRelease(deClass theClass) {
+  generateArenaReleaseString(theClass);
+  deGenerating = true;
+  deParseString(deStringVal, deRootGetBlock(deTheRoot));
+  deGenerating = false;
+}
+
+// Add the arena depth, which is non-zero while arena blocks run.
+static void addArenaDepth(void) {
+  deStringPos = 0;
+  deSprintToString(
+      "prependcode {\n"
+      "  rune_arenaDepth = 0u32\n"
+      "}\n");
+  deBlock rootBlock = deRootGetBlock(deTheRoot);
+  deStatement originalFirstStatement = deBlockGetFirstStatement(rootBlock);
+  deGenerating = true;
+  deParseString(deStringVal, rootBlock);
+  deGenerating = false;
+  bindNewStatements(rootBlock, originalFirstStatement);
+  deBindAllSignatures();
+}
+
+// Generate the function that allocates n objects of the class at once, from
+// the end of its arrays, and returns the first.  The arrays grow at most once,
+// and the new objects' data members have their default values.  Objects of
+// reference counted classes start with no references, so the first relation
+// or variable holding one owns it.
+static void generateAllocateManyString(deClass theClass) {
+  deStringPos = 0;
+  deBlock block = deClassGetSubBlock(theClass);
+  char *path = utAllocString(deGetBlockPath(block, true));
+  uint32 refWidth = deClassGetRefWidth(theClass);
+  uint32 refCount = deTemplateRefCounted(deClassGetTemplate(theClass))? 0 : 1;
+  uint64 maxObjects = refWidth >= 64? ~(uint64)0 : ((uint64)1 << refWidth) - 1;
+  // Grow like the allocator does, up to the largest size references can index.
+  deSprintToString(
+      "appendcode {\n"
+      "  func %1$s_allocateMany(n: u64) -> u%2$u {\n"
+      "    first = %1$s_used\n"
+      "    if n > <u64>(%4$lluu%2$u - first) {\n"
+      "      panic \"Too many %3$s objects for u%2$u references: declare a wider class %3$s:u<width>\"\n"
+      "    }\n"
+      "    used = first + <u%2$u>n\n"
+      "    if used > %1$s_allocated {\n"
+      "      while %1$s_allocated < used {\n"
+      "        if %1$s_allocated == %5$lluu%2$u {\n"
+      "          %1$s_allocated = %4$lluu%2$u\n"
+      "        } else {\n"
+      "          %1$s_allocated <<= 1u%2$u\n"
+      "        }\n"
+      "      }\n",
+      path, refWidth, deTemplateGetName(deClassGetTemplate(theClass)),
+      (unsigned long long)maxObjects, (unsigned long long)(maxObjects / 2 + 1));
+  if (deClassPacked(theClass)) {
+    deSprintToString("      %1$s_packed.resize(%1$s_allocated)\n", path);
+  }
+  deVariable variable;
+  deForeachBlockVariable(block, variable) {
+    if (!deVariablePacked(variable)) {
+      deSprintToString("      %s\n", resizeFieldArrayString(variable,
+          utSprintf("%s_allocated", path), refWidth));
+    }
+  } deEndBlockVariable;
+  deSprintToString(
+      "    }\n"
+      "    for o = first, o < used, o += 1u%2$u {\n"
+      "      %1$s_nextFree[o] = %3$uu%2$u\n"
+      "    }\n"
+      "    %1$s_used = used\n"
+      "    return first\n"
+      "  }\n"
+      "}\n",
+      path, refWidth, refCount);
+  utFree(path);
+}
+
+// Find the template's allocateMany() helper, if the program calls createMany().
+static deFunction findCalledBulkAllocator(deTemplate templ) {
+  deBlock block = deFunctionGetSubBlock(deTemplateGetFunction(templ));
+  deIdent ident = deBlockFindIdent(block, utSymCreate("allocateMany"));
+  if (ident == deIdentNull || deIdentGetType(ident) != DE_IDENT_FUNCTION) {
+    return deFunctionNull;
+  }
+  deFunction function = deIdentGetFunction(ident);
+  if (!deFunctionBulkAllocator(function) ||
+      deFunctionGetFirstSignature(function) == deSignatureNull) {
+    return deFunctionNull;
+  }
+  return function;
+}
+
+// Generate the class's bulk allocator, and return its result from the
+// allocateMany() helper, in place of the placeholder.
+static void addBulkAllocation(deClass theClass) {
+  deFunction helper = findCalledBulkAllocator(deClassGetTemplate(theClass));
+  if (helper == deFunctionNull) {
+    return;
+  }
+  deBlock rootBlock = deRootGetBlock(deTheRoot);
+  generateAllocateManyString(theClass);
+  deGenerating = true;
+  deParseString(deStringVal, rootBlock);
+  deFunction allocateManyFunc = deBlockGetLastFunction(rootBlock);
+  deDatatypeArray parameterTypes = deDatatypeArrayAlloc();
+  deDatatypeArrayAppendDatatype(parameterTypes, deUintDatatypeCreate(64));
+  deSignature signature = deSignatureCreate(allocateManyFunc, parameterTypes, 0);
+  deSignatureSetInstantiated(signature, true);
+  deSignatureSetReturnType(signature, deUintDatatypeCreate(deClassGetRefWidth(theClass)));
+  bindNewSignature(signature);
+  deForeachFunctionSignature(helper, signature) {
+    deStatement statement = deBlockGetFirstStatement(deSignatureGetBlock(signature));
+    deExpression placeholder = deStatementGetExpression(statement);
+    utAssert(deStatementGetType(statement) == DE_STATEMENT_RETURN);
+    if (deExpressionGetType(placeholder) != DE_EXPR_CALL) {
+      deLine line = deStatementGetLine(statement);
+      deExpressionDestroy(placeholder);
+      deExpression funcExpr = deIdentExpressionCreate(deFunctionGetSym(allocateManyFunc), line);
+      deExpression paramList = deExpressionCreate(DE_EXPR_LIST, line);
+      deExpressionAppendExpression(paramList, deIdentExpressionCreate(utSymCreate("n"), line));
+      deExpression callExpr = deBinaryExpressionCreate(DE_EXPR_CALL, funcExpr, paramList, line);
+      deStatementInsertExpression(statement, callExpr);
+    }
+    deQueueStatement(signature, statement, true);
+  } deEndFunctionSignature;
+  deGenerating = false;
+  deBindAllSignatures();
+}
+
+// Add Class.createMany(n), which iterates over n new objects of the class, to
+// classes that do not define it:
+//
+//   for point in Point.createMany(n) {
+//     point.x = ...
+//   }
+//
+// The objects are allocated in one step by the allocateMany() helper, which
+// memory management fills in, and are consecutive, so the loop writes each
+// data member array sequentially.  Constructors are not called, so data
+// members start with their default values, and the class must also be
+// constructed somewhere to define them.  Template classes are not supported.
+void deAddBulkAllocators(void) {
+  utSym createSym = utSymCreate("createMany");
+  utSym allocateSym = utSymCreate("allocateMany");
+  deTemplate templ;
+  deForeachRootTemplate(deTheRoot, templ) {
+    deFunction constructor = deTemplateGetFunction(templ);
+    deBlock classBlock = deFunctionGetSubBlock(constructor);
+    if (deFunctionBuiltin(constructor) || deTemplateIsTemplate(templ) ||
+        deBlockFindIdent(classBlock, createSym) != deIdentNull ||
+        deBlockFindIdent(classBlock, allocateSym) != deIdentNull) {
+      continue;
+    }
+    deStringPos = 0;
+    deSprintToString(
+        "func allocateMany(n: u64) -> u%2$u {\n"
+        "  return 0u%2$u\n"
+        "}\n"
+        "iterator createMany(n: u64) {\n"
+        "  first = allocateMany(n)\n"
+        "  for i in range(n) {\n"
+        "    yield !<%1$s>(first + !<u%2$u>i)\n"
+        "  }\n"
+        "}\n",
+        deTemplateGetName(templ), deTemplateGetRefWidth(templ));
+    deGenerating = true;
+    deParseString(deStringVal, classBlock);
+    deGenerating = false;
+    deIdent ident = deBlockFindIdent(classBlock, allocateSym);
+    deFunctionSetBulkAllocator(deIdentGetFunction(ident), true);
+  } deEndRootTemplate;
 }
 
 // Find the template's destructor.
@@ -263,15 +1048,31 @@ void deCallFinalInDestructors(void) {
 
 // Add code to constructors to allocate a new object, and add variables in the
 // root block needed to manage object memory.  We use structure-of-array memory
-// layout, so there is a global array per data member of the class.
+// layout by default, so there is a global array per data member of the class.
+// Packed classes interleave their scalar data members in one array of tuples.
 void deAddMemoryManagement(void) {
+  deArenasUsed = deProgramUsesArenas();
+  if (deArenasUsed) {
+    addArenaDepth();
+  }
   deClass theClass;
   deForeachRootClass(deTheRoot, theClass) {
     if (deClassBound(theClass)) {
       allocateSelfInConstructor(theClass);
       freeSelfInDestructor(theClass);
       if (deTemplateRefCounted(deClassGetTemplate(theClass))) {
-        addRefAndUnref(theClass);
+        addUnref(theClass);
+      }
+    }
+  } deEndRootClass;
+  // Compaction updates references in every class, so do it once all classes
+  // have their arrays.
+  deForeachRootClass(deTheRoot, theClass) {
+    if (deClassBound(theClass)) {
+      addCompaction(theClass);
+      addBulkAllocation(theClass);
+      if (deArenasUsed) {
+        addArenaRelease(theClass);
       }
     }
   } deEndRootClass;
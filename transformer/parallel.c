@@ -0,0 +1,551 @@
+//  Copyright 2021 Google LLC.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Parallel for statements.  The iterations of
+//
+//   parallel for i in range(n) {
+//     a[i] = f(b[i])
+//   }
+//
+// or of 'parallel for node in Node', which visits every allocated Node, run
+// concurrently on the runtime's thread pool, so iterations must not write
+// anything another iteration reads or writes.  A body may write:
+//
+//   - Variables only used inside parallel for bodies.  These become locals of
+//     the outlined body, so each thread has its own.
+//   - a[i], where i is the loop variable of a range loop.
+//   - Data members of the loop variable of an object loop, like node.value,
+//     including through methods called on it, which may write self.<member>.
+//
+// Functions called from the body are checked with the same rules, where their
+// own locals and parameters are private, but module globals are shared.  Data
+// members and arrays the body writes may only be read through the loop
+// variable too, so an iteration never reads what another writes.  Resizing an
+// array, as append does, writes it.
+//
+// Each thread allocates arrays, strings and bigints from its own pools, but
+// reference counts and class allocators are not thread-safe, so bodies cannot
+// create or destroy objects, assign objects of reference counted classes, or
+// print.  Exceptions cannot propagate out of a body, so try statements are not
+// allowed in bodies, and exceptions raised in them are reported as uncaught.
+// Run this after iterators are inlined, so the code inlined into bodies is
+// checked.
+#include "de.h"
+
+// A function checked for being called from a parallel for body.  The same
+// function may be called with or without a self it can write.
+typedef struct {
+  deSignature signature;
+  bool ownsSelf;
+} deParallelCallee;
+
+static deVariable deParallelLoopVar;
+static bool deParallelOverObjects;
+// Set on the second pass, which checks reads of written locations.
+static bool deParallelCheckingReads;
+static deParallelCallee *deParallelCallees;
+static uint32 deNumParallelCallees, deParallelCalleesAllocated;
+// Data members and arrays written by the body, only readable through the loop variable.
+static deVariable *deParallelWritten;
+static uint32 deNumParallelWritten, deParallelWrittenAllocated;
+
+static void checkBlock(deBlock block, bool inCallee, bool ownsSelf);
+
+// Find the statement containing the expression.
+static deStatement findExpressionStatement(deExpression expression) {
+  deExpression parent = deExpressionGetExpression(expression);
+  while (parent != deExpressionNull) {
+    expression = parent;
+    parent = deExpressionGetExpression(expression);
+  }
+  return deExpressionGetStatement(expression);
+}
+
+// Determine if the statement is inside a parallel for statement, or is one.
+static bool statementInParallelFor(deStatement statement) {
+  while (statement != deStatementNull) {
+    if (deStatementGetType(statement) == DE_STATEMENT_FOREACH && deStatementParallel(statement)) {
+      return true;
+    }
+    statement = deBlockGetOwningStatement(deStatementGetBlock(statement));
+  }
+  return false;
+}
+
+// Determine if the variable is only used inside parallel for statements.
+static bool isParallelPrivate(deVariable variable) {
+  deIdent ident = deVariableGetIdent(variable);
+  if (deVariableGetType(variable) != DE_VAR_LOCAL || ident == deIdentNull) {
+    return false;
+  }
+  bool used = false;
+  deExpression expression;
+  deForeachIdentExpression(ident, expression) {
+    deStatement statement = findExpressionStatement(expression);
+    if (statement == deStatementNull || !statementInParallelFor(statement)) {
+      return false;
+    }
+    used = true;
+  } deEndIdentExpression;
+  return used;
+}
+
+// Mark the variables of the scope block used only in parallel for statements.
+static void markParallelPrivateVariables(deBlock scopeBlock) {
+  deVariable variable;
+  deForeachBlockVariable(scopeBlock, variable) {
+    if (deVariableInstantiated(variable) && isParallelPrivate(variable)) {
+      deVariableSetParallelPrivate(variable, true);
+    }
+  } deEndBlockVariable;
+}
+
+// Return the variable the expression names, if it is an identifier.
+static deVariable findIdentVariable(deExpression expression) {
+  if (deExpressionGetType(expression) != DE_EXPR_IDENT) {
+    return deVariableNull;
+  }
+  deIdent ident = deExpressionGetIdent(expression);
+  if (ident == deIdentNull || deIdentGetType(ident) != DE_IDENT_VARIABLE) {
+    return deVariableNull;
+  }
+  return deIdentGetVariable(ident);
+}
+
+// Determine if the variable is a module or package global.
+static bool isGlobalVariable(deVariable variable) {
+  if (deVariableGetType(variable) == DE_VAR_PARAMETER) {
+    return false;
+  }
+  deFunctionType type = deFunctionGetType(deBlockGetOwningFunction(deVariableGetBlock(variable)));
+  return type == DE_FUNC_MODULE || type == DE_FUNC_PACKAGE;
+}
+
+// Determine if the datatype is a reference counted class.
+static bool isRefCountedClass(deDatatype datatype) {
+  return datatype != deDatatypeNull && deDatatypeGetType(datatype) == DE_TYPE_CLASS &&
+      deTemplateRefCounted(deClassGetTemplate(deDatatypeGetClass(datatype)));
+}
+
+// Determine if the expression refers to the object the current iteration owns:
+// the loop variable of an object loop, or self in a method called on it.
+static bool isOwnedObject(deExpression expression, bool inCallee, bool ownsSelf) {
+  deVariable variable = findIdentVariable(expression);
+  if (variable == deVariableNull) {
+    return false;
+  }
+  if (!inCallee) {
+    return deParallelOverObjects && variable == deParallelLoopVar;
+  }
+  return ownsSelf && deVariableGetType(variable) == DE_VAR_PARAMETER &&
+      deVariableGetSym(variable) == utSymCreate("self");
+}
+
+// Determine if the expression is the loop variable of a range loop, in the body.
+static bool isRangeLoopIndex(deExpression expression, bool inCallee) {
+  return !inCallee && !deParallelOverObjects &&
+      findIdentVariable(expression) == deParallelLoopVar;
+}
+
+// Record that the body writes the data member or array variable.
+static void addWrittenVariable(deVariable variable) {
+  for (uint32 i = 0; i < deNumParallelWritten; i++) {
+    if (deParallelWritten[i] == variable) {
+      return;
+    }
+  }
+  if (deNumParallelWritten == deParallelWrittenAllocated) {
+    deParallelWrittenAllocated <<= 1;
+    utResizeArray(deParallelWritten, deParallelWrittenAllocated);
+  }
+  deParallelWritten[deNumParallelWritten++] = variable;
+}
+
+// Determine if the body writes the data member or array variable.
+static bool variableIsWritten(deVariable variable) {
+  for (uint32 i = 0; i < deNumParallelWritten; i++) {
+    if (deParallelWritten[i] == variable) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Return the data member a dot expression on an object accesses, or deVariableNull.
+static deVariable findDataMember(deExpression dotExpr) {
+  deExpression left = deExpressionGetFirstExpression(dotExpr);
+  if (deDatatypeGetType(deExpressionGetDatatype(left)) != DE_TYPE_CLASS) {
+    return deVariableNull;
+  }
+  return findIdentVariable(deExpressionGetNextExpression(left));
+}
+
+// Determine if iterations may write the location, recording the data members
+// and arrays written.
+static bool isWritable(deExpression access, bool inCallee, bool ownsSelf) {
+  switch (deExpressionGetType(access)) {
+    case DE_EXPR_IDENT: {
+      deVariable variable = findIdentVariable(access);
+      if (variable == deVariableNull) {
+        return false;
+      }
+      if (inCallee) {
+        return !isGlobalVariable(variable);
+      }
+      return deVariableParallelPrivate(variable);
+    }
+    case DE_EXPR_DOT: {
+      deExpression left = deExpressionGetFirstExpression(access);
+      deVariable member = findDataMember(access);
+      if (member == deVariableNull) {
+        return isWritable(left, inCallee, ownsSelf);  // A tuple or struct member.
+      }
+      if (!isOwnedObject(left, inCallee, ownsSelf)) {
+        return false;
+      }
+      addWrittenVariable(member);
+      return true;
+    }
+    case DE_EXPR_INDEX: {
+      deExpression left = deExpressionGetFirstExpression(access);
+      if (isWritable(left, inCallee, ownsSelf)) {
+        return true;
+      }
+      if (!isRangeLoopIndex(deExpressionGetNextExpression(left), inCallee)) {
+        return false;
+      }
+      deVariable array = findIdentVariable(left);
+      if (array != deVariableNull) {
+        addWrittenVariable(array);
+      } else if (deExpressionGetType(left) == DE_EXPR_DOT && findDataMember(left) != deVariableNull) {
+        addWrittenVariable(findDataMember(left));
+      } else {
+        return false;
+      }
+      return true;
+    }
+    case DE_EXPR_NOTNULL:
+      return isWritable(deExpressionGetFirstExpression(access), inCallee, ownsSelf);
+    default:
+      return false;
+  }
+}
+
+// Report an error if the assignment writes a location other iterations may access.
+static void checkWrite(deExpression expression, deExpression access, bool inCallee,
+    bool ownsSelf) {
+  if (!inCallee && findIdentVariable(access) == deParallelLoopVar) {
+    // The loop variable is private, but each iteration owns only its own index or object.
+    deExprError(expression, "Parallel for bodies cannot assign loop variable %s",
+        deVariableGetName(deParallelLoopVar));
+  }
+  if (deExpressionGetType(access) == DE_EXPR_DOT) {
+    // Bit-packed members of several objects share each byte, so writes race.
+    deVariable member = findDataMember(access);
+    if (member != deVariableNull && deVariableGetPackedBits(member) != 0) {
+      deExprError(expression, "Parallel for bodies cannot write bit-packed data member %s, "
+          "unless compiled with -bytefields", deVariableGetName(member));
+    }
+  }
+  if (!isWritable(access, inCallee, ownsSelf)) {
+    deExprError(expression, "Parallel for bodies may only write private variables, "
+        "array elements indexed by the loop variable, and data members of the loop's object");
+  }
+}
+
+// Determine if the builtin method modifies or grows its array or string.
+static bool isMutatingBuiltin(deBuiltinFuncType type) {
+  switch (type) {
+    case DE_BUILTINFUNC_ARRAYRESIZE:
+    case DE_BUILTINFUNC_ARRAYRESERVE:
+    case DE_BUILTINFUNC_ARRAYAPPEND:
+    case DE_BUILTINFUNC_ARRAYCONCAT:
+    case DE_BUILTINFUNC_ARRAYREVERSE:
+    case DE_BUILTINFUNC_ARRAYSTOREVECTOR:
+    case DE_BUILTINFUNC_STRINGRESIZE:
+    case DE_BUILTINFUNC_STRINGAPPEND:
+    case DE_BUILTINFUNC_STRINGCONCAT:
+    case DE_BUILTINFUNC_STRINGREVERSE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Check a function called from a parallel for body, once per signature.
+static void checkCallee(deExpression expression, deSignature signature, bool ownsSelf) {
+  deFunction function = deSignatureGetFunction(signature);
+  deFunctionType type = deFunctionGetType(function);
+  if (type == DE_FUNC_CONSTRUCTOR || type == DE_FUNC_DESTRUCTOR) {
+    deExprError(expression, "Parallel for bodies cannot create or destroy objects");
+  }
+  if (deFunctionGetLinkage(function) == DE_LINK_EXTERN_C) {
+    return;
+  }
+  for (uint32 i = 0; i < deNumParallelCallees; i++) {
+    deParallelCallee *callee = deParallelCallees + i;
+    if (callee->signature == signature && callee->ownsSelf == ownsSelf) {
+      return;
+    }
+  }
+  if (deNumParallelCallees == deParallelCalleesAllocated) {
+    deParallelCalleesAllocated <<= 1;
+    utResizeArray(deParallelCallees, deParallelCalleesAllocated);
+  }
+  deParallelCallees[deNumParallelCallees].signature = signature;
+  deParallelCallees[deNumParallelCallees].ownsSelf = ownsSelf;
+  deNumParallelCallees++;
+  checkBlock(deSignatureGetBlock(signature), true, ownsSelf);
+}
+
+// Check a call from a parallel for body.  Arguments passed to var parameters
+// are written.
+static void checkCall(deExpression expression, bool inCallee, bool ownsSelf) {
+  deExpression access = deExpressionGetFirstExpression(expression);
+  deDatatype callType = deExpressionGetDatatype(access);
+  if (deDatatypeGetType(callType) == DE_TYPE_FUNCTION &&
+      deFunctionBuiltin(deDatatypeGetFunction(callType))) {
+    if (!deParallelCheckingReads &&
+        isMutatingBuiltin(deFunctionGetBuiltinType(deDatatypeGetFunction(callType)))) {
+      // Resizing an array or string writes it.
+      checkWrite(expression, deExpressionGetFirstExpression(access), inCallee, ownsSelf);
+    }
+    return;
+  }
+  deSignature signature = deExpressionGetSignature(expression);
+  if (signature == deSignatureNull) {
+    if (deDatatypeGetType(callType) == DE_TYPE_FUNCPTR) {
+      deExprError(expression, "Parallel for bodies cannot call through function pointers");
+    }
+    return;
+  }
+  if (deSignatureIsStruct(signature)) {
+    return;
+  }
+  bool calleeOwnsSelf = deExpressionIsMethodCall(access) &&
+      isOwnedObject(deExpressionGetFirstExpression(access), inCallee, ownsSelf);
+  if (!deParallelCheckingReads) {
+    deExpression parameters = deExpressionGetNextExpression(access);
+    deExpression argument;
+    deForeachExpressionExpression(parameters, argument) {
+      deParamspec paramspec = deSignatureGetiParamspec(signature,
+          deExpressionGetSignaturePos(argument));
+      deVariable param = deParamspecGetVariable(paramspec);
+      if (param != deVariableNull && !deVariableConst(param)) {
+        if (deExpressionGetType(argument) == DE_EXPR_NAMEDPARAM) {
+          argument = deExpressionGetLastExpression(argument);
+        }
+        checkWrite(expression, argument, inCallee, ownsSelf);
+      }
+    } deEndExpressionExpression;
+  }
+  checkCallee(expression, signature, calleeOwnsSelf);
+}
+
+// On the second pass, report reads of data members and arrays the body
+// writes, other than through the loop variable.
+static void checkRead(deExpression expression, bool inCallee, bool ownsSelf) {
+  deExpressionType type = deExpressionGetType(expression);
+  if (type == DE_EXPR_DOT) {
+    deVariable member = findDataMember(expression);
+    if (member != deVariableNull && variableIsWritten(member) &&
+        !isOwnedObject(deExpressionGetFirstExpression(expression), inCallee, ownsSelf)) {
+      deExprError(expression, "Parallel for body reads data member %s of other objects, "
+          "which other iterations write", deVariableGetName(member));
+    }
+  } else if (type == DE_EXPR_IDENT) {
+    deVariable variable = findIdentVariable(expression);
+    if (variable != deVariableNull && variableIsWritten(variable)) {
+      deExpression parent = deExpressionGetExpression(expression);
+      if (parent == deExpressionNull || deExpressionGetType(parent) != DE_EXPR_INDEX ||
+          deExpressionGetFirstExpression(parent) != expression ||
+          !isRangeLoopIndex(deExpressionGetNextExpression(expression), inCallee)) {
+        deExprError(expression, "Parallel for body reads elements of %s other iterations write",
+            deVariableGetName(variable));
+      }
+    }
+  }
+}
+
+// Check an expression in a parallel for body, or in a function it calls.
+static void checkExpression(deExpression expression, bool inCallee, bool ownsSelf) {
+  if (deExpressionIsType(expression)) {
+    return;
+  }
+  deExpressionType type = deExpressionGetType(expression);
+  if (deParallelCheckingReads) {
+    checkRead(expression, inCallee, ownsSelf);
+  } else if (type == DE_EXPR_EQUALS ||
+      (type >= DE_EXPR_ADD_EQUALS && type <= DE_EXPR_MULTRUNC_EQUALS)) {
+    if (isRefCountedClass(deExpressionGetDatatype(expression))) {
+      deExprError(expression, "Parallel for bodies cannot assign reference counted objects");
+    }
+    checkWrite(expression, deExpressionGetFirstExpression(expression), inCallee, ownsSelf);
+  }
+  if (type == DE_EXPR_CALL) {
+    checkCall(expression, inCallee, ownsSelf);
+  } else if (deExpressionGetSignature(expression) != deSignatureNull) {
+    checkCallee(expression, deExpressionGetSignature(expression), false);  // An overloaded operator.
+  }
+  deExpression child;
+  deForeachExpressionExpression(expression, child) {
+    checkExpression(child, inCallee, ownsSelf);
+  } deEndExpressionExpression;
+}
+
+// Check the statements of a parallel for body, or of a function it calls.
+static void checkBlock(deBlock block, bool inCallee, bool ownsSelf) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (!deStatementInstantiated(statement)) {
+      continue;
+    }
+    deLine line = deStatementGetLine(statement);
+    switch (deStatementGetType(statement)) {
+      case DE_STATEMENT_PRINT:
+        deError(line, "Parallel for bodies cannot print");
+        break;
+      case DE_STATEMENT_TRY:
+        deError(line, "Exceptions cannot be caught in parallel for bodies");
+        break;
+      case DE_STATEMENT_RETURN:
+        if (!inCallee) {
+          deError(line, "Parallel for bodies cannot return");
+        }
+        break;
+      case DE_STATEMENT_YIELD:
+      case DE_STATEMENT_FOREACH:
+        deError(line, "Parallel for bodies cannot contain coroutines or nested parallel for loops");
+        break;
+      case DE_STATEMENT_REF:
+      case DE_STATEMENT_UNREF:
+        deError(line, "Parallel for bodies cannot update reference counts");
+        break;
+      default:
+        break;
+    }
+    deExpression expression = deStatementGetExpression(statement);
+    if (expression != deExpressionNull) {
+      checkExpression(expression, inCallee, ownsSelf);
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull) {
+      checkBlock(subBlock, inCallee, ownsSelf);
+    }
+  } deEndBlockStatement;
+}
+
+// Check the loop of a parallel for statement: range(n) or range(first, last)
+// over integers of up to 64 bits, or a class.
+static void checkParallelLoop(deStatement statement) {
+  deExpression assignment = deStatementGetExpression(statement);
+  deExpression access = deExpressionGetFirstExpression(assignment);
+  deExpression value = deExpressionGetNextExpression(access);
+  deParallelLoopVar = findIdentVariable(access);
+  utAssert(deParallelLoopVar != deVariableNull);
+  if (!deVariableParallelPrivate(deParallelLoopVar)) {
+    deExprError(assignment, "Parallel for loop variable %s cannot be used outside the loop",
+        deVariableGetName(deParallelLoopVar));
+  }
+  deDatatype datatype = deVariableGetDatatype(deParallelLoopVar);
+  if (deDatatypeGetType(datatype) == DE_TYPE_CLASS) {
+    deParallelOverObjects = true;
+    // Objects cannot be freed during the loop, so the loop variable need not
+    // hold a reference.
+    deVariableSetBorrowed(deParallelLoopVar, true);
+    return;
+  }
+  deParallelOverObjects = false;
+  if (!deIsRangeCall(value)) {
+    deExprError(assignment, "Parallel for loops must iterate over range(...) or a class");
+  }
+  deExpression parameters = deExpressionGetNextExpression(deExpressionGetFirstExpression(value));
+  if (deExpressionCountExpressions(parameters) > 2) {
+    deExprError(assignment, "Parallel for loops over ranges cannot have a step");
+  }
+  deDatatypeType type = deDatatypeGetType(datatype);
+  if ((type != DE_TYPE_UINT && type != DE_TYPE_INT) || deDatatypeGetWidth(datatype) > 64) {
+    deExprError(assignment, "Parallel for loops over ranges must use integers of up to 64 bits");
+  }
+}
+
+// Check the parallel for statement.
+static void checkParallelStatement(deStatement statement) {
+  checkParallelLoop(statement);
+  deBlock body = deStatementGetSubBlock(statement);
+  deNumParallelWritten = 0;
+  deNumParallelCallees = 0;
+  deParallelCheckingReads = false;
+  checkBlock(body, false, false);
+  deNumParallelCallees = 0;
+  deParallelCheckingReads = true;
+  checkBlock(body, false, false);
+}
+
+// Check the parallel for statements in the block.  Nested ones are reported by
+// checkBlock.
+static void checkBlockParallelStatements(deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (deStatementInstantiated(statement) && deStatementParallel(statement)) {
+      checkParallelStatement(statement);
+    } else {
+      deBlock subBlock = deStatementGetSubBlock(statement);
+      if (subBlock != deBlockNull) {
+        checkBlockParallelStatements(subBlock);
+      }
+    }
+  } deEndBlockStatement;
+}
+
+// Determine if the block contains a parallel for statement.
+static bool blockHasParallelStatements(deBlock block) {
+  deStatement statement;
+  deForeachBlockStatement(block, statement) {
+    if (deStatementParallel(statement)) {
+      return true;
+    }
+    deBlock subBlock = deStatementGetSubBlock(statement);
+    if (subBlock != deBlockNull && blockHasParallelStatements(subBlock)) {
+      return true;
+    }
+  } deEndBlockStatement;
+  return false;
+}
+
+// Mark variables private to parallel for statements, and check the statements
+// follow the rules above.
+void deCheckParallelStatements(void) {
+  deParallelCalleesAllocated = 16;
+  deParallelCallees = utNewA(deParallelCallee, deParallelCalleesAllocated);
+  deParallelWrittenAllocated = 16;
+  deParallelWritten = utNewA(deVariable, deParallelWrittenAllocated);
+  deBlock rootBlock = deRootGetBlock(deTheRoot);
+  if (blockHasParallelStatements(rootBlock)) {
+    markParallelPrivateVariables(rootBlock);
+    checkBlockParallelStatements(rootBlock);
+  }
+  deSignature signature;
+  deForeachRootSignature(deTheRoot, signature) {
+    if (deSignatureInstantiated(signature)) {
+      deBlock block = deSignatureGetBlock(signature);
+      if (block != rootBlock && blockHasParallelStatements(block)) {
+        markParallelPrivateVariables(block);
+        checkBlockParallelStatements(block);
+      }
+    }
+  } deEndRootSignature;
+  utFree(deParallelCallees);
+  utFree(deParallelWritten);
+}
@@ -17,6 +17,69 @@
 
 deRelation deCurrentRelation;
 
+// Expanded identifier symbols, memoized while a transformer runs.  Expansion
+// only depends on the transformer's variables, so this is cleared whenever one
+// is assigned.  The blocks a transformer appends repeat the same few
+// identifiers, such as $parentLabel$childClass, so most lookups hit.
+typedef struct {
+  utSym oldSym;
+  utSym newSym;
+} deExpandedSym;
+
+static deExpandedSym *deExpandedSyms;
+static uint32 deExpandedSymTableSize, deNumExpandedSyms;
+
+// Forget all memoized symbol expansions.
+static void clearExpandedSyms(void) {
+  if (deNumExpandedSyms != 0) {
+    memset(deExpandedSyms, 0, deExpandedSymTableSize * sizeof(deExpandedSym));
+    deNumExpandedSyms = 0;
+  }
+}
+
+// Free the memoized symbol expansions.
+static void freeExpandedSyms(void) {
+  if (deExpandedSyms != NULL) {
+    utFree(deExpandedSyms);
+  }
+  deExpandedSyms = NULL;
+  deExpandedSymTableSize = deNumExpandedSyms = 0;
+}
+
+// Return the slot for |oldSym| in the open addressed table.
+static deExpandedSym *findExpandedSymSlot(utSym oldSym) {
+  char *name = utSymGetName(oldSym);
+  uint32 mask = deExpandedSymTableSize - 1;
+  uint32 slot = utHashData(name, strlen(name)) & mask;
+  while (deExpandedSyms[slot].oldSym != utSymNull && deExpandedSyms[slot].oldSym != oldSym) {
+    slot = (slot + 1) & mask;
+  }
+  return deExpandedSyms + slot;
+}
+
+// Memoize the expansion of |oldSym|, keeping the table at most half full.
+static void addExpandedSym(utSym oldSym, utSym newSym) {
+  if ((deNumExpandedSyms + 1) << 1 > deExpandedSymTableSize) {
+    deExpandedSym *oldTable = deExpandedSyms;
+    uint32 oldSize = deExpandedSymTableSize;
+    deExpandedSymTableSize = oldSize == 0? 256 : oldSize << 1;
+    deExpandedSyms = utNewA(deExpandedSym, deExpandedSymTableSize);
+    memset(deExpandedSyms, 0, deExpandedSymTableSize * sizeof(deExpandedSym));
+    for (uint32 i = 0; i < oldSize; i++) {
+      if (oldTable[i].oldSym != utSymNull) {
+        *findExpandedSymSlot(oldTable[i].oldSym) = oldTable[i];
+      }
+    }
+    if (oldTable != NULL) {
+      utFree(oldTable);
+    }
+  }
+  deExpandedSym *entry = findExpandedSymSlot(oldSym);
+  entry->oldSym = oldSym;
+  entry->newSym = newSym;
+  deNumExpandedSyms++;
+}
+
 // Dump the transformer to stdout.
 void deDumpTransformer(deTransformer transformer) {
   dePrintIndent();
@@ -30,6 +93,7 @@ void deDumpTransformer(deTransformer transformer) {
 
 // Set the value of a variable, freeing any existing value first.
 static void setVariableValue(deVariable variable, deValue value) {
+  clearExpandedSyms();
   deValue oldValue = deVariableGetValue(variable);
   if (oldValue != deValueNull) {
     deValueDestroy(oldValue);
@@ -311,18 +375,29 @@ static char *expandText(deBlock scopeBlock, char *oldText, deLine line) {
   return NULL;  // Dummy return.
 }
 
-// Expand a symbol.
+// Expand a symbol.  Symbols without a $ expand to themselves.
 static utSym expandSym(deBlock scopeBlock, utSym oldSym, deLine line) {
   char *oldName = utSymGetName(oldSym);
-  char *result = expandText(scopeBlock, oldName, line);
-  if (result == oldName) {
+  if (strchr(oldName, '$') == NULL) {
     return oldSym;
   }
-  return utSymCreate(result);
+  if (deExpandedSymTableSize != 0) {
+    deExpandedSym *entry = findExpandedSymSlot(oldSym);
+    if (entry->oldSym == oldSym) {
+      return entry->newSym;
+    }
+  }
+  char *result = expandText(scopeBlock, oldName, line);
+  utSym newSym = result == oldName? oldSym : utSymCreate(result);
+  addExpandedSym(oldSym, newSym);
+  return newSym;
 }
 
 // Expand a string.
 static deString expandString(deBlock scopeBlock, deString string, deLine line) {
+  if (strchr(deStringGetCstr(string), '$') == NULL) {
+    return string;
+  }
   char *result = expandText(scopeBlock, deStringGetCstr(string), line);
   if (!strcmp(result, deStringGetCstr(string))) {
     return string;
@@ -614,6 +689,23 @@ static void executeAssignmentStatement(deBlock scopeBlock, deStatement statement
   setVariableValue(variable, value);
 }
 
+// Execute a raise statement, which reports its message as a compile time
+// error, such as for an unsupported transformer parameter.
+static void executeRaiseStatement(deBlock scopeBlock, deStatement statement) {
+  deExpression expression = deStatementGetExpression(statement);
+  deExpression messageExpr = deExpressionGetNextExpression(
+      deExpressionGetFirstExpression(expression));
+  deLine line = deStatementGetLine(statement);
+  char *message = "Error raised in transformer";
+  if (messageExpr != deExpressionNull) {
+    deValue value = deEvaluateExpression(scopeBlock, messageExpr, deBigintNull);
+    if (deValueGetType(value) == DE_TYPE_STRING) {
+      message = deStringGetCstr(deValueGetStringVal(value));
+    }
+  }
+  deError(line, "%s", message);
+}
+
 // Execute the statement.
 static void executeStatement(deBlock scopeBlock, deStatement statement) {
   deStatement savedStatement = deCurrentStatement;
@@ -632,6 +724,9 @@ static void executeStatement(deBlock scopeBlock, deStatement statement) {
     case DE_STATEMENT_ASSIGN:
       executeAssignmentStatement(scopeBlock, statement);
       break;
+    case DE_STATEMENT_RAISE:
+      executeRaiseStatement(scopeBlock, statement);
+      break;
     default:
       deError(deStatementGetLine(statement),
               "Unsupported statement type in transformer");
@@ -657,6 +752,7 @@ static void executeTransformer(deBlock moduleBlock, deTransformer transformer,
   deGenerating = true;
   deBlock block = deTransformerGetSubBlock(transformer);
   executeBlockStatements(block, block);
+  freeExpandedSyms();
   deGenerating = false;
 }
 